@@ -8,6 +8,7 @@
 #include <sstream>
 #include "tendisplus/cluster/cluster_manager.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/storage/key_counter.h"
 #include "tendisplus/storage/varint.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/redis_port.h"
@@ -4542,24 +4543,8 @@ uint64_t ClusterManager::countKeysInSlot(uint32_t slot) {
   if (!expdb.ok()) {
     return 0;
   }
-  auto kvstore = std::move(expdb.value().store);
-  auto ptxn = kvstore->createTransaction(nullptr);
-  INVARIANT_D(ptxn.ok());
-  auto slotCursor = std::move(ptxn.value()->createSlotCursor(slot));
-
-  uint64_t keyNum = 0;
-  while (true) {
-    Expected<Record> expRcd = slotCursor->next();
-    if (expRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-      break;
-    }
-    if (!expRcd.ok()) {
-      LOG(ERROR) << "get slot cursor error:" << expRcd.status().toString();
-      return keyNum;
-    }
-    keyNum++;
-  }
-  return keyNum;
+  int64_t keyNum = expdb.value().store->getKeyCounter()->slotKeys(slot);
+  return keyNum > 0 ? keyNum : 0;
 }
 
 std::vector<std::string> ClusterManager::getKeyBySlot(uint32_t slot,
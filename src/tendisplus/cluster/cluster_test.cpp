@@ -2239,8 +2239,8 @@ TEST(Cluster, MigrateTTLIndex) {
   std::this_thread::sleep_for(12s);
 
   dbsize = work2.getIntResult({"dbsize", "containexpire", "containsubkey"});
-  // RT_LIST_META and RT_LIST_ELE will be deleted.
-  EXPECT_EQ(dbsize.value(), numData);
+  // the strings, RT_LIST_META and RT_LIST_ELE will be deleted.
+  EXPECT_EQ(dbsize.value(), 0);
 
   dbsize = work2.getIntResult({"dbsize"});
   // all is expired.
@@ -2,7 +2,9 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <algorithm>
 #include <utility>
+#include <vector>
 #include "glog/logging.h"
 #include "tendisplus/cluster/gc_manager.h"
 #include "tendisplus/commands/command.h"
@@ -11,7 +13,8 @@ namespace tendisplus {
 
 GCManager::GCManager(std::shared_ptr<ServerEntry> svr)
   : _svr(svr),
-    _cstate(svr->getClusterMgr()->getClusterState()),
+    _cstate(svr->getClusterMgr() ? svr->getClusterMgr()->getClusterState()
+                                 : nullptr),
     _isRunning(false),
     _gcDeleterMatrix(std::make_shared<PoolMatrix>()) {
   _svr->getParams()
@@ -30,6 +33,7 @@ Status GCManager::startup() {
     return s;
   }
   _isRunning.store(true, std::memory_order_relaxed);
+  _nextRescanTime = SCLOCK::now();
 
   _controller =
     std::make_unique<std::thread>(std::move([this]() { controlRoutine(); }));
@@ -52,6 +56,15 @@ Status GCManager::stopStoreTask(uint32_t storeid) {
       iter->_nextSchedTime = SCLOCK::time_point::max();
     }
   }
+  // the running ones stop when they find the store closed, and the
+  // GCIndex records are rescanned after the store reopens
+  for (auto it = _reclaimKeyTask.begin(); it != _reclaimKeyTask.end();) {
+    if (it->first.first == storeid && !it->second->_isRunning) {
+      it = _reclaimKeyTask.erase(it);
+    } else {
+      ++it;
+    }
+  }
   return {ErrorCodes::ERR_OK, ""};
 }
 
@@ -60,6 +73,11 @@ void GCManager::controlRoutine() {
     bool doSth = false;
     auto now = SCLOCK::now();
     doSth = gcSchedule(now) || doSth;
+    doSth = reclaimSchedule(now) || doSth;
+    if (now >= _nextRescanTime) {
+      rescanGCIndex();
+      _nextRescanTime = SCLOCK::now() + chrono::seconds(60);
+    }
     if (doSth) {
       std::this_thread::yield();
     } else {
@@ -94,6 +112,9 @@ SlotsBitmap GCManager::getCheckList() {
  *  delete slots one by one or delete at once after check finish
  */
 Status GCManager::delGarbage() {
+  if (!_cstate) {
+    return {ErrorCodes::ERR_CLUSTER, "cluster not enabled"};
+  }
   /* only master node should be check */
   if (!_cstate->isMyselfMaster()) {
     return {ErrorCodes::ERR_CLUSTER, "not master"};
@@ -404,6 +425,247 @@ Status DeleteRangeTask::deleteSlotRange() {
   return {ErrorCodes::ERR_OK, ""};
 }
 
+void GCManager::reclaimKey(uint32_t storeid, const GCIndex& index) {
+  std::lock_guard<myMutex> lk(_mutex);
+  auto key = std::make_pair(storeid, index.encode());
+  auto it = _reclaimKeyTask.find(key);
+  if (it != _reclaimKeyTask.end()) {
+    it->second->_again = true;
+    return;
+  }
+  auto task = std::make_shared<ReclaimKeyTask>(storeid, index, _svr);
+  task->_nextSchedTime = SCLOCK::now();
+  _reclaimKeyTask.emplace(std::move(key), std::move(task));
+}
+
+bool GCManager::reclaimSchedule(const SCLOCK::time_point& now) {
+  bool doSth = false;
+  std::lock_guard<myMutex> lk(_mutex);
+  for (auto it = _reclaimKeyTask.begin(); it != _reclaimKeyTask.end();) {
+    auto& task = it->second;
+    if (task->_isRunning || now < task->_nextSchedTime) {
+      ++it;
+      continue;
+    }
+    if (task->_state == DeleteRangeState::SUCC) {
+      it = _reclaimKeyTask.erase(it);
+      continue;
+    }
+    doSth = true;
+    task->_isRunning = true;
+    task->_state = DeleteRangeState::START;
+    _gcDeleter->schedule(
+      [this, iter = task.get()]() { reclaimKeyDelete(iter); });
+    ++it;
+  }
+  return doSth;
+}
+
+void GCManager::reclaimKeyDelete(ReclaimKeyTask* task) {
+  auto s = task->reclaimKey();
+  std::lock_guard<myMutex> lk(_mutex);
+  if (task->_again) {
+    task->_again = false;
+    task->_state = DeleteRangeState::START;
+    task->_nextSchedTime = SCLOCK::now();
+  } else if (!s.ok()) {
+    LOG(WARNING) << "reclaim key:" << hexlify(task->_index.getPriKey())
+                 << " storeid:" << task->_storeid
+                 << " failed:" << s.toString();
+    task->_state = DeleteRangeState::ERR;
+    task->_nextSchedTime = SCLOCK::now() + chrono::seconds(10);
+  } else {
+    task->_state = DeleteRangeState::SUCC;
+    task->_nextSchedTime = SCLOCK::now();
+  }
+  task->_isRunning = false;
+}
+
+void GCManager::rescanGCIndex() {
+  LocalSessionGuard sg(_svr.get());
+  for (uint32_t i = 0; i < _svr->getKVStoreCount(); i++) {
+    auto expdb =
+      _svr->getSegmentMgr()->getDb(sg.getSession(), i, mgl::LockMode::LOCK_IS);
+    if (!expdb.ok()) {
+      continue;
+    }
+    PStore kvstore = expdb.value().store;
+    if (!kvstore->isOpen() ||
+        kvstore->getMode() != KVStore::StoreMode::READ_WRITE) {
+      continue;
+    }
+    auto ptxn = kvstore->createTransaction(sg.getSession());
+    if (!ptxn.ok()) {
+      LOG(WARNING) << "rescan gcindex storeid:" << i
+                   << " failed:" << ptxn.status().toString();
+      continue;
+    }
+    auto cursor = ptxn.value()->createGCIndexCursor();
+    while (true) {
+      auto eIndex = cursor->next();
+      if (eIndex.status().code() == ErrorCodes::ERR_EXHAUST) {
+        break;
+      }
+      if (!eIndex.ok()) {
+        LOG(WARNING) << "rescan gcindex storeid:" << i
+                     << " failed:" << eIndex.status().toString();
+        break;
+      }
+      reclaimKey(i, eIndex.value());
+    }
+  }
+}
+
+// delete the subkeys of the lazily deleted versions in batches, every batch
+// is a txn under the keylock, so the key is not blocked for long
+Status ReclaimKeyTask::reclaimKey() {
+  auto expdb =
+    _svr->getSegmentMgr()->getDb(nullptr, _storeid, mgl::LockMode::LOCK_NONE);
+  RET_IF_ERR_EXPECTED(expdb);
+  PStore kvstore = expdb.value().store;
+  LocalSessionGuard sg(_svr.get());
+  auto sess = sg.getSession();
+  const auto& params = _svr->getParams();
+
+  const uint32_t chunkId = _index.getChunkId();
+  const uint32_t dbId = _index.getDbId();
+  const std::string& pk = _index.getPriKey();
+  const RecordKey indexRk = _index.getRecordKey();
+  const RecordKey mk(chunkId, dbId, RecordType::RT_DATA_META, pk, "");
+
+  // the index value the reclaiming begins with, the index is deleted only
+  // if it's not changed by another lazy delete
+  std::string indexValue;
+  bool restart = true;
+  std::vector<RecordType> eleTypes;
+  size_t typeIdx = 0;
+  std::string resume;
+  uint64_t total = 0;
+  while (true) {
+    if (!kvstore->isOpen() ||
+        kvstore->getMode() != KVStore::StoreMode::READ_WRITE) {
+      // the deletes come by binlog on a slave, and the index is rescanned
+      // after it becomes master
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    if (_svr->isClusterEnabled() &&
+        _svr->getMigrateManager()->slotInTask(chunkId)) {
+      return {ErrorCodes::ERR_CLUSTER, "slot in migrating"};
+    }
+    auto elk = KeyLock::AquireKeyLock(_storeid,
+                                      chunkId,
+                                      pk,
+                                      mgl::LockMode::LOCK_X,
+                                      sess,
+                                      _svr->getMGLockMgr(),
+                                      params->lockWaitTimeOut * 1000);
+    RET_IF_ERR_EXPECTED(elk);
+    auto ptxn = kvstore->createTransaction(sess);
+    RET_IF_ERR_EXPECTED(ptxn);
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+
+    auto eIndex = kvstore->getKV(indexRk, txn.get());
+    if (eIndex.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    RET_IF_ERR_EXPECTED(eIndex);
+    if (restart || eIndex.value().getValue() != indexValue) {
+      auto eDecode = GCIndex::decode(indexRk, eIndex.value());
+      RET_IF_ERR_EXPECTED(eDecode);
+      indexValue = eIndex.value().getValue();
+      eleTypes.clear();
+      for (auto type : eDecode.value().getTypes()) {
+        for (auto eleType : rcd_util::getEleTypes(type)) {
+          eleTypes.push_back(eleType);
+        }
+      }
+      std::sort(eleTypes.begin(), eleTypes.end(), [](auto a, auto b) {
+        return rt2Char(a) < rt2Char(b);
+      });
+      eleTypes.erase(std::unique(eleTypes.begin(), eleTypes.end()),
+                     eleTypes.end());
+      typeIdx = 0;
+      resume.clear();
+      restart = false;
+    }
+
+    auto eMeta = kvstore->getKV(mk, txn.get());
+    if (!eMeta.ok() && eMeta.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return eMeta.status();
+    }
+
+    uint32_t batch = std::max(params->lazyfreeReclaimBatch, 1U);
+    uint32_t deleted = 0;
+    auto cursor = txn->createDataCursor();
+    while (typeIdx < eleTypes.size() && deleted < batch) {
+      // all the versions of the subkeys begin with prefixPk() of version 0
+      // without its last byte, the varint 0
+      std::string prefix =
+        RecordKey(chunkId, dbId, eleTypes[typeIdx], pk, "").prefixPk();
+      prefix.pop_back();
+      cursor->seek(resume.empty() ? prefix : resume);
+      while (deleted < batch) {
+        auto eRcd = cursor->next();
+        if (eRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+          typeIdx++;
+          resume.clear();
+          break;
+        }
+        RET_IF_ERR_EXPECTED(eRcd);
+        const RecordKey& rk = eRcd.value().getRecordKey();
+        std::string key = rk.encode();
+        if (key.compare(0, prefix.size(), prefix) != 0) {
+          typeIdx++;
+          resume.clear();
+          break;
+        }
+        if (rk.getPrimaryKey() != pk) {
+          // a pk with pk|0 as its prefix, seek past all the versions of it.
+          // A subkey of pk sorted among them, which has to begin with a 0,
+          // is left to the compaction filter as an orphan
+          std::string next =
+            RecordKey(chunkId, dbId, rk.getRecordType(), rk.getPrimaryKey(), "")
+              .prefixPk();
+          next.pop_back();
+          next.back()++;
+          cursor->seek(next);
+          continue;
+        }
+        if (eMeta.ok() && rcd_util::isSubkeyOf(rk, eMeta.value())) {
+          // skip the subkeys of the live key
+          std::string next = RecordKey(chunkId,
+                                       dbId,
+                                       rk.getRecordType(),
+                                       pk,
+                                       "",
+                                       eMeta.value().getVersion())
+                               .prefixPk();
+          next.back()++;
+          cursor->seek(next);
+          continue;
+        }
+        auto s = kvstore->delKV(rk, txn.get());
+        RET_IF_ERR(s);
+        resume = std::move(key);
+        deleted++;
+      }
+    }
+
+    if (typeIdx >= eleTypes.size()) {
+      auto s = kvstore->delKV(indexRk, txn.get());
+      RET_IF_ERR(s);
+    }
+    auto eCmt = txn->commit();
+    RET_IF_ERR_EXPECTED(eCmt);
+    total += deleted;
+    if (typeIdx >= eleTypes.size()) {
+      LOG(INFO) << "reclaim key:" << hexlify(pk) << " storeid:" << _storeid
+                << " subkeys:" << total;
+      return {ErrorCodes::ERR_OK, ""};
+    }
+  }
+}
+
 void GCManager::garbageDeleterResize(size_t size) {
   _gcDeleter->resize(size);
 }
@@ -6,6 +6,7 @@
 #define SRC_TENDISPLUS_CLUSTER_GC_MANAGER_H_
 
 #include <list>
+#include <map>
 #include <memory>
 #include <string>
 #include <utility>
@@ -48,6 +49,30 @@ class DeleteRangeTask {
   Status deleteSlotRange();
 };
 
+// reclaim the subkeys of a key deleted lazily, see GCIndex
+class ReclaimKeyTask {
+ public:
+  explicit ReclaimKeyTask(uint32_t storeid,
+                          const GCIndex& index,
+                          std::shared_ptr<ServerEntry> svr)
+    : _storeid(storeid),
+      _index(index),
+      _svr(svr),
+      _isRunning(false),
+      _again(false),
+      _state(DeleteRangeState::START) {}
+
+  uint32_t _storeid;
+  GCIndex _index;
+  std::shared_ptr<ServerEntry> _svr;
+  bool _isRunning;
+  // the key is deleted lazily again while the task is running
+  bool _again;
+  SCLOCK::time_point _nextSchedTime;
+  DeleteRangeState _state;
+  Status reclaimKey();
+};
+
 using SlotsBitmap = std::bitset<CLUSTER_SLOTS>;
 class GCManager {
  public:
@@ -68,6 +93,9 @@ class GCManager {
                          uint64_t delay = 0);
   bool slotIsDeleting(uint32_t slot);
 
+  // reclaim the subkeys indexed by index in background
+  void reclaimKey(uint32_t storeid, const GCIndex& index);
+
   void garbageDeleterResize(size_t size);
   size_t garbageDeleterSize();
   Status delGarbage();
@@ -81,6 +109,11 @@ class GCManager {
                          uint32_t slotEnd,
                          mstime_t delay = 0);
   void garbageDelete(DeleteRangeTask* task);
+  bool reclaimSchedule(const SCLOCK::time_point& now);
+  void reclaimKeyDelete(ReclaimKeyTask* task);
+  // add the tasks of the GCIndex records, which are left by a restart
+  // or a failover
+  void rescanGCIndex();
   Status deleteLargeChunks(uint32_t storeid,
                            uint32_t slotStart,
                            uint32_t slotEnd,
@@ -94,6 +127,10 @@ class GCManager {
   std::unique_ptr<std::thread> _controller;
 
   std::list<std::shared_ptr<DeleteRangeTask>> _deleteChunkTask;
+  // storeid and GCIndex::encode() => task
+  std::map<std::pair<uint32_t, std::string>, std::shared_ptr<ReclaimKeyTask>>
+    _reclaimKeyTask;
+  SCLOCK::time_point _nextRescanTime;
 
   std::unique_ptr<WorkerPool> _gcDeleter;
   std::shared_ptr<PoolMatrix> _gcDeleterMatrix;
@@ -97,6 +97,10 @@ MigrateManager::MigrateManager(std::shared_ptr<ServerEntry> svr,
     _pTaskIdGen(0),
     _migrateSenderMatrix(std::make_shared<PoolMatrix>()),
     _migrateReceiverMatrix(std::make_shared<PoolMatrix>()),
+    _migrateSenderScaler(
+      std::make_unique<PoolAutoScaler>(_migrateSenderMatrix)),
+    _migrateReceiverScaler(
+      std::make_unique<PoolAutoScaler>(_migrateReceiverMatrix)),
     _workload(0),
     _rateLimiter(
       std::make_unique<RateLimiter>(_cfg->binlogRateLimitMB * 1024 * 1024)) {
@@ -1975,6 +1979,26 @@ void MigrateManager::migrateReceiverResize(size_t size) {
   _migrateReceiver->resize(size);
 }
 
+void MigrateManager::autoScalePools(uint64_t queueNsHigh, bool cpuBusy) {
+  std::lock_guard<myMutex> lk(_mutex);
+  // the configured threadnum is the upper bound
+  size_t cur = _migrateSender->size();
+  size_t num = _migrateSenderScaler->adapt(
+    cur, 1, 1, _cfg->migrateSenderThreadnum, queueNsHigh, cpuBusy);
+  if (num != cur) {
+    LOG(INFO) << "autoscale migrateSender from " << cur << " to " << num;
+    _migrateSender->resize(num);
+  }
+
+  cur = _migrateReceiver->size();
+  num = _migrateReceiverScaler->adapt(
+    cur, 1, 1, _cfg->migrateReceiveThreadnum, queueNsHigh, cpuBusy);
+  if (num != cur) {
+    LOG(INFO) << "autoscale migrateReceiver from " << cur << " to " << num;
+    _migrateReceiver->resize(num);
+  }
+}
+
 size_t MigrateManager::migrateSenderSize() {
   std::lock_guard<myMutex> lk(_mutex);
   return _migrateSender->size();
@@ -260,6 +260,9 @@ class MigrateManager {
 
   void migrateSenderResize(size_t size);
   void migrateReceiverResize(size_t size);
+  // resize _migrateSender and _migrateReceiver by their pressure, called in
+  // ServerEntry::serverCron() when pool-autoscale is on
+  void autoScalePools(uint64_t queueNsHigh, bool cpuBusy);
 
   size_t migrateSenderSize();
   size_t migrateReceiverSize();
@@ -338,6 +341,8 @@ class MigrateManager {
 
   std::unique_ptr<WorkerPool> _migrateReceiver;
   std::shared_ptr<PoolMatrix> _migrateReceiverMatrix;
+  std::unique_ptr<PoolAutoScaler> _migrateSenderScaler;
+  std::unique_ptr<PoolAutoScaler> _migrateReceiverScaler;
 
   uint16_t _workload;
   // mark dst node or source node
@@ -202,6 +202,10 @@ Expected<uint64_t> ChunkMigrateSender::sendRange(Transaction* txn,
   uint32_t curWriteNum = 0;
   uint32_t timeoutSec = 5;
   Status s;
+  // the meta of the last pk, to skip the orphan subkeys left by the lazy
+  // deletes, see GCIndex
+  std::string metaKey;
+  Expected<RecordValue> eMeta(ErrorCodes::ERR_NOTFOUND, "");
   while (true) {
     Expected<Record> expRcd = cursor->next();
     if (expRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
@@ -219,6 +223,30 @@ Expected<uint64_t> ChunkMigrateSender::sendRange(Transaction* txn,
     }
     Record& rcd = expRcd.value();
     const RecordKey& rcdKey = rcd.getRecordKey();
+    if (rcdKey.getRecordType() != RecordType::RT_DATA_META) {
+      RecordKey mk(rcdKey.getChunkId(),
+                   rcdKey.getDbId(),
+                   RecordType::RT_DATA_META,
+                   rcdKey.getPrimaryKey(),
+                   "");
+      std::string mkStr = mk.encode();
+      if (mkStr != metaKey) {
+        metaKey = std::move(mkStr);
+        auto eValue = txn->getKV(metaKey);
+        if (eValue.ok()) {
+          eMeta = RecordValue::decode(eValue.value());
+        } else {
+          eMeta = eValue.status();
+        }
+        if (!eMeta.ok() &&
+            eMeta.status().code() != ErrorCodes::ERR_NOTFOUND) {
+          return eMeta.status();
+        }
+      }
+      if (!eMeta.ok() || !rcd_util::isSubkeyOf(rcdKey, eMeta.value())) {
+        continue;
+      }
+    }
 
     std::string key = rcdKey.encode();
     const RecordValue& rcdValue = rcd.getRecordValue();
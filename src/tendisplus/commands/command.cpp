@@ -17,6 +17,7 @@
 #include "tendisplus/utils/scopeguard.h"
 #include "tendisplus/lock/lock.h"
 #include "tendisplus/storage/record.h"
+#include "tendisplus/storage/bitmap.h"
 #include "tendisplus/utils/sync_point.h"
 
 namespace tendisplus {
@@ -74,6 +75,10 @@ bool Command::isAdmin() const {
   return (_flags & CMD_ADMIN) != 0;
 }
 
+bool Command::isSlow() const {
+  return (_flags & (CMD_ADMIN | CMD_NOSCRIPT)) != 0;
+}
+
 bool Command::noExpire() {
   return _noexpire;
 }
@@ -269,6 +274,14 @@ Expected<std::string> Command::runSessionCmd(Session* sess) {
   // TODO(vinchen): here there is a copy, it is a waste.
   sess->getCtx()->setArgsBrief(sess->getArgs());
   it->second->incrCallTimes();
+  auto sampler = sess->getServerEntry()->getHotKeySampler();
+  if (sampler && sampler->shouldSample()) {
+    for (auto i : it->second->getKeysFromCommand(args)) {
+      if (static_cast<size_t>(i) < args.size()) {
+        sampler->sample(commandName, sess->getCtx()->getDbId(), args[i]);
+      }
+    }
+  }
   auto now = nsSinceEpoch();
   auto guard = MakeGuard([it, now, sess, commandName] {
     sess->getCtx()->clearRequestCtx();
@@ -313,51 +326,103 @@ Expected<std::string> Command::runSessionCmd(Session* sess) {
 //     return shard->isLocked(encodedKey);
 // }
 
-// requirement: intentionlock held
-Status Command::delKeyPessimisticInLock(Session* sess,
-                                        uint32_t storeId,
-                                        const RecordKey& mk,
-                                        RecordType valueType,
-                                        const TTLIndex* ictx) {
-  std::string keyEnc = mk.encode();
+// requirement: keylock held
+// only the meta and the ttl index are deleted in txn, the subkeys are left
+// for GCManager to reclaim, so it costs the same for a collection of any
+// size. The old subkeys are invisible at once, because a collection
+// recreated before the reclaim gets a newer version, see GCIndex.
+Status Command::delKeyLazyInLock(Session* sess,
+                                 uint32_t storeId,
+                                 const RecordKey& mk,
+                                 const RecordValue& meta,
+                                 Transaction* txn,
+                                 const TTLIndex* ictx) {
   auto server = sess->getServerEntry();
-
-  DLOG(INFO) << "begin delKeyPessimistic key:" << hexlify(mk.getPrimaryKey());
-
+  INVARIANT(server != nullptr);
   auto expdb =
-    server->getSegmentMgr()->getDb(sess, storeId, mgl::LockMode::LOCK_NONE);
-  if (!expdb.ok()) {
-    return expdb.status();
-  }
-  // NOTE(takenliu): use kvstore->createTransaction interface,
-  //   and commit in this function.
+    server->getSegmentMgr()->getDb(nullptr, storeId, mgl::LockMode::LOCK_NONE);
+  RET_IF_ERR_EXPECTED(expdb);
   PStore kvstore = expdb.value().store;
-  auto ptxn = kvstore->createTransaction(sess);
-  if (!ptxn.ok()) {
-    return ptxn.status();
+  INVARIANT_D(mk.getRecordType() == RecordType::RT_DATA_META);
+  INVARIANT_D(meta.getRecordType() != RecordType::RT_KV || meta.isPieced());
+
+  GCIndex index(mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey());
+  RecordKey indexRk = index.getRecordKey();
+  auto eIndex = kvstore->getKV(indexRk, txn);
+  if (eIndex.ok()) {
+    auto eDecode = GCIndex::decode(indexRk, eIndex.value());
+    RET_IF_ERR_EXPECTED(eDecode);
+    index = std::move(eDecode.value());
+  } else if (eIndex.status().code() != ErrorCodes::ERR_NOTFOUND) {
+    return eIndex.status();
   }
-  std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+  index.addKey(meta.getRecordType(), meta.getVersion());
 
-  Expected<string> ret = delSubkeysRange(
-          sess, storeId, mk, valueType, txn.get());
-  if (!ret.ok()) {
-    return ret.status();
+  Status s = kvstore->setKV(
+    indexRk, RecordValue(index.encodeValue(), RecordType::RT_META, -1), txn);
+  RET_IF_ERR(s);
+  s = kvstore->delKV(mk, txn);
+  RET_IF_ERR(s);
+  if (ictx && ictx->getType() != RecordType::RT_KV) {
+    s = txn->delKV(ictx->encode());
+    RET_IF_ERR(s);
   }
 
-  Status s = kvstore->delKV(mk, txn.get());
-  if (!s.ok()) {
-    return s;
+  // the reclaim task waits for the keylock, so it begins after txn commits
+  auto gcMgr = server->getGcMgr();
+  if (gcMgr) {
+    gcMgr->reclaimKey(storeId, index);
   }
+  return {ErrorCodes::ERR_OK, ""};
+}
 
-  if (ictx && ictx->getType() != RecordType::RT_KV) {
-    Status s = txn->delKV(ictx->encode());
-    if (!s.ok()) {
-      return s;
-    }
+// whether the collection with cnt subkeys should be deleted lazily
+bool Command::isLazyFree(Session* sess,
+                         const RecordKey& mk,
+                         const RecordValue& meta,
+                         uint64_t cnt,
+                         bool unlink) {
+  RecordType valueType = meta.getRecordType();
+  // a string has no subkeys unless it's pieced, see Bitmap
+  if (valueType == RecordType::RT_KV && !meta.isPieced()) {
+    return false;
   }
+  auto server = sess->getServerEntry();
+  uint64_t threshold = valueType == RecordType::RT_ZSET_META ? 1024 : 2048;
+  if (unlink) {
+    threshold =
+      std::min<uint64_t>(threshold, server->getParams()->lazyfreeThreshold);
+  }
+  if (cnt < threshold) {
+    return false;
+  }
+  // the orphan subkeys must not be migrated, so the keys in a migrating
+  // slot are deleted in txn
+  if (server->isClusterEnabled() &&
+      server->getMigrateManager()->slotInTask(mk.getChunkId())) {
+    return false;
+  }
+  return true;
+}
 
-  Expected<uint64_t> commitStatus = txn->commit();
-  return commitStatus.status();
+Expected<uint64_t> Command::getSubkeyVersion(
+  PStore kvstore,
+  const RecordKey& mk,
+  const Expected<RecordValue>& eMeta,
+  Transaction* txn) {
+  if (eMeta.ok()) {
+    return eMeta.value().getVersion();
+  }
+  GCIndex index(mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey());
+  RecordKey indexRk = index.getRecordKey();
+  auto eIndex = kvstore->getKV(indexRk, txn);
+  if (eIndex.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    return 0;
+  }
+  RET_IF_ERR_EXPECTED(eIndex);
+  auto eDecode = GCIndex::decode(indexRk, eIndex.value());
+  RET_IF_ERR_EXPECTED(eDecode);
+  return eDecode.value().getVersion() + 1;
 }
 
 Expected<std::pair<std::string, std::list<Record>>> Command::scan(
@@ -365,15 +430,23 @@ Expected<std::pair<std::string, std::list<Record>>> Command::scan(
   const std::string& from,
   uint64_t cnt,
   Transaction* txn) {
-  auto cursor = txn->createDataCursor();
-  if (from == "0") {
-    cursor->seek(pk);
-  } else {
+  std::string start = pk;
+  if (from != "0") {
     auto unhex = unhexlify(from);
     if (!unhex.ok()) {
       return unhex.status();
     }
-    cursor->seek(unhex.value());
+    start = std::move(unhex.value());
+  }
+  std::unique_ptr<BasicDataCursor> cursor;
+  if (start.compare(0, pk.size(), pk) == 0) {
+    cursor = txn->createPkCursor(pk);
+    if (start.size() != pk.size()) {
+      cursor->seek(start);
+    }
+  } else {
+    cursor = txn->createDataCursor();
+    cursor->seek(start);
   }
   std::list<Record> result;
   while (true) {
@@ -409,143 +482,25 @@ Expected<std::pair<std::string, std::list<Record>>> Command::scan(
 Status Command::delKeyOptimismInLock(Session* sess,
                                      uint32_t storeId,
                                      const RecordKey& rk,
-                                     RecordType valueType,
+                                     const RecordValue& meta,
                                      Transaction* txn,
                                      const TTLIndex* ictx) {
   auto s = Command::partialDelSubKeys(sess,
                                       storeId,
                                       std::numeric_limits<uint32_t>::max(),
                                       rk,
-                                      valueType,
+                                      meta,
                                       true,
                                       txn,
                                       ictx);
   return s.status();
 }
 
-Expected<string> Command::delSubkeysRange(Session* sess,
-                                          uint32_t storeId,
-                                          const RecordKey& mk,
-                                          RecordType valueType,
-                                          Transaction* txn) {
-  Status s(ErrorCodes::ERR_OK, "");
-  auto guard = MakeGuard([&s] {
-    if (!s.ok()) {
-      INVARIANT_D(0);
-    }
-  });
-
-  auto server = sess->getServerEntry();
-  INVARIANT(server != nullptr);
-  auto expdb = server->getSegmentMgr()->getDb(nullptr, storeId,
-                  mgl::LockMode::LOCK_NONE);
-  RET_IF_ERR_EXPECTED(expdb);
-
-  PStore kvstore = expdb.value().store;
-  INVARIANT_D(mk.getRecordType() == RecordType::RT_DATA_META);
-  if (valueType == RecordType::RT_KV) {
-    INVARIANT_D(0);
-    return {ErrorCodes::ERR_WRONG_TYPE, ""};
-  }
-  std::vector<RecordKey> prefixes;
-  if (valueType == RecordType::RT_HASH_META) {
-    RecordKey start(mk.getChunkId(),
-                    mk.getDbId(),
-                    RecordType::RT_HASH_ELE,
-                    mk.getPrimaryKey(),
-                    "",
-                    0);
-    RecordKey end(mk.getChunkId(),
-                  mk.getDbId(),
-                  RecordType::RT_HASH_ELE,
-                  mk.getPrimaryKey(),
-                  "",
-                  UINT64_MAX);
-    prefixes.push_back(start);
-    prefixes.push_back(end);
-  } else if (valueType == RecordType::RT_LIST_META) {
-    RecordKey start(mk.getChunkId(),
-                    mk.getDbId(),
-                    RecordType::RT_LIST_ELE,
-                    mk.getPrimaryKey(),
-                    "",
-                    0);
-    RecordKey end(mk.getChunkId(),
-                  mk.getDbId(),
-                  RecordType::RT_LIST_ELE,
-                  mk.getPrimaryKey(),
-                  "",
-                  UINT64_MAX);
-    prefixes.push_back(start);
-    prefixes.push_back(end);
-  } else if (valueType == RecordType::RT_SET_META) {
-    RecordKey start(mk.getChunkId(),
-                    mk.getDbId(),
-                    RecordType::RT_SET_ELE,
-                    mk.getPrimaryKey(),
-                    "",
-                    0);
-    RecordKey end(mk.getChunkId(),
-                  mk.getDbId(),
-                  RecordType::RT_SET_ELE,
-                  mk.getPrimaryKey(),
-                  "",
-                  UINT64_MAX);
-    prefixes.push_back(start);
-    prefixes.push_back(end);
-  } else if (valueType == RecordType::RT_ZSET_META) {
-    RecordKey start(mk.getChunkId(),
-                    mk.getDbId(),
-                    RecordType::RT_ZSET_S_ELE,
-                    mk.getPrimaryKey(),
-                    "",
-                    0);
-    RecordKey end(mk.getChunkId(),
-                  mk.getDbId(),
-                  RecordType::RT_ZSET_S_ELE,
-                  mk.getPrimaryKey(),
-                  "",
-                  UINT64_MAX);
-    prefixes.push_back(start);
-    prefixes.push_back(end);
-    RecordKey startH(mk.getChunkId(),
-                     mk.getDbId(),
-                     RecordType::RT_ZSET_H_ELE,
-                     mk.getPrimaryKey(),
-                     "",
-                     0);
-    RecordKey endH(mk.getChunkId(),
-                   mk.getDbId(),
-                   RecordType::RT_ZSET_H_ELE,
-                   mk.getPrimaryKey(),
-                   "",
-                   UINT64_MAX);
-    prefixes.push_back(startH);
-    prefixes.push_back(endH);
-  } else {
-    INVARIANT_D(0);
-  }
-
-  // NOTE(takenliu): deleteRange and delete meta is not in the same txn.
-  for (uint32_t i = 0; i < prefixes.size(); i+=2) {
-    string start = prefixes[i].prefixPk();
-    string end = prefixes[i+1].prefixPk();
-    auto s = kvstore->deleteRange(start, end);
-    if (!s.ok()) {
-      LOG(ERROR) << "delSubkeysRange::deleteRange commit failed, start:"
-                 << start << " end:" << end << " err:" << s.toString();
-      return s;
-    }
-  }
-
-  return {ErrorCodes::ERR_OK, ""};
-}
-
 Expected<uint32_t> Command::partialDelSubKeys(Session* sess,
                                               uint32_t storeId,
                                               uint32_t subCount,
                                               const RecordKey& mk,
-                                              RecordType valueType,
+                                              const RecordValue& meta,
                                               bool deleteMeta,
                                               Transaction* txn,
                                               const TTLIndex* ictx) {
@@ -567,55 +522,28 @@ Expected<uint32_t> Command::partialDelSubKeys(Session* sess,
 
   PStore kvstore = expdb.value().store;
   INVARIANT_D(mk.getRecordType() == RecordType::RT_DATA_META);
-  if (valueType == RecordType::RT_KV) {
+  RecordType valueType = meta.getRecordType();
+  if (valueType == RecordType::RT_KV && !meta.isPieced()) {
     s = kvstore->delKV(mk, txn);
     RET_IF_ERR(s);
 
     return 1;
   }
   std::vector<std::string> prefixes;
-  if (valueType == RecordType::RT_HASH_META) {
+  for (auto eleType : rcd_util::getEleTypes(valueType)) {
     RecordKey fakeEle(mk.getChunkId(),
                       mk.getDbId(),
-                      RecordType::RT_HASH_ELE,
+                      eleType,
                       mk.getPrimaryKey(),
-                      "");
+                      "",
+                      meta.getVersion());
     prefixes.push_back(fakeEle.prefixPk());
-  } else if (valueType == RecordType::RT_LIST_META) {
-    RecordKey fakeEle(mk.getChunkId(),
-                      mk.getDbId(),
-                      RecordType::RT_LIST_ELE,
-                      mk.getPrimaryKey(),
-                      "");
-    prefixes.push_back(fakeEle.prefixPk());
-  } else if (valueType == RecordType::RT_SET_META) {
-    RecordKey fakeEle(mk.getChunkId(),
-                      mk.getDbId(),
-                      RecordType::RT_SET_ELE,
-                      mk.getPrimaryKey(),
-                      "");
-    prefixes.push_back(fakeEle.prefixPk());
-  } else if (valueType == RecordType::RT_ZSET_META) {
-    RecordKey fakeEle(mk.getChunkId(),
-                      mk.getDbId(),
-                      RecordType::RT_ZSET_S_ELE,
-                      mk.getPrimaryKey(),
-                      "");
-    prefixes.push_back(fakeEle.prefixPk());
-    RecordKey fakeEle1(mk.getChunkId(),
-                       mk.getDbId(),
-                       RecordType::RT_ZSET_H_ELE,
-                       mk.getPrimaryKey(),
-                       "");
-    prefixes.push_back(fakeEle1.prefixPk());
-  } else {
-    INVARIANT_D(0);
   }
+  INVARIANT_D(!prefixes.empty());
 
   std::list<RecordKey> pendingDelete;
   for (const auto& prefix : prefixes) {
-    auto cursor = txn->createDataCursor();
-    cursor->seek(prefix);
+    auto cursor = txn->createPkCursor(prefix);
 
     while (true) {
       if (pendingDelete.size() >= subCount) {
@@ -656,7 +584,8 @@ Expected<uint32_t> Command::partialDelSubKeys(Session* sess,
 Expected<bool> Command::delKeyChkExpire(Session* sess,
                                         const std::string& key,
                                         RecordType tp,
-                                        Transaction* txn) {
+                                        Transaction* txn,
+                                        bool unlink) {
   Expected<RecordValue> rv = Command::expireKeyIfNeeded(sess, key, tp);
   if (rv.status().code() == ErrorCodes::ERR_EXPIRED) {
     return false;
@@ -667,7 +596,7 @@ Expected<bool> Command::delKeyChkExpire(Session* sess,
   }
 
   // key exists and not expired, now we delete it
-  Status s = Command::delKey(sess, key, tp, txn);
+  Status s = Command::delKey(sess, key, tp, txn, unlink);
   if (s.code() == ErrorCodes::ERR_NOTFOUND) {
     return false;
   }
@@ -703,7 +632,7 @@ Status Command::delKeyAndTTL(Session* sess,
 
 // not comitted, caller need commit itself.
 Status Command::delKey(Session* sess, const std::string& key, RecordType tp,
-        Transaction* txn) {
+        Transaction* txn, bool unlink) {
   auto server = sess->getServerEntry();
   INVARIANT(server != nullptr);
   SessionCtx* pCtx = sess->getCtx();
@@ -732,18 +661,21 @@ Status Command::delKey(Session* sess, const std::string& key, RecordType tp,
 
     TTLIndex ictx(
       key, valueType, sess->getCtx()->getDbId(), eValue.value().getTtl());
-    if (cnt.value() >= 2048 ||
-        (valueType == RecordType::RT_ZSET_META && cnt.value() >= 1024)) {
+    if (isLazyFree(sess, mk, eValue.value(), cnt.value(), unlink)) {
       LOG(INFO) << "bigkey delete:" << hexlify(mk.getPrimaryKey())
                 << ",rcdType:" << rt2Char(valueType) << ",size:" << cnt.value();
-      return Command::delKeyPessimisticInLock(
-        sess, storeId, mk, valueType, ictx.getTTL() > 0 ? &ictx : nullptr);
+      return Command::delKeyLazyInLock(sess,
+                                       storeId,
+                                       mk,
+                                       eValue.value(),
+                                       txn,
+                                       ictx.getTTL() > 0 ? &ictx : nullptr);
     } else {
       Status s =
         Command::delKeyOptimismInLock(sess,
                                       storeId,
                                       mk,
-                                      valueType,
+                                      eValue.value(),
                                       txn,
                                       ictx.getTTL() > 0 ? &ictx : nullptr);
       if (s.code() == ErrorCodes::ERR_COMMIT_RETRY && i != RETRY_CNT - 1) {
@@ -803,6 +735,12 @@ Expected<RecordValue> Command::expireKeyIfNeeded(Session* sess,
         }
       }
       ++sess->getServerEntry()->getServerStat().keyspaceHits;
+      if (tp == RecordType::RT_KV && eValue.value().isPieced()) {
+        // the callers of RT_KV want the whole string, the bit commands
+        // read a pieced string by Bitmap with RT_DATA_META
+        Bitmap bm(mk.getChunkId(), mk.getDbId(), key, eValue.value(), kvstore);
+        return bm.load(txn.get());
+      }
       return eValue.value();
     } else if (txn->isReplOnly()) {
       // NOTE(vinchen): if replOnly, it can't delete record, but return
@@ -815,41 +753,119 @@ Expected<RecordValue> Command::expireKeyIfNeeded(Session* sess,
     }
 
     TTLIndex ictx(key, valueType, sess->getCtx()->getDbId(), targetTtl);
-    if (cnt.value() >= 2048) {
+    Status s;
+    if (isLazyFree(sess, mk, eValue.value(), cnt.value(), false)) {
       LOG(INFO) << "bigkey delete:" << hexlify(mk.getPrimaryKey())
                 << ",rcdType:" << rt2Char(valueType) << ",size:" << cnt.value();
-      Status s =
-        Command::delKeyPessimisticInLock(sess, storeId, mk, valueType, &ictx);
-      if (s.ok()) {
-        return {ErrorCodes::ERR_EXPIRED, ""};
-      } else {
-        return s;
-      }
+      s = Command::delKeyLazyInLock(
+        sess, storeId, mk, eValue.value(), txn.get(), &ictx);
     } else {
-      Status s = Command::delKeyOptimismInLock(
-        sess, storeId, mk, valueType, txn.get(), &ictx);
-      if (!s.ok()) {
-        return s;
-      }
-      auto eCmt = txn.get()->commit();
-      if (!eCmt.ok()) {
-        return eCmt.status();
-      }
-      return {ErrorCodes::ERR_EXPIRED, ""};
+      s = Command::delKeyOptimismInLock(
+        sess, storeId, mk, eValue.value(), txn.get(), &ictx);
     }
+    if (!s.ok()) {
+      return s;
+    }
+    auto eCmt = txn.get()->commit();
+    if (!eCmt.ok()) {
+      return eCmt.status();
+    }
+    return {ErrorCodes::ERR_EXPIRED, ""};
   }
   // should never reach here
   INVARIANT_D(0);
   return {ErrorCodes::ERR_INTERNAL, "not reachable"};
 }
 
+Expected<std::vector<Expected<RecordValue>>> Command::expireKeysIfNeeded(
+  Session* sess, const std::vector<std::string>& keys, RecordType tp) {
+  auto server = sess->getServerEntry();
+  INVARIANT(server != nullptr);
+  auto pCtx = sess->getCtx();
+  INVARIANT(pCtx != nullptr);
+
+  struct StoreBatch {
+    PStore store;
+    std::vector<size_t> idx;
+    std::vector<RecordKey> keys;
+  };
+  std::map<uint32_t, StoreBatch> batches;
+  std::vector<Expected<RecordValue>> result(
+    keys.size(), Expected<RecordValue>(ErrorCodes::ERR_NOTFOUND, ""));
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, keys[i]);
+    if (!expdb.ok()) {
+      return expdb.status();
+    }
+    auto& batch = batches[expdb.value().dbId];
+    batch.store = expdb.value().store;
+    batch.idx.push_back(i);
+    batch.keys.emplace_back(
+      expdb.value().chunkId, pCtx->getDbId(), tp, keys[i], "");
+  }
+
+  for (auto& v : batches) {
+    auto& batch = v.second;
+    auto ptxn = batch.store->createTransaction(sess);
+    if (!ptxn.ok()) {
+      return ptxn.status();
+    }
+    std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+    auto eValues = batch.store->getKVs(batch.keys, txn.get());
+    INVARIANT_D(eValues.size() == batch.idx.size());
+
+    // TODO(vinchen) : Should it use store->getCurrentTime() instead?
+    uint64_t currentTs = msSinceEpoch();
+    for (size_t j = 0; j < eValues.size(); j++) {
+      size_t i = batch.idx[j];
+      auto& eValue = eValues[j];
+      if (!eValue.ok()) {
+        if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
+          ++server->getServerStat().keyspaceMisses;
+        }
+        result[i] = std::move(eValue);
+        continue;
+      }
+      uint64_t targetTtl = eValue.value().getTtl();
+      RecordType valueType = eValue.value().getRecordType();
+      if (!(_noexpire || targetTtl == 0 || currentTs < targetTtl)) {
+        // expired, let expireKeyIfNeeded() do the deletion
+        result[i] = expireKeyIfNeeded(sess, keys[i], tp);
+        continue;
+      }
+      if (valueType != tp && tp != RecordType::RT_DATA_META) {
+        result[i] = {ErrorCodes::ERR_WRONG_TYPE, ""};
+        continue;
+      }
+      if (!pCtx->verifyVersion(eValue.value().getVersionEP())) {
+        ++server->getServerStat().keyspaceIncorrectEp;
+        result[i] = {ErrorCodes::ERR_WRONG_VERSION_EP, ""};
+        continue;
+      }
+      ++server->getServerStat().keyspaceHits;
+      if (tp == RecordType::RT_KV && eValue.value().isPieced()) {
+        Bitmap bm(batch.keys[j].getChunkId(),
+                  batch.keys[j].getDbId(),
+                  keys[i],
+                  eValue.value(),
+                  batch.store);
+        result[i] = bm.load(txn.get());
+        continue;
+      }
+      result[i] = std::move(eValue);
+    }
+  }
+  return result;
+}
+
 std::string Command::fmtErr(const std::string& s) {
   if (s.size() != 0 && s[0] == '-') {
     return s;
   }
-  std::stringstream ss;
-  ss << "-ERR " << s << "\r\n";
-  return ss.str();
+  std::string ret;
+  ret.reserve(s.size() + 7);
+  ret.append("-ERR ").append(s).append("\r\n");
+  return ret;
 }
 
 std::string Command::fmtNull() {
@@ -869,9 +885,9 @@ std::string Command::fmtZero() {
 }
 
 std::string Command::fmtLongLong(int64_t v) {
-  std::stringstream ss;
-  ss << ":" << v << "\r\n";
-  return ss.str();
+  std::string ret;
+  fmtLongLong(ret, v);
+  return ret;
 }
 
 Expected<uint64_t> Command::getInt64FromFmtLongLong(const std::string& str) {
@@ -921,19 +937,17 @@ std::stringstream& Command::fmtLongLong(std::stringstream& ss, int64_t v) {
 }
 
 std::string Command::fmtBulk(const std::string& s) {
-  std::stringstream ss;
-  ss << "$" << s.size() << "\r\n";
-  ss.write(s.c_str(), s.size());
-  ss << "\r\n";
-  return ss.str();
+  std::string ret;
+  ret.reserve(fmtBulkLen(s));
+  fmtBulk(ret, s);
+  return ret;
 }
 
 std::string Command::fmtStatus(const std::string& s) {
-  std::stringstream ss;
-  ss << "+";
-  ss.write(s.c_str(), s.size());
-  ss << "\r\n";
-  return ss.str();
+  std::string ret;
+  ret.reserve(s.size() + 3);
+  fmtStatus(ret, s);
+  return ret;
 }
 
 std::stringstream& Command::fmtStatus(std::stringstream& ss,
@@ -944,6 +958,37 @@ std::stringstream& Command::fmtStatus(std::stringstream& ss,
   return ss;
 }
 
+std::string& Command::fmtMultiBulkLen(std::string& s, uint64_t l) {
+  s.append(1, '*').append(std::to_string(l)).append("\r\n");
+  return s;
+}
+
+std::string& Command::fmtBulk(std::string& s, const std::string& v) {
+  s.append(1, '$').append(std::to_string(v.size())).append("\r\n");
+  s.append(v).append("\r\n");
+  return s;
+}
+
+std::string& Command::fmtStatus(std::string& s, const std::string& v) {
+  s.append(1, '+').append(v).append("\r\n");
+  return s;
+}
+
+std::string& Command::fmtNull(std::string& s) {
+  s.append("$-1\r\n");
+  return s;
+}
+
+std::string& Command::fmtLongLong(std::string& s, int64_t v) {
+  s.append(1, ':').append(std::to_string(v)).append("\r\n");
+  return s;
+}
+
+size_t Command::fmtBulkLen(const std::string& s) {
+  // $<len>\r\n<s>\r\n
+  return 1 + std::to_string(s.size()).size() + 2 + s.size() + 2;
+}
+
 std::vector<int> Command::getKeysFromCommand(
   const std::vector<std::string>& argv) {
   int argc = argv.size();
@@ -51,6 +51,9 @@ class Command {
   bool isMultiKey() const;
   bool isWriteable() const;
   bool isAdmin() const;
+  // admin and noscript commands(keys, flushall, ...) may run for a long
+  // time, they are never executed in the io threads
+  bool isSlow() const;
   static bool noExpire();
   // will be LOCK_S when _noexpire set true.
   // should use lock upgrade in the future.
@@ -72,11 +75,18 @@ class Command {
   // return ERR_OK if not expired
   // return ERR_EXPIRED if expired
   // return errors on other unexpected conditions
+  // a pieced string is loaded as a whole if tp is RT_KV, see Bitmap
   static Expected<RecordValue> expireKeyIfNeeded(Session* sess,
                                                  const std::string& key,
                                                  RecordType tp,
                                                  bool hasVersion = true);
 
+  // batched version of expireKeyIfNeeded(), the meta records of keys in
+  // the same kvstore are read by one KVStore::getKVs().
+  // NOTE: all the keys should be locked before, see getAllKeysLocked()
+  static Expected<std::vector<Expected<RecordValue>>> expireKeysIfNeeded(
+    Session* sess, const std::vector<std::string>& keys, RecordType tp);
+
   static Expected<std::pair<std::string, std::list<Record>>> scan(
     const std::string& pk,
     const std::string& from,
@@ -87,8 +97,17 @@ class Command {
                              const RecordKey& mk,
                              const RecordValue& val,
                              Transaction* txn);
+  // if unlink, more keys are deleted lazily, see isLazyFree()
   static Status delKey(Session* sess, const std::string& key, RecordType tp,
-          Transaction* txn);
+          Transaction* txn, bool unlink = false);
+
+  // the version for the subkeys of a new collection mk, eMeta is the
+  // result of getting mk. It's nonzero if the subkeys of the deleted mk
+  // are not reclaimed yet, see GCIndex
+  static Expected<uint64_t> getSubkeyVersion(PStore kvstore,
+                                             const RecordKey& mk,
+                                             const Expected<RecordValue>& eMeta,
+                                             Transaction* txn);
 
   // return true if exists and delete succ
   // return false if not exists
@@ -96,7 +115,8 @@ class Command {
   static Expected<bool> delKeyChkExpire(Session* sess,
                                         const std::string& key,
                                         RecordType tp,
-                                        Transaction* txn);
+                                        Transaction* txn,
+                                        bool unlink = false);
 
   static std::string fmtErr(const std::string& s);
   static std::string fmtNull();
@@ -117,6 +137,16 @@ class Command {
   static std::stringstream& fmtNull(std::stringstream&);
   static std::stringstream& fmtLongLong(std::stringstream&, int64_t);
 
+  // append RESP directly to the reply, without the stringstream and the
+  // copy of ss.str(). reserve() the reply if the size is predictable
+  static std::string& fmtMultiBulkLen(std::string&, uint64_t);
+  static std::string& fmtBulk(std::string&, const std::string&);
+  static std::string& fmtStatus(std::string&, const std::string&);
+  static std::string& fmtNull(std::string&);
+  static std::string& fmtLongLong(std::string&, int64_t);
+  // the size of fmtBulk(s)
+  static size_t fmtBulkLen(const std::string& s);
+
   static constexpr int32_t RETRY_CNT = 3;
 
  protected:
@@ -129,34 +159,37 @@ class Command {
   static mgl::LockMode _expRdLk;
 
  private:
-  static Status delKeyPessimisticInLock(Session* sess,
-                                        uint32_t storeId,
-                                        const RecordKey& rk,
-                                        RecordType valueType,
-                                        const TTLIndex* ictx = nullptr);
+  // delete the meta only, the subkeys are left to the lazyfree reclaimer,
+  // see GCIndex and GCManager::reclaimKey()
+  static Status delKeyLazyInLock(Session* sess,
+                                 uint32_t storeId,
+                                 const RecordKey& mk,
+                                 const RecordValue& meta,
+                                 Transaction* txn,
+                                 const TTLIndex* ictx = nullptr);
 
   static Status delKeyOptimismInLock(Session* sess,
                                      uint32_t storeId,
                                      const RecordKey& rk,
-                                     RecordType valueType,
+                                     const RecordValue& meta,
                                      Transaction* txn,
                                      const TTLIndex* ictx = nullptr);
 
-  static Expected<string> delSubkeysRange(Session* sess,
-                                          uint32_t storeId,
-                                          const RecordKey& mk,
-                                          RecordType valueType,
-                                          Transaction* txn);
-
   static Expected<uint32_t> partialDelSubKeys(Session* sess,
                                               uint32_t storeId,
                                               uint32_t subCount,
                                               const RecordKey& mk,
-                                              RecordType valueType,
+                                              const RecordValue& meta,
                                               bool deleteMeta,
                                               Transaction* txn,
                                               const TTLIndex* ictx = nullptr);
 
+  static bool isLazyFree(Session* sess,
+                         const RecordKey& mk,
+                         const RecordValue& meta,
+                         uint64_t subCount,
+                         bool unlink);
+
   const std::string _name;
   /* Flags as string representation, one char per flag. */
   const std::string _sflags;
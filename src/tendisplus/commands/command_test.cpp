@@ -1083,6 +1083,32 @@ TEST(Command, slowlog) {
 }
 #endif  // !
 
+TEST(Command, fmtReply) {
+  std::string big(100000, 'x');
+  std::stringstream ss;
+  Command::fmtMultiBulkLen(ss, 5);
+  Command::fmtBulk(ss, "foo");
+  Command::fmtBulk(ss, big);
+  Command::fmtNull(ss);
+  Command::fmtLongLong(ss, -12345);
+  Command::fmtStatus(ss, "OK");
+
+  std::string rsp;
+  Command::fmtMultiBulkLen(rsp, 5);
+  Command::fmtBulk(rsp, "foo");
+  Command::fmtBulk(rsp, big);
+  Command::fmtNull(rsp);
+  Command::fmtLongLong(rsp, -12345);
+  Command::fmtStatus(rsp, "OK");
+  EXPECT_EQ(rsp, ss.str());
+
+  EXPECT_EQ(Command::fmtBulk(big).size(), Command::fmtBulkLen(big));
+  EXPECT_EQ(Command::fmtBulk(""), "$0\r\n\r\n");
+  EXPECT_EQ(Command::fmtLongLong(-1), ":-1\r\n");
+  EXPECT_EQ(Command::fmtStatus("none"), "+none\r\n");
+  EXPECT_EQ(Command::fmtErr("oops"), "-ERR oops\r\n");
+}
+
 TEST(Command, testGlobStylePattern) {
   const auto guard = MakeGuard([] { destroyEnv(); });
 
@@ -1692,6 +1718,11 @@ TEST(Command, info) {
     {"rocksproperty", "all", "0"},
     {"rocksproperty", "rocksdb.base-level"},
     {"rocksproperty", "all"},
+    {"tendisadmin", "hotkeys"},
+    {"tendisadmin", "hotkeys", "get", "5"},
+    {"tendisadmin", "bigkeys"},
+    {"tendisadmin", "bigkeys", "zset", "5"},
+    {"tendisstat", "hotkeys", "bigkeys"},
   };
 
   std::vector<std::pair<std::vector<std::string>, std::string>> okArr = {
@@ -1730,6 +1761,9 @@ TEST(Command, info) {
     {"tendisadmin", "sleep", "1", "2"},
     {"tendisadmin", "recovery", "1"},
     {"tendisadmin", "invalid"},
+    {"tendisadmin", "hotkeys", "get", "x"},
+    {"tendisadmin", "bigkeys", "invalid"},
+    {"tendisadmin", "bigkeys", "all", "1", "2"},
   };
 
   testCommandArray(server, correctArr, false);
@@ -2074,6 +2108,188 @@ void testResizeCommand(std::shared_ptr<ServerEntry> svr) {
   EXPECT_EQ(svr->getMigrateManager()->migrateReceiverSize(), 1);
 }
 
+TEST(Command, poolAutoScale) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  cfg->executorWorkPoolSize = 2;
+  cfg->executorThreadNum = 8;
+  cfg->executorThreadNumMin = 2;
+  cfg->executorThreadNumMax = 4;
+  cfg->poolAutoScale = true;
+  cfg->poolAutoScaleIntervalSec = 1;
+  auto server = makeServerEntry(cfg);
+
+  // more threads than executorThreadNumMax, and shrunk further when idle
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(server, std::move(socket), 1, false, nullptr, nullptr);
+  for (uint32_t i = 0; i < 100 && cfg->executorThreadNum > 2; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    sess.setArgs({"set", "a", std::to_string(i)});
+    auto expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok());
+  }
+  EXPECT_EQ(cfg->executorThreadNum, 2U);
+
+  sess.setArgs({"config", "set", "executorThreadNum", "4"});
+  auto expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+TEST(Command, bigKeyCron) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  EXPECT_EQ(cfg->bigkeyScanBatch, 100U);
+  auto server = makeServerEntry(cfg);
+
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(server, std::move(socket), 1, false, nullptr, nullptr);
+  for (uint32_t i = 0; i < 1000; i++) {
+    sess.setArgs({"hset", "bigkey", "field" + std::to_string(i), "value"});
+    auto expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok());
+  }
+
+  // the big keys are sized while the server keeps serving
+  std::vector<BigKeySampler::BigKey> keys;
+  for (uint32_t i = 0; i < 100 && keys.empty(); i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    keys = server->getBigKeySampler()->bigKeys(RecordType::RT_HASH_META, 1);
+
+    sess.setArgs({"get", "a"});
+    auto expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok());
+  }
+  EXPECT_EQ(keys.size(), 1U);
+  if (!keys.empty()) {
+    EXPECT_EQ(keys[0].key, "bigkey");
+    EXPECT_EQ(keys[0].elements, 1000U);
+  }
+  EXPECT_GT(server->getBigKeySampler()->sized.load(), 0U);
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+// the hash subkeys of pk with the version, or of any version if version
+// is UINT64_MAX
+uint64_t countLazyHashSubkeys(std::shared_ptr<ServerEntry> svr,
+                              const std::string& pk,
+                              uint64_t version) {
+  uint64_t count = 0;
+  for (auto& kvstore : svr->getStores()) {
+    auto ptxn = kvstore->createTransaction(nullptr);
+    EXPECT_TRUE(ptxn.ok());
+    auto cursor = ptxn.value()->createAllDataCursor();
+    while (true) {
+      auto eRcd = cursor->next();
+      if (eRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+        break;
+      }
+      EXPECT_TRUE(eRcd.ok());
+      const RecordKey& rk = eRcd.value().getRecordKey();
+      if (rk.getRecordType() == RecordType::RT_HASH_ELE &&
+          rk.getPrimaryKey() == pk &&
+          (version == UINT64_MAX || rk.getVersion() == version)) {
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+uint64_t countGCIndex(std::shared_ptr<ServerEntry> svr) {
+  uint64_t count = 0;
+  for (auto& kvstore : svr->getStores()) {
+    auto ptxn = kvstore->createTransaction(nullptr);
+    EXPECT_TRUE(ptxn.ok());
+    auto cursor = ptxn.value()->createGCIndexCursor();
+    while (cursor->next().ok()) {
+      count++;
+    }
+  }
+  return count;
+}
+
+TEST(Command, lazyFreeReclaim) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  cfg->lazyfreeReclaimBatch = 100;
+  auto server = makeServerEntry(cfg);
+
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  NetSession sess(server, std::move(socket), 1, false, nullptr, nullptr);
+  const std::string key = "{lz}h";
+  // in the same chunk, and its subkeys are under the prefix of key|0
+  const std::string other = key + std::string(1, '\0') + "x";
+  for (uint32_t i = 0; i < 2000; i++) {
+    sess.setArgs({"hset", key, "field" + std::to_string(i), "old"});
+    auto expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok());
+  }
+  for (uint32_t i = 0; i < 10; i++) {
+    sess.setArgs({"hset", other, "field" + std::to_string(i), "other"});
+    auto expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok());
+  }
+
+  sess.setArgs({"unlink", key});
+  auto expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtOne());
+  // recreated with a bumped version, maybe before the reclaim ends
+  for (uint32_t i = 0; i < 10; i++) {
+    sess.setArgs({"hset", key, "field" + std::to_string(i), "new"});
+    expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok());
+    EXPECT_EQ(expect.value(), Command::fmtOne());
+  }
+
+  for (uint32_t i = 0; i < 100 && countGCIndex(server) > 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  EXPECT_EQ(countGCIndex(server), 0U);
+  EXPECT_EQ(countLazyHashSubkeys(server, key, UINT64_MAX), 10U);
+  EXPECT_EQ(countLazyHashSubkeys(server, key, 1), 10U);
+  EXPECT_EQ(countLazyHashSubkeys(server, other, UINT64_MAX), 10U);
+
+  sess.setArgs({"hlen", key});
+  expect = Command::runSessionCmd(&sess);
+  EXPECT_TRUE(expect.ok());
+  EXPECT_EQ(expect.value(), Command::fmtLongLong(10));
+  for (uint32_t i = 0; i < 10; i++) {
+    sess.setArgs({"hget", key, "field" + std::to_string(i)});
+    expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok());
+    EXPECT_EQ(expect.value(), Command::fmtBulk("new"));
+
+    sess.setArgs({"hget", other, "field" + std::to_string(i)});
+    expect = Command::runSessionCmd(&sess);
+    EXPECT_TRUE(expect.ok());
+    EXPECT_EQ(expect.value(), Command::fmtBulk("other"));
+  }
+
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
 TEST(Command, resizeCommand) {
   const auto guard = MakeGuard([]() { destroyEnv(); });
   EXPECT_TRUE(setupEnv());
@@ -33,6 +33,10 @@
 #include "tendisplus/commands/command.h"
 #include "tendisplus/commands/release.h"
 #include "tendisplus/commands/version.h"
+#include "tendisplus/storage/bitmap.h"
+#include "tendisplus/storage/quicklist.h"
+#include "tendisplus/storage/key_counter.h"
+#include "tendisplus/storage/record_cache.h"
 #include "tendisplus/storage/varint.h"
 #include "tendisplus/utils/scopeguard.h"
 
@@ -204,7 +208,6 @@ class DbsizeCommand : public Command {
     auto currentDbid = sess->getCtx()->getDbId();
     auto ts = msSinceEpoch();
 
-    // TODO(vinchen): should use a faster way
     std::list<std::string> result;
     for (ssize_t i = 0; i < server->getKVStoreCount(); i++) {
       auto expdb =
@@ -217,6 +220,12 @@ class DbsizeCommand : public Command {
       }
 
       PStore kvstore = expdb.value().store;
+      if (!containSubkey && !containExpire) {
+        // the key counts of the store, the expired keys are counted
+        // until they are deleted, as redis does
+        size += kvstore->getKeyCounter()->dbKeys(currentDbid);
+        continue;
+      }
       auto ptxn = sess->getCtx()->createTransaction(kvstore);
       if (!ptxn.ok()) {
         return ptxn.status();
@@ -597,11 +606,9 @@ class IterAllCommand : public Command {
 
     std::unordered_map<std::string, uint64_t> lIdx;
     std::list<Record> result;
+    std::string nextCursor;
     uint64_t currentTs = msSinceEpoch();
     while (true) {
-      if (result.size() >= ebatchSize.value() + 1) {
-        break;
-      }
       Expected<Record> exptRcd = cursor->next();
       if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
         break;
@@ -621,6 +628,58 @@ class IterAllCommand : public Command {
 
       auto valueType = exptRcd.value().getRecordValue().getRecordType();
       if (!isRealEleType(keyType, valueType)) {
+        const auto& rv = exptRcd.value().getRecordValue();
+        if (keyType != RecordType::RT_DATA_META ||
+            (rv.getTtl() != 0 && currentTs > rv.getTtl())) {
+          continue;
+        }
+        // the elements packed in a meta, or in the nodes of a chunked
+        // list, are listed as its subkeys, a packed collection is never
+        // split across batches
+        if (valueType == RecordType::RT_LIST_META) {
+          auto expLm = ListMetaValue::decode(rv.getValue());
+          if (!expLm.ok()) {
+            return expLm.status();
+          }
+          if (!expLm.value().isChunked()) {
+            continue;
+          }
+          if (result.size() >= ebatchSize.value()) {
+            nextCursor = hexlify(exptRcd.value().getRecordKey().encode());
+            break;
+          }
+          QuickList ql(chunkId,
+                       dbid,
+                       exptRcd.value().getRecordKey().getPrimaryKey(),
+                       rv.getVersion(),
+                       expLm.value(),
+                       kvstore);
+          auto eRcds = ql.toEleRecords(ptxn.value());
+          if (!eRcds.ok()) {
+            return eRcds.status();
+          }
+          result.splice(result.end(), eRcds.value());
+          continue;
+        }
+        auto lp = rcd_util::getListPack(rv);
+        if (!lp.ok()) {
+          return lp.status();
+        }
+        if (!lp.value()) {
+          continue;
+        }
+        if (result.size() >= ebatchSize.value()) {
+          nextCursor = hexlify(exptRcd.value().getRecordKey().encode());
+          break;
+        }
+        RecordKey fakeEle(chunkId,
+                          dbid,
+                          rv.getEleType(),
+                          exptRcd.value().getRecordKey().getPrimaryKey(),
+                          "",
+                          rv.getVersion());
+        result.splice(result.end(),
+                      rcd_util::listPackRecords(*lp.value(), fakeEle));
         continue;
       }
 
@@ -633,7 +692,14 @@ class IterAllCommand : public Command {
         RecordKey mk(chunkId, dbid, RecordType::RT_DATA_META, key, "");
         Expected<RecordValue> eValue = kvstore->getKV(mk, ptxn.value());
         if (eValue.ok()) {
+          if (!rcd_util::isSubkeyOf(exptRcd.value().getRecordKey(),
+                                    eValue.value())) {
+            // orphan of a collection deleted lazily
+            continue;
+          }
           targetTtl = eValue.value().getTtl();
+        } else if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
+          continue;
         } else {
           LOG(WARNING) << "Get target ttl for key " << key
                        << " of type: " << rt2Str(keyType) << " in db:" << dbid
@@ -647,14 +713,14 @@ class IterAllCommand : public Command {
         continue;
       }
 
+      if (result.size() >= ebatchSize.value()) {
+        nextCursor = hexlify(exptRcd.value().getRecordKey().encode());
+        break;
+      }
       result.emplace_back(std::move(exptRcd.value()));
     }
 
-    std::string nextCursor;
-    if (result.size() == ebatchSize.value() + 1) {
-      nextCursor = hexlify(result.back().getRecordKey().encode());
-      result.pop_back();
-    } else {
+    if (nextCursor.empty()) {
       nextCursor = "0";
     }
     std::stringstream ss;
@@ -667,13 +733,28 @@ class IterAllCommand : public Command {
       const auto& vt = o.getRecordValue().getRecordType();
       Command::fmtBulk(ss, std::to_string(static_cast<uint32_t>(vt)));
       switch (t) {
-        case RecordType::RT_DATA_META:
+        case RecordType::RT_DATA_META: {
           INVARIANT_D(vt == RecordType::RT_KV);
           Command::fmtBulk(ss, std::to_string(o.getRecordKey().getDbId()));
           Command::fmtBulk(ss, o.getRecordKey().getPrimaryKey());
           Command::fmtBulk(ss, "");
-          Command::fmtBulk(ss, o.getRecordValue().getValue());
+          if (!o.getRecordValue().isPieced()) {
+            Command::fmtBulk(ss, o.getRecordValue().getValue());
+            break;
+          }
+          // the RT_KV_PIECE records are skipped, see Bitmap
+          Bitmap bm(o.getRecordKey().getChunkId(),
+                    o.getRecordKey().getDbId(),
+                    o.getRecordKey().getPrimaryKey(),
+                    o.getRecordValue(),
+                    kvstore);
+          auto eLoad = bm.load(ptxn.value());
+          if (!eLoad.ok()) {
+            return eLoad.status();
+          }
+          Command::fmtBulk(ss, eLoad.value().getValue());
           break;
+        }
 
         case RecordType::RT_HASH_ELE:
         case RecordType::RT_SET_ELE:
@@ -1516,6 +1597,9 @@ class tendisstatCommand : public Command {
       sections.insert("network");
       sections.insert("request");
       sections.insert("req_pool");
+      sections.insert("inline_pool");
+      sections.insert("hotkeys");
+      sections.insert("bigkeys");
       sections.insert("perf");
     } else {
       for (size_t i = 1; i < args.size(); ++i) {
@@ -1565,9 +1649,18 @@ class tendisstatCommand : public Command {
     if (sections.find("req_pool") != sections.end()) {
       serverSections.insert("req_pool");
     }
+    if (sections.find("inline_pool") != sections.end()) {
+      serverSections.insert("inline_pool");
+    }
     if (sections.find("request") != sections.end()) {
       serverSections.insert("request");
     }
+    if (sections.find("hotkeys") != sections.end()) {
+      serverSections.insert("hotkeys");
+    }
+    if (sections.find("bigkeys") != sections.end()) {
+      serverSections.insert("bigkeys");
+    }
 
     svr->appendJSONStat(writer, serverSections);
     if (sections.find("perf") != sections.end()) {
@@ -2146,7 +2239,25 @@ class InfoCommand : public Command {
       std::stringstream ss;
       ss << "# Keyspace\r\n";
 
-      ss << "db0:keys=0,expires=0,avg_ttl=0\r\n";
+      // db0 is always shown, the other dbs only if they have keys
+      std::map<uint32_t, int64_t> dbKeys = {{0, 0}};
+      auto server = sess->getServerEntry();
+      for (uint32_t i = 0; i < server->getKVStoreCount(); ++i) {
+        // don't wait for the stores locked
+        auto expdb = server->getSegmentMgr()->getDb(
+          sess, i, mgl::LockMode::LOCK_IS, false, 0);
+        if (!expdb.ok()) {
+          continue;
+        }
+        auto counts = expdb.value().store->getKeyCounter()->allDbKeys();
+        for (const auto& v : counts) {
+          dbKeys[v.first] += v.second;
+        }
+      }
+      for (const auto& v : dbKeys) {
+        ss << "db" << v.first << ":keys=" << v.second
+           << ",expires=0,avg_ttl=0\r\n";
+      }
 
       ss << "\r\n";
       result << ss.str();
@@ -2212,6 +2323,24 @@ class InfoCommand : public Command {
       uint64_t blockPinnedUsage = server->getBlockCache()->GetPinnedUsage();
       uint64_t blockCapacity = server->getBlockCache()->GetCapacity();
 
+      uint64_t cacheEntries = 0, cacheUsage = 0, cacheHits = 0;
+      uint64_t cacheMisses = 0, cacheEvictions = 0, cacheRejects = 0;
+      for (uint32_t i = 0; i < server->getKVStoreCount(); ++i) {
+        // don't wait for the stores locked
+        auto expdb = server->getSegmentMgr()->getDb(
+          sess, i, mgl::LockMode::LOCK_IS, false, 0);
+        if (!expdb.ok()) {
+          continue;
+        }
+        auto cache = expdb.value().store->getRecordCache();
+        cacheEntries += cache->size();
+        cacheUsage += cache->memUsage();
+        cacheHits += cache->hits.load(std::memory_order_relaxed);
+        cacheMisses += cache->misses.load(std::memory_order_relaxed);
+        cacheEvictions += cache->evictions.load(std::memory_order_relaxed);
+        cacheRejects += cache->rejects.load(std::memory_order_relaxed);
+      }
+
       ss << "# Dataset\r\n";
       ss << "rocksdb.kvstore-count:" << server->getKVStoreCount() << "\r\n";
       ss << "rocksdb.total-sst-files-size:" << total << "\r\n";
@@ -2229,6 +2358,14 @@ class InfoCommand : public Command {
       ss << "rocksdb.estimate-pending-compaction-bytes:" << compaction_pending
          << "\r\n";
       ss << "rocksdb.compaction-pending:" << numCompaction << "\r\n";
+      ss << "record-cache.capacity:"
+         << server->getParams()->recordCacheMB * 1024 * 1024ULL << "\r\n";
+      ss << "record-cache.entries:" << cacheEntries << "\r\n";
+      ss << "record-cache.usage:" << cacheUsage << "\r\n";
+      ss << "record-cache.hits:" << cacheHits << "\r\n";
+      ss << "record-cache.misses:" << cacheMisses << "\r\n";
+      ss << "record-cache.evictions:" << cacheEvictions << "\r\n";
+      ss << "record-cache.rejects:" << cacheRejects << "\r\n";
       ss << "\r\n";
       result << ss.str();
     }
@@ -2487,6 +2624,22 @@ class ObjectCommand : public Command {
       if (arg1 == "refcount") {
         return Command::fmtOne();
       } else if (arg1 == "encoding") {
+        auto lp = rcd_util::getListPack(rv.value());
+        if (!lp.ok()) {
+          return lp.status();
+        }
+        if (lp.value()) {
+          return Command::fmtBulk("listpack");
+        }
+        if (vt == RecordType::RT_LIST_META) {
+          auto expLm = ListMetaValue::decode(rv.value().getValue());
+          if (!expLm.ok()) {
+            return expLm.status();
+          }
+          if (expLm.value().isChunked()) {
+            return Command::fmtBulk("quicklist");
+          }
+        }
         return Command::fmtBulk(m.at(vt));
       } else if (arg1 == "idletime") {
         return Command::fmtLongLong(0);
@@ -3874,6 +4027,44 @@ class TendisadminCommand : public Command {
         auto s = expdb.value().store->recoveryFromBgError();
         RET_IF_ERR(s);
       }
+    } else if (operation == "hotkeys" || operation == "bigkeys") {
+      // tendisadmin hotkeys [command|all] [count]
+      // tendisadmin bigkeys [string|list|hash|set|zset|all] [count]
+      if (args.size() > 4) {
+        return {ErrorCodes::ERR_PARSEOPT, "args size incorrect!"};
+      }
+      std::string filter = args.size() > 2 ? toLower(args[2]) : "all";
+      size_t count = operation == "hotkeys" ? HotKeySampler::DEFAULT_COUNT
+                                            : BigKeySampler::DEFAULT_COUNT;
+      if (args.size() > 3) {
+        auto eCount = tendisplus::stoull(args[3]);
+        RET_IF_ERR_EXPECTED(eCount);
+        count = eCount.value();
+      }
+      const auto server = sess->getServerEntry();
+      rapidjson::StringBuffer sb;
+      rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(sb);
+      writer.StartObject();
+      if (operation == "hotkeys") {
+        server->getHotKeySampler()->appendJSONStat(
+          writer, filter == "all" ? "" : filter, count);
+      } else {
+        const std::map<std::string, RecordType> types = {
+          {"all", RecordType::RT_INVALID},
+          {"string", RecordType::RT_KV},
+          {"list", RecordType::RT_LIST_META},
+          {"hash", RecordType::RT_HASH_META},
+          {"set", RecordType::RT_SET_META},
+          {"zset", RecordType::RT_ZSET_META},
+        };
+        auto it = types.find(filter);
+        if (it == types.end()) {
+          return {ErrorCodes::ERR_PARSEOPT, "invalid type:" + filter};
+        }
+        server->getBigKeySampler()->appendJSONStat(writer, it->second, count);
+      }
+      writer.EndObject();
+      return Command::fmtBulk(std::string(sb.GetString()));
     } else {
       return {ErrorCodes::ERR_PARSEOPT, "invalid operation:" + operation};
     }
@@ -122,60 +122,33 @@ class UnlinkCommand : public Command {
       return locklist.status();
     }
 
-    std::vector<std::string> validKeys;
-    validKeys.reserve(args.size());
-    uint64_t elesNum = 0;
+    // the big collections are deleted lazily by delKey(), only their meta
+    // is deleted in the txn, see Command::isLazyFree()
+    uint64_t total = 0;
     for (size_t i = 1; i < args.size(); ++i) {
-      const std::string& key = args[i];
-      Expected<RecordValue> rv =
-        Command::expireKeyIfNeeded(sess, key, RecordType::RT_DATA_META);
-      if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
-          rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        continue;
-      } else if (!rv.status().ok()) {
-        return rv.status();
+      auto server = sess->getServerEntry();
+      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, args[i]);
+      if (!expdb.ok()) {
+        return expdb.status();
+      }
+
+      PStore kvstore = expdb.value().store;
+      auto ptxn = sess->getCtx()->createTransaction(kvstore);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      Expected<bool> done = Command::delKeyChkExpire(
+        sess, args[i], RecordType::RT_DATA_META, ptxn.value(), true);
+      if (!done.ok()) {
+        return done.status();
       }
-      elesNum += rv.value().getEleCnt();
-      validKeys.emplace_back(std::move(args[i]));
+      total += done.value() ? 1 : 0;
     }
-    uint64_t size = validKeys.size();
-    auto delKeyInTranscation =
-      [](Session* sess,
-         std::vector<std::string>&& keys,
-         std::list<std::unique_ptr<KeyLock>>&& locklist) {
-        for (size_t i = 0; i < keys.size(); ++i) {
-          auto server = sess->getServerEntry();
-          auto expdb = server->getSegmentMgr()->getDbHasLocked(
-                  sess, keys[i]);
-          if (!expdb.ok()) {
-            return;
-          }
-
-          PStore kvstore = expdb.value().store;
-          auto ptxn = sess->getCtx()->createTransaction(kvstore);
-          if (!ptxn.ok()) {
-            LOG(ERROR) << "UnlinkCommand createTransaction failed:"
-              << ptxn.status().toString();
-            return;
-          }
-          delKey(sess, keys[i], RecordType::RT_DATA_META, ptxn.value());
-        }
-        auto s = sess->getCtx()->commitAll("mset(nx)");
-        if (!s.ok()) {
-          LOG(ERROR) << "UnlinkCommand commitAll failed:" << s.toString();
-        }
-      };
-    if (elesNum > 1024) {
-      std::thread unlink(delKeyInTranscation,
-                         sess,
-                         std::move(validKeys),
-                         std::move(locklist.value()));
-      unlink.detach();
-    } else {
-      delKeyInTranscation(
-        sess, std::move(validKeys), std::move(locklist.value()));
+    auto s = sess->getCtx()->commitAll("unlink");
+    if (!s.ok()) {
+      return s;
     }
-    return Command::fmtLongLong(size);
+    return Command::fmtLongLong(total);
   }
 } unlinkCmd;
 
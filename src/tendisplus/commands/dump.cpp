@@ -12,6 +12,8 @@
 #include "tendisplus/commands/dump.h"
 #include "tendisplus/commands/command.h"
 #include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/bitmap.h"
+#include "tendisplus/storage/quicklist.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/redis_port.h"
 #include "tendisplus/storage/record.h"
@@ -461,23 +463,49 @@ class ListSerializer : public Serializer {
      * then compress it using lzf(not implemented), or just write raw to
      * buffer, both can work.*/
 
+    // a chunked list is read node by node, see QuickList
+    std::vector<std::string> elements;
+    if (expListMeta.value().isChunked()) {
+      QuickList ql(expdb.value().chunkId,
+                   _sess->getCtx()->getDbId(),
+                   _key,
+                   _rv.getVersion(),
+                   expListMeta.value(),
+                   kvstore);
+      auto eRange = ql.range(0, len - 1, ptxn.value());
+      if (!eRange.ok()) {
+        return eRange.status();
+      }
+      elements = std::move(eRange.value());
+      if (elements.size() != len) {
+        return {ErrorCodes::ERR_INTERNAL, "invalid list"};
+      }
+    }
+
     uint32_t byteSz(0);
     uint32_t lenSz(0);
     std::vector<std::string> ziplist;
     size_t zlCnt(0);
     for (size_t i = head; i != tail; i++) {
-      RecordKey nodeKey(expdb.value().chunkId,
-                        _sess->getCtx()->getDbId(),
-                        RecordType::RT_LIST_ELE,
-                        _key,
-                        std::to_string(i));
-      auto expNodeVal = kvstore->getKV(nodeKey, ptxn.value());
-      if (!expNodeVal.ok()) {
-        return expNodeVal.status();
+      std::string value;
+      if (expListMeta.value().isChunked()) {
+        value = std::move(elements[i - head]);
+      } else {
+        RecordKey nodeKey(expdb.value().chunkId,
+                          _sess->getCtx()->getDbId(),
+                          RecordType::RT_LIST_ELE,
+                          _key,
+                          std::to_string(i),
+                          _rv.getVersion());
+        auto expNodeVal = kvstore->getKV(nodeKey, ptxn.value());
+        if (!expNodeVal.ok()) {
+          return expNodeVal.status();
+        }
+        value = std::move(expNodeVal.value().getValue());
       }
-      byteSz += expNodeVal.value().getValue().size();
+      byteSz += value.size();
       lenSz++;
-      ziplist.emplace_back(std::move(expNodeVal.value().getValue()));
+      ziplist.emplace_back(std::move(value));
       if ((byteSz > ZLBYTE_LIMIT || lenSz > ZLLEN_LIMIT) || i == tail - 1) {
         ++zlCnt;
         auto ezlBytes = formatZiplist(payload, &_pos, ziplist, byteSz);
@@ -527,6 +555,14 @@ class SetSerializer : public Serializer {
       return expwr.status();
     }
 
+    if (auto lp = expMeta.value().getListPack()) {
+      for (const auto& v : lp->getEntries()) {
+        Serializer::saveString(payload, &_pos, v.first);
+      }
+      _begin = 0;
+      return _pos - _begin;
+    }
+
     auto server = _sess->getServerEntry();
     auto expdb = server->getSegmentMgr()->getDbHasLocked(_sess, _key);
     if (!expdb.ok()) {
@@ -538,13 +574,13 @@ class SetSerializer : public Serializer {
       return ptxn.status();
     }
 
-    auto cursor = ptxn.value()->createDataCursor();
     RecordKey fakeRk(expdb.value().chunkId,
                      _sess->getCtx()->getDbId(),
                      RecordType::RT_SET_ELE,
                      _key,
-                     "");
-    cursor->seek(fakeRk.prefixPk());
+                     "",
+                     _rv.getVersion());
+    auto cursor = ptxn.value()->createPkCursor(fakeRk.prefixPk());
     while (true) {
       Expected<Record> eRcd = cursor->next();
       if (eRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
@@ -593,8 +629,12 @@ class ZsetSerializer : public Serializer {
       return eMeta.status();
     }
     ZSlMetaValue meta = eMeta.value();
-    SkipList zsl(
-      expdb.value().chunkId, _sess->getCtx()->getDbId(), _key, meta, kvstore);
+    SkipList zsl(expdb.value().chunkId,
+                 _sess->getCtx()->getDbId(),
+                 _key,
+                 meta,
+                 kvstore,
+                 _rv.getVersion());
 
     auto expwr = saveLen(payload, &_pos, zsl.getCount() - 1);
     if (!expwr.ok()) {
@@ -635,6 +675,15 @@ class HashSerializer : public Serializer {
       return expwr.status();
     }
 
+    if (auto lp = expHashMeta.value().getListPack()) {
+      for (const auto& v : lp->getEntries()) {
+        Serializer::saveString(payload, &_pos, v.first);
+        Serializer::saveString(payload, &_pos, v.second);
+      }
+      _begin = 0;
+      return _pos - _begin;
+    }
+
     auto server = _sess->getServerEntry();
     auto expdb = server->getSegmentMgr()->getDbHasLocked(_sess, _key);
     if (!expdb.ok()) {
@@ -651,9 +700,9 @@ class HashSerializer : public Serializer {
                      _sess->getCtx()->getDbId(),
                      RecordType::RT_HASH_ELE,
                      _key,
-                     "");
-    auto cursor = ptxn.value()->createDataCursor();
-    cursor->seek(fakeRk.prefixPk());
+                     "",
+                     _rv.getVersion());
+    auto cursor = ptxn.value()->createPkCursor(fakeRk.prefixPk());
     while (true) {
       Expected<Record> expRcd = cursor->next();
       if (expRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
@@ -689,6 +738,13 @@ Expected<std::unique_ptr<Serializer>> getSerializer(Session* sess,
   auto type = rv.value().getRecordType();
   switch (type) {
     case RecordType::RT_KV:
+      if (rv.value().isPieced()) {
+        // load the whole string, see Bitmap
+        rv = Command::expireKeyIfNeeded(sess, key, RecordType::RT_KV);
+        if (!rv.ok()) {
+          return rv.status();
+        }
+      }
       ptr = std::move(std::unique_ptr<Serializer>(
         new KvSerializer(sess, key, std::move(rv.value()))));
       break;
@@ -1061,6 +1117,11 @@ class SetDeserializer : public Deserializer {
                      _key,
                      "");
     SetMetaValue sm;
+    auto eVersion = Command::getSubkeyVersion(
+      kvstore, metaRk, {ErrorCodes::ERR_NOTFOUND, ""}, txn);
+    if (!eVersion.ok()) {
+      return eVersion.status();
+    }
 
     for (size_t i = 0; i < len; i++) {
       std::string ele = loadString(_payload, &_pos);
@@ -1068,7 +1129,8 @@ class SetDeserializer : public Deserializer {
                    metaRk.getDbId(),
                    RecordType::RT_SET_ELE,
                    metaRk.getPrimaryKey(),
-                   std::move(ele));
+                   std::move(ele),
+                   eVersion.value());
       RecordValue rv("", RecordType::RT_SET_ELE, -1);
       Status s = kvstore->setKV(rk, rv, txn);
       if (!s.ok()) {
@@ -1076,12 +1138,12 @@ class SetDeserializer : public Deserializer {
       }
     }
     sm.setCount(len);
-    Status s = kvstore->setKV(metaRk,
-                              RecordValue(sm.encode(),
-                                          RecordType::RT_SET_META,
-                                          _sess->getCtx()->getVersionEP(),
-                                          _ttl),
-                              txn);
+    RecordValue metaRv(sm.encode(),
+                       RecordType::RT_SET_META,
+                       _sess->getCtx()->getVersionEP(),
+                       _ttl);
+    metaRv.setVersion(eVersion.value());
+    Status s = kvstore->setKV(metaRk, metaRv, txn);
     if (!s.ok()) {
       return s;
     }
@@ -1130,11 +1192,16 @@ class ZsetDeserializer : public Deserializer {
       return eMeta.status();
     }
     INVARIANT_D(eMeta.status().code() == ErrorCodes::ERR_NOTFOUND);
+    auto eVersion = Command::getSubkeyVersion(kvstore, rk, eMeta, txn);
+    if (!eVersion.ok()) {
+      return eVersion.status();
+    }
     ZSlMetaValue meta(1, 1, 0);
     RecordValue rv(meta.encode(),
                    RecordType::RT_ZSET_META,
                    _sess->getCtx()->getVersionEP(),
                    _ttl);
+    rv.setVersion(eVersion.value());
     Status s = kvstore->setKV(rk, rv, txn);
     if (!s.ok()) {
       return s;
@@ -1143,7 +1210,8 @@ class ZsetDeserializer : public Deserializer {
                      rk.getDbId(),
                      RecordType::RT_ZSET_S_ELE,
                      rk.getPrimaryKey(),
-                     std::to_string(ZSlMetaValue::HEAD_ID));
+                     std::to_string(ZSlMetaValue::HEAD_ID),
+                     eVersion.value());
     ZSlEleValue headVal;
     RecordValue headRv(headVal.encode(), RecordType::RT_ZSET_S_ELE, -1);
     s = kvstore->setKV(headRk, headRv, txn);
@@ -1186,6 +1254,16 @@ class HashDeserializer : public Deserializer {
       return expdb.status();
     }
     PStore kvstore = expdb.value().store;
+    RecordKey metaRk(expdb.value().chunkId,
+                     _sess->getCtx()->getDbId(),
+                     RecordType::RT_HASH_META,
+                     _key,
+                     "");
+    auto eVersion = Command::getSubkeyVersion(
+      kvstore, metaRk, {ErrorCodes::ERR_NOTFOUND, ""}, txn);
+    if (!eVersion.ok()) {
+      return eVersion.status();
+    }
     for (size_t i = 0; i < len; i++) {
       std::string field = loadString(_payload, &_pos);
       std::string value = loadString(_payload, &_pos);
@@ -1194,7 +1272,8 @@ class HashDeserializer : public Deserializer {
                    _sess->getCtx()->getDbId(),
                    RecordType::RT_HASH_ELE,
                    _key,
-                   field);
+                   field,
+                   eVersion.value());
       RecordValue rv(value, RecordType::RT_HASH_ELE, -1);
       Status s = kvstore->setKV(rk, rv, txn);
       if (!s.ok()) {
@@ -1202,17 +1281,13 @@ class HashDeserializer : public Deserializer {
       }
     }
 
-    RecordKey metaRk(expdb.value().chunkId,
-                     _sess->getCtx()->getDbId(),
-                     RecordType::RT_HASH_META,
-                     _key,
-                     "");
     HashMetaValue hashMeta;
     hashMeta.setCount(len);
     RecordValue metaRv(std::move(hashMeta.encode()),
                        RecordType::RT_HASH_META,
                        _sess->getCtx()->getVersionEP(),
                        _ttl);
+    metaRv.setVersion(eVersion.value());
     Status s = kvstore->setKV(metaRk, metaRv, txn);
     if (!s.ok()) {
       return s;
@@ -1330,7 +1405,25 @@ class ListDeserializer : public Deserializer {
                      _key,
                      "");
     PStore kvstore = expdb.value().store;
+    auto eVersion = Command::getSubkeyVersion(
+      kvstore, metaRk, {ErrorCodes::ERR_NOTFOUND, ""}, txn);
+    if (!eVersion.ok()) {
+      return eVersion.status();
+    }
     ListMetaValue lm(INITSEQ, INITSEQ);
+    // a new list is chunked, see QuickList
+    std::unique_ptr<QuickList> ql;
+    auto params = server->getParams();
+    if (params->listMaxNodeEntries > 0) {
+      ql = std::make_unique<QuickList>(metaRk.getChunkId(),
+                                       metaRk.getDbId(),
+                                       metaRk.getPrimaryKey(),
+                                       eVersion.value(),
+                                       lm,
+                                       kvstore,
+                                       params->listMaxNodeEntries,
+                                       params->listMaxNodeBytes);
+    }
 
     uint64_t head = lm.getHead();
     uint64_t tail = lm.getTail();
@@ -1343,6 +1436,13 @@ class ListDeserializer : public Deserializer {
         return expZl.status();
       }
       const auto& zl = expZl.value();
+      if (ql) {
+        Status s = ql->push(zl, false, txn);
+        if (!s.ok()) {
+          return s;
+        }
+        continue;
+      }
       uint64_t idx;
       for (auto iter = zl.begin(); iter != zl.end(); iter++) {
         idx = tail++;
@@ -1350,7 +1450,8 @@ class ListDeserializer : public Deserializer {
                      metaRk.getDbId(),
                      RecordType::RT_LIST_ELE,
                      metaRk.getPrimaryKey(),
-                     std::to_string(idx));
+                     std::to_string(idx),
+                     eVersion.value());
         RecordValue rv(std::move(*iter), RecordType::RT_LIST_ELE, -1);
         Status s = kvstore->setKV(rk, rv, txn);
         if (!s.ok()) {
@@ -1358,12 +1459,17 @@ class ListDeserializer : public Deserializer {
         }
       }
     }
-    lm.setHead(head);
-    lm.setTail(tail);
+    if (ql) {
+      lm = ql->getMeta();
+    } else {
+      lm.setHead(head);
+      lm.setTail(tail);
+    }
     RecordValue metaRv(lm.encode(),
                        RecordType::RT_LIST_META,
                        _sess->getCtx()->getVersionEP(),
                        _ttl);
+    metaRv.setVersion(eVersion.value());
     Status s = kvstore->setKV(metaRk, metaRv, txn);
     if (!s.ok()) {
       return s;
@@ -1672,6 +1778,27 @@ Expected<std::string> recordList2Aof(const std::list<Record>& list) {
   return ss.str();
 }
 
+// the elements of a chunked list as RT_LIST_ELE records, or nothing if
+// rv is not a chunked list, see QuickList
+static Expected<std::list<Record>> chunkedListRecords(uint32_t chunkId,
+                                                      uint32_t dbid,
+                                                      const std::string& key,
+                                                      const RecordValue& rv,
+                                                      PStore kvstore,
+                                                      Transaction* txn) {
+  std::list<Record> result;
+  if (rv.getRecordType() != RecordType::RT_LIST_META) {
+    return std::move(result);
+  }
+  auto expLm = ListMetaValue::decode(rv.getValue());
+  RET_IF_ERR_EXPECTED(expLm);
+  if (!expLm.value().isChunked()) {
+    return std::move(result);
+  }
+  QuickList ql(chunkId, dbid, key, rv.getVersion(), expLm.value(), kvstore);
+  return ql.toEleRecords(txn);
+}
+
 Expected<std::string> key2Aof(Session* sess, const std::string& key) {
   auto dbid = sess->getCtx()->getDbId();
   auto server = sess->getServerEntry();
@@ -1693,28 +1820,52 @@ Expected<std::string> key2Aof(Session* sess, const std::string& key) {
 
   auto type = eValue.value().getEleType();
 
-  RecordKey fakeEle(expdb.value().chunkId, dbid, type, key, "");
+  RecordKey fakeEle(expdb.value().chunkId,
+                    dbid,
+                    type,
+                    key,
+                    "",
+                    eValue.value().getVersion());
   std::string prefix = fakeEle.prefixPk();
-  auto cursor = ptxn.value()->createDataCursor();
-  cursor->seek(prefix);
 
   std::list<Record> result;
   uint64_t count = 0;
-  while (true) {
-    Expected<Record> exptRcd = cursor->next();
-    if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-      break;
-    }
-    if (!exptRcd.ok()) {
-      return exptRcd.status();
-    }
-    Record& rcd = exptRcd.value();
-    const RecordKey& rcdKey = rcd.getRecordKey();
-    if (rcdKey.prefixPk() != prefix) {
-      break;
+  auto lp = rcd_util::getListPack(eValue.value());
+  RET_IF_ERR_EXPECTED(lp);
+  auto chunked = chunkedListRecords(
+    expdb.value().chunkId, dbid, key, eValue.value(), kvstore, ptxn.value());
+  RET_IF_ERR_EXPECTED(chunked);
+  if (eValue.value().isPieced()) {
+    // the pieces are sent as the whole string, see Bitmap
+    Bitmap bm(expdb.value().chunkId, dbid, key, eValue.value(), kvstore);
+    auto eLoad = bm.load(ptxn.value());
+    RET_IF_ERR_EXPECTED(eLoad);
+    result.emplace_back(mk, std::move(eLoad.value()));
+    count = 1;
+  } else if (lp.value()) {
+    result = rcd_util::listPackRecords(*lp.value(), fakeEle);
+    count = result.size();
+  } else if (!chunked.value().empty()) {
+    result = std::move(chunked.value());
+    count = result.size();
+  } else {
+    auto cursor = ptxn.value()->createPkCursor(prefix);
+    while (true) {
+      Expected<Record> exptRcd = cursor->next();
+      if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+        break;
+      }
+      if (!exptRcd.ok()) {
+        return exptRcd.status();
+      }
+      Record& rcd = exptRcd.value();
+      const RecordKey& rcdKey = rcd.getRecordKey();
+      if (rcdKey.prefixPk() != prefix) {
+        break;
+      }
+      count++;
+      result.emplace_back(std::move(rcd));
     }
-    count++;
-    result.emplace_back(std::move(rcd));
   }
 
   INVARIANT_D(result.size() > 0);
@@ -1781,11 +1932,14 @@ class RestoreValueCommand : public Command {
     auto ptxn = sess->getCtx()->createTransaction(kvstore);
     RET_IF_ERR_EXPECTED(ptxn);
 
-    RecordKey fakeEle(
-      slotId, pCtx->getDbId(), rv.value().getEleType(), key, "");
+    RecordKey fakeEle(slotId,
+                      pCtx->getDbId(),
+                      rv.value().getEleType(),
+                      key,
+                      "",
+                      rv.value().getVersion());
     std::string prefix = fakeEle.prefixPk();
-    auto cursor = ptxn.value()->createDataCursor();
-    cursor->seek(prefix);
+    auto cursor = ptxn.value()->createPkCursor(prefix);
 
     /* 1.restorevalue_begin  */
     std::stringstream ss;
@@ -1800,28 +1954,50 @@ class RestoreValueCommand : public Command {
     /* 2. set/hmset/sadd/rpush/zadd *n */
     std::list<Record> result;
     uint64_t count = 0;
-    while (true) {
-      Expected<Record> exptRcd = cursor->next();
-      if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-        break;
-      }
-      RET_IF_ERR_EXPECTED(exptRcd);
+    auto lp = rcd_util::getListPack(rv.value());
+    RET_IF_ERR_EXPECTED(lp);
+    auto chunked = chunkedListRecords(
+      slotId, pCtx->getDbId(), key, rv.value(), kvstore, ptxn.value());
+    RET_IF_ERR_EXPECTED(chunked);
+    if (rv.value().isPieced()) {
+      // the pieces are sent as the whole string, see Bitmap
+      Bitmap bm(slotId, pCtx->getDbId(), key, rv.value(), kvstore);
+      auto eLoad = bm.load(ptxn.value());
+      RET_IF_ERR_EXPECTED(eLoad);
+      RecordKey mk(slotId, pCtx->getDbId(), RecordType::RT_KV, key, "");
+      result.emplace_back(mk, std::move(eLoad.value()));
+      count = 1;
+    } else if (lp.value()) {
+      // the packed elements are sent as one batch, see ListPack
+      result = rcd_util::listPackRecords(*lp.value(), fakeEle);
+      count = result.size();
+    } else if (!chunked.value().empty()) {
+      result = std::move(chunked.value());
+      count = result.size();
+    } else {
+      while (true) {
+        Expected<Record> exptRcd = cursor->next();
+        if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+          break;
+        }
+        RET_IF_ERR_EXPECTED(exptRcd);
 
-      Record& rcd = exptRcd.value();
-      const RecordKey& rcdKey = rcd.getRecordKey();
-      if (rcdKey.prefixPk() != prefix) {
-        break;
-      }
-      count++;
-      result.emplace_back(std::move(rcd));
-      if (result.size() >= 1000) {
-        auto eAof = recordList2Aof(result);
-        RET_IF_ERR_EXPECTED(eAof);
+        Record& rcd = exptRcd.value();
+        const RecordKey& rcdKey = rcd.getRecordKey();
+        if (rcdKey.prefixPk() != prefix) {
+          break;
+        }
+        count++;
+        result.emplace_back(std::move(rcd));
+        if (result.size() >= 1000) {
+          auto eAof = recordList2Aof(result);
+          RET_IF_ERR_EXPECTED(eAof);
 
-        auto s = sess->setResponse(eAof.value());
-        RET_IF_ERR(s);
+          auto s = sess->setResponse(eAof.value());
+          RET_IF_ERR(s);
 
-        result.clear();
+          result.clear();
+        }
       }
     }
     INVARIANT_D(count == rv.value().getEleCnt());
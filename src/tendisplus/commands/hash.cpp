@@ -19,10 +19,85 @@
 
 namespace tendisplus {
 
+// a new hash is packed in its meta if hash-max-listpack-entries is set,
+// see ListPack
+void hashNewListPack(Session* sess,
+                     const Expected<RecordValue>& eValue,
+                     HashMetaValue* meta) {
+  if (!eValue.ok() &&
+      sess->getServerEntry()->getParams()->hashMaxListpackEntries > 0) {
+    meta->setListPack(ListPack());
+  }
+}
+
+Expected<std::string> hashGetField(PStore kvstore,
+                                   const HashMetaValue& meta,
+                                   const RecordKey& subRk,
+                                   Transaction* txn) {
+  if (auto lp = meta.getListPack()) {
+    auto v = lp->get(subRk.getSecondaryKey());
+    if (v == nullptr) {
+      return {ErrorCodes::ERR_NOTFOUND, ""};
+    }
+    return *v;
+  }
+  Expected<RecordValue> eVal = kvstore->getKV(subRk, txn);
+  if (!eVal.ok()) {
+    return eVal.status();
+  }
+  return eVal.value().getValue();
+}
+
+Status hashSetField(PStore kvstore,
+                    HashMetaValue* meta,
+                    const RecordKey& subRk,
+                    const RecordValue& subRv,
+                    Transaction* txn) {
+  if (auto lp = meta->getListPack()) {
+    lp->set(subRk.getSecondaryKey(), subRv.getValue());
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  return kvstore->setKV(subRk, subRv, txn);
+}
+
+// move the packed fields to the RT_HASH_ELE records once the hash is
+// beyond hash-max-listpack-entries or hash-max-listpack-value
+Status hashConvertIfNeeded(Session* sess,
+                           PStore kvstore,
+                           const RecordKey& metaRk,
+                           uint64_t version,
+                           HashMetaValue* meta,
+                           Transaction* txn) {
+  auto lp = meta->getListPack();
+  if (lp == nullptr) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  const auto& params = sess->getServerEntry()->getParams();
+  if (lp->fits(params->hashMaxListpackEntries,
+               params->hashMaxListpackValue)) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  for (const auto& v : lp->getEntries()) {
+    RecordKey subRk(metaRk.getChunkId(),
+                    metaRk.getDbId(),
+                    RecordType::RT_HASH_ELE,
+                    metaRk.getPrimaryKey(),
+                    v.first,
+                    version);
+    RecordValue subRv(v.second, RecordType::RT_HASH_ELE, -1);
+    Status s = kvstore->setKV(subRk, subRv, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  meta->resetListPack();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Expected<std::string> hincrfloatGeneric(Session* sess,
                                         const RecordKey& metaRk,
                                         const Expected<RecordValue>& eValue,
-                                        const RecordKey& subRk,
+                                        const std::string& subkey,
                                         long double inc,
                                         PStore kvstore) {
   auto ptxn = sess->getCtx()->createTransaction(kvstore);
@@ -45,12 +120,25 @@ Expected<std::string> hincrfloatGeneric(Session* sess,
     }
     hashMeta = std::move(exptHashMeta.value());
   }  // no else, else not found , so subkeyCount = 0, ttl = 0
-
-  auto getSubkeyExpt = kvstore->getKV(subRk, ptxn.value());
+  hashNewListPack(sess, eValue, &hashMeta);
+
+  auto eVersion =
+    Command::getSubkeyVersion(kvstore, metaRk, eValue, ptxn.value());
+  if (!eVersion.ok()) {
+    return eVersion.status();
+  }
+  RecordKey subRk(metaRk.getChunkId(),
+                  metaRk.getDbId(),
+                  RecordType::RT_HASH_ELE,
+                  metaRk.getPrimaryKey(),
+                  subkey,
+                  eVersion.value());
+  auto getSubkeyExpt =
+    hashGetField(kvstore, hashMeta, subRk, ptxn.value());
   long double nowVal = 0;
   if (getSubkeyExpt.ok()) {
     Expected<long double> val =
-      ::tendisplus::stold(getSubkeyExpt.value().getValue());
+      ::tendisplus::stold(getSubkeyExpt.value());
     if (!val.ok()) {
       return {ErrorCodes::ERR_DECODE, "hash value is not a valid float"};
     }
@@ -65,16 +153,23 @@ Expected<std::string> hincrfloatGeneric(Session* sess,
   nowVal += inc;
   RecordValue newVal(
     ::tendisplus::ldtos(nowVal, true), RecordType::RT_HASH_ELE, -1);
+  Status setStatus =
+    hashSetField(kvstore, &hashMeta, subRk, newVal, ptxn.value());
+  if (!setStatus.ok()) {
+    return setStatus;
+  }
+  setStatus = hashConvertIfNeeded(
+    sess, kvstore, metaRk, eVersion.value(), &hashMeta, ptxn.value());
+  if (!setStatus.ok()) {
+    return setStatus;
+  }
   RecordValue metaValue(hashMeta.encode(),
                         RecordType::RT_HASH_META,
                         sess->getCtx()->getVersionEP(),
                         ttl,
                         eValue);
-  Status setStatus = kvstore->setKV(metaRk, metaValue, ptxn.value());
-  if (!setStatus.ok()) {
-    return setStatus;
-  }
-  setStatus = kvstore->setKV(subRk, newVal, ptxn.value());
+  metaValue.setVersion(eVersion.value());
+  setStatus = kvstore->setKV(metaRk, metaValue, ptxn.value());
   if (!setStatus.ok()) {
     return setStatus;
   }
@@ -90,7 +185,7 @@ Expected<std::string> hincrfloatGeneric(Session* sess,
 Expected<std::string> hincrGeneric(Session* sess,
                                    const RecordKey& metaRk,
                                    const Expected<RecordValue>& eValue,
-                                   const RecordKey& subRk,
+                                   const std::string& subkey,
                                    int64_t inc,
                                    PStore kvstore) {
   auto ptxn = sess->getCtx()->createTransaction(kvstore);
@@ -113,12 +208,25 @@ Expected<std::string> hincrGeneric(Session* sess,
     }
     hashMeta = std::move(exptHashMeta.value());
   }  // no else, else not found , so subkeyCount = 0, ttl = 0
-
-  auto getSubkeyExpt = kvstore->getKV(subRk, ptxn.value());
+  hashNewListPack(sess, eValue, &hashMeta);
+
+  auto eVersion =
+    Command::getSubkeyVersion(kvstore, metaRk, eValue, ptxn.value());
+  if (!eVersion.ok()) {
+    return eVersion.status();
+  }
+  RecordKey subRk(metaRk.getChunkId(),
+                  metaRk.getDbId(),
+                  RecordType::RT_HASH_ELE,
+                  metaRk.getPrimaryKey(),
+                  subkey,
+                  eVersion.value());
+  auto getSubkeyExpt =
+    hashGetField(kvstore, hashMeta, subRk, ptxn.value());
   int64_t nowVal = 0;
   if (getSubkeyExpt.ok()) {
     Expected<int64_t> val =
-      ::tendisplus::stoll(getSubkeyExpt.value().getValue());
+      ::tendisplus::stoll(getSubkeyExpt.value());
     if (!val.ok()) {
       return {ErrorCodes::ERR_DECODE, "hash value is not an integer "};
     }
@@ -136,16 +244,23 @@ Expected<std::string> hincrGeneric(Session* sess,
   }
   nowVal += inc;
   RecordValue newVal(std::to_string(nowVal), RecordType::RT_HASH_ELE, -1);
+  Status setStatus =
+    hashSetField(kvstore, &hashMeta, subRk, newVal, ptxn.value());
+  if (!setStatus.ok()) {
+    return setStatus;
+  }
+  setStatus = hashConvertIfNeeded(
+    sess, kvstore, metaRk, eVersion.value(), &hashMeta, ptxn.value());
+  if (!setStatus.ok()) {
+    return setStatus;
+  }
   RecordValue metaValue(hashMeta.encode(),
                         RecordType::RT_HASH_META,
                         sess->getCtx()->getVersionEP(),
                         ttl,
                         eValue);
-  Status setStatus = kvstore->setKV(metaRk, metaValue, ptxn.value());
-  if (!setStatus.ok()) {
-    return setStatus;
-  }
-  setStatus = kvstore->setKV(subRk, newVal, ptxn.value());
+  metaValue.setVersion(eVersion.value());
+  setStatus = kvstore->setKV(metaRk, metaValue, ptxn.value());
   if (!setStatus.ok()) {
     return setStatus;
   }
@@ -248,18 +363,25 @@ class HExistsCommand : public Command {
       return rv.status();
     }
 
+    Expected<HashMetaValue> exptHashMeta =
+      HashMetaValue::decode(rv.value().getValue());
+    if (!exptHashMeta.ok()) {
+      return exptHashMeta.status();
+    }
     RecordKey subRk(expdb.value().chunkId,
                     pCtx->getDbId(),
                     RecordType::RT_HASH_ELE,
                     key,
-                    subkey);
+                    subkey,
+                    rv.value().getVersion());
     PStore kvstore = expdb.value().store;
 
     auto ptxn = sess->getCtx()->createTransaction(kvstore);
     if (!ptxn.ok()) {
       return ptxn.status();
     }
-    Expected<RecordValue> eVal = kvstore->getKV(subRk, ptxn.value());
+    auto eVal =
+      hashGetField(kvstore, exptHashMeta.value(), subRk, ptxn.value());
     if (eVal.ok()) {
       return Command::fmtOne();
     } else if (eVal.status().code() == ErrorCodes::ERR_NOTFOUND) {
@@ -320,6 +442,24 @@ class HAllCommand : public Command {
                      RecordType::RT_HASH_META,
                      key,
                      "");
+    Expected<HashMetaValue> exptHashMeta =
+      HashMetaValue::decode(rv.value().getValue());
+    if (!exptHashMeta.ok()) {
+      return exptHashMeta.status();
+    }
+    if (auto lp = exptHashMeta.value().getListPack()) {
+      std::list<Record> result;
+      for (const auto& v : lp->getEntries()) {
+        result.emplace_back(RecordKey(metaRk.getChunkId(),
+                                      metaRk.getDbId(),
+                                      RecordType::RT_HASH_ELE,
+                                      key,
+                                      v.first,
+                                      rv.value().getVersion()),
+                            RecordValue(v.second, RecordType::RT_HASH_ELE, -1));
+      }
+      return std::move(result);
+    }
     // uint32_t storeId = expdb.value().dbId;
     PStore kvstore = expdb.value().store;
 
@@ -331,10 +471,10 @@ class HAllCommand : public Command {
                       metaRk.getDbId(),
                       RecordType::RT_HASH_ELE,
                       metaRk.getPrimaryKey(),
-                      "");
+                      "",
+                      rv.value().getVersion());
     std::string prefix = fakeEle.prefixPk();
-    auto cursor = ptxn.value()->createDataCursor();
-    cursor->seek(prefix);
+    auto cursor = ptxn.value()->createPkCursor(prefix);
 
     std::list<Record> result;
     while (true) {
@@ -365,13 +505,19 @@ class HGetAllCommand : public HAllCommand {
     if (!rcds.ok()) {
       return rcds.status();
     }
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rcds.value().size() * 2);
+    std::string rsp;
+    size_t rspLen = 32;
     for (const auto& v : rcds.value()) {
-      Command::fmtBulk(ss, v.getRecordKey().getSecondaryKey());
-      Command::fmtBulk(ss, v.getRecordValue().getValue());
+      rspLen += Command::fmtBulkLen(v.getRecordKey().getSecondaryKey()) +
+        Command::fmtBulkLen(v.getRecordValue().getValue());
     }
-    return ss.str();
+    rsp.reserve(rspLen);
+    Command::fmtMultiBulkLen(rsp, rcds.value().size() * 2);
+    for (const auto& v : rcds.value()) {
+      Command::fmtBulk(rsp, v.getRecordKey().getSecondaryKey());
+      Command::fmtBulk(rsp, v.getRecordValue().getValue());
+    }
+    return std::move(rsp);
   }
 } hgetAllCmd;
 
@@ -384,12 +530,17 @@ class HKeysCommand : public HAllCommand {
     if (!rcds.ok()) {
       return rcds.status();
     }
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rcds.value().size());
+    std::string rsp;
+    size_t rspLen = 32;
     for (const auto& v : rcds.value()) {
-      Command::fmtBulk(ss, v.getRecordKey().getSecondaryKey());
+      rspLen += Command::fmtBulkLen(v.getRecordKey().getSecondaryKey());
     }
-    return ss.str();
+    rsp.reserve(rspLen);
+    Command::fmtMultiBulkLen(rsp, rcds.value().size());
+    for (const auto& v : rcds.value()) {
+      Command::fmtBulk(rsp, v.getRecordKey().getSecondaryKey());
+    }
+    return std::move(rsp);
   }
 } hkeysCmd;
 
@@ -402,12 +553,17 @@ class HValsCommand : public HAllCommand {
     if (!rcds.ok()) {
       return rcds.status();
     }
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rcds.value().size());
+    std::string rsp;
+    size_t rspLen = 32;
     for (const auto& v : rcds.value()) {
-      Command::fmtBulk(ss, v.getRecordValue().getValue());
+      rspLen += Command::fmtBulkLen(v.getRecordValue().getValue());
     }
-    return ss.str();
+    rsp.reserve(rspLen);
+    Command::fmtMultiBulkLen(rsp, rcds.value().size());
+    for (const auto& v : rcds.value()) {
+      Command::fmtBulk(rsp, v.getRecordValue().getValue());
+    }
+    return std::move(rsp);
   }
 } hvalsCmd;
 
@@ -457,20 +613,29 @@ class HGetRecordCommand : public Command {
       return rv.status();
     }
 
+    Expected<HashMetaValue> exptHashMeta =
+      HashMetaValue::decode(rv.value().getValue());
+    if (!exptHashMeta.ok()) {
+      return exptHashMeta.status();
+    }
     RecordKey subRk(expdb.value().chunkId,
                     pCtx->getDbId(),
                     RecordType::RT_HASH_ELE,
                     key,
-                    subkey);
+                    subkey,
+                    rv.value().getVersion());
     PStore kvstore = expdb.value().store;
 
     auto ptxn = sess->getCtx()->createTransaction(kvstore);
     if (!ptxn.ok()) {
       return ptxn.status();
     }
-    Expected<RecordValue> eVal = kvstore->getKV(subRk, ptxn.value());
+    auto eVal =
+      hashGetField(kvstore, exptHashMeta.value(), subRk, ptxn.value());
     if (eVal.ok()) {
-      return std::move(Record(std::move(subRk), std::move(eVal.value())));
+      RecordValue subRv(
+        std::move(eVal.value()), RecordType::RT_HASH_ELE, -1);
+      return std::move(Record(std::move(subRk), std::move(subRv)));
     } else {
       return eVal.status();
     }
@@ -596,11 +761,6 @@ class HIncrByFloatCommand : public Command {
                      RecordType::RT_HASH_META,
                      key,
                      "");
-    RecordKey subRk(expdb.value().chunkId,
-                    pCtx->getDbId(),
-                    RecordType::RT_HASH_ELE,
-                    key,
-                    subkey);
     PStore kvstore = expdb.value().store;
 
     // now, we have no need to deal with expire, though it may still
@@ -613,12 +773,12 @@ class HIncrByFloatCommand : public Command {
     // here maybe one more time io than the original tendis
     for (int32_t i = 0; i < RETRY_CNT - 1; ++i) {
       auto result =
-        hincrfloatGeneric(sess, metaRk, rv, subRk, inc.value(), kvstore);
+        hincrfloatGeneric(sess, metaRk, rv, subkey, inc.value(), kvstore);
       if (result.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
         return result;
       }
     }
-    return hincrfloatGeneric(sess, metaRk, rv, subRk, inc.value(), kvstore);
+    return hincrfloatGeneric(sess, metaRk, rv, subkey, inc.value(), kvstore);
   }
 } hincrbyfloatCmd;
 
@@ -674,12 +834,6 @@ class HIncrByCommand : public Command {
                      RecordType::RT_HASH_META,
                      key,
                      "");
-    // uint32_t storeId = expdb.value().dbId;
-    RecordKey subRk(expdb.value().chunkId,
-                    pCtx->getDbId(),
-                    RecordType::RT_HASH_ELE,
-                    key,
-                    subkey);
     PStore kvstore = expdb.value().store;
 
     // now, we have no need to deal with expire, though it may still
@@ -691,12 +845,13 @@ class HIncrByCommand : public Command {
 
     // here maybe one more time io than the original tendis
     for (int32_t i = 0; i < RETRY_CNT - 1; ++i) {
-      auto result = hincrGeneric(sess, metaRk, rv, subRk, inc.value(), kvstore);
+      auto result =
+        hincrGeneric(sess, metaRk, rv, subkey, inc.value(), kvstore);
       if (result.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
         return result;
       }
     }
-    return hincrGeneric(sess, metaRk, rv, subRk, inc.value(), kvstore);
+    return hincrGeneric(sess, metaRk, rv, subkey, inc.value(), kvstore);
   }
 } hincrbyCommand;
 
@@ -781,13 +936,35 @@ class HMGetGeneric : public Command {
       Command::fmtMultiBulkLen(ss, args.size() - 2);
     }
 
+    Expected<HashMetaValue> exptHashMeta =
+      HashMetaValue::decode(rv.value().getValue());
+    if (!exptHashMeta.ok()) {
+      return exptHashMeta.status();
+    }
+    if (auto lp = exptHashMeta.value().getListPack()) {
+      for (size_t i = 2; i < args.size(); ++i) {
+        auto v = lp->get(args[i]);
+        if (v == nullptr) {
+          Command::fmtNull(ss);
+        } else {
+          Command::fmtBulk(ss, *v);
+        }
+      }
+      return ss.str();
+    }
+
+    std::vector<RecordKey> subKeys;
+    subKeys.reserve(args.size() - 2);
     for (size_t i = 2; i < args.size(); ++i) {
-      RecordKey subKey(expdb.value().chunkId,
-                       pCtx->getDbId(),
-                       RecordType::RT_HASH_ELE,
-                       key,
-                       args[i]);
-      Expected<RecordValue> eValue = kvstore->getKV(subKey, ptxn.value());
+      subKeys.emplace_back(expdb.value().chunkId,
+                           pCtx->getDbId(),
+                           RecordType::RT_HASH_ELE,
+                           key,
+                           args[i],
+                           rv.value().getVersion());
+    }
+    auto eValues = kvstore->getKVs(subKeys, ptxn.value());
+    for (auto& eValue : eValues) {
       if (!eValue.ok()) {
         if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
           Command::fmtNull(ss);
@@ -848,6 +1025,12 @@ Status hmcas(Session* sess,
     return ptxn.status();
   }
 
+  auto eVersion =
+    Command::getSubkeyVersion(kvstore, metaRk, eValue, ptxn.value());
+  if (!eVersion.ok()) {
+    return eVersion.status();
+  }
+
   HashMetaValue hashMeta;
   uint64_t ttl = 0;
   int64_t cas = -1;
@@ -861,6 +1044,7 @@ Status hmcas(Session* sess,
     hashMeta = std::move(exptHashMeta.value());
     cas = eValue.value().getCas();
   }  // no else, else not found , so subkeyCount = 0, ttl = 0, cas = 0
+  hashNewListPack(sess, eValue, &hashMeta);
 
   if (cmp) {
     // kv should exist for comparison
@@ -884,10 +1068,11 @@ Status hmcas(Session* sess,
                  pCtx->getDbId(),
                  RecordType::RT_HASH_ELE,
                  key,
-                 keyPos.first);
-    Expected<RecordValue> rv = kvstore->getKV(rk, ptxn.value());
+                 keyPos.first,
+                 eVersion.value());
+    auto rv = hashGetField(kvstore, hashMeta, rk, ptxn.value());
     if (rv.ok()) {
-      existkvs[keyPos.first] = rv.value().getValue();
+      existkvs[keyPos.first] = rv.value();
     } else if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
       exists = false;
     } else {
@@ -904,11 +1089,12 @@ Status hmcas(Session* sess,
                     pCtx->getDbId(),
                     RecordType::RT_HASH_ELE,
                     key,
-                    keyPos.first);
+                    keyPos.first,
+                    eVersion.value());
     if (eop.value() == OPSET || (!exists && eop.value() == OPADD)) {
       RecordValue subrv(
         subargs[keyPos.second + 2], RecordType::RT_HASH_ELE, -1);
-      Status s = kvstore->setKV(subrk, subrv, ptxn.value());
+      Status s = hashSetField(kvstore, &hashMeta, subrk, subrv, ptxn.value());
       if (!s.ok()) {
         return s;
       }
@@ -923,7 +1109,7 @@ Status hmcas(Session* sess,
       }
       RecordValue subrv(
         std::to_string(ev1.value() + ev.value()), RecordType::RT_HASH_ELE, -1);
-      Status s = kvstore->setKV(subrk, subrv, ptxn.value());
+      Status s = hashSetField(kvstore, &hashMeta, subrk, subrv, ptxn.value());
       if (!s.ok()) {
         return s;
       }
@@ -947,13 +1133,19 @@ Status hmcas(Session* sess,
     }
   }
   hashMeta.setCount(hashMeta.getCount() + uniqkeys.size() - existkvs.size());
+  Status s = hashConvertIfNeeded(
+    sess, kvstore, metaRk, eVersion.value(), &hashMeta, ptxn.value());
+  if (!s.ok()) {
+    return s;
+  }
   RecordValue metaValue(hashMeta.encode(),
                         RecordType::RT_HASH_META,
                         sess->getCtx()->getVersionEP(),
                         ttl,
                         eValue);
   metaValue.setCas(cas);
-  Status s = kvstore->setKV(metaRk, metaValue, ptxn.value());
+  metaValue.setVersion(eVersion.value());
+  s = kvstore->setKV(metaRk, metaValue, ptxn.value());
   if (!s.ok()) {
     return s;
   }
@@ -1151,29 +1343,48 @@ class HMSetGeneric : public Command {
       }
       hashMeta = std::move(exptHashMeta.value());
     }  // no else, else not found , so subkeyCount = 0, ttl = 0
+    hashNewListPack(sess, eValue, &hashMeta);
 
+    auto eVersion =
+      Command::getSubkeyVersion(kvstore, metaRk, eValue, ptxn.value());
+    if (!eVersion.ok()) {
+      return eVersion.status();
+    }
     for (const auto& v : rcds) {
-      auto getSubkeyExpt = kvstore->getKV(v.getRecordKey(), ptxn.value());
+      RecordKey subRk(metaRk.getChunkId(),
+                      metaRk.getDbId(),
+                      RecordType::RT_HASH_ELE,
+                      metaRk.getPrimaryKey(),
+                      v.getRecordKey().getSecondaryKey(),
+                      eVersion.value());
+      auto getSubkeyExpt =
+        hashGetField(kvstore, hashMeta, subRk, ptxn.value());
       if (!getSubkeyExpt.ok()) {
         if (getSubkeyExpt.status().code() != ErrorCodes::ERR_NOTFOUND) {
           return getSubkeyExpt.status();
         }
         inserted += 1;
       }
-      Status setStatus =
-        kvstore->setKV(v.getRecordKey(), v.getRecordValue(), ptxn.value());
+      Status setStatus = hashSetField(
+        kvstore, &hashMeta, subRk, v.getRecordValue(), ptxn.value());
       if (!setStatus.ok()) {
         return setStatus;
       }
     }
     hashMeta.setCount(hashMeta.getCount() + inserted);
+    Status setStatus = hashConvertIfNeeded(
+      sess, kvstore, metaRk, eVersion.value(), &hashMeta, ptxn.value());
+    if (!setStatus.ok()) {
+      return setStatus;
+    }
     RecordValue metaValue(hashMeta.encode(),
                           RecordType::RT_HASH_META,
                           sess->getCtx()->getVersionEP(),
                           ttl,
                           eValue);
     metaValue.setCas(-1);
-    Status setStatus = kvstore->setKV(metaRk, metaValue, ptxn.value());
+    metaValue.setVersion(eVersion.value());
+    setStatus = kvstore->setKV(metaRk, metaValue, ptxn.value());
     if (!setStatus.ok()) {
       return setStatus;
     }
@@ -1296,11 +1507,6 @@ class HSetGeneric : public Command {
                       key,
                       "");
     PStore kvstore = expdb.value().store;
-    RecordKey subKey(expdb.value().chunkId,
-                     pCtx->getDbId(),
-                     RecordType::RT_HASH_ELE,
-                     key,
-                     subkey);
     RecordValue subRv(val, RecordType::RT_HASH_ELE, -1);
 
     // now, we have no need to deal with expire, though it may still
@@ -1312,18 +1518,18 @@ class HSetGeneric : public Command {
 
     // here maybe one more time io than the original tendis
     for (int32_t i = 0; i < RETRY_CNT - 1; ++i) {
-      auto result = hsetGeneric(sess, metaKey, rv, subKey, subRv, kvstore);
+      auto result = hsetGeneric(sess, metaKey, rv, subkey, subRv, kvstore);
       if (result.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
         return result;
       }
     }
-    return hsetGeneric(sess, metaKey, rv, subKey, subRv, kvstore);
+    return hsetGeneric(sess, metaKey, rv, subkey, subRv, kvstore);
   }
 
   Expected<std::string> hsetGeneric(Session* sess,
                                     const RecordKey& metaRk,
                                     const Expected<RecordValue>& eValue,
-                                    const RecordKey& subRk,
+                                    const std::string& subkey,
                                     const RecordValue& subRv,
                                     PStore kvstore) {
     auto ptxn = sess->getCtx()->createTransaction(kvstore);
@@ -1342,9 +1548,22 @@ class HSetGeneric : public Command {
       }
       hashMeta = std::move(exptHashMeta.value());
     }  // no else, else not found , so subkeyCount = 0, ttl = 0
+    hashNewListPack(sess, eValue, &hashMeta);
 
+    auto eVersion =
+      Command::getSubkeyVersion(kvstore, metaRk, eValue, ptxn.value());
+    if (!eVersion.ok()) {
+      return eVersion.status();
+    }
+    RecordKey subRk(metaRk.getChunkId(),
+                    metaRk.getDbId(),
+                    RecordType::RT_HASH_ELE,
+                    metaRk.getPrimaryKey(),
+                    subkey,
+                    eVersion.value());
     bool updated = false;
-    auto getSubkeyExpt = kvstore->getKV(subRk, ptxn.value());
+    auto getSubkeyExpt =
+      hashGetField(kvstore, hashMeta, subRk, ptxn.value());
     if (getSubkeyExpt.ok()) {
       updated = true;
     } else if (getSubkeyExpt.status().code() == ErrorCodes::ERR_NOTFOUND) {
@@ -1358,16 +1577,23 @@ class HSetGeneric : public Command {
       return Command::fmtZero();
     }
 
+    Status setStatus =
+      hashSetField(kvstore, &hashMeta, subRk, subRv, ptxn.value());
+    if (!setStatus.ok()) {
+      return setStatus;
+    }
+    setStatus = hashConvertIfNeeded(
+      sess, kvstore, metaRk, eVersion.value(), &hashMeta, ptxn.value());
+    if (!setStatus.ok()) {
+      return setStatus;
+    }
     RecordValue metaValue(hashMeta.encode(),
                           RecordType::RT_HASH_META,
                           sess->getCtx()->getVersionEP(),
                           ttl,
                           eValue);
-    Status setStatus = kvstore->setKV(metaRk, metaValue, ptxn.value());
-    if (!setStatus.ok()) {
-      return setStatus;
-    }
-    setStatus = kvstore->setKV(subRk, subRv, ptxn.value());
+    metaValue.setVersion(eVersion.value());
+    setStatus = kvstore->setKV(metaRk, metaValue, ptxn.value());
     if (!setStatus.ok()) {
       return setStatus;
     }
@@ -1446,12 +1672,20 @@ class HDelCommand : public Command {
       hashMeta = std::move(exptHashMeta.value());
     }  // no else, else not found , so subkeyCount = 0, ttl = 0
 
+    uint64_t count = hashMeta.getCount();
     for (size_t i = 2; i < args.size(); ++i) {
+      if (auto lp = hashMeta.getListPack()) {
+        if (lp->del(args[i])) {
+          realDel++;
+        }
+        continue;
+      }
       RecordKey subRk(metaKey.getChunkId(),
                       dbId,
                       RecordType::RT_HASH_ELE,
                       metaKey.getPrimaryKey(),
-                      args[i]);
+                      args[i],
+                      eValue.value().getVersion());
       Expected<RecordValue> eVal = kvstore->getKV(subRk, txn);
       if (eVal.status().code() == ErrorCodes::ERR_NOTFOUND) {
         continue;
@@ -1467,15 +1701,15 @@ class HDelCommand : public Command {
     }
 
     // modify meta data
-    INVARIANT_D(realDel <= hashMeta.getCount());
+    INVARIANT_D(realDel <= count);
     Status s;
-    if (realDel >= hashMeta.getCount()) {
-      if (realDel > hashMeta.getCount()) {
+    if (realDel >= count) {
+      if (realDel > count) {
         LOG(ERROR) << "invalid hashmeta of " << metaKey.getPrimaryKey();
       }
       s = Command::delKeyAndTTL(sess, metaKey, eValue.value(), txn);
     } else {
-      hashMeta.setCount(hashMeta.getCount() - realDel);
+      hashMeta.setCount(count - realDel);
       RecordValue metaValue(hashMeta.encode(),
                             RecordType::RT_HASH_META,
                             sess->getCtx()->getVersionEP(),
@@ -1523,15 +1757,6 @@ class HDelCommand : public Command {
                      "");
     PStore kvstore = expdb.value().store;
 
-    std::vector<RecordKey> rcds;
-    for (size_t i = 2; i < args.size(); ++i) {
-      rcds.emplace_back(RecordKey(expdb.value().chunkId,
-                                  pCtx->getDbId(),
-                                  RecordType::RT_HASH_ELE,
-                                  key,
-                                  args[i]));
-    }
-
     for (uint32_t i = 0; i < RETRY_CNT; ++i) {
       auto ptxn = sess->getCtx()->createTransaction(kvstore);
       if (!ptxn.ok()) {
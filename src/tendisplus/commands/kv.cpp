@@ -11,12 +11,16 @@
 #include <vector>
 #include <queue>
 #include <cmath>
+#include <cstring>
+#include <functional>
 #include "glog/logging.h"
 #include "tendisplus/utils/sync_point.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/simd.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/storage/bitmap.h"
 #include "tendisplus/utils/scopeguard.h"
 
 namespace tendisplus {
@@ -132,6 +136,21 @@ Expected<std::string> setGeneric(Session* sess,
   return okReply == "" ? Command::fmtOK() : okReply;
 }
 
+// the meta of a string, a pieced string is not loaded as by
+// Command::expireKeyIfNeeded() with RT_KV, see Bitmap
+Expected<RecordValue> getStringMeta(Session* sess, const std::string& key) {
+  Expected<RecordValue> rv =
+    Command::expireKeyIfNeeded(sess, key, RecordType::RT_DATA_META);
+  if (rv.ok() && rv.value().getRecordType() != RecordType::RT_KV) {
+    return {ErrorCodes::ERR_WRONG_TYPE, ""};
+  }
+  return rv;
+}
+
+uint64_t getStringLen(const RecordValue& rv) {
+  return rv.isPieced() ? rv.getTotalSize() : rv.getValue().size();
+}
+
 class SetCommand : public Command {
  public:
   SetCommand() : Command("set", "wm") {}
@@ -539,8 +558,7 @@ class StrlenCommand : public Command {
     SessionCtx* pCtx = sess->getCtx();
     INVARIANT(pCtx != nullptr);
     const std::string& key = sess->getArgs()[1];
-    Expected<RecordValue> rv =
-      Command::expireKeyIfNeeded(sess, key, RecordType::RT_KV);
+    Expected<RecordValue> rv = getStringMeta(sess, key);
     if (rv.status().code() == ErrorCodes::ERR_EXPIRED) {
       return Command::fmtZero();
     } else if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
@@ -548,7 +566,7 @@ class StrlenCommand : public Command {
     } else if (!rv.status().ok()) {
       return rv.status();
     } else {
-      return Command::fmtLongLong(rv.value().getValue().size());
+      return Command::fmtLongLong(getStringLen(rv.value()));
     }
   }
 } strlenCmd;
@@ -587,8 +605,13 @@ class BitPosCommand : public Command {
     } else {
       return {ErrorCodes::ERR_PARSEOPT, "The bit argument must be 1 or 0."};
     }
-    Expected<RecordValue> rv =
-      Command::expireKeyIfNeeded(sess, key, RecordType::RT_KV);
+    auto server = sess->getServerEntry();
+    auto expdb =
+      server->getSegmentMgr()->getDbWithKeyLock(sess, key, Command::RdLock());
+    if (!expdb.ok()) {
+      return expdb.status();
+    }
+    Expected<RecordValue> rv = getStringMeta(sess, key);
     if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
         rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
       /* If the key does not exist, from our point of view it is an
@@ -604,8 +627,8 @@ class BitPosCommand : public Command {
       return rv.status();
     }
     int64_t start = 0;
-    const std::string& target = rv.value().getValue();
-    int64_t end = target.size() - 1;
+    ssize_t len = getStringLen(rv.value());
+    int64_t end = len - 1;
     if (args.size() == 4 || args.size() == 5) {
       Expected<int64_t> estart = ::tendisplus::stoll(args[3]);
       if (!estart.ok()) {
@@ -621,7 +644,6 @@ class BitPosCommand : public Command {
         endGiven = true;
       }
 
-      ssize_t len = rv.value().getValue().size();
       if (start < 0) {
         start = len + start;
       }
@@ -645,8 +667,27 @@ class BitPosCommand : public Command {
     if (start > end) {
       return Command::fmtLongLong(-1);
     }
-    int64_t result =
-      redis_port::bitPos(target.c_str() + start, end - start + 1, bit);
+    int64_t result = 0;
+    if (rv.value().isPieced()) {
+      auto ptxn = pCtx->createTransaction(expdb.value().store);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      Bitmap bm(expdb.value().chunkId,
+                pCtx->getDbId(),
+                key,
+                rv.value(),
+                expdb.value().store);
+      auto ePos = bm.bitPos(bit, start, end, ptxn.value());
+      if (!ePos.ok()) {
+        return ePos.status();
+      }
+      result = ePos.value();
+    } else {
+      const std::string& target = rv.value().getValue();
+      result =
+        redis_port::bitPos(target.c_str() + start, end - start + 1, bit);
+    }
     if (endGiven && bit == 0 && result == (end - start + 1) * 8) {
       return Command::fmtLongLong(-1);
     }
@@ -681,8 +722,13 @@ class BitCountCommand : public Command {
     SessionCtx* pCtx = sess->getCtx();
     INVARIANT(pCtx != nullptr);
     const std::string& key = sess->getArgs()[1];
-    Expected<RecordValue> rv =
-      Command::expireKeyIfNeeded(sess, key, RecordType::RT_KV);
+    auto server = sess->getServerEntry();
+    auto expdb =
+      server->getSegmentMgr()->getDbWithKeyLock(sess, key, Command::RdLock());
+    if (!expdb.ok()) {
+      return expdb.status();
+    }
+    Expected<RecordValue> rv = getStringMeta(sess, key);
     if (rv.status().code() == ErrorCodes::ERR_EXPIRED) {
       return Command::fmtZero();
     } else if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
@@ -691,8 +737,8 @@ class BitCountCommand : public Command {
       return rv.status();
     }
     int64_t start = 0;
-    const std::string& target = rv.value().getValue();
-    int64_t end = target.size() - 1;
+    ssize_t len = getStringLen(rv.value());
+    int64_t end = len - 1;
     if (sess->getArgs().size() == 4) {
       Expected<int64_t> estart = ::tendisplus::stoll(sess->getArgs()[2]);
       Expected<int64_t> eend = ::tendisplus::stoll(sess->getArgs()[3]);
@@ -704,7 +750,6 @@ class BitCountCommand : public Command {
       if (start < 0 && end < 0 && start > end) {
         return Command::fmtZero();
       }
-      ssize_t len = rv.value().getValue().size();
       if (start < 0) {
         start = len + start;
       }
@@ -728,6 +773,24 @@ class BitCountCommand : public Command {
     if (start > end) {
       return Command::fmtZero();
     }
+    if (rv.value().isPieced()) {
+      // only the pieces in the range are read
+      auto ptxn = pCtx->createTransaction(expdb.value().store);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      Bitmap bm(expdb.value().chunkId,
+                pCtx->getDbId(),
+                key,
+                rv.value(),
+                expdb.value().store);
+      auto eCount = bm.bitCount(start, end, ptxn.value());
+      if (!eCount.ok()) {
+        return eCount.status();
+      }
+      return Command::fmtLongLong(eCount.value());
+    }
+    const std::string& target = rv.value().getValue();
     return Command::fmtLongLong(
       redis_port::popCount(target.c_str() + start, end - start + 1));
   }
@@ -1196,25 +1259,18 @@ class SetBitCommand : public GetSetGeneral {
     return 1;
   }
 
-  Expected<RecordValue> newValueFromOld(
-    Session* sess, const Expected<RecordValue>& oldValue) const {
+  // the bit offset and the bit to set
+  Expected<std::pair<uint64_t, int>> parse(Session* sess) const {
     Expected<uint64_t> epos = ::tendisplus::stoul(sess->getArgs()[2]);
     if (!epos.ok()) {
       return epos.status();
     }
     uint64_t pos = epos.value();
     int on = 0;
-    std::string tomodify;
-    if (oldValue.ok()) {
-      tomodify = oldValue.value().getValue();
-    }
     if ((pos >> 3) >= (512 * 1024 * 1024)) {
       return {ErrorCodes::ERR_PARSEOPT,
               "bit offset is not an integer or out of range"};
     }
-    if ((pos >> 3) > 4 * 1024 * 1024) {
-      LOG(WARNING) << "meet large bitpos:" << pos;
-    }
     if (sess->getArgs()[3] == "1") {
       on = 1;
     } else if (sess->getArgs()[3] == "0") {
@@ -1223,6 +1279,24 @@ class SetBitCommand : public GetSetGeneral {
       return {ErrorCodes::ERR_PARSEOPT,
               "bit is not an integer or out of range"};
     }
+    return std::make_pair(pos, on);
+  }
+
+  Expected<RecordValue> newValueFromOld(
+    Session* sess, const Expected<RecordValue>& oldValue) const {
+    auto eParse = parse(sess);
+    if (!eParse.ok()) {
+      return eParse.status();
+    }
+    uint64_t pos = eParse.value().first;
+    int on = eParse.value().second;
+    std::string tomodify;
+    if (oldValue.ok()) {
+      tomodify = oldValue.value().getValue();
+    }
+    if ((pos >> 3) > 4 * 1024 * 1024) {
+      LOG(WARNING) << "meet large bitpos:" << pos;
+    }
 
     uint64_t byte = (pos >> 3);
     if (tomodify.size() < byte + 1) {
@@ -1245,17 +1319,104 @@ class SetBitCommand : public GetSetGeneral {
       std::move(tomodify), type, sess->getCtx()->getVersionEP(), ttl, oldValue);
   }
 
+  // SETBIT of a pieced string, or of a string which would be longer than
+  // bitmap-piece-size, writes the piece of the bit only, see Bitmap.
+  // A string is pieced at the first time it gets longer than the size.
+  Expected<std::string> runPieced(Session* sess,
+                                  const DbWithLock& db,
+                                  const Expected<RecordValue>& oldValue,
+                                  uint64_t pos,
+                                  int on,
+                                  uint64_t pieceSize) {
+    auto pCtx = sess->getCtx();
+    PStore kvstore = db.store;
+    const std::string& key = sess->getArgs()[1];
+    RecordKey rk(db.chunkId, pCtx->getDbId(), RecordType::RT_KV, key, "");
+    bool pieced = oldValue.ok() && oldValue.value().isPieced();
+    for (int32_t i = 0; i < RETRY_CNT; ++i) {
+      auto ptxn = pCtx->createTransaction(kvstore);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      uint64_t version = 0;
+      if (!pieced) {
+        // the pieces of the strings deleted or overwritten may be still there
+        auto eVersion = Command::getSubkeyVersion(
+          kvstore, rk, {ErrorCodes::ERR_NOTFOUND, ""}, ptxn.value());
+        if (!eVersion.ok()) {
+          return eVersion.status();
+        }
+        version = eVersion.value();
+      }
+      Bitmap bm(db.chunkId,
+                pCtx->getDbId(),
+                key,
+                pieced ? oldValue.value()
+                       : Bitmap::newMeta(oldValue, pieceSize, version),
+                kvstore);
+      if (!pieced && oldValue.ok()) {
+        auto s = bm.setRange(0, oldValue.value().getValue(), ptxn.value());
+        if (!s.ok()) {
+          return s;
+        }
+      }
+      auto eOld = bm.setBit(pos, on, ptxn.value());
+      if (!eOld.ok()) {
+        return eOld.status();
+      }
+      auto s = bm.save(ptxn.value(), pCtx->getVersionEP());
+      if (!s.ok()) {
+        return s;
+      }
+      auto eCmt = pCtx->commitTransaction(ptxn.value());
+      if (eCmt.ok()) {
+        return eOld.value() ? Command::fmtOne() : Command::fmtZero();
+      }
+      if (eCmt.status().code() != ErrorCodes::ERR_COMMIT_RETRY ||
+          i == RETRY_CNT - 1) {
+        return eCmt.status();
+      }
+    }
+    INVARIANT_D(0);
+    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+  }
+
   Expected<std::string> run(Session* sess) final {
+    auto eParse = parse(sess);
+    if (!eParse.ok()) {
+      return eParse.status();
+    }
+    uint64_t pos = eParse.value().first;
+    const std::string& key = sess->getArgs()[1];
+    auto server = sess->getServerEntry();
+    auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
+      sess, key, mgl::LockMode::LOCK_X);
+    if (!expdb.ok()) {
+      return expdb.status();
+    }
+    Expected<RecordValue> oldValue = getStringMeta(sess, key);
+    if (oldValue.status().code() != ErrorCodes::ERR_OK &&
+        oldValue.status().code() != ErrorCodes::ERR_EXPIRED &&
+        oldValue.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return oldValue.status();
+    }
+    uint64_t pieceSize = server->getParams()->bitmapPieceSize;
+    uint64_t len = oldValue.ok() ? getStringLen(oldValue.value()) : 0;
+    if ((oldValue.ok() && oldValue.value().isPieced()) ||
+        (pieceSize > 0 && std::max(len, (pos >> 3) + 1) > pieceSize)) {
+      return runPieced(sess,
+                       expdb.value(),
+                       oldValue,
+                       pos,
+                       eParse.value().second,
+                       pieceSize);
+    }
+
     const Expected<RecordValue>& rv = runGeneral(sess);
     if (!rv.ok()) {
       return rv.status();
     }
 
-    Expected<uint64_t> epos = ::tendisplus::stoul(sess->getArgs()[2]);
-    if (!epos.ok()) {
-      return epos.status();
-    }
-    uint64_t pos = epos.value();
     std::string toreturn = rv.value().getValue();
 
     uint64_t byte = (pos >> 3);
@@ -1693,23 +1854,26 @@ class MGetCommand : public Command {
       return locklist.status();
     }
 
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, sess->getArgs().size() - 1);
-    for (size_t i = 1; i < sess->getArgs().size(); ++i) {
-      const std::string& key = sess->getArgs()[i];
-      Expected<RecordValue> rv =
-        Command::expireKeyIfNeeded(sess, key, RecordType::RT_KV);
+    std::vector<std::string> keys(args.begin() + 1, args.end());
+    auto erv = Command::expireKeysIfNeeded(sess, keys, RecordType::RT_KV);
+    if (!erv.ok()) {
+      return erv.status();
+    }
+
+    std::string rsp;
+    Command::fmtMultiBulkLen(rsp, keys.size());
+    for (auto& rv : erv.value()) {
       if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
           rv.status().code() == ErrorCodes::ERR_NOTFOUND ||
           rv.status().code() == ErrorCodes::ERR_WRONG_TYPE) {
-        Command::fmtNull(ss);
+        Command::fmtNull(rsp);
         continue;
       } else if (!rv.status().ok()) {
         return rv.status();
       }
-      Command::fmtBulk(ss, rv.value().getValue());
+      Command::fmtBulk(rsp, rv.value().getValue());
     }
-    return ss.str();
+    return std::move(rsp);
   }
 } mgetCmd;
 
@@ -1775,23 +1939,39 @@ class BitopCommand : public Command {
     }
 
     size_t numKeys = args.size() - 3;
-    size_t maxLen = 0;
-    std::vector<std::string> vals;
+    uint64_t maxLen = 0;
+    // a pieced source is read by pieces, see Bitmap
+    std::vector<std::string> vals(numKeys);
+    std::vector<std::unique_ptr<Bitmap>> bitmaps(numKeys);
+    std::vector<std::unique_ptr<Transaction>> txns(numKeys);
     for (size_t j = 0; j < numKeys; ++j) {
-      Expected<RecordValue> rv =
-        Command::expireKeyIfNeeded(sess, args[j + 3], RecordType::RT_KV);
+      Expected<RecordValue> rv = getStringMeta(sess, args[j + 3]);
       if (rv.status().code() == ErrorCodes::ERR_EXPIRED) {
-        vals.push_back("");
+        continue;
       } else if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        vals.push_back("");
+        continue;
       } else if (!rv.status().ok()) {
         return rv.status();
-      } else {
-        vals.push_back(rv.value().getValue());
-        if (vals[j].size() > maxLen) {
-          maxLen = vals[j].size();
-        }
       }
+      maxLen = std::max(maxLen, getStringLen(rv.value()));
+      if (!rv.value().isPieced()) {
+        vals[j] = rv.value().getValue();
+        continue;
+      }
+      auto srcdb = server->getSegmentMgr()->getDbHasLocked(sess, args[j + 3]);
+      if (!srcdb.ok()) {
+        return srcdb.status();
+      }
+      auto ptxn = srcdb.value().store->createTransaction(sess);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      txns[j] = std::move(ptxn.value());
+      bitmaps[j] = std::make_unique<Bitmap>(srcdb.value().chunkId,
+                                            pCtx->getDbId(),
+                                            args[j + 3],
+                                            rv.value(),
+                                            srcdb.value().store);
     }
     if (maxLen == 0) {
       auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
@@ -1813,30 +1993,50 @@ class BitopCommand : public Command {
       }
       return Command::fmtZero();
     }
-    std::string result(maxLen, 0);
-    for (size_t i = 0; i < maxLen; ++i) {
-      unsigned char output = (vals[0].size() <= i) ? 0 : vals[0][i];
-      if (op == Op::BITOP_NOT)
-        output = ~output;
-      for (size_t j = 1; j < numKeys; ++j) {
-        unsigned char byte = (vals[j].size() <= i) ? 0 : vals[j][i];
+
+    // the bytes in [offset, offset + len) of the result
+    auto calc = [&](uint64_t offset, uint64_t len) -> Expected<std::string> {
+      std::string result(len, 0);
+      for (size_t j = 0; j < numKeys; ++j) {
+        std::string val;
+        if (bitmaps[j]) {
+          auto eRange =
+            bitmaps[j]->getRange(offset, offset + len - 1, txns[j].get());
+          if (!eRange.ok()) {
+            return eRange.status();
+          }
+          val = std::move(eRange.value());
+        } else if (offset < vals[j].size()) {
+          val = vals[j].substr(offset, len);
+        }
+        // the bytes beyond val are zeros
+        size_t n = std::min(val.size(), static_cast<size_t>(len));
+        uint8_t* dst = reinterpret_cast<uint8_t*>(&result[0]);
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(val.data());
+        if (j == 0) {
+          memcpy(dst, src, n);
+          if (op == Op::BITOP_NOT) {
+            simd::bitNot(dst, len);
+          }
+          continue;
+        }
         switch (op) {
           case Op::BITOP_AND:
-            output &= byte;
+            simd::bitAnd(dst, src, n);
+            memset(dst + n, 0, len - n);
             break;
           case Op::BITOP_OR:
-            output |= byte;
+            simd::bitOr(dst, src, n);
             break;
           case Op::BITOP_XOR:
-            output ^= byte;
+            simd::bitXor(dst, src, n);
             break;
           default:
             INVARIANT_D(0);
         }
       }
-      result[i] = output;
-    }
-
+      return result;
+    };
 
     auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
             sess, targetKey, mgl::LockMode::LOCK_X);
@@ -1845,6 +2045,16 @@ class BitopCommand : public Command {
     }
     PStore kvstore = expdb.value().store;
 
+    uint64_t pieceSize = server->getParams()->bitmapPieceSize;
+    if (pieceSize > 0 && maxLen > pieceSize) {
+      return storePieced(sess, expdb.value(), maxLen, pieceSize, calc);
+    }
+    auto eResult = calc(0, maxLen);
+    if (!eResult.ok()) {
+      return eResult.status();
+    }
+    const std::string& result = eResult.value();
+
     RecordKey rk(
       expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_KV, targetKey, "");
     RecordValue rv(result, RecordType::RT_KV, pCtx->getVersionEP());
@@ -1878,6 +2088,70 @@ class BitopCommand : public Command {
     INVARIANT_D(0);
     return {ErrorCodes::ERR_INTERNAL, "not reachable"};
   }
+
+ private:
+  // store the result of maxLen bytes in pieces, calc(offset, len) gives
+  // the bytes of a piece, so the whole result is never in memory
+  Expected<std::string> storePieced(
+    Session* sess,
+    const DbWithLock& db,
+    uint64_t maxLen,
+    uint64_t pieceSize,
+    const std::function<Expected<std::string>(uint64_t, uint64_t)>& calc) {
+    auto pCtx = sess->getCtx();
+    PStore kvstore = db.store;
+    const std::string& targetKey = sess->getArgs()[2];
+    RecordKey rk(
+      db.chunkId, pCtx->getDbId(), RecordType::RT_KV, targetKey, "");
+    for (int32_t i = 0; i < RETRY_CNT; ++i) {
+      auto ptxn = pCtx->createTransaction(kvstore);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      // the old value of any type is overwritten
+      auto eDel = Command::delKeyChkExpire(
+        sess, targetKey, RecordType::RT_DATA_META, ptxn.value());
+      if (!eDel.ok()) {
+        return eDel.status();
+      }
+      auto eVersion = Command::getSubkeyVersion(
+        kvstore, rk, {ErrorCodes::ERR_NOTFOUND, ""}, ptxn.value());
+      if (!eVersion.ok()) {
+        return eVersion.status();
+      }
+      uint64_t version = eVersion.value();
+      Bitmap bm(db.chunkId,
+                pCtx->getDbId(),
+                targetKey,
+                Bitmap::newMeta(
+                  {ErrorCodes::ERR_NOTFOUND, ""}, pieceSize, version),
+                kvstore);
+      for (uint64_t offset = 0; offset < maxLen; offset += pieceSize) {
+        auto ePiece = calc(offset, std::min(pieceSize, maxLen - offset));
+        if (!ePiece.ok()) {
+          return ePiece.status();
+        }
+        auto s = bm.setRange(offset, ePiece.value(), ptxn.value());
+        if (!s.ok()) {
+          return s;
+        }
+      }
+      auto s = bm.save(ptxn.value(), pCtx->getVersionEP());
+      if (!s.ok()) {
+        return s;
+      }
+      auto eCmt = pCtx->commitTransaction(ptxn.value());
+      if (eCmt.ok()) {
+        return Command::fmtLongLong(maxLen);
+      }
+      if (eCmt.status().code() != ErrorCodes::ERR_COMMIT_RETRY ||
+          i == RETRY_CNT - 1) {
+        return eCmt.status();
+      }
+    }
+    INVARIANT_D(0);
+    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+  }
 } bitopCmd;
 
 class MSetGenericCommand : public Command {
@@ -2144,8 +2418,16 @@ class RenameGenericCommand : public Command {
       return s;
     }
 
-    // set new meta k/v
-    s = dststore->setKV(dstRk, rv.value(), dptxn.value());
+    // set new meta k/v, the subkeys of dst deleted lazily may be still
+    // there, so the moved subkeys need a version of dst's own
+    auto eVersion = Command::getSubkeyVersion(
+      dststore, dstRk, {ErrorCodes::ERR_NOTFOUND, ""}, dptxn.value());
+    if (!eVersion.ok()) {
+      return eVersion.status();
+    }
+    RecordValue dstRv(rv.value());
+    dstRv.setVersion(eVersion.value());
+    s = dststore->setKV(dstRk, dstRv, dptxn.value());
     if (!s.ok()) {
       return s;
     }
@@ -2166,7 +2448,8 @@ class RenameGenericCommand : public Command {
       }
     }
 
-    if (rv.value().getRecordType() == RecordType::RT_KV) {
+    if (rv.value().getRecordType() == RecordType::RT_KV &&
+        !rv.value().isPieced()) {
       pCtx->commitAll("rename");
       rollback = false;
       return _flagnx ? Command::fmtOne() : Command::fmtOK();
@@ -2177,13 +2460,12 @@ class RenameGenericCommand : public Command {
       return cnt.status();
     }
 
-    std::vector<std::string> prefixes =
-      getEleType(rk, rv.value().getRecordType());
+    std::vector<std::string> prefixes = getEleType(
+      rk, rv.value().getRecordType(), rv.value().getVersion());
     std::vector<Record> pending;
     pending.reserve(cnt.value());
     for (const auto& prefix : prefixes) {
-      auto cursor = sptxn.value()->createDataCursor();
-      cursor->seek(prefix);
+      auto cursor = sptxn.value()->createPkCursor(prefix);
 
       while (true) {
         Expected<Record> expRcd = cursor->next();
@@ -2208,7 +2490,8 @@ class RenameGenericCommand : public Command {
                    dstRk.getDbId(),
                    srcRk.getRecordType(),
                    dst,
-                   srcRk.getSecondaryKey());
+                   srcRk.getSecondaryKey(),
+                   eVersion.value());
       const RecordValue& rv = ele.getRecordValue();
       Status s = dststore->setKV(rk, rv, dptxn.value());
       if (!s.ok()) {
@@ -2233,41 +2516,63 @@ class RenameGenericCommand : public Command {
  private:
   bool _flagnx;
   std::vector<std::string> getEleType(const RecordKey& rk,
-                                      const RecordType& type) {
+                                      const RecordType& type,
+                                      uint64_t version) {
     std::vector<std::string> ret;
-    if (type == RecordType::RT_HASH_META) {
+    if (type == RecordType::RT_KV) {
+      RecordKey fakeRk(rk.getChunkId(),
+                       rk.getDbId(),
+                       RecordType::RT_KV_PIECE,
+                       rk.getPrimaryKey(),
+                       "",
+                       version);
+      ret.push_back(fakeRk.prefixPk());
+    } else if (type == RecordType::RT_HASH_META) {
       RecordKey fakeRk(rk.getChunkId(),
                        rk.getDbId(),
                        RecordType::RT_HASH_ELE,
                        rk.getPrimaryKey(),
-                       "");
+                       "",
+                       version);
       ret.push_back(fakeRk.prefixPk());
     } else if (type == RecordType::RT_LIST_META) {
       RecordKey fakeRk(rk.getChunkId(),
                        rk.getDbId(),
                        RecordType::RT_LIST_ELE,
                        rk.getPrimaryKey(),
-                       "");
+                       "",
+                       version);
       ret.push_back(fakeRk.prefixPk());
+      // the nodes of a chunked list, see QuickList
+      RecordKey fakeRk2(rk.getChunkId(),
+                        rk.getDbId(),
+                        RecordType::RT_LIST_NODE,
+                        rk.getPrimaryKey(),
+                        "",
+                        version);
+      ret.push_back(fakeRk2.prefixPk());
     } else if (type == RecordType::RT_SET_META) {
       RecordKey fakeRk(rk.getChunkId(),
                        rk.getDbId(),
                        RecordType::RT_SET_ELE,
                        rk.getPrimaryKey(),
-                       "");
+                       "",
+                       version);
       ret.push_back(fakeRk.prefixPk());
     } else if (type == RecordType::RT_ZSET_META) {
       RecordKey fakeRk(rk.getChunkId(),
                        rk.getDbId(),
                        RecordType::RT_ZSET_S_ELE,
                        rk.getPrimaryKey(),
-                       "");
+                       "",
+                       version);
       ret.push_back(fakeRk.prefixPk());
       RecordKey fakeRk2(rk.getChunkId(),
                         rk.getDbId(),
                         RecordType::RT_ZSET_H_ELE,
                         rk.getPrimaryKey(),
-                        "");
+                        "",
+                        version);
       ret.push_back(fakeRk2.prefixPk());
     }
     return ret;
@@ -2314,16 +2619,41 @@ class GetBitCommand : public GetGenericCmd {
       return {ErrorCodes::ERR_PARSEOPT,
               "bit offset is not an integer or out of range"};
     }
-    auto v = GetGenericCmd::run(sess);
-    if (v.status().code() == ErrorCodes::ERR_EXPIRED ||
-        v.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    const std::string& key = sess->getArgs()[1];
+    auto server = sess->getServerEntry();
+    auto expdb =
+      server->getSegmentMgr()->getDbWithKeyLock(sess, key, Command::RdLock());
+    if (!expdb.ok()) {
+      return expdb.status();
+    }
+    auto rv = getStringMeta(sess, key);
+    if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
+        rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
       return Command::fmtZero();
     }
-    if (!v.ok()) {
-      return v.status();
+    if (!rv.ok()) {
+      return rv.status();
+    }
+    if (rv.value().isPieced()) {
+      // only the piece of the bit is read
+      auto pCtx = sess->getCtx();
+      auto ptxn = pCtx->createTransaction(expdb.value().store);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      Bitmap bm(expdb.value().chunkId,
+                pCtx->getDbId(),
+                key,
+                rv.value(),
+                expdb.value().store);
+      auto eBit = bm.getBit(pos, ptxn.value());
+      if (!eBit.ok()) {
+        return eBit.status();
+      }
+      return eBit.value() ? Command::fmtOne() : Command::fmtZero();
     }
 
-    std::string bitValue = v.value();
+    const std::string& bitValue = rv.value().getValue();
     size_t byte, bit;
     uint8_t bitval = 0;
 
@@ -15,6 +15,7 @@
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/scopeguard.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/storage/quicklist.h"
 
 namespace tendisplus {
 
@@ -27,6 +28,49 @@ enum class ListPos {
   LP_TAIL,
 };
 
+// the new lists are chunked if list-max-node-entries > 0, see QuickList
+bool newListChunked(Session* sess) {
+  return sess->getServerEntry()->getParams()->listMaxNodeEntries > 0;
+}
+
+QuickList makeQuickList(Session* sess,
+                        PStore kvstore,
+                        const RecordKey& metaRk,
+                        uint64_t version,
+                        const ListMetaValue& lm) {
+  auto params = sess->getServerEntry()->getParams();
+  return QuickList(metaRk.getChunkId(),
+                   metaRk.getDbId(),
+                   metaRk.getPrimaryKey(),
+                   version,
+                   lm,
+                   kvstore,
+                   params->listMaxNodeEntries,
+                   params->listMaxNodeBytes);
+}
+
+// write the meta of a chunked list, or delete the key if it's empty
+Status saveQuickList(Session* sess,
+                     PStore kvstore,
+                     Transaction* txn,
+                     const RecordKey& metaRk,
+                     const Expected<RecordValue>& rv,
+                     uint64_t version,
+                     const QuickList& ql) {
+  if (ql.size() == 0) {
+    INVARIANT_D(rv.ok());
+    return rv.ok() ? Command::delKeyAndTTL(sess, metaRk, rv.value(), txn)
+                   : rv.status();
+  }
+  RecordValue metaValue(ql.getMeta().encode(),
+                        RecordType::RT_LIST_META,
+                        sess->getCtx()->getVersionEP(),
+                        rv.ok() ? rv.value().getTtl() : 0,
+                        rv);
+  metaValue.setVersion(version);
+  return kvstore->setKV(metaRk, metaValue, txn);
+}
+
 Expected<std::string> genericPop(Session* sess,
                                  PStore kvstore,
                                  Transaction* txn,
@@ -47,6 +91,20 @@ Expected<std::string> genericPop(Session* sess,
   }
   lm = std::move(exptLm.value());
 
+  if (lm.isChunked()) {
+    uint64_t version = rv.value().getVersion();
+    auto ql = makeQuickList(sess, kvstore, metaRk, version, lm);
+    auto eValue = ql.pop(pos == ListPos::LP_HEAD, txn);
+    if (!eValue.ok()) {
+      return eValue.status();
+    }
+    Status s = saveQuickList(sess, kvstore, txn, metaRk, rv, version, ql);
+    if (!s.ok()) {
+      return s;
+    }
+    return std::move(eValue.value());
+  }
+
   uint64_t head = lm.getHead();
   uint64_t tail = lm.getTail();
   INVARIANT_D(head != tail);
@@ -63,7 +121,8 @@ Expected<std::string> genericPop(Session* sess,
                   metaRk.getDbId(),
                   RecordType::RT_LIST_ELE,
                   metaRk.getPrimaryKey(),
-                  std::to_string(idx));
+                  std::to_string(idx),
+                  rv.value().getVersion());
   Expected<RecordValue> subRv = kvstore->getKV(subRk, txn);
   if (!subRv.ok()) {
     return subRv.status();
@@ -118,6 +177,22 @@ Expected<std::string> genericPush(Session* sess,
     return Command::fmtZero();
   }
 
+  auto eVersion = Command::getSubkeyVersion(kvstore, metaRk, rv, txn);
+  if (!eVersion.ok()) {
+    return eVersion.status();
+  }
+  if (lm.isChunked() || (!rv.ok() && newListChunked(sess))) {
+    auto ql = makeQuickList(sess, kvstore, metaRk, eVersion.value(), lm);
+    Status s = ql.push(args, pos == ListPos::LP_HEAD, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    s = saveQuickList(sess, kvstore, txn, metaRk, rv, eVersion.value(), ql);
+    if (!s.ok()) {
+      return s;
+    }
+    return Command::fmtLongLong(ql.size());
+  }
   uint64_t head = lm.getHead();
   uint64_t tail = lm.getTail();
   for (size_t i = 0; i < args.size(); ++i) {
@@ -131,7 +206,8 @@ Expected<std::string> genericPush(Session* sess,
                     metaRk.getDbId(),
                     RecordType::RT_LIST_ELE,
                     metaRk.getPrimaryKey(),
-                    std::to_string(idx));
+                    std::to_string(idx),
+                    eVersion.value());
     RecordValue subRv(args[i], RecordType::RT_LIST_ELE, -1);
     Status s = kvstore->setKV(subRk, subRv, txn);
     if (!s.ok()) {
@@ -140,13 +216,13 @@ Expected<std::string> genericPush(Session* sess,
   }
   lm.setHead(head);
   lm.setTail(tail);
-  Status s = kvstore->setKV(metaRk,
-                            RecordValue(lm.encode(),
-                                        RecordType::RT_LIST_META,
-                                        sess->getCtx()->getVersionEP(),
-                                        ttl,
-                                        rv),
-                            txn);
+  RecordValue metaValue(lm.encode(),
+                        RecordType::RT_LIST_META,
+                        sess->getCtx()->getVersionEP(),
+                        ttl,
+                        rv);
+  metaValue.setVersion(eVersion.value());
+  Status s = kvstore->setKV(metaRk, metaValue, txn);
   if (!s.ok()) {
     return s;
   }
@@ -621,15 +697,31 @@ class LtrimCommand : public Command {
     }
     uint64_t head = lm.getHead();
     uint64_t cnt = 0;
-    auto functor = [kvstore, sess, &cnt, &ptxn, &mk](int64_t start,
-                                                    int64_t end) -> Status {
+    uint64_t version = rv.value().getVersion();
+    if (lm.isChunked()) {
+      // the nodes out of the range are deleted in one txn, they are much
+      // fewer than the elements
+      auto ql = makeQuickList(sess, kvstore, mk, version, lm);
+      auto st = ql.trim(start, end, ptxn.value());
+      if (!st.ok()) {
+        return st;
+      }
+      st = saveQuickList(sess, kvstore, ptxn.value(), mk, rv, version, ql);
+      if (!st.ok()) {
+        return st;
+      }
+      return sess->getCtx()->commitTransaction(ptxn.value()).status();
+    }
+    auto functor = [kvstore, sess, &cnt, &ptxn, &mk, version](
+                     int64_t start, int64_t end) -> Status {
       SessionCtx* pCtx = sess->getCtx();
       for (int64_t i = start; i < end; ++i) {
         RecordKey subRk(mk.getChunkId(),
                         pCtx->getDbId(),
                         RecordType::RT_LIST_ELE,
                         mk.getPrimaryKey(),
-                        std::to_string(i));
+                        std::to_string(i),
+                        version);
         Status s = kvstore->delKV(subRk, ptxn.value());
         if (!s.ok()) {
           return s;
@@ -845,24 +937,44 @@ class LRangeCommand : public Command {
       end = len - 1;
     }
     int64_t rangelen = (end - start) + 1;
+    if (lm.isChunked()) {
+      RecordKey metaRk(expdb.value().chunkId,
+                       pCtx->getDbId(),
+                       RecordType::RT_LIST_META,
+                       key,
+                       "");
+      auto ql =
+        makeQuickList(sess, kvstore, metaRk, rv.value().getVersion(), lm);
+      auto eRange = ql.range(start, end, ptxn.value());
+      if (!eRange.ok()) {
+        return eRange.status();
+      }
+      std::string rsp;
+      Command::fmtMultiBulkLen(rsp, eRange.value().size());
+      for (const auto& v : eRange.value()) {
+        Command::fmtBulk(rsp, v);
+      }
+      return std::move(rsp);
+    }
     start += head;
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, rangelen);
+    std::string rsp;
+    Command::fmtMultiBulkLen(rsp, rangelen);
     while (rangelen--) {
       RecordKey subRk(expdb.value().chunkId,
                       pCtx->getDbId(),
                       RecordType::RT_LIST_ELE,
                       key,
-                      std::to_string(start));
+                      std::to_string(start),
+                      rv.value().getVersion());
       Expected<RecordValue> eSubVal = kvstore->getKV(subRk, ptxn.value());
       if (eSubVal.ok()) {
-        Command::fmtBulk(ss, eSubVal.value().getValue());
+        Command::fmtBulk(rsp, eSubVal.value().getValue());
       } else {
         return eSubVal.status();
       }
       start++;
     }
-    return ss.str();
+    return std::move(rsp);
   }
 } lrangeCmd;
 
@@ -946,11 +1058,21 @@ class LIndexCommand : public Command {
     if (mappingIdx < head || mappingIdx >= tail) {
       return fmtNull();
     }
+    if (lm.isChunked()) {
+      auto ql =
+        makeQuickList(sess, kvstore, metaRk, rv.value().getVersion(), lm);
+      auto eValue = ql.index(mappingIdx - head, ptxn.value());
+      if (!eValue.ok()) {
+        return eValue.status();
+      }
+      return fmtBulk(eValue.value());
+    }
     RecordKey subRk(expdb.value().chunkId,
                     pCtx->getDbId(),
                     RecordType::RT_LIST_ELE,
                     key,
-                    std::to_string(mappingIdx));
+                    std::to_string(mappingIdx),
+                    rv.value().getVersion());
     Expected<RecordValue> eSubVal = kvstore->getKV(subRk, ptxn.value());
     if (eSubVal.ok()) {
       return fmtBulk(eSubVal.value().getValue());
@@ -1029,29 +1151,42 @@ class LSetCommand : public Command {
         return ptxn.status();
       }
 
-      RecordKey subRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_LIST_ELE,
-                      key,
-                      std::to_string(realIndex));
-      RecordValue subRv(value, RecordType::RT_LIST_ELE, -1);
-      Status s = kvstore->setKV(subRk, subRv, ptxn.value());
-      if (!s.ok()) {
-        return s;
-      }
-      // update meta key's revision
       RecordKey metaRk(expdb.value().chunkId,
                        pCtx->getDbId(),
                        RecordType::RT_LIST_META,
                        key,
                        "");
-      s = kvstore->setKV(metaRk,
-                         RecordValue(lm.encode(),
-                                     RecordType::RT_LIST_META,
-                                     sess->getCtx()->getVersionEP(),
-                                     rv.value().getTtl(),
-                                     rv),
-                         ptxn.value());
+      Status s;
+      if (lm.isChunked()) {
+        uint64_t version = rv.value().getVersion();
+        auto ql = makeQuickList(sess, kvstore, metaRk, version, lm);
+        s = ql.set(realIndex - head, value, ptxn.value());
+        if (!s.ok()) {
+          return s;
+        }
+        s = saveQuickList(
+          sess, kvstore, ptxn.value(), metaRk, rv, version, ql);
+      } else {
+        RecordKey subRk(expdb.value().chunkId,
+                        pCtx->getDbId(),
+                        RecordType::RT_LIST_ELE,
+                        key,
+                        std::to_string(realIndex),
+                        rv.value().getVersion());
+        RecordValue subRv(value, RecordType::RT_LIST_ELE, -1);
+        s = kvstore->setKV(subRk, subRv, ptxn.value());
+        if (!s.ok()) {
+          return s;
+        }
+        // update meta key's revision
+        s = kvstore->setKV(metaRk,
+                           RecordValue(lm.encode(),
+                                       RecordType::RT_LIST_META,
+                                       sess->getCtx()->getVersionEP(),
+                                       rv.value().getTtl(),
+                                       rv),
+                           ptxn.value());
+      }
       if (!s.ok()) {
         return s;
       }
@@ -1122,12 +1257,6 @@ class LRemCommand : public Command {
       return rv.status();
     }
 
-    ListPos pos(ListPos::LP_HEAD);
-    if (count < 0) {
-      pos = ListPos::LP_TAIL;
-      count = -count;
-    }
-
     Expected<ListMetaValue> expLm =
       ListMetaValue::decode(rv.value().getValue());
     INVARIANT_D(expLm.ok());
@@ -1135,6 +1264,45 @@ class LRemCommand : public Command {
       return expLm.status();
     }
     ListMetaValue lm = std::move(expLm.value());
+
+    if (lm.isChunked()) {
+      PStore kvstore = expdb.value().store;
+      auto ptxn = sess->getCtx()->createTransaction(kvstore);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      RecordKey metaRk(expdb.value().chunkId,
+                       pCtx->getDbId(),
+                       RecordType::RT_LIST_META,
+                       key,
+                       "");
+      uint64_t version = rv.value().getVersion();
+      auto ql = makeQuickList(sess, kvstore, metaRk, version, lm);
+      auto eRemoved = ql.remove(count, value, ptxn.value());
+      if (!eRemoved.ok()) {
+        return eRemoved.status();
+      }
+      if (eRemoved.value() == 0) {
+        return Command::fmtZero();
+      }
+      Status s =
+        saveQuickList(sess, kvstore, ptxn.value(), metaRk, rv, version, ql);
+      if (!s.ok()) {
+        return s;
+      }
+      Expected<uint64_t> expCmt =
+        sess->getCtx()->commitTransaction(ptxn.value());
+      if (!expCmt.ok()) {
+        return expCmt.status();
+      }
+      return Command::fmtLongLong(eRemoved.value());
+    }
+
+    ListPos pos(ListPos::LP_HEAD);
+    if (count < 0) {
+      pos = ListPos::LP_TAIL;
+      count = -count;
+    }
     uint64_t head = lm.getHead();
     uint64_t tail = lm.getTail();
 
@@ -1154,7 +1322,8 @@ class LRemCommand : public Command {
                       pCtx->getDbId(),
                       RecordType::RT_LIST_ELE,
                       key,
-                      std::to_string(index));
+                      std::to_string(index),
+                      rv.value().getVersion());
       Expected<RecordValue> expRv = kvstore->getKV(subRk, ptxn.value());
       if (!expRv.ok()) {
         return expRv.status();
@@ -1208,7 +1377,8 @@ class LRemCommand : public Command {
                         pCtx->getDbId(),
                         RecordType::RT_LIST_ELE,
                         key,
-                        std::to_string(pos));
+                        std::to_string(pos),
+                        rv.value().getVersion());
         Expected<RecordValue> eSubVal = kvstore->getKV(subRk, ptxn.value());
         if (!eSubVal.ok()) {
           return eSubVal.status();
@@ -1217,7 +1387,8 @@ class LRemCommand : public Command {
                         pCtx->getDbId(),
                         RecordType::RT_LIST_ELE,
                         key,
-                        std::to_string(destPos));
+                        std::to_string(destPos),
+                        rv.value().getVersion());
         Status s = kvstore->setKV(newRk, eSubVal.value(), ptxn.value());
         if (!s.ok()) {
           return s;
@@ -1236,7 +1407,8 @@ class LRemCommand : public Command {
                         pCtx->getDbId(),
                         RecordType::RT_LIST_ELE,
                         key,
-                        std::to_string(pos));
+                        std::to_string(pos),
+                        rv.value().getVersion());
         Expected<RecordValue> eSubVal = kvstore->getKV(subRk, ptxn.value());
         if (!eSubVal.ok()) {
           return eSubVal.status();
@@ -1245,7 +1417,8 @@ class LRemCommand : public Command {
                         pCtx->getDbId(),
                         RecordType::RT_LIST_ELE,
                         key,
-                        std::to_string(destPos));
+                        std::to_string(destPos),
+                        rv.value().getVersion());
         Status s = kvstore->setKV(newRk, eSubVal.value(), ptxn.value());
         if (!s.ok()) {
           return s;
@@ -1270,7 +1443,8 @@ class LRemCommand : public Command {
                       pCtx->getDbId(),
                       RecordType::RT_LIST_ELE,
                       key,
-                      std::to_string(delPos));
+                      std::to_string(delPos),
+                      rv.value().getVersion());
       Status s = kvstore->delKV(subRk, ptxn.value());
       if (!s.ok()) {
         return s;
@@ -1377,12 +1551,41 @@ class LInsertCommand : public Command {
     if (!ptxn.ok()) {
       return ptxn.status();
     }
+    if (lm.isChunked()) {
+      // the node of the pivot is rewritten, and split if it's full
+      RecordKey metaRk(expdb.value().chunkId,
+                       pCtx->getDbId(),
+                       RecordType::RT_LIST_META,
+                       key,
+                       "");
+      uint64_t version = rv.value().getVersion();
+      auto ql = makeQuickList(sess, kvstore, metaRk, version, lm);
+      auto eFound = ql.insert(pivot, value, step > 0, ptxn.value());
+      if (!eFound.ok()) {
+        return eFound.status();
+      }
+      if (!eFound.value()) {
+        return Command::fmtLongLong(-1);
+      }
+      Status s =
+        saveQuickList(sess, kvstore, ptxn.value(), metaRk, rv, version, ql);
+      if (!s.ok()) {
+        return s;
+      }
+      Expected<uint64_t> expCmt =
+        sess->getCtx()->commitTransaction(ptxn.value());
+      if (!expCmt.ok()) {
+        return expCmt.status();
+      }
+      return Command::fmtLongLong(ql.size());
+    }
     while (len > 0) {
       RecordKey subRk(expdb.value().chunkId,
                       pCtx->getDbId(),
                       RecordType::RT_LIST_ELE,
                       key,
-                      std::to_string(index));
+                      std::to_string(index),
+                      rv.value().getVersion());
       Expected<RecordValue> eSubRv = kvstore->getKV(subRk, ptxn.value());
       if (!eSubRv.ok()) {
         return eSubRv.status();
@@ -1426,7 +1629,8 @@ class LInsertCommand : public Command {
                       pCtx->getDbId(),
                       RecordType::RT_LIST_ELE,
                       key,
-                      std::to_string(index + step));
+                      std::to_string(index + step),
+                      rv.value().getVersion());
       Expected<RecordValue> eSubVal = kvstore->getKV(subRk, ptxn.value());
       if (!eSubVal.ok()) {
         return eSubVal.status();
@@ -1436,7 +1640,8 @@ class LInsertCommand : public Command {
                       subRk.getDbId(),
                       RecordType::RT_LIST_ELE,
                       key,
-                      std::to_string(index));
+                      std::to_string(index),
+                      rv.value().getVersion());
       Status s = kvstore->setKV(newRk, eSubVal.value(), ptxn.value());
       if (!s.ok()) {
         return s;
@@ -1448,7 +1653,8 @@ class LInsertCommand : public Command {
                      pCtx->getDbId(),
                      RecordType::RT_LIST_ELE,
                      key,
-                     std::to_string(index));
+                     std::to_string(index),
+                     rv.value().getVersion());
     RecordValue targRv(value, RecordType::RT_LIST_ELE, -1);
     Status s = kvstore->setKV(targRk, targRv, ptxn.value());
     if (!s.ok()) {
@@ -20,6 +20,7 @@
 #include "tendisplus/utils/base64.h"
 #include "tendisplus/storage/varint.h"
 #include "tendisplus/storage/rocks/rocks_kvstore.h"
+#include "tendisplus/utils/compression.h"
 
 namespace tendisplus {
 
@@ -313,7 +314,7 @@ class FullSyncCommand : public Command {
   FullSyncCommand() : Command("fullsync", "a") {}
 
   ssize_t arity() const {
-    return 4;
+    return -4;
   }
 
   int32_t firstkey() const {
@@ -339,6 +340,40 @@ class FullSyncCommand : public Command {
   }
 } fullSyncCommand;
 
+// fullsyncfile storeId slaveIp slavePort
+// a connection the slave pulls the files of its fullsync over, see
+// ReplManager::supplyFullSyncFileRoutine()
+class FullSyncFileCommand : public Command {
+ public:
+  FullSyncFileCommand() : Command("fullsyncfile", "a") {}
+
+  ssize_t arity() const {
+    return 4;
+  }
+
+  int32_t firstkey() const {
+    return 0;
+  }
+
+  int32_t lastkey() const {
+    return 0;
+  }
+
+  int32_t keystep() const {
+    return 0;
+  }
+
+  bool isBgCmd() const {
+    return true;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    LOG(FATAL) << "fullsyncfile should not be called";
+    // void compiler complain
+    return {ErrorCodes::ERR_INTERNAL, "shouldn't be called"};
+  }
+} fullSyncFileCommand;
+
 class QuitCommand : public Command {
  public:
   QuitCommand() : Command("quit", "a") {}
@@ -410,7 +445,7 @@ class IncrSyncCommand : public Command {
   IncrSyncCommand() : Command("incrsync", "a") {}
 
   ssize_t arity() const {
-    return 6;
+    return -6;
   }
 
   int32_t firstkey() const {
@@ -429,7 +464,7 @@ class IncrSyncCommand : public Command {
     return true;
   }
 
-  // incrSync storeId dstStoreId binlogId ip port
+  // incrSync storeId dstStoreId binlogId ip port [codecs]
   // binlogId: the last binlog that has been applied
   Expected<std::string> run(Session* sess) final {
     LOG(FATAL) << "incrsync should not be called";
@@ -463,6 +498,8 @@ class ApplyBinlogsGeneric : public Command {
     INVARIANT(replMgr != nullptr);
 
     size_t cnt = 0;
+    // the binlogs of the slave are applied as a batch
+    std::vector<ReplLogRawV2> logs;
     BinlogReader reader(binlogs);
     while (true) {
       auto eLog = reader.next();
@@ -472,36 +509,40 @@ class ApplyBinlogsGeneric : public Command {
         LOG(ERROR) << "reader.next() failed:" << eLog.status().toString();
         return eLog.status();
       }
-      Status s;
+      cnt++;
       if (mode == BinlogApplyMode::KEEP_BINLOG_ID) {
-        s = replMgr->applyRepllogV2(sess,
-                                    storeId,
-                                    eLog.value().getReplLogKey(),
-                                    eLog.value().getReplLogValue());
-      } else {
-        if (!svr->isClusterEnabled()) {
-          LOG(ERROR) << "not ClusterEnabled.";
-          return {ErrorCodes::ERR_INTERNAL, "not ClusterEnabled"};
-        }
-        auto migrateMgr = svr->getMigrateManager();
-        s = migrateMgr->applyRepllog(sess,
-                                     storeId,
-                                     mode,
-                                     eLog.value().getReplLogKey(),
-                                     eLog.value().getReplLogValue());
+        logs.emplace_back(std::move(eLog.value()));
+        continue;
+      }
+      if (!svr->isClusterEnabled()) {
+        LOG(ERROR) << "not ClusterEnabled.";
+        return {ErrorCodes::ERR_INTERNAL, "not ClusterEnabled"};
       }
+      auto migrateMgr = svr->getMigrateManager();
+      auto s = migrateMgr->applyRepllog(sess,
+                                        storeId,
+                                        mode,
+                                        eLog.value().getReplLogKey(),
+                                        eLog.value().getReplLogValue());
       if (!s.ok()) {
         LOG(ERROR) << "applyRepllog failed,mode:" << (uint32_t)mode
-                   << " err:" << eLog.status().toString();
+                   << " err:" << s.toString();
         return s;
       }
-      cnt++;
     }
 
     if (cnt != binlogCnt) {
       return {ErrorCodes::ERR_PARSEOPT, "invalid binlog size of binlog count"};
     }
 
+    if (!logs.empty()) {
+      auto s = replMgr->applyRepllogsV2(sess, storeId, logs);
+      if (!s.ok()) {
+        LOG(ERROR) << "applyRepllogsV2 failed,store:" << storeId
+                   << " err:" << s.toString();
+        return s;
+      }
+    }
     return {ErrorCodes::ERR_OK, ""};
   }
 
@@ -652,12 +693,31 @@ class ApplyBinlogsGeneric : public Command {
     return {ErrorCodes::ERR_OK, ""};
   }
 
-  // applybinlogsv2 storeId binlogs cnt flag
+  // applybinlogsv2 storeId binlogs cnt flag [codec]
   // why is there no storeId ? storeId is contained in this
   // session in fact.
   // please refer to comments of ReplManager::registerIncrSync
   Expected<std::string> run(Session* sess) final {
     const std::vector<std::string>& args = sess->getArgs();
+    if (args.size() > 6) {
+      return {ErrorCodes::ERR_WRONG_ARGS_SIZE, ""};
+    }
+    // the binlogs are in a frame of the codec if it's given
+    const std::string* binlogs = &args[2];
+    std::string uncompressed;
+    if (args.size() == 6) {
+      auto eCodec = codecFromName(args[5]);
+      if (!eCodec.ok()) {
+        return eCodec.status();
+      }
+      auto eData = uncompressFrame(eCodec.value(), args[2]);
+      if (!eData.ok()) {
+        LOG(ERROR) << "uncompress binlogs failed:" << eData.status().toString();
+        return eData.status();
+      }
+      uncompressed = std::move(eData.value());
+      binlogs = &uncompressed;
+    }
     uint32_t storeId;
     Expected<uint64_t> exptStoreId = ::tendisplus::stoul(args[1]);
     if (!exptStoreId.ok()) {
@@ -684,21 +744,21 @@ class ApplyBinlogsGeneric : public Command {
     }
     switch ((BinlogFlag)eflag.value()) {
       case BinlogFlag::NORMAL: {
-        auto s = runNormal(sess, storeId, args[2], binlogCnt, _mode);
+        auto s = runNormal(sess, storeId, *binlogs, binlogCnt, _mode);
         if (!s.ok()) {
           return s;
         }
         break;
       }
       case BinlogFlag::FLUSH: {
-        auto s = runFlush(sess, storeId, args[2], binlogCnt);
+        auto s = runFlush(sess, storeId, *binlogs, binlogCnt);
         if (!s.ok()) {
           return s;
         }
         break;
       }
       case BinlogFlag::MIGRATE: {
-        auto s = runMigrate(sess, storeId, args[2], binlogCnt);
+        auto s = runMigrate(sess, storeId, *binlogs, binlogCnt);
         if (!s.ok()) {
           return s;
         }
@@ -716,7 +776,7 @@ class ApplyBinlogsCommandV2 : public ApplyBinlogsGeneric {
         "applybinlogsv2", "aw", BinlogApplyMode::KEEP_BINLOG_ID) {}
 
   ssize_t arity() const {
-    return 5;
+    return -5;
   }
 
   int32_t firstkey() const {
@@ -30,7 +30,8 @@ class ScanGenericCommand : public Command {
 
   virtual RecordKey genFakeRcd(uint32_t chunkId,
                                uint32_t dbId,
-                               const std::string& key) const = 0;
+                               const std::string& key,
+                               uint64_t version) const = 0;
 
   virtual Expected<std::string> genResult(const std::string& cursor,
                                           const std::list<Record>& rcds) = 0;
@@ -110,7 +111,12 @@ class ScanGenericCommand : public Command {
       auto eMetaContent = ZSlMetaValue::decode(rv.value().getValue());
       RET_IF_ERR_EXPECTED(eMetaContent);
       ZSlMetaValue meta = eMetaContent.value();
-      SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
+      SkipList sl(expdb.value().chunkId,
+                  pCtx->getDbId(),
+                  key,
+                  meta,
+                  kvstore,
+                  rv.value().getVersion());
       Zrangespec range;
       if (zslParseRange(cursor.c_str(), maxscore.c_str(), &range) != 0) {
         return {ErrorCodes::ERR_ZSLPARSERANGE, ""};
@@ -133,10 +139,20 @@ class ScanGenericCommand : public Command {
       return ss.str();
     }
 
-    RecordKey fake = genFakeRcd(expdb.value().chunkId, pCtx->getDbId(), key);
+    RecordKey fake = genFakeRcd(
+      expdb.value().chunkId, pCtx->getDbId(), key, rv.value().getVersion());
 
-    auto batch = Command::scan(fake.prefixPk(), cursor, count, ptxn.value());
-    RET_IF_ERR_EXPECTED(batch);
+    auto lp = rcd_util::getListPack(rv.value());
+    RET_IF_ERR_EXPECTED(lp);
+    Expected<std::pair<std::string, std::list<Record>>> batch =
+      std::make_pair(std::string("0"), std::list<Record>());
+    if (lp.value()) {
+      // a packed collection is small, return it in one batch
+      batch.value().second = rcd_util::listPackRecords(*lp.value(), fake);
+    } else {
+      batch = Command::scan(fake.prefixPk(), cursor, count, ptxn.value());
+      RET_IF_ERR_EXPECTED(batch);
+    }
     const bool NOCASE = false;
     for (std::list<Record>::iterator it = batch.value().second.begin();
          it != batch.value().second.end();) {
@@ -169,8 +185,9 @@ class ZScanCommand : public ScanGenericCommand {
 
   RecordKey genFakeRcd(uint32_t chunkId,
                        uint32_t dbId,
-                       const std::string& key) const final {
-    return {chunkId, dbId, RecordType::RT_ZSET_H_ELE, key, ""};
+                       const std::string& key,
+                       uint64_t version) const final {
+    return {chunkId, dbId, RecordType::RT_ZSET_H_ELE, key, "", version};
   }
 
   Expected<std::string> genResult(const std::string& cursor,
@@ -200,12 +217,14 @@ class ZScanbyscoreCommand : public ScanGenericCommand {
 
   RecordKey genFakeRcd(uint32_t chunkId,
                        uint32_t dbId,
-                       const std::string& key) const final {
+                       const std::string& key,
+                       uint64_t version) const final {
     return {chunkId,
             dbId,
             RecordType::RT_ZSET_S_ELE,
             key,
-            std::to_string(ZSlMetaValue::HEAD_ID)};
+            std::to_string(ZSlMetaValue::HEAD_ID),
+            version};
   }
 
   Expected<std::string> genResult(const std::string& cursor,
@@ -251,8 +270,9 @@ class SScanCommand : public ScanGenericCommand {
 
   RecordKey genFakeRcd(uint32_t chunkId,
                        uint32_t dbId,
-                       const std::string& key) const final {
-    return {chunkId, dbId, RecordType::RT_SET_ELE, key, ""};
+                       const std::string& key,
+                       uint64_t version) const final {
+    return {chunkId, dbId, RecordType::RT_SET_ELE, key, "", version};
   }
 
   Expected<std::string> genResult(const std::string& cursor,
@@ -278,8 +298,9 @@ class HScanCommand : public ScanGenericCommand {
 
   RecordKey genFakeRcd(uint32_t chunkId,
                        uint32_t dbId,
-                       const std::string& key) const final {
-    return {chunkId, dbId, RecordType::RT_HASH_ELE, key, ""};
+                       const std::string& key,
+                       uint64_t version) const final {
+    return {chunkId, dbId, RecordType::RT_HASH_ELE, key, "", version};
   }
 
   Expected<std::string> genResult(const std::string& cursor,
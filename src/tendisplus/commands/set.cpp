@@ -14,6 +14,7 @@
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/redis_port.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/storage/set_cursor.h"
 #include "tendisplus/utils/scopeguard.h"
 
 namespace tendisplus {
@@ -21,6 +22,45 @@ namespace tendisplus {
 Expected<bool> delGeneric(Session* sess, const std::string& key,
         Transaction* txn);
 
+// move the packed members to the RT_SET_ELE records before adding the
+// members that make the set beyond set-max-listpack-entries or
+// set-max-listpack-value, see ListPack
+Status setConvertIfNeeded(Session* sess,
+                          PStore kvstore,
+                          Transaction* txn,
+                          const RecordKey& metaRk,
+                          uint64_t version,
+                          const std::vector<std::string>& members,
+                          SetMetaValue* sm) {
+  auto lp = sm->getListPack();
+  if (lp == nullptr) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  const auto& params = sess->getServerEntry()->getParams();
+  bool fits = lp->size() + members.size() <= params->setMaxListpackEntries;
+  for (size_t i = 0; i < members.size() && fits; ++i) {
+    fits = members[i].size() <= params->setMaxListpackValue;
+  }
+  if (fits) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  for (const auto& v : lp->getEntries()) {
+    RecordKey subRk(metaRk.getChunkId(),
+                    metaRk.getDbId(),
+                    RecordType::RT_SET_ELE,
+                    metaRk.getPrimaryKey(),
+                    v.first,
+                    version);
+    RecordValue subRv("", RecordType::RT_SET_ELE, -1);
+    Status s = kvstore->setKV(subRk, subRv, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  sm->resetListPack();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Expected<std::string> genericSRem(Session* sess,
                                   PStore kvstore,
                                   Transaction* txn,
@@ -46,12 +86,20 @@ Expected<std::string> genericSRem(Session* sess,
   }
 
   uint64_t cnt = 0;
+  uint64_t count = sm.getCount();
   for (size_t i = 0; i < args.size(); ++i) {
+    if (auto lp = sm.getListPack()) {
+      if (lp->del(args[i])) {
+        cnt += 1;
+      }
+      continue;
+    }
     RecordKey subRk(metaRk.getChunkId(),
                     metaRk.getDbId(),
                     RecordType::RT_SET_ELE,
                     metaRk.getPrimaryKey(),
-                    args[i]);
+                    args[i],
+                    rv.value().getVersion());
     Expected<RecordValue> rv = kvstore->getKV(subRk, txn);
     if (rv.ok()) {
       cnt += 1;
@@ -65,19 +113,19 @@ Expected<std::string> genericSRem(Session* sess,
       return s;
     }
   }
-  INVARIANT_D(sm.getCount() >= cnt);
+  INVARIANT_D(count >= cnt);
   Status s;
-  if (sm.getCount() <= cnt) {
-    if (sm.getCount() < cnt) {
+  if (count <= cnt) {
+    if (count < cnt) {
       LOG(ERROR) << "invalid set:"
                  << rcd_util::makeInvalidErrStr(metaRk.getRecordValueType(),
                                                 metaRk.getPrimaryKey(),
-                                                sm.getCount(),
+                                                count,
                                                 cnt);
     }
     s = Command::delKeyAndTTL(sess, metaRk, rv.value(), txn);
   } else {
-    sm.setCount(sm.getCount() - cnt);
+    sm.setCount(count - cnt);
     s = kvstore->setKV(metaRk,
                        RecordValue(sm.encode(),
                                    RecordType::RT_SET_META,
@@ -116,15 +164,36 @@ Expected<std::string> genericSAdd(Session* sess,
   } else if (rv.status().code() != ErrorCodes::ERR_NOTFOUND &&
              rv.status().code() != ErrorCodes::ERR_EXPIRED) {
     return rv.status();
+  } else if (sess->getServerEntry()->getParams()->setMaxListpackEntries > 0) {
+    sm.setListPack(ListPack());
   }
 
+  auto eVersion = Command::getSubkeyVersion(kvstore, metaRk, rv, txn);
+  if (!eVersion.ok()) {
+    return eVersion.status();
+  }
+  if (sm.getListPack()) {
+    std::vector<std::string> members(args.begin() + 2, args.end());
+    Status s = setConvertIfNeeded(
+      sess, kvstore, txn, metaRk, eVersion.value(), members, &sm);
+    if (!s.ok()) {
+      return s;
+    }
+  }
   uint64_t cnt = 0;
   for (size_t i = 2; i < args.size(); ++i) {
+    if (auto lp = sm.getListPack()) {
+      if (lp->set(args[i], "")) {
+        cnt += 1;
+      }
+      continue;
+    }
     RecordKey subRk(metaRk.getChunkId(),
                     metaRk.getDbId(),
                     RecordType::RT_SET_ELE,
                     metaRk.getPrimaryKey(),
-                    args[i]);
+                    args[i],
+                    eVersion.value());
 
       Expected<RecordValue> subrv = kvstore->getKV(subRk, txn);
       if (subrv.ok()) {
@@ -142,13 +211,13 @@ Expected<std::string> genericSAdd(Session* sess,
     }
   }
   sm.setCount(sm.getCount() + cnt);
-  Status s = kvstore->setKV(metaRk,
-                            RecordValue(sm.encode(),
-                                        RecordType::RT_SET_META,
-                                        sess->getCtx()->getVersionEP(),
-                                        ttl,
-                                        rv),
-                            txn);
+  RecordValue metaValue(sm.encode(),
+                        RecordType::RT_SET_META,
+                        sess->getCtx()->getVersionEP(),
+                        ttl,
+                        rv);
+  metaValue.setVersion(eVersion.value());
+  Status s = kvstore->setKV(metaRk, metaValue, txn);
   if (!s.ok()) {
     return s;
   }
@@ -216,12 +285,21 @@ class SMembersCommand : public Command {
     }
     ssize = exptSm.value().getCount();
 
-    std::stringstream ss;
-    Command::fmtMultiBulkLen(ss, ssize);
-    auto cursor = ptxn.value()->createDataCursor();
-    RecordKey fake = {
-      expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_SET_ELE, key, ""};
-    cursor->seek(fake.prefixPk());
+    std::string rsp;
+    Command::fmtMultiBulkLen(rsp, ssize);
+    if (auto lp = exptSm.value().getListPack()) {
+      for (const auto& v : lp->getEntries()) {
+        Command::fmtBulk(rsp, v.first);
+      }
+      return std::move(rsp);
+    }
+    RecordKey fake = {expdb.value().chunkId,
+                      pCtx->getDbId(),
+                      RecordType::RT_SET_ELE,
+                      key,
+                      "",
+                      rv.value().getVersion()};
+    auto cursor = ptxn.value()->createPkCursor(fake.prefixPk());
     while (true) {
       Expected<Record> exptRcd = cursor->next();
       if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
@@ -236,7 +314,7 @@ class SMembersCommand : public Command {
         break;
       }
       cnt += 1;
-      Command::fmtBulk(ss, rcdkey.getSecondaryKey());
+      Command::fmtBulk(rsp, rcdkey.getSecondaryKey());
     }
     INVARIANT_D(cnt == ssize);
     if (cnt != ssize) {
@@ -244,7 +322,7 @@ class SMembersCommand : public Command {
               rcd_util::makeInvalidErrStr(
                 metaRk.getRecordValueType(), key, ssize, cnt)};
     }
-    return ss.str();
+    return std::move(rsp);
   }
 } smemberscmd;
 
@@ -302,11 +380,20 @@ class SIsMemberCommand : public Command {
       return ptxn.status();
     }
 
+    Expected<SetMetaValue> exptSm = SetMetaValue::decode(rv.value().getValue());
+    if (!exptSm.ok()) {
+      return exptSm.status();
+    }
+    if (auto lp = exptSm.value().getListPack()) {
+      return lp->get(subkey) ? Command::fmtOne() : Command::fmtZero();
+    }
+
     RecordKey subRk(expdb.value().chunkId,
                     pCtx->getDbId(),
                     RecordType::RT_SET_ELE,
                     key,
-                    subkey);
+                    subkey,
+                    rv.value().getVersion());
     Expected<RecordValue> eSubVal = kvstore->getKV(subRk, ptxn.value());
     if (eSubVal.ok()) {
       return Command::fmtOne();
@@ -318,6 +405,95 @@ class SIsMemberCommand : public Command {
   }
 } sIsMemberCmd;
 
+class SMIsMemberCommand : public Command {
+ public:
+  SMIsMemberCommand() : Command("smismember", "rF") {}
+
+  ssize_t arity() const {
+    return -3;
+  }
+
+  int32_t firstkey() const {
+    return 1;
+  }
+
+  int32_t lastkey() const {
+    return 1;
+  }
+
+  int32_t keystep() const {
+    return 1;
+  }
+
+  Expected<std::string> run(Session* sess) final {
+    const std::vector<std::string>& args = sess->getArgs();
+    const std::string& key = args[1];
+
+    SessionCtx* pCtx = sess->getCtx();
+    INVARIANT(pCtx != nullptr);
+
+    auto server = sess->getServerEntry();
+    auto expdb =
+      server->getSegmentMgr()->getDbWithKeyLock(sess, key, Command::RdLock());
+    if (!expdb.ok()) {
+      return expdb.status();
+    }
+
+    std::stringstream ss;
+    Command::fmtMultiBulkLen(ss, args.size() - 2);
+    Expected<RecordValue> rv =
+      Command::expireKeyIfNeeded(sess, key, RecordType::RT_SET_META);
+    if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
+        rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      for (size_t i = 2; i < args.size(); ++i) {
+        Command::fmtLongLong(ss, 0);
+      }
+      return ss.str();
+    } else if (!rv.ok()) {
+      return rv.status();
+    }
+
+    PStore kvstore = expdb.value().store;
+    auto ptxn = sess->getCtx()->createTransaction(kvstore);
+    if (!ptxn.ok()) {
+      return ptxn.status();
+    }
+
+    Expected<SetMetaValue> exptSm = SetMetaValue::decode(rv.value().getValue());
+    if (!exptSm.ok()) {
+      return exptSm.status();
+    }
+    if (auto lp = exptSm.value().getListPack()) {
+      for (size_t i = 2; i < args.size(); ++i) {
+        Command::fmtLongLong(ss, lp->get(args[i]) ? 1 : 0);
+      }
+      return ss.str();
+    }
+
+    std::vector<RecordKey> subRks;
+    subRks.reserve(args.size() - 2);
+    for (size_t i = 2; i < args.size(); ++i) {
+      subRks.emplace_back(expdb.value().chunkId,
+                          pCtx->getDbId(),
+                          RecordType::RT_SET_ELE,
+                          key,
+                          args[i],
+                          rv.value().getVersion());
+    }
+    auto eSubVals = kvstore->getKVs(subRks, ptxn.value());
+    for (auto& eSubVal : eSubVals) {
+      if (eSubVal.ok()) {
+        Command::fmtLongLong(ss, 1);
+      } else if (eSubVal.status().code() == ErrorCodes::ERR_NOTFOUND) {
+        Command::fmtLongLong(ss, 0);
+      } else {
+        return eSubVal.status();
+      }
+    }
+    return ss.str();
+  }
+} smIsMemberCmd;
+
 class SrandMemberCommand : public Command {
  public:
   SrandMemberCommand() : Command("srandmember", "rR") {}
@@ -406,7 +582,6 @@ class SrandMemberCommand : public Command {
       return {ErrorCodes::ERR_DECODE, "invalid set meta" + key};
     }
 
-    auto cursor = ptxn.value()->createDataCursor();
     uint32_t beginIdx = 0;
     uint32_t cnt = 0;
     uint32_t peek = 0;
@@ -432,28 +607,40 @@ class SrandMemberCommand : public Command {
       // TODO(vinchen):  should be configable
       return {ErrorCodes::ERR_INTERNAL, "bulk too big"};
     }
-    RecordKey fake = {
-      expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_SET_ELE, key, ""};
-    cursor->seek(fake.prefixPk());
-    while (true) {
-      Expected<Record> exptRcd = cursor->next();
-      if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-        break;
-      }
-      if (!exptRcd.ok()) {
-        return exptRcd.status();
-      }
-      if (cnt++ < beginIdx) {
-        continue;
-      }
-      if (cnt > ssize) {
-        break;
-      }
-      if (peek < remain) {
-        vals.emplace_back(exptRcd.value().getRecordKey().getSecondaryKey());
+    if (auto lp = exptSm.value().getListPack()) {
+      const auto& entries = lp->getEntries();
+      for (size_t i = beginIdx; i < entries.size() && peek < remain; ++i) {
+        vals.emplace_back(entries[i].first);
         peek++;
-      } else {
-        break;
+      }
+    } else {
+      RecordKey fake = {expdb.value().chunkId,
+                        pCtx->getDbId(),
+                        RecordType::RT_SET_ELE,
+                        key,
+                        "",
+                        rv.value().getVersion()};
+      auto cursor = ptxn.value()->createPkCursor(fake.prefixPk());
+      while (true) {
+        Expected<Record> exptRcd = cursor->next();
+        if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+          break;
+        }
+        if (!exptRcd.ok()) {
+          return exptRcd.status();
+        }
+        if (cnt++ < beginIdx) {
+          continue;
+        }
+        if (cnt > ssize) {
+          break;
+        }
+        if (peek < remain) {
+          vals.emplace_back(exptRcd.value().getRecordKey().getSecondaryKey());
+          peek++;
+        } else {
+          break;
+        }
       }
     }
     // TODO(vinchen): vals should be shuffle here
@@ -548,8 +735,15 @@ class SpopCommand : public Command {
     if (!ptxn.ok()) {
       return ptxn.status();
     }
-    RecordKey fake = {
-      expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_SET_ELE, key, ""};
+    if (sm.getListPack()) {
+      return spopListPack(sess, kvstore, metaRk, rv.value(), count, &sm);
+    }
+    RecordKey fake = {expdb.value().chunkId,
+                      pCtx->getDbId(),
+                      RecordType::RT_SET_ELE,
+                      key,
+                      "",
+                      rv.value().getVersion()};
     auto batch = Command::scan(fake.prefixPk(), "0", count, ptxn.value());
     if (!batch.ok()) {
       return batch.status();
@@ -620,6 +814,69 @@ class SpopCommand : public Command {
       }
     }
 
+    INVARIANT_D(0);
+    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+  }
+
+ private:
+  Expected<std::string> spopListPack(Session* sess,
+                                     PStore kvstore,
+                                     const RecordKey& metaRk,
+                                     const RecordValue& rv,
+                                     uint32_t count,
+                                     SetMetaValue* sm) {
+    auto lp = sm->getListPack();
+    std::vector<std::string> popped;
+    for (const auto& v : lp->getEntries()) {
+      if (popped.size() >= count) {
+        break;
+      }
+      popped.emplace_back(v.first);
+    }
+    if (popped.size() == 0) {
+      return Command::fmtNull();
+    }
+    for (const auto& v : popped) {
+      lp->del(v);
+    }
+
+    std::stringstream ss;
+    if (popped.size() > 1) {
+      Command::fmtMultiBulkLen(ss, popped.size());
+    }
+    for (const auto& v : popped) {
+      Command::fmtBulk(ss, v);
+    }
+    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
+      auto ptxn = sess->getCtx()->createTransaction(kvstore);
+      if (!ptxn.ok()) {
+        return ptxn.status();
+      }
+      Status s;
+      if (lp->size() == 0) {
+        s = Command::delKeyAndTTL(sess, metaRk, rv, ptxn.value());
+      } else {
+        s = kvstore->setKV(metaRk,
+                           RecordValue(sm->encode(),
+                                       RecordType::RT_SET_META,
+                                       sess->getCtx()->getVersionEP(),
+                                       rv.getTtl(),
+                                       rv),
+                           ptxn.value());
+      }
+      if (!s.ok()) {
+        return s;
+      }
+      auto expCmt = sess->getCtx()->commitTransaction(ptxn.value());
+      if (expCmt.ok()) {
+        return ss.str();
+      }
+      if (expCmt.status().code() != ErrorCodes::ERR_COMMIT_RETRY ||
+          i == RETRY_CNT - 1) {
+        return expCmt.status();
+      }
+    }
+
     INVARIANT_D(0);
     return {ErrorCodes::ERR_INTERNAL, "not reachable"};
   }
@@ -828,6 +1085,182 @@ class SRemCommand : public Command {
   }
 } sremCommand;
 
+// a set of SINTER, SUNION or SDIFF, the meta is kept for the cursors
+// over its packed members
+struct SetSource {
+  SetSource(SetMetaValue&& sm, const RecordKey& rk, Transaction* ptxn)
+    : meta(std::move(sm)), fake(rk), txn(ptxn) {}
+
+  SetMetaValue meta;
+  const RecordKey fake;
+  Transaction* const txn;
+
+  std::unique_ptr<SetCursor> newCursor() const {
+    if (auto lp = meta.getListPack()) {
+      return std::make_unique<SetCursor>(lp);
+    }
+    return std::make_unique<SetCursor>(fake, txn);
+  }
+};
+
+// the sets of args[startkey:], nullptr for a key not found or expired.
+// The keys after the first missing one are not read if stopIfMissing.
+Expected<std::vector<std::unique_ptr<SetSource>>> loadSetSources(
+  Session* sess,
+  const std::vector<std::string>& args,
+  size_t startkey,
+  bool stopIfMissing) {
+  auto server = sess->getServerEntry();
+  std::vector<std::unique_ptr<SetSource>> sources;
+  for (size_t i = startkey; i < args.size(); ++i) {
+    Expected<RecordValue> rv =
+      Command::expireKeyIfNeeded(sess, args[i], RecordType::RT_SET_META);
+    if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
+        rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      sources.emplace_back(nullptr);
+      if (stopIfMissing) {
+        break;
+      }
+      continue;
+    } else if (!rv.ok()) {
+      return rv.status();
+    }
+
+    auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, args[i]);
+    RET_IF_ERR_EXPECTED(expdb);
+    Expected<SetMetaValue> exptSm = SetMetaValue::decode(rv.value().getValue());
+    RET_IF_ERR_EXPECTED(exptSm);
+    auto ptxn = sess->getCtx()->createTransaction(expdb.value().store);
+    RET_IF_ERR_EXPECTED(ptxn);
+
+    RecordKey fake(expdb.value().chunkId,
+                   sess->getCtx()->getDbId(),
+                   RecordType::RT_SET_ELE,
+                   args[i],
+                   "",
+                   rv.value().getVersion());
+    sources.emplace_back(std::make_unique<SetSource>(
+      std::move(exptSm.value()), fake, ptxn.value()));
+  }
+  return std::move(sources);
+}
+
+// whether any of the sets contains member, see SetCursor
+Expected<bool> anyContains(
+  const std::vector<std::unique_ptr<SetCursor>>& cursors,
+  const std::string& member) {
+  for (const auto& cursor : cursors) {
+    auto eFound = cursor->contains(member);
+    if (!eFound.ok() || eFound.value()) {
+      return eFound;
+    }
+  }
+  return false;
+}
+
+// the members of SINTER, SUNION or SDIFF, replied or written into the
+// destination of *STORE as they come. The members are unique, so they
+// are written without a read, and packed while they fit, see ListPack.
+class SetOpResult {
+ public:
+  explicit SetOpResult(Session* sess)
+    : _sess(sess), _store(false), _txn(nullptr), _version(0), _count(0) {}
+
+  // the destination is deleted in finish(), after the sources are read,
+  // so it can be one of them. The new members get a newer version than
+  // the old ones, and are kept apart from them until then.
+  Status openStore(const std::string& storeKey) {
+    auto server = _sess->getServerEntry();
+    auto expdb = server->getSegmentMgr()->getDbHasLocked(_sess, storeKey);
+    RET_IF_ERR_EXPECTED(expdb);
+    _kvstore = expdb.value().store;
+    auto ptxn = _sess->getCtx()->createTransaction(_kvstore);
+    RET_IF_ERR_EXPECTED(ptxn);
+    _txn = ptxn.value();
+    _storeKey = storeKey;
+    _metaRk = std::make_unique<RecordKey>(expdb.value().chunkId,
+                                          _sess->getCtx()->getDbId(),
+                                          RecordType::RT_SET_META,
+                                          storeKey,
+                                          "");
+
+    auto eVersion = Command::getSubkeyVersion(
+      _kvstore, *_metaRk, {ErrorCodes::ERR_NOTFOUND, ""}, _txn);
+    RET_IF_ERR_EXPECTED(eVersion);
+    _version = eVersion.value();
+    auto eOld = _kvstore->getKV(*_metaRk, _txn);
+    if (eOld.ok()) {
+      _version = std::max(_version, eOld.value().getVersion() + 1);
+    } else if (eOld.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return eOld.status();
+    }
+    if (server->getParams()->setMaxListpackEntries > 0) {
+      _sm.setListPack(ListPack());
+    }
+    _store = true;
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  Status add(const std::string& member) {
+    _count++;
+    if (!_store) {
+      Command::fmtBulk(_ss, member);
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    if (_sm.getListPack()) {
+      Status s = setConvertIfNeeded(
+        _sess, _kvstore, _txn, *_metaRk, _version, {member}, &_sm);
+      RET_IF_ERR(s);
+    }
+    if (auto lp = _sm.getListPack()) {
+      lp->set(member, "");
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    RecordKey subRk(_metaRk->getChunkId(),
+                    _metaRk->getDbId(),
+                    RecordType::RT_SET_ELE,
+                    _metaRk->getPrimaryKey(),
+                    member,
+                    _version);
+    return _kvstore->setKV(
+      subRk, RecordValue("", RecordType::RT_SET_ELE, -1), _txn);
+  }
+
+  Expected<std::string> finish() {
+    if (!_store) {
+      std::stringstream ss;
+      Command::fmtMultiBulkLen(ss, _count);
+      return ss.str() + _ss.str();
+    }
+    Expected<bool> deleted = delGeneric(_sess, _storeKey, _txn);
+    RET_IF_ERR_EXPECTED(deleted);
+    if (_count > 0) {
+      _sm.setCount(_count);
+      RecordValue metaValue(_sm.encode(),
+                            RecordType::RT_SET_META,
+                            _sess->getCtx()->getVersionEP());
+      metaValue.setVersion(_version);
+      Status s = _kvstore->setKV(*_metaRk, metaValue, _txn);
+      RET_IF_ERR(s);
+    }
+    auto eCmt = _sess->getCtx()->commitTransaction(_txn);
+    RET_IF_ERR_EXPECTED(eCmt);
+    return Command::fmtLongLong(_count);
+  }
+
+ private:
+  Session* _sess;
+  bool _store;
+  std::stringstream _ss;
+  PStore _kvstore;
+  Transaction* _txn;
+  std::string _storeKey;
+  std::unique_ptr<RecordKey> _metaRk;
+  uint64_t _version;
+  SetMetaValue _sm;
+  uint64_t _count;
+};
+
 class SdiffgenericCommand : public Command {
  public:
   SdiffgenericCommand(const std::string& name, const char* sflags, bool store)
@@ -836,9 +1269,7 @@ class SdiffgenericCommand : public Command {
   Expected<std::string> run(Session* sess) final {
     const std::vector<std::string>& args = sess->getArgs();
     size_t startkey = _store ? 2 : 1;
-    std::set<std::string> result;
     auto server = sess->getServerEntry();
-    SessionCtx* pCtx = sess->getCtx();
 
     std::vector<int> index = getKeysFromCommand(args);
     auto lock = server->getSegmentMgr()->getAllKeysLocked(
@@ -847,117 +1278,40 @@ class SdiffgenericCommand : public Command {
       return lock.status();
     }
 
-    for (size_t i = startkey; i < args.size(); ++i) {
-      Expected<RecordValue> rv =
-        Command::expireKeyIfNeeded(sess, args[i], RecordType::RT_SET_META);
-      if (rv.status().code() == ErrorCodes::ERR_EXPIRED) {
-        continue;
-      } else if (rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        continue;
-      } else if (!rv.ok()) {
-        return rv.status();
-      }
-
-      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, args[i]);
-      if (!expdb.ok()) {
-        return expdb.status();
-      }
-
-      PStore kvstore = expdb.value().store;
-      auto ptxn = sess->getCtx()->createTransaction(kvstore);
-      if (!ptxn.ok()) {
-        return ptxn.status();
-      }
-      auto cursor = ptxn.value()->createDataCursor();
-      RecordKey fake = {expdb.value().chunkId,
-                        pCtx->getDbId(),
-                        RecordType::RT_SET_ELE,
-                        args[i],
-                        ""};
-      cursor->seek(fake.prefixPk());
-      while (true) {
-        Expected<Record> exptRcd = cursor->next();
-        if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-          break;
-        }
-        if (!exptRcd.ok()) {
-          return exptRcd.status();
-        }
-        Record& rcd = exptRcd.value();
-        const RecordKey& rcdkey = rcd.getRecordKey();
-        if (rcdkey.prefixPk() != fake.prefixPk()) {
-          break;
-        }
-        if (i == startkey) {
-          result.insert(rcdkey.getSecondaryKey());
-        } else {
-          result.erase(rcdkey.getSecondaryKey());
-        }
-      }
+    auto eSources = loadSetSources(sess, args, startkey, false);
+    RET_IF_ERR_EXPECTED(eSources);
+    const auto& sources = eSources.value();
+    SetOpResult result(sess);
+    if (_store) {
+      Status s = result.openStore(args[1]);
+      RET_IF_ERR(s);
     }
-
-    if (!_store) {
-      std::stringstream ss;
-      Command::fmtMultiBulkLen(ss, result.size());
-      for (auto& v : result) {
-        Command::fmtBulk(ss, v);
-      }
-      return ss.str();
-    }
-
-    const std::string& storeKey = args[1];
-    auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, storeKey);
-    if (!expdb.ok()) {
-      return expdb.status();
-    }
-    PStore kvstore = expdb.value().store;
-    auto ptxn = sess->getCtx()->createTransaction(kvstore);
-    if (!ptxn.ok()) {
-      return ptxn.status();
+    if (!sources[0]) {
+      return result.finish();
     }
 
-    Expected<bool> deleted = delGeneric(sess, storeKey, ptxn.value());
-    // Expected<bool> deleted = Command::delKeyChkExpire(sess, storeKey,
-    // RecordType::RT_SET_META);
-    if (!deleted.ok()) {
-      return deleted.status();
-    }
-
-    std::vector<std::string> newKeys(2);
-    for (auto& v : result) {
-      newKeys.push_back(std::move(v));
-    }
-
-    RecordKey storeRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_SET_META,
-                      storeKey,
-                      "");
-    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-      Expected<std::string> addStore = genericSAdd(
-        sess,
-        kvstore,
-        ptxn.value(),
-        storeRk,
-        {ErrorCodes::ERR_NOTFOUND, ""}, /* storeKey has been deleted */
-        newKeys);
-      if (addStore.ok()) {
-        auto s1 = sess->getCtx()->commitTransaction(ptxn.value());
-        if (!s1.ok()) {
-          return s1.status();
-        }
-        return addStore.value();
+    // walk the first set, and skip the members of the others
+    std::vector<std::unique_ptr<SetCursor>> probes;
+    for (size_t i = 1; i < sources.size(); ++i) {
+      if (sources[i]) {
+        probes.emplace_back(sources[i]->newCursor());
       }
-      if (addStore.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
-        return addStore.status();
+    }
+    auto cursor = sources[0]->newCursor();
+    while (true) {
+      auto eMember = cursor->next();
+      if (eMember.status().code() == ErrorCodes::ERR_EXHAUST) {
+        break;
       }
-      if (i == RETRY_CNT - 1) {
-        return addStore.status();
-      } else {
-        continue;
+      RET_IF_ERR_EXPECTED(eMember);
+      auto eFound = anyContains(probes, eMember.value());
+      RET_IF_ERR_EXPECTED(eFound);
+      if (!eFound.value()) {
+        Status s = result.add(eMember.value());
+        RET_IF_ERR(s);
       }
     }
-    return {ErrorCodes::ERR_INTERNAL, "currently unrechable"};
+    return result.finish();
   }
 
  private:
@@ -1006,9 +1360,10 @@ class SdiffStoreCommand : public SdiffgenericCommand {
   }
 } sdiffstoreCommand;
 
-// Implement O(n*m) intersection
-// which n is the cardinality of the smallest set
-// m is the num of sets input
+// Implement the intersection as a stream, the smallest set is walked,
+// and every member of it is looked up in the other sets from the smaller
+// ones, see SetCursor. It costs O(n*m) at most, which n is the
+// cardinality of the smallest set, m is the num of sets input.
 class SintergenericCommand : public Command {
  public:
   SintergenericCommand(const std::string& name, const char* sflags, bool store)
@@ -1017,9 +1372,7 @@ class SintergenericCommand : public Command {
   Expected<std::string> run(Session* sess) final {
     const std::vector<std::string>& args = sess->getArgs();
     size_t startkey = _store ? 2 : 1;
-    std::set<std::string> result;
     auto server = sess->getServerEntry();
-    SessionCtx* pCtx = sess->getCtx();
 
     std::vector<int> index = getKeysFromCommand(args);
     auto lock = server->getSegmentMgr()->getAllKeysLocked(
@@ -1028,163 +1381,56 @@ class SintergenericCommand : public Command {
       return lock.status();
     }
 
-    // stored all sets sorted by their length
-    std::vector<std::pair<size_t, uint64_t>> setList;
-    for (size_t i = startkey; i < args.size(); i++) {
-      Expected<RecordValue> rv =
-        Command::expireKeyIfNeeded(sess, args[i], RecordType::RT_SET_META);
-
-      // if one set is empty, their intersection is empty set, so just
-      // return it.
-      if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
-          rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        if (_store) {
-          continue;
-        }
-        return Command::fmtNull();
-      } else if (!rv.ok()) {
-        return rv.status();
-      }
-
-      Expected<SetMetaValue> expSetMeta =
-        SetMetaValue::decode(rv.value().getValue());
+    auto eSources = loadSetSources(sess, args, startkey, !_store);
+    RET_IF_ERR_EXPECTED(eSources);
+    SetOpResult result(sess);
+    if (_store) {
+      Status s = result.openStore(args[1]);
+      RET_IF_ERR(s);
+    }
 
-      uint64_t setLength = expSetMeta.value().getCount();
-      if (setLength == 0) {
+    // if one set is empty, their intersection is empty set
+    std::vector<const SetSource*> setList;
+    for (const auto& source : eSources.value()) {
+      if (!source || source->meta.getCount() == 0) {
         if (_store) {
-          continue;
+          // we must del the storeKey before we return
+          return result.finish();
         }
         return Command::fmtNull();
       }
-      setList.push_back(std::make_pair(i, setLength));
+      setList.push_back(source.get());
     }
     std::sort(setList.begin(), setList.end(), [](auto& left, auto& right) {
-      return left.second < right.second;
+      return left->meta.getCount() < right->meta.getCount();
     });
 
-    for (size_t i = 0; i < setList.size(); i++) {
-      const std::string& key = args[setList[i].first];
-      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, key);
-      if (!expdb.ok()) {
-        return expdb.status();
-      }
-      PStore kvstore = expdb.value().store;
-      auto ptxn = sess->getCtx()->createTransaction(kvstore);
-      if (!ptxn.ok()) {
-        return ptxn.status();
-      }
-      if (i == 0) {
-        auto cursor = ptxn.value()->createDataCursor();
-        RecordKey fakeRk(expdb.value().chunkId,
-                         pCtx->getDbId(),
-                         RecordType::RT_SET_ELE,
-                         key,
-                         "");
-        cursor->seek(fakeRk.prefixPk());
-        while (true) {
-          Expected<Record> expRcd = cursor->next();
-          if (expRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-            break;
-          }
-          if (!expRcd.ok()) {
-            return expRcd.status();
-          }
-          Record& rcd = expRcd.value();
-          const RecordKey& rcdKey = rcd.getRecordKey();
-          if (rcdKey.prefixPk() != fakeRk.prefixPk()) {
-            break;
-          }
-          result.insert(rcdKey.getSecondaryKey());
-        }
-        // for the smallest set
-        // input all its keys into set, then goto next loop;
-        continue;
+    std::vector<std::unique_ptr<SetCursor>> probes;
+    for (size_t i = 1; i < setList.size(); i++) {
+      probes.emplace_back(setList[i]->newCursor());
+    }
+    auto cursor = setList[0]->newCursor();
+    while (true) {
+      auto eMember = cursor->next();
+      if (eMember.status().code() == ErrorCodes::ERR_EXHAUST) {
+        break;
       }
-      if (result.size() == 0) {
-        if (_store) {
-          // we must del the storeKey before we return
+      RET_IF_ERR_EXPECTED(eMember);
+      bool inAll = true;
+      for (const auto& probe : probes) {
+        auto eFound = probe->contains(eMember.value());
+        RET_IF_ERR_EXPECTED(eFound);
+        if (!eFound.value()) {
+          inAll = false;
           break;
         }
-        // has no intersection, just return empty set
-        return Command::fmtNull();
-      }
-
-      for (auto iter = result.begin(); iter != result.end();) {
-        RecordKey subRk(expdb.value().chunkId,
-                        pCtx->getDbId(),
-                        RecordType::RT_SET_ELE,
-                        key,
-                        *iter);
-        Expected<RecordValue> subValue = kvstore->getKV(subRk, ptxn.value());
-        // if key not found, erase it
-        if (!subValue.ok() ||
-            subValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
-          // then the old iterator will be invalid
-          // new value is the iterator to the next element
-          iter = result.erase(iter);
-        } else {
-          // otherwise move forward manually
-          iter++;
-        }
-      }
-    }
-
-    if (!_store) {
-      std::stringstream ss;
-      Command::fmtMultiBulkLen(ss, result.size());
-      for (auto& v : result) {
-        Command::fmtBulk(ss, v);
       }
-      return ss.str();
-    }
-
-    const std::string& storeKey = args[1];
-    auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, storeKey);
-    if (!expdb.ok()) {
-      return expdb.status();
-    }
-    PStore kvstore = expdb.value().store;
-    auto ptxn = sess->getCtx()->createTransaction(kvstore);
-    if (!ptxn.ok()) {
-      return ptxn.status();
-    }
-
-    Expected<bool> deleted = delGeneric(sess, storeKey, ptxn.value());
-    // Expected<bool> deleted = Command::delKeyChkExpire(sess, storeKey,
-    // RecordType::RT_SET_META);
-    if (!deleted.ok()) {
-      return deleted.status();
-    }
-
-    std::vector<std::string> newKeys(2);
-    for (auto& v : result) {
-      newKeys.push_back(std::move(v));
-    }
-
-
-    RecordKey storeRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_SET_META,
-                      storeKey,
-                      "");
-    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-      Expected<std::string> addStore =
-        genericSAdd(sess,
-                    kvstore,
-                    ptxn.value(),
-                    storeRk,
-                    {ErrorCodes::ERR_NOTFOUND, ""},
-                    newKeys);
-      if (addStore.ok()) {
-        auto s1 = sess->getCtx()->commitTransaction(ptxn.value());
-        if (!s1.ok()) {
-          return s1.status();
-        }
-        return addStore.value();
+      if (inAll) {
+        Status s = result.add(eMember.value());
+        RET_IF_ERR(s);
       }
-      return addStore.status();
     }
-    return {ErrorCodes::ERR_INTERNAL, "currently unrechable"};
+    return result.finish();
   }
 
  private:
@@ -1381,9 +1627,7 @@ class SuniongenericCommand : public Command {
   Expected<std::string> run(Session* sess) final {
     const std::vector<std::string>& args = sess->getArgs();
     size_t startkey = _store ? 2 : 1;
-    std::unordered_set<std::string> result;
     auto server = sess->getServerEntry();
-    SessionCtx* pCtx = sess->getCtx();
 
     std::vector<int> index = getKeysFromCommand(args);
     auto lock = server->getSegmentMgr()->getAllKeysLocked(
@@ -1392,109 +1636,37 @@ class SuniongenericCommand : public Command {
       return lock.status();
     }
 
-    for (size_t i = startkey; i < args.size(); ++i) {
-      Expected<RecordValue> rv =
-        Command::expireKeyIfNeeded(sess, args[i], RecordType::RT_SET_META);
-      if (rv.status().code() == ErrorCodes::ERR_EXPIRED ||
-          rv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        continue;
-      } else if (!rv.ok()) {
-        return rv.status();
-      }
+    auto eSources = loadSetSources(sess, args, startkey, false);
+    RET_IF_ERR_EXPECTED(eSources);
+    SetOpResult result(sess);
+    if (_store) {
+      Status s = result.openStore(args[1]);
+      RET_IF_ERR(s);
+    }
 
-      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, args[i]);
-      if (!expdb.ok()) {
-        return expdb.status();
-      }
-      PStore kvstore = expdb.value().store;
-      auto ptxn = sess->getCtx()->createTransaction(kvstore);
-      if (!ptxn.ok()) {
-        return ptxn.status();
+    // walk the sets one by one, and skip the members of the sets before
+    std::vector<std::unique_ptr<SetCursor>> probes;
+    for (const auto& source : eSources.value()) {
+      if (!source) {
+        continue;
       }
-      auto cursor = ptxn.value()->createDataCursor();
-      RecordKey fakeRk(expdb.value().chunkId,
-                       pCtx->getDbId(),
-                       RecordType::RT_SET_ELE,
-                       args[i],
-                       "");
-      cursor->seek(fakeRk.prefixPk());
+      auto cursor = source->newCursor();
       while (true) {
-        Expected<Record> exptRcd = cursor->next();
-        if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-          break;
-        }
-        if (!exptRcd.ok()) {
-          return exptRcd.status();
-        }
-
-        Record& rcd = exptRcd.value();
-        const RecordKey& rcdkey = rcd.getRecordKey();
-        if (rcdkey.prefixPk() != fakeRk.prefixPk()) {
+        auto eMember = cursor->next();
+        if (eMember.status().code() == ErrorCodes::ERR_EXHAUST) {
           break;
         }
-        result.insert(rcdkey.getSecondaryKey());
-      }
-    }
-
-    if (!_store) {
-      std::stringstream ss;
-      Command::fmtMultiBulkLen(ss, result.size());
-      for (const auto& v : result) {
-        Command::fmtBulk(ss, v);
-      }
-      return ss.str();
-    }
-
-    const std::string& storeKey = args[1];
-    auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, storeKey);
-    if (!expdb.ok()) {
-      return expdb.status();
-    }
-    PStore kvstore = expdb.value().store;
-    auto ptxn = sess->getCtx()->createTransaction(kvstore);
-    if (!ptxn.ok()) {
-      return ptxn.status();
-    }
-    Expected<bool> deleted = delGeneric(sess, storeKey, ptxn.value());
-    if (!deleted.ok()) {
-      return deleted.status();
-    }
-
-    std::vector<std::string> newKeys(2);
-    for (const auto& v : result) {
-      newKeys.push_back(std::move(v));
-    }
-
-    RecordKey storeRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_SET_META,
-                      storeKey,
-                      "");
-    for (uint32_t i = 0; i < RETRY_CNT; ++i) {
-      Expected<std::string> addStore =
-        genericSAdd(sess,
-                    kvstore,
-                    ptxn.value(),
-                    storeRk,
-                    {ErrorCodes::ERR_NOTFOUND, ""},
-                    newKeys);
-      if (addStore.ok()) {
-        auto s1 = sess->getCtx()->commitTransaction(ptxn.value());
-        if (!s1.ok()) {
-          return s1.status();
+        RET_IF_ERR_EXPECTED(eMember);
+        auto eFound = anyContains(probes, eMember.value());
+        RET_IF_ERR_EXPECTED(eFound);
+        if (!eFound.value()) {
+          Status s = result.add(eMember.value());
+          RET_IF_ERR(s);
         }
-        return addStore.value();
-      }
-      if (addStore.status().code() != ErrorCodes::ERR_COMMIT_RETRY) {
-        return addStore.status();
-      }
-      if (i == RETRY_CNT - 1) {
-        return addStore.status();
-      } else {
-        continue;
       }
+      probes.emplace_back(source->newCursor());
     }
-    return {ErrorCodes::ERR_INTERNAL, "not reachable"};
+    return result.finish();
   }
 
  private:
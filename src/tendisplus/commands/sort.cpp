@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <map>
 #ifndef _WIN32
 #include <experimental/optional>
 #endif
@@ -13,6 +14,7 @@
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/quicklist.h"
 
 namespace tendisplus {
 constexpr uint64_t MAXSEQ = 9223372036854775807ULL;
@@ -70,50 +72,106 @@ class SortCommand : public Command {
     return std::make_pair(std::move(combine), std::move(field));
   }
 
-  Expected<std::string> getPatternResult(Session* sess,
-                                         const std::string& metaKey,
-                                         const std::string& fieldKey) {
+  // get the values of keys(or fields of hash keys) matched by pattern, the
+  // result is in the same order with metaKeys. the metas and fields in the
+  // same kvstore are read by one KVStore::getKVs()
+  Expected<std::vector<Expected<std::string>>> getPatternResults(
+    Session* sess,
+    const std::vector<std::string>& metaKeys,
+    const std::string& fieldKey) {
     const auto& server = sess->getServerEntry();
     const auto& pCtx = sess->getCtx();
-    auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, metaKey);
-    if (!expdb.ok()) {
-      return expdb.status();
+    std::vector<Expected<std::string>> result(
+      metaKeys.size(), Expected<std::string>(ErrorCodes::ERR_NOTFOUND, ""));
+    if (metaKeys.empty()) {
+      return result;
     }
 
-    auto byRv =
-      Command::expireKeyIfNeeded(sess, metaKey, RecordType::RT_DATA_META);
-    // should handle NOT_FOUND and EXPIRED outsie
-    if (!byRv.ok()) {
-      return byRv.status();
+    auto eMetas =
+      Command::expireKeysIfNeeded(sess, metaKeys, RecordType::RT_DATA_META);
+    if (!eMetas.ok()) {
+      return eMetas.status();
     }
-    auto byStore = expdb.value().store;
-    auto byExptxn = sess->getCtx()->createTransaction(byStore);
-    if (!byExptxn.ok()) {
-      return byExptxn.status();
+    auto& metas = eMetas.value();
+
+    if (fieldKey.size() == 0) {
+      for (size_t i = 0; i < metas.size(); i++) {
+        // should handle NOT_FOUND and EXPIRED outsie
+        if (!metas[i].ok()) {
+          result[i] = metas[i].status();
+        } else if (metas[i].value().isPieced()) {
+          // load the whole string, see Bitmap
+          auto rv =
+            Command::expireKeyIfNeeded(sess, metaKeys[i], RecordType::RT_KV);
+          if (rv.ok()) {
+            result[i] = rv.value().getValue();
+          } else {
+            result[i] = rv.status();
+          }
+        } else {
+          result[i] = std::move(metas[i].value().getValue());
+        }
+      }
+      return result;
     }
 
-    if (fieldKey.size() != 0) {
-      RecordKey hashRk(expdb.value().chunkId,
-                       pCtx->getDbId(),
-                       RecordType::RT_HASH_ELE,
-                       metaKey,
-                       fieldKey);
-      auto hashVal = byStore->getKV(hashRk, byExptxn.value());
-      if (!hashVal.ok()) {
-        return hashVal.status();
-      }
-      return std::move(hashVal.value().getValue());
-    } else {
-      RecordKey kvRk(
-        expdb.value().chunkId, pCtx->getDbId(), RecordType::RT_KV, metaKey, "");
-      auto kvVal = byStore->getKV(kvRk, byExptxn.value());
-      if (!kvVal.ok()) {
-        return kvVal.status();
+    struct StoreBatch {
+      PStore store;
+      std::vector<size_t> idx;
+      std::vector<RecordKey> keys;
+    };
+    std::map<uint32_t, StoreBatch> batches;
+    for (size_t i = 0; i < metas.size(); i++) {
+      if (!metas[i].ok()) {
+        result[i] = metas[i].status();
+        continue;
       }
-      return std::move(kvVal.value().getValue());
+      if (metas[i].value().getRecordType() == RecordType::RT_HASH_META) {
+        auto hm = HashMetaValue::decode(metas[i].value().getValue());
+        if (!hm.ok()) {
+          return hm.status();
+        }
+        if (auto lp = hm.value().getListPack()) {
+          auto v = lp->get(fieldKey);
+          if (v) {
+            result[i] = *v;
+          }
+          continue;
+        }
+      }
+      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, metaKeys[i]);
+      if (!expdb.ok()) {
+        return expdb.status();
+      }
+      auto& batch = batches[expdb.value().dbId];
+      batch.store = expdb.value().store;
+      batch.idx.push_back(i);
+      batch.keys.emplace_back(expdb.value().chunkId,
+                              pCtx->getDbId(),
+                              RecordType::RT_HASH_ELE,
+                              metaKeys[i],
+                              fieldKey,
+                              metas[i].value().getVersion());
     }
-  }
 
+    for (auto& v : batches) {
+      auto& batch = v.second;
+      auto byExptxn = sess->getCtx()->createTransaction(batch.store);
+      if (!byExptxn.ok()) {
+        return byExptxn.status();
+      }
+      auto hashVals = batch.store->getKVs(batch.keys, byExptxn.value());
+      for (size_t j = 0; j < hashVals.size(); j++) {
+        size_t i = batch.idx[j];
+        if (!hashVals[j].ok()) {
+          result[i] = hashVals[j].status();
+        } else {
+          result[i] = std::move(hashVals[j].value().getValue());
+        }
+      }
+    }
+    return result;
+  }
 
  public:
   SortCommand() : Command("sort", "wm") {}
@@ -263,7 +321,9 @@ class SortCommand : public Command {
     // get the length of the object
     ssize_t veclen(0);
     uint64_t lHead(0), lTail(0);
+    std::unique_ptr<QuickList> ql(nullptr);
     std::unique_ptr<SkipList> sl(nullptr);
+    std::unique_ptr<ListPack> setLp(nullptr);
     switch (keyType) {
       case RecordType::RT_LIST_META: {
         auto lm = ListMetaValue::decode(rv->getValue());
@@ -273,6 +333,14 @@ class SortCommand : public Command {
         lHead = lm.value().getHead();
         lTail = lm.value().getTail();
         veclen = lTail - lHead;
+        if (lm.value().isChunked()) {
+          ql = std::make_unique<QuickList>(expdb.value().chunkId,
+                                           pCtx->getDbId(),
+                                           key,
+                                           rv->getVersion(),
+                                           lm.value(),
+                                           kvstore);
+        }
         break;
       }
       case RecordType::RT_SET_META: {
@@ -281,6 +349,9 @@ class SortCommand : public Command {
           return sm.status();
         }
         veclen = sm.value().getCount();
+        if (auto lp = sm.value().getListPack()) {
+          setLp = std::make_unique<ListPack>(*lp);
+        }
         break;
       }
       case RecordType::RT_ZSET_META: {
@@ -294,7 +365,8 @@ class SortCommand : public Command {
                                         metaRk.getDbId(),
                                         metaRk.getPrimaryKey(),
                                         meta,
-                                        kvstore);
+                                        kvstore,
+                                        rv->getVersion());
         break;
       }
       default:
@@ -352,12 +424,34 @@ class SortCommand : public Command {
         }
       }
 
+      // a chunked list is read node by node, see QuickList
+      std::vector<std::string> elements;
+      uint64_t first = 0;
+      if (ql && sign * static_cast<int64_t>(stop - pos) >= 0) {
+        first = std::min(pos, stop) - lHead;
+        auto eRange =
+          ql->range(first, std::max(pos, stop) - lHead, ptxn.value());
+        if (!eRange.ok()) {
+          return eRange.status();
+        }
+        elements = std::move(eRange.value());
+      }
       while (sign * static_cast<int64_t>(stop - pos) >= 0) {
+        if (ql) {
+          uint64_t i = pos - lHead - first;
+          if (i >= elements.size()) {
+            return {ErrorCodes::ERR_NOTFOUND, ""};
+          }
+          records.emplace_back(Element{std::move(elements[i]), 0});
+          pos += sign;
+          continue;
+        }
         RecordKey subRk(expdb.value().chunkId,
                         pCtx->getDbId(),
                         RecordType::RT_LIST_ELE,
                         key,
-                        std::to_string(pos));
+                        std::to_string(pos),
+                        rv->getVersion());
         Expected<RecordValue> expRv = kvstore->getKV(subRk, ptxn.value());
         if (!expRv.ok()) {
           return expRv.status();
@@ -365,14 +459,18 @@ class SortCommand : public Command {
         records.emplace_back(Element{expRv.value().getValue(), 0});
         pos += sign;
       }
+    } else if (keyType == RecordType::RT_SET_META && setLp) {
+      for (const auto& v : setLp->getEntries()) {
+        records.emplace_back(Element{v.first, 0});
+      }
     } else if (keyType == RecordType::RT_SET_META) {
-      auto cursor = ptxn.value()->createDataCursor();
       RecordKey fakeRk = {expdb.value().chunkId,
                           pCtx->getDbId(),
                           RecordType::RT_SET_ELE,
                           key,
-                          ""};
-      cursor->seek(fakeRk.prefixPk());
+                          "",
+                          rv->getVersion()};
+      auto cursor = ptxn.value()->createPkCursor(fakeRk.prefixPk());
       while (true) {
         Expected<Record> expRcd = cursor->next();
         if (expRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
@@ -443,6 +541,23 @@ class SortCommand : public Command {
       if (!nosort) {
         const auto& op = ops[0];
         const auto& priKeylist = op.priKey;
+        // prefetch all the "BY" values in one batch
+        std::vector<std::string> byKeys;
+        std::vector<size_t> byPos(records.size(), 0);
+        if (sortby) {
+          for (size_t i = 0; i < records.size(); i++) {
+            if (priKeylist[i].size() != 0 && priKeylist[i] != records[i].key) {
+              byPos[i] = byKeys.size();
+              byKeys.emplace_back(priKeylist[i]);
+            }
+          }
+        }
+        auto eByVals = getPatternResults(sess, byKeys, op.field);
+        if (!eByVals.ok()) {
+          return eByVals.status();
+        }
+        auto& byVals = eByVals.value();
+
         std::string nval;
         for (size_t i = 0; i < records.size(); i++) {
           auto& ele = records[i];
@@ -458,8 +573,7 @@ class SortCommand : public Command {
               // set subkey itself as value.
               nval = ele.key;
             } else {
-              const auto& field = op.field;
-              auto expVal = getPatternResult(sess, priKeylist[i], field);
+              auto& expVal = byVals[byPos[i]];
               if (expVal.status().code() == ErrorCodes::ERR_NOTFOUND ||
                   expVal.status().code() == ErrorCodes::ERR_EXPIRED) {
                 continue;
@@ -519,6 +633,31 @@ class SortCommand : public Command {
         sortStart = start;
         sortEnd = end + 1;
       }
+      // prefetch all the "GET" values of each op in one batch
+      std::vector<std::vector<Expected<std::string>>> getVals(ops.size());
+      std::vector<std::vector<size_t>> getPos(ops.size());
+      for (size_t j = 1; j < ops.size(); j++) {
+        const auto& op = ops[j];
+        if (op.cmd == "") {
+          continue;
+        }
+        std::vector<std::string> getKeys;
+        getPos[j].resize(records.size(), 0);
+        for (ssize_t i = sortStart; i < sortEnd; i++) {
+          size_t uniqueId = records[i].uniqueId;
+          const auto& priKey = op.priKey[uniqueId];
+          if (priKey.size() != 0 && priKey != records[i].key) {
+            getPos[j][i] = getKeys.size();
+            getKeys.emplace_back(priKey);
+          }
+        }
+        auto eGetVals = getPatternResults(sess, getKeys, op.field);
+        if (!eGetVals.ok()) {
+          return eGetVals.status();
+        }
+        getVals[j] = std::move(eGetVals.value());
+      }
+
       for (ssize_t i = sortStart; i < sortEnd; i++) {
         for (size_t j = 1; j < ops.size(); j++) {
           const auto& op = ops[j];
@@ -534,16 +673,15 @@ class SortCommand : public Command {
           } else if (priKeylist[uniqueId] == records[i].key) {
             result.emplace_back(records[i].key);
           } else {
-            const auto& field = op.field;
-            auto expVal = getPatternResult(sess, priKeylist[uniqueId], field);
+            auto& expVal = getVals[j][getPos[j][i]];
             if (expVal.status().code() == ErrorCodes::ERR_NOTFOUND ||
                 expVal.status().code() == ErrorCodes::ERR_EXPIRED) {
               result.emplace_back("");
-            }
-            if (!expVal.ok()) {
+            } else if (!expVal.ok()) {
               return expVal.status();
+            } else {
+              result.emplace_back(std::move(expVal.value()));
             }
-            result.emplace_back(expVal.value());
           }
         }
       }
@@ -579,27 +717,50 @@ class SortCommand : public Command {
                        RecordType::RT_LIST_META,
                        args[storeKeyIndex],
                        "");
+      auto eVersion = Command::getSubkeyVersion(
+        addStore, metaRk, {ErrorCodes::ERR_NOTFOUND, ""}, addPtxn.value());
+      if (!eVersion.ok()) {
+        return eVersion.status();
+      }
       ListMetaValue lm(INITSEQ, INITSEQ);
-      uint64_t head = lm.getHead();
-      uint64_t idx = head++;
-      for (const auto& x : result) {
-        RecordKey subRk(metaRk.getChunkId(),
-                        metaRk.getDbId(),
-                        RecordType::RT_LIST_ELE,
-                        metaRk.getPrimaryKey(),
-                        std::to_string(idx++));
-        RecordValue subRv(x, RecordType::RT_LIST_ELE, -1);
-        Status s = addStore->setKV(subRk, subRv, addPtxn.value());
+      auto params = server->getParams();
+      if (params->listMaxNodeEntries > 0) {
+        // a new list is chunked, see QuickList
+        QuickList ql(metaRk.getChunkId(),
+                     metaRk.getDbId(),
+                     metaRk.getPrimaryKey(),
+                     eVersion.value(),
+                     lm,
+                     addStore,
+                     params->listMaxNodeEntries,
+                     params->listMaxNodeBytes);
+        Status s = ql.push(result, false, addPtxn.value());
         if (!s.ok()) {
           return s;
         }
+        lm = ql.getMeta();
+      } else {
+        uint64_t head = lm.getHead();
+        uint64_t idx = head++;
+        for (const auto& x : result) {
+          RecordKey subRk(metaRk.getChunkId(),
+                          metaRk.getDbId(),
+                          RecordType::RT_LIST_ELE,
+                          metaRk.getPrimaryKey(),
+                          std::to_string(idx++),
+                          eVersion.value());
+          RecordValue subRv(x, RecordType::RT_LIST_ELE, -1);
+          Status s = addStore->setKV(subRk, subRv, addPtxn.value());
+          if (!s.ok()) {
+            return s;
+          }
+        }
+        lm.setTail(idx);
       }
-      lm.setTail(idx);
-      Status s = addStore->setKV(metaRk,
-                                 RecordValue(lm.encode(),
-                                             RecordType::RT_LIST_META,
-                                             pCtx->getVersionEP()),
-                                 addPtxn.value());
+      RecordValue metaRv(
+        lm.encode(), RecordType::RT_LIST_META, pCtx->getVersionEP());
+      metaRv.setVersion(eVersion.value());
+      Status s = addStore->setKV(metaRk, metaRv, addPtxn.value());
       if (!s.ok()) {
         return s;
       }
@@ -11,12 +11,15 @@
 #include <vector>
 #include <map>
 #include <cmath>
+#include <functional>
+#include <queue>
 #include "glog/logging.h"
 #include "tendisplus/utils/sync_point.h"
 #include "tendisplus/utils/string.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/redis_port.h"
 #include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/set_cursor.h"
 #include "tendisplus/commands/command.h"
 #include "tendisplus/storage/varint.h"
 
@@ -47,33 +50,30 @@ Expected<std::string> genericZrem(Session* sess,
     return eMetaContent.status();
   }
   ZSlMetaValue meta = eMetaContent.value();
-  SkipList sl(mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
+  uint64_t version = eMeta.value().getVersion();
+  SkipList sl(mk.getChunkId(),
+              mk.getDbId(),
+              mk.getPrimaryKey(),
+              meta,
+              kvstore,
+              version);
 
   uint32_t cnt = 0;
   for (const auto& subkey : subkeys) {
-    RecordKey hk(mk.getChunkId(),
-                 pCtx->getDbId(),
-                 RecordType::RT_ZSET_H_ELE,
-                 mk.getPrimaryKey(),
-                 subkey);
-    Expected<RecordValue> eValue = kvstore->getKV(hk, ptxn.value());
-    if (!eValue.ok() && eValue.status().code() != ErrorCodes::ERR_NOTFOUND) {
-      return eValue.status();
-    }
-    if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    Expected<double> oldScore = sl.getScore(subkey, ptxn.value());
+    if (!oldScore.ok() &&
+        oldScore.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return oldScore.status();
+    }
+    if (oldScore.status().code() == ErrorCodes::ERR_NOTFOUND) {
       continue;
     } else {
       cnt += 1;
-      Expected<double> oldScore =
-        ::tendisplus::doubleDecode(eValue.value().getValue());
-      if (!oldScore.ok()) {
-        return oldScore.status();
-      }
       Status s = sl.remove(oldScore.value(), subkey, ptxn.value());
       if (!s.ok()) {
         return s;
       }
-      s = kvstore->delKV(hk, ptxn.value());
+      s = sl.delScore(subkey, ptxn.value());
       if (!s.ok()) {
         return s;
       }
@@ -88,12 +88,15 @@ Expected<std::string> genericZrem(Session* sess,
     if (!s.ok()) {
       return s;
     }
-    RecordKey head(mk.getChunkId(),
-                   pCtx->getDbId(),
-                   RecordType::RT_ZSET_S_ELE,
-                   mk.getPrimaryKey(),
-                   std::to_string(ZSlMetaValue::HEAD_ID));
-    s = kvstore->delKV(head, ptxn.value());
+    if (!sl.isListPack()) {
+      RecordKey head(mk.getChunkId(),
+                     pCtx->getDbId(),
+                     RecordType::RT_ZSET_S_ELE,
+                     mk.getPrimaryKey(),
+                     std::to_string(ZSlMetaValue::HEAD_ID),
+                     version);
+      s = kvstore->delKV(head, ptxn.value());
+    }
   }
   if (!s.ok()) {
     return s;
@@ -140,6 +143,11 @@ Expected<std::string> genericZadd(Session* sess,
   SessionCtx* pCtx = sess->getCtx();
 
   ZSlMetaValue meta;
+  auto eVersion = Command::getSubkeyVersion(kvstore, mk, eMeta, txn);
+  if (!eVersion.ok()) {
+    return eVersion.status();
+  }
+  uint64_t version = eVersion.value();
 
   if (eMeta.ok()) {
     auto eMetaContent = ZSlMetaValue::decode(eMeta.value().getValue());
@@ -147,6 +155,11 @@ Expected<std::string> genericZadd(Session* sess,
       return eMetaContent.status();
     }
     meta = eMetaContent.value();
+  } else if (sess->getServerEntry()->getParams()->zsetMaxListpackEntries > 0) {
+    // head node also included into the count
+    meta = ZSlMetaValue(1 /*lvl*/, 1 /*count*/, 0 /*tail*/);
+    // the head is in the cache of the packed zset, see SkipList
+    meta.setListPack(ListPack());
   } else {
     INVARIANT_D(eMeta.status().code() == ErrorCodes::ERR_NOTFOUND ||
                 eMeta.status().code() == ErrorCodes::ERR_EXPIRED);
@@ -154,6 +167,7 @@ Expected<std::string> genericZadd(Session* sess,
     ZSlMetaValue tmp(1 /*lvl*/, 1 /*count*/, 0 /*tail*/);
     RecordValue rv(
       tmp.encode(), RecordType::RT_ZSET_META, pCtx->getVersionEP());
+    rv.setVersion(version);
     Status s = kvstore->setKV(mk, rv, txn);
     if (!s.ok()) {
       return s;
@@ -162,7 +176,8 @@ Expected<std::string> genericZadd(Session* sess,
                    pCtx->getDbId(),
                    RecordType::RT_ZSET_S_ELE,
                    mk.getPrimaryKey(),
-                   std::to_string(ZSlMetaValue::HEAD_ID));
+                   std::to_string(ZSlMetaValue::HEAD_ID),
+                   version);
     ZSlEleValue headVal;
     RecordValue subRv(headVal.encode(), RecordType::RT_ZSET_S_ELE, -1);
     s = kvstore->setKV(head, subRv, txn);
@@ -180,25 +195,29 @@ Expected<std::string> genericZadd(Session* sess,
     meta = eMetaContent.value();
   }
 
-  SkipList sl(mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
+  SkipList sl(mk.getChunkId(),
+              mk.getDbId(),
+              mk.getPrimaryKey(),
+              meta,
+              kvstore,
+              version);
+  const auto& params = sess->getServerEntry()->getParams();
+  sl.setMaxListPack(params->zsetMaxListpackEntries,
+                    params->zsetMaxListpackValue);
   std::stringstream ss;
   double newScore = 0;
   // sl.traverse(ss, ptxn.value());
   for (const auto& entry : subKeys) {
-    RecordKey hk(mk.getChunkId(),
-                 pCtx->getDbId(),
-                 RecordType::RT_ZSET_H_ELE,
-                 mk.getPrimaryKey(),
-                 entry.first);
     newScore = entry.second;
     if (std::isnan(newScore)) {
       return {ErrorCodes::ERR_NAN, ""};
     }
-    Expected<RecordValue> eValue = kvstore->getKV(hk, txn);
-    if (!eValue.ok() && eValue.status().code() != ErrorCodes::ERR_NOTFOUND) {
-      return eValue.status();
+    Expected<double> oldScore = sl.getScore(entry.first, txn);
+    if (!oldScore.ok() &&
+        oldScore.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return oldScore.status();
     }
-    if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    if (oldScore.status().code() == ErrorCodes::ERR_NOTFOUND) {
       if (xx) {
         continue;
       }
@@ -208,8 +227,7 @@ Expected<std::string> genericZadd(Session* sess,
       if (!s.ok()) {
         return s;
       }
-      RecordValue hv(newScore, RecordType::RT_ZSET_H_ELE);
-      s = kvstore->setKV(hk, hv, txn);
+      s = sl.setScore(entry.first, newScore, txn);
       if (!s.ok()) {
         return s;
       }
@@ -217,11 +235,6 @@ Expected<std::string> genericZadd(Session* sess,
       if (nx) {
         continue;
       }
-      Expected<double> oldScore =
-        ::tendisplus::doubleDecode(eValue.value().getValue());
-      if (!oldScore.ok()) {
-        return oldScore.status();
-      }
       if (incr) {
         newScore += oldScore.value();
         if (std::isnan(newScore)) {
@@ -243,8 +256,7 @@ Expected<std::string> genericZadd(Session* sess,
       if (!s.ok()) {
         return s;
       }
-      RecordValue hv(newScore, RecordType::RT_ZSET_H_ELE);
-      s = kvstore->setKV(hk, hv, txn);
+      s = sl.setScore(entry.first, newScore, txn);
       if (!s.ok()) {
         return s;
       }
@@ -277,31 +289,24 @@ Expected<std::string> genericZRank(Session* sess,
     return ptxn.status();
   }
 
-  RecordKey hk(mk.getChunkId(),
-               mk.getDbId(),
-               RecordType::RT_ZSET_H_ELE,
-               mk.getPrimaryKey(),
-               subkey);
-  Expected<RecordValue> eValue =
-    kvstore->getKV(hk, ptxn.value(), RecordType::RT_ZSET_H_ELE);
-  if (!eValue.ok()) {
-    if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
-      return Command::fmtNull();
-    }
-    return eValue.status();
-  }
-  Expected<double> score =
-    ::tendisplus::doubleDecode(eValue.value().getValue());
-  if (!score.ok()) {
-    return score.status();
-  }
-
   auto eMetaContent = ZSlMetaValue::decode(mv.getValue());
   if (!eMetaContent.ok()) {
     return eMetaContent.status();
   }
   const ZSlMetaValue& meta = eMetaContent.value();
-  SkipList sl(mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
+  SkipList sl(mk.getChunkId(),
+              mk.getDbId(),
+              mk.getPrimaryKey(),
+              meta,
+              kvstore,
+              mv.getVersion());
+  Expected<double> score = sl.getScore(subkey, ptxn.value());
+  if (!score.ok()) {
+    if (score.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      return Command::fmtNull();
+    }
+    return score.status();
+  }
   Expected<uint32_t> rank = sl.rank(score.value(), subkey, ptxn.value());
   if (!rank.ok()) {
     return rank.status();
@@ -379,8 +384,13 @@ class ZRemByRangeGenericCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(
-      mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey(), meta, kvstore);
+    uint64_t version = eMeta.value().getVersion();
+    SkipList sl(mk.getChunkId(),
+                mk.getDbId(),
+                mk.getPrimaryKey(),
+                meta,
+                kvstore,
+                version);
 
     if (_type == Type::RANK) {
       int64_t llen = sl.getCount() - 1;
@@ -422,12 +432,7 @@ class ZRemByRangeGenericCommand : public Command {
       result = std::move(tmp.value());
     }
     for (const auto& v : result) {
-      RecordKey hk(mk.getChunkId(),
-                   pCtx->getDbId(),
-                   RecordType::RT_ZSET_H_ELE,
-                   mk.getPrimaryKey(),
-                   v.second);
-      auto s = kvstore->delKV(hk, ptxn.value());
+      auto s = sl.delScore(v.second, ptxn.value());
       if (!s.ok()) {
         return s;
       }
@@ -442,12 +447,15 @@ class ZRemByRangeGenericCommand : public Command {
       if (!s.ok()) {
         return s;
       }
-      RecordKey head(mk.getChunkId(),
-                     pCtx->getDbId(),
-                     RecordType::RT_ZSET_S_ELE,
-                     mk.getPrimaryKey(),
-                     std::to_string(ZSlMetaValue::HEAD_ID));
-      s = kvstore->delKV(head, ptxn.value());
+      if (!sl.isListPack()) {
+        RecordKey head(mk.getChunkId(),
+                       pCtx->getDbId(),
+                       RecordType::RT_ZSET_S_ELE,
+                       mk.getPrimaryKey(),
+                       std::to_string(ZSlMetaValue::HEAD_ID),
+                       version);
+        s = kvstore->delKV(head, ptxn.value());
+      }
     }
     if (!s.ok()) {
       return s;
@@ -911,35 +919,17 @@ class ZCountCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
-    auto f = sl.firstInRange(range, ptxn.value());
-    if (!f.ok()) {
-      return f.status();
-    }
-    if (f.value() == SKIPLIST_INVALID_POS) {
-      return Command::fmtZero();
-    }
-    auto first = sl.getCacheNode(f.value());
-    Expected<uint32_t> rank =
-      sl.rank(first->getScore(), first->getSubKey(), ptxn.value());
-    if (!rank.ok()) {
-      return rank.status();
-    }
-    // sl.getCount()-1 : total skiplist nodes exclude head
-    uint32_t count = (sl.getCount() - 1 - (rank.value() - 1));
-    auto l = sl.lastInRange(range, ptxn.value());
-    if (!l.ok()) {
-      return l.status();
-    }
-    if (l.value() == SKIPLIST_INVALID_POS) {
-      return Command::fmtLongLong(count);
-    }
-    auto last = sl.getCacheNode(l.value());
-    rank = sl.rank(last->getScore(), last->getSubKey(), ptxn.value());
-    if (!rank.ok()) {
-      return rank.status();
-    }
-    return Command::fmtLongLong(count - (sl.getCount() - 1 - rank.value()));
+    SkipList sl(expdb.value().chunkId,
+                pCtx->getDbId(),
+                key,
+                meta,
+                kvstore,
+                rv.value().getVersion());
+    auto count = sl.count(range, ptxn.value());
+    if (!count.ok()) {
+      return count.status();
+    }
+    return Command::fmtLongLong(count.value());
   }
 } zcountCommand;
 
@@ -1001,7 +991,12 @@ class ZlexCountCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
+    SkipList sl(expdb.value().chunkId,
+                pCtx->getDbId(),
+                key,
+                meta,
+                kvstore,
+                rv.value().getVersion());
 
     auto f = sl.firstInLexRange(range, ptxn.value());
     if (!f.ok()) {
@@ -1137,7 +1132,12 @@ class ZRangeByScoreGenericCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
+    SkipList sl(expdb.value().chunkId,
+                pCtx->getDbId(),
+                key,
+                meta,
+                kvstore,
+                rv.value().getVersion());
     auto arr = sl.scanByScore(range, offset, limit, _rev, ptxn.value());
     if (!arr.ok()) {
       return arr.status();
@@ -1272,7 +1272,12 @@ class ZRangeByLexGenericCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
+    SkipList sl(expdb.value().chunkId,
+                pCtx->getDbId(),
+                key,
+                meta,
+                kvstore,
+                rv.value().getVersion());
     auto arr = sl.scanByLex(range, offset, limit, _rev, ptxn.value());
     if (!arr.ok()) {
       return arr.status();
@@ -1372,7 +1377,12 @@ class ZRangeGenericCommand : public Command {
       return eMetaContent.status();
     }
     ZSlMetaValue meta = eMetaContent.value();
-    SkipList sl(expdb.value().chunkId, pCtx->getDbId(), key, meta, kvstore);
+    SkipList sl(expdb.value().chunkId,
+                pCtx->getDbId(),
+                key,
+                meta,
+                kvstore,
+                rv.value().getVersion());
     int64_t len = sl.getCount() - 1;
     if (start < 0) {
       start = len + start;
@@ -1394,19 +1404,25 @@ class ZRangeGenericCommand : public Command {
     if (!arr.ok()) {
       return arr.status();
     }
-    std::stringstream ss;
+    std::string rsp;
+    size_t rspLen = 32;
+    for (const auto& v : arr.value()) {
+      // 32 is enough for the score
+      rspLen += Command::fmtBulkLen(v.second) + (withscore ? 32 : 0);
+    }
+    rsp.reserve(rspLen);
     if (withscore) {
-      Command::fmtMultiBulkLen(ss, arr.value().size() * 2);
+      Command::fmtMultiBulkLen(rsp, arr.value().size() * 2);
     } else {
-      Command::fmtMultiBulkLen(ss, arr.value().size());
+      Command::fmtMultiBulkLen(rsp, arr.value().size());
     }
     for (const auto& v : arr.value()) {
-      Command::fmtBulk(ss, v.second);
+      Command::fmtBulk(rsp, v.second);
       if (withscore) {
-        Command::fmtBulk(ss, ::tendisplus::dtos(v.first));
+        Command::fmtBulk(rsp, ::tendisplus::dtos(v.first));
       }
     }
-    return ss.str();
+    return std::move(rsp);
   }
 
  private:
@@ -1479,20 +1495,35 @@ class ZScoreCommand : public Command {
       return ptxn.status();
     }
 
-    RecordKey hk(expdb.value().chunkId,
-                 pCtx->getDbId(),
-                 RecordType::RT_ZSET_H_ELE,
-                 key,
-                 subkey);
-    Expected<RecordValue> eValue = kvstore->getKV(hk, ptxn.value());
-    if (!eValue.ok() && eValue.status().code() != ErrorCodes::ERR_NOTFOUND) {
-      return eValue.status();
+    auto eMetaContent = ZSlMetaValue::decode(rv.value().getValue());
+    if (!eMetaContent.ok()) {
+      return eMetaContent.status();
     }
-    if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
-      return Command::fmtNull();
+    std::string encoded;
+    if (auto lp = eMetaContent.value().getListPack()) {
+      auto v = lp->get(subkey);
+      if (v == nullptr) {
+        return Command::fmtNull();
+      }
+      encoded = *v;
+    } else {
+      RecordKey hk(expdb.value().chunkId,
+                   pCtx->getDbId(),
+                   RecordType::RT_ZSET_H_ELE,
+                   key,
+                   subkey,
+                   rv.value().getVersion());
+      Expected<RecordValue> eValue = kvstore->getKV(hk, ptxn.value());
+      if (!eValue.ok() &&
+          eValue.status().code() != ErrorCodes::ERR_NOTFOUND) {
+        return eValue.status();
+      }
+      if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
+        return Command::fmtNull();
+      }
+      encoded = eValue.value().getValue();
     }
-    Expected<double> oldScore =
-      ::tendisplus::doubleDecode(eValue.value().getValue());
+    Expected<double> oldScore = ::tendisplus::doubleDecode(encoded);
     if (!oldScore.ok()) {
       return oldScore.status();
     }
@@ -1676,6 +1707,106 @@ class ZSetCountCommand : public Command {
   }
 } zsetcountCmd;
 
+// a source of ZUNIONSTORE or ZINTERSTORE, the members of a set score 1.
+// The elements of a small source are packed in its meta, lp is a copy.
+struct ZSetOpSource {
+  ZSetOpSource(const RecordKey& rk, Transaction* ptxn, double w, uint64_t n)
+    : fake(rk), txn(ptxn), weight(w), count(n) {}
+
+  const RecordKey fake;
+  Transaction* const txn;
+  const double weight;
+  // the head of a zset is counted, which doesn't matter to the order
+  const uint64_t count;
+  std::unique_ptr<ListPack> lp;
+
+  bool isZset() const {
+    return fake.getRecordType() == RecordType::RT_ZSET_H_ELE;
+  }
+
+  std::unique_ptr<MemberCursor> newCursor() const {
+    if (lp) {
+      return std::make_unique<MemberCursor>(lp.get());
+    }
+    return std::make_unique<MemberCursor>(fake, txn);
+  }
+
+  std::unique_ptr<SetCursor> newProbe() const {
+    if (lp) {
+      return std::make_unique<SetCursor>(lp.get());
+    }
+    return std::make_unique<SetCursor>(fake, txn);
+  }
+
+  // the weighted score of a member from its value
+  Expected<double> score(const std::string& value) const {
+    double score = 1;
+    if (isZset()) {
+      Expected<double> eScore = tendisplus::doubleDecode(value);
+      if (!eScore.ok()) {
+        return eScore.status();
+      }
+      score = eScore.value();
+    }
+    score *= weight;
+    if (std::isnan(score)) {
+      score = 0;
+    }
+    return score;
+  }
+};
+
+// nullptr if the key is neither a zset nor a set
+Expected<std::unique_ptr<ZSetOpSource>> loadZSetOpSource(
+  Session* sess, const std::string& key, const RecordValue& rv, double w) {
+  RecordType eleType;
+  uint64_t count = 0;
+  std::unique_ptr<ListPack> lp;
+  if (rv.getRecordType() == RecordType::RT_ZSET_META) {
+    auto eMeta = ZSlMetaValue::decode(rv.getValue());
+    if (!eMeta.ok()) {
+      return eMeta.status();
+    }
+    eleType = RecordType::RT_ZSET_H_ELE;
+    count = eMeta.value().getCount();
+    if (auto packed = eMeta.value().getListPack()) {
+      lp = std::make_unique<ListPack>(std::move(*packed));
+    }
+  } else if (rv.getRecordType() == RecordType::RT_SET_META) {
+    auto eMeta = SetMetaValue::decode(rv.getValue());
+    if (!eMeta.ok()) {
+      return eMeta.status();
+    }
+    eleType = RecordType::RT_SET_ELE;
+    count = eMeta.value().getCount();
+    if (auto packed = eMeta.value().getListPack()) {
+      lp = std::make_unique<ListPack>(std::move(*packed));
+    }
+  } else {
+    return std::unique_ptr<ZSetOpSource>();
+  }
+
+  auto expdb = sess->getServerEntry()->getSegmentMgr()->getDbHasLocked(sess,
+                                                                       key);
+  if (!expdb.ok()) {
+    return expdb.status();
+  }
+  auto ptxn = sess->getCtx()->createTransaction(expdb.value().store);
+  if (!ptxn.ok()) {
+    return ptxn.status();
+  }
+  RecordKey fake(expdb.value().chunkId,
+                 sess->getCtx()->getDbId(),
+                 eleType,
+                 key,
+                 "",
+                 rv.getVersion());
+  auto source =
+    std::make_unique<ZSetOpSource>(fake, ptxn.value(), w, count);
+  source->lp = std::move(lp);
+  return std::move(source);
+}
+
 class ZUnionInterGenericCommand : public Command {
  public:
   enum class ZsetOp {
@@ -1796,153 +1927,44 @@ class ZUnionInterGenericCommand : public Command {
       return lock.status();
     }
 
-    std::vector<std::pair<size_t, uint32_t>> sortList;
-    std::vector<std::pair<uint32_t, RecordValue>> zsetList;
-    zsetList.reserve(keyindex.size() - 1);
+    std::vector<std::unique_ptr<ZSetOpSource>> sources;
     for (size_t i = 0; i < keyindex.size() - 1; i++) {
-      Expected<RecordValue> exprv = Command::expireKeyIfNeeded(
-        sess, args[keyindex[i]], RecordType::RT_DATA_META);
+      const std::string& key = args[keyindex[i]];
+      Expected<RecordValue> exprv =
+        Command::expireKeyIfNeeded(sess, key, RecordType::RT_DATA_META);
       if (exprv.status().code() == ErrorCodes::ERR_EXPIRED ||
           exprv.status().code() == ErrorCodes::ERR_NOTFOUND) {
-        if (_op == ZsetOp::SET_OP_INTER)
-          Command::fmtZero();
+        if (_op == ZsetOp::SET_OP_INTER) {
+          // the intersection is empty
+          sources.clear();
+          break;
+        }
         continue;
       } else if (!exprv.ok()) {
         return exprv.status();
       }
-      if (exprv.value().getRecordType() == RecordType::RT_ZSET_META) {
-        Expected<ZSlMetaValue> zslMeta =
-          ZSlMetaValue::decode(exprv.value().getValue());
-        uint32_t len = zslMeta.value().getCount();
-        sortList.push_back(std::make_pair(i, len));
-        zsetList.emplace_back(std::make_pair(i, std::move(exprv.value())));
-      } else if (exprv.value().getRecordType() == RecordType::RT_SET_META) {
-        Expected<SetMetaValue> eSetMeta =
-          SetMetaValue::decode(exprv.value().getValue());
-        uint32_t len = eSetMeta.value().getCount();
-        sortList.push_back(std::make_pair(i, len));
-        zsetList.emplace_back(std::make_pair(i, std::move(exprv.value())));
-      }
-    }
-
-    // sort set according to its op type.
-    bool (*comp)(size_t, size_t);
-    if (_op == ZsetOp::SET_OP_INTER) {
-      comp = [](size_t a, size_t b) { return a < b; };
-    } else {
-      comp = [](size_t a, size_t b) { return a > b; };
-    }
-    std::sort(
-      sortList.begin(), sortList.end(), [comp](auto& left, auto& right) {
-        return comp(left.second, right.second);
-      });
-
-    std::map<std::string, double> scoreMap;
-
-    for (size_t fakei = 0; fakei < sortList.size(); fakei++) {
-      size_t i = sortList[fakei].first;
-      double w = weights[i];
-      const std::string& key = args[keyindex[i]];
-      auto expdb = server->getSegmentMgr()->getDbHasLocked(sess, key);
-      if (!expdb.ok()) {
-        return expdb.status();
+      auto eSource = loadZSetOpSource(sess, key, exprv.value(), weights[i]);
+      if (!eSource.ok()) {
+        return eSource.status();
       }
-      PStore kvstore = expdb.value().store;
-      auto ptxn = sess->getCtx()->createTransaction(kvstore);
-      if (!ptxn.ok()) {
-        return ptxn.status();
+      if (eSource.value()) {
+        sources.emplace_back(std::move(eSource.value()));
       }
+    }
 
-      RecordType keyType = zsetList[i].second.getRecordType();
-      if (fakei == 0 || _op == ZsetOp::SET_OP_UNION) {
-        if (keyType == RecordType::RT_ZSET_META) {
-          Expected<ZSlMetaValue> zslMeta =
-            ZSlMetaValue::decode(zsetList[i].second.getValue());
-          SkipList sl(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      key,
-                      zslMeta.value(),
-                      kvstore);
-          auto arr = sl.scanByRank(0, sl.getCount() - 1, false, ptxn.value());
-          if (!arr.ok()) {
-            return arr.status();
-          }
-          for (const auto& v : arr.value()) {
-            double value = v.first * w;
-            if (std::isnan(value))
-              value = 0.0;
-            if (!scoreMap.count(v.second)) {
-              scoreMap[v.second] = value;
-              continue;
-            }
-            zunionInterAggregate(&scoreMap[v.second], value, aggr);
-          }
-        } else if (keyType == RecordType::RT_SET_META) {
-          auto cursor = ptxn.value()->createDataCursor();
-          RecordKey rk(expdb.value().chunkId,
-                       pCtx->getDbId(),
-                       RecordType::RT_SET_ELE,
-                       key,
-                       "");
-          cursor->seek(rk.prefixPk());
-          while (true) {
-            Expected<Record> expRcd = cursor->next();
-            if (expRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
-              break;
-            }
-            if (!expRcd.ok()) {
-              return expRcd.status();
-            }
-            Record& rcd = expRcd.value();
-            const RecordKey& rcdKey = rcd.getRecordKey();
-            if (rcdKey.prefixPk() != rk.prefixPk()) {
-              break;
-            }
-            const std::string& subkey = rcdKey.getSecondaryKey();
-            if (!scoreMap.count(subkey)) {
-              scoreMap[subkey] = 1 * w;
-              continue;
-            }
-            zunionInterAggregate(&scoreMap[subkey], 1 * w, aggr);
-          }
-        }
-        continue;
-      } else if (_op == ZsetOp::SET_OP_INTER) {
-        RecordType eleType = keyType == RecordType::RT_ZSET_META
-          ? RecordType::RT_ZSET_H_ELE
-          : RecordType::RT_SET_ELE;
-        for (auto iter = scoreMap.begin(); iter != scoreMap.end();) {
-          const std::string& subkey = iter->first;
-          RecordKey rk(
-            expdb.value().chunkId, pCtx->getDbId(), eleType, key, subkey);
-          auto eVal = kvstore->getKV(rk, ptxn.value());
-
-          if (!eVal.ok() || eVal.status().code() == ErrorCodes::ERR_NOTFOUND) {
-            iter = scoreMap.erase(iter);
-            continue;
-          }
-          double value = 1;
-          if (keyType == RecordType::RT_ZSET_META) {
-            Expected<double> eScore =
-              tendisplus::doubleDecode(eVal.value().getValue());
-            if (!eScore.ok()) {
-              return eScore.status();
-            }
-            value = eScore.value();
-          }
-          value = value * w;
-          if (std::isnan(value))
-            value = 0;
-          zunionInterAggregate(&(iter->second), value, aggr);
-          iter++;
-        }
-      }
+    Expected<std::vector<std::pair<double, std::string>>> eResult =
+      _op == ZsetOp::SET_OP_UNION ? unionSources(sources, aggr)
+                                  : interSources(sources, aggr);
+    if (!eResult.ok()) {
+      return eResult.status();
     }
+    auto& result = eResult.value();
+    // in the order of the skiplist
+    std::sort(result.begin(), result.end());
 
-    // delete before store
     const std::string& storeKey = args[1];
-    auto expdb = server->getSegmentMgr()->getDbWithKeyLock(sess, storeKey,
-            mgl::LockMode::LOCK_X);
+    auto expdb = server->getSegmentMgr()->getDbWithKeyLock(
+      sess, storeKey, mgl::LockMode::LOCK_X);
     if (!expdb.ok()) {
       return expdb.status();
     }
@@ -1951,12 +1973,31 @@ class ZUnionInterGenericCommand : public Command {
     if (!ptxn.ok()) {
       return ptxn.status();
     }
+    RecordKey storeRk(expdb.value().chunkId,
+                      pCtx->getDbId(),
+                      RecordType::RT_ZSET_META,
+                      storeKey,
+                      "");
+    // the destination may be one of the sources, its members get a newer
+    // version than the old ones
+    auto eVersion = Command::getSubkeyVersion(
+      kvstore, storeRk, {ErrorCodes::ERR_NOTFOUND, ""}, ptxn.value());
+    if (!eVersion.ok()) {
+      return eVersion.status();
+    }
+    uint64_t version = eVersion.value();
+    auto eOld = kvstore->getKV(storeRk, ptxn.value());
+    if (eOld.ok()) {
+      version = std::max(version, eOld.value().getVersion() + 1);
+    } else if (eOld.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      return eOld.status();
+    }
 
     Expected<bool> eRes = delGeneric(sess, storeKey, ptxn.value());
     if (!eRes.ok()) {
       return eRes.status();
     }
-    if (scoreMap.size() == 0) {
+    if (result.size() == 0) {
       auto eCmt = sess->getCtx()->commitTransaction(ptxn.value());
       if (!eCmt.ok()) {
         return eCmt.status();
@@ -1964,33 +2005,156 @@ class ZUnionInterGenericCommand : public Command {
       return Command::fmtZero();
     }
 
-    RecordKey storeRk(expdb.value().chunkId,
-                      pCtx->getDbId(),
-                      RecordType::RT_ZSET_META,
-                      storeKey,
-                      "");
-    for (int32_t i = 0; i < RETRY_CNT; ++i) {
-      Expected<std::string> s = genericZadd(sess,
-                                            kvstore,
-                                            storeRk,
-                                            {ErrorCodes::ERR_NOTFOUND, ""},
-                                            scoreMap,
-                                            ZADD_NONE,
-                                            ptxn.value());
+    const auto& params = server->getParams();
+    // head node also included into the count
+    ZSlMetaValue meta(1 /*lvl*/, 1 /*count*/, 0 /*tail*/);
+    if (params->zsetMaxListpackEntries >= result.size()) {
+      meta.setListPack(ListPack());
+    }
+    SkipList sl(expdb.value().chunkId,
+                pCtx->getDbId(),
+                storeKey,
+                meta,
+                kvstore,
+                version);
+    sl.setMaxListPack(params->zsetMaxListpackEntries,
+                      params->zsetMaxListpackValue);
+    Status s = sl.bulkLoad(result, ptxn.value());
+    if (!s.ok()) {
+      return s;
+    }
+    s = sl.save(ptxn.value(),
+                {ErrorCodes::ERR_NOTFOUND, ""},
+                pCtx->getVersionEP());
+    if (!s.ok()) {
+      return s;
+    }
+    auto eCmt = sess->getCtx()->commitTransaction(ptxn.value());
+    if (!eCmt.ok()) {
+      return eCmt.status();
+    }
+    return Command::fmtLongLong(result.size());
+  }
+
+ private:
+  // merge the sources in the order of the members, a member is aggregated
+  // from all the sources of it at once
+  Expected<std::vector<std::pair<double, std::string>>> unionSources(
+    const std::vector<std::unique_ptr<ZSetOpSource>>& sources,
+    Aggregate aggr) {
+    std::vector<std::pair<double, std::string>> result;
+    std::vector<std::unique_ptr<MemberCursor>> cursors;
+    std::vector<std::string> values(sources.size());
+    // the next member of each source, and the source
+    using Head = std::pair<std::string, size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    auto advance = [&](size_t i) -> Status {
+      auto eMember = cursors[i]->next();
+      if (eMember.status().code() == ErrorCodes::ERR_EXHAUST) {
+        return {ErrorCodes::ERR_OK, ""};
+      }
+      if (!eMember.ok()) {
+        return eMember.status();
+      }
+      values[i] = std::move(eMember.value().second);
+      heads.emplace(std::move(eMember.value().first), i);
+      return {ErrorCodes::ERR_OK, ""};
+    };
+    for (size_t i = 0; i < sources.size(); ++i) {
+      cursors.emplace_back(sources[i]->newCursor());
+      Status s = advance(i);
       if (!s.ok()) {
-        return s.status();
+        return s;
       }
-      auto eCmt = sess->getCtx()->commitTransaction(ptxn.value());
-      if (!eCmt.ok()) {
-        return eCmt.status();
+    }
+    while (!heads.empty()) {
+      std::string member = heads.top().first;
+      double score = 0;
+      bool first = true;
+      while (!heads.empty() && heads.top().first == member) {
+        size_t i = heads.top().second;
+        heads.pop();
+        auto eScore = sources[i]->score(values[i]);
+        if (!eScore.ok()) {
+          return eScore.status();
+        }
+        if (first) {
+          score = eScore.value();
+          first = false;
+        } else {
+          zunionInterAggregate(&score, eScore.value(), aggr);
+        }
+        Status s = advance(i);
+        if (!s.ok()) {
+          return s;
+        }
       }
-      return s.value();
+      result.emplace_back(score, std::move(member));
     }
+    return std::move(result);
+  }
 
-    return {ErrorCodes::ERR_INTERNAL, "Not reachable"};
+  // walk the smallest source, and probe the others, see SetCursor
+  Expected<std::vector<std::pair<double, std::string>>> interSources(
+    const std::vector<std::unique_ptr<ZSetOpSource>>& sources,
+    Aggregate aggr) {
+    std::vector<std::pair<double, std::string>> result;
+    if (sources.empty()) {
+      return std::move(result);
+    }
+    size_t walker = 0;
+    for (size_t i = 1; i < sources.size(); ++i) {
+      if (sources[i]->count < sources[walker]->count) {
+        walker = i;
+      }
+    }
+    std::vector<std::unique_ptr<SetCursor>> probes(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) {
+      if (i != walker) {
+        probes[i] = sources[i]->newProbe();
+      }
+    }
+    auto cursor = sources[walker]->newCursor();
+    std::string value;
+    while (true) {
+      auto eMember = cursor->next();
+      if (eMember.status().code() == ErrorCodes::ERR_EXHAUST) {
+        break;
+      }
+      if (!eMember.ok()) {
+        return eMember.status();
+      }
+      const std::string& member = eMember.value().first;
+      auto eScore = sources[walker]->score(eMember.value().second);
+      if (!eScore.ok()) {
+        return eScore.status();
+      }
+      double score = eScore.value();
+      bool found = true;
+      for (size_t i = 0; i < sources.size() && found; ++i) {
+        if (i == walker) {
+          continue;
+        }
+        auto eFound = probes[i]->contains(member, &value);
+        if (!eFound.ok()) {
+          return eFound.status();
+        }
+        found = eFound.value();
+        if (found) {
+          auto eOther = sources[i]->score(value);
+          if (!eOther.ok()) {
+            return eOther.status();
+          }
+          zunionInterAggregate(&score, eOther.value(), aggr);
+        }
+      }
+      if (found) {
+        result.emplace_back(score, std::move(eMember.value().first));
+      }
+    }
+    return std::move(result);
   }
 
- private:
   void zunionInterAggregate(double* oldScore,
                             double value,
                             const Aggregate& aggr) {
@@ -7,7 +7,6 @@ namespace tendisplus {
 namespace mgl {
 
 std::atomic<uint64_t> MGLock::_idGen(0);
-std::list<MGLock*> MGLock::_dummyList{};
 
 MGLock::MGLock(MGLockMgr* mgr)
   : _id(_idGen.fetch_add(1, std::memory_order_relaxed)),
@@ -15,7 +14,9 @@ MGLock::MGLock(MGLockMgr* mgr)
     _targetHash(0),
     _mode(LockMode::LOCK_NONE),
     _res(LockRes::LOCKRES_UNINITED),
-    _resIter(_dummyList.end()),
+    _fastPath(false),
+    _prev(nullptr),
+    _next(nullptr),
     _lockMgr(mgr),
     _threadId(getCurThreadId()) {}
 
@@ -26,13 +27,13 @@ MGLock::~MGLock() {
 void MGLock::releaseLockResult() {
   std::lock_guard<std::mutex> lk(_mutex);
   _res = LockRes::LOCKRES_UNINITED;
-  _resIter = _dummyList.end();
+  _fastPath = false;
 }
 
-void MGLock::setLockResult(LockRes res, std::list<MGLock*>::iterator iter) {
+void MGLock::setLockResult(LockRes res, bool fastPath) {
   std::lock_guard<std::mutex> lk(_mutex);
   _res = res;
-  _resIter = iter;
+  _fastPath = fastPath;
 }
 
 void MGLock::unlock() {
@@ -56,7 +57,7 @@ LockRes MGLock::lock(const std::string& target,
   _target = target;
   _mode = mode;
   INVARIANT_D(getStatus() == LockRes::LOCKRES_UNINITED);
-  _resIter = _dummyList.end();
+  INVARIANT_D(_prev == nullptr && _next == nullptr);
   if (_target != "") {
     _targetHash = static_cast<uint64_t>(std::hash<std::string>{}(_target));
   } else {
@@ -77,10 +78,6 @@ LockRes MGLock::lock(const std::string& target,
   }
 }
 
-std::list<MGLock*>::iterator MGLock::getLockIter() const {
-  return _resIter;
-}
-
 void MGLock::notify() {
   _cv.notify_one();
 }
@@ -97,18 +94,24 @@ LockRes MGLock::getStatus() const {
   return _res;
 }
 
+bool MGLock::isFastPath() const {
+  std::lock_guard<std::mutex> lk(_mutex);
+  return _fastPath;
+}
+
 std::string MGLock::toString() const {
   std::lock_guard<std::mutex> lk(_mutex);
   char buf[256];
   snprintf(buf,
            sizeof(buf),
            "id:%" PRIu64 " target:%s targetHash:%" PRIu64
-           " LockMode:%s LockRes:%d threadId:0x%" PRIx64,
+           " LockMode:%s LockRes:%d fastPath:%d threadId:0x%" PRIx64,
            _id,
            _target.c_str(),
            _targetHash,
            lockModeRepr(_mode),
            static_cast<int>(_res),
+           static_cast<int>(_fastPath),
            _threadId);
   return std::string(buf);
 }
@@ -3,7 +3,6 @@
 
 #include <atomic>
 #include <string>
-#include <list>
 #include <mutex>  // NOLINT
 #include <condition_variable>  // NOLINT
 
@@ -15,6 +14,7 @@ namespace tendisplus {
 namespace mgl {
 
 class LockSchedCtx;
+class LockList;
 
 // multi granularity lock
 // each lock can lock only one target, use multiple MGLocks
@@ -34,12 +34,15 @@ class MGLock {
     const std::string& getTarget() const { return _target; }
     std::string toString() const;
     uint64_t getThreadId() const { return _threadId; }
+    // whether the lock is granted by the fast path of MGLockMgr
+    bool isFastPath() const;
 
  private:
     friend class LockSchedCtx;
-    void setLockResult(LockRes res, std::list<MGLock*>::iterator iter);
+    friend class LockList;
+    friend class MGLockMgr;
+    void setLockResult(LockRes res, bool fastPath = false);
     void releaseLockResult();
-    std::list<MGLock*>::iterator getLockIter() const;
     void notify();
     bool waitLock(uint64_t timeoutMs);
 
@@ -52,12 +55,14 @@ class MGLock {
     mutable std::mutex _mutex;
     std::condition_variable _cv;
     LockRes _res;
-    std::list<MGLock*>::iterator _resIter;
+    bool _fastPath;
+    // linked in LockSchedCtx's running or pending list
+    MGLock* _prev;
+    MGLock* _next;
     MGLockMgr* _lockMgr;
     uint64_t _threadId;
 
     static std::atomic<uint64_t> _idGen;
-    static std::list<MGLock*> _dummyList;
 };
 
 }  // namespace mgl
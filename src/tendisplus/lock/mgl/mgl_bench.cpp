@@ -0,0 +1,88 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+// microbenchmark of MGLockMgr, compares the fast path with the mutex only
+// path, usage: mgl_bench [threads] [seconds] [hotkey percent]
+// each op locks like a write command: IX on store, IX on chunk, X on key
+
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "tendisplus/lock/mgl/mgl.h"
+#include "tendisplus/lock/mgl/mgl_mgr.h"
+
+namespace tendisplus {
+namespace mgl {
+
+uint64_t runBench(bool fastPath,
+                  size_t threadNum,
+                  size_t seconds,
+                  size_t hotPercent) {
+  auto mgr = std::make_unique<MGLockMgr>(fastPath);
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> ops(0);
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0; i < threadNum; i++) {
+    threads.emplace_back([&, i]() {
+      uint64_t n = 0;
+      uint32_t seed = static_cast<uint32_t>(i);
+      while (!stop.load(std::memory_order_relaxed)) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t rnd = seed >> 8;
+        bool hot = rnd % 100 < hotPercent;
+        std::string key =
+          hot ? "hotkey" : "key_" + std::to_string(rnd % 1000000);
+        std::string chunk = "chunk_" + std::to_string(rnd % 16384);
+
+        MGLock store(mgr.get()), chk(mgr.get()), k(mgr.get());
+        store.lock("store_0", LockMode::LOCK_IX, 10000);
+        chk.lock(chunk, LockMode::LOCK_IX, 10000);
+        k.lock(key, LockMode::LOCK_X, 10000);
+        k.unlock();
+        chk.unlock();
+        store.unlock();
+        n++;
+      }
+      ops.fetch_add(n, std::memory_order_relaxed);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  stop.store(true, std::memory_order_relaxed);
+  for (auto& t : threads) {
+    t.join();
+  }
+  return ops.load() / seconds;
+}
+
+}  // namespace mgl
+}  // namespace tendisplus
+
+int main(int argc, char** argv) {
+  size_t threadNum = argc > 1 ? strtoul(argv[1], nullptr, 10) : 64;
+  size_t seconds = argc > 2 ? strtoul(argv[2], nullptr, 10) : 5;
+  size_t hotPercent = argc > 3 ? strtoul(argv[3], nullptr, 10) : 10;
+  if (threadNum == 0 || seconds == 0 || hotPercent > 100) {
+    std::cerr << "usage: " << argv[0]
+              << " [threads] [seconds] [hotkey percent]" << std::endl;
+    return 1;
+  }
+
+  std::cout << "threads:" << threadNum << " seconds:" << seconds
+            << " hotkey percent:" << hotPercent << std::endl;
+  for (bool fastPath : {false, true}) {
+    uint64_t qps = tendisplus::mgl::runBench(
+      fastPath, threadNum, seconds, hotPercent);
+    std::cout << (fastPath ? "fastpath " : "mutex    ") << qps << " ops/s"
+              << std::endl;
+  }
+  return 0;
+}
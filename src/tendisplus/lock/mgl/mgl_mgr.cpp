@@ -43,67 +43,104 @@ bool isConflict(uint16_t modes, LockMode mode) {
   return (conflictTable[modeInt] & modes) != 0;
 }
 
-LockSchedCtx::LockSchedCtx()
-  : _runningModes(0),
+void LockList::pushBack(MGLock* core) {
+  INVARIANT_D(core->_prev == nullptr && core->_next == nullptr);
+  core->_prev = _tail;
+  core->_next = nullptr;
+  if (_tail) {
+    _tail->_next = core;
+  } else {
+    _head = core;
+  }
+  _tail = core;
+  ++_size;
+}
+
+void LockList::erase(MGLock* core) {
+  INVARIANT_D(_size != 0);
+  if (core->_prev) {
+    core->_prev->_next = core->_next;
+  } else {
+    INVARIANT_D(_head == core);
+    _head = core->_next;
+  }
+  if (core->_next) {
+    core->_next->_prev = core->_prev;
+  } else {
+    INVARIANT_D(_tail == core);
+    _tail = core->_prev;
+  }
+  core->_prev = nullptr;
+  core->_next = nullptr;
+  --_size;
+}
+
+MGLock* LockList::next(MGLock* core) {
+  return core->_next;
+}
+
+LockSchedCtx::LockSchedCtx(uint64_t hash)
+  : _hash(hash),
+    _runningModes(0),
     _pendingModes(0),
-    _runningRefCnt(enum2Int(LockMode::LOCK_MODE_NUM), 0),
-    _pendingRefCnt(enum2Int(LockMode::LOCK_MODE_NUM), 0) {}
+    _runningRefCnt{0},
+    _pendingRefCnt{0} {}
 
 // NOTE(deyukong): if compitable locks come endlessly,
 // and we always schedule compitable locks first.
 // Then the _pendingList will have no chance to schedule.
-void LockSchedCtx::lock(MGLock* core) {
+void LockSchedCtx::lock(MGLock* core, uint16_t fastModes) {
   auto mode = core->getMode();
-  if (isConflict(_runningModes, mode) || _pendingList.size() >= 1) {
-    auto it = _pendingList.insert(_pendingList.end(), core);
+  if (isConflict(_runningModes | fastModes, mode) || _pendingList.size() >= 1) {
+    _pendingList.pushBack(core);
     incrPendingRef(mode);
-    core->setLockResult(LockRes::LOCKRES_WAIT, it);
+    core->setLockResult(LockRes::LOCKRES_WAIT);
   } else {
-    auto it = _runningList.insert(_runningList.end(), core);
+    _runningList.pushBack(core);
     incrRunningRef(mode);
-    core->setLockResult(LockRes::LOCKRES_OK, it);
+    core->setLockResult(LockRes::LOCKRES_OK);
   }
 }
 
-void LockSchedCtx::schedPendingLocks() {
-  std::list<MGLock*>::iterator it = _pendingList.begin();
-  while (it != _pendingList.end()) {
-    MGLock* tmpLock = *it;
-    if (isConflict(_runningModes, tmpLock->getMode())) {
-      it++;
+void LockSchedCtx::schedPendingLocks(uint16_t fastModes) {
+  MGLock* tmpLock = _pendingList.front();
+  while (tmpLock != nullptr) {
+    if (isConflict(_runningModes | fastModes, tmpLock->getMode())) {
       // NOTE(vinchen): Here, it should be break instead of continue.
       // Because of first come first lock/unlock, it can't release the
       // lock after the conflict pending lock. Otherwise, it would lead
       // to this lock starve.
       break;
     }
+    MGLock* next = LockList::next(tmpLock);
     incrRunningRef(tmpLock->getMode());
     decPendingRef(tmpLock->getMode());
-    auto runningIt = _runningList.insert(_runningList.end(), tmpLock);
-    it = _pendingList.erase(it);
-    tmpLock->setLockResult(LockRes::LOCKRES_OK, runningIt);
+    _pendingList.erase(tmpLock);
+    _runningList.pushBack(tmpLock);
+    tmpLock->setLockResult(LockRes::LOCKRES_OK);
     tmpLock->notify();
+    tmpLock = next;
   }
 }
 
-bool LockSchedCtx::unlock(MGLock* core) {
+bool LockSchedCtx::unlock(MGLock* core, uint16_t fastModes) {
   auto mode = core->getMode();
   if (core->getStatus() == LockRes::LOCKRES_OK) {
-    _runningList.erase(core->getLockIter());
+    _runningList.erase(core);
     decRunningRef(mode);
     core->releaseLockResult();
     if (_runningModes != 0) {
       return false;
     }
     INVARIANT_D(_runningList.size() == 0);
-    schedPendingLocks();
+    schedPendingLocks(fastModes);
   } else if (core->getStatus() == LockRes::LOCKRES_WAIT) {
-    _pendingList.erase(core->getLockIter());
+    _pendingList.erase(core);
     decPendingRef(mode);
     core->releaseLockResult();
     INVARIANT_D((_pendingModes == 0 && _pendingList.size() == 0) ||
                 (_pendingModes != 0 && _pendingList.size() != 0));
-    schedPendingLocks();
+    schedPendingLocks(fastModes);
   } else {
     INVARIANT_D(0);
   }
@@ -151,11 +188,11 @@ void LockSchedCtx::decRunningRef(LockMode mode) {
 std::string LockSchedCtx::toString() {
   std::stringstream ss;
 
-  for (auto i : _runningList) {
+  for (auto i = _runningList.front(); i; i = LockList::next(i)) {
     ss << "running: {" << i->toString() << "}\r\n";
   }
 
-  for (auto i : _pendingList) {
+  for (auto i = _pendingList.front(); i; i = LockList::next(i)) {
     ss << "pending: {" << i->toString() << "}\r\n";
   }
 
@@ -164,11 +201,11 @@ std::string LockSchedCtx::toString() {
 
 std::vector<std::string> LockSchedCtx::getShardLocks() {
   std::vector<std::string> tempLocks;
-  for (auto i : _runningList) {
+  for (auto i = _runningList.front(); i; i = LockList::next(i)) {
     tempLocks.push_back("running: {" + i->toString() + "}");
   }
 
-  for (auto i : _pendingList) {
+  for (auto i = _pendingList.front(); i; i = LockList::next(i)) {
     tempLocks.push_back("pending: {" + i->toString() + "}");
   }
   return tempLocks;
@@ -179,23 +216,140 @@ MGLockMgr& MGLockMgr::getInstance() {
   return mgr;
 }
 
+static constexpr uint64_t SLOT_SLOW = 1ULL << 63;
+static constexpr uint32_t SLOT_COUNT_BITS = 8;
+static constexpr uint64_t SLOT_COUNT_MAX = (1ULL << SLOT_COUNT_BITS) - 1;
+static constexpr uint64_t SLOT_COUNT_MASK = (1ULL << 32) - 1;
+static constexpr uint32_t SLOT_TAG_SHIFT = 32;
+static constexpr uint64_t SLOT_TAG_MASK = (1ULL << 31) - 1;
+
+// the slot index comes from the low bits of hash, the tag from the high bits
+static uint64_t slotTag(uint64_t hash) {
+  return (hash >> SLOT_TAG_SHIFT) & SLOT_TAG_MASK;
+}
+
+static uint64_t slotUnit(LockMode mode) {
+  return 1ULL << ((enum2Int(mode) - 1) * SLOT_COUNT_BITS);
+}
+
+static uint64_t slotCount(uint64_t word, LockMode mode) {
+  return (word >> ((enum2Int(mode) - 1) * SLOT_COUNT_BITS)) & SLOT_COUNT_MAX;
+}
+
+static uint16_t slotModes(uint64_t word) {
+  uint16_t modes = 0;
+  for (auto mode : {LockMode::LOCK_IS,
+                    LockMode::LOCK_IX,
+                    LockMode::LOCK_S,
+                    LockMode::LOCK_X}) {
+    if (slotCount(word, mode)) {
+      modes |= static_cast<uint16_t>(1 << enum2Int(mode));
+    }
+  }
+  return modes;
+}
+
+// modes held by the fast path locks of the target with hash
+static uint16_t slotModes(uint64_t word, uint64_t hash) {
+  if ((word & SLOT_COUNT_MASK) == 0 ||
+      ((word >> SLOT_TAG_SHIFT) & SLOT_TAG_MASK) != slotTag(hash)) {
+    return 0;
+  }
+  return slotModes(word);
+}
+
+bool MGLockMgr::tryLockFast(LockSlot* slot, MGLock* core) {
+  auto mode = core->getMode();
+  if (mode == LockMode::LOCK_NONE) {
+    return false;
+  }
+  uint64_t tag = slotTag(core->getHash());
+  uint64_t old = slot->word.load(std::memory_order_acquire);
+  while (true) {
+    if (old & SLOT_SLOW) {
+      return false;
+    }
+    uint64_t word;
+    if ((old & SLOT_COUNT_MASK) == 0) {
+      // no fast path lock, the slot can be owned by this target
+      word = (tag << SLOT_TAG_SHIFT) | slotUnit(mode);
+    } else if (((old >> SLOT_TAG_SHIFT) & SLOT_TAG_MASK) != tag ||
+               isConflict(slotModes(old), mode) ||
+               slotCount(old, mode) == SLOT_COUNT_MAX) {
+      return false;
+    } else {
+      word = old + slotUnit(mode);
+    }
+    if (slot->word.compare_exchange_weak(old,
+                                         word,
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+      return true;
+    }
+  }
+}
+
+void MGLockMgr::unlockFast(size_t slotIdx, MGLock* core) {
+  uint64_t old = _slots[slotIdx].word.fetch_sub(slotUnit(core->getMode()),
+                                                std::memory_order_acq_rel);
+  INVARIANT_D(slotCount(old, core->getMode()) != 0);
+  core->releaseLockResult();
+  if (old & SLOT_SLOW) {
+    // some locks of the slot may wait for this one
+    LockShard& shard = _shards[slotIdx % SHARD_NUM];
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    schedSlotInLock(&shard, slotIdx);
+  }
+}
+
+void MGLockMgr::schedSlotInLock(LockShard* shard, size_t slotIdx) {
+  uint64_t word = _slots[slotIdx].word.load(std::memory_order_acquire);
+  for (auto& iter : shard->map) {
+    uint64_t hash = iter.second.getHash();
+    if (hash % SLOT_NUM == slotIdx) {
+      iter.second.schedPendingLocks(slotModes(word, hash));
+    }
+  }
+}
+
 void MGLockMgr::lock(MGLock* core) {
   uint64_t hash = core->getHash();
-  LockShard& shard = _shards[hash % SHARD_NUM];
+  size_t slotIdx = hash % SLOT_NUM;
+  LockSlot& slot = _slots[slotIdx];
+  if (_enableFastPath && tryLockFast(&slot, core)) {
+    core->setLockResult(LockRes::LOCKRES_OK, true);
+    return;
+  }
+
+  LockShard& shard = _shards[slotIdx % SHARD_NUM];
   std::lock_guard<std::mutex> lk(shard.mutex);
   auto iter = shard.map.find(core->getTarget());
   if (iter == shard.map.end()) {
-    LockSchedCtx tmp;
+    LockSchedCtx tmp(hash);
     auto insertResult = shard.map.emplace(core->getTarget(), std::move(tmp));
     iter = insertResult.first;
+    if (++shard.slotRefs[slotIdx / SHARD_NUM] == 1) {
+      // stop the fast path of this slot
+      slot.word.fetch_or(SLOT_SLOW, std::memory_order_acq_rel);
+    }
   }
-  iter->second.lock(core);
+  // the fast path locks can't increase after the slot is slow
+  iter->second.lock(core,
+                    slotModes(slot.word.load(std::memory_order_acquire), hash));
   return;
 }
 
 void MGLockMgr::unlock(MGLock* core) {
   uint64_t hash = core->getHash();
-  LockShard& shard = _shards[hash % SHARD_NUM];
+  size_t slotIdx = hash % SLOT_NUM;
+  if (core->isFastPath()) {
+    INVARIANT_D(core->getStatus() == LockRes::LOCKRES_OK);
+    unlockFast(slotIdx, core);
+    return;
+  }
+
+  LockSlot& slot = _slots[slotIdx];
+  LockShard& shard = _shards[slotIdx % SHARD_NUM];
   std::lock_guard<std::mutex> lk(shard.mutex);
 
   INVARIANT_D(core->getStatus() == LockRes::LOCKRES_WAIT ||
@@ -203,9 +357,14 @@ void MGLockMgr::unlock(MGLock* core) {
 
   auto iter = shard.map.find(core->getTarget());
   INVARIANT(iter != shard.map.end());
-  bool empty = iter->second.unlock(core);
+  bool empty = iter->second.unlock(
+    core, slotModes(slot.word.load(std::memory_order_acquire), hash));
   if (empty) {
     shard.map.erase(iter);
+    if (--shard.slotRefs[slotIdx / SHARD_NUM] == 0) {
+      // no target of this slot in map, restart the fast path
+      slot.word.fetch_and(~SLOT_SLOW, std::memory_order_acq_rel);
+    }
   }
   return;
 }
@@ -221,6 +380,27 @@ std::string MGLockMgr::toString() {
 
 std::vector<std::string> MGLockMgr::getLockList() {
   std::vector<std::string> list;
+  // the fast path locks are not linked anywhere, only the counts are known
+  for (uint32_t i = 0; i < SLOT_NUM; i++) {
+    uint64_t word = _slots[i].word.load(std::memory_order_relaxed);
+    if ((word & SLOT_COUNT_MASK) == 0) {
+      continue;
+    }
+    char buf[256];
+    snprintf(buf,
+             sizeof(buf),
+             "fastpath: {slot:%u tag:%" PRIu64 " IS:%" PRIu64 " IX:%" PRIu64
+             " S:%" PRIu64 " X:%" PRIu64 " slow:%d}",
+             i,
+             (word >> SLOT_TAG_SHIFT) & SLOT_TAG_MASK,
+             slotCount(word, LockMode::LOCK_IS),
+             slotCount(word, LockMode::LOCK_IX),
+             slotCount(word, LockMode::LOCK_S),
+             slotCount(word, LockMode::LOCK_X),
+             (word & SLOT_SLOW) ? 1 : 0);
+    list.push_back(buf);
+  }
+
   for (uint32_t i = 0; i < SHARD_NUM; i++) {
     LockShard& shard = _shards[i];
     std::lock_guard<std::mutex> lk(shard.mutex);
@@ -5,8 +5,8 @@
 #ifndef SRC_TENDISPLUS_LOCK_MGL_MGL_MGR_H__
 #define SRC_TENDISPLUS_LOCK_MGL_MGL_MGR_H__
 
+#include <atomic>
 #include <vector>
-#include <list>
 #include <unordered_map>
 #include <mutex>  // NOLINT
 #include <string>
@@ -19,28 +19,51 @@ namespace mgl {
 
 class MGLock;
 
+// intrusive doubly linked list of MGLock, linked by MGLock::_prev/_next,
+// so that lock()/unlock() never allocate list nodes.
+// not thread safe, protected by LockShard's mutex
+class LockList {
+ public:
+  LockList() : _head(nullptr), _tail(nullptr), _size(0) {}
+  void pushBack(MGLock* core);
+  void erase(MGLock* core);
+  MGLock* front() const { return _head; }
+  static MGLock* next(MGLock* core);
+  bool empty() const { return _size == 0; }
+  size_t size() const { return _size; }
+
+ private:
+  MGLock* _head;
+  MGLock* _tail;
+  size_t _size;
+};
+
 // TODO(deyukong): this class should only be in mgl_mgr.cpp
 // not thread safe, protected by LockShard's mutex
 class LockSchedCtx {
  public:
-  LockSchedCtx();
+  explicit LockSchedCtx(uint64_t hash);
   LockSchedCtx(LockSchedCtx&&) = default;
-  void lock(MGLock* core);
-  bool unlock(MGLock* core);
+  // fastModes is the modes of the target held by the fast path,
+  // see MGLockMgr
+  void lock(MGLock* core, uint16_t fastModes);
+  bool unlock(MGLock* core, uint16_t fastModes);
+  void schedPendingLocks(uint16_t fastModes);
+  uint64_t getHash() const { return _hash; }
   std::string toString();
   std::vector<std::string> getShardLocks();
  private:
-  void schedPendingLocks();
   void incrPendingRef(LockMode mode);
   void incrRunningRef(LockMode mode);
   void decPendingRef(LockMode mode);
   void decRunningRef(LockMode mode);
+  uint64_t _hash;
   uint16_t _runningModes;
   uint16_t _pendingModes;
-  std::vector<uint16_t> _runningRefCnt;
-  std::vector<uint16_t> _pendingRefCnt;
-  std::list<MGLock*> _runningList;
-  std::list<MGLock*> _pendingList;
+  uint16_t _runningRefCnt[enum2Int(LockMode::LOCK_MODE_NUM)];
+  uint16_t _pendingRefCnt[enum2Int(LockMode::LOCK_MODE_NUM)];
+  LockList _runningList;
+  LockList _pendingList;
 };
 
 /* First come first lock
@@ -59,16 +82,37 @@ class LockSchedCtx {
 // hardware_destructive_interference_size requires quite high version
 // gcc. 128 should work for most cases
 struct alignas(128) LockShard {
+  static constexpr size_t SLOT_PER_SHARD = 32;
   std::mutex mutex;
   std::unordered_map<std::string, LockSchedCtx> map;
+  // number of targets in map of each slot belongs to this shard,
+  // indexed by slot index / SHARD_NUM, see MGLockMgr
+  uint32_t slotRefs[SLOT_PER_SHARD] = {0};
 };
 
+// one atomic word per slot, targets are mapped into slots by hash.
+// bit 0-31: running count of the fast path locks, 8 bits per mode
+// bit 32-62: tag of the target holding the fast path locks
+// bit 63: the slot has targets in LockShard's map, go to slow path
+struct alignas(128) LockSlot {
+  std::atomic<uint64_t> word{0};
+};
+
+// Uncontended locks are granted by a CAS on the LockSlot of the target,
+// they never touch the mutex, the map and the lists of LockShard.
+// A slot is owned by one target(tag) while it has fast path locks. If the
+// lock conflicts, or the slot is owned by another target, or the slot is
+// slow, it goes to LockShard, marks the slot slow, and regards the fast
+// path locks of the same tag as running locks. All the locks of a slow
+// slot go to LockShard until no target of the slot is in the map.
+// The last fast path unlock of a slow slot schedules the pending locks.
 // TODO(vinchen): now there is a warning here, because the MGLockMgr change from
 // a static object to a heap object of ServerEntry
 // warning C4316: tendisplus::mgl::MGLockMgr
 class MGLockMgr {
  public:
-  MGLockMgr() = default;
+  explicit MGLockMgr(bool enableFastPath = true)
+    : _enableFastPath(enableFastPath) {}
   void lock(MGLock* core);
   void unlock(MGLock* core);
   static MGLockMgr& getInstance();
@@ -76,8 +120,16 @@ class MGLockMgr {
   std::vector<std::string> getLockList();
 
  private:
+  bool tryLockFast(LockSlot* slot, MGLock* core);
+  void unlockFast(size_t slotIdx, MGLock* core);
+  void schedSlotInLock(LockShard* shard, size_t slotIdx);
+
   static constexpr size_t SHARD_NUM = 32;
+  // slot index % SHARD_NUM == hash % SHARD_NUM == shard index
+  static constexpr size_t SLOT_NUM = SHARD_NUM * LockShard::SLOT_PER_SHARD;
+  const bool _enableFastPath;
   LockShard _shards[SHARD_NUM];
+  LockSlot _slots[SLOT_NUM];
 };
 
 }  // namespace mgl
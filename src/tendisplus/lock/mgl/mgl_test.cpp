@@ -2,6 +2,8 @@
 #include <string>
 #include <algorithm>
 #include <thread>  // NOLINT
+#include <vector>
+#include <memory>
 
 #include "gtest/gtest.h"
 
@@ -106,5 +108,86 @@ TEST(MGL, Starvation) {
     l3.unlock();
 }
 
+TEST(MGL, FastPath) {
+    auto mgr = std::make_unique<MGLockMgr>();
+    MGLock l1(mgr.get()), l2(mgr.get()), l3(mgr.get()), l4(mgr.get());
+    // compatible locks of one target are granted by the fast path
+    EXPECT_EQ(l1.lock("something", LockMode::LOCK_IS, 1000),
+                      LockRes::LOCKRES_OK);
+    EXPECT_EQ(l2.lock("something", LockMode::LOCK_IX, 1000),
+                      LockRes::LOCKRES_OK);
+    EXPECT_TRUE(l1.isFastPath());
+    EXPECT_TRUE(l2.isFastPath());
+    EXPECT_EQ(mgr->getLockList().size(), 1U);
+
+    // conflict one waits in slow path, and blocks the later locks
+    std::thread tmp([&l3]() {
+        EXPECT_EQ(l3.lock("something", LockMode::LOCK_X, 10000),
+                          LockRes::LOCKRES_OK);
+        EXPECT_FALSE(l3.isFastPath());
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    EXPECT_EQ(l4.lock("something", LockMode::LOCK_IS, 100),
+                      LockRes::LOCKRES_TIMEOUT);
+    EXPECT_FALSE(l4.isFastPath());
+    l4.unlock();
+
+    // the last fast path unlock wakes up the waiting one
+    l1.unlock();
+    l2.unlock();
+    tmp.join();
+    l3.unlock();
+    EXPECT_EQ(mgr->getLockList().size(), 0U);
+
+    // fast path works again after the slow locks are gone
+    EXPECT_EQ(l1.lock("something", LockMode::LOCK_X, 1000),
+                      LockRes::LOCKRES_OK);
+    EXPECT_TRUE(l1.isFastPath());
+    l1.unlock();
+}
+
+TEST(MGL, FastPathDisabled) {
+    auto mgr = std::make_unique<MGLockMgr>(false);
+    MGLock l1(mgr.get()), l2(mgr.get());
+    EXPECT_EQ(l1.lock("something", LockMode::LOCK_IS, 1000),
+                      LockRes::LOCKRES_OK);
+    EXPECT_FALSE(l1.isFastPath());
+    EXPECT_EQ(l2.lock("something", LockMode::LOCK_X, 100),
+                      LockRes::LOCKRES_TIMEOUT);
+    l1.unlock();
+    l2.unlock();
+}
+
+TEST(MGL, FastPathConcurrent) {
+    auto mgr = std::make_unique<MGLockMgr>();
+    constexpr size_t threadNum = 16;
+    constexpr size_t loop = 20000;
+    uint64_t counter = 0;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < threadNum; i++) {
+        threads.emplace_back([&mgr, &counter, i]() {
+            for (size_t j = 0; j < loop; j++) {
+                MGLock parent(mgr.get()), child(mgr.get());
+                EXPECT_EQ(parent.lock("store", LockMode::LOCK_IX, 10000),
+                          LockRes::LOCKRES_OK);
+                // half of the threads write a hot key, others write their own
+                std::string key = i % 2 ? "hotkey" : std::to_string(i);
+                EXPECT_EQ(child.lock(key, LockMode::LOCK_X, 10000),
+                          LockRes::LOCKRES_OK);
+                if (key == "hotkey") {
+                    counter++;
+                }
+                child.unlock();
+                parent.unlock();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(counter, threadNum / 2 * loop);
+    EXPECT_EQ(mgr->getLockList().size(), 0U);
+}
+
 }  // namespace mgl
 }  // namespace tendisplus
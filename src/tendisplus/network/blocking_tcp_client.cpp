@@ -11,9 +11,17 @@
 #include <string>
 
 #include <algorithm>
+#include <fstream>
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
 #include "asio.hpp"
 #include "glog/logging.h"
 #include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/scopeguard.h"
 #include "tendisplus/utils/time.h"
 
 namespace tendisplus {
@@ -299,6 +307,88 @@ Status BlockingTcpClient::writeLine(const std::string& line) {
   return writeData(line1);
 }
 
+#ifdef __linux__
+Status BlockingTcpClient::sendFile(const std::string& fileName,
+                                   uint64_t offset,
+                                   uint64_t size,
+                                   std::chrono::seconds timeout) {
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return {ErrorCodes::ERR_INTERNAL,
+            "open " + fileName + " failed:" + strerror(errno)};
+  }
+  auto guard = MakeGuard([fd] { ::close(fd); });
+
+  // sendfile() returns EAGAIN instead of blocking, then it waits for the
+  // socket in poll() as the async ops above wait for the io_context
+  std::error_code ec;
+  _socket.native_non_blocking(true, ec);
+  if (ec) {
+    return {ErrorCodes::ERR_NETWORK, ec.message()};
+  }
+  int sock = _socket.native_handle();
+  off_t off = offset;
+  while (size > 0) {
+    size_t batchSize = std::min<uint64_t>(size, _netBatchSize);
+    ssize_t n = ::sendfile(sock, fd, &off, batchSize);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        closeSocket();
+        return {ErrorCodes::ERR_NETWORK, strerror(errno)};
+      }
+      struct pollfd pfd = {sock, POLLOUT, 0};
+      int ret = ::poll(&pfd, 1, timeout.count() * 1000);
+      if (ret == 0) {
+        closeSocket();
+        return {ErrorCodes::ERR_TIMEOUT, "sendFile timeout"};
+      } else if (ret < 0 && errno != EINTR) {
+        closeSocket();
+        return {ErrorCodes::ERR_NETWORK, strerror(errno)};
+      }
+      continue;
+    } else if (n == 0) {
+      return {ErrorCodes::ERR_INTERNAL, fileName + " is shorter than sent"};
+    }
+    size -= n;
+    if (_rateLimiter) {
+      _rateLimiter->Request(n);
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+#else
+Status BlockingTcpClient::sendFile(const std::string& fileName,
+                                   uint64_t offset,
+                                   uint64_t size,
+                                   std::chrono::seconds timeout) {
+  auto myfile = std::ifstream(fileName, std::ios::binary);
+  if (!myfile.is_open()) {
+    return {ErrorCodes::ERR_INTERNAL, "open " + fileName + " failed"};
+  }
+  myfile.seekg(offset);
+  std::string buf;
+  while (size > 0) {
+    size_t batchSize = std::min<uint64_t>(size, _netBatchSize);
+    buf.resize(batchSize);
+    myfile.read(&buf[0], batchSize);
+    if (!myfile) {
+      return {ErrorCodes::ERR_INTERNAL, fileName + " is shorter than sent"};
+    }
+    auto s = writeOneBatch(buf.c_str(), batchSize, timeout);
+    if (!s.ok()) {
+      return s;
+    }
+    size -= batchSize;
+    if (_rateLimiter) {
+      _rateLimiter->Request(batchSize);
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+#endif
+
 asio::ip::tcp::socket BlockingTcpClient::borrowConn() {
   return std::move(_socket);
 }
@@ -42,6 +42,12 @@ class BlockingTcpClient
                        uint32_t size,
                        std::chrono::seconds timeout);
   Status writeData(const std::string& data);
+  // send size bytes of the file from offset, the kernel copies them to the
+  // socket with sendfile(2) where it exists, each batch waits timeout
+  Status sendFile(const std::string& fileName,
+                  uint64_t offset,
+                  uint64_t size,
+                  std::chrono::seconds timeout);
 
   std::string getRemoteRepr() const {
     try {
@@ -14,6 +14,7 @@
 #include "tendisplus/utils/test_util.h"
 #include "tendisplus/storage/varint.h"
 #include "tendisplus/server/server_entry.h"
+#include "tendisplus/commands/command.h"
 
 namespace tendisplus {
 
@@ -50,6 +51,11 @@ constexpr ssize_t REDIS_IOBUF_LEN = (1024 * 16);
 constexpr ssize_t REDIS_MAX_QUERYBUF_LEN = (1024 * 1024 * 1024);
 constexpr ssize_t REDIS_INLINE_MAX_SIZE = (1024 * 64);
 constexpr ssize_t REDIS_MBULK_BIG_ARG = (1024 * 32);
+// max commands processed back-to-back in one executor hop, so that a
+// deep pipeline can't starve other sessions in the same worker
+constexpr uint32_t REDIS_PIPELINE_MAX_CMDS = 64;
+// merged replies of a pipeline are sent out once they exceed this size
+constexpr size_t REDIS_PIPELINE_MAX_RSP_LEN = (1024 * 64);
 
 std::string RequestMatrix::toString() const {
   std::stringstream ss;
@@ -363,6 +369,7 @@ NetSession::NetSession(std::shared_ptr<ServerEntry> server,
     _reqType(RedisReqMode::REDIS_REQ_UNKNOWN),
     _multibulklen(0),
     _bulkLen(-1),
+    _pipelining(false),
     _isSendRunning(false),
     _isEnded(false),
     _netMatrix(netMatrix),
@@ -470,34 +477,135 @@ std::string NetSession::getLocalRepr() const {
 }
 
 void NetSession::schedule() {
+  if (_type == Session::Type::NET && _server->isRunToCompletion()) {
+    scheduleInIoThread();
+    return;
+  }
   // incr the reference, so it's safe to remove sessions
   // from _serverEntry at executing time.
   auto self(shared_from_this());
   _server->schedule([this, self]() { stepState(); }, _ioCtxId);
 }
 
+void NetSession::scheduleInIoThread() {
+  auto self(shared_from_this());
+  auto state = _state.load(std::memory_order_relaxed);
+  if (state == State::Process && isSlowCmd()) {
+    // don't block the other sessions of this io thread
+    _server->schedule([this, self]() { stepState(); }, _ioCtxId);
+    return;
+  }
+
+  const auto& matrix = _server->getInlineMatrix();
+  if (state != State::DrainReqBuf &&
+      inIoThread()) {
+    // run to completion, no cross-thread handoff
+    if (state != State::Process) {
+      stepState();
+      return;
+    }
+    int64_t startTs = nsSinceEpoch();
+    ++matrix->executing;
+    stepState();
+    --matrix->executing;
+    ++matrix->executed;
+    matrix->executeTime += nsSinceEpoch() - startTs;
+    return;
+  }
+
+  // back from the executor pools, or the pipeline is too long and it
+  // should yield to the other sessions of this io thread
+  int64_t enQueueTs = nsSinceEpoch();
+  ++matrix->inQueue;
+  asio::post(_sock.get_executor(), [this, self, enQueueTs]() {
+    const auto& matrix = _server->getInlineMatrix();
+    --matrix->inQueue;
+    matrix->queueTime += nsSinceEpoch() - enQueueTs;
+    scheduleInIoThread();
+  });
+}
+
+bool NetSession::inIoThread() {
+  return _sock.get_io_context().get_executor().running_in_this_thread();
+}
+
+bool NetSession::isSlowCmd() const {
+  auto cmd = Command::getCommand(const_cast<NetSession*>(this));
+  return cmd != nullptr && cmd->isSlow();
+}
+
+void NetSession::scheduleNext() {
+  if (!_pipelining) {
+    schedule();
+  }
+}
+
 asio::ip::tcp::socket NetSession::borrowConn() {
+  INVARIANT_D(!inIoThread());
+  std::unique_lock<std::mutex> lk(_mutex);
+  // replies of the commands pipelined before should go first, and the
+  // socket can't be moved until their async writes complete
+  flushPipelineRspInLock(false);
+  _sendCv.wait(lk, [this] { return !_isSendRunning || _isEnded; });
   return std::move(_sock);
 }
 
 Status NetSession::setResponse(const std::string& s) {
+  return setResponse(std::string(s));
+}
+
+Status NetSession::setResponse(std::string&& s) {
   std::lock_guard<std::mutex> lk(_mutex);
   if (_isEnded) {
     _closeAfterRsp = true;
     return {ErrorCodes::ERR_NETWORK, "connection is ended"};
   }
 
+  if (_pipelineRsp && s.size() < REDIS_PIPELINE_MAX_RSP_LEN) {
+    auto& buffer = _pipelineRsp->buffer;
+    buffer.append(s);
+    _pipelineRsp->closeAfterThis = _closeAfterRsp;
+    if (buffer.size() >= REDIS_PIPELINE_MAX_RSP_LEN) {
+      flushPipelineRspInLock(!_closeAfterRsp);
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  // big replies are not merged, but sent following the merged ones by
+  // the same gathered write
+  bool keepPipeline = _pipelineRsp != nullptr && !_closeAfterRsp;
+  flushPipelineRspInLock(false);
   auto v = std::make_shared<SendBuffer>();
-  std::copy(s.begin(), s.end(), std::back_inserter(v->buffer));
+  v->buffer = std::move(s);
   v->closeAfterThis = _closeAfterRsp;
+  sendRspInLock(v);
+  if (keepPipeline) {
+    flushPipelineRspInLock(true);
+  }
+
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+void NetSession::sendRspInLock(std::shared_ptr<SendBuffer> buf) {
   if (_isSendRunning) {
-    _sendBuffer.push_back(v);
+    _sendBuffer.push_back(buf);
   } else {
     _isSendRunning = true;
-    drainRsp(v);
+    drainRsp({buf});
   }
+}
 
-  return {ErrorCodes::ERR_OK, ""};
+void NetSession::flushPipelineRspInLock(bool keep) {
+  if (_pipelineRsp && _pipelineRsp->buffer.size() > 0 && !_isEnded) {
+    sendRspInLock(_pipelineRsp);
+    _pipelineRsp.reset();
+  }
+  if (keep && !_pipelineRsp) {
+    _pipelineRsp = std::make_shared<SendBuffer>();
+    _pipelineRsp->closeAfterThis = false;
+  } else if (!keep) {
+    _pipelineRsp.reset();
+  }
 }
 
 void NetSession::start() {
@@ -552,7 +660,7 @@ void NetSession::processInlineBuffer() {
       return;
     }
     setState(State::DrainReqNet);
-    schedule();
+    scheduleNext();
     return;
   }
 
@@ -585,7 +693,7 @@ void NetSession::processInlineBuffer() {
   }
 
   setState(State::Process);
-  schedule();
+  scheduleNext();
 }
 
 // NOTE(deyukong): mainly port from redis::networking.c,
@@ -607,14 +715,14 @@ void NetSession::processMultibulkBuffer() {
       }
       // not complete line
       setState(State::DrainReqNet);
-      schedule();
+      scheduleNext();
       return;
     }
     /* Buffer should also contain \n */
     if (newLine - _queryBuf.data() > _queryBufPos - 2) {
       // not complete line
       setState(State::DrainReqNet);
-      schedule();
+      scheduleNext();
       return;
     }
 
@@ -639,7 +747,7 @@ void NetSession::processMultibulkBuffer() {
 
       INVARIANT(_args.size() == 0);
       setState(State::Process);
-      schedule();
+      scheduleNext();
       return;
     }
     _multibulklen = ll;
@@ -722,7 +830,7 @@ void NetSession::processMultibulkBuffer() {
   } else {
     setState(State::DrainReqNet);
   }
-  schedule();
+  scheduleNext();
 }
 
 void NetSession::drainReqCallback(const std::error_code& ec, size_t actualLen) {
@@ -852,23 +960,56 @@ void NetSession::drainReqNet() {
 
 void NetSession::processReq() {
   bool continueSched = true;
-  if (_args.size()) {
-    _ctx->setProcessPacketStart(nsSinceEpoch());
-    continueSched = _server->processRequest(reinterpret_cast<Session*>(this));
-    _reqMatrix->processed += 1;
-    _reqMatrix->processCost += nsSinceEpoch() - _ctx->getProcessPacketStart();
-    _ctx->setProcessPacketStart(0);
+  uint32_t batched = 0;
+  {
+    // replies of the commands processed back-to-back here are merged,
+    // and sent by one write at the end
+    std::lock_guard<std::mutex> lk(_mutex);
+    flushPipelineRspInLock(true);
   }
-  if (!continueSched) {
-    endSession();
-  } else if (!_closeAfterRsp) {
+  _pipelining = true;
+  while (true) {
+    if (_args.size()) {
+      _ctx->setProcessPacketStart(nsSinceEpoch());
+      continueSched = _server->processRequest(reinterpret_cast<Session*>(this));
+      _reqMatrix->processed += 1;
+      _reqMatrix->processCost += nsSinceEpoch() - _ctx->getProcessPacketStart();
+      _ctx->setProcessPacketStart(0);
+    }
+    if (!continueSched || _closeAfterRsp) {
+      break;
+    }
     resetMultiBulkCtx();
     if (_queryBufPos == 0) {
       setState(State::DrainReqNet);
-    } else {
-      setState(State::DrainReqBuf);
-      ++_netMatrix->stickyPackets;
+      break;
+    }
+    setState(State::DrainReqBuf);
+    ++_netMatrix->stickyPackets;
+    if (++batched >= REDIS_PIPELINE_MAX_CMDS) {
+      break;
     }
+    // parse the next command in _queryBuf without another executor hop,
+    // go on only if it is complete.
+    drainReqBuf();
+    if (_state.load(std::memory_order_relaxed) != State::Process) {
+      break;
+    }
+    // in run-to-completion mode, let schedule() decide the thread of it
+    if (_type == Session::Type::NET && _server->isRunToCompletion() &&
+        (isSlowCmd() || !inIoThread())) {
+      break;
+    }
+  }
+  _pipelining = false;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    flushPipelineRspInLock(false);
+  }
+
+  if (!continueSched) {
+    endSession();
+  } else if (!_closeAfterRsp) {
     schedule();
   } else {
     // closeAfterRsp, donot process more requests
@@ -876,30 +1017,40 @@ void NetSession::processReq() {
   }
 }
 
-void NetSession::drainRsp(std::shared_ptr<SendBuffer> buf) {
+void NetSession::drainRsp(std::vector<std::shared_ptr<SendBuffer>> bufs) {
   auto self(shared_from_this());
   uint64_t now = nsSinceEpoch();
+  std::vector<asio::const_buffer> buffers;
+  buffers.reserve(bufs.size());
+  for (const auto& buf : bufs) {
+    buffers.emplace_back(buf->buffer.data(), buf->buffer.size());
+  }
   asio::async_write(
     _sock,
-    asio::buffer(buf->buffer.data(), buf->buffer.size()),  // NOLINT
-    [this, self, buf, now](const std::error_code& ec, size_t actualLen) {
+    buffers,
+    [this, self, bufs, now](const std::error_code& ec, size_t actualLen) {
       _reqMatrix->sendPacketCost += nsSinceEpoch() - now;
-      drainRspCallback(ec, actualLen, buf);
+      drainRspCallback(ec, actualLen, bufs);
     });
 }
 
-void NetSession::drainRspCallback(const std::error_code& ec,
-                                  size_t actualLen,
-                                  std::shared_ptr<SendBuffer> buf) {
+void NetSession::drainRspCallback(
+  const std::error_code& ec,
+  size_t actualLen,
+  std::vector<std::shared_ptr<SendBuffer>> bufs) {
   if (ec) {
     LOG(WARNING) << "drainRspCallback:" << ec.message();
     endSession();
     return;
   }
-  if (actualLen != buf->buffer.size()) {
-    LOG(FATAL) << "conn:" << _connId << ",data:" << buf->buffer.data()
-               << ",actualLen:" << actualLen
-               << ",bufsize:" << buf->buffer.size() << ",invalid drainRsp len";
+  size_t totalLen = 0;
+  for (const auto& buf : bufs) {
+    totalLen += buf->buffer.size();
+  }
+  if (actualLen != totalLen) {
+    LOG(FATAL) << "conn:" << _connId << ",actualLen:" << actualLen
+               << ",bufsize:" << totalLen << ",bufcnt:" << bufs.size()
+               << ",invalid drainRsp len";
   }
 
   if (_server) {
@@ -907,7 +1058,7 @@ void NetSession::drainRspCallback(const std::error_code& ec,
     _server->getServerStat().netOutputBytes += actualLen;
   }
 
-  if (buf->closeAfterThis) {
+  if (bufs.back()->closeAfterThis) {
     endSession();
     return;
   }
@@ -915,11 +1066,20 @@ void NetSession::drainRspCallback(const std::error_code& ec,
   std::lock_guard<std::mutex> lk(_mutex);
   INVARIANT(_isSendRunning);
   if (_sendBuffer.size() > 0) {
-    auto it = _sendBuffer.front();
-    _sendBuffer.pop_front();
-    drainRsp(it);
+    // gather all the pending buffers into one write(writev), nothing
+    // after a closeAfterThis buffer is sent.
+    std::vector<std::shared_ptr<SendBuffer>> next;
+    while (_sendBuffer.size() > 0) {
+      next.emplace_back(_sendBuffer.front());
+      _sendBuffer.pop_front();
+      if (next.back()->closeAfterThis) {
+        break;
+      }
+    }
+    drainRsp(std::move(next));
   } else {
     _isSendRunning = false;
+    _sendCv.notify_all();
   }
 }
 
@@ -930,6 +1090,7 @@ void NetSession::endSession() {
       return;
     }
     _isEnded = true;
+    _sendCv.notify_all();
     ++_netMatrix->connReleased;
     DLOG(INFO) << "net session, id:" << id() << ",connId:" << _connId
                << " destroyed";
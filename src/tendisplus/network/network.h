@@ -9,6 +9,7 @@
 
 #include <utility>
 #include <atomic>
+#include <condition_variable>  // NOLINT
 #include <memory>
 #include <string>
 #include <vector>
@@ -122,7 +123,7 @@ class NetworkAsio {
 };
 
 struct SendBuffer {
-  std::vector<char> buffer;
+  std::string buffer;
   bool closeAfterThis;
 };
 
@@ -141,8 +142,11 @@ class NetSession : public Session {
   virtual ~NetSession() = default;
   virtual std::string getRemoteRepr() const;
   virtual std::string getLocalRepr() const;
+  // the socket is handed over after the replies before are written, it
+  // waits for the io thread, so it must be called by a slow command
   asio::ip::tcp::socket borrowConn();
   virtual Status setResponse(const std::string& s);
+  virtual Status setResponse(std::string&& s);
   void setCloseAfterRsp();
   virtual void start();
   virtual Status cancel();
@@ -181,11 +185,11 @@ class NetSession : public Session {
   virtual void drainReqBuf();
   virtual void drainReqCallback(const std::error_code& ec, size_t actualLen);
 
-  // send data to tcpbuff
-  virtual void drainRsp(std::shared_ptr<SendBuffer>);
+  // send data to tcpbuff, all the bufs are gathered into one write
+  virtual void drainRsp(std::vector<std::shared_ptr<SendBuffer>> bufs);
   virtual void drainRspCallback(const std::error_code& ec,
                                 size_t actualLen,
-                                std::shared_ptr<SendBuffer> buf);
+                                std::vector<std::shared_ptr<SendBuffer>> bufs);
 
   // handle msg parsed from drainReqCallback
   virtual void processReq();
@@ -195,6 +199,7 @@ class NetSession : public Session {
  private:
   FRIEND_TEST(NetSession, drainReqInvalid);
   FRIEND_TEST(NetSession, Completed);
+  FRIEND_TEST(NetSession, Pipeline);
   FRIEND_TEST(Command, common);
   friend class NoSchedNetSession;
 
@@ -207,6 +212,23 @@ class NetSession : public Session {
   // utils to shift parsed partial params from _queryBuf
   void shiftQueryBuf(ssize_t start, ssize_t end);
 
+  // schedule the next state, unless the commands are being pipelined,
+  // in which case processReq() drives the states by itself
+  void scheduleNext();
+
+  // schedule() of the run-to-completion mode
+  void scheduleInIoThread();
+  // the command parsed should be executed in the executor pools
+  bool isSlowCmd() const;
+  // current thread is the io thread of _sock
+  bool inIoThread();
+
+  // hand buf over to the sending queue, _mutex should be held
+  void sendRspInLock(std::shared_ptr<SendBuffer> buf);
+  // send the merged replies of the current pipeline, _mutex should be held.
+  // if keep is true, the following replies keep being merged
+  void flushPipelineRspInLock(bool keep);
+
  protected:
   uint64_t _connId;
   bool _closeAfterRsp;
@@ -220,13 +242,21 @@ class NetSession : public Session {
   int64_t _multibulklen;
   int64_t _bulkLen;
 
-  // _mutex protects _isSendRunning, _isEnded, _sendBuffer
+  // true if processReq() is running buffered commands back-to-back,
+  // only visited in the thread running processReq()
+  bool _pipelining;
+
+  // _mutex protects _isSendRunning, _isEnded, _sendBuffer, _pipelineRsp
   // other variables will never be visited in send-threads.
   std::mutex _mutex;
+  // notified when _isSendRunning is reset or _isEnded is set
+  std::condition_variable _sendCv;
   bool _isSendRunning;
   bool _isEnded;
   bool _first;
   std::list<std::shared_ptr<SendBuffer>> _sendBuffer;
+  // replies of the pipelined commands, merged into one SendBuffer
+  std::shared_ptr<SendBuffer> _pipelineRsp;
 
   std::shared_ptr<NetworkMatrix> _netMatrix;
   std::shared_ptr<RequestMatrix> _reqMatrix;
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <fstream>
 #include "gtest/gtest.h"
 #include "glog/logging.h"
 #include "tendisplus/network/network.h"
@@ -124,6 +125,128 @@ TEST(NetSession, Completed) {
 }
 
 
+TEST(NetSession, Pipeline) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  auto server = makeServerEntry(cfg);
+
+  asio::io_context ioContext;
+  asio::ip::tcp::socket socket(ioContext);
+  auto netMatrix = std::make_shared<NetworkMatrix>();
+  auto sess =
+    std::make_shared<NoSchedNetSession>(server,
+                                        std::move(socket),
+                                        1,
+                                        false,
+                                        netMatrix,
+                                        std::make_shared<RequestMatrix>());
+
+  // three complete commands followed by a partial one
+  std::string s =
+    "*3\r\n$3\r\nset\r\n$1\r\na\r\n$1\r\n1\r\n"
+    "*2\r\n$3\r\nget\r\n$1\r\na\r\n"
+    "ping\r\n"
+    "*2\r\n$3\r\nget\r\n";
+  sess->_queryBuf.resize(s.size() + 128, 0);
+  std::copy(s.begin(), s.end(), sess->_queryBuf.begin());
+  sess->setState(NetSession::State::DrainReqNet);
+  sess->drainReqCallback(std::error_code(), s.size());
+  EXPECT_EQ(sess->_state.load(), NetSession::State::Process);
+
+  // all the complete commands are processed in one processReq(),
+  // and their replies are merged into one SendBuffer
+  sess->processReq();
+  EXPECT_EQ(sess->_state.load(), NetSession::State::DrainReqNet);
+  EXPECT_EQ(sess->_closeAfterRsp, false);
+  EXPECT_EQ(netMatrix->stickyPackets.get(), 3U);
+  auto rsp = sess->getResponse();
+  EXPECT_EQ(rsp.size(), 1U);
+  EXPECT_EQ(rsp[0], "+OK\r\n$1\r\n1\r\n+PONG\r\n");
+  EXPECT_EQ(std::string(sess->_queryBuf.data(), sess->_queryBufPos), "");
+  EXPECT_EQ(sess->_multibulklen, 1);
+
+#ifndef _WIN32
+  sess.reset();
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
+// the fast commands are executed in the io thread, the slow ones in the
+// executor pools, see NetSession::scheduleInIoThread()
+TEST(NetSession, RunToCompletion) {
+  const auto guard = MakeGuard([] { destroyEnv(); });
+  EXPECT_TRUE(setupEnv());
+  auto cfg = makeServerParam();
+  cfg->runToCompletion = true;
+  cfg->netIoThreadNum = 1;
+  auto server = makeServerEntry(cfg);
+  const auto& matrix = server->getInlineMatrix();
+
+  auto ioCtx = std::make_shared<asio::io_context>();
+  std::thread thd([&ioCtx] {
+    asio::io_context::work work(*ioCtx);
+    ioCtx->run();
+  });
+  auto cli = std::make_shared<BlockingTcpClient>(ioCtx, 1024, 1024 * 1024, 10);
+  EXPECT_TRUE(
+    cli->connect("127.0.0.1", cfg->port, std::chrono::seconds(1)).ok());
+
+  auto readLines = [&cli](size_t n) {
+    std::string lines;
+    for (size_t i = 0; i < n; i++) {
+      auto eLine = cli->readLine(std::chrono::seconds(3));
+      EXPECT_TRUE(eLine.ok());
+      if (eLine.ok()) {
+        lines.append(eLine.value()).append("\n");
+      }
+    }
+    return lines;
+  };
+  // executed is counted after the reply is sent
+  auto waitExecuted = [&matrix](uint64_t expected) {
+    for (uint32_t i = 0; i < 100 && matrix->executed.get() < expected; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return matrix->executed.get();
+  };
+  const std::string configGet =
+    "*3\r\n$6\r\nconfig\r\n$3\r\nget\r\n$10\r\nmaxclients\r\n";
+
+  // inline
+  uint64_t executed = waitExecuted(0);
+  EXPECT_TRUE(cli->writeData("ping\r\n").ok());
+  EXPECT_EQ(readLines(1), "+PONG\n");
+  EXPECT_EQ(waitExecuted(executed + 1), executed + 1);
+
+  // CMD_ADMIN is slow, it's sent to the pool
+  executed = matrix->executed.get();
+  EXPECT_TRUE(cli->writeData(configGet).ok());
+  EXPECT_EQ(readLines(3), "*2\n$10\nmaxclients\n");
+  readLines(2);
+  EXPECT_EQ(waitExecuted(executed), executed);
+
+  // the pipeline goes to the pool at the slow command, and back to the io
+  // thread after it, the replies keep the order
+  executed = matrix->executed.get();
+  EXPECT_TRUE(
+    cli->writeData("ping\r\nping\r\n" + configGet + "ping\r\n").ok());
+  EXPECT_EQ(readLines(5), "+PONG\n+PONG\n*2\n$10\nmaxclients\n");
+  readLines(2);
+  EXPECT_EQ(readLines(1), "+PONG\n");
+  EXPECT_EQ(waitExecuted(executed + 2), executed + 2);
+
+  ioCtx->stop();
+  thd.join();
+  cli.reset();
+#ifndef _WIN32
+  server->stop();
+  EXPECT_EQ(server.use_count(), 1);
+#endif
+}
+
 class session : public std::enable_shared_from_this<session> {
  public:
   explicit session(asio::ip::tcp::socket socket) : _socket(std::move(socket)) {}
@@ -265,6 +388,49 @@ TEST(BlockingTcpClient, Common) {
   thd1.join();
 }
 
+TEST(BlockingTcpClient, SendFile) {
+  auto ioCtx = std::make_shared<asio::io_context>();
+  auto ioCtx1 = std::make_shared<asio::io_context>();
+  uint32_t port = 54021;
+  server svr(*ioCtx, port);
+
+  std::thread thd([&ioCtx] {
+    asio::io_context::work work(*ioCtx);
+    ioCtx->run();
+  });
+  std::thread thd1([&ioCtx1] {
+    asio::io_context::work work(*ioCtx1);
+    ioCtx1->run();
+  });
+
+  const std::string fname = "sendfile.txt";
+  const auto guard = MakeGuard([&fname] { remove(fname.c_str()); });
+  std::ofstream myfile(fname, std::ios::binary);
+  myfile << "hello\r\nsendfile\r\n";
+  myfile.close();
+
+  auto cli1 = std::make_shared<BlockingTcpClient>(ioCtx1, 128, 4, 10);
+  Status s = cli1->connect("127.0.0.1", port, std::chrono::seconds(1));
+  EXPECT_TRUE(s.ok());
+  // from the middle, in batches of 4 bytes
+  s = cli1->sendFile(fname, 7, 10, std::chrono::seconds(1));
+  EXPECT_TRUE(s.ok()) << s.toString();
+  Expected<std::string> exps = cli1->readLine(std::chrono::seconds(3));
+  EXPECT_TRUE(exps.ok());
+  EXPECT_EQ(exps.value(), "sendfile");
+
+  // beyond the end
+  s = cli1->sendFile(fname, 7, 11, std::chrono::seconds(1));
+  EXPECT_FALSE(s.ok());
+  s = cli1->sendFile("nofile.txt", 0, 1, std::chrono::seconds(1));
+  EXPECT_FALSE(s.ok());
+
+  ioCtx->stop();
+  ioCtx1->stop();
+  thd.join();
+  thd1.join();
+}
+
 class session2 : public std::enable_shared_from_this<session2> {
  public:
   explicit session2(asio::ip::tcp::socket socket)
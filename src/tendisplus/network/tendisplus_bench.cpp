@@ -0,0 +1,725 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+// load generator and latency benchmark of tendisplus, usage:
+//   tendisplus_bench --host=127.0.0.1 --port=51002 --workload=kv
+//     --clients=50 --requests=100000 --pipeline=1 --dist=zipfian
+// see usage() for all the options. latencies are recorded in a HDR style
+// histogram per client, the per-run delta of the tendisstat counters
+// (request, req_pool, inline_pool, network) is dumped alongside.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "asio.hpp"
+#include "rapidjson/document.h"
+
+#include "tendisplus/network/blocking_tcp_client.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/param_manager.h"
+#include "tendisplus/utils/status.h"
+
+namespace tendisplus {
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+// log-linear histogram of latencies in microseconds, the same bucketing
+// as HdrHistogram with 3 significant digits: 2048 sub buckets for each
+// power of 2, so the relative error of any recorded value is below 0.1%
+class LatencyHistogram {
+ public:
+  LatencyHistogram() : _counts(countsLen(), 0) {}
+
+  void record(uint64_t us) {
+    us = std::min(us, MAX_VALUE);
+    _counts[indexOf(us)]++;
+    _total++;
+    _sum += us;
+    _sumSquare += static_cast<double>(us) * us;
+    _min = std::min(_min, us);
+    _max = std::max(_max, us);
+  }
+
+  void merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < _counts.size(); i++) {
+      _counts[i] += other._counts[i];
+    }
+    _total += other._total;
+    _sum += other._sum;
+    _sumSquare += other._sumSquare;
+    _min = std::min(_min, other._min);
+    _max = std::max(_max, other._max);
+  }
+
+  uint64_t count() const {
+    return _total;
+  }
+  uint64_t max() const {
+    return _total ? _max : 0;
+  }
+  uint64_t min() const {
+    return _total ? _min : 0;
+  }
+  double mean() const {
+    return _total ? static_cast<double>(_sum) / _total : 0;
+  }
+  double stddev() const {
+    if (_total == 0) {
+      return 0;
+    }
+    double m = mean();
+    return std::sqrt(std::max(0.0, _sumSquare / _total - m * m));
+  }
+
+  // the highest value equivalent to the value at percentile
+  uint64_t percentile(double p) const {
+    if (_total == 0) {
+      return 0;
+    }
+    uint64_t target = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(p / 100.0 * _total)));
+    uint64_t acc = 0;
+    for (size_t i = 0; i < _counts.size(); i++) {
+      acc += _counts[i];
+      if (acc >= target) {
+        return std::min(highestEquivalent(i), _max);
+      }
+    }
+    return _max;
+  }
+
+  // the percentile distribution in the .hgrm format of HdrHistogram, which
+  // can be plotted by its tools. values are printed in milliseconds.
+  void printDistribution(FILE* out) const {
+    fprintf(out, "%12s %14s %10s %14s\n\n", "Value", "Percentile",
+            "TotalCount", "1/(1-Percentile)");
+    if (_total == 0) {
+      return;
+    }
+    const uint32_t ticksPerHalf = 5;
+    for (uint32_t half = 0;; half++) {
+      double base = 100.0 - 100.0 / std::pow(2.0, half);
+      double step = 100.0 / std::pow(2.0, half + 1) / ticksPerHalf;
+      for (uint32_t tick = 0; tick < ticksPerHalf; tick++) {
+        double p = base + step * tick;
+        uint64_t target = static_cast<uint64_t>(std::ceil(p / 100.0 * _total));
+        if (target >= _total) {
+          fprintf(out, "%12.3f %14.12f %10lu\n", max() / 1000.0, 1.0,
+                  static_cast<unsigned long>(_total));  // NOLINT
+          printFooter(out);
+          return;
+        }
+        uint64_t v = percentile(p);
+        fprintf(out, "%12.3f %14.12f %10lu %14.2f\n", v / 1000.0, p / 100.0,
+                static_cast<unsigned long>(countTo(v)),  // NOLINT
+                1 / (1 - p / 100.0));
+      }
+    }
+  }
+
+ private:
+  static constexpr uint32_t SUB_BUCKET_BITS = 11;
+  static constexpr uint64_t SUB_BUCKET_HALF = 1ULL << (SUB_BUCKET_BITS - 1);
+  // about 19 hours, long enough for any request
+  static constexpr uint64_t MAX_VALUE = (1ULL << 36) - 1;
+
+  static size_t countsLen() {
+    return indexOf(MAX_VALUE) + 1;
+  }
+
+  static size_t bucketCount() {
+    return countsLen() / SUB_BUCKET_HALF - 1;
+  }
+
+  static size_t indexOf(uint64_t v) {
+    uint32_t bucket = 0;
+    while ((v >> bucket) >= (SUB_BUCKET_HALF << 1)) {
+      bucket++;
+    }
+    return bucket * SUB_BUCKET_HALF + (v >> bucket);
+  }
+
+  static uint64_t highestEquivalent(size_t idx) {
+    if (idx < (SUB_BUCKET_HALF << 1)) {
+      return idx;
+    }
+    uint32_t bucket = idx / SUB_BUCKET_HALF - 1;
+    uint64_t sub = idx - bucket * SUB_BUCKET_HALF;
+    return ((sub + 1) << bucket) - 1;
+  }
+
+  uint64_t countTo(uint64_t value) const {
+    uint64_t acc = 0;
+    for (size_t i = 0; i <= indexOf(value); i++) {
+      acc += _counts[i];
+    }
+    return acc;
+  }
+
+  void printFooter(FILE* out) const {
+    fprintf(out, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n",
+            mean() / 1000.0, stddev() / 1000.0);
+    fprintf(out, "#[Max     = %12.3f, Total count    = %12lu]\n",
+            max() / 1000.0, static_cast<unsigned long>(_total));  // NOLINT
+    fprintf(out, "#[Buckets = %12lu, SubBuckets     = %12lu]\n",
+            static_cast<unsigned long>(bucketCount()),  // NOLINT
+            static_cast<unsigned long>(SUB_BUCKET_HALF << 1));  // NOLINT
+  }
+
+  std::vector<uint64_t> _counts;
+  uint64_t _total = 0;
+  uint64_t _sum = 0;
+  double _sumSquare = 0;
+  uint64_t _min = UINT64_MAX;
+  uint64_t _max = 0;
+};
+
+enum class KeyDist { UNIFORM, ZIPFIAN, HOTKEY };
+
+// picks the index of the key in [0, keyspace) for each op
+class KeyGenerator {
+ public:
+  KeyGenerator(KeyDist dist,
+               uint64_t keyspace,
+               double theta,
+               uint64_t hotKeys,
+               uint64_t hotPercent,
+               uint64_t seed)
+    : _dist(dist),
+      _keyspace(keyspace),
+      _theta(theta),
+      _hotKeys(std::max<uint64_t>(1, std::min(hotKeys, keyspace))),
+      _hotPercent(hotPercent),
+      _rand(seed) {
+    if (_dist == KeyDist::ZIPFIAN) {
+      // the zipfian generator of YCSB, "Quickly Generating Billion-Record
+      // Synthetic Databases", Gray et al.
+      _zetan = zeta(_keyspace, _theta);
+      double zeta2 = zeta(2, _theta);
+      _alpha = 1.0 / (1.0 - _theta);
+      _eta = (1 - std::pow(2.0 / _keyspace, 1 - _theta)) /
+        (1 - zeta2 / _zetan);
+    }
+  }
+
+  uint64_t next() {
+    switch (_dist) {
+      case KeyDist::UNIFORM:
+        return _rand() % _keyspace;
+      case KeyDist::HOTKEY:
+        if (_rand() % 100 < _hotPercent) {
+          return _rand() % _hotKeys;
+        }
+        return _rand() % _keyspace;
+      case KeyDist::ZIPFIAN: {
+        double u = std::uniform_real_distribution<double>(0, 1)(_rand);
+        double uz = u * _zetan;
+        if (uz < 1.0) {
+          return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, _theta)) {
+          return 1 % _keyspace;
+        }
+        auto v = static_cast<uint64_t>(
+          _keyspace * std::pow(_eta * u - _eta + 1, _alpha));
+        return std::min(v, _keyspace - 1);
+      }
+    }
+    return 0;
+  }
+
+  uint64_t rand() {
+    return _rand();
+  }
+
+ private:
+  static double zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+      sum += 1.0 / std::pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+  KeyDist _dist;
+  uint64_t _keyspace;
+  double _theta;
+  uint64_t _hotKeys;
+  uint64_t _hotPercent;
+  std::mt19937_64 _rand;
+  double _zetan = 0;
+  double _alpha = 0;
+  double _eta = 0;
+};
+
+struct BenchConfig {
+  std::string host;
+  uint16_t port;
+  std::string password;
+  std::string workload;
+  std::string keyPrefix;
+  uint64_t clients;
+  uint64_t requests;
+  uint64_t duration;
+  uint64_t pipeline;
+  uint64_t keyspace;
+  uint64_t fields;
+  uint64_t valueSize;
+  uint64_t readPercent;
+  KeyDist dist;
+  double theta;
+  uint64_t hotKeys;
+  uint64_t hotPercent;
+  uint64_t timeoutSec;
+  uint64_t maxReplySize;
+  bool printHist;
+  bool dumpStat;
+};
+
+struct ClientResult {
+  LatencyHistogram hist;
+  uint64_t ops = 0;
+  uint64_t errors = 0;
+  Status status;
+};
+
+void appendCommand(std::string* buf, const std::vector<std::string>& args) {
+  buf->append("*").append(std::to_string(args.size())).append("\r\n");
+  for (const auto& arg : args) {
+    buf->append("$").append(std::to_string(arg.size())).append("\r\n");
+    buf->append(arg).append("\r\n");
+  }
+}
+
+// one command of the workload, the read or write of key
+std::vector<std::string> genCommand(const BenchConfig& cfg,
+                                    KeyGenerator* gen,
+                                    const std::string& value) {
+  std::string key = cfg.keyPrefix + std::to_string(gen->next());
+  bool isRead = gen->rand() % 100 < cfg.readPercent;
+  std::string field = std::to_string(gen->rand() % cfg.fields);
+  const auto& w = cfg.workload;
+  if (w == "kv") {
+    if (isRead) {
+      return {"get", key};
+    }
+    return {"set", key, value};
+  } else if (w == "hash") {
+    if (isRead) {
+      return {"hget", key, field};
+    }
+    return {"hset", key, field, value};
+  } else if (w == "list") {
+    if (isRead) {
+      return {"lrange", key, "0", "9"};
+    }
+    return {"rpush", key, value};
+  } else if (w == "zset") {
+    if (isRead) {
+      return {"zscore", key, field};
+    }
+    return {"zadd", key, std::to_string(gen->rand() % 1000000), field};
+  } else if (w == "set") {
+    if (isRead) {
+      return {"sismember", key, field};
+    }
+    return {"sadd", key, field};
+  } else {
+    INVARIANT_D(w == "lua");
+    if (isRead) {
+      return {"eval", "return redis.call('get', KEYS[1])", "1", key};
+    }
+    return {"eval",
+            "return redis.call('set', KEYS[1], ARGV[1])",
+            "1",
+            key,
+            value};
+  }
+}
+
+// read one reply, returns false on an error reply
+Expected<bool> readReply(BlockingTcpClient* client, std::chrono::seconds to) {
+  auto eLine = client->readLine(to);
+  if (!eLine.ok()) {
+    return eLine.status();
+  }
+  const std::string& line = eLine.value();
+  if (line.empty()) {
+    return {ErrorCodes::ERR_PARSEPKT, "empty reply"};
+  }
+  switch (line[0]) {
+    case '+':
+    case ':':
+      return true;
+    case '-':
+      return false;
+    case '$': {
+      int64_t len = strtoll(line.c_str() + 1, nullptr, 10);
+      if (len < 0) {
+        return true;
+      }
+      auto eData = client->read(len + 2, to);
+      if (!eData.ok()) {
+        return eData.status();
+      }
+      return true;
+    }
+    case '*': {
+      int64_t n = strtoll(line.c_str() + 1, nullptr, 10);
+      bool ok = true;
+      for (int64_t i = 0; i < n; i++) {
+        auto eReply = readReply(client, to);
+        if (!eReply.ok()) {
+          return eReply.status();
+        }
+        ok = ok && eReply.value();
+      }
+      return ok;
+    }
+    default:
+      return {ErrorCodes::ERR_PARSEPKT, "invalid reply:" + line};
+  }
+}
+
+Expected<std::shared_ptr<BlockingTcpClient>> connect(
+  const BenchConfig& cfg, const std::shared_ptr<asio::io_context>& ctx) {
+  auto client =
+    std::make_shared<BlockingTcpClient>(ctx, cfg.maxReplySize, 1024 * 1024,
+                                        cfg.timeoutSec);
+  Status s = client->connect(cfg.host, cfg.port, std::chrono::seconds(3));
+  if (!s.ok()) {
+    return s;
+  }
+  if (!cfg.password.empty()) {
+    std::string buf;
+    appendCommand(&buf, {"auth", cfg.password});
+    s = client->writeData(buf);
+    if (!s.ok()) {
+      return s;
+    }
+    auto eLine = client->readLine(std::chrono::seconds(cfg.timeoutSec));
+    if (!eLine.ok()) {
+      return eLine.status();
+    }
+    if (eLine.value() != "+OK") {
+      return {ErrorCodes::ERR_AUTH, eLine.value()};
+    }
+  }
+  return client;
+}
+
+void runClient(const BenchConfig& cfg,
+               const std::shared_ptr<asio::io_context>& ctx,
+               uint64_t id,
+               uint64_t requests,
+               Clock::time_point deadline,
+               ClientResult* result) {
+  auto eClient = connect(cfg, ctx);
+  if (!eClient.ok()) {
+    result->status = eClient.status();
+    return;
+  }
+  auto client = eClient.value();
+  KeyGenerator gen(
+    cfg.dist, cfg.keyspace, cfg.theta, cfg.hotKeys, cfg.hotPercent, id + 1);
+  std::string value(cfg.valueSize, 'x');
+  std::chrono::seconds timeout(cfg.timeoutSec);
+  std::string buf;
+
+  while (true) {
+    uint64_t batch = cfg.pipeline;
+    if (cfg.duration > 0) {
+      if (Clock::now() >= deadline) {
+        break;
+      }
+    } else {
+      if (result->ops >= requests) {
+        break;
+      }
+      batch = std::min(batch, requests - result->ops);
+    }
+
+    buf.clear();
+    for (uint64_t i = 0; i < batch; i++) {
+      appendCommand(&buf, genCommand(cfg, &gen, value));
+    }
+    auto start = Clock::now();
+    Status s = client->writeData(buf);
+    if (!s.ok()) {
+      result->status = s;
+      return;
+    }
+    // the latency of each command in a pipeline is from the batch sent
+    // to its reply read, the same as redis-benchmark
+    for (uint64_t i = 0; i < batch; i++) {
+      auto eReply = readReply(client.get(), timeout);
+      if (!eReply.ok()) {
+        result->status = eReply.status();
+        return;
+      }
+      if (!eReply.value()) {
+        result->errors++;
+      }
+      auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                  Clock::now() - start)
+                  .count();
+      result->hist.record(us);
+      result->ops++;
+    }
+  }
+}
+
+// tendisstat sections with the counters of the request path
+Expected<std::string> getTendisStat(
+  const BenchConfig& cfg, const std::shared_ptr<asio::io_context>& ctx) {
+  auto eClient = connect(cfg, ctx);
+  if (!eClient.ok()) {
+    return eClient.status();
+  }
+  std::string buf;
+  appendCommand(
+    &buf, {"tendisstat", "network", "request", "req_pool", "inline_pool"});
+  Status s = eClient.value()->writeData(buf);
+  if (!s.ok()) {
+    return s;
+  }
+  std::chrono::seconds timeout(cfg.timeoutSec);
+  auto eLine = eClient.value()->readLine(timeout);
+  if (!eLine.ok()) {
+    return eLine.status();
+  }
+  if (eLine.value().empty() || eLine.value()[0] != '$') {
+    return {ErrorCodes::ERR_INTERNAL, "tendisstat failed:" + eLine.value()};
+  }
+  int64_t len = strtoll(eLine.value().c_str() + 1, nullptr, 10);
+  auto eData = eClient.value()->read(len + 2, timeout);
+  if (!eData.ok()) {
+    return eData.status();
+  }
+  return eData.value().substr(0, len);
+}
+
+void printStatDelta(const std::string& before, const std::string& after) {
+  rapidjson::Document b, a;
+  b.Parse(before);
+  a.Parse(after);
+  if (b.HasParseError() || a.HasParseError() || !b.IsObject() ||
+      !a.IsObject()) {
+    std::cout << "invalid tendisstat" << std::endl;
+    return;
+  }
+  std::cout << "====== tendisstat delta ======" << std::endl;
+  for (auto sec = a.MemberBegin(); sec != a.MemberEnd(); ++sec) {
+    const char* secName = sec->name.GetString();
+    auto bsec = b.FindMember(secName);
+    if (!sec->value.IsObject() || bsec == b.MemberEnd() ||
+        !bsec->value.IsObject()) {
+      continue;
+    }
+    for (auto m = sec->value.MemberBegin(); m != sec->value.MemberEnd();
+         ++m) {
+      const char* name = m->name.GetString();
+      auto bm = bsec->value.FindMember(name);
+      if (!m->value.IsUint64() || bm == bsec->value.MemberEnd() ||
+          !bm->value.IsUint64()) {
+        continue;
+      }
+      int64_t delta = m->value.GetUint64() - bm->value.GetUint64();
+      std::cout << secName << "." << name << ": " << delta << std::endl;
+    }
+  }
+  // the cost per command in the pools, from the PoolMatrix counters
+  for (const char* pool : {"req_pool", "inline_pool"}) {
+    if (!a.HasMember(pool) || !b.HasMember(pool) ||
+        !a[pool].HasMember("executed") || !b[pool].HasMember("executed")) {
+      continue;
+    }
+    uint64_t executed =
+      a[pool]["executed"].GetUint64() - b[pool]["executed"].GetUint64();
+    if (executed == 0) {
+      continue;
+    }
+    uint64_t queue =
+      a[pool]["queue_time"].GetUint64() - b[pool]["queue_time"].GetUint64();
+    uint64_t exec = a[pool]["execute_time"].GetUint64() -
+      b[pool]["execute_time"].GetUint64();
+    std::cout << pool << ".avg_queue_time(ns): " << queue / executed
+              << std::endl;
+    std::cout << pool << ".avg_execute_time(ns): " << exec / executed
+              << std::endl;
+  }
+}
+
+Expected<BenchConfig> parseConfig(const ParamManager& pm) {
+  BenchConfig cfg;
+  cfg.host = pm.getString("host", "127.0.0.1");
+  cfg.port = pm.getUint64("port", 51002);
+  cfg.password = pm.getString("password");
+  cfg.workload = pm.getString("workload", "kv");
+  cfg.keyPrefix = pm.getString("key-prefix", "bench:");
+  cfg.clients = pm.getUint64("clients", 50);
+  cfg.requests = pm.getUint64("requests", 100000);
+  cfg.duration = pm.getUint64("duration", 0);
+  cfg.pipeline = pm.getUint64("pipeline", 1);
+  cfg.keyspace = pm.getUint64("keyspace", 100000);
+  cfg.fields = pm.getUint64("fields", 100);
+  cfg.valueSize = pm.getUint64("value-size", 64);
+  cfg.readPercent = pm.getUint64("read-percent", 50);
+  cfg.theta = pm.getUint64("zipf-theta", 99) / 100.0;
+  cfg.hotKeys = pm.getUint64("hot-keys", 100);
+  cfg.hotPercent = pm.getUint64("hot-percent", 90);
+  cfg.timeoutSec = pm.getUint64("timeout", 10);
+  cfg.maxReplySize = pm.getUint64("max-reply-size", 64 * 1024 * 1024);
+  cfg.printHist = pm.getUint64("hist", 0) != 0;
+  cfg.dumpStat = pm.getUint64("dump-stat", 0) != 0;
+
+  std::string dist = pm.getString("dist", "uniform");
+  if (dist == "uniform") {
+    cfg.dist = KeyDist::UNIFORM;
+  } else if (dist == "zipfian") {
+    cfg.dist = KeyDist::ZIPFIAN;
+  } else if (dist == "hotkey") {
+    cfg.dist = KeyDist::HOTKEY;
+  } else {
+    return {ErrorCodes::ERR_PARSEOPT, "invalid dist:" + dist};
+  }
+
+  const auto& w = cfg.workload;
+  if (w != "kv" && w != "hash" && w != "list" && w != "zset" && w != "set" &&
+      w != "lua") {
+    return {ErrorCodes::ERR_PARSEOPT, "invalid workload:" + w};
+  }
+  if (cfg.clients == 0 || cfg.pipeline == 0 || cfg.keyspace == 0 ||
+      cfg.fields == 0 || cfg.readPercent > 100 || cfg.hotPercent > 100 ||
+      (cfg.requests == 0 && cfg.duration == 0)) {
+    return {ErrorCodes::ERR_PARSEOPT, "invalid options"};
+  }
+  if (cfg.theta <= 0 || cfg.theta >= 1) {
+    return {ErrorCodes::ERR_PARSEOPT, "zipf-theta should be in (0, 100)"};
+  }
+  return cfg;
+}
+
+int run(const BenchConfig& cfg) {
+  auto ctx = std::make_shared<asio::io_context>();
+  std::vector<std::thread> ioThreads;
+  size_t ioThreadNum =
+    std::max<size_t>(1, std::min<size_t>(cfg.clients, 4));
+  for (size_t i = 0; i < ioThreadNum; i++) {
+    ioThreads.emplace_back([ctx] {
+      asio::io_context::work work(*ctx);
+      ctx->run();
+    });
+  }
+
+  auto eBefore = getTendisStat(cfg, ctx);
+  if (!eBefore.ok()) {
+    std::cerr << "get tendisstat failed:" << eBefore.status().toString();
+  }
+
+  std::vector<ClientResult> results(cfg.clients);
+  std::vector<std::thread> clients;
+  auto start = Clock::now();
+  auto deadline = start + std::chrono::seconds(cfg.duration);
+  for (uint64_t i = 0; i < cfg.clients; i++) {
+    uint64_t requests = cfg.requests / cfg.clients +
+      (i < cfg.requests % cfg.clients ? 1 : 0);
+    clients.emplace_back(
+      runClient, std::cref(cfg), ctx, i, requests, deadline, &results[i]);
+  }
+  for (auto& t : clients) {
+    t.join();
+  }
+  double seconds =
+    std::chrono::duration<double>(Clock::now() - start).count();
+
+  LatencyHistogram hist;
+  uint64_t ops = 0;
+  uint64_t errors = 0;
+  for (const auto& r : results) {
+    if (!r.status.ok()) {
+      std::cerr << "client failed:" << r.status.toString();
+    }
+    hist.merge(r.hist);
+    ops += r.ops;
+    errors += r.errors;
+  }
+
+  std::cout << "====== " << cfg.workload << " ======" << std::endl;
+  std::cout << "clients:" << cfg.clients << " pipeline:" << cfg.pipeline
+            << " keyspace:" << cfg.keyspace
+            << " read-percent:" << cfg.readPercent
+            << " value-size:" << cfg.valueSize << std::endl;
+  std::cout << ops << " requests completed in " << seconds << " seconds, "
+            << errors << " errors" << std::endl;
+  std::cout << "throughput(ops/s): "
+            << static_cast<uint64_t>(seconds > 0 ? ops / seconds : 0)
+            << std::endl;
+  std::cout << "latency(us): min=" << hist.min()
+            << " mean=" << static_cast<uint64_t>(hist.mean())
+            << " p50=" << hist.percentile(50) << " p90=" << hist.percentile(90)
+            << " p99=" << hist.percentile(99)
+            << " p99.9=" << hist.percentile(99.9)
+            << " p99.99=" << hist.percentile(99.99) << " max=" << hist.max()
+            << std::endl;
+  if (cfg.printHist) {
+    hist.printDistribution(stdout);
+  }
+
+  auto eAfter = getTendisStat(cfg, ctx);
+  if (eBefore.ok() && eAfter.ok()) {
+    printStatDelta(eBefore.value(), eAfter.value());
+    if (cfg.dumpStat) {
+      std::cout << eAfter.value() << std::endl;
+    }
+  }
+
+  ctx->stop();
+  for (auto& t : ioThreads) {
+    t.join();
+  }
+  return ops > 0 ? 0 : 1;
+}
+
+}  // namespace bench
+}  // namespace tendisplus
+
+void usage() {
+  std::cerr
+    << "tendisplus_bench --host=127.0.0.1 --port=51002 --password=xx"
+    << " --workload=kv|hash|list|zset|set|lua --clients=50"
+    << " --requests=100000 --duration=0(seconds, overrides requests)"
+    << " --pipeline=1 --keyspace=100000 --fields=100 --value-size=64"
+    << " --read-percent=50 --dist=uniform|zipfian|hotkey"
+    << " --zipf-theta=99(percent) --hot-keys=100 --hot-percent=90"
+    << " --key-prefix=bench: --timeout=10 --hist=0|1 --dump-stat=0|1"
+    << std::endl;
+}
+
+int main(int argc, char** argv) {
+  tendisplus::ParamManager pm;
+  pm.init(argc, argv);
+  if (pm.getString("help", "no") != "no") {
+    usage();
+    return 0;
+  }
+  auto eCfg = tendisplus::bench::parseConfig(pm);
+  if (!eCfg.ok()) {
+    std::cerr << eCfg.status().toString();
+    usage();
+    return 1;
+  }
+  return tendisplus::bench::run(eCfg.value());
+}
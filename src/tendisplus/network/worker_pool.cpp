@@ -3,6 +3,7 @@
 // project for additional information.
 
 #include <stdlib.h>
+#include <algorithm>
 #include <functional>
 #include <string>
 #include "glog/logging.h"
@@ -202,9 +203,81 @@ void WorkerPool::resizeIncrease(size_t size) {
  */
 void WorkerPool::resizeDecrease(size_t size) {
   for (size_t i = 0; i < size; ++i) {
+    // post directly rather than schedule(), the task never returns, it
+    // would leave inQueue and executing of _matrix increased forever.
     auto exceptionTask = []() { throw IOCtxException(); };
-    this->schedule(std::move(exceptionTask));
+    asio::post(*_ioCtx, std::move(exceptionTask));
   }
 }
 
+PoolAutoScaler::PoolAutoScaler(std::shared_ptr<PoolMatrix> poolMatrix)
+  : _matrix(poolMatrix), _lastMatrix(*poolMatrix), _lastTs(nsSinceEpoch()) {}
+
+size_t PoolAutoScaler::adapt(size_t curNum,
+                             size_t step,
+                             size_t minNum,
+                             size_t maxNum,
+                             uint64_t queueNsHigh,
+                             bool cpuBusy) {
+  uint64_t now = nsSinceEpoch();
+  auto delta = *_matrix - _lastMatrix;
+  uint64_t periodNs = now > _lastTs ? now - _lastTs : 0;
+  _lastMatrix = *_matrix;
+  _lastTs = now;
+
+  return calcPoolSize(
+    delta, periodNs, curNum, step, minNum, maxNum, queueNsHigh, cpuBusy);
+}
+
+/**
+ * @brief calculate the thread number of pools for the next period
+ * @note grow by step if the average queueing delay is over queueNsHigh, or
+ *      more tasks are waiting than the threads. it's useless to add threads
+ *      when cpu is saturated, so don't grow if cpuBusy.
+ *      shrink by step if the queueing delay is low, no task is waiting and
+ *      the busy threads would use less than half of the smaller pool.
+ */
+size_t PoolAutoScaler::calcPoolSize(const PoolMatrix& delta,
+                                    uint64_t periodNs,
+                                    size_t curNum,
+                                    size_t step,
+                                    size_t minNum,
+                                    size_t maxNum,
+                                    uint64_t queueNsHigh,
+                                    bool cpuBusy) {
+  maxNum = std::max(minNum, maxNum);
+  step = std::max(step, static_cast<size_t>(1));
+  if (curNum < minNum) {
+    return minNum;
+  }
+  if (curNum > maxNum) {
+    return maxNum;
+  }
+  if (periodNs == 0) {
+    return curNum;
+  }
+
+  uint64_t executed = delta.executed.get();
+  uint64_t avgQueueNs = executed ? delta.queueTime.get() / executed : 0;
+  uint64_t inQueue = delta.inQueue.get();
+  uint64_t executing = delta.executing.get();
+  uint64_t waiting = inQueue > executing ? inQueue - executing : 0;
+
+  if ((avgQueueNs > queueNsHigh || waiting > curNum) && !cpuBusy) {
+    return std::min(curNum + step, maxNum);
+  }
+
+  if (avgQueueNs < queueNsHigh / 4 && waiting == 0 && curNum > minNum) {
+    size_t newNum = curNum - std::min(step, curNum - minNum);
+    // average number of busy threads in the last period
+    double busyThreads =
+      static_cast<double>(delta.executeTime.get()) / periodNs;
+    if (busyThreads < newNum * 0.5) {
+      return newNum;
+    }
+  }
+
+  return curNum;
+}
+
 }  // namespace tendisplus
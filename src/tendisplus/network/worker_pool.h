@@ -38,8 +38,6 @@ class PoolMatrix {
   void reset();
 };
 
-// TODO(pecochen): currently only support static thread-num
-// It's better to adaptively resize thread-pool by pressure
 class WorkerPool {
  public:
   explicit WorkerPool(const std::string& name,
@@ -87,5 +85,34 @@ class WorkerPool {
   std::map<std::thread::id, std::thread> _threads;
 };
 
+// PoolAutoScaler suggests the thread number of pools by the pressure
+// recorded in their PoolMatrix since the last call of adapt().
+// It grows the pools when the tasks wait too long in the queue and the
+// cpu is not saturated, and shrinks them when they are mostly idle.
+class PoolAutoScaler {
+ public:
+  explicit PoolAutoScaler(std::shared_ptr<PoolMatrix> poolMatrix);
+  size_t adapt(size_t curNum,
+               size_t step,
+               size_t minNum,
+               size_t maxNum,
+               uint64_t queueNsHigh,
+               bool cpuBusy);
+  // delta is the matrix of the last period which lasts periodNs
+  static size_t calcPoolSize(const PoolMatrix& delta,
+                             uint64_t periodNs,
+                             size_t curNum,
+                             size_t step,
+                             size_t minNum,
+                             size_t maxNum,
+                             uint64_t queueNsHigh,
+                             bool cpuBusy);
+
+ private:
+  std::shared_ptr<PoolMatrix> _matrix;
+  PoolMatrix _lastMatrix;
+  uint64_t _lastTs;
+};
+
 }  // namespace tendisplus
 #endif  // SRC_TENDISPLUS_NETWORK_WORKER_POOL_H_
@@ -73,3 +73,61 @@ TEST(Workerpool, schedule) {
   t.join();
   auto guard = tendisplus::MakeGuard([]() { tendisplus::destroyEnv(); });
 }
+
+TEST(Workerpool, autoScale) {
+  using tendisplus::PoolAutoScaler;
+  uint64_t periodNs = 1000000000;
+  uint64_t queueNsHigh = 1000000;
+
+  // tasks queue too long, grow by step
+  tendisplus::PoolMatrix busy;
+  busy.executed = 100;
+  busy.queueTime = 100 * 2 * queueNsHigh;
+  busy.executeTime = 8 * periodNs;
+  EXPECT_EQ(PoolAutoScaler::calcPoolSize(
+              busy, periodNs, 8, 4, 4, 16, queueNsHigh, false),
+            12);
+  // never beyond the upper bound
+  EXPECT_EQ(PoolAutoScaler::calcPoolSize(
+              busy, periodNs, 16, 4, 4, 16, queueNsHigh, false),
+            16);
+  // no use to grow if cpu is saturated
+  EXPECT_EQ(PoolAutoScaler::calcPoolSize(
+              busy, periodNs, 8, 4, 4, 16, queueNsHigh, true),
+            8);
+
+  // more tasks waiting than threads, grow too
+  tendisplus::PoolMatrix backlog;
+  backlog.inQueue = 20;
+  backlog.executing = 8;
+  EXPECT_EQ(PoolAutoScaler::calcPoolSize(
+              backlog, periodNs, 8, 4, 4, 16, queueNsHigh, false),
+            12);
+
+  // mostly idle, shrink by step but never below the lower bound
+  tendisplus::PoolMatrix idle;
+  idle.executed = 100;
+  idle.queueTime = 100 * 1000;
+  idle.executeTime = periodNs;
+  EXPECT_EQ(PoolAutoScaler::calcPoolSize(
+              idle, periodNs, 12, 4, 4, 16, queueNsHigh, false),
+            8);
+  EXPECT_EQ(PoolAutoScaler::calcPoolSize(
+              idle, periodNs, 4, 4, 4, 16, queueNsHigh, false),
+            4);
+
+  // threads are busy though tasks don't queue, keep it
+  tendisplus::PoolMatrix steady = idle;
+  steady.executeTime = 6 * periodNs;
+  EXPECT_EQ(PoolAutoScaler::calcPoolSize(
+              steady, periodNs, 12, 4, 4, 16, queueNsHigh, false),
+            12);
+
+  // out of bounds after the bounds changed
+  EXPECT_EQ(PoolAutoScaler::calcPoolSize(
+              steady, periodNs, 20, 4, 4, 16, queueNsHigh, false),
+            16);
+  EXPECT_EQ(PoolAutoScaler::calcPoolSize(
+              steady, periodNs, 2, 4, 4, 16, queueNsHigh, false),
+            4);
+}
@@ -2,27 +2,192 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <mutex>  // NOLINT
 #include <string>
+#include <thread>  // NOLINT
 #include <vector>
 
 #include "tendisplus/utils/param_manager.h"
 #include "tendisplus/utils/base64.h"
+#include "tendisplus/utils/portable.h"
+#include "tendisplus/utils/string.h"
+#include "tendisplus/storage/binlog_file.h"
 #include "tendisplus/storage/kvstore.h"
 #include "tendisplus/storage/varint.h"
 #include "tendisplus/storage/record.h"
 
 namespace tendisplus {
 
+// a blocking client of the redis protocol, the commands appended are sent
+// together when the replies are read
+class RespClient {
+ public:
+  RespClient() : _fd(-1) {}
+  RespClient(const RespClient&) = delete;
+  ~RespClient() {
+    if (_fd >= 0) {
+      ::close(_fd);
+    }
+  }
+
+  Status connect(const std::string& host, uint32_t port) {
+    struct addrinfo hints;
+    struct addrinfo* res = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int ret = getaddrinfo(
+      host.c_str(), std::to_string(port).c_str(), &hints, &res);
+    if (ret != 0) {
+      return {ErrorCodes::ERR_NETWORK, gai_strerror(ret)};
+    }
+    for (auto p = res; p != nullptr; p = p->ai_next) {
+      _fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+      if (_fd < 0) {
+        continue;
+      }
+      if (::connect(_fd, p->ai_addr, p->ai_addrlen) == 0) {
+        break;
+      }
+      ::close(_fd);
+      _fd = -1;
+    }
+    freeaddrinfo(res);
+    if (_fd < 0) {
+      return {ErrorCodes::ERR_NETWORK,
+              "connect " + host + ":" + std::to_string(port) + " failed"};
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  void append(const std::vector<std::string>& args) {
+    _wbuf += "*" + std::to_string(args.size()) + "\r\n";
+    for (const auto& arg : args) {
+      _wbuf += "$" + std::to_string(arg.size()) + "\r\n";
+      _wbuf += arg;
+      _wbuf += "\r\n";
+    }
+  }
+
+  // the reply of the first command not replied yet, an error reply is
+  // ERR_INTERNAL
+  Expected<std::string> reply() {
+    auto s = flush();
+    if (!s.ok()) {
+      return s;
+    }
+    auto eLine = readLine();
+    if (!eLine.ok()) {
+      return eLine;
+    }
+    const std::string& line = eLine.value();
+    if (line.empty()) {
+      return {ErrorCodes::ERR_NETWORK, "bad reply"};
+    }
+    switch (line[0]) {
+      case '+':
+      case ':':
+        return line.substr(1);
+      case '-':
+        return {ErrorCodes::ERR_INTERNAL, line.substr(1)};
+      case '$': {
+        auto eLen = ::tendisplus::stoll(line.substr(1));
+        if (!eLen.ok()) {
+          return eLen.status();
+        }
+        if (eLen.value() < 0) {
+          return std::string();
+        }
+        size_t len = eLen.value();
+        while (_rbuf.size() < len + 2) {
+          s = fill();
+          if (!s.ok()) {
+            return s;
+          }
+        }
+        std::string bulk = _rbuf.substr(0, len);
+        _rbuf.erase(0, len + 2);
+        return bulk;
+      }
+      default:
+        return {ErrorCodes::ERR_NETWORK, "unsupported reply:" + line};
+    }
+  }
+
+  Expected<std::string> command(const std::vector<std::string>& args) {
+    append(args);
+    return reply();
+  }
+
+ private:
+  Status flush() {
+    size_t sent = 0;
+    while (sent < _wbuf.size()) {
+      ssize_t n = ::send(
+        _fd, _wbuf.data() + sent, _wbuf.size() - sent, MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return {ErrorCodes::ERR_NETWORK, strerror(errno)};
+      }
+      sent += n;
+    }
+    _wbuf.clear();
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  Status fill() {
+    char buf[16 * 1024];
+    ssize_t n = ::recv(_fd, buf, sizeof(buf), 0);
+    if (n < 0 && errno == EINTR) {
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    if (n <= 0) {
+      return {ErrorCodes::ERR_NETWORK, "connection closed"};
+    }
+    _rbuf.append(buf, n);
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  Expected<std::string> readLine() {
+    size_t pos;
+    while ((pos = _rbuf.find("\r\n")) == std::string::npos) {
+      auto s = fill();
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    std::string line = _rbuf.substr(0, pos);
+    _rbuf.erase(0, pos + 2);
+    return line;
+  }
+
+  int _fd;
+  std::string _wbuf;
+  std::string _rbuf;
+};
+
 // TODO(takenliu) print error to stderr or logfile?
 class BinlogScanner {
  public:
-  enum TOOL_MODE { TEXT_SHOW = 0, BASE64_SHOW, TEXT_SHOW_SCOPE };
+  enum TOOL_MODE { TEXT_SHOW = 0, BASE64_SHOW, TEXT_SHOW_SCOPE, RESTORE };
 
   void init(const tendisplus::ParamManager& pm) {
     _logfile = pm.getString("logfile");
+    _logdir = pm.getString("logdir");
     _startDatetime = pm.getUint64("start-datetime", _startDatetime);
     _endDatetime = pm.getUint64("end-datetime", _endDatetime);
+    _hasStartPosition = !pm.getString("start-position").empty();
     _startPosition = pm.getUint64("start-position", _startPosition);
     _endPosition = pm.getUint64("end-position", _endPosition);
     _mode = TOOL_MODE::TEXT_SHOW;
@@ -30,7 +195,14 @@ class BinlogScanner {
       _mode = TOOL_MODE::BASE64_SHOW;
     } else if (pm.getString("mode") == "scope") {
       _mode = TOOL_MODE::TEXT_SHOW_SCOPE;
+    } else if (pm.getString("mode") == "restore") {
+      _mode = TOOL_MODE::RESTORE;
     }
+    _host = pm.getString("host", _host);
+    _port = pm.getUint64("port", _port);
+    _password = pm.getString("password");
+    _threads = std::max<uint64_t>(pm.getUint64("threads", _threads), 1);
+    _pipeline = std::max<uint64_t>(pm.getUint64("pipeline", _pipeline), 1);
   }
 
   bool isFiltered(const ReplLogKeyV2& logkey, const ReplLogValueV2& logValue) {
@@ -139,78 +311,217 @@ class BinlogScanner {
     return "";
   }
 
-  Expected<std::string> scan() {
-    FILE* pf = fopen(_logfile.c_str(), "r");
-    if (pf == NULL) {
-      return {ErrorCodes::ERR_INTERNAL, "fopen failed"};
-    }
-    const uint32_t kBuffLen = 4096;
-    char buff[kBuffLen];
-
-    int ret = fread(buff, BINLOG_HEADER_V2_LEN, 1, pf);
-    if (ret != 1 || strstr(buff, BINLOG_HEADER_V2) != buff) {
-      fclose(pf);
-      return {ErrorCodes::ERR_INTERNAL, "read head failed"};
-    }
-    buff[BINLOG_HEADER_V2_LEN] = '\0';
-    uint32_t storeId =
-      be32toh(*reinterpret_cast<uint32_t*>(buff + strlen(BINLOG_HEADER_V2)));
-
-    while (!feof(pf)) {
-      // keylen
-      uint32_t keylen = 0;
-      ret = fread(buff, sizeof(uint32_t), 1, pf);
-      if (ret != 1) {
-        if (feof(pf)) {
-          fclose(pf);
+  // the binlog files of --logfile, or all the ones of the stores under
+  // --logdir, each store in the order of the file seq
+  Status listFiles() {
+    if (!_logfile.empty()) {
+      auto eReader = BinlogFileReader::open(_logfile);
+      if (!eReader.ok()) {
+        return eReader.status();
+      }
+      _files[eReader.value()->getStoreId()].push_back(_logfile);
+      return {ErrorCodes::ERR_OK, ""};
+    }
+    try {
+      for (auto& dir : filesystem::directory_iterator(_logdir)) {
+        auto storeId = ::tendisplus::stoul(dir.path().filename().string());
+        if (!filesystem::is_directory(dir) || !storeId.ok()) {
+          continue;
+        }
+        for (auto& p : filesystem::directory_iterator(dir.path())) {
+          if (filesystem::is_regular_file(p) &&
+              p.path().filename().string().substr(0, 6) == "binlog") {
+            _files[storeId.value()].push_back(p.path().string());
+          }
+        }
+        std::sort(_files[storeId.value()].begin(),
+                  _files[storeId.value()].end());
+      }
+    } catch (const std::exception& ex) {
+      return {ErrorCodes::ERR_INTERNAL,
+              "list " + _logdir + " failed:" + ex.what()};
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  Expected<std::string> scan(const std::string& logfile) {
+    auto eReader = BinlogFileReader::open(logfile);
+    if (!eReader.ok()) {
+      return eReader.status();
+    }
+    auto& reader = eReader.value();
+    // the blocks out of the range are skipped by the index of v3 files
+    reader->setRange(
+      _startPosition, _endPosition, _startDatetime, _endDatetime);
+    while (true) {
+      auto eLog = reader->next();
+      if (!eLog.ok()) {
+        if (eLog.status().code() == ErrorCodes::ERR_EXHAUST) {
           return {ErrorCodes::ERR_OK, ""};
         }
-        fclose(pf);
-        return {ErrorCodes::ERR_INTERNAL, "read keylen failed"};
+        return eLog.status();
       }
-      buff[sizeof(uint32_t)] = '\0';
-      keylen = int32Decode(buff);
-
-      // key
-      std::string key;
-      key.resize(keylen);
-      ret = fread(const_cast<char*>(key.c_str()), keylen, 1, pf);
-      if (ret != 1) {
-        fclose(pf);
-        return {ErrorCodes::ERR_INTERNAL, "read key failed"};
+
+      auto retStr = process(eLog.value().getReplLogKey(),
+                            eLog.value().getReplLogValue(),
+                            reader->getStoreId());
+      if (!retStr.empty()) {
+        return retStr;
       }
+    }
+  }
 
-      // valuelen
-      uint32_t valuelen = 0;
-      ret = fread(buff, sizeof(uint32_t), 1, pf);
-      if (ret != 1) {
-        fclose(pf);
-        return {ErrorCodes::ERR_INTERNAL, "read valuelen failed"};
+  // replay the binlogs of the store by restorebinlogv2, from --start-position
+  // or the one after binlogpos of the store
+  Status restoreStore(uint32_t storeId,
+                      const std::vector<std::string>& files) {
+    RespClient client;
+    auto s = client.connect(_host, _port);
+    if (!s.ok()) {
+      return s;
+    }
+    if (!_password.empty()) {
+      auto eReply = client.command({"auth", _password});
+      if (!eReply.ok()) {
+        return eReply.status();
       }
-      buff[sizeof(uint32_t)] = '\0';
-      valuelen = int32Decode(buff);
-
-      // value
-      std::string value;
-      value.resize(valuelen);
-      ret = fread(const_cast<char*>(value.c_str()), valuelen, 1, pf);
-      if (ret != 1) {
-        fclose(pf);
-        return {ErrorCodes::ERR_INTERNAL, "read value failed"};
+    }
+    uint64_t nextId = _startPosition;
+    if (!_hasStartPosition) {
+      auto eReply = client.command({"binlogpos", std::to_string(storeId)});
+      if (!eReply.ok()) {
+        return eReply.status();
+      }
+      auto ePos = ::tendisplus::stoul(eReply.value());
+      if (!ePos.ok()) {
+        return ePos.status();
       }
+      nextId = ePos.value() + 1;
+    }
 
-      auto retStr = process(key, value, storeId);
-      if (!retStr.empty()) {
-        return retStr;
+    uint64_t restored = 0;
+    uint64_t pending = 0;
+    auto waitReplies = [&client, &pending, &restored]() -> Status {
+      for (; pending > 0; pending--, restored++) {
+        auto eReply = client.reply();
+        if (!eReply.ok()) {
+          return eReply.status();
+        }
       }
+      return {ErrorCodes::ERR_OK, ""};
+    };
+    for (const auto& file : files) {
+      if (nextId > _endPosition) {
+        break;
+      }
+      auto eReader = BinlogFileReader::open(file);
+      if (!eReader.ok()) {
+        return eReader.status();
+      }
+      auto& reader = eReader.value();
+      reader->setRange(nextId, _endPosition, _startDatetime, _endDatetime);
+      while (true) {
+        auto eLog = reader->next();
+        if (!eLog.ok()) {
+          if (eLog.status().code() == ErrorCodes::ERR_EXHAUST) {
+            break;
+          }
+          return {eLog.status().code(),
+                  eLog.status().getErrmsg() + ". file name: " + file};
+        }
+        const auto& log = eLog.value();
+        uint64_t binlogId = log.getBinlogId();
+        uint64_t ts = log.getTimestamp();
+        // a binlog may be saved again in the next file after an error
+        if (binlogId < nextId || binlogId > _endPosition ||
+            ts < _startDatetime || ts > _endDatetime) {
+          continue;
+        }
+        const auto& key = log.getReplLogKey();
+        const auto& value = log.getReplLogValue();
+        client.append(
+          {"restorebinlogv2",
+           std::to_string(storeId),
+           Base64::Encode((unsigned char*)key.c_str(), key.size()),
+           Base64::Encode((unsigned char*)value.c_str(), value.size())});
+        nextId = binlogId + 1;
+        if (++pending >= _pipeline) {
+          s = waitReplies();
+          if (!s.ok()) {
+            return s;
+          }
+        }
+      }
+    }
+    s = waitReplies();
+    if (!s.ok()) {
+      return s;
     }
 
-    fclose(pf);
+    std::lock_guard<std::mutex> lk(_mutex);
+    std::cout << "storeid:" << storeId << " restored:" << restored
+              << " nextbinlogid:" << nextId << std::endl;
     return {ErrorCodes::ERR_OK, ""};
   }
 
+  // the stores are replayed by --threads threads in parallel, the binlogs of
+  // a store one by one, pipelined by --pipeline commands
+  Status restore() {
+    std::vector<uint32_t> stores;
+    for (const auto& v : _files) {
+      stores.push_back(v.first);
+    }
+    std::atomic<size_t> next(0);
+    Status result = {ErrorCodes::ERR_OK, ""};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < std::min<size_t>(_threads, stores.size()); i++) {
+      threads.emplace_back([this, &stores, &next, &result]() {
+        size_t idx;
+        while ((idx = next++) < stores.size()) {
+          uint32_t storeId = stores[idx];
+          auto s = restoreStore(storeId, _files.at(storeId));
+          if (!s.ok()) {
+            std::lock_guard<std::mutex> lk(_mutex);
+            std::cerr << "restore store " << storeId
+                      << " failed:" << s.getErrmsg() << std::endl;
+            result = s;
+          }
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    return result;
+  }
+
   Expected<std::string> run() {
-    auto e = scan();
+    auto s = listFiles();
+    if (!s.ok()) {
+      return s;
+    }
+    if (_mode == TOOL_MODE::RESTORE) {
+      s = restore();
+      if (!s.ok()) {
+        return s;
+      }
+      return {ErrorCodes::ERR_OK, ""};
+    }
+
+    Expected<std::string> e = {ErrorCodes::ERR_OK, ""};
+    std::string logfile;
+    for (const auto& v : _files) {
+      for (const auto& file : v.second) {
+        logfile = file;
+        e = scan(file);
+        if (!e.ok()) {
+          break;
+        }
+      }
+      if (!e.ok()) {
+        break;
+      }
+    }
     if (_mode == TOOL_MODE::TEXT_SHOW_SCOPE) {
       std::cout << "firstbinlogid:" << _firstbinlogid << std::endl;
       std::cout << "lastbinlogid:" << _lastbinlogid << std::endl;
@@ -220,7 +531,7 @@ class BinlogScanner {
 
     if (!e.ok()) {
       return {e.status().code(),
-              e.status().getErrmsg() + ". file name: " + _logfile};
+              e.status().getErrmsg() + ". file name: " + logfile};
     }
 
     return e;
@@ -228,12 +539,22 @@ class BinlogScanner {
 
  private:
   std::string _logfile;
+  std::string _logdir;
+  std::map<uint32_t, std::vector<std::string>> _files;
   TOOL_MODE _mode;
   uint64_t _startDatetime = 0;
   uint64_t _endDatetime = UINT64_MAX;
+  bool _hasStartPosition = false;
   uint64_t _startPosition = 0;
   uint64_t _endPosition = UINT64_MAX;
 
+  std::string _host = "127.0.0.1";
+  uint64_t _port = 8903;
+  std::string _password;
+  uint64_t _threads = 8;
+  uint64_t _pipeline = 128;
+  std::mutex _mutex;
+
   uint64_t _firstbinlogid = UINT64_MAX;
   uint64_t _lastbinlogid = UINT64_MAX;
   uint64_t _firstbinlogtime = UINT64_MAX;
@@ -247,6 +568,12 @@ void usage() {
             << " --start-datetime=1111 --end-datetime=22222"
             << " --start-position=333333 --end-position=55555"
             << /*" --keys=1,2,4,5,6,7,8,9" <<*/ std::endl;
+  // replay the dump dir of a server into the restored backup, each store
+  // from the one after its binlogpos if no --start-position
+  std::cerr << "binlog_tool --logdir=dump --mode=restore"
+            << " --host=127.0.0.1 --port=8903 --password=xxx"
+            << " --threads=8 --pipeline=128 --end-datetime=22222"
+            << std::endl;
 }
 
 int main(int argc, char** argv) {
@@ -2,6 +2,7 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <algorithm>
 #include <list>
 #include <chrono>  // NOLINT
 #include <fstream>
@@ -20,7 +21,8 @@ namespace tendisplus {
 bool ReplManager::supplyFullSync(asio::ip::tcp::socket sock,
                                  const std::string& storeIdArg,
                                  const std::string& slaveIpArg,
-                                 const std::string& slavePortArg) {
+                                 const std::string& slavePortArg,
+                                 const std::string& streamsArg) {
   std::shared_ptr<BlockingTcpClient> client =
     std::move(_svr->getNetwork()->createBlockingClient(std::move(sock),
                                                        64 * 1024 * 1024));
@@ -48,20 +50,66 @@ bool ReplManager::supplyFullSync(asio::ip::tcp::socket sock,
     client->writeLine("-ERR invalid expSlavePort");
     return false;
   }
+
+  uint32_t streams = 1;
+  if (!streamsArg.empty()) {
+    auto expStreams = tendisplus::stoul(streamsArg);
+    if (!expStreams.ok() || expStreams.value() == 0) {
+      LOG(ERROR) << "ReplManager::supplyFullSync streamsArg error:"
+                 << streamsArg;
+      client->writeLine("-ERR invalid streams");
+      return false;
+    }
+    streams = static_cast<uint32_t>(expStreams.value());
+  }
   LOG(INFO) << "ReplManager::supplyFullSync storeId:" << storeIdArg << " "
-            << slaveIpArg << ":" << slavePortArg;
+            << slaveIpArg << ":" << slavePortArg << " streams:" << streams;
   uint16_t slavePort = static_cast<uint16_t>(expSlavePort.value());
   _fullPusher->schedule([this,
                          storeId,
                          client(std::move(client)),
                          slaveIpArg,
-                         slavePort]() mutable {
-    supplyFullSyncRoutine(std::move(client), storeId, slaveIpArg, slavePort);
+                         slavePort,
+                         streams]() mutable {
+    supplyFullSyncRoutine(
+      std::move(client), storeId, slaveIpArg, slavePort, streams);
   });
 
   return true;
 }
 
+bool ReplManager::supplyFullSyncFile(asio::ip::tcp::socket sock,
+                                     const std::string& storeIdArg,
+                                     const std::string& slaveIpArg,
+                                     const std::string& slavePortArg) {
+  std::shared_ptr<BlockingTcpClient> client =
+    std::move(_svr->getNetwork()->createBlockingClient(std::move(sock),
+                                                       64 * 1024 * 1024));
+
+  auto expStoreId = tendisplus::stoul(storeIdArg);
+  if (!expStoreId.ok() || expStoreId.value() >= _svr->getKVStoreCount()) {
+    LOG(ERROR) << "ReplManager::supplyFullSyncFile storeIdArg error:"
+               << storeIdArg;
+    client->writeLine("-ERR invalid storeId");
+    return false;
+  }
+  uint32_t storeId = static_cast<uint32_t>(expStoreId.value());
+
+  if (_fullFilePusher->isFull()) {
+    LOG(WARNING) << "ReplManager::supplyFullSyncFile fullFilePusher isFull.";
+    client->writeLine("-ERR workerpool full");
+    return false;
+  }
+  client->writeLine("+OK");
+
+  string slaveNode = slaveIpArg + ":" + slavePortArg;
+  _fullFilePusher->schedule(
+    [this, storeId, client(std::move(client)), slaveNode]() mutable {
+      supplyFullSyncFileRoutine(std::move(client), storeId, slaveNode);
+    });
+  return true;
+}
+
 bool ReplManager::isFullSupplierFull() const {
   return _fullPusher->isFull();
 }
@@ -90,6 +138,7 @@ void ReplManager::masterPushRoutine(uint32_t storeId, uint64_t clientId) {
   uint64_t binlogPos = 0;
   BlockingTcpClient* client = nullptr;
   uint32_t dstStoreId = 0;
+  Codec codec = Codec::NONE;
   bool needHeartbeat = false;
   {
     std::lock_guard<std::mutex> lk(_mutex);
@@ -102,6 +151,7 @@ void ReplManager::masterPushRoutine(uint32_t storeId, uint64_t clientId) {
     binlogPos = _pushStatus[storeId][clientId]->binlogPos;
     client = _pushStatus[storeId][clientId]->client.get();
     dstStoreId = _pushStatus[storeId][clientId]->dstStoreId;
+    codec = _pushStatus[storeId][clientId]->codec;
     lastSend = _pushStatus[storeId][clientId]->lastSendBinlogTime;
   }
   if (lastSend + std::chrono::seconds(gBinlogHeartbeatSecs) < SCLOCK::now()) {
@@ -109,7 +159,7 @@ void ReplManager::masterPushRoutine(uint32_t storeId, uint64_t clientId) {
   }
 
   auto ret = masterSendBinlogV2(
-    client, storeId, dstStoreId, binlogPos, needHeartbeat, _svr, _cfg);
+    client, storeId, dstStoreId, binlogPos, needHeartbeat, codec, _svr, _cfg);
   if (!ret.ok()) {
     LOG(WARNING) << "masterSendBinlog to client:" << client->getRemoteRepr()
                  << " failed:" << ret.status().toString();
@@ -145,6 +195,10 @@ void ReplManager::masterPushRoutine(uint32_t storeId, uint64_t clientId) {
 //  the 3) step is necessary, if ignored, the +OK in step 2) and binlogs
 //  in step 4) may sticky together. and redis-resp protocal is not fixed-size
 //  That makes client2Session complicated.
+//  If the slave gives the codecs it accepts in 1), separated by ',', the
+//  master replies +OK with the first one it knows in 2), and sends the
+//  binlogs compressed by it in 4), see masterSendBinlogV2(). The master
+//  replies only +OK if it knows none of them.
 
 // NOTE(deyukong): we define binlogPos the greatest id that has been applied.
 // "NOT" the smallest id that has not been applied. keep the same with
@@ -154,7 +208,8 @@ bool ReplManager::registerIncrSync(asio::ip::tcp::socket sock,
                                    const std::string& dstStoreIdArg,
                                    const std::string& binlogPosArg,
                                    const std::string& listenIpArg,
-                                   const std::string& listenPortArg) {
+                                   const std::string& listenPortArg,
+                                   const std::string& codecsArg) {
   std::shared_ptr<BlockingTcpClient> client =
     std::move(_svr->getNetwork()->createBlockingClient(std::move(sock),
                                                        64 * 1024 * 1024));
@@ -224,7 +279,8 @@ bool ReplManager::registerIncrSync(asio::ip::tcp::socket sock,
     LOG(ERROR) << ss.str();
     return false;
   }
-  client->writeLine("+OK");
+  Codec codec = negotiateCodec(codecsArg);
+  client->writeLine(codec == Codec::NONE ? "+OK" : "+OK " + codecName(codec));
   Expected<std::string> exptPong = client->readLine(std::chrono::seconds(1));
   if (!exptPong.ok()) {
     LOG(WARNING) << "slave incrsync handshake failed:"
@@ -242,7 +298,8 @@ bool ReplManager::registerIncrSync(asio::ip::tcp::socket sock,
                       binlogPos,
                       client = std::move(client),
                       listenIpArg,
-                      listen_port]() mutable {
+                      listen_port,
+                      codec]() mutable {
     std::lock_guard<std::mutex> lk(_mutex);
     // takenliu: recycleBinlog use firstPos, and incrSync use binlogPos+1
     if (_logRecycStatus[storeId]->firstBinlogId > (binlogPos + 1) &&
@@ -277,7 +334,8 @@ bool ReplManager::registerIncrSync(asio::ip::tcp::socket sock,
                      std::move(client),
                      clientId,
                      listenIpArg,
-                     listen_port};
+                     listen_port,
+                     codec};
 #else
     _pushStatus[storeId][clientId] = std::move(std::unique_ptr<MPovStatus>(
       new MPovStatus{false,
@@ -289,12 +347,13 @@ bool ReplManager::registerIncrSync(asio::ip::tcp::socket sock,
                      std::move(client),
                      clientId,
                      listenIpArg,
-                     listen_port}));
+                     listen_port,
+                     codec}));
 #endif
     return true;
   }();
   LOG(INFO) << "slave:" << remoteHost << " registerIncrSync "
-            << (registPosOk ? "ok" : "failed");
+            << (registPosOk ? "ok" : "failed") << ",codec:" << codecName(codec);
 
   return registPosOk;
 }
@@ -307,11 +366,17 @@ bool ReplManager::registerIncrSync(asio::ip::tcp::socket sock,
 //     send content
 //     read +OK
 // read +OK
+//
+// If the slave asks for more than one stream, it pulls the files itself
+// over so many fullsyncfile connections instead, see
+// supplyFullSyncFileRoutine(). The master only sends binlogpos and filelist
+// here, and then reads the +PING sent by the slave meanwhile until its +OK.
 void ReplManager::supplyFullSyncRoutine(
   std::shared_ptr<BlockingTcpClient> client,
   uint32_t storeId,
   const string& slave_listen_ip,
-  uint16_t slave_listen_port) {
+  uint16_t slave_listen_port,
+  uint32_t streams) {
   LocalSessionGuard sg(_svr.get());
   sg.getSession()->setArgs(
     {"masterfullsync", client->getRemoteRepr(), std::to_string(storeId)});
@@ -401,10 +466,19 @@ void ReplManager::supplyFullSyncRoutine(
     });
 
   uint64_t currTime = nsSinceEpoch();
+  // link the files of the store to send, or make a checkpoint if they
+  // can't be linked, e.g. the wals are on another disk
   Expected<BackupInfo> bkInfo =
     store->backup(store->dftBackupDir(),
-                  KVStore::BackupMode::BACKUP_CKPT_INTER,
+                  KVStore::BackupMode::BACKUP_LINK_INTER,
                   _svr->getCatalog()->getBinlogVersion());
+  if (!bkInfo.ok()) {
+    LOG(WARNING) << "storeId:" << storeId << ",link backup failed:"
+                 << bkInfo.status().toString() << ", try checkpoint";
+    bkInfo = store->backup(store->dftBackupDir(),
+                           KVStore::BackupMode::BACKUP_CKPT_INTER,
+                           _svr->getCatalog()->getBinlogVersion());
+  }
   if (!bkInfo.ok()) {
     std::stringstream ss;
     ss << "-ERR backup failed:" << bkInfo.status().toString();
@@ -454,6 +528,34 @@ void ReplManager::supplyFullSyncRoutine(
   LOG(INFO) << "fullsync " << storeId
             << " send fileList success:" << sb.GetString();
 
+  if (streams > 1) {
+    {
+      std::lock_guard<std::mutex> lk(_mutex);
+      string slaveNode = slave_listen_ip + ":" + to_string(slave_listen_port);
+      auto iter = _fullPushStatus[storeId].find(slaveNode);
+      if (iter == _fullPushStatus[storeId].end()) {
+        LOG(ERROR) << "store:" << storeId << " fullsync of " << slaveNode
+                   << " stopped";
+        return;
+      }
+      iter->second->fileList = bkInfo.value().getFileList();
+    }
+    while (true) {
+      secs = _cfg->timeoutSecBinlogWaitRsp;
+      auto reply = client->readLine(std::chrono::seconds(secs));
+      if (!reply.ok()) {
+        LOG(ERROR) << "fullsync wait " << client->getRemoteRepr()
+                   << " failed:" << reply.status().toString();
+        return;
+      } else if (reply.value() != "+PING") {
+        LOG(INFO) << "fullsync storeid:" << storeId << " done, read "
+                  << client->getRemoteRepr() << " reply:" << reply.value();
+        hasError = reply.value() != "+OK";
+        return;
+      }
+    }
+  }
+
   std::string readBuf;
   size_t fileBatch = (_cfg->binlogRateLimitMB * 1024 * 1024) / 10;
   readBuf.reserve(fileBatch);
@@ -514,4 +616,92 @@ void ReplManager::supplyFullSyncRoutine(
   }
 }
 
+// the fullsyncfile connection of a slave, see supplyFullSyncRoutine()
+// foreach file
+//     read filename
+//     send +crc32c of the file, or + for an SST file, see isSstFile()
+//     send content
+// read +OK
+// The files are read by the kernel into the socket, a file lost with a
+// broken connection is pulled again over another one.
+void ReplManager::supplyFullSyncFileRoutine(
+  std::shared_ptr<BlockingTcpClient> client,
+  uint32_t storeId,
+  const string& slaveNode) {
+  LocalSessionGuard sg(_svr.get());
+  sg.getSession()->setArgs(
+    {"masterfullsyncfile", client->getRemoteRepr(), std::to_string(storeId)});
+  auto expdb = _svr->getSegmentMgr()->getDb(
+    sg.getSession(), storeId, mgl::LockMode::LOCK_IS);
+  if (!expdb.ok()) {
+    LOG(ERROR) << "getDb failed:" << expdb.status().toString();
+    return;
+  }
+  auto store = std::move(expdb.value().store);
+  INVARIANT(store != nullptr);
+
+  uint32_t secs = _cfg->timeoutSecBinlogWaitRsp;
+  size_t fileBatch = (_cfg->binlogRateLimitMB * 1024 * 1024) / 10;
+  while (true) {
+    auto expName = client->readLine(std::chrono::seconds(secs));
+    if (!expName.ok()) {
+      LOG(WARNING) << "fullsyncfile read " << client->getRemoteRepr()
+                   << " failed:" << expName.status().toString();
+      return;
+    } else if (expName.value() == "+OK") {
+      return;
+    }
+    const std::string& fileName = expName.value();
+
+    uint64_t fileSize = 0;
+    {
+      std::lock_guard<std::mutex> lk(_mutex);
+      auto iter = _fullPushStatus[storeId].find(slaveNode);
+      if (iter == _fullPushStatus[storeId].end() ||
+          iter->second->state != FullPushState::PUSHING) {
+        client->writeLine("-ERR no fullsync of " + slaveNode);
+        return;
+      }
+      auto fileIter = iter->second->fileList.find(fileName);
+      if (fileIter == iter->second->fileList.end()) {
+        client->writeLine("-ERR invalid file " + fileName);
+        return;
+      }
+      fileSize = fileIter->second;
+    }
+
+    std::string fname = store->dftBackupDir() + "/" + fileName;
+    std::string crc;
+    if (!isSstFile(fileName)) {
+      auto expCrc = fileCrc32c(fname, fileSize);
+      if (!expCrc.ok()) {
+        LOG(ERROR) << "checksum file:" << fname
+                   << " failed:" << expCrc.status().toString();
+        client->writeLine("-ERR checksum failed");
+        return;
+      }
+      crc = std::to_string(expCrc.value());
+    }
+    Status s = client->writeLine("+" + crc);
+    if (!s.ok()) {
+      LOG(ERROR) << "write checksum of:" << fileName
+                 << " to client failed:" << s.toString();
+      return;
+    }
+    for (uint64_t offset = 0; offset < fileSize; offset += fileBatch) {
+      size_t batchSize = std::min<uint64_t>(fileSize - offset, fileBatch);
+      _rateLimiter->Request(batchSize);
+      s = client->sendFile(
+        fname, offset, batchSize, std::chrono::seconds(secs));
+      if (!s.ok()) {
+        LOG(ERROR) << "send client:" << client->getRemoteRepr()
+                   << " file:" << fileName << ",size:" << fileSize
+                   << " failed:" << s.toString();
+        return;
+      }
+    }
+    LOG(INFO) << "fullsyncfile send file success:" << fname;
+  }
+}
+
 }  // namespace tendisplus
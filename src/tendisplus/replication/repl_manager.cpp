@@ -84,10 +84,14 @@ ReplManager::ReplManager(std::shared_ptr<ServerEntry> svr,
     _clientIdGen(0),
     _dumpPath(cfg->dumpPath),
     _fullPushMatrix(std::make_shared<PoolMatrix>()),
+    _fullFilePushMatrix(std::make_shared<PoolMatrix>()),
     _incrPushMatrix(std::make_shared<PoolMatrix>()),
     _fullReceiveMatrix(std::make_shared<PoolMatrix>()),
     _incrCheckMatrix(std::make_shared<PoolMatrix>()),
     _logRecycleMatrix(std::make_shared<PoolMatrix>()),
+    _binlogApplyMatrix(std::make_shared<PoolMatrix>()),
+    _incrPushScaler(std::make_unique<PoolAutoScaler>(_incrPushMatrix)),
+    _logRecycleScaler(std::make_unique<PoolAutoScaler>(_logRecycleMatrix)),
     _connectMasterTimeoutMs(1000) {
   _cfg->serverParamsVar("incrPushThreadnum")->setUpdate([this]() {
     incrPusherResize(_cfg->incrPushThreadnum);
@@ -95,12 +99,18 @@ ReplManager::ReplManager(std::shared_ptr<ServerEntry> svr,
   _cfg->serverParamsVar("fullPushThreadnum")->setUpdate([this]() {
     fullPusherResize(_cfg->fullPushThreadnum);
   });
+  _cfg->serverParamsVar("fullPushFileThreadnum")->setUpdate([this]() {
+    fullFilePusherResize(_cfg->fullPushFileThreadnum);
+  });
   _cfg->serverParamsVar("fullReceiveThreadnum")->setUpdate([this]() {
     fullReceiverResize(_cfg->fullReceiveThreadnum);
   });
   _cfg->serverParamsVar("logRecycleThreadnum")->setUpdate([this]() {
     logRecyclerResize(_cfg->logRecycleThreadnum);
   });
+  _cfg->serverParamsVar("binlogApplyThreadnum")->setUpdate([this]() {
+    binlogApplierResize(_cfg->binlogApplyThreadnum);
+  });
 }
 
 Status ReplManager::stopStore(uint32_t storeId) {
@@ -163,6 +173,13 @@ Status ReplManager::startup() {
     return s;
   }
 
+  _fullFilePusher =
+    std::make_unique<WorkerPool>("tx-repl-mfile", _fullFilePushMatrix);
+  s = _fullFilePusher->startup(_cfg->fullPushFileThreadnum);
+  if (!s.ok()) {
+    return s;
+  }
+
   _fullReceiver =
     std::make_unique<WorkerPool>("tx-repl-sfull", _fullReceiveMatrix);
   s = _fullReceiver->startup(_cfg->fullReceiveThreadnum);
@@ -176,6 +193,13 @@ Status ReplManager::startup() {
     return s;
   }
 
+  _binlogApplier =
+    std::make_unique<WorkerPool>("tx-repl-sapply", _binlogApplyMatrix);
+  s = _binlogApplier->startup(_cfg->binlogApplyThreadnum);
+  if (!s.ok()) {
+    return s;
+  }
+
   _logRecycler =
     std::make_unique<WorkerPool>("tx-log-recyc", _logRecycleMatrix);
   s = _logRecycler->startup(_cfg->logRecycleThreadnum);
@@ -770,7 +794,7 @@ void ReplManager::recycleBinlog(uint32_t storeId) {
   uint64_t newStart = 0;
   uint64_t newSave = 0;
   {
-    std::ofstream* fs = nullptr;
+    BinlogFileWriter* fs = nullptr;
     int64_t maxWriteLen = 0;
     if (saveLogs) {
       fs = getCurBinlogFs(storeId);
@@ -790,6 +814,10 @@ void ReplManager::recycleBinlog(uint32_t storeId) {
     if (!s.ok()) {
       LOG(ERROR) << "kvstore->truncateBinlogV2 store:" << storeId
                  << "failed:" << s.status().toString();
+      if (fs) {
+        // the binlogs not deleted are saved again into a new file
+        updateCurBinlogFs(storeId, 0, 0, true);
+      }
       hasError = true;
       return;
     }
@@ -876,103 +904,14 @@ Expected<uint64_t> ReplManager::getSaveBinlogId(uint32_t storeId,
     return {ErrorCodes::ERR_INTERNAL, "parse fileno failed"};
   }
 
-  std::ifstream fs(maxPath);
-  if (!fs.is_open()) {
-    LOG(ERROR) << "open file:" << maxPath << " for read failed";
-    return {ErrorCodes::ERR_INTERNAL, "open file failed"};
+  auto eReader = BinlogFileReader::open(maxPath);
+  if (!eReader.ok()) {
+    LOG(ERROR) << "open file:" << maxPath
+               << " failed:" << eReader.status().toString();
+    return eReader.status();
   }
-  std::string readBuf;
-  readBuf.resize(4096);
-
-  fs.read(&readBuf[0], strlen(BINLOG_HEADER_V2) + sizeof(uint32_t));
-  if (!fs.good()) {
-    if (fs.eof()) {
-      return {ErrorCodes::ERR_NO_KEY, ""};
-    }
-    LOG(ERROR) << "read file:" << maxPath
-               << " failed with err:" << strerror(errno);
-    return {ErrorCodes::ERR_INTERNAL, "read file failed"};
-  }
-
-  std::string key;
-  std::string value;
-  // The last key may be incomplete, and you need to return the second last
-  // key
-  std::string lastKey;
-  std::string lastValue;
-
-  while (true) {
-    uint32_t keylen = 0;
-    fs.read(&readBuf[0], sizeof(uint32_t));
-    if (fs.eof()) {
-      break;
-    }
-    if (!fs.good()) {
-      LOG(ERROR) << "read file:" << maxPath
-                 << " failed with err:" << strerror(errno);
-      return {ErrorCodes::ERR_INTERNAL, "read file failed"};
-    }
-    readBuf[sizeof(uint32_t)] = '\0';
-    keylen = int32Decode(readBuf.c_str());
-
-    std::string tempKey;
-    tempKey.resize(keylen);
-    fs.read(&tempKey[0], keylen);
-    if (fs.eof()) {
-      break;
-    }
-    if (!fs.good()) {
-      LOG(ERROR) << "read file:" << maxPath
-                 << " failed with err:" << strerror(errno);
-      return {ErrorCodes::ERR_INTERNAL, "read file failed"};
-    }
-
-    uint32_t valuelen = 0;
-    fs.read(&readBuf[0], sizeof(uint32_t));
-    if (fs.eof()) {
-      break;
-    }
-    if (!fs.good()) {
-      LOG(ERROR) << "read file:" << maxPath
-                 << " failed with err:" << strerror(errno);
-      return {ErrorCodes::ERR_INTERNAL, "read file failed"};
-    }
-    readBuf[sizeof(uint32_t)] = '\0';
-    valuelen = int32Decode(readBuf.c_str());
-
-    std::string tempValue;
-    tempValue.resize(valuelen);
-    fs.read(&tempValue[0], valuelen);
-    if (fs.eof()) {
-      break;
-    }
-    if (!fs.good()) {
-      LOG(ERROR) << "read file:" << maxPath
-                 << " failed with err:" << strerror(errno);
-      return {ErrorCodes::ERR_INTERNAL, "read file failed"};
-    }
-
-    lastKey = key;
-    lastValue = value;
-    key = tempKey;
-    value = tempValue;
-  }
-
-  Expected<ReplLogKeyV2> logKey = ReplLogKeyV2::decode(key);
-  Expected<ReplLogValueV2> logValue = ReplLogValueV2::decode(value);
-  if (!logKey.ok() || !logValue.ok()) {
-    Expected<ReplLogKeyV2> logLastKey = ReplLogKeyV2::decode(lastKey);
-    Expected<ReplLogValueV2> logLastValue = ReplLogValueV2::decode(lastValue);
-    if (!logLastKey.ok()) {
-      return logLastKey.status();
-    }
-    if (!logLastValue.ok()) {
-      return logLastValue.status();
-    }
-    return logLastKey.value().getBinlogId();
-  }
-
-  return logKey.value().getBinlogId();
+  // The last binlog may be incomplete, the one before it is returned
+  return eReader.value()->getLastBinlogId();
 }
 
 bool ReplManager::flushCurBinlogFs(uint32_t storeId) {
@@ -1548,9 +1487,11 @@ void ReplManager::stop() {
   // make sure all workpool has been stopped; otherwise calling
   // the destructor of a std::thread that is running will crash
   _fullPusher->stop();
+  _fullFilePusher->stop();
   _incrPusher->stop();
   _fullReceiver->stop();
   _incrChecker->stop();
+  _binlogApplier->stop();
   _logRecycler->stop();
 
 #if defined(_WIN32) && _MSC_VER > 1900
@@ -1573,7 +1514,10 @@ void ReplManager::stop() {
   std::unique_lock<std::mutex> lk(_mutex);
   for (size_t i = 0; i < _logRecycStatus.size(); i++) {
     if (_logRecycStatus[i]->fs) {
-      _logRecycStatus[i]->fs->close();
+      auto s = _logRecycStatus[i]->fs->close();
+      if (!s.ok()) {
+        LOG(ERROR) << "store:" << i << " " << s.toString();
+      }
       _logRecycStatus[i]->fs.reset();
     }
   }
@@ -1584,6 +1528,10 @@ void ReplManager::fullPusherResize(size_t size) {
   _fullPusher->resize(size);
 }
 
+void ReplManager::fullFilePusherResize(size_t size) {
+  _fullFilePusher->resize(size);
+}
+
 void ReplManager::fullReceiverResize(size_t size) {
   _fullReceiver->resize(size);
 }
@@ -1596,10 +1544,37 @@ void ReplManager::logRecyclerResize(size_t size) {
   _logRecycler->resize(size);
 }
 
+void ReplManager::binlogApplierResize(size_t size) {
+  _binlogApplier->resize(size);
+}
+
+void ReplManager::autoScalePools(uint64_t queueNsHigh, bool cpuBusy) {
+  // the configured threadnum is the upper bound
+  size_t cur = _incrPusher->size();
+  size_t num = _incrPushScaler->adapt(
+    cur, 1, 1, _cfg->incrPushThreadnum, queueNsHigh, cpuBusy);
+  if (num != cur) {
+    LOG(INFO) << "autoscale incrPusher from " << cur << " to " << num;
+    incrPusherResize(num);
+  }
+
+  cur = _logRecycler->size();
+  num = _logRecycleScaler->adapt(
+    cur, 1, 1, _cfg->logRecycleThreadnum, queueNsHigh, cpuBusy);
+  if (num != cur) {
+    LOG(INFO) << "autoscale logRecycler from " << cur << " to " << num;
+    logRecyclerResize(num);
+  }
+}
+
 size_t ReplManager::fullPusherSize() {
   return _fullPusher->size();
 }
 
+size_t ReplManager::fullFilePusherSize() {
+  return _fullFilePusher->size();
+}
+
 size_t ReplManager::fullReceiverSize() {
   return _fullReceiver->size();
 }
@@ -1612,4 +1587,8 @@ size_t ReplManager::logRecycleSize() {
   return _logRecycler->size();
 }
 
+size_t ReplManager::binlogApplierSize() {
+  return _binlogApplier->size();
+}
+
 }  // namespace tendisplus
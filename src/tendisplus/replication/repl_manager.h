@@ -6,10 +6,12 @@
 #define SRC_TENDISPLUS_REPLICATION_REPL_MANAGER_H_
 
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <list>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -20,7 +22,9 @@
 #include "tendisplus/network/blocking_tcp_client.h"
 #include "tendisplus/replication/repl_util.h"
 #include "tendisplus/server/server_entry.h"
+#include "tendisplus/storage/binlog_file.h"
 #include "tendisplus/storage/catalog.h"
+#include "tendisplus/utils/compression.h"
 #include "tendisplus/utils/rate_limiter.h"
 
 namespace tendisplus {
@@ -52,6 +56,8 @@ struct MPovStatus {
   uint64_t clientId = 0;
   string slave_listen_ip;
   uint16_t slave_listen_port = 0;
+  // the binlogs are compressed with
+  Codec codec = Codec::NONE;
 };
 
 enum class FullPushState {
@@ -75,6 +81,9 @@ struct MPovFullPushStatus {
   uint64_t clientId;
   string slave_listen_ip;
   uint16_t slave_listen_port;
+  // the files the slave may pull over fullsyncfile connections,
+  // filename->filesize, empty if it receives them over the client
+  std::map<std::string, uint64_t> fileList;
 };
 
 struct RecycleBinlogStatus {
@@ -87,7 +96,7 @@ struct RecycleBinlogStatus {
   uint64_t timestamp;
   SCLOCK::time_point fileCreateTime;
   uint64_t fileSize;
-  std::unique_ptr<std::ofstream> fs;
+  std::unique_ptr<BinlogFileWriter> fs;
   bool needNewFile;
   uint64_t saveBinlogId;
   std::string toString() const {
@@ -153,13 +162,19 @@ class ReplManager {
   bool supplyFullSync(asio::ip::tcp::socket sock,
                       const std::string& storeIdArg,
                       const std::string& slaveIpArg,
-                      const std::string& slavePortArg);
+                      const std::string& slavePortArg,
+                      const std::string& streamsArg);
+  bool supplyFullSyncFile(asio::ip::tcp::socket sock,
+                          const std::string& storeIdArg,
+                          const std::string& slaveIpArg,
+                          const std::string& slavePortArg);
   bool registerIncrSync(asio::ip::tcp::socket sock,
                         const std::string& storeIdArg,
                         const std::string& dstStoreIdArg,
                         const std::string& binlogPosArg,
                         const std::string& listenIpArg,
-                        const std::string& listenPortArg);
+                        const std::string& listenPortArg,
+                        const std::string& codecsArg);
   Status replicationSetMaster(std::string ip,
                               uint32_t port,
                               bool checkEmpty = true);
@@ -176,6 +191,10 @@ class ReplManager {
                         uint32_t storeId,
                         const std::string& logKey,
                         const std::string& logValue);
+  // apply a batch of binlogs, see applyTxnsInLanesV2()
+  Status applyRepllogsV2(Session* sess,
+                         uint32_t storeId,
+                         const std::vector<ReplLogRawV2>& logs);
 #endif
   bool flushCurBinlogFs(uint32_t storeId);
   void appendJSONStat(rapidjson::PrettyWriter<rapidjson::StringBuffer>&) const;
@@ -189,14 +208,21 @@ class ReplManager {
   Expected<uint64_t> getSaveBinlogId(uint32_t storeId, uint32_t fileSeq);
 
   void fullPusherResize(size_t size);
+  void fullFilePusherResize(size_t size);
   void fullReceiverResize(size_t size);
   void incrPusherResize(size_t size);
   void logRecyclerResize(size_t size);
+  void binlogApplierResize(size_t size);
+  // resize _incrPusher and _logRecycler by their pressure, called in
+  // ServerEntry::serverCron() when pool-autoscale is on
+  void autoScalePools(uint64_t queueNsHigh, bool cpuBusy);
 
   size_t fullPusherSize();
+  size_t fullFilePusherSize();
   size_t fullReceiverSize();
   size_t incrPusherSize();
   size_t logRecycleSize();
+  size_t binlogApplierSize();
 
   std::string getRecycleBinlogStr(Session* sess) const;
   std::string getMasterHost() const;
@@ -214,14 +240,26 @@ class ReplManager {
   void supplyFullSyncRoutine(std::shared_ptr<BlockingTcpClient> client,
                              uint32_t storeId,
                              const string& slave_listen_ip,
-                             uint16_t slave_listen_port);
+                             uint16_t slave_listen_port,
+                             uint32_t streams);
+  void supplyFullSyncFileRoutine(std::shared_ptr<BlockingTcpClient> client,
+                                 uint32_t storeId,
+                                 const string& slaveNode);
   bool isFullSupplierFull() const;
 
   std::shared_ptr<BlockingTcpClient> createClient(const StoreMeta&,
                                                   uint64_t timeoutMs = 1000);
   void slaveStartFullsync(const StoreMeta&);
+  // pull the files of flist into backupDir over streams connections, the
+  // finished ones are skipped, client is kept alive meanwhile
+  Status slaveFetchFiles(const StoreMeta& metaSnapshot,
+                         BlockingTcpClient* client,
+                         const std::string& backupDir,
+                         const std::map<std::string, uint64_t>& flist,
+                         uint32_t streams,
+                         std::set<std::string>* finishedFiles);
   void slaveChkSyncStatus(const StoreMeta&);
-  std::ofstream* getCurBinlogFs(uint32_t storeid);
+  BinlogFileWriter* getCurBinlogFs(uint32_t storeid);
 
 #ifdef BINLOG_V1
   // binlogPos: the greatest id that has been applied
@@ -254,6 +292,14 @@ class ReplManager {
   void getReplInfoSimple(std::stringstream& ss) const;
   void getReplInfoDetail(std::stringstream& ss) const;
   void recycleFullPushStatus();
+#ifndef BINLOG_V1
+  // run apply as the only one applying to the store, if sess is the one
+  // syncing it, apply returns the timestamp of the binlogs applied
+  Status applyAsSyncSession(
+    Session* sess,
+    uint32_t storeId,
+    const std::function<Expected<uint64_t>()>& apply);
+#endif
 
  private:
   const std::shared_ptr<ServerParams> _cfg;
@@ -288,6 +334,10 @@ class ReplManager {
   // master's pov, workerpool of pushing full backup
   std::unique_ptr<WorkerPool> _fullPusher;
 
+  // master's pov, workerpool of sending the files of full backups to the
+  // fullsyncfile connections
+  std::unique_ptr<WorkerPool> _fullFilePusher;
+
   // master's pov fullsync rate limiter
   std::unique_ptr<RateLimiter> _rateLimiter;
 
@@ -303,6 +353,9 @@ class ReplManager {
   // slave's pov, periodly check incr-sync status
   std::unique_ptr<WorkerPool> _incrChecker;
 
+  // slave's pov, workerpool of applying the lanes of binlogs
+  std::unique_ptr<WorkerPool> _binlogApplier;
+
   // master and slave's pov, log recycler
   std::unique_ptr<WorkerPool> _logRecycler;
 
@@ -313,10 +366,14 @@ class ReplManager {
   std::unique_ptr<std::thread> _controller;
 
   std::shared_ptr<PoolMatrix> _fullPushMatrix;
+  std::shared_ptr<PoolMatrix> _fullFilePushMatrix;
   std::shared_ptr<PoolMatrix> _incrPushMatrix;
   std::shared_ptr<PoolMatrix> _fullReceiveMatrix;
   std::shared_ptr<PoolMatrix> _incrCheckMatrix;
   std::shared_ptr<PoolMatrix> _logRecycleMatrix;
+  std::shared_ptr<PoolMatrix> _binlogApplyMatrix;
+  std::unique_ptr<PoolAutoScaler> _incrPushScaler;
+  std::unique_ptr<PoolAutoScaler> _logRecycleScaler;
   uint64_t _connectMasterTimeoutMs;
 };
 
@@ -4,11 +4,21 @@
 
 #include "tendisplus/replication/repl_util.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <fstream>
+#include <functional>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <string>
 #include <utility>
+#include <vector>
 #include "glog/logging.h"
+#include "rocksdb/convenience.h"
+#include "util/crc32c.h"
 #include "tendisplus/commands/command.h"
+#include "tendisplus/utils/sync_point.h"
 
 namespace tendisplus {
 
@@ -55,6 +65,7 @@ Expected<BinlogResult> masterSendBinlogV2(
   uint32_t dstStoreId,
   uint64_t binlogPos,
   bool needHeartBeart,
+  Codec codec,
   std::shared_ptr<ServerEntry> svr,
   const std::shared_ptr<ServerParams> cfg) {
   uint32_t suggestBatch = svr->getParams()->bingLogSendBatch;
@@ -145,6 +156,19 @@ Expected<BinlogResult> masterSendBinlogV2(
     Command::fmtBulk(ss2, std::to_string(dstStoreId));
     /* add timestamp which binlog_heartbeat created */
     Command::fmtBulk(ss2, std::to_string(br.binlogTs));
+  } else if (codec != Codec::NONE) {
+    // applybinlogsv2 with the binlogs in a frame of the codec
+    auto eFrame = compressFrame(codec, writer.getBinlogStr());
+    if (!eFrame.ok()) {
+      return eFrame.status();
+    }
+    Command::fmtMultiBulkLen(ss2, 6);
+    Command::fmtBulk(ss2, "applybinlogsv2");
+    Command::fmtBulk(ss2, std::to_string(dstStoreId));
+    Command::fmtBulk(ss2, eFrame.value());
+    Command::fmtBulk(ss2, std::to_string(writer.getCount()));
+    Command::fmtBulk(ss2, std::to_string((uint32_t)writer.getFlag()));
+    Command::fmtBulk(ss2, codecName(codec));
   } else {
     // TODO(vinchen): too more copy
     Command::fmtMultiBulkLen(ss2, 5);
@@ -290,6 +314,230 @@ Expected<BinlogResult> applySingleTxnV2(Session* sess,
   return br;
 }
 
+uint32_t binlogLaneOf(const std::string& key, uint32_t lanes) {
+  INVARIANT_D(lanes > 0);
+  if (key.size() > RecordKey::getHdrSize()) {
+    uint32_t chunkId = RecordKey::decodeChunkId(key);
+    if (chunkId < CLUSTER_SLOTS) {
+      return chunkId % lanes;
+    }
+  }
+  return std::hash<std::string>()(key) % lanes;
+}
+
+// the ops of the lanes of a batch, see applyTxnsInLanesV2()
+struct BinlogLanes {
+  std::vector<std::vector<ReplLogValueEntryV2>> ops;
+  std::vector<Status> results;
+  // the next lane to apply
+  std::atomic<uint32_t> next{0};
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t done = 0;
+};
+
+// apply the ops in a txn
+static Status applyLaneV2(Session* sess,
+                          KVStore* store,
+                          const std::vector<ReplLogValueEntryV2>& ops) {
+  if (ops.empty()) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  auto ptxn = store->createTransaction(sess);
+  if (!ptxn.ok()) {
+    return ptxn.status();
+  }
+  auto txn = std::move(ptxn.value());
+  for (const auto& op : ops) {
+    auto s = txn->applyBinlog(op);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  TEST_SYNC_POINT_CALLBACK(
+    "applyLaneV2::BeforeCommit",
+    const_cast<std::vector<ReplLogValueEntryV2>*>(&ops));
+  auto expCmit = txn->commit();
+  if (!expCmit.ok()) {
+    return expCmit.status();
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<BinlogResult> applyTxnsInLanesV2(Session* sess,
+                                          uint32_t storeId,
+                                          const std::vector<ReplLogRawV2>& logs,
+                                          WorkerPool* pool,
+                                          uint32_t lanes) {
+  if (!sess->getCtx()->isReplOnly()) {
+    INVARIANT_D(0);
+    return {ErrorCodes::ERR_INTERNAL, "It is not a slave"};
+  }
+  INVARIANT_D(!logs.empty());
+
+  std::vector<uint64_t> binlogIds;
+  auto batch = std::make_shared<BinlogLanes>();
+  batch->ops.resize(std::max(lanes, 1U));
+  uint64_t timestamp = 0;
+  bool serial = lanes <= 1 || pool == nullptr;
+  // the ops with their lanes. The lanes of the ops of a binlog, which is a
+  // txn of the master like RENAME or MSET, are merged, so the ops commit
+  // in one txn as they do in the master.
+  std::vector<std::pair<uint32_t, ReplLogValueEntryV2>> entries;
+  std::vector<uint32_t> laneRoots(batch->ops.size());
+  for (uint32_t i = 0; i < laneRoots.size(); ++i) {
+    laneRoots[i] = i;
+  }
+  auto rootOf = [&laneRoots](uint32_t lane) {
+    while (laneRoots[lane] != lane) {
+      lane = laneRoots[lane] = laneRoots[laneRoots[lane]];
+    }
+    return lane;
+  };
+  for (const auto& log : logs) {
+    auto key = ReplLogKeyV2::decode(log.getReplLogKey());
+    if (!key.ok()) {
+      LOG(ERROR) << "ReplLogKeyV2::decode failed:" << key.status().toString();
+      return key.status();
+    }
+    if (!binlogIds.empty() && key.value().getBinlogId() <= binlogIds.back()) {
+      return {ErrorCodes::ERR_MANUAL, "binlogIds not ascending"};
+    }
+    binlogIds.push_back(key.value().getBinlogId());
+    if (serial) {
+      continue;
+    }
+
+    auto value = ReplLogValueV2::decode(log.getReplLogValue());
+    if (!value.ok()) {
+      return value.status();
+    }
+    size_t offset = value.value().getHdrSize();
+    auto data = value.value().getData();
+    size_t dataSize = value.value().getDataSize();
+    uint32_t firstLane = UINT32_MAX;
+    while (offset < dataSize) {
+      size_t size = 0;
+      auto entry = ReplLogValueEntryV2::decode(
+        (const char*)data + offset, dataSize - offset, &size);
+      if (!entry.ok()) {
+        return entry.status();
+      }
+      offset += size;
+
+      timestamp = entry.value().getTimestamp();
+      auto op = entry.value().getOp();
+      if (op != ReplOp::REPL_OP_SET && op != ReplOp::REPL_OP_DEL) {
+        serial = true;
+        break;
+      }
+      auto lane = binlogLaneOf(entry.value().getOpKey(), lanes);
+      if (firstLane == UINT32_MAX) {
+        firstLane = lane;
+      } else {
+        laneRoots[rootOf(lane)] = rootOf(firstLane);
+      }
+      entries.emplace_back(lane, std::move(entry.value()));
+    }
+    if (!serial && offset != dataSize) {
+      return {ErrorCodes::ERR_INTERNAL, "bad binlog"};
+    }
+  }
+  if (!serial) {
+    for (auto& entry : entries) {
+      batch->ops[rootOf(entry.first)].emplace_back(std::move(entry.second));
+    }
+  }
+
+  if (serial) {
+    BinlogResult br;
+    for (const auto& log : logs) {
+      auto ebr = applySingleTxnV2(sess,
+                                  storeId,
+                                  log.getReplLogKey(),
+                                  log.getReplLogValue(),
+                                  BinlogApplyMode::KEEP_BINLOG_ID);
+      if (!ebr.ok()) {
+        return ebr.status();
+      }
+      br = ebr.value();
+    }
+    return br;
+  }
+
+  auto svr = sess->getServerEntry();
+  auto expdb =
+    svr->getSegmentMgr()->getDb(sess, storeId, mgl::LockMode::LOCK_IX);
+  if (!expdb.ok()) {
+    LOG(ERROR) << "getDb failed:" << expdb.status().toString();
+    return expdb.status();
+  }
+  auto store = std::move(expdb.value().store);
+  INVARIANT(store != nullptr);
+  if (binlogIds.front() <= store->getHighestBinlogId()) {
+    string err = "binlogId:" + to_string(binlogIds.front()) +
+      " can't be smaller than highestBinlogId:" +
+      to_string(store->getHighestBinlogId());
+    LOG(ERROR) << err;
+    return {ErrorCodes::ERR_MANUAL, err};
+  }
+
+  // a lane is applied by this thread or a thread of the pool, whichever
+  // takes it first, so a busy pool doesn't hold the batch
+  batch->results.resize(lanes, Status(ErrorCodes::ERR_OK, ""));
+  auto applyLanes = [batch, sess, store]() {
+    uint32_t i = 0;
+    while ((i = batch->next++) < batch->ops.size()) {
+      auto s = applyLaneV2(sess, store.get(), batch->ops[i]);
+      std::lock_guard<std::mutex> lk(batch->mutex);
+      batch->results[i] = s;
+      if (++batch->done == batch->ops.size()) {
+        batch->cv.notify_one();
+      }
+    }
+  };
+  for (uint32_t i = 1; i < lanes; ++i) {
+    pool->schedule([applyLanes]() { applyLanes(); });
+  }
+  applyLanes();
+  {
+    std::unique_lock<std::mutex> lk(batch->mutex);
+    batch->cv.wait(lk, [&batch] { return batch->done == batch->ops.size(); });
+  }
+  for (const auto& s : batch->results) {
+    if (!s.ok()) {
+      LOG(ERROR) << "store:" << storeId << " apply lane failed:"
+                 << s.toString();
+      return s;
+    }
+  }
+
+  // all the lanes have committed, move the binlog position
+  auto ptxn = store->createTransaction(sess);
+  if (!ptxn.ok()) {
+    LOG(ERROR) << "createTransaction failed:" << ptxn.status().toString();
+    return ptxn.status();
+  }
+  auto txn = std::move(ptxn.value());
+  for (size_t i = 0; i < logs.size(); ++i) {
+    auto s = txn->setBinlogKV(
+      binlogIds[i], logs[i].getReplLogKey(), logs[i].getReplLogValue());
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  auto expCmit = txn->commit();
+  if (!expCmit.ok()) {
+    return expCmit.status();
+  }
+  store->setBinlogTime(timestamp);
+
+  BinlogResult br;
+  br.binlogTs = timestamp;
+  br.binlogId = binlogIds.back();
+  return br;
+}
+
 Status sendWriter(BinlogWriter* writer,
                   BlockingTcpClient* client,
                   uint32_t dstStoreId,
@@ -493,4 +741,40 @@ Status SendSlotsBinlog(BlockingTcpClient* client,
   return {ErrorCodes::ERR_OK, ""};
 }
 
+Expected<uint32_t> fileCrc32c(const std::string& fileName, uint64_t size) {
+  auto myfile = std::ifstream(fileName, std::ios::binary);
+  if (!myfile.is_open()) {
+    return {ErrorCodes::ERR_INTERNAL, "open file:" + fileName + " failed"};
+  }
+  uint32_t crc = 0;
+  std::string buf(std::min<uint64_t>(size, 1024 * 1024), '\0');
+  while (size > 0) {
+    size_t batchSize = std::min<uint64_t>(size, buf.size());
+    myfile.read(&buf[0], batchSize);
+    if (!myfile) {
+      return {ErrorCodes::ERR_INTERNAL, "read file:" + fileName + " failed"};
+    }
+    crc = rocksdb::crc32c::Extend(crc, buf.data(), batchSize);
+    size -= batchSize;
+  }
+  return crc;
+}
+
+bool isSstFile(const std::string& fileName) {
+  static const std::string suffix = ".sst";
+  return fileName.size() > suffix.size() &&
+    fileName.compare(fileName.size() - suffix.size(), suffix.size(), suffix) ==
+    0;
+}
+
+Status verifySstFile(const std::string& fileName) {
+  auto s = rocksdb::VerifySstFileChecksum(
+    rocksdb::Options(), rocksdb::EnvOptions(), fileName);
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL,
+            "verify " + fileName + " failed:" + s.ToString()};
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 }  // namespace tendisplus
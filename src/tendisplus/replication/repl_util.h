@@ -7,9 +7,12 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 #include "tendisplus/cluster/cluster_manager.h"
 #include "tendisplus/network/blocking_tcp_client.h"
+#include "tendisplus/network/worker_pool.h"
 #include "tendisplus/server/server_entry.h"
+#include "tendisplus/utils/compression.h"
 
 namespace tendisplus {
 
@@ -48,6 +51,7 @@ Expected<BinlogResult> masterSendBinlogV2(
   uint32_t dstStoreId,
   uint64_t binlogPos,
   bool needHeartBeart,
+  Codec codec,
   std::shared_ptr<ServerEntry> svr,
   const std::shared_ptr<ServerParams> cfg);
 
@@ -58,6 +62,29 @@ Expected<BinlogResult> applySingleTxnV2(Session* sess,
                                         const std::string& logValue,
                                         BinlogApplyMode mode);
 
+// NOTE: applyTxnsInLanesV2 applies a batch of binlogs from the master in
+// lanes, rather than one commit per binlog. The ops are partitioned by the
+// chunk of the key, or by the hash of the key out of the chunks, so the
+// lanes never write the same key and the ops of a key keep their order.
+// The lanes of the ops of one binlog, e.g. the keys of a RENAME, or the
+// meta and the GCIndex of a key deleted lazily, are merged into one.
+// Each lane applies its ops in one txn, and the lanes commit in parallel
+// on pool. The binlogs are stored by one more txn after all the lanes have
+// committed, which moves the binlog position of the store. If any of them
+// fails, or the server crashes in between, the position isn't moved and
+// the batch is applied again, which is fine as the ops are the puts and
+// deletes of the keys in order.
+// A batch having other ops, like deleting a range, is applied by
+// applySingleTxnV2() one binlog at a time, as it is if lanes is 1.
+Expected<BinlogResult> applyTxnsInLanesV2(Session* sess,
+                                          uint32_t storeId,
+                                          const std::vector<ReplLogRawV2>& logs,
+                                          WorkerPool* pool,
+                                          uint32_t lanes);
+
+// the lane of the op of key, of the lanes
+uint32_t binlogLaneOf(const std::string& key, uint32_t lanes);
+
 Status sendWriter(BinlogWriter* writer,
                   BlockingTcpClient*,
                   uint32_t dstStoreId,
@@ -81,6 +108,16 @@ Status SendSlotsBinlog(BlockingTcpClient*,
                        bool* needRetry,
                        uint64_t* binlogTimeStamp);
 
+// the crc32c of the first size bytes of the file, to check the files sent
+// by fullsync
+Expected<uint32_t> fileCrc32c(const std::string& fileName, uint64_t size);
+// NOTE: an SST file sent by fullsync is checked by the checksums of its
+// blocks rather than crc32c, so the master sends it without reading it
+// once more. The other files of a backup are small.
+bool isSstFile(const std::string& fileName);
+// verify the checksums of all the blocks of the SST file
+Status verifySstFile(const std::string& fileName);
+
 }  // namespace tendisplus
 
 #endif  // SRC_TENDISPLUS_REPLICATION_REPL_UTIL_H_
@@ -4,20 +4,25 @@
 
 #include <algorithm>
 #include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
 #include <fstream>
 #include <limits>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <set>
 #include <string>
+#include <thread>  // NOLINT
 #include <utility>
+#include <vector>
 
 #include "glog/logging.h"
 #include "rapidjson/document.h"
 #include "rapidjson/error/en.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
+#include "util/crc32c.h"
 
 #include "tendisplus/commands/command.h"
 #include "tendisplus/lock/lock.h"
@@ -34,9 +39,13 @@ namespace tendisplus {
 Expected<BackupInfo> getBackupInfo(BlockingTcpClient* client,
                                    const StoreMeta& metaSnapshot,
                                    const string& ip,
-                                   uint16_t port) {
+                                   uint16_t port,
+                                   uint32_t streams) {
   std::stringstream ss;
   ss << "FULLSYNC " << metaSnapshot.syncFromId << " " << ip << " " << port;
+  if (streams > 1) {
+    ss << " " << streams;
+  }
   Status s = client->writeLine(ss.str());
   if (!s.ok()) {
     LOG(WARNING) << "fullSync master failed:" << s.toString();
@@ -96,6 +105,9 @@ Expected<BackupInfo> getBackupInfo(BlockingTcpClient* client,
 //     read content
 //     send +OK
 // send +OK
+//
+// With fullSyncStreams more than 1, the files are pulled over so many
+// connections instead, see slaveFetchFiles()
 void ReplManager::slaveStartFullsync(const StoreMeta& metaSnapshot) {
   LOG(INFO) << "store:" << metaSnapshot.id << " fullsync start";
 
@@ -173,10 +185,12 @@ void ReplManager::slaveStartFullsync(const StoreMeta& metaSnapshot) {
 
   // 4) read backupinfo from master
   // get binlogPos and filelist, other messages get from "backup_meta" file
+  uint32_t streams = _cfg->fullSyncStreams;
   auto ebkInfo = getBackupInfo(client.get(),
                                metaSnapshot,
                                _svr->getParams()->bindIp,
-                               _svr->getParams()->port);
+                               _svr->getParams()->port,
+                               streams);
   if (!ebkInfo.ok()) {
     LOG(WARNING) << "storeId:" << metaSnapshot.id
                  << ",syncMaster:" << metaSnapshot.syncFromHost << ":"
@@ -205,6 +219,19 @@ void ReplManager::slaveStartFullsync(const StoreMeta& metaSnapshot) {
   auto flist = ebkInfo.value().getFileList();
 
   std::set<std::string> finishedFiles;
+  if (streams > 1) {
+    Status s = slaveFetchFiles(metaSnapshot,
+                               client.get(),
+                               store->dftBackupDir(),
+                               flist,
+                               streams,
+                               &finishedFiles);
+    if (!s.ok()) {
+      LOG(WARNING) << "store:" << metaSnapshot.id
+                   << " fullsync fetch files failed:" << s.toString();
+      return;
+    }
+  }
   while (true) {
     if (finishedFiles.size() == flist.size()) {
       break;
@@ -323,6 +350,176 @@ void ReplManager::slaveStartFullsync(const StoreMeta& metaSnapshot) {
             << ",restart binlogId:" << restartStatus.value();
 }
 
+// each of the streams is a fullsyncfile connection, see
+// ReplManager::supplyFullSyncFileRoutine(). The files are taken from a
+// queue shared by the streams, and a file failed in a stream goes back to
+// the queue. A stream reconnects after a failure, and gives up after
+// several failures in a row, which fails the fullsync.
+Status ReplManager::slaveFetchFiles(
+  const StoreMeta& metaSnapshot,
+  BlockingTcpClient* client,
+  const std::string& backupDir,
+  const std::map<std::string, uint64_t>& flist,
+  uint32_t streams,
+  std::set<std::string>* finishedFiles) {
+  constexpr uint32_t MAX_STREAM_RETRY = 3;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::list<std::string> pending;
+  for (const auto& kv : flist) {
+    if (finishedFiles->count(kv.first) == 0) {
+      pending.push_back(kv.first);
+    }
+  }
+  uint32_t running = streams;
+  Status status = {ErrorCodes::ERR_OK, ""};
+
+  size_t fileBatch = (_cfg->binlogRateLimitMB * 1024 * 1024) / 10;
+  auto fetchFile = [&backupDir, &flist, fileBatch](
+                     BlockingTcpClient* stream,
+                     const std::string& fileName) -> Status {
+    Status s = stream->writeLine(fileName);
+    if (!s.ok()) {
+      return s;
+    }
+    auto expCrc = stream->readLine(std::chrono::seconds(100));
+    if (!expCrc.ok()) {
+      return expCrc.status();
+    } else if (expCrc.value().size() == 0 || expCrc.value()[0] != '+') {
+      return {ErrorCodes::ERR_INTERNAL, expCrc.value()};
+    }
+    // an SST file is verified by the checksums of its blocks
+    bool isSst = expCrc.value() == "+";
+    uint64_t crc = 0;
+    if (!isSst) {
+      auto eCrc = ::tendisplus::stoul(expCrc.value().substr(1));
+      if (!eCrc.ok()) {
+        return eCrc.status();
+      }
+      crc = eCrc.value();
+    }
+
+    std::string fullFileName = backupDir + "/" + fileName;
+    std::error_code ec;
+    filesystem::create_directories(
+      filesystem::path(fullFileName).remove_filename(), ec);
+    if (ec) {
+      return {ErrorCodes::ERR_INTERNAL, ec.message()};
+    }
+    auto myfile = std::fstream(fullFileName, std::ios::out | std::ios::binary);
+    if (!myfile.is_open()) {
+      return {ErrorCodes::ERR_INTERNAL, "open " + fullFileName + " failed"};
+    }
+    uint32_t fileCrc = 0;
+    size_t remain = flist.at(fileName);
+    while (remain) {
+      size_t batchSize = std::min(remain, fileBatch);
+      remain -= batchSize;
+      Expected<std::string> exptData =
+        stream->read(batchSize, std::chrono::seconds(100));
+      if (!exptData.ok()) {
+        return exptData.status();
+      }
+      const std::string& data = exptData.value();
+      myfile.write(data.c_str(), data.size());
+      if (myfile.bad()) {
+        return {ErrorCodes::ERR_INTERNAL,
+                "write " + fullFileName + " failed:" + strerror(errno)};
+      }
+      if (!isSst) {
+        fileCrc = rocksdb::crc32c::Extend(fileCrc, data.c_str(), data.size());
+      }
+    }
+    if (isSst) {
+      myfile.close();
+      return verifySstFile(fullFileName);
+    }
+    if (fileCrc != crc) {
+      return {ErrorCodes::ERR_INTERNAL, "checksum mismatch " + fileName};
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  };
+
+  auto fetchFiles = [&, this]() {
+    std::shared_ptr<BlockingTcpClient> stream;
+    uint32_t failures = 0;
+    std::unique_lock<std::mutex> lk(mutex);
+    while (status.ok() && !pending.empty()) {
+      std::string fileName = pending.front();
+      pending.pop_front();
+      lk.unlock();
+
+      Status s = {ErrorCodes::ERR_OK, ""};
+      if (stream == nullptr) {
+        stream = createClient(metaSnapshot, _connectMasterTimeoutMs);
+        if (stream == nullptr) {
+          s = {ErrorCodes::ERR_NETWORK, "connect master failed"};
+        } else {
+          std::stringstream ss;
+          ss << "FULLSYNCFILE " << metaSnapshot.syncFromId << " "
+             << _svr->getParams()->bindIp << " " << _svr->getParams()->port;
+          s = stream->writeLine(ss.str());
+          auto reply = stream->readLine(std::chrono::seconds(10));
+          if (s.ok() && (!reply.ok() || reply.value() != "+OK")) {
+            s = {ErrorCodes::ERR_NETWORK,
+                 reply.ok() ? reply.value() : reply.status().toString()};
+          }
+        }
+      }
+      if (s.ok()) {
+        s = fetchFile(stream.get(), fileName);
+      }
+
+      lk.lock();
+      if (s.ok()) {
+        LOG(INFO) << "fullsync file:" << fileName << " transfer done";
+        finishedFiles->insert(fileName);
+        failures = 0;
+      } else {
+        LOG(WARNING) << "fullsync file:" << fileName
+                     << " transfer failed:" << s.toString();
+        stream.reset();
+        pending.push_front(fileName);
+        if (++failures >= MAX_STREAM_RETRY) {
+          status = s;
+        }
+      }
+    }
+    --running;
+    cv.notify_all();
+    lk.unlock();
+    if (stream != nullptr) {
+      stream->writeLine("+OK");
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < streams; ++i) {
+    threads.emplace_back(fetchFiles);
+  }
+  {
+    // tell the master the slave is still alive
+    std::unique_lock<std::mutex> lk(mutex);
+    while (!cv.wait_for(
+      lk, std::chrono::seconds(1), [&running] { return running == 0; })) {
+      lk.unlock();
+      Status s = client->writeLine("+PING");
+      lk.lock();
+      if (!s.ok()) {
+        status = s;
+      }
+    }
+  }
+  for (auto& thd : threads) {
+    thd.join();
+  }
+  if (!status.ok()) {
+    return status;
+  }
+  INVARIANT_D(finishedFiles->size() == flist.size());
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 void ReplManager::slaveChkSyncStatus(const StoreMeta& metaSnapshot) {
   bool reconn = [this, &metaSnapshot] {
     std::lock_guard<std::mutex> lk(_mutex);
@@ -369,6 +566,12 @@ void ReplManager::slaveChkSyncStatus(const StoreMeta& metaSnapshot) {
   std::stringstream ss;
   ss << "INCRSYNC " << metaSnapshot.syncFromId << ' ' << metaSnapshot.id << ' '
      << metaSnapshot.binlogId << ' ' << _cfg->bindIp << ' ' << _cfg->port;
+  // the masters not knowing the codecs reject it, so it's asked for only
+  // if incrsync-compress-type is set
+  std::string codecs = _cfg->incrSyncCompressType;
+  if (codecs != "none") {
+    ss << ' ' << codecs;
+  }
   auto status = client->writeLine(ss.str());
   if (!status.ok()) {
     errStr =
@@ -385,6 +588,9 @@ void ReplManager::slaveChkSyncStatus(const StoreMeta& metaSnapshot) {
     errStr = errPrefix + "incrsync master bad return:" + s.value();
     return;
   }
+  // +OK [codec]
+  auto reply = stringSplit(s.value(), " ");
+  std::string codec = reply.size() > 1 ? reply[1] : "none";
 
   Status pongStatus = client->writeLine("+PONG");
   if (!pongStatus.ok()) {
@@ -432,7 +638,7 @@ void ReplManager::slaveChkSyncStatus(const StoreMeta& metaSnapshot) {
 
   LOG(INFO) << "store:" << metaSnapshot.id
             << ",binlogId:" << metaSnapshot.binlogId << " psync master succ."
-            << "session id: " << sessionId << ";";
+            << "session id: " << sessionId << ";codec:" << codec << ";";
 }
 
 void ReplManager::slaveSyncRoutine(uint32_t storeId) {
@@ -473,11 +679,10 @@ void ReplManager::slaveSyncRoutine(uint32_t storeId) {
   }
 }
 
-// if logKey == "", it means binlog_heartbeat
-Status ReplManager::applyRepllogV2(Session* sess,
-                                   uint32_t storeId,
-                                   const std::string& logKey,
-                                   const std::string& logValue) {
+Status ReplManager::applyAsSyncSession(
+  Session* sess,
+  uint32_t storeId,
+  const std::function<Expected<uint64_t>()>& apply) {
   [this, storeId]() {
     std::unique_lock<std::mutex> lk(_mutex);
     _cv.wait(lk, [this, storeId] { return !_syncStatus[storeId]->isRunning; });
@@ -506,37 +711,62 @@ Status ReplManager::applyRepllogV2(Session* sess,
     return {ErrorCodes::ERR_NOTFOUND, "sessionId not match"};
   }
 
-  if (logKey == "") {
-    // binlog_heartbeat
-    auto ets = tendisplus::stoull(logValue);
-    INVARIANT_D(ets.ok());
-    binlogTs = ets.value();
-    if (binlogTs == 0) {
-      /* If binlogTs == 0, it means the binlog_heartbeat generated by old
-       * tendisplus version before 2.0.6 */
-      binlogTs = msSinceEpoch();
+  auto ets = apply();
+  if (!ets.ok()) {
+    return ets.status();
+  }
+  binlogTs = ets.value();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+// if logKey == "", it means binlog_heartbeat
+Status ReplManager::applyRepllogV2(Session* sess,
+                                   uint32_t storeId,
+                                   const std::string& logKey,
+                                   const std::string& logValue) {
+  return applyAsSyncSession(sess, storeId, [&]() -> Expected<uint64_t> {
+    if (logKey == "") {
+      // binlog_heartbeat
+      auto ets = tendisplus::stoull(logValue);
+      INVARIANT_D(ets.ok());
+      uint64_t binlogTs = ets.value();
+      if (binlogTs == 0) {
+        /* If binlogTs == 0, it means the binlog_heartbeat generated by old
+         * tendisplus version before 2.0.6 */
+        binlogTs = msSinceEpoch();
+      }
+      return binlogTs;
     }
-  } else {
-    auto binlog = applySingleTxnV2(sess,
-                                   storeId,
-                                   logKey,
-                                   logValue,
-                                   BinlogApplyMode::KEEP_BINLOG_ID);
+    auto binlog = applySingleTxnV2(
+      sess, storeId, logKey, logValue, BinlogApplyMode::KEEP_BINLOG_ID);
     if (!binlog.ok()) {
       return binlog.status();
-    } else {
-      std::lock_guard<std::mutex> lk(_mutex);
-      // NOTE(vinchen): store the binlogId without changeReplState()
-      // If it's shutdown, we can get the largest binlogId from rocksdb.
-      _syncMeta[storeId]->binlogId = binlog.value().binlogId;
-      binlogTs = binlog.value().binlogTs;
     }
-  }
-  return {ErrorCodes::ERR_OK, ""};
+    std::lock_guard<std::mutex> lk(_mutex);
+    // NOTE(vinchen): store the binlogId without changeReplState()
+    // If it's shutdown, we can get the largest binlogId from rocksdb.
+    _syncMeta[storeId]->binlogId = binlog.value().binlogId;
+    return binlog.value().binlogTs;
+  });
+}
+
+Status ReplManager::applyRepllogsV2(Session* sess,
+                                    uint32_t storeId,
+                                    const std::vector<ReplLogRawV2>& logs) {
+  return applyAsSyncSession(sess, storeId, [&]() -> Expected<uint64_t> {
+    auto binlog = applyTxnsInLanesV2(
+      sess, storeId, logs, _binlogApplier.get(), _cfg->binlogApplyLanes);
+    if (!binlog.ok()) {
+      return binlog.status();
+    }
+    std::lock_guard<std::mutex> lk(_mutex);
+    _syncMeta[storeId]->binlogId = binlog.value().binlogId;
+    return binlog.value().binlogTs;
+  });
 }
 
-std::ofstream* ReplManager::getCurBinlogFs(uint32_t storeId) {
-  std::ofstream* fs = nullptr;
+BinlogFileWriter* ReplManager::getCurBinlogFs(uint32_t storeId) {
+  BinlogFileWriter* fs = nullptr;
   uint32_t currentId = 0;
   uint64_t ts = 0;
   {
@@ -568,14 +798,18 @@ std::ofstream* ReplManager::getCurBinlogFs(uint32_t storeId) {
              currentId + 1,
              tbuf);
 
-    fs = KVStore::createBinlogFile(fname, storeId);
-    if (!fs) {
-      return fs;
+    // the codec is checked by the params
+    auto codec = codecFromName(_cfg->binlogFileCompressType).value();
+    auto eFs = BinlogFileWriter::create(fname, storeId, codec);
+    if (!eFs.ok()) {
+      LOG(ERROR) << "create binlog file failed:" << eFs.status().toString();
+      return nullptr;
     }
+    fs = eFs.value().get();
 
     std::unique_lock<std::mutex> lk(_mutex);
     auto& v = _logRecycStatus[storeId];
-    v->fs.reset(fs);
+    v->fs = std::move(eFs.value());
     v->fileSeq = currentId + 1;
     v->fileCreateTime = SCLOCK::now();
     v->fileSize = BINLOG_HEADER_V2_LEN;
@@ -620,7 +854,10 @@ void ReplManager::updateCurBinlogFs(uint32_t storeId,
         SCLOCK::now() ||
       changeNewFile || v->needNewFile) {
     if (v->fs) {
-      v->fs->close();
+      auto s = v->fs->close();
+      if (!s.ok()) {
+        LOG(ERROR) << "store:" << storeId << " " << s.toString();
+      }
       v->fs.reset();
     }
     if (ts) {
@@ -105,6 +105,22 @@ Status IndexManager::scanExpiredKeysJob(uint32_t storeId) {
     return {ErrorCodes::ERR_OK, ""};
   }
 
+  // the expired strings found by the compaction filter go first, they
+  // may have no ttl index if they are written by an old version
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    auto& keys = _expiredKeys[storeId];
+    if (keys.size() < _scanBatch) {
+      auto expired =
+        store->getKeyCounter()->takeExpired(_scanBatch - keys.size());
+      _totalEnqueue += expired.size();
+      keys.splice(keys.end(), expired);
+    }
+    if (keys.size() >= _scanBatch) {
+      return {ErrorCodes::ERR_OK, ""};
+    }
+  }
+
   auto ptxn = store->createTransaction(sg.getSession());
   if (!ptxn.ok()) {
     return ptxn.status();
@@ -225,8 +225,8 @@ TEST(IndexManager, scanIndexAfterExpire) {
 
   server->stop();
 
-  ASSERT_EQ(totalDequeue, 2048 * 4 * 4u);
-  ASSERT_EQ(totalEnqueue, 2048 * 4 * 4u);
+  ASSERT_EQ(totalDequeue, 2048 * 4 * 5u);
+  ASSERT_EQ(totalEnqueue, 2048 * 4 * 5u);
 
   ASSERT_EQ(server.use_count(), 1);
 
@@ -253,8 +253,8 @@ TEST(IndexManager, scanIndexWhileExpire) {
 
   server->stop();
 
-  ASSERT_EQ(totalDequeue, 2048 * 4 * 4u);
-  ASSERT_EQ(totalEnqueue, 2048 * 4 * 4u);
+  ASSERT_EQ(totalDequeue, 2048 * 4 * 5u);
+  ASSERT_EQ(totalEnqueue, 2048 * 4 * 5u);
 
   ASSERT_EQ(server.use_count(), 1);
 
@@ -297,8 +297,8 @@ TEST(IndexManager, singleJobRunning) {
 
   server->stop();
 
-  ASSERT_EQ(totalEnqueue, 2048 * 4 * 4u);
-  ASSERT_EQ(totalDequeue, 2048 * 4 * 4u);
+  ASSERT_EQ(totalEnqueue, 2048 * 4 * 5u);
+  ASSERT_EQ(totalDequeue, 2048 * 4 * 5u);
 
   ASSERT_EQ(server.use_count(), 1);
 
@@ -0,0 +1,528 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include "glog/logging.h"
+#include "tendisplus/server/key_sampler.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/string.h"
+#include "tendisplus/utils/time.h"
+
+namespace tendisplus {
+
+static_assert((HotKeySampler::SKETCH_WIDTH &
+               (HotKeySampler::SKETCH_WIDTH - 1)) == 0,
+              "the width of the sketch should be a power of 2");
+
+TopK::TopK(size_t k) : _k(k) {}
+
+void TopK::offer(const std::string& item, uint64_t weight) {
+  auto it = _weights.find(item);
+  if (it != _weights.end()) {
+    _order.erase({it->second, item});
+    it->second = weight;
+    _order.emplace(weight, item);
+    return;
+  }
+  if (_weights.size() >= _k) {
+    auto lightest = _order.begin();
+    if (lightest->first >= weight) {
+      return;
+    }
+    _weights.erase(lightest->second);
+    _order.erase(lightest);
+  }
+  _weights.emplace(item, weight);
+  _order.emplace(weight, item);
+}
+
+uint64_t TopK::minWeight() const {
+  if (_weights.size() < _k || _order.empty()) {
+    return 0;
+  }
+  return _order.begin()->first;
+}
+
+std::vector<std::pair<std::string, uint64_t>> TopK::list() const {
+  std::vector<std::pair<std::string, uint64_t>> result;
+  result.reserve(_order.size());
+  for (auto it = _order.rbegin(); it != _order.rend(); ++it) {
+    result.emplace_back(it->second, it->first);
+  }
+  return result;
+}
+
+void TopK::halve() {
+  std::set<std::pair<uint64_t, std::string>> order;
+  for (auto it = _weights.begin(); it != _weights.end();) {
+    it->second >>= 1;
+    if (it->second == 0) {
+      it = _weights.erase(it);
+    } else {
+      order.emplace(it->second, it->first);
+      ++it;
+    }
+  }
+  _order = std::move(order);
+}
+
+void TopK::clear() {
+  _weights.clear();
+  _order.clear();
+}
+
+// the item of a key in the TopKs, dbId:key
+static std::string hotKeyItem(uint32_t dbId, const std::string& key) {
+  return std::to_string(dbId) + ":" + key;
+}
+
+static std::pair<uint32_t, std::string> parseHotKeyItem(
+  const std::string& item) {
+  auto pos = item.find(':');
+  INVARIANT_D(pos != std::string::npos);
+  return {static_cast<uint32_t>(std::stoul(item.substr(0, pos))),
+          item.substr(pos + 1)};
+}
+
+HotKeySampler::HotKeySampler(const std::shared_ptr<ServerParams>& cfg)
+  : _cfg(cfg), _sketch(SKETCH_DEPTH * SKETCH_WIDTH, 0), _total(TOPK) {}
+
+bool HotKeySampler::shouldSample() {
+  uint32_t rate = _cfg->hotkeySampleRate;
+  if (rate == 0) {
+    return false;
+  }
+  // per thread, so that the workers don't contend for it
+  static thread_local uint64_t commands = 0;
+  return ++commands % rate == 0;
+}
+
+uint64_t HotKeySampler::countInLock(const std::string& item) {
+  uint64_t h = std::hash<std::string>()(item);
+  uint64_t result = UINT64_MAX;
+  for (size_t i = 0; i < SKETCH_DEPTH; ++i) {
+    uint64_t mixed = (h + i) * 0x9E3779B97F4A7C15ULL;
+    size_t pos = i * SKETCH_WIDTH + ((mixed >> 32) & (SKETCH_WIDTH - 1));
+    if (_sketch[pos] < UINT32_MAX) {
+      _sketch[pos]++;
+    }
+    result = std::min<uint64_t>(result, _sketch[pos]);
+  }
+  return result;
+}
+
+void HotKeySampler::sample(const std::string& cmd,
+                           uint32_t dbId,
+                           const std::string& key) {
+  std::string item = hotKeyItem(dbId, key);
+  std::lock_guard<std::mutex> lk(_mutex);
+  sampled.fetch_add(1, std::memory_order_relaxed);
+  _total.offer(item, countInLock(item));
+  uint64_t count = countInLock(cmd + '\0' + item);
+  auto it = _cmds.find(cmd);
+  if (it == _cmds.end()) {
+    it = _cmds.emplace(cmd, TopK(TOPK)).first;
+  }
+  it->second.offer(item, count);
+}
+
+std::vector<HotKeySampler::HotKey> HotKeySampler::hotKeys(
+  const std::string& cmd, size_t n) const {
+  std::vector<std::pair<std::string, uint64_t>> items;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    if (cmd.empty()) {
+      items = _total.list();
+    } else {
+      auto it = _cmds.find(cmd);
+      if (it != _cmds.end()) {
+        items = it->second.list();
+      }
+    }
+  }
+  uint64_t rate = std::max(_cfg->hotkeySampleRate, 1U);
+  std::vector<HotKey> result;
+  for (const auto& v : items) {
+    if (result.size() >= n) {
+      break;
+    }
+    auto dbKey = parseHotKeyItem(v.first);
+    result.push_back({dbKey.first, std::move(dbKey.second), v.second * rate});
+  }
+  return result;
+}
+
+void HotKeySampler::decay() {
+  std::lock_guard<std::mutex> lk(_mutex);
+  for (auto& v : _sketch) {
+    v >>= 1;
+  }
+  _total.halve();
+  for (auto it = _cmds.begin(); it != _cmds.end();) {
+    it->second.halve();
+    if (it->second.size() == 0) {
+      // the command is not run for a while
+      it = _cmds.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void HotKeySampler::clear() {
+  std::lock_guard<std::mutex> lk(_mutex);
+  std::fill(_sketch.begin(), _sketch.end(), 0);
+  _total.clear();
+  _cmds.clear();
+  sampled.store(0, std::memory_order_relaxed);
+}
+
+void HotKeySampler::appendJSONStat(
+  rapidjson::PrettyWriter<rapidjson::StringBuffer>& w,
+  const std::string& cmd,
+  size_t n) const {
+  w.Key("sample_rate");
+  w.Uint64(_cfg->hotkeySampleRate);
+  w.Key("sampled");
+  w.Uint64(sampled.load(std::memory_order_relaxed));
+  w.Key("command");
+  w.String(cmd.empty() ? "all" : cmd);
+  w.Key("keys");
+  w.StartArray();
+  for (const auto& v : hotKeys(cmd, n)) {
+    w.StartObject();
+    w.Key("db");
+    w.Uint64(v.dbId);
+    w.Key("key");
+    w.String(v.key);
+    w.Key("count");
+    w.Uint64(v.count);
+    w.EndObject();
+  }
+  w.EndArray();
+}
+
+BigKeySampler::BigKeySampler(const std::shared_ptr<ServerParams>& cfg,
+                             uint32_t storeCount)
+  : _cfg(cfg), _stores(storeCount) {}
+
+// the bytes of the records of prefix, estimated by the first SIZE_SAMPLES
+// records of it
+static Expected<uint64_t> sampleBytes(const std::string& prefix,
+                                      uint64_t records,
+                                      Transaction* txn) {
+  if (records == 0) {
+    return 0;
+  }
+  auto cursor = txn->createPkCursor(prefix);
+  uint64_t bytes = 0;
+  uint64_t n = 0;
+  while (n < BigKeySampler::SIZE_SAMPLES) {
+    auto eKey = cursor->key();
+    if (eKey.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    RET_IF_ERR_EXPECTED(eKey);
+    if (eKey.value().compare(0, prefix.size(), prefix) != 0) {
+      break;
+    }
+    auto eRcd = cursor->next();
+    RET_IF_ERR_EXPECTED(eRcd);
+    bytes += eKey.value().size() +
+      eRcd.value().getRecordValue().encode().size();
+    n++;
+  }
+  if (n == 0) {
+    return 0;
+  }
+  return bytes / n * records;
+}
+
+Expected<BigKeySampler::BigKey> BigKeySampler::sizeKey(const Record& meta,
+                                                      Transaction* txn) {
+  const RecordKey& mk = meta.getRecordKey();
+  const RecordValue& rv = meta.getRecordValue();
+  BigKey result = {
+    mk.getDbId(), mk.getPrimaryKey(), rv.getRecordType(), 0, 0};
+  result.bytes = mk.getPrimaryKey().size() + rv.getValue().size();
+  auto prefixOf = [&mk, &rv](RecordType type) {
+    return RecordKey(mk.getChunkId(),
+                     mk.getDbId(),
+                     type,
+                     mk.getPrimaryKey(),
+                     "",
+                     rv.getVersion())
+      .prefixPk();
+  };
+  // the element records of the type, unless the elements are packed
+  RecordType eleType = RecordType::RT_INVALID;
+  uint64_t records = 0;
+  switch (rv.getRecordType()) {
+    case RecordType::RT_KV:
+      result.elements = 1;
+      if (rv.isPieced()) {
+        result.bytes += rv.getTotalSize();
+      }
+      break;
+    case RecordType::RT_HASH_META: {
+      auto eMeta = HashMetaValue::decode(rv.getValue());
+      RET_IF_ERR_EXPECTED(eMeta);
+      result.elements = eMeta.value().getCount();
+      if (!eMeta.value().getListPack()) {
+        eleType = RecordType::RT_HASH_ELE;
+        records = result.elements;
+      }
+      break;
+    }
+    case RecordType::RT_SET_META: {
+      auto eMeta = SetMetaValue::decode(rv.getValue());
+      RET_IF_ERR_EXPECTED(eMeta);
+      result.elements = eMeta.value().getCount();
+      if (!eMeta.value().getListPack()) {
+        eleType = RecordType::RT_SET_ELE;
+        records = result.elements;
+      }
+      break;
+    }
+    case RecordType::RT_ZSET_META: {
+      auto eMeta = ZSlMetaValue::decode(rv.getValue());
+      RET_IF_ERR_EXPECTED(eMeta);
+      // the count includes the head
+      result.elements = eMeta.value().getCount() - 1;
+      if (!eMeta.value().getListPack()) {
+        eleType = RecordType::RT_ZSET_H_ELE;
+        records = result.elements;
+        // and the skiplist nodes, the head included
+        auto eBytes = sampleBytes(prefixOf(RecordType::RT_ZSET_S_ELE),
+                                  eMeta.value().getCount(),
+                                  txn);
+        RET_IF_ERR_EXPECTED(eBytes);
+        result.bytes += eBytes.value();
+      }
+      break;
+    }
+    case RecordType::RT_LIST_META: {
+      auto eMeta = ListMetaValue::decode(rv.getValue());
+      RET_IF_ERR_EXPECTED(eMeta);
+      result.elements = eMeta.value().getTail() - eMeta.value().getHead();
+      if (eMeta.value().isChunked()) {
+        // the records of the node index are small, and they follow the
+        // nodes, see QuickList
+        eleType = RecordType::RT_LIST_NODE;
+        records = eMeta.value().getNodeCount();
+      } else {
+        eleType = RecordType::RT_LIST_ELE;
+        records = result.elements;
+      }
+      break;
+    }
+    default:
+      return {ErrorCodes::ERR_DECODE,
+              "invalid meta type:" + rt2Str(rv.getRecordType())};
+  }
+  if (eleType != RecordType::RT_INVALID) {
+    auto eBytes = sampleBytes(prefixOf(eleType), records, txn);
+    RET_IF_ERR_EXPECTED(eBytes);
+    result.bytes += eBytes.value();
+  }
+  return result;
+}
+
+// drop the sizes of the keys not kept by the TopKs
+template <typename StoreState>
+static void pruneSizes(StoreState* st) {
+  for (auto it = st->sizes.begin(); it != st->sizes.end();) {
+    bool kept = false;
+    for (auto topks : {&st->found, &st->building}) {
+      auto t = topks->find(it->second.type);
+      if (t != topks->end() && t->second.contains(it->first)) {
+        kept = true;
+        break;
+      }
+    }
+    if (kept) {
+      ++it;
+    } else {
+      it = st->sizes.erase(it);
+    }
+  }
+}
+
+Expected<uint64_t> BigKeySampler::sizeStore(uint32_t storeId,
+                                            KVStore* store,
+                                            uint64_t limit) {
+  if (storeId >= _stores.size()) {
+    return {ErrorCodes::ERR_INTERNAL, "invalid store id"};
+  }
+  std::string next;
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    next = _stores[storeId].next;
+  }
+  auto ptxn = store->createTransaction(nullptr);
+  RET_IF_ERR_EXPECTED(ptxn);
+  Transaction* txn = ptxn.value().get();
+  auto cursor = txn->createDataCursor();
+  const uint8_t metaType = rt2Char(RecordType::RT_DATA_META);
+  auto metasOf = [](uint32_t chunkId) {
+    return RecordKey(chunkId, 0, RecordType::RT_DATA_META, "", "")
+      .prefixSlotType();
+  };
+  cursor->seek(next.empty() ? metasOf(0) : next);
+
+  std::vector<std::pair<std::string, BigKey>> keys;
+  uint64_t count = 0;
+  bool done = false;
+  uint64_t now = msSinceEpoch();
+  while (true) {
+    auto eKey = cursor->key();
+    if (eKey.status().code() == ErrorCodes::ERR_EXHAUST) {
+      done = true;
+      break;
+    }
+    RET_IF_ERR_EXPECTED(eKey);
+    const std::string& key = eKey.value();
+    if (key.size() <= RecordKey::getHdrSize()) {
+      done = true;
+      break;
+    }
+    uint32_t chunkId = RecordKey::decodeChunkId(key);
+    if (chunkId >= CLUSTER_SLOTS) {
+      done = true;
+      break;
+    }
+    uint8_t type = key[RecordKey::TYPE_OFFSET];
+    if (type != metaType) {
+      // skip the other records of the chunk, the metas of a chunk are
+      // together
+      if (type < metaType) {
+        cursor->seek(metasOf(chunkId));
+      } else if (chunkId + 1 < CLUSTER_SLOTS) {
+        cursor->seek(metasOf(chunkId + 1));
+      } else {
+        done = true;
+        break;
+      }
+      continue;
+    }
+    if (count >= limit) {
+      next = key;
+      break;
+    }
+    auto eRcd = cursor->next();
+    RET_IF_ERR_EXPECTED(eRcd);
+    count++;
+    const RecordValue& rv = eRcd.value().getRecordValue();
+    if (rv.getTtl() != 0 && rv.getTtl() < now) {
+      continue;
+    }
+    auto eSize = sizeKey(eRcd.value(), txn);
+    if (!eSize.ok()) {
+      LOG(WARNING) << "size key failed:"
+                   << eRcd.value().getRecordKey().getPrimaryKey() << " "
+                   << eSize.status().toString();
+      continue;
+    }
+    keys.emplace_back(key, std::move(eSize.value()));
+  }
+  sized.fetch_add(count, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lk(_mutex);
+  auto& st = _stores[storeId];
+  for (auto& v : keys) {
+    auto it = st.building.find(v.second.type);
+    if (it == st.building.end()) {
+      it = st.building.emplace(v.second.type, TopK(TOPK)).first;
+    }
+    if (v.second.bytes > it->second.minWeight()) {
+      it->second.offer(v.first, v.second.bytes);
+      st.sizes[v.first] = std::move(v.second);
+    }
+  }
+  if (done) {
+    st.next.clear();
+    st.found = std::move(st.building);
+    st.building.clear();
+    pruneSizes(&st);
+    _scanned.insert(storeId);
+    if (_scanned.size() >= _stores.size()) {
+      rounds.fetch_add(1, std::memory_order_relaxed);
+      _scanned.clear();
+    }
+  } else {
+    st.next = std::move(next);
+    if (st.sizes.size() > TOPK * 64) {
+      pruneSizes(&st);
+    }
+  }
+  return count;
+}
+
+std::vector<BigKeySampler::BigKey> BigKeySampler::bigKeys(RecordType type,
+                                                         size_t n) const {
+  std::vector<BigKey> result;
+  std::lock_guard<std::mutex> lk(_mutex);
+  for (const auto& st : _stores) {
+    // the keys kept by either of the TopKs, sized lately
+    std::set<std::string> items;
+    for (auto topks : {&st.found, &st.building}) {
+      for (const auto& t : *topks) {
+        if (type != RecordType::RT_INVALID && t.first != type) {
+          continue;
+        }
+        for (const auto& v : t.second.list()) {
+          items.insert(v.first);
+        }
+      }
+    }
+    for (const auto& item : items) {
+      auto it = st.sizes.find(item);
+      if (it != st.sizes.end()) {
+        result.push_back(it->second);
+      }
+    }
+  }
+  std::sort(result.begin(),
+            result.end(),
+            [](const BigKey& a, const BigKey& b) { return a.bytes > b.bytes; });
+  if (result.size() > n) {
+    result.resize(n);
+  }
+  return result;
+}
+
+void BigKeySampler::appendJSONStat(
+  rapidjson::PrettyWriter<rapidjson::StringBuffer>& w,
+  RecordType type,
+  size_t n) const {
+  w.Key("scan_batch");
+  w.Uint64(_cfg->bigkeyScanBatch);
+  w.Key("sized");
+  w.Uint64(sized.load(std::memory_order_relaxed));
+  w.Key("rounds");
+  w.Uint64(rounds.load(std::memory_order_relaxed));
+  w.Key("type");
+  w.String(type == RecordType::RT_INVALID ? "all" : toLower(rt2Str(type)));
+  w.Key("keys");
+  w.StartArray();
+  for (const auto& v : bigKeys(type, n)) {
+    w.StartObject();
+    w.Key("db");
+    w.Uint64(v.dbId);
+    w.Key("key");
+    w.String(v.key);
+    w.Key("type");
+    w.String(toLower(rt2Str(v.type)));
+    w.Key("elements");
+    w.Uint64(v.elements);
+    w.Key("bytes");
+    w.Uint64(v.bytes);
+    w.EndObject();
+  }
+  w.EndArray();
+}
+
+}  // namespace tendisplus
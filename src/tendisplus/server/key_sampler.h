@@ -0,0 +1,168 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_SERVER_KEY_SAMPLER_H_
+#define SRC_TENDISPLUS_SERVER_KEY_SAMPLER_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "tendisplus/server/server_params.h"
+#include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/record.h"
+#include "tendisplus/utils/status.h"
+
+namespace tendisplus {
+
+// the k items of the biggest weights offered, the weight of an item kept
+// is updated by offering it again
+class TopK {
+ public:
+  explicit TopK(size_t k);
+  void offer(const std::string& item, uint64_t weight);
+  bool contains(const std::string& item) const {
+    return _weights.count(item) > 0;
+  }
+  // the weight an item must exceed to be kept, 0 if not full
+  uint64_t minWeight() const;
+  // the items in the descending order of the weights
+  std::vector<std::pair<std::string, uint64_t>> list() const;
+  // the items halved to 0 are dropped
+  void halve();
+  void clear();
+  size_t size() const {
+    return _weights.size();
+  }
+
+ private:
+  const size_t _k;
+  std::unordered_map<std::string, uint64_t> _weights;
+  // (weight, item), the lightest first
+  std::set<std::pair<uint64_t, std::string>> _order;
+};
+
+// NOTE: HotKeySampler finds the keys accessed most often, without tracking
+// all the keys. One in hotkey-sample-rate commands is sampled by
+// Command::runSessionCmd(), and its keys are counted in a count-min sketch
+// by the command and in total. A key whose estimate exceeds the lightest
+// of the top keys of the command, or of the top keys in total, replaces
+// it. The counts are halved every DECAY_INTERVAL_SEC by serverCron, so the
+// keys hot a while ago fade out.
+class HotKeySampler {
+ public:
+  struct HotKey {
+    uint32_t dbId;
+    std::string key;
+    // the estimated accesses, the sampled ones times the sample rate
+    uint64_t count;
+  };
+
+  explicit HotKeySampler(const std::shared_ptr<ServerParams>& cfg);
+  HotKeySampler(const HotKeySampler&) = delete;
+  HotKeySampler(HotKeySampler&&) = delete;
+  // whether the command run now should be sampled, it's cheap
+  bool shouldSample();
+  void sample(const std::string& cmd, uint32_t dbId, const std::string& key);
+  // the hot keys of cmd, or of all the commands if cmd is empty
+  std::vector<HotKey> hotKeys(const std::string& cmd, size_t n) const;
+  void decay();
+  void clear();
+  void appendJSONStat(rapidjson::PrettyWriter<rapidjson::StringBuffer>& w,
+                      const std::string& cmd,
+                      size_t n) const;
+
+  std::atomic<uint64_t> sampled{0};
+
+  static constexpr size_t TOPK = 50;
+  // the keys reported if the count is not given
+  static constexpr size_t DEFAULT_COUNT = 10;
+  static constexpr size_t SKETCH_DEPTH = 4;
+  static constexpr size_t SKETCH_WIDTH = 16384;
+  static constexpr uint64_t DECAY_INTERVAL_SEC = 10;
+
+ private:
+  uint64_t countInLock(const std::string& item);
+
+  const std::shared_ptr<ServerParams> _cfg;
+  mutable std::mutex _mutex;
+  std::vector<uint32_t> _sketch;
+  TopK _total;
+  // command -> the hot keys of it
+  std::map<std::string, TopK> _cmds;
+};
+
+// NOTE: BigKeySampler finds the biggest keys of the stores, by sizing the
+// meta records of a store bigkey-scan-batch at a time, from where the last
+// batch stopped, see ServerEntry::bigKeyCron(). The elements of a key come
+// from its meta, and its bytes are the meta and the elements, estimated by
+// the first SIZE_SAMPLES element records. A key found by the last full scan
+// of a store is reported until the next scan of the store completes, so
+// the keys deleted are forgotten after a scan.
+class BigKeySampler {
+ public:
+  struct BigKey {
+    uint32_t dbId;
+    std::string key;
+    RecordType type;
+    uint64_t elements;
+    uint64_t bytes;
+  };
+
+  BigKeySampler(const std::shared_ptr<ServerParams>& cfg, uint32_t storeCount);
+  BigKeySampler(const BigKeySampler&) = delete;
+  BigKeySampler(BigKeySampler&&) = delete;
+  // size the next limit metas of the store, from the one after the last
+  // sized, return the metas sized
+  Expected<uint64_t> sizeStore(uint32_t storeId,
+                               KVStore* store,
+                               uint64_t limit);
+  // the biggest keys in bytes of the type, or of all the types if type is
+  // RT_INVALID
+  std::vector<BigKey> bigKeys(RecordType type, size_t n) const;
+  // the elements and the bytes of the key of the meta
+  static Expected<BigKey> sizeKey(const Record& meta, Transaction* txn);
+  void appendJSONStat(rapidjson::PrettyWriter<rapidjson::StringBuffer>& w,
+                      RecordType type,
+                      size_t n) const;
+
+  std::atomic<uint64_t> sized{0};
+  // the full scans of all the stores completed
+  std::atomic<uint64_t> rounds{0};
+
+  // per type per store
+  static constexpr size_t TOPK = 20;
+  static constexpr size_t DEFAULT_COUNT = 10;
+  static constexpr size_t SIZE_SAMPLES = 4;
+
+ private:
+  struct StoreState {
+    // the key to size next, empty for the first meta of the store
+    std::string next;
+    // the keys of each type found by the last full scan and the running
+    // one, weighted by the bytes
+    std::map<RecordType, TopK> found;
+    std::map<RecordType, TopK> building;
+    // the sizes of the keys offered, by the encoded meta key, the ones
+    // not kept by the TopKs are dropped once in a while
+    std::unordered_map<std::string, BigKey> sizes;
+  };
+
+  const std::shared_ptr<ServerParams> _cfg;
+  mutable std::mutex _mutex;
+  std::vector<StoreState> _stores;
+  // the stores scanned fully in the running round
+  std::set<uint32_t> _scanned;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_SERVER_KEY_SAMPLER_H_
@@ -0,0 +1,201 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "tendisplus/server/key_sampler.h"
+#include "tendisplus/server/server_params.h"
+#include "tendisplus/storage/rocks/rocks_kvstore.h"
+#include "tendisplus/utils/portable.h"
+#include "tendisplus/utils/scopeguard.h"
+
+namespace tendisplus {
+
+TEST(TopK, Common) {
+  TopK topk(3);
+  EXPECT_EQ(topk.minWeight(), 0U);
+  topk.offer("a", 5);
+  topk.offer("b", 3);
+  topk.offer("c", 4);
+  EXPECT_EQ(topk.minWeight(), 3U);
+  // lighter than the lightest
+  topk.offer("d", 2);
+  EXPECT_FALSE(topk.contains("d"));
+  topk.offer("e", 6);
+  EXPECT_FALSE(topk.contains("b"));
+  // updated
+  topk.offer("a", 1);
+  auto list = topk.list();
+  EXPECT_EQ(list.size(), 3U);
+  EXPECT_EQ(list[0].first, "e");
+  EXPECT_EQ(list[1].first, "c");
+  EXPECT_EQ(list[2].first, "a");
+
+  topk.halve();
+  EXPECT_EQ(topk.size(), 2U);
+  EXPECT_FALSE(topk.contains("a"));
+  EXPECT_EQ(topk.list()[0].second, 3U);
+  topk.clear();
+  EXPECT_EQ(topk.size(), 0U);
+}
+
+TEST(HotKeySampler, Common) {
+  auto cfg = std::make_shared<ServerParams>();
+  cfg->hotkeySampleRate = 0;
+  HotKeySampler sampler(cfg);
+  EXPECT_FALSE(sampler.shouldSample());
+  cfg->hotkeySampleRate = 10;
+  uint32_t sampled = 0;
+  for (int i = 0; i < 100; ++i) {
+    sampled += sampler.shouldSample();
+  }
+  EXPECT_EQ(sampled, 10U);
+
+  // a hot key among many cold ones
+  for (int i = 0; i < 2000; ++i) {
+    sampler.sample("get", 0, "cold" + std::to_string(i));
+    if (i % 10 == 0) {
+      sampler.sample("get", 0, "hot");
+      sampler.sample("hget", 1, "hash");
+    }
+  }
+  EXPECT_EQ(sampler.sampled, 2400U);
+  auto hot = sampler.hotKeys("", 2);
+  EXPECT_EQ(hot.size(), 2U);
+  std::set<std::string> keys = {hot[0].key, hot[1].key};
+  EXPECT_EQ(keys, std::set<std::string>({"hot", "hash"}));
+  EXPECT_GE(hot[0].count, 200U * 10);
+  hot = sampler.hotKeys("hget", 10);
+  EXPECT_EQ(hot.size(), 1U);
+  EXPECT_EQ(hot[0].dbId, 1U);
+  EXPECT_EQ(hot[0].key, "hash");
+  EXPECT_EQ(hot[0].count, 200U * 10);
+  EXPECT_EQ(sampler.hotKeys("get", 1)[0].key, "hot");
+  EXPECT_TRUE(sampler.hotKeys("set", 10).empty());
+
+  // fades out
+  sampler.decay();
+  hot = sampler.hotKeys("hget", 10);
+  EXPECT_EQ(hot[0].count, 100U * 10);
+  for (int i = 0; i < 10; ++i) {
+    sampler.decay();
+  }
+  EXPECT_TRUE(sampler.hotKeys("", 10).empty());
+  EXPECT_TRUE(sampler.hotKeys("hget", 10).empty());
+
+  sampler.sample("get", 0, "a");
+  sampler.clear();
+  EXPECT_TRUE(sampler.hotKeys("", 10).empty());
+  EXPECT_EQ(sampler.sampled, 0U);
+}
+
+std::shared_ptr<ServerParams> genParams() {
+  const auto guard = MakeGuard([] { remove("a.cfg"); });
+  std::ofstream myfile;
+  myfile.open("a.cfg");
+  myfile << "bind 127.0.0.1\n";
+  myfile << "port 8903\n";
+  myfile << "loglevel debug\n";
+  myfile << "logdir ./log\n";
+  myfile << "storage rocks\n";
+  myfile << "dir ./db\n";
+  myfile << "rocks.blockcachemb 4096\n";
+  myfile.close();
+  auto cfg = std::make_shared<ServerParams>();
+  auto s = cfg->parseFile("a.cfg");
+  EXPECT_EQ(s.ok(), true) << s.toString();
+  return cfg;
+}
+
+TEST(BigKeySampler, Common) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+  // strings in the chunks around the collections
+  for (uint32_t chunk : {0, 3, 100}) {
+    for (uint32_t i = 0; i < 10; ++i) {
+      RecordKey rk(chunk, 0, RecordType::RT_DATA_META, std::to_string(i), "");
+      RecordValue rv(std::string(i * 10, 'v'), RecordType::RT_KV, -1);
+      EXPECT_TRUE(store->setKV(rk, rv, txn).ok());
+    }
+  }
+  RecordKey hk(3, 0, RecordType::RT_DATA_META, "hash", "");
+  RecordValue hv(HashMetaValue(1000).encode(), RecordType::RT_HASH_META, -1);
+  EXPECT_TRUE(store->setKV(hk, hv, txn).ok());
+  for (uint32_t i = 0; i < 1000; ++i) {
+    RecordKey rk(3, 0, RecordType::RT_HASH_ELE, "hash", std::to_string(i));
+    RecordValue rv(std::string(100, 'v'), RecordType::RT_HASH_ELE, -1);
+    EXPECT_TRUE(store->setKV(rk, rv, txn).ok());
+  }
+  RecordKey sk(100, 1, RecordType::RT_DATA_META, "set", "");
+  RecordValue sv(SetMetaValue(20).encode(), RecordType::RT_SET_META, -1);
+  EXPECT_TRUE(store->setKV(sk, sv, txn).ok());
+  for (uint32_t i = 0; i < 20; ++i) {
+    RecordKey rk(100, 1, RecordType::RT_SET_ELE, "set", std::to_string(i));
+    RecordValue rv("", RecordType::RT_SET_ELE, -1);
+    EXPECT_TRUE(store->setKV(rk, rv, txn).ok());
+  }
+  EXPECT_TRUE(txn->commit().ok());
+
+  BigKeySampler sampler(cfg, 1);
+  auto scanAll = [&sampler, &store]() {
+    uint64_t rounds = sampler.rounds;
+    uint64_t batches = 0;
+    while (sampler.rounds == rounds) {
+      auto eSized = sampler.sizeStore(0, store.get(), 7);
+      EXPECT_TRUE(eSized.ok());
+      EXPECT_LE(eSized.value(), 7U);
+      batches++;
+    }
+    return batches;
+  };
+  // 32 metas in batches of 7
+  EXPECT_EQ(scanAll(), 5U);
+  EXPECT_EQ(sampler.sized, 32U);
+
+  auto big = sampler.bigKeys(RecordType::RT_INVALID, 3);
+  EXPECT_EQ(big.size(), 3U);
+  EXPECT_EQ(big[0].key, "hash");
+  EXPECT_EQ(big[0].type, RecordType::RT_HASH_META);
+  EXPECT_EQ(big[0].elements, 1000U);
+  EXPECT_GT(big[0].bytes, 1000U * 100);
+  EXPECT_LT(big[0].bytes, 1000U * 200);
+  EXPECT_EQ(big[1].type, RecordType::RT_SET_META);
+  EXPECT_EQ(big[1].dbId, 1U);
+  EXPECT_EQ(big[1].elements, 20U);
+  auto strings = sampler.bigKeys(RecordType::RT_KV, 100);
+  // the strings of the same name in the chunks are different keys, the
+  // biggest TOPK of them are kept
+  EXPECT_EQ(strings.size(), BigKeySampler::TOPK);
+  EXPECT_EQ(strings[0].key, "9");
+  EXPECT_EQ(strings[0].elements, 1U);
+  EXPECT_TRUE(sampler.bigKeys(RecordType::RT_ZSET_META, 10).empty());
+
+  // forgotten after a full scan
+  eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  EXPECT_TRUE(store->delKV(hk, eTxn.value().get()).ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  scanAll();
+  big = sampler.bigKeys(RecordType::RT_INVALID, 1);
+  EXPECT_EQ(big[0].key, "set");
+  EXPECT_TRUE(sampler.bigKeys(RecordType::RT_HASH_META, 10).empty());
+  EXPECT_EQ(sampler.rounds, 2U);
+}
+
+}  // namespace tendisplus
@@ -2,9 +2,13 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <algorithm>
 #include <memory>
+#include <mutex>  // NOLINT
+#include <string>
 #include <utility>
 #include <thread>  // NOLINT
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "glog/logging.h"
@@ -12,6 +16,7 @@
 #include "tendisplus/server/server_entry.h"
 #include "tendisplus/server/index_manager.h"
 #include "tendisplus/server/segment_manager.h"
+#include "tendisplus/replication/repl_util.h"
 #include "tendisplus/commands/command.h"
 #include "tendisplus/network/network.h"
 #include "tendisplus/utils/test_util.h"
@@ -1022,4 +1027,101 @@ TEST(Repl, BinlogVersion) {
   ASSERT_EQ(version2_slave2.use_count(), 1);
 }
 
+// a batch from the master is applied in lanes, the ops of a binlog of
+// keys in different chunks are applied by one lane in one txn
+TEST(Repl, BinlogLanes) {
+  const auto guard = MakeGuard([] {
+    destroyEnv(single_dir);
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+  });
+  EXPECT_TRUE(setupEnv(single_dir));
+  auto cfg = makeServerParam(single_port, 1, single_dir, false);
+  auto server = std::make_shared<ServerEntry>(cfg);
+  auto s = server->startup(cfg);
+  INVARIANT(s.ok());
+  auto ctx = std::make_shared<asio::io_context>();
+  auto session = makeSession(server, ctx);
+  session->getCtx()->setReplOnly(true);
+  auto pool = std::make_unique<WorkerPool>("tx-test-lanes",
+                                           std::make_shared<PoolMatrix>());
+  EXPECT_TRUE(pool->startup(3).ok());
+
+  auto store = server->getStores()[0];
+  uint64_t highest = store->getHighestBinlogId();
+  auto encode = [](const std::string& key) {
+    // the chunk of "a", "b", "c", "d" is 1, 2, 3, 5, so the lane of 4 is
+    // 1, 2, 3, 1
+    uint32_t chunkId = key[0] == 'd' ? 5 : key[0] - 'a' + 1;
+    return RecordKey(chunkId, 0, RecordType::RT_KV, key, "").encode();
+  };
+  // like the binlogs of "MSET a 1 b 1", "SET c 1", "SET d 1"
+  std::vector<std::vector<std::string>> txns = {{"a", "b"}, {"c"}, {"d"}};
+  std::vector<ReplLogRawV2> logs;
+  for (size_t i = 0; i < txns.size(); ++i) {
+    std::vector<ReplLogValueEntryV2> entries;
+    for (const auto& key : txns[i]) {
+      RecordValue rv("1", RecordType::RT_KV, -1);
+      entries.emplace_back(
+        ReplOp::REPL_OP_SET, msSinceEpoch(), encode(key), rv.encode());
+    }
+    uint32_t chunkId = txns[i].size() > 1 ? Transaction::CHUNKID_MULTI
+                                          : RecordKey::decodeChunkId(
+                                              encode(txns[i][0]));
+    ReplLogValueV2 val(chunkId,
+                       ReplFlag::REPL_GROUP_START,
+                       i + 1,
+                       msSinceEpoch(),
+                       0,
+                       "",
+                       nullptr,
+                       0);
+    logs.emplace_back(ReplLogKeyV2(highest + 1 + i).encode(),
+                      val.encode(entries));
+  }
+
+  // the keys of the lanes, no key of a lane is visible before it commits
+  std::mutex mutex;
+  std::vector<std::vector<std::string>> lanes;
+  SyncPoint::GetInstance()->SetCallBack(
+    "applyLaneV2::BeforeCommit", [&](void* arg) {
+      auto ops = reinterpret_cast<std::vector<ReplLogValueEntryV2>*>(arg);
+      auto eTxn = store->createTransaction(nullptr);
+      EXPECT_TRUE(eTxn.ok());
+      std::vector<std::string> keys;
+      for (const auto& op : *ops) {
+        auto rk = RecordKey::decode(op.getOpKey());
+        EXPECT_TRUE(rk.ok());
+        EXPECT_EQ(store->getKV(rk.value(), eTxn.value().get()).status().code(),
+                  ErrorCodes::ERR_NOTFOUND);
+        keys.push_back(rk.value().getPrimaryKey());
+      }
+      std::sort(keys.begin(), keys.end());
+      std::lock_guard<std::mutex> lk(mutex);
+      lanes.push_back(keys);
+    });
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  auto eResult = applyTxnsInLanesV2(session.get(), 0, logs, pool.get(), 4);
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  ASSERT_TRUE(eResult.ok()) << eResult.status().toString();
+  EXPECT_EQ(eResult.value().binlogId, highest + 3);
+  EXPECT_EQ(store->getHighestBinlogId(), highest + 3);
+  // "a" and "b" are in one lane, with "d" of the lane of "a"
+  std::sort(lanes.begin(), lanes.end());
+  std::vector<std::vector<std::string>> expected = {{"a", "b", "d"}, {"c"}};
+  EXPECT_EQ(lanes, expected);
+
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  for (const auto& key : {"a", "b", "c", "d"}) {
+    auto rk = RecordKey::decode(encode(key));
+    EXPECT_TRUE(store->getKV(rk.value(), eTxn.value().get()).ok());
+  }
+
+  pool->stop();
+  server->stop();
+  ASSERT_EQ(server.use_count(), 1);
+}
+
 }  // namespace tendisplus
@@ -12,6 +12,7 @@
 #include "glog/logging.h"
 #include "tendisplus/server/server_entry.h"
 #include "tendisplus/server/server_params.h"
+#include "tendisplus/server/session.h"
 #include "tendisplus/utils/redis_port.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/time.h"
@@ -219,11 +220,15 @@ ServerEntry::ServerEntry()
     _clusterMgr(nullptr),
     _gcMgr(nullptr),
     _scriptMgr(nullptr),
+    _hotKeySampler(nullptr),
+    _bigKeySampler(nullptr),
     _catalog(nullptr),
     _netMatrix(std::make_shared<NetworkMatrix>()),
     _poolMatrix(std::make_shared<PoolMatrix>()),
+    _inlineMatrix(std::make_shared<PoolMatrix>()),
     _reqMatrix(std::make_shared<RequestMatrix>()),
     _cronThd(nullptr),
+    _bigKeyThd(nullptr),
     _enableCluster(false),
     _requirepass(""),
     _masterauth(""),
@@ -252,6 +257,8 @@ ServerEntry::ServerEntry(const std::shared_ptr<ServerParams>& cfg)
   _enableCluster = cfg->clusterEnabled;
   _dbNum = cfg->dbNum;
   _cfg = cfg;
+  _hotKeySampler = std::make_unique<HotKeySampler>(cfg);
+  _bigKeySampler = std::make_unique<BigKeySampler>(cfg, cfg->kvStoreCount);
   _cfg->serverParamsVar("executorThreadNum")->setUpdate([this]() {
     resizeExecutorThreadNum(_cfg->executorThreadNum);
   });
@@ -261,6 +268,7 @@ void ServerEntry::resetServerStat() {
   std::lock_guard<std::mutex> lk(_mutex);
 
   _poolMatrix->reset();
+  _inlineMatrix->reset();
   _netMatrix->reset();
   _reqMatrix->reset();
 
@@ -365,6 +373,21 @@ Status ServerEntry::adaptSomeThreadNumByCpuNum(
       << cfg->executorThreadNum;
   }
 
+  // bounds of the executor threads for pool-autoscale
+  if (cfg->executorThreadNumMin == 0) {
+    cfg->executorThreadNumMin = cfg->executorWorkPoolSize;
+  }
+  if (cfg->executorThreadNumMax == 0) {
+    cfg->executorThreadNumMax =
+      std::min(uint32_t(200), std::max(cfg->executorThreadNum, cpuNum * 4));
+  }
+
+  if (cfg->netIoThreadNum == 0 && cfg->runToCompletion) {
+    // one io thread per core, the commands are executed in io threads
+    cfg->netIoThreadNum = cpuNum;
+    LOG(INFO) << "adaptSomeThreadNumByCpuNum netIoThreadNum:"
+              << cfg->netIoThreadNum << " for run-to-completion";
+  }
   if (cfg->netIoThreadNum == 0) {
     uint32_t threadnum = static_cast<uint32_t>(cpuNum / 4);
     threadnum = std::max(uint32_t(2), threadnum);
@@ -529,6 +552,8 @@ Status ServerEntry::startup(const std::shared_ptr<ServerParams>& cfg) {
     _cfg->executorThreadNum += pool->size();
   }
 
+  _executorScaler = std::make_unique<PoolAutoScaler>(_poolMatrix);
+
   // _cfg->executorThreadNum = _executorList.size() *
   // _executorList.back()->size(); network
   _network = std::make_unique<NetworkAsio>(
@@ -572,13 +597,14 @@ Status ServerEntry::startup(const std::shared_ptr<ServerParams>& cfg) {
       LOG(WARNING) << "start up migrate manager failed!";
       return s;
     }
+  }
 
-    _gcMgr = std::make_unique<GCManager>(shared_from_this());
-    s = _gcMgr->startup();
-    if (!s.ok()) {
-      LOG(WARNING) << "start up gc manager failed";
-      return s;
-    }
+  // the lazyfree reclaimer runs without cluster too
+  _gcMgr = std::make_unique<GCManager>(shared_from_this());
+  s = _gcMgr->startup();
+  if (!s.ok()) {
+    LOG(WARNING) << "start up gc manager failed";
+    return s;
   }
 
   _scriptMgr = std::make_unique<ScriptManager>(shared_from_this());
@@ -617,6 +643,12 @@ Status ServerEntry::startup(const std::shared_ptr<ServerParams>& cfg) {
     INVARIANT(!pthread_setname_np(pthread_self(), "tx-svr-cron"));
     serverCron();
   });
+  // NOTE: sizing the keys takes sessions and db locks, so it can't run in
+  // serverCron() which holds _mutex
+  _bigKeyThd = std::make_unique<std::thread>([this] {
+    INVARIANT(!pthread_setname_np(pthread_self(), "tx-svr-bigkey"));
+    bigKeyCron();
+  });
 
   // init slowlog
   _slowlogStat.initSlowlogFile(cfg->slowlogPath);
@@ -824,6 +856,10 @@ void ServerEntry::DelMonitorNoLock(uint64_t connId) {
  */
 void ServerEntry::resizeExecutorThreadNum(uint64_t newThreadNum) {
   std::lock_guard<std::mutex> lk(_mutex);
+  resizeExecutorThreadNumInLock(newThreadNum);
+}
+
+void ServerEntry::resizeExecutorThreadNumInLock(uint64_t newThreadNum) {
   auto threadSum = _executorList.size() * _executorList.back()->size();
   if (newThreadNum < threadSum) {
     resizeDecrExecutorThreadNum(newThreadNum);
@@ -881,6 +917,85 @@ void ServerEntry::resizeIncrExecutorThreadNum(uint64_t newThreadNum) {
   }
 }
 
+// size a batch of the metas of every store for the big keys
+void ServerEntry::sizeBigKeys() {
+  uint64_t batch = _cfg->bigkeyScanBatch;
+  if (batch == 0) {
+    return;
+  }
+  LocalSessionGuard sg(this);
+  for (uint32_t i = 0; i < getKVStoreCount(); ++i) {
+    if (!_isRunning.load(std::memory_order_relaxed)) {
+      return;
+    }
+    // don't wait for the stores locked
+    auto expdb = _segmentMgr->getDb(
+      sg.getSession(), i, mgl::LockMode::LOCK_IS, false, 0);
+    if (!expdb.ok() || !expdb.value().store->isRunning()) {
+      continue;
+    }
+    auto eSized =
+      _bigKeySampler->sizeStore(i, expdb.value().store.get(), batch);
+    if (!eSized.ok()) {
+      LOG(WARNING) << "size the keys of store:" << i
+                   << " failed:" << eSized.status().toString();
+    }
+  }
+}
+
+void ServerEntry::bigKeyCron() {
+  using namespace std::chrono_literals;  // NOLINT(build/namespaces)
+
+  LOG(INFO) << "bigKeyCron thread starts";
+  while (_isRunning.load(std::memory_order_relaxed)) {
+    {
+      std::unique_lock<std::mutex> lk(_mutex);
+      bool ok = _eventCV.wait_for(lk, 1000ms, [this] {
+        return _isRunning.load(std::memory_order_relaxed) == false;
+      });
+      if (ok) {
+        break;
+      }
+    }
+    sizeBigKeys();
+  }
+  LOG(INFO) << "bigKeyCron thread exits";
+}
+
+/**
+ * @brief resize the executor pools, repl pools and migrate pools by pressure
+ * @note the executor pools are resized by executorWorkPoolSize within
+ *      [executorThreadNumMin, executorThreadNumMax], just like
+ *      "config set executorThreadNum".
+ */
+void ServerEntry::autoScalePools(bool cpuBusy) {
+  uint64_t queueNsHigh = _cfg->poolAutoScaleQueueUs * 1000ULL;
+  uint64_t step = _cfg->executorWorkPoolSize;
+  // round the bounds to multiple of executorWorkPoolSize
+  uint64_t minNum = (_cfg->executorThreadNumMin + step - 1) / step * step;
+  uint64_t maxNum = std::max(_cfg->executorThreadNumMax / step * step, step);
+
+  {
+    // NOTE: the executor list and executorThreadNum change together, the
+    // same as "config set executorThreadNum"
+    std::lock_guard<std::mutex> lk(_mutex);
+    uint64_t cur = _executorList.size() * _executorList.back()->size();
+    uint64_t num =
+      _executorScaler->adapt(cur, step, minNum, maxNum, queueNsHigh, cpuBusy);
+    if (num != cur) {
+      LOG(INFO) << "autoscale executor threads from " << cur << " to " << num
+                << (cpuBusy ? ", cpu busy" : "");
+      resizeExecutorThreadNumInLock(num);
+      _cfg->executorThreadNum = num;
+    }
+  }
+
+  _replMgr->autoScalePools(queueNsHigh, cpuBusy);
+  if (_migrateMgr) {
+    _migrateMgr->autoScalePools(queueNsHigh, cpuBusy);
+  }
+}
+
 void ServerEntry::replyMonitors(Session* sess) {
   if (_monitors.size() <= 0) {
     return;
@@ -941,6 +1056,27 @@ bool ServerEntry::processRequest(Session* sess) {
   if (expCmd.value()->isBgCmd()) {
     auto expCmdName = expCmd.value()->getName();
     if (expCmdName == "fullsync") {
+      // the streams are optional
+      if (sess->getArgs().size() > 5) {
+        auto s = sess->setResponse(
+          redis_port::errorReply("wrong number of arguments for 'fullsync'"));
+        return s.ok();
+      }
+      LOG(WARNING) << "[master] session id:" << sess->id()
+                   << " socket borrowed";
+      NetSession* ns = dynamic_cast<NetSession*>(sess);
+      INVARIANT(ns != nullptr);
+      std::vector<std::string> args = ns->getArgs();
+      // we have called precheck, it should have 4 or 5 args
+      INVARIANT(args.size() == 4 || args.size() == 5);
+      _replMgr->supplyFullSync(ns->borrowConn(),
+                               args[1],
+                               args[2],
+                               args[3],
+                               args.size() == 5 ? args[4] : "");
+      ++_serverStat.syncFull;
+      return false;
+    } else if (expCmdName == "fullsyncfile") {
       LOG(WARNING) << "[master] session id:" << sess->id()
                    << " socket borrowed";
       NetSession* ns = dynamic_cast<NetSession*>(sess);
@@ -948,19 +1084,31 @@ bool ServerEntry::processRequest(Session* sess) {
       std::vector<std::string> args = ns->getArgs();
       // we have called precheck, it should have 4 args
       INVARIANT(args.size() == 4);
-      _replMgr->supplyFullSync(ns->borrowConn(), args[1], args[2], args[3]);
-      ++_serverStat.syncFull;
+      _replMgr->supplyFullSyncFile(
+        ns->borrowConn(), args[1], args[2], args[3]);
       return false;
     } else if (expCmdName == "incrsync") {
+      // the codecs are optional
+      if (sess->getArgs().size() > 7) {
+        auto s = sess->setResponse(
+          redis_port::errorReply("wrong number of arguments for 'incrsync'"));
+        return s.ok();
+      }
       LOG(WARNING) << "[master] session id:" << sess->id()
                    << " socket borrowed";
       NetSession* ns = dynamic_cast<NetSession*>(sess);
       INVARIANT(ns != nullptr);
       std::vector<std::string> args = ns->getArgs();
-      // we have called precheck, it should have 2 args
-      INVARIANT(args.size() == 6);
-      bool ret = _replMgr->registerIncrSync(
-        ns->borrowConn(), args[1], args[2], args[3], args[4], args[5]);
+      // we have called precheck, it should have 6 or 7 args
+      INVARIANT(args.size() == 6 || args.size() == 7);
+      bool ret =
+        _replMgr->registerIncrSync(ns->borrowConn(),
+                                   args[1],
+                                   args[2],
+                                   args[3],
+                                   args[4],
+                                   args[5],
+                                   args.size() == 7 ? args[6] : "");
       if (ret) {
         ++_serverStat.syncPartialOk;
       } else {
@@ -1013,7 +1161,7 @@ bool ServerEntry::processRequest(Session* sess) {
                 << " err:" << expect.status().toString();
     return true;
   }
-  auto s = sess->setResponse(expect.value());
+  auto s = sess->setResponse(std::move(expect.value()));
   if (!s.ok()) {
     return false;
   }
@@ -1057,6 +1205,14 @@ void ServerEntry::getStatInfo(std::stringstream& ss) const {
   ss << "commands_in_queue:" << _poolMatrix->inQueue.get() << "\r\n";
   ss << "commands_executed_in_workpool:" << _poolMatrix->executed.get()
      << "\r\n";
+  ss << "run_to_completion:" << (isRunToCompletion() ? "yes" : "no")
+     << "\r\n";
+  ss << "commands_executed_inline:" << _inlineMatrix->executed.get()
+     << "\r\n";
+  ss << "total_commands_inline_queue_cost(ns):"
+     << _inlineMatrix->queueTime.get() << "\r\n";
+  ss << "total_commands_inline_execute_cost(ns):"
+     << _inlineMatrix->executeTime.get() << "\r\n";
 
   ss << "total_stricky_packets:" << _netMatrix->stickyPackets.get() << "\r\n";
   ss << "total_invalid_packets:" << _netMatrix->invalidPackets.get() << "\r\n";
@@ -1124,6 +1280,34 @@ void ServerEntry::appendJSONStat(
     w.Uint64(_poolMatrix->executeTime.get());
     w.EndObject();
   }
+  if (sections.find("inline_pool") != sections.end()) {
+    w.Key("inline_pool");
+    w.StartObject();
+    w.Key("run_to_completion");
+    w.Bool(isRunToCompletion());
+    w.Key("in_queue");
+    w.Uint64(_inlineMatrix->inQueue.get());
+    w.Key("executed");
+    w.Uint64(_inlineMatrix->executed.get());
+    w.Key("queue_time");
+    w.Uint64(_inlineMatrix->queueTime.get());
+    w.Key("execute_time");
+    w.Uint64(_inlineMatrix->executeTime.get());
+    w.EndObject();
+  }
+  if (sections.find("hotkeys") != sections.end() && _hotKeySampler) {
+    w.Key("hotkeys");
+    w.StartObject();
+    _hotKeySampler->appendJSONStat(w, "", HotKeySampler::DEFAULT_COUNT);
+    w.EndObject();
+  }
+  if (sections.find("bigkeys") != sections.end() && _bigKeySampler) {
+    w.Key("bigkeys");
+    w.StartObject();
+    _bigKeySampler->appendJSONStat(
+      w, RecordType::RT_INVALID, BigKeySampler::DEFAULT_COUNT);
+    w.EndObject();
+  }
 }
 
 bool ServerEntry::getTotalIntProperty(Session* sess,
@@ -1311,9 +1495,16 @@ void ServerEntry::serverCron() {
   auto interval = 100ms;  // every 100ms execute one time
   uint64_t hz = 1000ms / interval;
 
+  uint32_t cpuNum = std::max(std::thread::hardware_concurrency(), 1U);
+  uint64_t autoScaleSec = 0;
+  uint64_t oldCpuUs = cpuTimeUs();
+  uint64_t oldCpuTs = nsSinceEpoch() / 1000;
+
   LOG(INFO) << "serverCron thread starts, hz:" << hz;
   while (_isRunning.load(std::memory_order_relaxed)) {
     std::unique_lock<std::mutex> lk(_mutex);
+    bool autoScale = false;
+    bool cpuBusy = false;
 
     bool ok = _eventCV.wait_for(lk, interval, [this] {
       return _isRunning.load(std::memory_order_relaxed) == false;
@@ -1365,7 +1556,34 @@ void ServerEntry::serverCron() {
       _scriptMgr->cron();
     }
 
+    run_with_period(HotKeySampler::DECAY_INTERVAL_SEC * 1000) {
+      _hotKeySampler->decay();
+    }
+
+    run_with_period(1000) {
+      if (++autoScaleSec >= std::max(_cfg->poolAutoScaleIntervalSec, 1U)) {
+        autoScaleSec = 0;
+        // cpu utilisation of the process in the last period
+        uint64_t cpuUs = cpuTimeUs();
+        uint64_t cpuTs = nsSinceEpoch() / 1000;
+        uint64_t percent = cpuTs > oldCpuTs && cpuUs > oldCpuUs
+          ? (cpuUs - oldCpuUs) * 100 / ((cpuTs - oldCpuTs) * cpuNum)
+          : 0;
+        oldCpuUs = cpuUs;
+        oldCpuTs = cpuTs;
+        if (_cfg->poolAutoScale) {
+          autoScale = true;
+          cpuBusy = percent >= _cfg->poolAutoScaleCpuPercent;
+        }
+      }
+    }
+
     cronLoop++;
+    // NOTE: resizing the pools takes _mutex and the locks of the managers
+    lk.unlock();
+    if (autoScale) {
+      autoScalePools(cpuBusy);
+    }
   }
 }
 
@@ -1408,6 +1626,11 @@ void ServerEntry::stop() {
   LOG(INFO) << "server begins to stop...";
   _isRunning.store(false, std::memory_order_relaxed);
   _eventCV.notify_all();
+  // before the pools, the managers and the stores go away
+  if (_bigKeyThd) {
+    _bigKeyThd->join();
+  }
+  _cronThd->join();
   _network->stop();
 
   // NOTE(takenliu): _scriptMgr need stop earlier than _executorList
@@ -1471,7 +1694,6 @@ void ServerEntry::stop() {
     }
   }
 
-  _cronThd->join();
   _slowlogStat.closeSlowlogFile();
   LOG(INFO) << "server stops complete...";
   _isStopped.store(true, std::memory_order_relaxed);
@@ -24,6 +24,7 @@
 #include "tendisplus/replication/repl_manager.h"
 #include "tendisplus/cluster/migrate_manager.h"
 #include "tendisplus/server/index_manager.h"
+#include "tendisplus/server/key_sampler.h"
 #include "tendisplus/storage/kvstore.h"
 #include "tendisplus/storage/rocks/rocks_kvstore.h"
 #include "tendisplus/storage/catalog.h"
@@ -199,6 +200,12 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   ClusterManager* getClusterMgr();
   GCManager* getGcMgr();
   ScriptManager* getScriptMgr();
+  HotKeySampler* getHotKeySampler() {
+    return _hotKeySampler.get();
+  }
+  BigKeySampler* getBigKeySampler() {
+    return _bigKeySampler.get();
+  }
 
   // TODO(takenliu) : args exist at two places, has better way?
   std::string requirepass() const;
@@ -303,6 +310,14 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   bool isRunning() const {
     return _isRunning;
   }
+  bool isRunToCompletion() const {
+    return _cfg->runToCompletion;
+  }
+  // matrix of the tasks executed in the io threads in run-to-completion
+  // mode, compared with _poolMatrix of the executor pools
+  const std::shared_ptr<PoolMatrix>& getInlineMatrix() const {
+    return _inlineMatrix;
+  }
 
   CursorMap &getCursorMap(int dbId) {
     return _cursorMaps[dbId];
@@ -315,8 +330,12 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   void replyMonitors(Session* sess);
   void DelMonitorNoLock(uint64_t connId);
   void resizeExecutorThreadNum(uint64_t newThreadNum);
+  void resizeExecutorThreadNumInLock(uint64_t newThreadNum);
   void resizeIncrExecutorThreadNum(uint64_t newThreadNum);
   void resizeDecrExecutorThreadNum(uint64_t newThreadNum);
+  void autoScalePools(bool cpuBusy);
+  void sizeBigKeys();
+  void bigKeyCron();
 
   // NOTE(deyukong): _isRunning = true -> running
   // _isRunning = false && _isStopped = false -> stopping in progress
@@ -333,6 +352,7 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   std::map<uint64_t, std::shared_ptr<Session>> _sessions;
   std::vector<std::unique_ptr<WorkerPool>> _executorList;
   std::set<std::unique_ptr<WorkerPool>> _executorRecycleSet;
+  std::unique_ptr<PoolAutoScaler> _executorScaler;
   std::unique_ptr<SegmentMgr> _segmentMgr;
   std::unique_ptr<ReplManager> _replMgr;
   std::unique_ptr<MigrateManager> _migrateMgr;
@@ -342,6 +362,8 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
   std::unique_ptr<ClusterManager> _clusterMgr;
   std::unique_ptr<GCManager> _gcMgr;
   std::unique_ptr<ScriptManager> _scriptMgr;
+  std::unique_ptr<HotKeySampler> _hotKeySampler;
+  std::unique_ptr<BigKeySampler> _bigKeySampler;
 
   std::shared_ptr<rocksdb::Cache> _blockCache;
   std::vector<PStore> _kvstores;
@@ -349,8 +371,10 @@ class ServerEntry : public std::enable_shared_from_this<ServerEntry> {
 
   std::shared_ptr<NetworkMatrix> _netMatrix;
   std::shared_ptr<PoolMatrix> _poolMatrix;
+  std::shared_ptr<PoolMatrix> _inlineMatrix;
   std::shared_ptr<RequestMatrix> _reqMatrix;
   std::unique_ptr<std::thread> _cronThd;
+  std::unique_ptr<std::thread> _bigKeyThd;
 
   bool _enableCluster;
   // NOTE(deyukong):
@@ -106,6 +106,14 @@ bool compressTypeParamCheck(const string& val) {
   return false;
 }
 
+bool binlogCompressTypeCheck(const string& val) {
+  auto v = toLower(val);
+  if (v == "lz4" || v == "none") {
+    return true;
+  }
+  return false;
+}
+
 bool executorThreadNumCheck(const std::string& val) {
   auto num = std::strtoull(val.c_str(), nullptr, 10);
   if (!getGlobalServer()) {
@@ -328,6 +336,18 @@ ServerParams::ServerParams() {
     executorThreadNum, executorThreadNumCheck, nullptr, 1, 200, true);
   REGISTER_VARS_SAME_NAME(
     executorWorkPoolSize, nullptr, nullptr, 1, 200, false);
+  REGISTER_VARS_DIFF_NAME("run-to-completion", runToCompletion);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("pool-autoscale", poolAutoScale);
+  REGISTER_VARS_SAME_NAME(
+    executorThreadNumMin, nullptr, nullptr, 0, 200, true);
+  REGISTER_VARS_SAME_NAME(
+    executorThreadNumMax, nullptr, nullptr, 0, 200, true);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("pool-autoscale-interval-sec",
+                                  poolAutoScaleIntervalSec);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("pool-autoscale-queue-us",
+                                  poolAutoScaleQueueUs);
+  REGISTER_VARS_FULL("pool-autoscale-cpu-percent",
+                     poolAutoScaleCpuPercent, nullptr, nullptr, 1, 100, true);
 
   REGISTER_VARS(binlogRateLimitMB);
   REGISTER_VARS(netBatchSize);
@@ -336,12 +356,31 @@ ServerParams::ServerParams() {
   REGISTER_VARS_SAME_NAME(incrPushThreadnum, nullptr, nullptr, 1, 200, true);
   REGISTER_VARS_SAME_NAME(fullPushThreadnum, nullptr, nullptr, 1, 200, true);
   REGISTER_VARS_SAME_NAME(fullReceiveThreadnum, nullptr, nullptr, 1, 200, true);
+  REGISTER_VARS_SAME_NAME(fullSyncStreams, nullptr, nullptr, 1, 16, true);
+  REGISTER_VARS_SAME_NAME(
+    fullPushFileThreadnum, nullptr, nullptr, 1, 200, true);
   REGISTER_VARS_SAME_NAME(logRecycleThreadnum, nullptr, nullptr, 1, 200, true);
+  REGISTER_VARS_SAME_NAME(binlogApplyLanes, nullptr, nullptr, 1, 64, true);
+  REGISTER_VARS_SAME_NAME(binlogApplyThreadnum, nullptr, nullptr, 1, 200, true);
+  REGISTER_VARS_FULL("incrsync-compress-type",
+                     incrSyncCompressType,
+                     binlogCompressTypeCheck,
+                     removeQuotesAndToLower,
+                     -1,
+                     -1,
+                     true);
   REGISTER_VARS_FULL("truncateBinlogIntervalMs", truncateBinlogIntervalMs,
     NULL, NULL, 10, 5000, true)
   REGISTER_VARS_ALLOW_DYNAMIC_SET(truncateBinlogNum);
   REGISTER_VARS(binlogFileSizeMB);
   REGISTER_VARS(binlogFileSecs);
+  REGISTER_VARS_FULL("binlog-file-compress-type",
+                     binlogFileCompressType,
+                     binlogCompressTypeCheck,
+                     removeQuotesAndToLower,
+                     -1,
+                     -1,
+                     true);
   REGISTER_VARS(binlogDelRange);
 
   REGISTER_VARS_ALLOW_DYNAMIC_SET(keysDefaultLimit);
@@ -368,6 +407,9 @@ ServerParams::ServerParams() {
                      false);
   REGISTER_VARS_DIFF_NAME("rocks.level0_compress_enabled", level0Compress);
   REGISTER_VARS_DIFF_NAME("rocks.level1_compress_enabled", level1Compress);
+  REGISTER_VARS_DIFF_NAME("rocks.prefix_bloom_enabled", rocksPrefixBloom);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("compact-reclaim-subkeys",
+                                  compactReclaimSubkeys);
 
   REGISTER_VARS_SAME_NAME(
     migrateSenderThreadnum, nullptr, nullptr, 1, 200, true);
@@ -391,6 +433,29 @@ ServerParams::ServerParams() {
   REGISTER_VARS_DIFF_NAME_DYNAMIC("cluster-migration-distance",
                                   migrateDistance);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("garbage-delete-size", garbageDeleteSize);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("lazyfree-threshold", lazyfreeThreshold);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("lazyfree-reclaim-batch",
+                                  lazyfreeReclaimBatch);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("hash-max-listpack-entries",
+                                  hashMaxListpackEntries);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("hash-max-listpack-value",
+                                  hashMaxListpackValue);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("set-max-listpack-entries",
+                                  setMaxListpackEntries);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("set-max-listpack-value",
+                                  setMaxListpackValue);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("zset-max-listpack-entries",
+                                  zsetMaxListpackEntries);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("zset-max-listpack-value",
+                                  zsetMaxListpackValue);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("zset-index-cache-mb", zsetIndexCacheMB);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("zset-index-min-count", zsetIndexMinCount);
+  REGISTER_VARS_DIFF_NAME("record-cache-mb", recordCacheMB);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("hotkey-sample-rate", hotkeySampleRate);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("bigkey-scan-batch", bigkeyScanBatch);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("bitmap-piece-size", bitmapPieceSize);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("list-max-node-entries", listMaxNodeEntries);
+  REGISTER_VARS_DIFF_NAME_DYNAMIC("list-max-node-bytes", listMaxNodeBytes);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("cluster-migration-binlog-iters",
                                   migrateBinlogIter);
   REGISTER_VARS_DIFF_NAME_DYNAMIC("cluster-migration-slots-num-per-task",
@@ -394,6 +394,20 @@ class ServerParams {
   uint32_t netIoThreadNum = 0;
   uint32_t executorThreadNum = 0;
   uint32_t executorWorkPoolSize = 0;
+  // run-to-completion mode, a connection is read, parsed, executed and
+  // replied in its own io thread. only the slow commands are executed in
+  // the executor pools
+  bool runToCompletion = false;
+  // adaptively resize the executor pools within
+  // [executorThreadNumMin, executorThreadNumMax], and the incr-push,
+  // log-recycle and migrate pools within [1, their threadnum], by the
+  // queueing delay of the pools and the cpu utilisation
+  bool poolAutoScale = false;
+  uint32_t executorThreadNumMin = 0;
+  uint32_t executorThreadNumMax = 0;
+  uint32_t poolAutoScaleIntervalSec = 5;
+  uint32_t poolAutoScaleQueueUs = 1000;
+  uint32_t poolAutoScaleCpuPercent = 90;
 
   uint32_t binlogRateLimitMB = 64;
   uint32_t netBatchSize = 1024 * 1024;
@@ -402,11 +416,27 @@ class ServerParams {
   uint32_t incrPushThreadnum = 4;
   uint32_t fullPushThreadnum = 4;
   uint32_t fullReceiveThreadnum = 4;
+  // the slave pulls the files of a fullsync over so many connections, 1 to
+  // receive them over the fullsync connection one by one
+  uint32_t fullSyncStreams = 1;
+  // the threads of the master sending the files to the connections above
+  uint32_t fullPushFileThreadnum = 8;
   uint32_t logRecycleThreadnum = 4;
+  // the binlogs of a batch are applied by the slave in so many lanes, see
+  // applyTxnsInLanesV2(), 1 to apply them one by one
+  uint32_t binlogApplyLanes = 4;
+  uint32_t binlogApplyThreadnum = 4;
+  // the codec the slave asks the master to compress the binlogs with,
+  // "none" or "lz4"
+  string incrSyncCompressType = "none";
   uint32_t truncateBinlogIntervalMs = 1000;
   uint32_t truncateBinlogNum = 50000;
   uint32_t binlogFileSizeMB = 64;
   uint32_t binlogFileSecs = 20 * 60;
+  // the codec of the binlog files dumped, "none" for the flat v2 files,
+  // "lz4" for the block compressed v3 files indexed by binlog id and
+  // timestamp, see BinlogFileWriter
+  string binlogFileCompressType = "none";
   uint32_t binlogDelRange = 1;
 
   uint32_t keysDefaultLimit = 100;
@@ -426,6 +456,10 @@ class ServerParams {
   bool rocksFlushLogAtTrxCommit = false;
   bool level0Compress = false;
   bool level1Compress = false;
+  // NOTE: off by default, the existing databases are created without the
+  // prefix extractor, see RocksKVStore::options()
+  bool rocksPrefixBloom = false;
+  bool compactReclaimSubkeys = true;
 
   uint32_t bingLogSendBatch = 256;
   uint32_t bingLogSendBytes = 16 * 1024 * 1024;
@@ -434,6 +468,41 @@ class ServerParams {
   uint32_t migrateReceiveThreadnum = 4;
   uint32_t garbageDeleteThreadnum = 1;
   uint32_t garbageDeleteSize = 30;
+  // UNLINK deletes the collections with more subkeys lazily
+  uint32_t lazyfreeThreshold = 64;
+  // max subkeys the lazyfree reclaimer deletes in one txn
+  uint32_t lazyfreeReclaimBatch = 1000;
+  // the elements of the small collections are packed in the meta record,
+  // see ListPack. It's disabled by 0 entries, because the older versions
+  // can't read the packed metas.
+  uint32_t hashMaxListpackEntries = 0;
+  uint32_t hashMaxListpackValue = 64;
+  uint32_t setMaxListpackEntries = 0;
+  uint32_t setMaxListpackValue = 64;
+  uint32_t zsetMaxListpackEntries = 0;
+  uint32_t zsetMaxListpackValue = 64;
+  // the in-memory order index of the big zsets, see ZSetIndexCache.
+  // It's shared by all the kvstores, and disabled by 0.
+  uint32_t zsetIndexCacheMB = 0;
+  uint32_t zsetIndexMinCount = 128;
+  // the decoded values of the hot keys, see RecordCache. It's shared by
+  // all the kvstores, and disabled by 0.
+  uint32_t recordCacheMB = 0;
+  // one in the commands is sampled for the hot keys, see HotKeySampler.
+  // It's disabled by 0.
+  uint32_t hotkeySampleRate = 100;
+  // the metas sized per kvstore per second for the big keys, see
+  // BigKeySampler. It's disabled by 0.
+  uint32_t bigkeyScanBatch = 100;
+  // the strings longer than it are stored in pieces of the size by SETBIT
+  // and BITOP, see Bitmap. It's disabled by 0, because the older versions
+  // can't read the pieced strings.
+  uint32_t bitmapPieceSize = 0;
+  // the new lists are chunked into nodes of the limits, see QuickList.
+  // It's disabled by 0 entries, because the older versions can't read
+  // the chunked lists.
+  uint32_t listMaxNodeEntries = 0;
+  uint32_t listMaxNodeBytes = 8192;
 
   bool clusterEnabled = false;
   bool domainEnabled = false;
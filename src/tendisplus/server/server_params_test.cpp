@@ -228,6 +228,12 @@ TEST(ServerParams, DefaultValue) {
   EXPECT_EQ(cfg->netIoThreadNum, 0);
   EXPECT_EQ(cfg->executorThreadNum, 0);
   EXPECT_EQ(cfg->executorWorkPoolSize, 0);
+  EXPECT_EQ(cfg->poolAutoScale, false);
+  EXPECT_EQ(cfg->executorThreadNumMin, 0);
+  EXPECT_EQ(cfg->executorThreadNumMax, 0);
+  EXPECT_EQ(cfg->poolAutoScaleIntervalSec, 5);
+  EXPECT_EQ(cfg->poolAutoScaleQueueUs, 1000);
+  EXPECT_EQ(cfg->poolAutoScaleCpuPercent, 90);
 
   EXPECT_EQ(cfg->binlogRateLimitMB, 64);
   EXPECT_EQ(cfg->netBatchSize, 1024 * 1024);
@@ -236,11 +242,17 @@ TEST(ServerParams, DefaultValue) {
   EXPECT_EQ(cfg->incrPushThreadnum, 4);
   EXPECT_EQ(cfg->fullPushThreadnum, 4);
   EXPECT_EQ(cfg->fullReceiveThreadnum, 4);
+  EXPECT_EQ(cfg->fullSyncStreams, 1);
+  EXPECT_EQ(cfg->fullPushFileThreadnum, 8);
   EXPECT_EQ(cfg->logRecycleThreadnum, 4);
+  EXPECT_EQ(cfg->binlogApplyLanes, 4);
+  EXPECT_EQ(cfg->binlogApplyThreadnum, 4);
+  EXPECT_EQ(cfg->incrSyncCompressType, "none");
   EXPECT_EQ(cfg->truncateBinlogIntervalMs, 1000);
   EXPECT_EQ(cfg->truncateBinlogNum, 50000);
   EXPECT_EQ(cfg->binlogFileSizeMB, 64);
   EXPECT_EQ(cfg->binlogFileSecs, 20 * 60);
+  EXPECT_EQ(cfg->binlogFileCompressType, "none");
   EXPECT_EQ(cfg->lockWaitTimeOut, 3600);
 
   EXPECT_EQ(cfg->rocksBlockcacheMB, 4096);
@@ -249,6 +261,8 @@ TEST(ServerParams, DefaultValue) {
   EXPECT_EQ(cfg->rocksWALDir, "");
   EXPECT_EQ(cfg->rocksCompressType, "snappy");
   EXPECT_EQ(cfg->rocksStrictCapacityLimit, false);
+  EXPECT_EQ(cfg->rocksPrefixBloom, false);
+  EXPECT_EQ(cfg->compactReclaimSubkeys, true);
   EXPECT_EQ(cfg->getRocksdbOptions().size(), 0);
   EXPECT_EQ(cfg->level0Compress, false);
   EXPECT_EQ(cfg->level0Compress, false);
@@ -259,6 +273,22 @@ TEST(ServerParams, DefaultValue) {
   EXPECT_EQ(cfg->migrateSenderThreadnum, 4);
   EXPECT_EQ(cfg->migrateReceiveThreadnum, 4);
   EXPECT_EQ(cfg->garbageDeleteThreadnum, 1);
+  EXPECT_EQ(cfg->lazyfreeThreshold, 64);
+  EXPECT_EQ(cfg->lazyfreeReclaimBatch, 1000);
+  EXPECT_EQ(cfg->hashMaxListpackEntries, 0);
+  EXPECT_EQ(cfg->hashMaxListpackValue, 64);
+  EXPECT_EQ(cfg->setMaxListpackEntries, 0);
+  EXPECT_EQ(cfg->setMaxListpackValue, 64);
+  EXPECT_EQ(cfg->zsetMaxListpackEntries, 0);
+  EXPECT_EQ(cfg->zsetMaxListpackValue, 64);
+  EXPECT_EQ(cfg->zsetIndexCacheMB, 0);
+  EXPECT_EQ(cfg->zsetIndexMinCount, 128);
+  EXPECT_EQ(cfg->recordCacheMB, 0);
+  EXPECT_EQ(cfg->hotkeySampleRate, 100);
+  EXPECT_EQ(cfg->bigkeyScanBatch, 100);
+  EXPECT_EQ(cfg->bitmapPieceSize, 0);
+  EXPECT_EQ(cfg->listMaxNodeEntries, 0);
+  EXPECT_EQ(cfg->listMaxNodeBytes, 8192);
   EXPECT_EQ(cfg->clusterEnabled, false);
   EXPECT_EQ(cfg->domainEnabled, false);
   EXPECT_EQ(cfg->migrateTaskSlotsLimit, 10);
@@ -31,6 +31,11 @@ class Session : public std::enable_shared_from_this<Session> {
   virtual ~Session();
   uint64_t id() const;
   virtual Status setResponse(const std::string& s) = 0;
+  // the reply may be moved into the session, so the network layer can
+  // send it without another copy
+  virtual Status setResponse(std::string&& s) {
+    return setResponse(static_cast<const std::string&>(s));
+  }
   // only for unittest
   virtual std::vector<std::string> getResponse() {
     return std::vector<std::string>();
@@ -101,6 +106,7 @@ class LocalSession : public Session {
   Status cancel() final;
   int getFd() final;
   std::string getRemote() const final;
+  using Session::setResponse;
   Status setResponse(const std::string& s) final;
   void setArgs(const std::vector<std::string>& args);
   void setArgs(const std::string& cmd);
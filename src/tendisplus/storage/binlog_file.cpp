@@ -0,0 +1,411 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include "tendisplus/storage/binlog_file.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include "glog/logging.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/utils/invariant.h"
+
+namespace tendisplus {
+
+namespace {
+
+// keylen(4) + key + vallen(4) + value
+void encodeRecord(std::string* buf, const ReplLogRawV2& log) {
+  char len[sizeof(uint32_t)];
+  int32Encode(len, log.getReplLogKey().size());
+  buf->append(len, sizeof(len));
+  buf->append(log.getReplLogKey());
+  int32Encode(len, log.getReplLogValue().size());
+  buf->append(len, sizeof(len));
+  buf->append(log.getReplLogValue());
+}
+
+Expected<ReplLogRawV2> decodeRecord(const std::string& buf, size_t* pos) {
+  std::string kv[2];
+  for (auto& s : kv) {
+    if (buf.size() - *pos < sizeof(uint32_t)) {
+      return {ErrorCodes::ERR_DECODE, "incomplete binlog"};
+    }
+    uint32_t len = int32Decode(buf.data() + *pos);
+    *pos += sizeof(uint32_t);
+    if (buf.size() - *pos < len) {
+      return {ErrorCodes::ERR_DECODE, "incomplete binlog"};
+    }
+    s = buf.substr(*pos, len);
+    *pos += len;
+  }
+  return ReplLogRawV2(std::move(kv[0]), std::move(kv[1]));
+}
+
+// ERR_EXHAUST if the stream ends right before the record
+Expected<ReplLogRawV2> readRecord(std::istream* fs) {
+  std::string kv[2];
+  for (size_t i = 0; i < 2; i++) {
+    char len[sizeof(uint32_t)];
+    fs->read(len, sizeof(len));
+    if (i == 0 && fs->gcount() == 0 && fs->eof()) {
+      return {ErrorCodes::ERR_EXHAUST, ""};
+    }
+    if (!fs->good()) {
+      return {ErrorCodes::ERR_DECODE, "incomplete binlog"};
+    }
+    kv[i].resize(int32Decode(len));
+    fs->read(&kv[i][0], kv[i].size());
+    if (!fs->good()) {
+      return {ErrorCodes::ERR_DECODE, "incomplete binlog"};
+    }
+  }
+  return ReplLogRawV2(std::move(kv[0]), std::move(kv[1]));
+}
+
+}  // namespace
+
+void BinlogBlockIndex::add(uint64_t binlogId, uint64_t ts) {
+  if (count == 0) {
+    firstBinlogId = binlogId;
+  }
+  lastBinlogId = binlogId;
+  minTimestamp = std::min(minTimestamp, ts);
+  maxTimestamp = std::max(maxTimestamp, ts);
+  count++;
+}
+
+std::string BinlogBlockIndex::encode() const {
+  std::string buf(ENCODED_SIZE, '\0');
+  char* p = &buf[0];
+  p += int64Encode(p, offset);
+  p += int64Encode(p, firstBinlogId);
+  p += int64Encode(p, lastBinlogId);
+  p += int64Encode(p, minTimestamp);
+  p += int64Encode(p, maxTimestamp);
+  int32Encode(p, count);
+  return buf;
+}
+
+BinlogBlockIndex BinlogBlockIndex::decode(const char* buf) {
+  BinlogBlockIndex index;
+  index.offset = int64Decode(buf);
+  index.firstBinlogId = int64Decode(buf + 8);
+  index.lastBinlogId = int64Decode(buf + 16);
+  index.minTimestamp = int64Decode(buf + 24);
+  index.maxTimestamp = int64Decode(buf + 32);
+  index.count = int32Decode(buf + 40);
+  return index;
+}
+
+BinlogFileWriter::BinlogFileWriter(const std::string& name,
+                                   Codec codec,
+                                   size_t blockSize)
+  : _name(name),
+    _codec(codec),
+    _blockSize(blockSize),
+    _offset(0),
+    _closed(false) {
+  // the offsets of the v3 blocks are counted from the header
+  auto mode = std::ios::out | std::ios::binary |
+    (codec == Codec::NONE ? std::ios::app : std::ios::trunc);
+  _fs.open(name, mode);
+}
+
+BinlogFileWriter::~BinlogFileWriter() {
+  auto s = close();
+  if (!s.ok()) {
+    LOG(ERROR) << "close binlog file " << _name << " failed:" << s.toString();
+  }
+}
+
+Expected<std::unique_ptr<BinlogFileWriter>> BinlogFileWriter::create(
+  const std::string& name, uint32_t storeId, Codec codec, size_t blockSize) {
+  std::unique_ptr<BinlogFileWriter> writer(
+    new BinlogFileWriter(name, codec, blockSize));
+  if (!writer->_fs.is_open()) {
+    writer->_closed = true;
+    return {ErrorCodes::ERR_INTERNAL, "open binlog file failed:" + name};
+  }
+
+  // the header
+  std::string header =
+    writer->getVersion() == 2 ? BINLOG_HEADER_V2 : BINLOG_HEADER_V3;
+  char id[sizeof(uint32_t)];
+  int32Encode(id, storeId);
+  header.append(id, sizeof(id));
+  writer->_fs.write(header.data(), header.size());
+  if (!writer->_fs.good()) {
+    return {ErrorCodes::ERR_INTERNAL, "write binlog file failed:" + name};
+  }
+  writer->_offset = header.size();
+  return std::move(writer);
+}
+
+Expected<uint64_t> BinlogFileWriter::append(const ReplLogRawV2& log) {
+  INVARIANT_D(!_closed);
+  if (_codec == Codec::NONE) {
+    std::string buf;
+    encodeRecord(&buf, log);
+    _fs.write(buf.data(), buf.size());
+    if (!_fs.good()) {
+      return {ErrorCodes::ERR_INTERNAL, "write binlog file failed:" + _name};
+    }
+    _offset += buf.size();
+    return buf.size();
+  }
+
+  encodeRecord(&_block, log);
+  _curIndex.add(log.getBinlogId(), log.getTimestamp());
+  if (_block.size() < _blockSize) {
+    return 0;
+  }
+  return flush();
+}
+
+Expected<uint64_t> BinlogFileWriter::flush() {
+  INVARIANT_D(!_closed);
+  uint64_t written = 0;
+  if (!_block.empty()) {
+    auto eFrame = compressFrame(_codec, _block);
+    if (!eFrame.ok()) {
+      return eFrame.status();
+    }
+    std::string hdr(sizeof(uint32_t) + 1, '\0');
+    int32Encode(&hdr[0], eFrame.value().size() + 1);
+    hdr[sizeof(uint32_t)] = static_cast<char>(_codec);
+    _fs.write(hdr.data(), hdr.size());
+    _fs.write(eFrame.value().data(), eFrame.value().size());
+    written = hdr.size() + eFrame.value().size();
+
+    _curIndex.offset = _offset;
+    _index.push_back(_curIndex);
+    _curIndex = BinlogBlockIndex();
+    _block.clear();
+    _offset += written;
+  }
+  _fs.flush();
+  if (!_fs.good()) {
+    return {ErrorCodes::ERR_INTERNAL, "write binlog file failed:" + _name};
+  }
+  return written;
+}
+
+Status BinlogFileWriter::close() {
+  if (_closed) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  // no footer for a broken file, it is read block by block
+  if (_codec != Codec::NONE && _fs.good() && flush().ok()) {
+    std::string footer;
+    for (const auto& index : _index) {
+      footer.append(index.encode());
+    }
+    char offset[sizeof(uint64_t)];
+    int64Encode(offset, _offset);
+    footer.append(offset, sizeof(offset));
+    footer.append(BINLOG_FOOTER_V3);
+    _fs.write(footer.data(), footer.size());
+  }
+  _closed = true;
+  bool good = _fs.good();
+  _fs.close();
+  if (!good || _fs.fail()) {
+    return {ErrorCodes::ERR_INTERNAL, "close binlog file failed:" + _name};
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+BinlogFileReader::BinlogFileReader(const std::string& name)
+  : _name(name),
+    _fs(name, std::ios::in | std::ios::binary),
+    _storeId(0),
+    _version(0),
+    _fileSize(0),
+    _hasIndex(false),
+    _blockIdx(0),
+    _blockOffset(0),
+    _blockPos(0),
+    _startBinlogId(0),
+    _endBinlogId(UINT64_MAX),
+    _startTs(0),
+    _endTs(UINT64_MAX) {}
+
+Expected<std::unique_ptr<BinlogFileReader>> BinlogFileReader::open(
+  const std::string& name) {
+  std::unique_ptr<BinlogFileReader> reader(new BinlogFileReader(name));
+  auto s = reader->init();
+  if (!s.ok()) {
+    return s;
+  }
+  return std::move(reader);
+}
+
+Status BinlogFileReader::init() {
+  if (!_fs.is_open()) {
+    return {ErrorCodes::ERR_INTERNAL, "open binlog file failed:" + _name};
+  }
+  std::string header(BINLOG_HEADER_V2_LEN, '\0');
+  _fs.read(&header[0], header.size());
+  if (!_fs.good()) {
+    return {ErrorCodes::ERR_DECODE, "read head failed:" + _name};
+  }
+  size_t magicLen = strlen(BINLOG_HEADER_V2);
+  if (header.compare(0, magicLen, BINLOG_HEADER_V2) == 0) {
+    _version = 2;
+  } else if (header.compare(0, magicLen, BINLOG_HEADER_V3) == 0) {
+    _version = 3;
+  } else {
+    return {ErrorCodes::ERR_DECODE, "bad head:" + _name};
+  }
+  _storeId = int32Decode(header.data() + magicLen);
+  _blockOffset = header.size();
+
+  _fs.seekg(0, std::ios::end);
+  _fileSize = _fs.tellg();
+  _fs.seekg(_blockOffset);
+  if (_version == 3) {
+    return readIndex();
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status BinlogFileReader::readIndex() {
+  if (_fileSize < BINLOG_HEADER_V2_LEN + BINLOG_FOOTER_V3_LEN) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  std::string trailer(BINLOG_FOOTER_V3_LEN, '\0');
+  _fs.seekg(_fileSize - trailer.size());
+  _fs.read(&trailer[0], trailer.size());
+  if (!_fs.good()) {
+    return {ErrorCodes::ERR_INTERNAL, "read binlog file failed:" + _name};
+  }
+  uint64_t indexOffset = int64Decode(trailer.data());
+  uint64_t indexEnd = _fileSize - trailer.size();
+  if (trailer.compare(sizeof(uint64_t), std::string::npos, BINLOG_FOOTER_V3) ||
+      indexOffset < BINLOG_HEADER_V2_LEN || indexOffset > indexEnd ||
+      (indexEnd - indexOffset) % BinlogBlockIndex::ENCODED_SIZE != 0) {
+    LOG(WARNING) << "binlog file without index:" << _name;
+    _fs.seekg(_blockOffset);
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  std::string buf(indexEnd - indexOffset, '\0');
+  _fs.seekg(indexOffset);
+  _fs.read(&buf[0], buf.size());
+  if (!_fs.good()) {
+    return {ErrorCodes::ERR_INTERNAL, "read binlog file failed:" + _name};
+  }
+  for (size_t i = 0; i < buf.size(); i += BinlogBlockIndex::ENCODED_SIZE) {
+    _index.push_back(BinlogBlockIndex::decode(buf.data() + i));
+  }
+  _hasIndex = true;
+  _fileSize = indexOffset;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+void BinlogFileReader::setRange(uint64_t startBinlogId,
+                                uint64_t endBinlogId,
+                                uint64_t startTs,
+                                uint64_t endTs) {
+  _startBinlogId = startBinlogId;
+  _endBinlogId = endBinlogId;
+  _startTs = startTs;
+  _endTs = endTs;
+}
+
+bool BinlogFileReader::inRange(const BinlogBlockIndex& index) const {
+  return index.lastBinlogId >= _startBinlogId &&
+    index.firstBinlogId <= _endBinlogId && index.maxTimestamp >= _startTs &&
+    index.minTimestamp <= _endTs;
+}
+
+Status BinlogFileReader::readBlock() {
+  if (_hasIndex) {
+    while (_blockIdx < _index.size() && !inRange(_index[_blockIdx])) {
+      // the binlog ids are ascending
+      if (_index[_blockIdx].firstBinlogId > _endBinlogId) {
+        _blockIdx = _index.size();
+        break;
+      }
+      _blockIdx++;
+    }
+    if (_blockIdx == _index.size()) {
+      return {ErrorCodes::ERR_EXHAUST, ""};
+    }
+    _blockOffset = _index[_blockIdx++].offset;
+  } else if (_blockOffset == _fileSize) {
+    return {ErrorCodes::ERR_EXHAUST, ""};
+  }
+
+  char hdr[sizeof(uint32_t) + 1];
+  _fs.seekg(_blockOffset);
+  _fs.read(hdr, sizeof(hdr));
+  if (!_fs.good()) {
+    return {ErrorCodes::ERR_DECODE, "incomplete block"};
+  }
+  uint32_t len = int32Decode(hdr);
+  auto codec = static_cast<Codec>(hdr[sizeof(uint32_t)]);
+  if (len == 0 || _fileSize - _blockOffset - sizeof(uint32_t) < len ||
+      (codec != Codec::NONE && codec != Codec::LZ4)) {
+    return {ErrorCodes::ERR_DECODE, "incomplete block"};
+  }
+  std::string frame(len - 1, '\0');
+  _fs.read(&frame[0], frame.size());
+  if (!_fs.good()) {
+    return {ErrorCodes::ERR_DECODE, "incomplete block"};
+  }
+  auto eBlock = uncompressFrame(codec, frame);
+  if (!eBlock.ok()) {
+    return eBlock.status();
+  }
+  _block = std::move(eBlock.value());
+  _blockPos = 0;
+  _blockOffset += sizeof(uint32_t) + len;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<ReplLogRawV2> BinlogFileReader::next() {
+  if (_version == 2) {
+    return readRecord(&_fs);
+  }
+  while (_blockPos == _block.size()) {
+    auto s = readBlock();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return decodeRecord(_block, &_blockPos);
+}
+
+Expected<uint64_t> BinlogFileReader::getLastBinlogId() {
+  if (_hasIndex) {
+    if (_index.empty()) {
+      return {ErrorCodes::ERR_NOTFOUND, ""};
+    }
+    return _index.back().lastBinlogId;
+  }
+  bool found = false;
+  uint64_t binlogId = 0;
+  while (true) {
+    auto eLog = next();
+    if (!eLog.ok()) {
+      if (eLog.status().code() == ErrorCodes::ERR_DECODE) {
+        LOG(WARNING) << "binlog file " << _name
+                     << " is torn:" << eLog.status().toString();
+      } else if (eLog.status().code() != ErrorCodes::ERR_EXHAUST) {
+        return eLog.status();
+      }
+      break;
+    }
+    found = true;
+    binlogId = eLog.value().getBinlogId();
+  }
+  if (!found) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  return binlogId;
+}
+
+}  // namespace tendisplus
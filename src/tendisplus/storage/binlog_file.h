@@ -0,0 +1,148 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_BINLOG_FILE_H_
+#define SRC_TENDISPLUS_STORAGE_BINLOG_FILE_H_
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "tendisplus/storage/record.h"
+#include "tendisplus/utils/compression.h"
+#include "tendisplus/utils/status.h"
+
+namespace tendisplus {
+
+// The files of the binlogs truncated by ReplManager::recycleBinlog().
+// Both versions begin with the header and the storeId(4), a binlog is
+// keylen(4) + key + vallen(4) + value.
+// v2: the binlogs one by one.
+// v3: blocks of binlogs, a block is blocklen(4) + codec(1) + frame, see
+//     compressFrame(). The footer indexes the blocks by binlog id and
+//     timestamp: [BinlogBlockIndex::ENCODED_SIZE]* + indexOffset(8) +
+//     BINLOG_FOOTER_V3. A file without footer (the server crashed) is read
+//     block by block.
+struct BinlogBlockIndex {
+  uint64_t offset = 0;
+  uint64_t firstBinlogId = 0;
+  uint64_t lastBinlogId = 0;
+  uint64_t minTimestamp = UINT64_MAX;
+  uint64_t maxTimestamp = 0;
+  uint32_t count = 0;
+
+  void add(uint64_t binlogId, uint64_t ts);
+  std::string encode() const;
+  static BinlogBlockIndex decode(const char* buf);
+  static constexpr size_t ENCODED_SIZE = 5 * sizeof(uint64_t) +
+    sizeof(uint32_t);
+};
+
+#define BINLOG_FOOTER_V3 "BLOGIDX3"
+#define BINLOG_FOOTER_V3_LEN (strlen(BINLOG_FOOTER_V3) + sizeof(uint64_t))
+
+class BinlogFileWriter {
+ public:
+  // Codec::NONE writes a v2 file, which the old binlog_tool can read
+  static Expected<std::unique_ptr<BinlogFileWriter>> create(
+    const std::string& name,
+    uint32_t storeId,
+    Codec codec,
+    size_t blockSize = DEFAULT_BLOCK_SIZE);
+  BinlogFileWriter(const BinlogFileWriter&) = delete;
+  BinlogFileWriter(BinlogFileWriter&&) = delete;
+  ~BinlogFileWriter();
+
+  // return the bytes written to the file, a v3 file keeps the binlogs in
+  // memory until a block is full. If it fails, the binlogs appended after
+  // the last flush() may be lost.
+  Expected<uint64_t> append(const ReplLogRawV2& log);
+  // write the binlogs kept in memory, return the bytes written
+  Expected<uint64_t> flush();
+  // flush() and write the footer
+  Status close();
+  bool good() const {
+    return _fs.good();
+  }
+  uint32_t getVersion() const {
+    return _codec == Codec::NONE ? 2 : 3;
+  }
+
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 256 * 1024;
+
+ private:
+  BinlogFileWriter(const std::string& name, Codec codec, size_t blockSize);
+
+  const std::string _name;
+  const Codec _codec;
+  const size_t _blockSize;
+  std::ofstream _fs;
+  uint64_t _offset;
+  bool _closed;
+  std::string _block;
+  BinlogBlockIndex _curIndex;
+  std::vector<BinlogBlockIndex> _index;
+};
+
+class BinlogFileReader {
+ public:
+  static Expected<std::unique_ptr<BinlogFileReader>> open(
+    const std::string& name);
+  BinlogFileReader(const BinlogFileReader&) = delete;
+  BinlogFileReader(BinlogFileReader&&) = delete;
+
+  uint32_t getStoreId() const {
+    return _storeId;
+  }
+  uint32_t getVersion() const {
+    return _version;
+  }
+  bool hasIndex() const {
+    return _hasIndex;
+  }
+  const std::vector<BinlogBlockIndex>& getIndex() const {
+    return _index;
+  }
+  // the blocks out of the range are skipped if the file has index, the
+  // binlogs of the blocks left are still to be filtered by the caller
+  void setRange(uint64_t startBinlogId,
+                uint64_t endBinlogId,
+                uint64_t startTs,
+                uint64_t endTs);
+  // ERR_EXHAUST at the end, ERR_DECODE if the file is torn or corrupted
+  Expected<ReplLogRawV2> next();
+  // the last binlog id, ERR_NOTFOUND if the file has no binlog. The torn
+  // tail of a crashed file is ignored.
+  Expected<uint64_t> getLastBinlogId();
+
+ private:
+  explicit BinlogFileReader(const std::string& name);
+  Status init();
+  Status readIndex();
+  bool inRange(const BinlogBlockIndex& index) const;
+  // ERR_EXHAUST if no block is left
+  Status readBlock();
+
+  const std::string _name;
+  std::ifstream _fs;
+  uint32_t _storeId;
+  uint32_t _version;
+  uint64_t _fileSize;
+  bool _hasIndex;
+  std::vector<BinlogBlockIndex> _index;
+  // the next block in _index, or the offset of it if no index
+  size_t _blockIdx;
+  uint64_t _blockOffset;
+  std::string _block;
+  size_t _blockPos;
+
+  uint64_t _startBinlogId;
+  uint64_t _endBinlogId;
+  uint64_t _startTs;
+  uint64_t _endTs;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_BINLOG_FILE_H_
@@ -0,0 +1,158 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "tendisplus/storage/binlog_file.h"
+#include "tendisplus/utils/portable.h"
+#include "tendisplus/utils/scopeguard.h"
+
+namespace tendisplus {
+
+ReplLogRawV2 genBinlog(uint64_t binlogId, uint64_t ts) {
+  std::vector<ReplLogValueEntryV2> entries;
+  entries.emplace_back(ReplOp::REPL_OP_SET,
+                       ts,
+                       "key" + std::to_string(binlogId),
+                       std::string(100, 'v'));
+  ReplLogValueV2 value(
+    0, ReplFlag::REPL_GROUP_START, binlogId, ts, 0, "set", nullptr, 0);
+  return ReplLogRawV2(ReplLogKeyV2(binlogId).encode(), value.encode(entries));
+}
+
+void writeBinlogs(const std::string& name,
+                  Codec codec,
+                  uint64_t count,
+                  size_t blockSize) {
+  auto eWriter = BinlogFileWriter::create(name, 3, codec, blockSize);
+  EXPECT_TRUE(eWriter.ok());
+  auto& writer = eWriter.value();
+  for (uint64_t id = 1; id <= count; id++) {
+    EXPECT_TRUE(writer->append(genBinlog(id, 1000 + id)).ok());
+    if (id % 100 == 0) {
+      EXPECT_TRUE(writer->flush().ok());
+    }
+  }
+  EXPECT_TRUE(writer->close().ok());
+}
+
+// the binlog ids read
+std::vector<uint64_t> readBinlogs(BinlogFileReader* reader) {
+  std::vector<uint64_t> ids;
+  while (true) {
+    auto eLog = reader->next();
+    if (!eLog.ok()) {
+      EXPECT_EQ(eLog.status().code(), ErrorCodes::ERR_EXHAUST);
+      break;
+    }
+    ids.push_back(eLog.value().getBinlogId());
+  }
+  return ids;
+}
+
+TEST(BinlogFile, V2) {
+  const auto guard = MakeGuard([] { remove("binlog-v2.log"); });
+  writeBinlogs("binlog-v2.log", Codec::NONE, 1000, 4096);
+
+  auto eReader = BinlogFileReader::open("binlog-v2.log");
+  EXPECT_TRUE(eReader.ok());
+  auto& reader = eReader.value();
+  EXPECT_EQ(reader->getVersion(), 2U);
+  EXPECT_EQ(reader->getStoreId(), 3U);
+  EXPECT_FALSE(reader->hasIndex());
+  auto ids = readBinlogs(reader.get());
+  EXPECT_EQ(ids.size(), 1000U);
+  EXPECT_EQ(ids.back(), 1000U);
+
+  eReader = BinlogFileReader::open("binlog-v2.log");
+  EXPECT_EQ(eReader.value()->getLastBinlogId().value(), 1000U);
+}
+
+TEST(BinlogFile, V3) {
+  const auto guard = MakeGuard([] {
+    remove("binlog-v2.log");
+    remove("binlog-v3.log");
+  });
+  writeBinlogs("binlog-v2.log", Codec::NONE, 1000, 4096);
+  writeBinlogs("binlog-v3.log", Codec::LZ4, 1000, 4096);
+  EXPECT_LT(filesystem::file_size("binlog-v3.log"),
+            filesystem::file_size("binlog-v2.log") / 2);
+
+  auto eReader = BinlogFileReader::open("binlog-v3.log");
+  EXPECT_TRUE(eReader.ok());
+  auto& reader = eReader.value();
+  EXPECT_EQ(reader->getVersion(), 3U);
+  EXPECT_EQ(reader->getStoreId(), 3U);
+  EXPECT_TRUE(reader->hasIndex());
+  const auto& index = reader->getIndex();
+  EXPECT_GT(index.size(), 10U);
+  EXPECT_EQ(index[0].firstBinlogId, 1U);
+  EXPECT_EQ(index[0].minTimestamp, 1001U);
+  EXPECT_EQ(index.back().lastBinlogId, 1000U);
+  for (size_t i = 1; i < index.size(); i++) {
+    EXPECT_EQ(index[i].firstBinlogId, index[i - 1].lastBinlogId + 1);
+  }
+  auto ids = readBinlogs(reader.get());
+  EXPECT_EQ(ids.size(), 1000U);
+  for (size_t i = 0; i < ids.size(); i++) {
+    EXPECT_EQ(ids[i], i + 1);
+  }
+  EXPECT_EQ(reader->getLastBinlogId().value(), 1000U);
+
+  // only the blocks of the range are read
+  auto seek = [](uint64_t startId, uint64_t endId,
+                 uint64_t startTs, uint64_t endTs) {
+    auto eReader = BinlogFileReader::open("binlog-v3.log");
+    EXPECT_TRUE(eReader.ok());
+    eReader.value()->setRange(startId, endId, startTs, endTs);
+    return readBinlogs(eReader.value().get());
+  };
+  ids = seek(500, 600, 0, UINT64_MAX);
+  EXPECT_LE(ids.front(), 500U);
+  EXPECT_GE(ids.back(), 600U);
+  EXPECT_LT(ids.size(), 300U);
+  ids = seek(0, UINT64_MAX, 1700, 1710);
+  EXPECT_LE(ids.front(), 700U);
+  EXPECT_GE(ids.back(), 710U);
+  EXPECT_LT(ids.size(), 200U);
+  EXPECT_TRUE(seek(2000, UINT64_MAX, 0, UINT64_MAX).empty());
+  EXPECT_TRUE(seek(0, UINT64_MAX, 0, 1000).empty());
+}
+
+TEST(BinlogFile, V3Torn) {
+  const auto guard = MakeGuard([] { remove("binlog-v3.log"); });
+  writeBinlogs("binlog-v3.log", Codec::LZ4, 1000, 4096);
+  auto eReader = BinlogFileReader::open("binlog-v3.log");
+  EXPECT_TRUE(eReader.ok());
+  auto last = eReader.value()->getIndex().back();
+
+  // crashed in writing the last block, without footer
+  filesystem::resize_file("binlog-v3.log", last.offset + 10);
+  eReader = BinlogFileReader::open("binlog-v3.log");
+  EXPECT_TRUE(eReader.ok());
+  auto& reader = eReader.value();
+  EXPECT_FALSE(reader->hasIndex());
+  uint64_t count = 0;
+  while (true) {
+    auto eLog = reader->next();
+    if (!eLog.ok()) {
+      EXPECT_EQ(eLog.status().code(), ErrorCodes::ERR_DECODE);
+      break;
+    }
+    EXPECT_EQ(eLog.value().getBinlogId(), ++count);
+  }
+  EXPECT_EQ(count, last.firstBinlogId - 1);
+
+  eReader = BinlogFileReader::open("binlog-v3.log");
+  EXPECT_EQ(eReader.value()->getLastBinlogId().value(), count);
+
+  // no binlog at all
+  filesystem::resize_file("binlog-v3.log", BINLOG_HEADER_V2_LEN);
+  eReader = BinlogFileReader::open("binlog-v3.log");
+  EXPECT_EQ(eReader.value()->getLastBinlogId().status().code(),
+            ErrorCodes::ERR_NOTFOUND);
+}
+
+}  // namespace tendisplus
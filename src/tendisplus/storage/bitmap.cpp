@@ -0,0 +1,309 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include "tendisplus/storage/bitmap.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/string.h"
+
+namespace tendisplus {
+
+Bitmap::Bitmap(uint32_t chunkId,
+               uint32_t dbId,
+               const std::string& pk,
+               const RecordValue& meta,
+               PStore store)
+  : _chunkId(chunkId),
+    _dbId(dbId),
+    _pk(pk),
+    _meta(meta),
+    _store(store),
+    _pieceSize(meta.getPieceSize()) {
+  INVARIANT_D(_meta.isPieced());
+  INVARIANT_D(_pieceSize > 0);
+}
+
+RecordValue Bitmap::newMeta(const Expected<RecordValue>& oldValue,
+                            uint64_t pieceSize,
+                            uint64_t version) {
+  uint64_t ttl = oldValue.ok() ? oldValue.value().getTtl() : 0;
+  RecordValue meta("", RecordType::RT_KV, -1, ttl, oldValue);
+  meta.setVersion(version);
+  meta.setPieceSize(pieceSize);
+  meta.setTotalSize(0);
+  return meta;
+}
+
+uint64_t Bitmap::size() const {
+  return _meta.getTotalSize();
+}
+
+RecordKey Bitmap::pieceKey(uint64_t idx) const {
+  char buf[sizeof(uint64_t)];
+  int64Encode(buf, idx);
+  return RecordKey(_chunkId,
+                   _dbId,
+                   RecordType::RT_KV_PIECE,
+                   _pk,
+                   std::string(buf, sizeof(buf)),
+                   _meta.getVersion());
+}
+
+Expected<std::string> Bitmap::getPiece(uint64_t idx, Transaction* txn) {
+  auto eValue = _store->getKV(pieceKey(idx), txn);
+  if (eValue.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    return std::string();
+  }
+  if (!eValue.ok()) {
+    return eValue.status();
+  }
+  return eValue.value().getValue();
+}
+
+Status Bitmap::forEachPiece(
+  uint64_t first,
+  uint64_t last,
+  Transaction* txn,
+  const std::function<bool(uint64_t, const std::string&)>& cb) {
+  std::string prefix = pieceKey(0).prefixPk();
+  auto cursor = txn->createPkCursor(prefix);
+  cursor->seek(pieceKey(first).encode());
+  while (true) {
+    Expected<Record> eRcd = cursor->next();
+    if (eRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    if (!eRcd.ok()) {
+      return eRcd.status();
+    }
+    const RecordKey& rk = eRcd.value().getRecordKey();
+    if (rk.prefixPk() != prefix) {
+      break;
+    }
+    const std::string& sk = rk.getSecondaryKey();
+    if (sk.size() != sizeof(uint64_t)) {
+      return {ErrorCodes::ERR_DECODE, "invalid piece:" + hexlify(sk)};
+    }
+    uint64_t idx = int64Decode(sk.c_str());
+    if (idx > last) {
+      break;
+    }
+    if (!cb(idx, eRcd.value().getRecordValue().getValue())) {
+      break;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<std::string> Bitmap::getRange(uint64_t start,
+                                       uint64_t end,
+                                       Transaction* txn) {
+  if (size() == 0 || start >= size()) {
+    return std::string();
+  }
+  end = std::min(end, size() - 1);
+  if (start > end) {
+    return std::string();
+  }
+  std::string result(end - start + 1, 0);
+  auto s = forEachPiece(
+    start / _pieceSize,
+    end / _pieceSize,
+    txn,
+    [&](uint64_t idx, const std::string& piece) {
+      uint64_t begin = idx * _pieceSize;
+      uint64_t from = std::max(begin, start);
+      uint64_t to = std::min(begin + piece.size(), end + 1);
+      if (from < to) {
+        memcpy(&result[from - start], piece.data() + from - begin, to - from);
+      }
+      return true;
+    });
+  if (!s.ok()) {
+    return s;
+  }
+  return result;
+}
+
+Expected<RecordValue> Bitmap::load(Transaction* txn) {
+  auto eValue = getRange(0, size(), txn);
+  if (!eValue.ok()) {
+    return eValue.status();
+  }
+  return RecordValue(std::move(eValue.value()),
+                     RecordType::RT_KV,
+                     _meta.getVersionEP(),
+                     _meta.getTtl(),
+                     _meta.getCas());
+}
+
+Expected<uint8_t> Bitmap::getBit(uint64_t offset, Transaction* txn) {
+  uint64_t byte = offset >> 3;
+  if (byte >= size()) {
+    return 0;
+  }
+  auto ePiece = getPiece(byte / _pieceSize, txn);
+  if (!ePiece.ok()) {
+    return ePiece.status();
+  }
+  uint64_t pos = byte % _pieceSize;
+  if (pos >= ePiece.value().size()) {
+    return 0;
+  }
+  uint8_t bit = 7 - (offset & 0x7);
+  return (static_cast<uint8_t>(ePiece.value()[pos]) >> bit) & 0x1;
+}
+
+Expected<uint8_t> Bitmap::setBit(uint64_t offset, bool on, Transaction* txn) {
+  uint64_t byte = offset >> 3;
+  uint64_t idx = byte / _pieceSize;
+  auto ePiece = getPiece(idx, txn);
+  if (!ePiece.ok()) {
+    return ePiece.status();
+  }
+  std::string& piece = ePiece.value();
+  uint64_t pos = byte % _pieceSize;
+  if (piece.size() < pos + 1) {
+    piece.resize(pos + 1, 0);
+  }
+  uint8_t byteval = static_cast<uint8_t>(piece[pos]);
+  uint8_t bit = 7 - (offset & 0x7);
+  uint8_t old = (byteval >> bit) & 0x1;
+  if (old != static_cast<uint8_t>(on)) {
+    byteval &= ~(1 << bit);
+    byteval |= (static_cast<uint8_t>(on) << bit);
+    piece[pos] = byteval;
+    auto s = _store->setKV(
+      pieceKey(idx), RecordValue(piece, RecordType::RT_KV_PIECE, -1), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (byte >= size()) {
+    _meta.setTotalSize(byte + 1);
+  }
+  return old;
+}
+
+Status Bitmap::setRange(uint64_t offset,
+                        const std::string& value,
+                        Transaction* txn) {
+  uint64_t done = 0;
+  while (done < value.size()) {
+    uint64_t byte = offset + done;
+    uint64_t idx = byte / _pieceSize;
+    uint64_t pos = byte % _pieceSize;
+    uint64_t len = std::min(_pieceSize - pos, value.size() - done);
+    std::string piece;
+    if (pos != 0 || len != _pieceSize) {
+      // only a part of the piece is overwritten
+      auto ePiece = getPiece(idx, txn);
+      if (!ePiece.ok()) {
+        return ePiece.status();
+      }
+      piece = std::move(ePiece.value());
+      if (piece.size() < pos + len) {
+        piece.resize(pos + len, 0);
+      }
+      piece.replace(pos, len, value, done, len);
+    } else {
+      piece = value.substr(done, len);
+    }
+    auto s = _store->setKV(
+      pieceKey(idx), RecordValue(piece, RecordType::RT_KV_PIECE, -1), txn);
+    if (!s.ok()) {
+      return s;
+    }
+    done += len;
+  }
+  if (offset + value.size() > size()) {
+    _meta.setTotalSize(offset + value.size());
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<uint64_t> Bitmap::bitCount(uint64_t start,
+                                    uint64_t end,
+                                    Transaction* txn) {
+  uint64_t count = 0;
+  if (size() == 0 || start >= size()) {
+    return count;
+  }
+  end = std::min(end, size() - 1);
+  auto s = forEachPiece(
+    start / _pieceSize,
+    end / _pieceSize,
+    txn,
+    [&](uint64_t idx, const std::string& piece) {
+      uint64_t begin = idx * _pieceSize;
+      uint64_t from = std::max(begin, start);
+      uint64_t to = std::min(begin + piece.size(), end + 1);
+      if (from < to) {
+        count +=
+          redis_port::popCount(piece.data() + from - begin, to - from);
+      }
+      return true;
+    });
+  if (!s.ok()) {
+    return s;
+  }
+  return count;
+}
+
+Expected<int64_t> Bitmap::bitPos(uint32_t bit,
+                                 uint64_t start,
+                                 uint64_t end,
+                                 Transaction* txn) {
+  INVARIANT_D(start <= end && end < size());
+  int64_t result = -1;
+  // the first byte not checked yet
+  uint64_t next = start;
+  auto s = forEachPiece(
+    start / _pieceSize,
+    end / _pieceSize,
+    txn,
+    [&](uint64_t idx, const std::string& piece) {
+      uint64_t begin = idx * _pieceSize;
+      uint64_t from = std::max(begin, start);
+      uint64_t to = std::min(begin + piece.size(), end + 1);
+      if (bit == 0 && next < from) {
+        // the missing bytes before the piece are zeros
+        result = (next - start) * 8;
+        return false;
+      }
+      if (from >= to) {
+        return true;
+      }
+      int64_t pos =
+        redis_port::bitPos(piece.data() + from - begin, to - from, bit);
+      if ((bit == 1 && pos != -1) ||
+          (bit == 0 && pos != static_cast<int64_t>(to - from) * 8)) {
+        result = (from - start) * 8 + pos;
+        return false;
+      }
+      next = to;
+      return true;
+    });
+  if (!s.ok()) {
+    return s;
+  }
+  if (result != -1 || bit == 1) {
+    return result;
+  }
+  // no zero in the pieces, the bytes after them are zeros. As
+  // redis_port::bitPos(), the string is taken as padded with zeros
+  return static_cast<int64_t>(next - start) * 8;
+}
+
+Status Bitmap::save(Transaction* txn, uint64_t versionEP) {
+  RecordKey mk(_chunkId, _dbId, RecordType::RT_KV, _pk, "");
+  _meta.setVersionEP(versionEP);
+  return _store->setKV(mk, _meta, txn);
+}
+
+}  // namespace tendisplus
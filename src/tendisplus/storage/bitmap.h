@@ -0,0 +1,87 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_BITMAP_H_
+#define SRC_TENDISPLUS_STORAGE_BITMAP_H_
+
+#include <functional>
+#include <string>
+#include "tendisplus/storage/record.h"
+#include "tendisplus/storage/kvstore.h"
+
+namespace tendisplus {
+
+// NOTE: a big string may be stored in pieces, so that SETBIT and GETBIT
+// read and write one piece rather than the whole string, and BITCOUNT,
+// BITPOS and BITOP go through the pieces of the range only.
+// The meta of a pieced string is a RT_KV with an empty value, its
+// pieceSize is the bytes of a piece and its totalSize is the length of
+// the string. The piece n, the bytes in [n * pieceSize, (n + 1) * pieceSize),
+// is a RT_KV_PIECE record of the version of the meta, whose subkey is n
+// in big-endian. A piece may be shorter than pieceSize, or not exist at
+// all, the bytes missing are zeros.
+// If a pieced meta is overwritten or deleted, the txn records its version
+// in the GCIndex, see RocksTxn::countKey(). A new pieced meta gets a
+// version from Command::getSubkeyVersion(), so the pieces of the strings
+// deleted or overwritten before are never seen. They are reclaimed by
+// GCManager or the compaction filter.
+class Bitmap {
+ public:
+  Bitmap(uint32_t chunkId,
+         uint32_t dbId,
+         const std::string& pk,
+         const RecordValue& meta,
+         PStore store);
+  // an empty pieced meta inheriting the ttl and cas of oldValue
+  static RecordValue newMeta(const Expected<RecordValue>& oldValue,
+                             uint64_t pieceSize,
+                             uint64_t version);
+
+  const RecordValue& getMeta() const {
+    return _meta;
+  }
+  uint64_t size() const;
+  // the bytes in [start, end] of the string, end is cut to size() - 1
+  Expected<std::string> getRange(uint64_t start,
+                                 uint64_t end,
+                                 Transaction* txn);
+  // the whole string as a not pieced RecordValue
+  Expected<RecordValue> load(Transaction* txn);
+  Expected<uint8_t> getBit(uint64_t offset, Transaction* txn);
+  // return the old bit, size() grows if offset is beyond the end
+  Expected<uint8_t> setBit(uint64_t offset, bool on, Transaction* txn);
+  // overwrite the bytes from offset with value
+  Status setRange(uint64_t offset, const std::string& value, Transaction* txn);
+  // the same with redis_port::popCount() of the bytes in [start, end]
+  Expected<uint64_t> bitCount(uint64_t start, uint64_t end, Transaction* txn);
+  // the same with redis_port::bitPos() of the bytes in [start, end]
+  Expected<int64_t> bitPos(uint32_t bit,
+                           uint64_t start,
+                           uint64_t end,
+                           Transaction* txn);
+  // write the meta, the pieces are written by setBit() and setRange()
+  Status save(Transaction* txn, uint64_t versionEP);
+
+ private:
+  RecordKey pieceKey(uint64_t idx) const;
+  Expected<std::string> getPiece(uint64_t idx, Transaction* txn);
+  // call cb with the index and the content of the existing pieces in
+  // [first, last], in order. Stop if cb returns false.
+  Status forEachPiece(
+    uint64_t first,
+    uint64_t last,
+    Transaction* txn,
+    const std::function<bool(uint64_t, const std::string&)>& cb);
+
+  const uint32_t _chunkId;
+  const uint32_t _dbId;
+  const std::string _pk;
+  RecordValue _meta;
+  PStore _store;
+  const uint64_t _pieceSize;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_BITMAP_H_
@@ -0,0 +1,237 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+#include "tendisplus/utils/status.h"
+#include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/portable.h"
+#include "tendisplus/utils/redis_port.h"
+#include "tendisplus/storage/bitmap.h"
+#include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/rocks/rocks_kvstore.h"
+#include "tendisplus/server/server_params.h"
+
+namespace tendisplus {
+
+std::shared_ptr<ServerParams> genParams() {
+  const auto guard = MakeGuard([] { remove("a.cfg"); });
+  std::ofstream myfile;
+  myfile.open("a.cfg");
+  myfile << "bind 127.0.0.1\n";
+  myfile << "port 8903\n";
+  myfile << "loglevel debug\n";
+  myfile << "logdir ./log\n";
+  myfile << "storage rocks\n";
+  myfile << "dir ./db\n";
+  myfile << "rocks.blockcachemb 4096\n";
+  myfile.close();
+  auto cfg = std::make_shared<ServerParams>();
+  auto s = cfg->parseFile("a.cfg");
+  EXPECT_EQ(s.ok(), true) << s.toString();
+  return cfg;
+}
+
+// check bm against the same string kept in memory
+void checkBitmap(Bitmap* bm, const std::string& expected, Transaction* txn) {
+  EXPECT_EQ(bm->size(), expected.size());
+  auto eLoad = bm->load(txn);
+  EXPECT_TRUE(eLoad.ok());
+  EXPECT_FALSE(eLoad.value().isPieced());
+  EXPECT_EQ(eLoad.value().getValue(), expected);
+
+  for (uint64_t start = 0; start < expected.size(); start += 7) {
+    for (uint64_t end = start; end < expected.size(); end += 13) {
+      auto eRange = bm->getRange(start, end, txn);
+      EXPECT_TRUE(eRange.ok());
+      EXPECT_EQ(eRange.value(), expected.substr(start, end - start + 1));
+
+      auto eCount = bm->bitCount(start, end, txn);
+      EXPECT_TRUE(eCount.ok());
+      EXPECT_EQ(eCount.value(),
+                redis_port::popCount(expected.c_str() + start,
+                                     end - start + 1));
+
+      for (uint32_t bit = 0; bit <= 1; bit++) {
+        auto ePos = bm->bitPos(bit, start, end, txn);
+        EXPECT_TRUE(ePos.ok());
+        EXPECT_EQ(ePos.value(),
+                  redis_port::bitPos(
+                    expected.c_str() + start, end - start + 1, bit))
+          << start << " " << end << " " << bit;
+      }
+    }
+  }
+}
+
+TEST(Bitmap, Common) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+
+  uint64_t version = 1;
+  RecordValue meta =
+    Bitmap::newMeta({ErrorCodes::ERR_NOTFOUND, ""}, 16, version);
+  EXPECT_TRUE(meta.isPieced());
+  Bitmap bm(0, 0, "test", meta, store);
+  std::string expected;
+
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+
+  // a sparse bitmap, most of the pieces are missing
+  for (uint64_t offset : {3, 7, 100, 1000, 1001, 2047}) {
+    auto eOld = bm.setBit(offset, true, txn);
+    EXPECT_TRUE(eOld.ok());
+    EXPECT_EQ(eOld.value(), 0);
+    if (expected.size() < (offset >> 3) + 1) {
+      expected.resize((offset >> 3) + 1, 0);
+    }
+    expected[offset >> 3] |= 1 << (7 - (offset & 0x7));
+  }
+  auto eOld = bm.setBit(1000, false, txn);
+  EXPECT_TRUE(eOld.ok());
+  EXPECT_EQ(eOld.value(), 1);
+  expected[1000 >> 3] &= ~(1 << (7 - (1000 & 0x7)));
+  for (uint64_t offset : {3, 4, 1000, 1001, 5000}) {
+    auto eBit = bm.getBit(offset, txn);
+    EXPECT_TRUE(eBit.ok());
+    EXPECT_EQ(eBit.value(),
+              (offset >> 3) < expected.size()
+                ? (static_cast<uint8_t>(expected[offset >> 3]) >>
+                   (7 - (offset & 0x7))) & 0x1
+                : 0);
+  }
+  checkBitmap(&bm, expected, txn);
+
+  // overwrite across the pieces, and grow the bitmap
+  std::string value(50, '\xff');
+  EXPECT_TRUE(bm.setRange(20, value, txn).ok());
+  expected.replace(20, value.size(), value);
+  EXPECT_TRUE(bm.setRange(expected.size() + 5, value, txn).ok());
+  expected.resize(expected.size() + 5, 0);
+  expected.append(value);
+  checkBitmap(&bm, expected, txn);
+
+  // reload from the store
+  EXPECT_TRUE(bm.save(txn, 1).ok());
+  EXPECT_TRUE(txn->commit().ok());
+  eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  txn = eTxn.value().get();
+  RecordKey mk(0, 0, RecordType::RT_KV, "test", "");
+  auto eMeta = store->getKV(mk, txn);
+  EXPECT_TRUE(eMeta.ok());
+  EXPECT_TRUE(eMeta.value().isPieced());
+  EXPECT_EQ(eMeta.value().getPieceSize(), 16U);
+  EXPECT_EQ(eMeta.value().getTotalSize(), expected.size());
+  EXPECT_EQ(eMeta.value().getVersion(), version);
+  EXPECT_TRUE(eMeta.value().getValue().empty());
+  auto eCnt = rcd_util::getSubKeyCount(mk, eMeta.value());
+  EXPECT_TRUE(eCnt.ok());
+  EXPECT_EQ(eCnt.value(), (expected.size() + 15) / 16);
+
+  Bitmap bm2(0, 0, "test", eMeta.value(), store);
+  checkBitmap(&bm2, expected, txn);
+
+  // the pieces of another version are not seen
+  RecordValue meta2 =
+    Bitmap::newMeta(eMeta.value(), 16, version + 1);
+  Bitmap bm3(0, 0, "test", meta2, store);
+  EXPECT_EQ(bm3.size(), 0U);
+  EXPECT_TRUE(bm3.setRange(0, std::string(100, 0), txn).ok());
+  checkBitmap(&bm3, std::string(100, 0), txn);
+  RecordKey piece(0,
+                  0,
+                  RecordType::RT_KV_PIECE,
+                  "test",
+                  std::string(8, 0),
+                  meta2.getVersion());
+  EXPECT_TRUE(rcd_util::isSubkeyOf(piece, meta2));
+  EXPECT_FALSE(rcd_util::isSubkeyOf(piece, eMeta.value()));
+  EXPECT_FALSE(rcd_util::isSubkeyOf(
+    piece, RecordValue("", RecordType::RT_KV, -1, 0, -1, meta2.getVersion())));
+}
+
+TEST(Bitmap, GCIndex) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  RecordKey mk(0, 0, RecordType::RT_KV, "test", "");
+  RecordKey indexRk = GCIndex(0, 0, "test").getRecordKey();
+
+  auto setPieced = [&](uint64_t version) {
+    auto eTxn = store->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    Bitmap bm(0,
+              0,
+              "test",
+              Bitmap::newMeta({ErrorCodes::ERR_NOTFOUND, ""}, 16, version),
+              store);
+    EXPECT_TRUE(bm.setRange(0, std::string(100, 'a'), eTxn.value().get()).ok());
+    EXPECT_TRUE(bm.save(eTxn.value().get(), 1).ok());
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+  };
+  auto getIndexVersion = [&]() -> uint64_t {
+    auto eTxn = store->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    auto eValue = store->getKV(indexRk, eTxn.value().get());
+    if (!eValue.ok()) {
+      EXPECT_EQ(eValue.status().code(), ErrorCodes::ERR_NOTFOUND);
+      return 0;
+    }
+    auto eIndex = GCIndex::decode(indexRk, eValue.value());
+    EXPECT_TRUE(eIndex.ok());
+    auto types = eIndex.value().getTypes();
+    EXPECT_EQ(types.size(), 1U);
+    EXPECT_EQ(types[0], RecordType::RT_KV);
+    return eIndex.value().getVersion();
+  };
+
+  // a pieced string saved again keeps its pieces
+  setPieced(5);
+  setPieced(5);
+  EXPECT_EQ(getIndexVersion(), 0U);
+
+  // overwritten by a plain string
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  EXPECT_TRUE(store
+                ->setKV(mk,
+                        RecordValue("abc", RecordType::RT_KV, -1),
+                        eTxn.value().get())
+                .ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  EXPECT_EQ(getIndexVersion(), 5U);
+
+  // deleted, the newest version is kept
+  setPieced(7);
+  setPieced(3);
+  EXPECT_EQ(getIndexVersion(), 7U);
+  eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  EXPECT_TRUE(store->delKV(mk, eTxn.value().get()).ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  EXPECT_EQ(getIndexVersion(), 7U);
+}
+
+}  // namespace tendisplus
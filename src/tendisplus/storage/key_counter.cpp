@@ -0,0 +1,104 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <iterator>
+#include "tendisplus/storage/key_counter.h"
+#include "tendisplus/utils/string.h"
+
+namespace tendisplus {
+
+KeyCounter::KeyCounter() : _slotKeys(CLUSTER_SLOTS, 0) {}
+
+void KeyCounter::applyInLock(uint32_t chunkId, uint32_t dbId, int64_t delta) {
+  if (chunkId >= CLUSTER_SLOTS || delta == 0) {
+    return;
+  }
+  auto& count = _counts[{chunkId, dbId}];
+  count += delta;
+  if (count == 0) {
+    _counts.erase({chunkId, dbId});
+  }
+  auto& dbCount = _dbKeys[dbId];
+  dbCount += delta;
+  if (dbCount == 0) {
+    _dbKeys.erase(dbId);
+  }
+  _slotKeys[chunkId] += delta;
+}
+
+void KeyCounter::apply(const Counts& deltas) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  for (const auto& v : deltas) {
+    applyInLock(v.first.first, v.first.second, v.second);
+  }
+}
+
+void KeyCounter::clear() {
+  std::lock_guard<std::mutex> lk(_mutex);
+  _counts.clear();
+  _dbKeys.clear();
+  _slotKeys.assign(CLUSTER_SLOTS, 0);
+  _expired.clear();
+}
+
+void KeyCounter::clearChunks(uint32_t begin, uint32_t end) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  auto it = _counts.lower_bound({begin, 0});
+  while (it != _counts.end() && it->first.first < end) {
+    int64_t count = it->second;
+    uint32_t chunkId = it->first.first;
+    uint32_t dbId = it->first.second;
+    ++it;
+    applyInLock(chunkId, dbId, -count);
+  }
+}
+
+int64_t KeyCounter::keys(uint32_t chunkId, uint32_t dbId) const {
+  std::lock_guard<std::mutex> lk(_mutex);
+  auto it = _counts.find({chunkId, dbId});
+  return it == _counts.end() ? 0 : it->second;
+}
+
+int64_t KeyCounter::dbKeys(uint32_t dbId) const {
+  std::lock_guard<std::mutex> lk(_mutex);
+  auto it = _dbKeys.find(dbId);
+  return it == _dbKeys.end() ? 0 : it->second;
+}
+
+int64_t KeyCounter::slotKeys(uint32_t chunkId) const {
+  if (chunkId >= CLUSTER_SLOTS) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lk(_mutex);
+  return _slotKeys[chunkId];
+}
+
+std::map<uint32_t, int64_t> KeyCounter::allDbKeys() const {
+  std::lock_guard<std::mutex> lk(_mutex);
+  return _dbKeys;
+}
+
+KeyCounter::Counts KeyCounter::getCounts() const {
+  std::lock_guard<std::mutex> lk(_mutex);
+  return _counts;
+}
+
+void KeyCounter::addExpired(TTLIndex&& index) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  if (_expired.size() < MAX_EXPIRED) {
+    _expired.emplace_back(std::move(index));
+  }
+}
+
+std::list<TTLIndex> KeyCounter::takeExpired(size_t n) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  std::list<TTLIndex> expired;
+  auto end = _expired.begin();
+  std::advance(end, std::min(n, _expired.size()));
+  expired.splice(expired.end(), _expired, _expired.begin(), end);
+  return expired;
+}
+
+}  // namespace tendisplus
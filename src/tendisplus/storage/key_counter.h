@@ -0,0 +1,66 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_KEY_COUNTER_H_
+#define SRC_TENDISPLUS_STORAGE_KEY_COUNTER_H_
+
+#include <list>
+#include <map>
+#include <mutex>  // NOLINT
+#include <utility>
+#include <vector>
+#include "tendisplus/storage/record.h"
+
+namespace tendisplus {
+
+// the exact number of the keys in a kvstore, per (chunk, db), per db and
+// per slot. It is the in-memory copy of the KeyCount records, loaded when
+// the store is opened and updated after the txns writing the metas are
+// committed, see RocksTxn::commit(). Only the data chunks are counted.
+// The expired keys are counted until they are deleted, as redis does.
+class KeyCounter {
+ public:
+  // (chunkId, dbId) -> count or delta
+  using Counts = std::map<std::pair<uint32_t, uint32_t>, int64_t>;
+
+  KeyCounter();
+  KeyCounter(const KeyCounter&) = delete;
+  KeyCounter(KeyCounter&&) = delete;
+
+  void apply(const Counts& deltas);
+  void clear();
+  // forget the counts of the chunks in [begin, end)
+  void clearChunks(uint32_t begin, uint32_t end);
+
+  int64_t keys(uint32_t chunkId, uint32_t dbId) const;
+  int64_t dbKeys(uint32_t dbId) const;
+  int64_t slotKeys(uint32_t chunkId) const;
+  // dbId -> count, the dbs without keys are omitted
+  std::map<uint32_t, int64_t> allDbKeys() const;
+  Counts getCounts() const;
+
+  // the expired strings found by the compaction filter. The compaction
+  // can't count the keys it drops exactly, so it keeps them. The strings
+  // are deleted by their ttl indexes, see RocksTxn::countKey(), this only
+  // covers the ones written before them, by IndexManager as well. At most
+  // MAX_EXPIRED keys are kept here, the others are found by the later
+  // compactions.
+  void addExpired(TTLIndex&& index);
+  std::list<TTLIndex> takeExpired(size_t n);
+
+  static constexpr size_t MAX_EXPIRED = 10000;
+
+ private:
+  void applyInLock(uint32_t chunkId, uint32_t dbId, int64_t delta);
+
+  mutable std::mutex _mutex;
+  Counts _counts;
+  std::map<uint32_t, int64_t> _dbKeys;
+  std::vector<int64_t> _slotKeys;
+  std::list<TTLIndex> _expired;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_KEY_COUNTER_H_
@@ -0,0 +1,71 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <string>
+#include "gtest/gtest.h"
+#include "tendisplus/storage/key_counter.h"
+
+namespace tendisplus {
+
+TEST(KeyCounter, Common) {
+  KeyCounter counter;
+  counter.apply({{{0, 0}, 3}, {{0, 1}, 2}, {{5, 0}, 4}, {{16383, 2}, 1}});
+  EXPECT_EQ(counter.keys(0, 0), 3);
+  EXPECT_EQ(counter.keys(0, 1), 2);
+  EXPECT_EQ(counter.keys(1, 0), 0);
+  EXPECT_EQ(counter.dbKeys(0), 7);
+  EXPECT_EQ(counter.dbKeys(1), 2);
+  EXPECT_EQ(counter.dbKeys(3), 0);
+  EXPECT_EQ(counter.slotKeys(0), 5);
+  EXPECT_EQ(counter.slotKeys(16383), 1);
+  EXPECT_EQ(counter.slotKeys(16384), 0);
+
+  // the chunks out of the slots are ignored
+  counter.apply({{{16384, 0}, 1}, {{0, 0}, -3}});
+  EXPECT_EQ(counter.keys(0, 0), 0);
+  EXPECT_EQ(counter.dbKeys(0), 4);
+  EXPECT_EQ(counter.slotKeys(0), 2);
+  std::map<uint32_t, int64_t> dbKeys = {{0, 4}, {1, 2}, {2, 1}};
+  EXPECT_EQ(counter.allDbKeys(), dbKeys);
+  KeyCounter::Counts counts = {{{0, 1}, 2}, {{5, 0}, 4}, {{16383, 2}, 1}};
+  EXPECT_EQ(counter.getCounts(), counts);
+
+  counter.clearChunks(1, 16383);
+  EXPECT_EQ(counter.dbKeys(0), 0);
+  EXPECT_EQ(counter.dbKeys(1), 2);
+  EXPECT_EQ(counter.slotKeys(5), 0);
+  EXPECT_EQ(counter.slotKeys(16383), 1);
+
+  counter.clear();
+  EXPECT_TRUE(counter.getCounts().empty());
+  EXPECT_TRUE(counter.allDbKeys().empty());
+  EXPECT_EQ(counter.slotKeys(16383), 0);
+}
+
+TEST(KeyCounter, Expired) {
+  KeyCounter counter;
+  counter.apply({{{1, 0}, 3}});
+  for (uint32_t i = 0; i < KeyCounter::MAX_EXPIRED + 10; i++) {
+    counter.addExpired(TTLIndex(std::to_string(i), RecordType::RT_KV, 0, 1));
+  }
+  // counted until they are deleted
+  EXPECT_EQ(counter.keys(1, 0), 3);
+
+  auto expired = counter.takeExpired(2);
+  EXPECT_EQ(expired.size(), 2U);
+  EXPECT_EQ(expired.front().getPriKey(), "0");
+  EXPECT_EQ(expired.back().getPriKey(), "1");
+  EXPECT_EQ(expired.front().getType(), RecordType::RT_KV);
+
+  expired = counter.takeExpired(KeyCounter::MAX_EXPIRED);
+  EXPECT_EQ(expired.size(), KeyCounter::MAX_EXPIRED - 2);
+  EXPECT_EQ(expired.front().getPriKey(), "2");
+  EXPECT_TRUE(counter.takeExpired(10).empty());
+
+  counter.addExpired(TTLIndex("a", RecordType::RT_KV, 0, 1));
+  counter.clear();
+  EXPECT_TRUE(counter.takeExpired(10).empty());
+}
+
+}  // namespace tendisplus
@@ -2,7 +2,6 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
-#include <fstream>
 #include "glog/logging.h"
 #include "tendisplus/storage/kvstore.h"
 #include "tendisplus/utils/portable.h"
@@ -208,9 +207,12 @@ Expected<ReplLogV2> RepllogCursorV2::nextV2() {
   return {ErrorCodes::ERR_EXHAUST, ""};
 }
 
-BasicDataCursor::BasicDataCursor(std::unique_ptr<Cursor> cursor)
+BasicDataCursor::BasicDataCursor(std::unique_ptr<Cursor> cursor,
+                                 bool seekFirst)
   : _baseCursor(std::move(cursor)) {
-  _baseCursor->seek("");
+  if (seekFirst) {
+    _baseCursor->seek("");
+  }
 }
 
 void BasicDataCursor::seek(const std::string& prefix) {
@@ -268,8 +270,23 @@ void AllDataCursor::seekToLast() {
   _baseCursor->seekToLast();
 }
 
+// the key counts are kept with the data, but they are not data
+static bool skipKeyCounts(Cursor* cursor, uint32_t chunkId) {
+  if (chunkId != KeyCount::CHUNKID) {
+    return false;
+  }
+  RecordKey next(KeyCount::CHUNKID + 1, 0, RecordType::RT_INVALID, "", "");
+  cursor->seek(next.prefixChunkid());
+  return true;
+}
+
 Expected<Record> AllDataCursor::next() {
   auto expRcd = _baseCursor->next();
+  if (expRcd.ok() &&
+      skipKeyCounts(_baseCursor.get(),
+                    expRcd.value().getRecordKey().getChunkId())) {
+    return next();
+  }
   if (expRcd.ok()) {
     Record dataRecord(expRcd.value());
     if (dataRecord.getRecordKey().getRecordType() != RecordType::RT_BINLOG) {
@@ -288,6 +305,11 @@ Status AllDataCursor::prev() {
 
 Expected<std::string> AllDataCursor::key() {
   auto expKey = _baseCursor->key();
+  if (expKey.ok() &&
+      skipKeyCounts(_baseCursor.get(),
+                    RecordKey::decodeChunkId(expKey.value()))) {
+    expKey = _baseCursor->key();
+  }
   if (expKey.ok()) {
     std::string dataKey = expKey.value();
     if (RecordKey::decodeType(dataKey) != RecordType::RT_BINLOG) {
@@ -421,6 +443,25 @@ Expected<VersionMeta> VersionMetaCursor::next() {
   }
 }
 
+GCIndexCursor::GCIndexCursor(std::unique_ptr<Cursor> cursor)
+  : _baseCursor(std::move(cursor)) {
+  _baseCursor->seek(RecordKey::prefixGCIndex());
+}
+
+Expected<GCIndex> GCIndexCursor::next() {
+  Expected<Record> expRcd = _baseCursor->next();
+  if (expRcd.ok()) {
+    const RecordKey& rk = expRcd.value().getRecordKey();
+    if (rk.getChunkId() != GCIndex::CHUNKID ||
+        rk.getRecordType() != RecordType::RT_META) {
+      return {ErrorCodes::ERR_EXHAUST, "no more gc index"};
+    }
+    return GCIndex::decode(rk, expRcd.value().getRecordValue());
+  } else {
+    return expRcd.status();
+  }
+}
+
 SlotCursor::SlotCursor(std::unique_ptr<Cursor> cursor, uint32_t slot)
   : _slot(slot), _baseCursor(std::move(cursor)) {
   RecordKey tmplRk(slot, 0, RecordType::RT_DATA_META, "", "");
@@ -495,30 +536,6 @@ uint64_t KVStore::getCurrentTime() {
   return ts;
 }
 
-std::ofstream* KVStore::createBinlogFile(const std::string& name,
-                                         uint32_t storeId) {
-  std::ofstream* fs = new std::ofstream(
-    name.c_str(), std::ios::out | std::ios::app | std::ios::binary);
-  if (!fs->is_open()) {
-    LOG(ERROR) << "fs->is_open() failed:" << name;
-    return nullptr;
-  }
-
-  // the header
-  fs->write(BINLOG_HEADER_V2, strlen(BINLOG_HEADER_V2));
-  if (!fs->good()) {
-    LOG(ERROR) << "fs->write() failed:" << name;
-    return nullptr;
-  }
-  uint32_t storeIdTrans = htobe32(storeId);
-  fs->write(reinterpret_cast<char*>(&storeIdTrans), sizeof(storeIdTrans));
-  if (!fs->good()) {
-    LOG(ERROR) << "fs->write() failed:" << name;
-    return nullptr;
-  }
-  return fs;
-}
-
 BackupInfo::BackupInfo()
   : _binlogPos(Transaction::TXNID_UNINITED),
     _backupMode(0),
@@ -28,6 +28,7 @@
 
 namespace tendisplus {
 
+class BinlogFileWriter;
 class KVStore;
 class Record;
 class ReplLogValueEntryV2;
@@ -38,6 +39,11 @@ class TTLIndex;
 class RecordKey;
 class RecordValue;
 class VersionMeta;
+class GCIndex;
+class ZSetIndexCache;
+struct ZSetIndexUpdate;
+class RecordCache;
+class KeyCounter;
 enum class RecordType;
 
 enum class BinlogVersion : uint8_t {
@@ -91,7 +97,8 @@ class RepllogCursorV2 {
 class BasicDataCursor {
  public:
   BasicDataCursor() = delete;
-  explicit BasicDataCursor(std::unique_ptr<Cursor>);
+  // seekFirst is false if the cursor has been positioned by its creator
+  explicit BasicDataCursor(std::unique_ptr<Cursor>, bool seekFirst = true);
   ~BasicDataCursor() = default;
   void seek(const std::string& prefix);
   // void seekToLast();
@@ -165,6 +172,17 @@ class VersionMetaCursor {
   std::unique_ptr<Cursor> _baseCursor;
 };
 
+class GCIndexCursor {
+ public:
+  GCIndexCursor() = delete;
+  explicit GCIndexCursor(std::unique_ptr<Cursor> cursor);
+  ~GCIndexCursor() = default;
+  Expected<GCIndex> next();
+
+ protected:
+  std::unique_ptr<Cursor> _baseCursor;
+};
+
 class SlotCursor {
  public:
   SlotCursor() = delete;
@@ -230,17 +248,31 @@ class Transaction {
   virtual std::unique_ptr<SlotsCursor> createSlotsCursor(uint32_t start,
                                                          uint32_t end) = 0;
   virtual std::unique_ptr<VersionMetaCursor> createVersionMetaCursor() = 0;
+  virtual std::unique_ptr<GCIndexCursor> createGCIndexCursor() = 0;
   virtual std::unique_ptr<BasicDataCursor> createDataCursor() = 0;
+  // a data cursor positioned at prefix, which is a RecordKey::prefixPk().
+  // it may stop at the last key of the pk (ERR_EXHAUST) rather than going
+  // on to the next pk, so it can use the prefix blooms
+  virtual std::unique_ptr<BasicDataCursor> createPkCursor(
+    const std::string& prefix) = 0;
   virtual std::unique_ptr<AllDataCursor> createAllDataCursor() = 0;
   virtual std::unique_ptr<BinlogCursor> createBinlogCursor() = 0;
 
   virtual Expected<std::string> getKV(const std::string& key) = 0;
+  // batched getKV() of the data column family, the result is in the
+  // same order with keys
+  virtual std::vector<Expected<std::string>> getKVs(
+    const std::vector<std::string>& keys) = 0;
   virtual Status setKV(const std::string& key,
                        const std::string& val,
                        const uint64_t ts = 0) = 0;
   virtual Status delKV(const std::string& key, const uint64_t ts = 0) = 0;
   virtual Status addDeleteRangeBinlog(const std::string& begin,
                                       const std::string& end) = 0;
+  // update the cached ZSetIndex of the zset meta key after commit, rather
+  // than invalidating it. It must be called after the meta is written.
+  virtual void updateZSetIndex(const std::string& key,
+                               ZSetIndexUpdate&& update) = 0;
   virtual uint64_t getBinlogTime() = 0;
   virtual void setBinlogTime(uint64_t timestamp) = 0;
   virtual bool isReplOnly() const = 0;
@@ -296,6 +328,8 @@ class BinlogObserver {
 struct KVStoreStat {
   std::atomic<uint64_t> compactFilterCount;
   std::atomic<uint64_t> compactKvExpiredCount;
+  // subkeys dropped by compaction since their meta is gone or expired
+  std::atomic<uint64_t> compactSubkeyReclaimedCount{0};
   // number of request when store is paused
   std::atomic<uint64_t> pausedErrorCount;
   // number of request when store is destroyed
@@ -304,6 +338,9 @@ struct KVStoreStat {
 
 #define BINLOG_HEADER_V2 "BINLOG_V2\r\n"
 #define BINLOG_HEADER_V2_LEN (strlen(BINLOG_HEADER_V2) + sizeof(uint32_t))
+// the block compressed and indexed version, of the same length as v2, see
+// BinlogFileWriter
+#define BINLOG_HEADER_V3 "BINLOG_V3\r\n"
 
 struct TruncateBinlogResult {
   TruncateBinlogResult()
@@ -321,7 +358,16 @@ class KVStore {
  public:
   enum class StoreMode { READ_WRITE = 0, REPLICATE_ONLY = 1, STORE_NONE = 2 };
 
-  enum class BackupMode { BACKUP_COPY, BACKUP_CKPT, BACKUP_CKPT_INTER };
+  // BACKUP_LINK_INTER works as BACKUP_CKPT_INTER, but only links the live
+  // files of the store into the backupdir, nothing is copied or flushed
+  // there, the sizes in the filelist are the parts of the files belonging
+  // to the backup
+  enum class BackupMode {
+    BACKUP_COPY,
+    BACKUP_CKPT,
+    BACKUP_CKPT_INTER,
+    BACKUP_LINK_INTER,
+  };
 
 
   explicit KVStore(const std::string& id, const std::string& path);
@@ -342,6 +388,10 @@ class KVStore {
   virtual Expected<RecordValue> getKV(const RecordKey& key,
                                       Transaction* txn,
                                       RecordType valueType) = 0;
+  // point lookup a batch of keys using one MultiGet, the result is in
+  // the same order with keys
+  virtual std::vector<Expected<RecordValue>> getKVs(
+    const std::vector<RecordKey>& keys, Transaction* txn) = 0;
   virtual Status setKV(const RecordKey&, const RecordValue&, Transaction*) = 0;
   virtual Status setKV(const Record& kv, Transaction* txn) = 0;
   // TODO(eliotwang) deprecate this member function
@@ -357,15 +407,14 @@ class KVStore {
   virtual Status assignBinlogIdIfNeeded(Transaction* txn) = 0;
   virtual void setNextBinlogSeq(uint64_t binlogId, Transaction* txn) = 0;
   virtual uint64_t getNextBinlogSeq() const = 0;
-  static std::ofstream* createBinlogFile(const std::string& name,
-                                         uint32_t storeId);
-  virtual Expected<TruncateBinlogResult> truncateBinlogV2(uint64_t start,
-                                                          uint64_t end,
-                                                          uint64_t save,
-                                                          Transaction* txn,
-                                                          std::ofstream* fs,
-                                                          int64_t maxWritelen,
-                                                          bool tailSlave) = 0;
+  virtual Expected<TruncateBinlogResult> truncateBinlogV2(
+    uint64_t start,
+    uint64_t end,
+    uint64_t save,
+    Transaction* txn,
+    BinlogFileWriter* fs,
+    int64_t maxWritelen,
+    bool tailSlave) = 0;
   virtual Expected<uint64_t> getBinlogCnt(Transaction* txn) const = 0;
   virtual Expected<bool> validateAllBinlog(Transaction* txn) const = 0;
 
@@ -426,6 +475,13 @@ class KVStore {
   virtual void appendJSONStat(
     rapidjson::PrettyWriter<rapidjson::StringBuffer>&) const = 0;
 
+  // the order index cache of the zsets in the store, see SkipList
+  virtual ZSetIndexCache* getZSetIndexCache() = 0;
+  // the values of the hot keys in the store, see RecordCache
+  virtual RecordCache* getRecordCache() = 0;
+  // the number of the keys in the store, see KeyCount
+  virtual KeyCounter* getKeyCounter() = 0;
+
   uint64_t getBinlogTime();
   void setBinlogTime(uint64_t timestamp);
   uint64_t getCurrentTime();
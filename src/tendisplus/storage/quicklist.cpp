@@ -0,0 +1,748 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include "tendisplus/storage/quicklist.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/string.h"
+
+namespace tendisplus {
+
+QuickList::QuickList(uint32_t chunkId,
+                     uint32_t dbId,
+                     const std::string& pk,
+                     uint64_t version,
+                     const ListMetaValue& meta,
+                     PStore store,
+                     uint64_t maxEntries,
+                     uint64_t maxBytes)
+  : _chunkId(chunkId),
+    _dbId(dbId),
+    _pk(pk),
+    _version(version),
+    _head(meta.getHead()),
+    _store(store),
+    _maxEntries(maxEntries ? maxEntries : DEFAULT_MAX_ENTRIES),
+    _maxBytes(maxBytes ? maxBytes : DEFAULT_MAX_BYTES),
+    _size(meta.getTail() - meta.getHead()),
+    _nodeCount(meta.getNodeCount()),
+    _firstPos(meta.getFirstPos()),
+    _lastPos(meta.getLastPos()),
+    _nextNodeId(meta.getNextNodeId()),
+    _loaded(false),
+    _offsets(1, 0) {
+  INVARIANT_D(meta.isChunked() || meta.getHead() == meta.getTail());
+}
+
+std::string QuickList::encodeNode(const std::vector<std::string>& elements) {
+  std::string result = varintEncodeStr(elements.size());
+  for (const auto& v : elements) {
+    result.append(varintEncodeStr(v.size()));
+    result.append(v);
+  }
+  return result;
+}
+
+Expected<std::vector<std::string>> QuickList::decodeNode(
+  const std::string& v) {
+  const uint8_t* buf = reinterpret_cast<const uint8_t*>(v.c_str());
+  auto expt = varintDecodeFwd(buf, v.size());
+  if (!expt.ok()) {
+    return expt.status();
+  }
+  size_t offset = expt.value().second;
+  uint64_t count = expt.value().first;
+  // an element takes one byte at least
+  if (count > v.size() - offset) {
+    return {ErrorCodes::ERR_DECODE, "invalid list node"};
+  }
+  std::vector<std::string> result;
+  result.reserve(count);
+  for (uint64_t i = 0; i < count; i++) {
+    expt = varintDecodeFwd(buf + offset, v.size() - offset);
+    if (!expt.ok()) {
+      return expt.status();
+    }
+    offset += expt.value().second;
+    uint64_t len = expt.value().first;
+    if (len > v.size() - offset) {
+      return {ErrorCodes::ERR_DECODE, "invalid list node"};
+    }
+    result.emplace_back(v, offset, len);
+    offset += len;
+  }
+  if (offset != v.size()) {
+    return {ErrorCodes::ERR_DECODE, "invalid list node"};
+  }
+  return result;
+}
+
+ListMetaValue QuickList::getMeta() const {
+  ListMetaValue lm(_head, _head + _size);
+  lm.setNodes(_nodeCount, _firstPos, _lastPos, _nextNodeId);
+  return lm;
+}
+
+RecordKey QuickList::nodeKey(uint64_t id) const {
+  char buf[1 + sizeof(uint64_t)];
+  buf[0] = NODE_TAG;
+  int64Encode(buf + 1, id);
+  return RecordKey(_chunkId,
+                   _dbId,
+                   RecordType::RT_LIST_NODE,
+                   _pk,
+                   std::string(buf, sizeof(buf)),
+                   _version);
+}
+
+RecordKey QuickList::indexKey(uint64_t pos) const {
+  char buf[1 + sizeof(uint64_t)];
+  buf[0] = INDEX_TAG;
+  int64Encode(buf + 1, pos);
+  return RecordKey(_chunkId,
+                   _dbId,
+                   RecordType::RT_LIST_NODE,
+                   _pk,
+                   std::string(buf, sizeof(buf)),
+                   _version);
+}
+
+Expected<QuickList::Node> QuickList::decodeIndex(const Record& rcd) const {
+  const RecordKey& rk = rcd.getRecordKey();
+  const std::string& sk = rk.getSecondaryKey();
+  if (rk.getChunkId() != _chunkId || rk.getDbId() != _dbId ||
+      rk.getRecordType() != RecordType::RT_LIST_NODE ||
+      rk.getPrimaryKey() != _pk || rk.getVersion() != _version ||
+      sk.size() != 1 + sizeof(uint64_t) || sk[0] != INDEX_TAG) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  const std::string& v = rcd.getRecordValue().getValue();
+  const uint8_t* buf = reinterpret_cast<const uint8_t*>(v.c_str());
+  auto eId = varintDecodeFwd(buf, v.size());
+  if (!eId.ok()) {
+    return eId.status();
+  }
+  size_t offset = eId.value().second;
+  auto eCount = varintDecodeFwd(buf + offset, v.size() - offset);
+  if (!eCount.ok()) {
+    return eCount.status();
+  }
+  offset += eCount.value().second;
+  if (offset != v.size() || eCount.value().first == 0) {
+    return {ErrorCodes::ERR_DECODE, "invalid list node index"};
+  }
+  return Node{int64Decode(sk.c_str() + 1),
+              eId.value().first,
+              eCount.value().first};
+}
+
+bool QuickList::fits(uint64_t count, uint64_t bytes) const {
+  return count <= _maxEntries && bytes <= _maxBytes;
+}
+
+Expected<QuickList::Node> QuickList::loadEnd(bool head, Transaction* txn) {
+  RecordKey rk = indexKey(head ? _firstPos : _lastPos);
+  auto eValue = _store->getKV(rk, txn);
+  if (!eValue.ok()) {
+    return eValue.status();
+  }
+  auto eNode = decodeIndex(Record(std::move(rk), std::move(eValue.value())));
+  if (eNode.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    return {ErrorCodes::ERR_DECODE, "invalid list node index"};
+  }
+  return eNode;
+}
+
+Expected<QuickList::Node> QuickList::loadNeighbour(const Node& end,
+                                                   bool head,
+                                                   Transaction* txn) {
+  INVARIANT_D(_nodeCount > 1);
+  auto cursor = txn->createDataCursor();
+  cursor->seek(indexKey(end.pos).encode());
+  if (head) {
+    // skip the end node itself
+    auto eRcd = cursor->next();
+    if (!eRcd.ok()) {
+      return eRcd.status();
+    }
+  } else {
+    auto s = cursor->prev();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  auto eRcd = cursor->next();
+  if (!eRcd.ok()) {
+    return eRcd.status();
+  }
+  auto eNode = decodeIndex(eRcd.value());
+  if (eNode.status().code() == ErrorCodes::ERR_NOTFOUND) {
+    return {ErrorCodes::ERR_DECODE, "invalid list node index"};
+  }
+  return eNode;
+}
+
+Status QuickList::loadIndex(Transaction* txn) {
+  RecordKey rk(_chunkId, _dbId, RecordType::RT_LIST_NODE, _pk, "", _version);
+  auto cursor = txn->createDataCursor();
+  cursor->seek(rk.prefixPk() + INDEX_TAG);
+  _nodes.clear();
+  while (true) {
+    auto eRcd = cursor->next();
+    if (eRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    if (!eRcd.ok()) {
+      return eRcd.status();
+    }
+    auto eNode = decodeIndex(eRcd.value());
+    if (eNode.status().code() == ErrorCodes::ERR_NOTFOUND) {
+      break;
+    }
+    if (!eNode.ok()) {
+      return eNode.status();
+    }
+    _nodes.push_back(eNode.value());
+  }
+  uint64_t size = _size;
+  uint64_t nodeCount = _nodeCount;
+  rebuildOffsets();
+  if (_size != size || _nodeCount != nodeCount) {
+    return {ErrorCodes::ERR_DECODE, "list node index mismatch"};
+  }
+  _loaded = true;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status QuickList::loadIndexIfNeeded(Transaction* txn) {
+  if (_loaded) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  return loadIndex(txn);
+}
+
+Status QuickList::renumber(Transaction* txn) {
+  INVARIANT_D(_loaded);
+  for (const auto& node : _nodes) {
+    auto s = _store->delKV(indexKey(node.pos), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  uint64_t pos = FIRST_POS - _nodes.size() / 2 * POS_GAP;
+  for (auto& node : _nodes) {
+    node.pos = pos;
+    pos += POS_GAP;
+    auto s = writeIndex(node, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  rebuildOffsets();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<uint64_t> QuickList::newEndPos(bool head, Transaction* txn) {
+  if (head ? _firstPos < POS_GAP
+           : _lastPos > std::numeric_limits<uint64_t>::max() - POS_GAP) {
+    auto s = loadIndex(txn);
+    if (!s.ok()) {
+      return s;
+    }
+    s = renumber(txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return head ? _firstPos - POS_GAP : _lastPos + POS_GAP;
+}
+
+std::pair<size_t, uint64_t> QuickList::locate(uint64_t idx) const {
+  INVARIANT_D(idx < size());
+  auto it = std::upper_bound(_offsets.begin(), _offsets.end(), idx);
+  size_t pos = it - _offsets.begin() - 1;
+  return {pos, idx - _offsets[pos]};
+}
+
+void QuickList::rebuildOffsets() {
+  _offsets.resize(_nodes.size() + 1);
+  _offsets[0] = 0;
+  for (size_t i = 0; i < _nodes.size(); i++) {
+    _offsets[i + 1] = _offsets[i] + _nodes[i].count;
+  }
+  _size = _offsets.back();
+  _nodeCount = _nodes.size();
+  if (!_nodes.empty()) {
+    _firstPos = _nodes.front().pos;
+    _lastPos = _nodes.back().pos;
+  }
+}
+
+Expected<std::vector<std::string>> QuickList::loadNode(const Node& node,
+                                                       Transaction* txn) {
+  auto eValue = _store->getKV(nodeKey(node.id), txn);
+  if (!eValue.ok()) {
+    return eValue.status();
+  }
+  auto eNode = decodeNode(eValue.value().getValue());
+  if (!eNode.ok()) {
+    return eNode.status();
+  }
+  if (eNode.value().size() != node.count) {
+    return {ErrorCodes::ERR_DECODE,
+            "list node count mismatch:" + std::to_string(node.id)};
+  }
+  return eNode;
+}
+
+Status QuickList::writeIndex(const Node& node, Transaction* txn) {
+  std::string value = varintEncodeStr(node.id);
+  value.append(varintEncodeStr(node.count));
+  return _store->setKV(
+    indexKey(node.pos),
+    RecordValue(std::move(value), RecordType::RT_LIST_NODE, -1),
+    txn);
+}
+
+Status QuickList::writeNode(Node* node,
+                            const std::vector<std::string>& elements,
+                            Transaction* txn) {
+  INVARIANT_D(!elements.empty());
+  auto s = _store->setKV(
+    nodeKey(node->id),
+    RecordValue(encodeNode(elements), RecordType::RT_LIST_NODE, -1),
+    txn);
+  if (!s.ok() || node->count == elements.size()) {
+    return s;
+  }
+  node->count = elements.size();
+  return writeIndex(*node, txn);
+}
+
+Status QuickList::deleteNode(const Node& node, Transaction* txn) {
+  auto s = _store->delKV(nodeKey(node.id), txn);
+  if (!s.ok()) {
+    return s;
+  }
+  return _store->delKV(indexKey(node.pos), txn);
+}
+
+Status QuickList::insertNode(size_t pos, Transaction* txn) {
+  bool last = pos + 1 == _nodes.size();
+  if (last ? _nodes[pos].pos > std::numeric_limits<uint64_t>::max() - POS_GAP
+           : _nodes[pos + 1].pos - _nodes[pos].pos < 2) {
+    auto s = renumber(txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  uint64_t prev = _nodes[pos].pos;
+  uint64_t newPos =
+    last ? prev + POS_GAP : prev + (_nodes[pos + 1].pos - prev) / 2;
+  _nodes.insert(_nodes.begin() + pos + 1, {newPos, _nextNodeId++, 0});
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status QuickList::saveNode(size_t pos,
+                           std::vector<std::string> elements,
+                           Transaction* txn) {
+  if (elements.empty()) {
+    auto s = deleteNode(_nodes[pos], txn);
+    if (!s.ok()) {
+      return s;
+    }
+    _nodes.erase(_nodes.begin() + pos);
+    rebuildOffsets();
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  std::vector<std::vector<std::string>> parts(1);
+  uint64_t bytes = 0;
+  for (auto& v : elements) {
+    auto& last = parts.back();
+    if (!last.empty() && !fits(last.size() + 1, bytes + v.size())) {
+      parts.emplace_back();
+      bytes = 0;
+    }
+    bytes += v.size();
+    parts.back().emplace_back(std::move(v));
+  }
+  for (size_t i = 0; i < parts.size(); i++) {
+    if (i > 0) {
+      auto s = insertNode(pos + i - 1, txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    auto s = writeNode(&_nodes[pos + i], parts[i], txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  rebuildOffsets();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<std::string> QuickList::index(uint64_t idx, Transaction* txn) {
+  if (idx >= size()) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  auto s = loadIndexIfNeeded(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  auto loc = locate(idx);
+  auto eNode = loadNode(_nodes[loc.first], txn);
+  if (!eNode.ok()) {
+    return eNode.status();
+  }
+  return std::move(eNode.value()[loc.second]);
+}
+
+Expected<std::vector<std::string>> QuickList::range(uint64_t start,
+                                                    uint64_t end,
+                                                    Transaction* txn) {
+  std::vector<std::string> result;
+  if (start >= size() || start > end) {
+    return result;
+  }
+  auto s = loadIndexIfNeeded(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  end = std::min(end, size() - 1);
+  uint64_t len = end - start + 1;
+  result.reserve(len);
+  auto loc = locate(start);
+  for (size_t pos = loc.first; result.size() < len; pos++) {
+    auto eNode = loadNode(_nodes[pos], txn);
+    if (!eNode.ok()) {
+      return eNode.status();
+    }
+    auto& node = eNode.value();
+    for (size_t i = pos == loc.first ? loc.second : 0;
+         i < node.size() && result.size() < len;
+         i++) {
+      result.emplace_back(std::move(node[i]));
+    }
+  }
+  return result;
+}
+
+Status QuickList::set(uint64_t idx,
+                      const std::string& value,
+                      Transaction* txn) {
+  if (idx >= size()) {
+    return {ErrorCodes::ERR_OUT_OF_RANGE, ""};
+  }
+  auto s = loadIndexIfNeeded(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  auto loc = locate(idx);
+  auto eNode = loadNode(_nodes[loc.first], txn);
+  if (!eNode.ok()) {
+    return eNode.status();
+  }
+  eNode.value()[loc.second] = value;
+  return saveNode(loc.first, std::move(eNode.value()), txn);
+}
+
+Status QuickList::push(const std::vector<std::string>& values,
+                       bool head,
+                       Transaction* txn) {
+  if (values.empty()) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  // only the end node is read and written, the index loaded is stale
+  _loaded = false;
+  Node end;
+  std::vector<std::string> node;
+  uint64_t bytes = 0;
+  if (_nodeCount == 0) {
+    end = {FIRST_POS, _nextNodeId++, 0};
+    _firstPos = _lastPos = end.pos;
+    _nodeCount = 1;
+  } else {
+    auto eEnd = loadEnd(head, txn);
+    if (!eEnd.ok()) {
+      return eEnd.status();
+    }
+    end = eEnd.value();
+    auto eNode = loadNode(end, txn);
+    if (!eNode.ok()) {
+      return eNode.status();
+    }
+    node = std::move(eNode.value());
+    for (const auto& v : node) {
+      bytes += v.size();
+    }
+  }
+
+  for (const auto& v : values) {
+    if (!node.empty() && !fits(node.size() + 1, bytes + v.size())) {
+      // the end node is full, start a new one beside it
+      auto s = writeNode(&end, node, txn);
+      if (!s.ok()) {
+        return s;
+      }
+      auto ePos = newEndPos(head, txn);
+      if (!ePos.ok()) {
+        return ePos.status();
+      }
+      _loaded = false;
+      end = {ePos.value(), _nextNodeId++, 0};
+      if (head) {
+        _firstPos = end.pos;
+      } else {
+        _lastPos = end.pos;
+      }
+      _nodeCount++;
+      node.clear();
+      bytes = 0;
+    }
+    if (head) {
+      node.insert(node.begin(), v);
+    } else {
+      node.push_back(v);
+    }
+    bytes += v.size();
+    _size++;
+  }
+  return writeNode(&end, node, txn);
+}
+
+Expected<std::string> QuickList::pop(bool head, Transaction* txn) {
+  if (_size == 0) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  _loaded = false;
+  auto eEnd = loadEnd(head, txn);
+  if (!eEnd.ok()) {
+    return eEnd.status();
+  }
+  Node end = eEnd.value();
+  auto eNode = loadNode(end, txn);
+  if (!eNode.ok()) {
+    return eNode.status();
+  }
+  auto& node = eNode.value();
+  std::string result;
+  if (head) {
+    result = std::move(node.front());
+    node.erase(node.begin());
+  } else {
+    result = std::move(node.back());
+    node.pop_back();
+  }
+  _size--;
+  if (!node.empty()) {
+    auto s = writeNode(&end, node, txn);
+    if (!s.ok()) {
+      return s;
+    }
+    return result;
+  }
+
+  // the end node is empty, the one beside it becomes the end
+  if (_nodeCount > 1) {
+    auto eNext = loadNeighbour(end, head, txn);
+    if (!eNext.ok()) {
+      return eNext.status();
+    }
+    if (head) {
+      _firstPos = eNext.value().pos;
+    } else {
+      _lastPos = eNext.value().pos;
+    }
+  }
+  auto s = deleteNode(end, txn);
+  if (!s.ok()) {
+    return s;
+  }
+  _nodeCount--;
+  return result;
+}
+
+Status QuickList::trim(uint64_t start, uint64_t end, Transaction* txn) {
+  auto s = loadIndexIfNeeded(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  if (start >= size() || start > end) {
+    for (const auto& node : _nodes) {
+      s = deleteNode(node, txn);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    _nodes.clear();
+    rebuildOffsets();
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  end = std::min(end, size() - 1);
+  auto first = locate(start);
+  auto last = locate(end);
+
+  // the nodes after the range
+  for (size_t pos = last.first + 1; pos < _nodes.size(); pos++) {
+    s = deleteNode(_nodes[pos], txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  _nodes.resize(last.first + 1);
+
+  // the nodes on the edges of the range
+  if (last.second + 1 != _nodes[last.first].count) {
+    auto eNode = loadNode(_nodes[last.first], txn);
+    if (!eNode.ok()) {
+      return eNode.status();
+    }
+    eNode.value().resize(last.second + 1);
+    if (first.first == last.first) {
+      eNode.value().erase(eNode.value().begin(),
+                          eNode.value().begin() + first.second);
+      first.second = 0;
+    }
+    s = writeNode(&_nodes[last.first], eNode.value(), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (first.second != 0) {
+    auto eNode = loadNode(_nodes[first.first], txn);
+    if (!eNode.ok()) {
+      return eNode.status();
+    }
+    eNode.value().erase(eNode.value().begin(),
+                        eNode.value().begin() + first.second);
+    s = writeNode(&_nodes[first.first], eNode.value(), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
+  // the nodes before the range
+  for (size_t pos = 0; pos < first.first; pos++) {
+    s = deleteNode(_nodes[pos], txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  _nodes.erase(_nodes.begin(), _nodes.begin() + first.first);
+  rebuildOffsets();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Expected<bool> QuickList::insert(const std::string& pivot,
+                                 const std::string& value,
+                                 bool before,
+                                 Transaction* txn) {
+  auto s = loadIndexIfNeeded(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  for (size_t pos = 0; pos < _nodes.size(); pos++) {
+    auto eNode = loadNode(_nodes[pos], txn);
+    if (!eNode.ok()) {
+      return eNode.status();
+    }
+    auto& node = eNode.value();
+    auto it = std::find(node.begin(), node.end(), pivot);
+    if (it == node.end()) {
+      continue;
+    }
+    node.insert(before ? it : it + 1, value);
+    s = saveNode(pos, std::move(node), txn);
+    if (!s.ok()) {
+      return s;
+    }
+    return true;
+  }
+  return false;
+}
+
+Expected<uint64_t> QuickList::remove(int64_t count,
+                                     const std::string& value,
+                                     Transaction* txn) {
+  auto s = loadIndexIfNeeded(txn);
+  if (!s.ok()) {
+    return s;
+  }
+  bool fromTail = count < 0;
+  uint64_t limit = std::numeric_limits<uint64_t>::max();
+  if (count != 0) {
+    limit = fromTail ? -static_cast<uint64_t>(count) : count;
+  }
+  uint64_t removed = 0;
+  size_t n = _nodes.size();
+  for (size_t i = 0; i < n && removed < limit; i++) {
+    // the nodes after pos don't move when a node is deleted from the
+    // tail side, and the ones before it don't move from the head side
+    size_t pos = fromTail ? n - 1 - i : i - (n - _nodes.size());
+    auto eNode = loadNode(_nodes[pos], txn);
+    if (!eNode.ok()) {
+      return eNode.status();
+    }
+    auto& node = eNode.value();
+    std::vector<std::string> kept;
+    kept.reserve(node.size());
+    uint64_t before = removed;
+    if (fromTail) {
+      for (auto it = node.rbegin(); it != node.rend(); ++it) {
+        if (removed < limit && *it == value) {
+          removed++;
+        } else {
+          kept.emplace_back(std::move(*it));
+        }
+      }
+      std::reverse(kept.begin(), kept.end());
+    } else {
+      for (auto& v : node) {
+        if (removed < limit && v == value) {
+          removed++;
+        } else {
+          kept.emplace_back(std::move(v));
+        }
+      }
+    }
+    if (removed == before) {
+      continue;
+    }
+    // never split here, or the positions above would move
+    s = kept.empty() ? saveNode(pos, std::move(kept), txn)
+                     : writeNode(&_nodes[pos], kept, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  rebuildOffsets();
+  return removed;
+}
+
+Expected<std::list<Record>> QuickList::toEleRecords(Transaction* txn) {
+  auto eRange = range(0, size(), txn);
+  if (!eRange.ok()) {
+    return eRange.status();
+  }
+  std::list<Record> result;
+  uint64_t seq = _head;
+  for (auto& v : eRange.value()) {
+    RecordKey rk(_chunkId,
+                 _dbId,
+                 RecordType::RT_LIST_ELE,
+                 _pk,
+                 std::to_string(seq++),
+                 _version);
+    RecordValue rv(std::move(v), RecordType::RT_LIST_ELE, -1);
+    result.emplace_back(std::move(rk), std::move(rv));
+  }
+  return std::move(result);
+}
+
+}  // namespace tendisplus
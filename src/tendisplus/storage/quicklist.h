@@ -0,0 +1,168 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_QUICKLIST_H_
+#define SRC_TENDISPLUS_STORAGE_QUICKLIST_H_
+
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+#include "tendisplus/storage/record.h"
+#include "tendisplus/storage/kvstore.h"
+
+namespace tendisplus {
+
+// NOTE: a chunked list packs its elements into nodes, like the quicklist
+// of redis, rather than a RT_LIST_ELE record per element, so that a long
+// list of small elements doesn't pay a record for every element, and
+// LINDEX, LSET and LRANGE read the nodes they need only.
+// A node is a RT_LIST_NODE record of the version of the meta, whose
+// subkey is 'n' and the node id in big-endian, and whose value is
+// N|LEN|ELEMENT|LEN|ELEMENT... The order of the nodes is kept by the node
+// index, a RT_LIST_NODE record per node too, whose subkey is 'p' and the
+// position of the node in big-endian, and whose value is ID|COUNT. The
+// positions are POS_GAP apart, a node split from another one takes the
+// middle of the gap, and the positions are renumbered if there's no
+// room left. The meta only keeps the number of the nodes and the
+// positions of the end nodes, see ListMetaValue, so a push or a pop
+// writes an end node, its index record and a meta of a fixed size. The
+// other operations load the index first, and find an element by a binary
+// search of the counts and a read of one node.
+// A node holds maxEntries elements and maxBytes bytes at most, unless it
+// holds a single element. The limits only apply to the nodes written.
+class QuickList {
+ public:
+  // the limits of the lists chunked before the encoding is turned off
+  static constexpr uint64_t DEFAULT_MAX_ENTRIES = 128;
+  static constexpr uint64_t DEFAULT_MAX_BYTES = 8192;
+
+  // meta is a chunked meta, or an empty one for a new list. The limits
+  // of 0 fall back to the defaults.
+  QuickList(uint32_t chunkId,
+            uint32_t dbId,
+            const std::string& pk,
+            uint64_t version,
+            const ListMetaValue& meta,
+            PStore store,
+            uint64_t maxEntries = 0,
+            uint64_t maxBytes = 0);
+
+  static std::string encodeNode(const std::vector<std::string>& elements);
+  static Expected<std::vector<std::string>> decodeNode(const std::string& v);
+
+  uint64_t size() const {
+    return _size;
+  }
+  // the chunked meta of the current nodes, the caller writes it into the
+  // RT_LIST_META, or deletes the key if the list is empty
+  ListMetaValue getMeta() const;
+
+  Expected<std::string> index(uint64_t idx, Transaction* txn);
+  // the elements in [start, end], end is cut to size() - 1
+  Expected<std::vector<std::string>> range(uint64_t start,
+                                           uint64_t end,
+                                           Transaction* txn);
+  Status set(uint64_t idx, const std::string& value, Transaction* txn);
+  // push the values one by one to the head or the tail, as LPUSH and
+  // RPUSH. The values go into the end node until it's full.
+  Status push(const std::vector<std::string>& values,
+              bool head,
+              Transaction* txn);
+  // ERR_NOTFOUND if the list is empty
+  Expected<std::string> pop(bool head, Transaction* txn);
+  // keep the elements in [start, end] only, all of them are removed if
+  // start > end. The nodes out of the range are deleted without a read.
+  Status trim(uint64_t start, uint64_t end, Transaction* txn);
+  // return false if pivot is not found
+  Expected<bool> insert(const std::string& pivot,
+                        const std::string& value,
+                        bool before,
+                        Transaction* txn);
+  // remove the elements equal to value, count of them from the head if
+  // count > 0, -count of them from the tail if count < 0, or all of them.
+  // Return the number removed.
+  Expected<uint64_t> remove(int64_t count,
+                            const std::string& value,
+                            Transaction* txn);
+  // the elements as the RT_LIST_ELE records of the sequences from the
+  // head, for the readers of the records, like restorevalue and iterall
+  Expected<std::list<Record>> toEleRecords(Transaction* txn);
+
+ private:
+  // the subkey tags of the nodes and of the node index
+  static constexpr char NODE_TAG = 'n';
+  static constexpr char INDEX_TAG = 'p';
+  // the position of the first node of a list, and the gap between the
+  // positions of the nodes
+  static constexpr uint64_t FIRST_POS = 1ULL << 63;
+  static constexpr uint64_t POS_GAP = 1ULL << 32;
+
+  // an entry of the node index
+  struct Node {
+    uint64_t pos;
+    uint64_t id;
+    uint64_t count;
+  };
+
+  RecordKey nodeKey(uint64_t id) const;
+  RecordKey indexKey(uint64_t pos) const;
+  // ERR_NOTFOUND if rcd is not a record of the node index of the list
+  Expected<Node> decodeIndex(const Record& rcd) const;
+  bool fits(uint64_t count, uint64_t bytes) const;
+  // the index entry of the head or the tail node
+  Expected<Node> loadEnd(bool head, Transaction* txn);
+  // the index entry next to the end node, which is not the only one
+  Expected<Node> loadNeighbour(const Node& end,
+                               bool head,
+                               Transaction* txn);
+  // load the whole node index into _nodes, push and pop don't keep it
+  Status loadIndex(Transaction* txn);
+  Status loadIndexIfNeeded(Transaction* txn);
+  // spread the positions of _nodes around FIRST_POS again
+  Status renumber(Transaction* txn);
+  // the position of a new node beyond the end node
+  Expected<uint64_t> newEndPos(bool head, Transaction* txn);
+  // the node of the element idx, and the offset of it in the node
+  std::pair<size_t, uint64_t> locate(uint64_t idx) const;
+  void rebuildOffsets();
+  Expected<std::vector<std::string>> loadNode(const Node& node,
+                                              Transaction* txn);
+  Status writeIndex(const Node& node, Transaction* txn);
+  // write the node as is, and its index entry if the count changes
+  Status writeNode(Node* node,
+                   const std::vector<std::string>& elements,
+                   Transaction* txn);
+  Status deleteNode(const Node& node, Transaction* txn);
+  // add an empty entry after pos to _nodes, it's written with the node
+  Status insertNode(size_t pos, Transaction* txn);
+  // write the node at pos, split it if it's too big, or delete it if
+  // it's empty
+  Status saveNode(size_t pos,
+                  std::vector<std::string> elements,
+                  Transaction* txn);
+
+  const uint32_t _chunkId;
+  const uint32_t _dbId;
+  const std::string _pk;
+  const uint64_t _version;
+  const uint64_t _head;
+  PStore _store;
+  const uint64_t _maxEntries;
+  const uint64_t _maxBytes;
+  uint64_t _size;
+  uint64_t _nodeCount;
+  uint64_t _firstPos;
+  uint64_t _lastPos;
+  uint64_t _nextNodeId;
+  bool _loaded;
+  std::vector<Node> _nodes;
+  // _offsets[i] is the index of the first element of the node i, and
+  // the last one is the size of the list
+  std::vector<uint64_t> _offsets;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_QUICKLIST_H_
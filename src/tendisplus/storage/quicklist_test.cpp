@@ -0,0 +1,431 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+#include "tendisplus/utils/status.h"
+#include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/portable.h"
+#include "tendisplus/storage/quicklist.h"
+#include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/storage/rocks/rocks_kvstore.h"
+#include "tendisplus/server/server_params.h"
+
+namespace tendisplus {
+
+std::shared_ptr<ServerParams> genParams() {
+  const auto guard = MakeGuard([] { remove("a.cfg"); });
+  std::ofstream myfile;
+  myfile.open("a.cfg");
+  myfile << "bind 127.0.0.1\n";
+  myfile << "port 8903\n";
+  myfile << "loglevel debug\n";
+  myfile << "logdir ./log\n";
+  myfile << "storage rocks\n";
+  myfile << "dir ./db\n";
+  myfile << "rocks.blockcachemb 4096\n";
+  myfile.close();
+  auto cfg = std::make_shared<ServerParams>();
+  auto s = cfg->parseFile("a.cfg");
+  EXPECT_EQ(s.ok(), true) << s.toString();
+  return cfg;
+}
+
+// check ql against the same list kept in memory, and the meta of it
+// against the nodes written
+void checkQuickList(QuickList* ql,
+                    const std::vector<std::string>& expected,
+                    PStore store,
+                    Transaction* txn) {
+  EXPECT_EQ(ql->size(), expected.size());
+  auto eRange = ql->range(0, expected.size(), txn);
+  EXPECT_TRUE(eRange.ok());
+  EXPECT_EQ(eRange.value(), expected);
+
+  for (uint64_t start = 0; start < expected.size(); start += 5) {
+    for (uint64_t end = start; end < expected.size(); end += 11) {
+      auto eSub = ql->range(start, end, txn);
+      EXPECT_TRUE(eSub.ok());
+      EXPECT_EQ(eSub.value(),
+                std::vector<std::string>(expected.begin() + start,
+                                         expected.begin() + end + 1));
+    }
+    auto eIndex = ql->index(start, txn);
+    EXPECT_TRUE(eIndex.ok());
+    EXPECT_EQ(eIndex.value(), expected[start]);
+  }
+  EXPECT_EQ(ql->index(expected.size(), txn).status().code(),
+            ErrorCodes::ERR_NOTFOUND);
+
+  // a list loaded from the meta reads the same
+  if (expected.empty()) {
+    return;
+  }
+  auto meta = ql->getMeta();
+  EXPECT_TRUE(meta.isChunked());
+  EXPECT_EQ(meta.getTail() - meta.getHead(), expected.size());
+  auto eMeta = ListMetaValue::decode(meta.encode());
+  EXPECT_TRUE(eMeta.ok());
+  EXPECT_EQ(eMeta.value().getHead(), meta.getHead());
+  EXPECT_EQ(eMeta.value().getNextNodeId(), meta.getNextNodeId());
+  EXPECT_EQ(eMeta.value().getNodeCount(), meta.getNodeCount());
+  EXPECT_EQ(eMeta.value().getFirstPos(), meta.getFirstPos());
+  EXPECT_EQ(eMeta.value().getLastPos(), meta.getLastPos());
+  QuickList loaded(0, 0, "test", 1, eMeta.value(), store, 4, 64);
+  auto eLoaded = loaded.range(0, expected.size(), txn);
+  EXPECT_TRUE(eLoaded.ok());
+  EXPECT_EQ(eLoaded.value(), expected);
+
+  auto eRcds = loaded.toEleRecords(txn);
+  EXPECT_TRUE(eRcds.ok());
+  EXPECT_EQ(eRcds.value().size(), expected.size());
+  uint64_t seq = meta.getHead();
+  auto it = expected.begin();
+  for (const auto& rcd : eRcds.value()) {
+    EXPECT_EQ(rcd.getRecordKey().getRecordType(), RecordType::RT_LIST_ELE);
+    EXPECT_EQ(rcd.getRecordKey().getSecondaryKey(), std::to_string(seq++));
+    EXPECT_EQ(rcd.getRecordValue().getValue(), *it++);
+  }
+}
+
+// no empty node is left, no node is over the entry limit, and the node
+// index matches the meta and the nodes
+void checkNodes(const ListMetaValue& meta, Transaction* txn) {
+  RecordKey rk(0, 0, RecordType::RT_LIST_NODE, "test", "", 1);
+  auto cursor = txn->createDataCursor();
+  cursor->seek(rk.prefixPk());
+  std::map<uint64_t, uint64_t> nodes;
+  std::vector<std::pair<uint64_t, uint64_t>> index;
+  while (true) {
+    auto eRcd = cursor->next();
+    if (!eRcd.ok()) {
+      EXPECT_EQ(eRcd.status().code(), ErrorCodes::ERR_EXHAUST);
+      break;
+    }
+    const auto& key = eRcd.value().getRecordKey();
+    if (key.getPrimaryKey() != "test") {
+      break;
+    }
+    const std::string& sk = key.getSecondaryKey();
+    const std::string& v = eRcd.value().getRecordValue().getValue();
+    EXPECT_EQ(sk.size(), 9);
+    if (sk[0] == 'n') {
+      auto eNode = QuickList::decodeNode(v);
+      EXPECT_TRUE(eNode.ok());
+      EXPECT_GT(eNode.value().size(), 0);
+      EXPECT_LE(eNode.value().size(), 4);
+      nodes[int64Decode(sk.c_str() + 1)] = eNode.value().size();
+    } else {
+      EXPECT_EQ(sk[0], 'p');
+      auto eId = varintDecodeFwd(
+        reinterpret_cast<const uint8_t*>(v.c_str()), v.size());
+      EXPECT_TRUE(eId.ok());
+      auto eCount = varintDecodeFwd(
+        reinterpret_cast<const uint8_t*>(v.c_str()) + eId.value().second,
+        v.size() - eId.value().second);
+      EXPECT_TRUE(eCount.ok());
+      index.emplace_back(eId.value().first, eCount.value().first);
+      if (index.size() == 1) {
+        EXPECT_EQ(int64Decode(sk.c_str() + 1), meta.getFirstPos());
+      }
+      if (index.size() == meta.getNodeCount()) {
+        EXPECT_EQ(int64Decode(sk.c_str() + 1), meta.getLastPos());
+      }
+    }
+  }
+  EXPECT_EQ(nodes.size(), meta.getNodeCount());
+  EXPECT_EQ(index.size(), meta.getNodeCount());
+  uint64_t count = 0;
+  for (const auto& entry : index) {
+    EXPECT_EQ(nodes[entry.first], entry.second);
+    count += entry.second;
+  }
+  EXPECT_EQ(count, meta.getTail() - meta.getHead());
+}
+
+TEST(QuickList, Node) {
+  std::vector<std::string> elements = {"a", "", std::string(300, 'b'), "c"};
+  auto eNode = QuickList::decodeNode(QuickList::encodeNode(elements));
+  EXPECT_TRUE(eNode.ok());
+  EXPECT_EQ(eNode.value(), elements);
+
+  eNode = QuickList::decodeNode(QuickList::encodeNode({}));
+  EXPECT_TRUE(eNode.ok());
+  EXPECT_TRUE(eNode.value().empty());
+
+  std::string v = QuickList::encodeNode(elements);
+  EXPECT_FALSE(QuickList::decodeNode(v.substr(0, v.size() - 1)).ok());
+  EXPECT_FALSE(QuickList::decodeNode(v + "x").ok());
+}
+
+TEST(QuickList, Common) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+
+  // 4 elements or 64 bytes a node at most
+  QuickList ql(0, 0, "test", 1, ListMetaValue(0, 0), store, 4, 64);
+  std::vector<std::string> expected;
+  EXPECT_EQ(ql.pop(true, txn).status().code(), ErrorCodes::ERR_NOTFOUND);
+
+  std::vector<std::string> values;
+  for (uint32_t i = 0; i < 10; i++) {
+    values.emplace_back(std::to_string(i));
+  }
+  EXPECT_TRUE(ql.push(values, false, txn).ok());
+  expected = values;
+  EXPECT_TRUE(ql.push(values, true, txn).ok());
+  for (const auto& v : values) {
+    expected.insert(expected.begin(), v);
+  }
+  checkQuickList(&ql, expected, store, txn);
+  EXPECT_EQ(ql.getMeta().getNodeCount(), 6);
+
+  // a big element takes a node by itself
+  std::string big(100, 'x');
+  EXPECT_TRUE(ql.push({big}, false, txn).ok());
+  expected.push_back(big);
+  EXPECT_TRUE(ql.set(3, big, txn).ok());
+  expected[3] = big;
+  EXPECT_EQ(ql.set(expected.size(), big, txn).code(),
+            ErrorCodes::ERR_OUT_OF_RANGE);
+  checkQuickList(&ql, expected, store, txn);
+
+  auto eInsert = ql.insert("5", "y", true, txn);
+  EXPECT_TRUE(eInsert.ok());
+  EXPECT_TRUE(eInsert.value());
+  expected.insert(std::find(expected.begin(), expected.end(), "5"), "y");
+  eInsert = ql.insert("none", "y", true, txn);
+  EXPECT_TRUE(eInsert.ok());
+  EXPECT_FALSE(eInsert.value());
+  checkQuickList(&ql, expected, store, txn);
+
+  auto eRemoved = ql.remove(-1, "5", txn);
+  EXPECT_TRUE(eRemoved.ok());
+  EXPECT_EQ(eRemoved.value(), 1);
+  auto last = std::find(expected.rbegin(), expected.rend(), "5");
+  expected.erase(std::next(last).base());
+  checkQuickList(&ql, expected, store, txn);
+
+  EXPECT_TRUE(ql.trim(3, 14, txn).ok());
+  expected = std::vector<std::string>(expected.begin() + 3,
+                                      expected.begin() + 15);
+  checkQuickList(&ql, expected, store, txn);
+
+  EXPECT_TRUE(ql.trim(5, 2, txn).ok());
+  expected.clear();
+  checkQuickList(&ql, expected, store, txn);
+  EXPECT_EQ(ql.getMeta().getNodeCount(), 0);
+  checkNodes(ql.getMeta(), txn);
+}
+
+TEST(QuickList, Random) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+
+  std::mt19937 gen(0);
+  auto randValue = [&gen]() {
+    // a few distinct values, so that insert and remove find them
+    return std::string(gen() % 20, 'a' + gen() % 4);
+  };
+
+  QuickList ql(0, 0, "test", 1, ListMetaValue(0, 0), store, 4, 64);
+  std::vector<std::string> expected;
+  for (uint32_t round = 0; round < 2000; round++) {
+    switch (gen() % 7) {
+      case 0:
+      case 1: {
+        std::vector<std::string> values(gen() % 6);
+        for (auto& v : values) {
+          v = randValue();
+        }
+        bool head = gen() % 2;
+        EXPECT_TRUE(ql.push(values, head, txn).ok());
+        for (const auto& v : values) {
+          if (head) {
+            expected.insert(expected.begin(), v);
+          } else {
+            expected.push_back(v);
+          }
+        }
+        break;
+      }
+      case 2: {
+        bool head = gen() % 2;
+        auto ePop = ql.pop(head, txn);
+        if (expected.empty()) {
+          EXPECT_EQ(ePop.status().code(), ErrorCodes::ERR_NOTFOUND);
+          break;
+        }
+        EXPECT_TRUE(ePop.ok());
+        EXPECT_EQ(ePop.value(), head ? expected.front() : expected.back());
+        if (head) {
+          expected.erase(expected.begin());
+        } else {
+          expected.pop_back();
+        }
+        break;
+      }
+      case 3: {
+        if (expected.empty()) {
+          break;
+        }
+        uint64_t idx = gen() % expected.size();
+        std::string v = randValue();
+        EXPECT_TRUE(ql.set(idx, v, txn).ok());
+        expected[idx] = v;
+        break;
+      }
+      case 4: {
+        std::string pivot = randValue();
+        std::string v = randValue();
+        bool before = gen() % 2;
+        auto eInsert = ql.insert(pivot, v, before, txn);
+        EXPECT_TRUE(eInsert.ok());
+        auto it = std::find(expected.begin(), expected.end(), pivot);
+        EXPECT_EQ(eInsert.value(), it != expected.end());
+        if (it != expected.end()) {
+          expected.insert(before ? it : it + 1, v);
+        }
+        break;
+      }
+      case 5: {
+        int64_t count = static_cast<int64_t>(gen() % 5) - 2;
+        std::string v = randValue();
+        auto eRemoved = ql.remove(count, v, txn);
+        EXPECT_TRUE(eRemoved.ok());
+        uint64_t limit = count == 0 ? expected.size() : std::abs(count);
+        uint64_t removed = 0;
+        if (count < 0) {
+          for (size_t i = expected.size(); i > 0 && removed < limit; i--) {
+            if (expected[i - 1] == v) {
+              expected.erase(expected.begin() + i - 1);
+              removed++;
+            }
+          }
+        } else {
+          for (size_t i = 0; i < expected.size() && removed < limit;) {
+            if (expected[i] == v) {
+              expected.erase(expected.begin() + i);
+              removed++;
+            } else {
+              i++;
+            }
+          }
+        }
+        EXPECT_EQ(eRemoved.value(), removed);
+        break;
+      }
+      case 6: {
+        // trim rarely, or the list never grows
+        if (gen() % 4 != 0 || expected.empty()) {
+          break;
+        }
+        uint64_t start = gen() % (expected.size() + 1);
+        uint64_t end = start + gen() % (expected.size() + 1);
+        EXPECT_TRUE(ql.trim(start, end, txn).ok());
+        if (start >= expected.size()) {
+          expected.clear();
+        } else {
+          end = std::min<uint64_t>(end, expected.size() - 1);
+          expected = std::vector<std::string>(expected.begin() + start,
+                                              expected.begin() + end + 1);
+        }
+        break;
+      }
+    }
+    EXPECT_EQ(ql.size(), expected.size());
+    if (round % 100 == 0) {
+      checkQuickList(&ql, expected, store, txn);
+    }
+  }
+  checkQuickList(&ql, expected, store, txn);
+
+  checkNodes(ql.getMeta(), txn);
+}
+
+TEST(QuickList, Renumber) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+
+  QuickList ql(0, 0, "test", 1, ListMetaValue(0, 0), store, 4, 64);
+  std::vector<std::string> expected = {"a", "b", "c"};
+  EXPECT_TRUE(ql.push(expected, false, txn).ok());
+  auto meta = ql.getMeta();
+  size_t metaSize = meta.encode().size();
+
+  // the node of the pivot splits again and again at the same place, until
+  // the positions are renumbered
+  for (uint32_t i = 0; i < 200; i++) {
+    auto eInsert = ql.insert("b", "x", true, txn);
+    EXPECT_TRUE(eInsert.ok());
+    EXPECT_TRUE(eInsert.value());
+    expected.insert(expected.end() - 2, "x");
+  }
+  checkQuickList(&ql, expected, store, txn);
+  checkNodes(ql.getMeta(), txn);
+
+  // push and pop only write the end nodes and a meta of a fixed size
+  std::vector<std::string> values(100, "y");
+  EXPECT_TRUE(ql.push(values, false, txn).ok());
+  EXPECT_TRUE(ql.push(values, true, txn).ok());
+  expected.insert(expected.end(), values.begin(), values.end());
+  expected.insert(expected.begin(), values.begin(), values.end());
+  for (uint32_t i = 0; i < 100; i++) {
+    EXPECT_TRUE(ql.pop(i % 2, txn).ok());
+  }
+  expected.erase(expected.begin(), expected.begin() + 50);
+  expected.erase(expected.end() - 50, expected.end());
+  meta = ql.getMeta();
+  EXPECT_EQ(meta.getTail() - meta.getHead(), expected.size());
+  EXPECT_LE(meta.encode().size(), metaSize + 8);
+  QuickList loaded(0, 0, "test", 1, meta, store, 4, 64);
+  checkQuickList(&loaded, expected, store, txn);
+  checkNodes(meta, txn);
+}
+
+}  // namespace tendisplus
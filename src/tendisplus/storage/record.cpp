@@ -2,6 +2,7 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <algorithm>
 #include <type_traits>
 #include <utility>
 #include <memory>
@@ -60,6 +61,8 @@ bool isRealEleType(RecordType keyType, RecordType valueType) {
         return true;
       }
     case RecordType::RT_ZSET_S_ELE:
+    case RecordType::RT_KV_PIECE:
+    case RecordType::RT_LIST_NODE:
     case RecordType::RT_BINLOG:
     case RecordType::RT_TTL_INDEX:
     case RecordType::RT_META:  // For ts/revision
@@ -97,6 +100,10 @@ uint8_t rt2Char(RecordType t) {
       return 'c';
     case RecordType::RT_ZSET_S_ELE:
       return 'z';
+    case RecordType::RT_KV_PIECE:
+      return 'p';
+    case RecordType::RT_LIST_NODE:
+      return 'n';
     case RecordType::RT_TTL_INDEX:
       return std::numeric_limits<uint8_t>::max() - 1;
     // it's convinent (for seek) to have BINLOG to pos
@@ -117,10 +124,12 @@ uint8_t rt2Char(RecordType t) {
 std::string rt2Str(RecordType t) {
   switch (t) {
     case RecordType::RT_KV:
+    case RecordType::RT_KV_PIECE:
       return "STRING";
 
     case RecordType::RT_LIST_META:
     case RecordType::RT_LIST_ELE:
+    case RecordType::RT_LIST_NODE:
       return "LIST";
 
     case RecordType::RT_HASH_META:
@@ -168,6 +177,10 @@ RecordType char2Rt(uint8_t t) {
       return RecordType::RT_ZSET_S_ELE;
     case 'c':
       return RecordType::RT_ZSET_H_ELE;
+    case 'p':
+      return RecordType::RT_KV_PIECE;
+    case 'n':
+      return RecordType::RT_LIST_NODE;
     case std::numeric_limits<uint8_t>::max() - 1:
       return RecordType::RT_TTL_INDEX;
     case std::numeric_limits<uint8_t>::max():
@@ -261,9 +274,10 @@ void RecordKey::encodePrefixPk(std::vector<uint8_t>* arr) const {
   // each other in physical space
   arr->push_back(0);
 
-  // NOTE(vinchen): version of key, temporarily useless
-  // delSubkeysRange use _version=UINT64_MAX as upper_bound
-  INVARIANT_D(_version == 0 || _version == UINT64_MAX);
+  // version of the subkeys, it's the version in the RecordValue of the
+  // meta, see Command::getSubkeyVersion(). UINT64_MAX is used as the
+  // upper bound of all the versions.
+  INVARIANT_D(_type != RecordType::RT_DATA_META || _version == 0);
   auto v = varintEncode(_version);
   arr->insert(arr->end(), v.begin(), v.end());
 }
@@ -385,6 +399,49 @@ const std::string& RecordKey::prefixVersionMeta() {
   return s;
 }
 
+const std::string& RecordKey::prefixGCIndex() {
+  static std::string s = []() {
+    std::string result;
+
+    static_assert(GCIndex::DBID == 0XFFFD0000U, "invalid GCIndex::DBID");
+    static_assert(GCIndex::CHUNKID == 0XFFFD0000U, "invalid GCIndex::CHUNKID");
+    result.push_back(0xFF);
+    result.push_back(0xFD);
+    result.push_back(0x00);
+    result.push_back(0x00);
+    result.push_back(rt2Char(RecordType::RT_META));
+    result.push_back(0xFF);
+    result.push_back(0xFD);
+    result.push_back(0x00);
+    result.push_back(0x00);
+    return result;
+  }();
+
+  return s;
+}
+
+const std::string& RecordKey::prefixKeyCount() {
+  static std::string s = []() {
+    std::string result;
+
+    static_assert(KeyCount::DBID == 0XFFFC0000U, "invalid KeyCount::DBID");
+    static_assert(KeyCount::CHUNKID == 0XFFFC0000U,
+                  "invalid KeyCount::CHUNKID");
+    result.push_back(0xFF);
+    result.push_back(0xFC);
+    result.push_back(0x00);
+    result.push_back(0x00);
+    result.push_back(rt2Char(RecordType::RT_META));
+    result.push_back(0xFF);
+    result.push_back(0xFC);
+    result.push_back(0x00);
+    result.push_back(0x00);
+    return result;
+  }();
+
+  return s;
+}
+
 RecordType RecordKey::getRecordType() const {
   INVARIANT_D(isKeyType(_type));
   return _type;
@@ -473,7 +530,6 @@ Expected<RecordKey> RecordKey::decode(const std::string& key) {
   }
   size_t versionLen = v.value().second;
   auto version = v.value().first;
-  INVARIANT_D(version == 0);
 
   // sk
   skLen = left - versionLen;
@@ -540,6 +596,37 @@ Expected<bool> RecordKey::validate(const std::string& key, RecordType type) {
   return true;
 }
 
+size_t RecordKey::decodePrefixPkSize(const char* key, size_t size) {
+  constexpr size_t rsvd = sizeof(TRSV);
+  const size_t offset = getHdrSize();
+  const uint8_t* keyCstr = reinterpret_cast<const uint8_t*>(key);
+
+  // an encoded key: chunkid|type|dbid|pk|0|version|sk|len(pk)|reserved
+  if (size >= minSize()) {
+    const uint8_t* p = keyCstr + size - rsvd - 1;
+    auto expt = varintDecodeRvs(p, size - rsvd - offset);
+    if (expt.ok()) {
+      size_t rvsOffset = expt.value().second;
+      uint64_t pkLen = expt.value().first;
+      if (pkLen < size &&
+          size >= offset + rsvd + rvsOffset + pkLen + 1 &&
+          keyCstr[offset + pkLen] == 0) {
+        size_t left = size - offset - rsvd - rvsOffset - pkLen - 1;
+        auto v = varintDecodeFwd(keyCstr + offset + pkLen + 1, left);
+        if (v.ok() && v.value().first == 0) {
+          return offset + pkLen + 1;
+        }
+      }
+    }
+  }
+
+  // prefixPk(): chunkid|type|dbid|pk|0|version, version is 0
+  if (size >= offset + 2 && keyCstr[size - 1] == 0 && keyCstr[size - 2] == 0) {
+    return size - 1;
+  }
+  return 0;
+}
+
 uint32_t RecordKey::decodeChunkId(const std::string& key) {
   INVARIANT_D(key.size() > getHdrSize());
   return int32Decode(key.c_str() + CHUNKID_OFFSET);
@@ -684,6 +771,7 @@ RecordValue::RecordValue(const std::string& val,
     setCas(oldRV.value().getCas());
     setVersion(oldRV.value().getVersion());
     setPieceSize(oldRV.value().getPieceSize());
+    setTotalSize(oldRV.value().getTotalSize());
   }
 }
 
@@ -697,6 +785,7 @@ RecordValue::RecordValue(const std::string&& val,
     setCas(oldRV.value().getCas());
     setVersion(oldRV.value().getVersion());
     setPieceSize(oldRV.value().getPieceSize());
+    setTotalSize(oldRV.value().getTotalSize());
   }
 }
 
@@ -717,7 +806,6 @@ std::string RecordValue::encode() const {
 
     // version
     offset += varintEncodeBuf(ptr + offset, size - offset, _version);
-    INVARIANT_D(_version == (uint64_t)0);
 
     // versionEP
     offset += varintEncodeBuf(ptr + offset, size - offset, _versionEP + 1);
@@ -731,11 +819,11 @@ std::string RecordValue::encode() const {
     // pieceSize
     // why +1? same as CAS
     offset += varintEncodeBuf(ptr + offset, size - offset, _pieceSize + 1);
-    INVARIANT_D(_pieceSize == (uint64_t)-1);
+    INVARIANT_D(_pieceSize == (uint64_t)-1 || _type == RecordType::RT_KV);
 
     // totalSize
     offset += varintEncodeBuf(ptr + offset, size - offset, _totalSize + 1);
-    INVARIANT_D(_totalSize == (uint64_t)-1);
+    INVARIANT_D(_totalSize == (uint64_t)-1 || _type == RecordType::RT_KV);
   } else {
     // NOTE(vinchen) : for none DATA META value, the below members is
     // useless. They will take 6 bytes, and always be 0
@@ -795,7 +883,6 @@ Expected<RecordValue> RecordValue::decode(const std::string& value) {
     }
     offset += expt.value().second;
     version = expt.value().first;
-    INVARIANT_D(version == 0);
 
     // versionEP
     expt = varintDecodeFwd(valueCstr + offset, value.size() - offset);
@@ -823,7 +910,6 @@ Expected<RecordValue> RecordValue::decode(const std::string& value) {
     }
     offset += expt.value().second;
     pieceSize = expt.value().first - 1;
-    INVARIANT_D(pieceSize == (uint64_t)-1);
 
     // totalSize
     expt = varintDecodeFwd(valueCstr + offset, value.size() - offset);
@@ -832,7 +918,6 @@ Expected<RecordValue> RecordValue::decode(const std::string& value) {
     }
     offset += expt.value().second;
     totalSize = expt.value().first - 1;
-    INVARIANT_D(totalSize == (uint64_t)-1);
 
     if (offset > value.size()) {
       std::stringstream ss;
@@ -846,8 +931,10 @@ Expected<RecordValue> RecordValue::decode(const std::string& value) {
   if (value.size() > offset) {
     rawValue = std::string(value.c_str() + offset, value.size() - offset);
   }
-  return RecordValue(
+  RecordValue rv(
     std::move(rawValue), typeForMeta, versionEP, ttl, cas, version, pieceSize);
+  rv.setTotalSize(totalSize);
+  return rv;
 }
 
 Expected<bool> RecordValue::validate(const std::string& value,
@@ -1184,19 +1271,144 @@ std::string Record::toString() const {
   return ss.str();
 }
 
+Expected<ListPack> ListPack::decode(const uint8_t* buf, size_t size) {
+  size_t offset = 0;
+  auto expt = varintDecodeFwd(buf, size);
+  if (!expt.ok()) {
+    return expt.status();
+  }
+  offset += expt.value().second;
+  uint64_t n = expt.value().first;
+
+  ListPack result;
+  result._entries.reserve(n);
+  for (uint64_t i = 0; i < n; ++i) {
+    std::string field[2];
+    for (auto& f : field) {
+      expt = varintDecodeFwd(buf + offset, size - offset);
+      if (!expt.ok()) {
+        return expt.status();
+      }
+      offset += expt.value().second;
+      uint64_t len = expt.value().first;
+      if (len > size - offset) {
+        return {ErrorCodes::ERR_DECODE, "invalid listpack length"};
+      }
+      f.assign(reinterpret_cast<const char*>(buf + offset), len);
+      offset += len;
+    }
+    result._entries.emplace_back(std::move(field[0]), std::move(field[1]));
+  }
+  return result;
+}
+
+void ListPack::encode(std::vector<uint8_t>* out) const {
+  size_t len = 1 + varintEncodeSize(_entries.size());
+  for (const auto& v : _entries) {
+    len += varintEncodeSize(v.first.size()) + v.first.size();
+    len += varintEncodeSize(v.second.size()) + v.second.size();
+  }
+  out->reserve(out->size() + len);
+  out->push_back(ENCODING);
+  auto bytes = varintEncode(_entries.size());
+  out->insert(out->end(), bytes.begin(), bytes.end());
+  for (const auto& v : _entries) {
+    for (const std::string* f : {&v.first, &v.second}) {
+      bytes = varintEncode(f->size());
+      out->insert(out->end(), bytes.begin(), bytes.end());
+      out->insert(out->end(), f->begin(), f->end());
+    }
+  }
+}
+
+const std::string* ListPack::get(const std::string& subkey) const {
+  auto it = std::lower_bound(
+    _entries.begin(), _entries.end(), subkey,
+    [](const Entry& e, const std::string& k) { return e.first < k; });
+  if (it == _entries.end() || it->first != subkey) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+bool ListPack::set(const std::string& subkey, const std::string& value) {
+  auto it = std::lower_bound(
+    _entries.begin(), _entries.end(), subkey,
+    [](const Entry& e, const std::string& k) { return e.first < k; });
+  if (it != _entries.end() && it->first == subkey) {
+    it->second = value;
+    return false;
+  }
+  _entries.emplace(it, subkey, value);
+  return true;
+}
+
+bool ListPack::del(const std::string& subkey) {
+  auto it = std::lower_bound(
+    _entries.begin(), _entries.end(), subkey,
+    [](const Entry& e, const std::string& k) { return e.first < k; });
+  if (it == _entries.end() || it->first != subkey) {
+    return false;
+  }
+  _entries.erase(it);
+  return true;
+}
+
+bool ListPack::fits(uint64_t maxEntries, uint64_t maxValue) const {
+  if (_entries.size() > maxEntries) {
+    return false;
+  }
+  for (const auto& v : _entries) {
+    if (v.first.size() > maxValue || v.second.size() > maxValue) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// decode the optional listpack following the fixed fields of a meta
+static Status decodeListPack(const std::string& val,
+                             size_t offset,
+                             bool* isListPack,
+                             ListPack* lp) {
+  *isListPack = false;
+  if (offset >= val.size() ||
+      static_cast<uint8_t>(val[offset]) != ListPack::ENCODING) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  offset++;
+  auto elp = ListPack::decode(
+    reinterpret_cast<const uint8_t*>(val.c_str()) + offset,
+    val.size() - offset);
+  if (!elp.ok()) {
+    return elp.status();
+  }
+  *isListPack = true;
+  *lp = std::move(elp.value());
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 HashMetaValue::HashMetaValue() : HashMetaValue(0) {}
 
-HashMetaValue::HashMetaValue(uint64_t count) : _count(count) {}
+HashMetaValue::HashMetaValue(uint64_t count)
+  : _count(count), _isListPack(false) {}
 
-HashMetaValue::HashMetaValue(HashMetaValue&& o) : _count(o._count) {
+HashMetaValue::HashMetaValue(HashMetaValue&& o)
+  : _count(o._count),
+    _isListPack(o._isListPack),
+    _lp(std::move(o._lp)) {
   o._count = 0;
+  o._isListPack = false;
 }
 
 std::string HashMetaValue::encode() const {
   std::vector<uint8_t> value;
   value.reserve(128);
-  auto countBytes = varintEncode(_count);
+  auto countBytes = varintEncode(getCount());
   value.insert(value.end(), countBytes.begin(), countBytes.end());
+  if (_isListPack) {
+    _lp.encode(&value);
+  }
   return std::string(reinterpret_cast<const char*>(value.data()), value.size());
 }
 
@@ -1211,7 +1423,12 @@ Expected<HashMetaValue> HashMetaValue::decode(const std::string& val) {
   offset += expt.value().second;
   count = expt.value().first;
 
-  return HashMetaValue(count);
+  HashMetaValue result(count);
+  auto s = decodeListPack(val, offset, &result._isListPack, &result._lp);
+  if (!s.ok()) {
+    return s;
+  }
+  return std::move(result);
 }
 
 HashMetaValue& HashMetaValue::operator=(HashMetaValue&& o) {
@@ -1219,7 +1436,10 @@ HashMetaValue& HashMetaValue::operator=(HashMetaValue&& o) {
     return *this;
   }
   _count = o._count;
+  _isListPack = o._isListPack;
+  _lp = std::move(o._lp);
   o._count = 0;
+  o._isListPack = false;
   return *this;
 }
 
@@ -1228,25 +1448,68 @@ void HashMetaValue::setCount(uint64_t count) {
 }
 
 uint64_t HashMetaValue::getCount() const {
-  return _count;
+  return _isListPack ? _lp.size() : _count;
+}
+
+ListPack* HashMetaValue::getListPack() {
+  return _isListPack ? &_lp : nullptr;
+}
+
+const ListPack* HashMetaValue::getListPack() const {
+  return _isListPack ? &_lp : nullptr;
+}
+
+void HashMetaValue::setListPack(ListPack lp) {
+  _isListPack = true;
+  _lp = std::move(lp);
+}
+
+void HashMetaValue::resetListPack() {
+  _count = _lp.size();
+  _isListPack = false;
+  _lp = ListPack();
 }
 
 ListMetaValue::ListMetaValue(uint64_t head, uint64_t tail)
-  : _head(head), _tail(tail) {}
+  : _head(head),
+    _tail(tail),
+    _chunked(false),
+    _nextNodeId(0),
+    _nodeCount(0),
+    _firstPos(0),
+    _lastPos(0) {}
 
 ListMetaValue::ListMetaValue(ListMetaValue&& v)
-  : _head(v._head), _tail(v._tail) {
+  : _head(v._head),
+    _tail(v._tail),
+    _chunked(v._chunked),
+    _nextNodeId(v._nextNodeId),
+    _nodeCount(v._nodeCount),
+    _firstPos(v._firstPos),
+    _lastPos(v._lastPos) {
   v._head = 0;
   v._tail = 0;
+  v._chunked = false;
+  v._nextNodeId = 0;
+  v._nodeCount = 0;
+  v._firstPos = 0;
+  v._lastPos = 0;
 }
 
 std::string ListMetaValue::encode() const {
   std::vector<uint8_t> value;
-  value.reserve(128);
+  value.reserve(64);
   auto headBytes = varintEncode(_head);
   value.insert(value.end(), headBytes.begin(), headBytes.end());
   auto tailBytes = varintEncode(_tail);
   value.insert(value.end(), tailBytes.begin(), tailBytes.end());
+  if (_chunked) {
+    value.push_back(ENCODING);
+    for (uint64_t v : {_nextNodeId, _nodeCount, _firstPos, _lastPos}) {
+      auto bytes = varintEncode(v);
+      value.insert(value.end(), bytes.begin(), bytes.end());
+    }
+  }
   return std::string(reinterpret_cast<const char*>(value.data()), value.size());
 }
 
@@ -1268,7 +1531,30 @@ Expected<ListMetaValue> ListMetaValue::decode(const std::string& val) {
   }
   offset += expt.value().second;
   tail = expt.value().first;
-  return ListMetaValue(head, tail);
+  ListMetaValue result(head, tail);
+  if (offset >= val.size() ||
+      static_cast<uint8_t>(val[offset]) != ENCODING) {
+    return std::move(result);
+  }
+  offset++;
+
+  // the nodes of a chunked list
+  uint64_t fields[4];
+  for (auto& field : fields) {
+    expt = varintDecodeFwd(valCstr + offset, val.size() - offset);
+    if (!expt.ok()) {
+      return expt.status();
+    }
+    offset += expt.value().second;
+    field = expt.value().first;
+  }
+  // a node holds one element at least
+  if (offset != val.size() || tail < head || fields[1] > tail - head ||
+      (fields[1] == 0) != (tail == head)) {
+    return {ErrorCodes::ERR_DECODE, "invalid list nodes"};
+  }
+  result.setNodes(fields[1], fields[2], fields[3], fields[0]);
+  return std::move(result);
 }
 
 ListMetaValue& ListMetaValue::operator=(ListMetaValue&& o) {
@@ -1277,11 +1563,32 @@ ListMetaValue& ListMetaValue::operator=(ListMetaValue&& o) {
   }
   _head = o._head;
   _tail = o._tail;
+  _chunked = o._chunked;
+  _nextNodeId = o._nextNodeId;
+  _nodeCount = o._nodeCount;
+  _firstPos = o._firstPos;
+  _lastPos = o._lastPos;
   o._head = 0;
   o._tail = 0;
+  o._chunked = false;
+  o._nextNodeId = 0;
+  o._nodeCount = 0;
+  o._firstPos = 0;
+  o._lastPos = 0;
   return *this;
 }
 
+void ListMetaValue::setNodes(uint64_t nodes,
+                             uint64_t firstPos,
+                             uint64_t lastPos,
+                             uint64_t nextNodeId) {
+  _chunked = true;
+  _nextNodeId = nextNodeId;
+  _nodeCount = nodes;
+  _firstPos = firstPos;
+  _lastPos = lastPos;
+}
+
 void ListMetaValue::setHead(uint64_t head) {
   _head = head;
 }
@@ -1298,9 +1605,10 @@ uint64_t ListMetaValue::getTail() const {
   return _tail;
 }
 
-SetMetaValue::SetMetaValue() : _count(0) {}
+SetMetaValue::SetMetaValue() : SetMetaValue(0) {}
 
-SetMetaValue::SetMetaValue(uint64_t count) : _count(count) {}
+SetMetaValue::SetMetaValue(uint64_t count)
+  : _count(count), _isListPack(false) {}
 
 Expected<SetMetaValue> SetMetaValue::decode(const std::string& val) {
   const uint8_t* valCstr = reinterpret_cast<const uint8_t*>(val.c_str());
@@ -1311,14 +1619,22 @@ Expected<SetMetaValue> SetMetaValue::decode(const std::string& val) {
   }
   offset += expt.value().second;
   uint64_t count = expt.value().first;
-  return SetMetaValue(count);
+  SetMetaValue result(count);
+  auto s = decodeListPack(val, offset, &result._isListPack, &result._lp);
+  if (!s.ok()) {
+    return s;
+  }
+  return result;
 }
 
 std::string SetMetaValue::encode() const {
   std::vector<uint8_t> value;
   value.reserve(8);
-  auto countBytes = varintEncode(_count);
+  auto countBytes = varintEncode(getCount());
   value.insert(value.end(), countBytes.begin(), countBytes.end());
+  if (_isListPack) {
+    _lp.encode(&value);
+  }
   return std::string(reinterpret_cast<const char*>(value.data()), value.size());
 }
 
@@ -1327,7 +1643,26 @@ void SetMetaValue::setCount(uint64_t count) {
 }
 
 uint64_t SetMetaValue::getCount() const {
-  return _count;
+  return _isListPack ? _lp.size() : _count;
+}
+
+ListPack* SetMetaValue::getListPack() {
+  return _isListPack ? &_lp : nullptr;
+}
+
+const ListPack* SetMetaValue::getListPack() const {
+  return _isListPack ? &_lp : nullptr;
+}
+
+void SetMetaValue::setListPack(ListPack lp) {
+  _isListPack = true;
+  _lp = std::move(lp);
+}
+
+void SetMetaValue::resetListPack() {
+  _count = _lp.size();
+  _isListPack = false;
+  _lp = ListPack();
 }
 
 uint32_t ZSlMetaValue::HEAD_ID = 1;
@@ -1339,7 +1674,8 @@ ZSlMetaValue::ZSlMetaValue(uint8_t lvl, uint32_t count, uint64_t tail)
     _maxLevel(MAX_LAYER),
     _count(count),
     _tail(tail),
-    _posAlloc(ZSlMetaValue::MIN_POS) {
+    _posAlloc(ZSlMetaValue::MIN_POS),
+    _isListPack(false) {
   // NOTE(vinchen): _maxLevel can't change. If you want to
   // change it, the constructor of ZSlEleValue should add new
   // parameter of it.
@@ -1364,7 +1700,7 @@ std::string ZSlMetaValue::encode() const {
   value.insert(value.end(), bytes.begin(), bytes.end());
   INVARIANT_D(_maxLevel == ZSlMetaValue::MAX_LAYER);
 
-  bytes = varintEncode(_count);
+  bytes = varintEncode(getCount());
   value.insert(value.end(), bytes.begin(), bytes.end());
 
   bytes = varintEncode(_tail);
@@ -1373,6 +1709,9 @@ std::string ZSlMetaValue::encode() const {
   bytes = varintEncode(_posAlloc);
   value.insert(value.end(), bytes.begin(), bytes.end());
 
+  if (_isListPack) {
+    _lp.encode(&value);
+  }
   return std::string(reinterpret_cast<const char*>(value.data()), value.size());
 }
 
@@ -1422,6 +1761,10 @@ Expected<ZSlMetaValue> ZSlMetaValue::decode(const std::string& val) {
   offset += expt.value().second;
   result._posAlloc = expt.value().first;
 
+  auto s = decodeListPack(val, offset, &result._isListPack, &result._lp);
+  if (!s.ok()) {
+    return s;
+  }
   return result;
 }
 
@@ -1434,7 +1777,8 @@ uint8_t ZSlMetaValue::getLevel() const {
 }
 
 uint32_t ZSlMetaValue::getCount() const {
-  return _count;
+  // the head is included
+  return _isListPack ? _lp.size() + 1 : _count;
 }
 
 uint64_t ZSlMetaValue::getTail() const {
@@ -1445,6 +1789,19 @@ uint64_t ZSlMetaValue::getPosAlloc() const {
   return _posAlloc;
 }
 
+ListPack* ZSlMetaValue::getListPack() {
+  return _isListPack ? &_lp : nullptr;
+}
+
+const ListPack* ZSlMetaValue::getListPack() const {
+  return _isListPack ? &_lp : nullptr;
+}
+
+void ZSlMetaValue::setListPack(ListPack lp) {
+  _isListPack = true;
+  _lp = std::move(lp);
+}
+
 /*
 ZslEleSubKey::ZslEleSubKey()
     :ZslEleSubKey(0, "") {
@@ -1728,6 +2085,145 @@ Expected<TTLIndex> TTLIndex::decode(const RecordKey& rk) {
   return TTLIndex(priKey, type, dbId, ttl);
 }
 
+RecordKey GCIndex::getRecordKey() const {
+  std::string index;
+  for (size_t i = 0; i < sizeof(_chunkId); ++i) {
+    index.push_back(
+      static_cast<char>((_chunkId >> ((sizeof(_chunkId) - i - 1) * 8)) & 0xff));
+  }
+  for (size_t i = 0; i < sizeof(_dbId); ++i) {
+    index.push_back(
+      static_cast<char>((_dbId >> ((sizeof(_dbId) - i - 1) * 8)) & 0xff));
+  }
+  index.append(_priKey);
+
+  return RecordKey(
+    GCIndex::CHUNKID, GCIndex::DBID, RecordType::RT_META, std::move(index), "");
+}
+
+std::string GCIndex::encode() const {
+  return getRecordKey().encode();
+}
+
+std::string GCIndex::encodeValue() const {
+  auto v = varintEncode(_version);
+  std::string value(v.begin(), v.end());
+  value.append(_types);
+  return value;
+}
+
+Expected<GCIndex> GCIndex::decode(const RecordKey& rk, const RecordValue& rv) {
+  const std::string& index = rk.getPrimaryKey();
+  if (rk.getChunkId() != GCIndex::CHUNKID ||
+      index.size() < sizeof(_chunkId) + sizeof(_dbId)) {
+    return {ErrorCodes::ERR_DECODE, "invalid gc index key"};
+  }
+  uint32_t chunkId = 0;
+  uint32_t dbId = 0;
+  size_t offset = 0;
+  for (size_t i = 0; i < sizeof(chunkId); ++i) {
+    chunkId = (chunkId << 8) | static_cast<uint8_t>(index[offset++]);
+  }
+  for (size_t i = 0; i < sizeof(dbId); ++i) {
+    dbId = (dbId << 8) | static_cast<uint8_t>(index[offset++]);
+  }
+
+  const std::string& value = rv.getValue();
+  auto v = varintDecodeFwd(reinterpret_cast<const uint8_t*>(value.c_str()),
+                           value.size());
+  if (!v.ok()) {
+    return {ErrorCodes::ERR_DECODE, "invalid gc index value"};
+  }
+  return GCIndex(chunkId,
+                 dbId,
+                 index.substr(offset),
+                 v.value().first,
+                 value.substr(v.value().second));
+}
+
+void GCIndex::addKey(RecordType valueType, uint64_t version) {
+  INVARIANT_D(isDataMetaType(valueType));
+  _version = std::max(_version, version);
+  char c = static_cast<char>(rt2Char(valueType));
+  if (_types.find(c) == std::string::npos) {
+    _types.push_back(c);
+  }
+}
+
+std::vector<RecordType> GCIndex::getTypes() const {
+  std::vector<RecordType> types;
+  for (auto c : _types) {
+    types.push_back(char2Rt(static_cast<uint8_t>(c)));
+  }
+  return types;
+}
+
+RecordKey KeyCount::getRecordKey() const {
+  std::string index;
+  for (size_t i = 0; i < sizeof(_chunkId); ++i) {
+    index.push_back(
+      static_cast<char>((_chunkId >> ((sizeof(_chunkId) - i - 1) * 8)) & 0xff));
+  }
+  for (size_t i = 0; i < sizeof(_dbId); ++i) {
+    index.push_back(
+      static_cast<char>((_dbId >> ((sizeof(_dbId) - i - 1) * 8)) & 0xff));
+  }
+
+  return RecordKey(KeyCount::CHUNKID,
+                   KeyCount::DBID,
+                   RecordType::RT_META,
+                   std::move(index),
+                   "");
+}
+
+std::string KeyCount::encode() const {
+  return getRecordKey().encode();
+}
+
+std::string KeyCount::encodeValue(int64_t count) {
+  return RecordValue(std::to_string(count), RecordType::RT_META, -1).encode();
+}
+
+Expected<int64_t> KeyCount::decodeValue(const std::string& value) {
+  auto eValue = RecordValue::decode(value);
+  if (!eValue.ok()) {
+    return eValue.status();
+  }
+  return ::tendisplus::stoll(eValue.value().getValue());
+}
+
+Expected<KeyCount> KeyCount::decode(const RecordKey& rk,
+                                    const RecordValue& rv) {
+  const std::string& index = rk.getPrimaryKey();
+  if (rk.getChunkId() != KeyCount::CHUNKID ||
+      index.size() != sizeof(_chunkId) + sizeof(_dbId)) {
+    return {ErrorCodes::ERR_DECODE, "invalid key count key"};
+  }
+  uint32_t chunkId = 0;
+  uint32_t dbId = 0;
+  size_t offset = 0;
+  for (size_t i = 0; i < sizeof(chunkId); ++i) {
+    chunkId = (chunkId << 8) | static_cast<uint8_t>(index[offset++]);
+  }
+  for (size_t i = 0; i < sizeof(dbId); ++i) {
+    dbId = (dbId << 8) | static_cast<uint8_t>(index[offset++]);
+  }
+  auto eCount = ::tendisplus::stoll(rv.getValue());
+  if (!eCount.ok()) {
+    return {ErrorCodes::ERR_DECODE, "invalid key count value"};
+  }
+  return KeyCount(chunkId, dbId, eCount.value());
+}
+
+RecordKey KeyCount::getMarkerKey() {
+  return RecordKey(
+    KeyCount::CHUNKID, KeyCount::DBID, RecordType::RT_META, "", "");
+}
+
+bool KeyCount::isMarker(const RecordKey& rk) {
+  return rk.getChunkId() == KeyCount::CHUNKID && rk.getPrimaryKey().empty();
+}
+
 Expected<VersionMeta> VersionMeta::decode(const RecordKey& rk,
                                           const RecordValue& rv) {
   const auto& json = rv.getValue();
@@ -1761,20 +2257,29 @@ Expected<uint64_t> getSubKeyCount(const RecordKey& key,
   INVARIANT_D(key.getRecordType() == RecordType::RT_DATA_META);
   switch (val.getRecordType()) {
     case RecordType::RT_KV: {
+      if (val.isPieced()) {
+        return (val.getTotalSize() + val.getPieceSize() - 1) /
+          val.getPieceSize();
+      }
       return 1;
     }
+    // the elements packed in the meta are not subkeys, see ListPack
     case RecordType::RT_HASH_META: {
       auto v = HashMetaValue::decode(val.getValue());
       if (!v.ok()) {
         return v.status();
       }
-      return v.value().getCount();
+      return v.value().getListPack() ? 0 : v.value().getCount();
     }
     case RecordType::RT_LIST_META: {
       auto v = ListMetaValue::decode(val.getValue());
       if (!v.ok()) {
         return v.status();
       }
+      // a node and its record in the node index, see QuickList
+      if (v.value().isChunked()) {
+        return v.value().getNodeCount() * 2;
+      }
       return v.value().getTail() - v.value().getHead();
     }
     case RecordType::RT_SET_META: {
@@ -1782,14 +2287,14 @@ Expected<uint64_t> getSubKeyCount(const RecordKey& key,
       if (!v.ok()) {
         return v.status();
       }
-      return v.value().getCount();
+      return v.value().getListPack() ? 0 : v.value().getCount();
     }
     case RecordType::RT_ZSET_META: {
       auto v = ZSlMetaValue::decode(val.getValue());
       if (!v.ok()) {
         return v.status();
       }
-      return v.value().getCount();
+      return v.value().getListPack() ? 0 : v.value().getCount();
     }
     default: {
       return {ErrorCodes::ERR_INTERNAL, "not support"};
@@ -1804,5 +2309,107 @@ std::string makeInvalidErrStr(RecordType type,
   return "Invalid " + rt2Str(type) + ":" + key + ", meta number is " +
     std::to_string(metaCnt) + ", element number is " + std::to_string(eleCnt);
 }
+
+RecordType getMetaType(RecordType eleType) {
+  switch (eleType) {
+    case RecordType::RT_LIST_ELE:
+    case RecordType::RT_LIST_NODE:
+      return RecordType::RT_LIST_META;
+    case RecordType::RT_HASH_ELE:
+      return RecordType::RT_HASH_META;
+    case RecordType::RT_SET_ELE:
+      return RecordType::RT_SET_META;
+    case RecordType::RT_ZSET_S_ELE:
+    case RecordType::RT_ZSET_H_ELE:
+      return RecordType::RT_ZSET_META;
+    case RecordType::RT_KV_PIECE:
+      return RecordType::RT_KV;
+    default:
+      INVARIANT_D(0);
+      return RecordType::RT_INVALID;
+  }
+}
+
+Expected<std::unique_ptr<ListPack>> getListPack(const RecordValue& meta) {
+  const ListPack* lp = nullptr;
+  switch (meta.getRecordType()) {
+    case RecordType::RT_HASH_META: {
+      auto v = HashMetaValue::decode(meta.getValue());
+      if (!v.ok()) {
+        return v.status();
+      }
+      lp = v.value().getListPack();
+      return lp ? std::make_unique<ListPack>(*lp) : nullptr;
+    }
+    case RecordType::RT_SET_META: {
+      auto v = SetMetaValue::decode(meta.getValue());
+      if (!v.ok()) {
+        return v.status();
+      }
+      lp = v.value().getListPack();
+      return lp ? std::make_unique<ListPack>(*lp) : nullptr;
+    }
+    case RecordType::RT_ZSET_META: {
+      auto v = ZSlMetaValue::decode(meta.getValue());
+      if (!v.ok()) {
+        return v.status();
+      }
+      lp = v.value().getListPack();
+      return lp ? std::make_unique<ListPack>(*lp) : nullptr;
+    }
+    default:
+      return std::unique_ptr<ListPack>();
+  }
+}
+
+std::list<Record> listPackRecords(const ListPack& lp,
+                                  const RecordKey& fakeEle) {
+  std::list<Record> result;
+  for (const auto& v : lp.getEntries()) {
+    RecordKey rk(fakeEle.getChunkId(),
+                 fakeEle.getDbId(),
+                 fakeEle.getRecordType(),
+                 fakeEle.getPrimaryKey(),
+                 v.first,
+                 fakeEle.getVersion());
+    RecordValue rv(v.second, fakeEle.getRecordType(), -1);
+    result.emplace_back(std::move(rk), std::move(rv));
+  }
+  return result;
+}
+
+std::vector<RecordType> getEleTypes(RecordType metaType) {
+  switch (metaType) {
+    case RecordType::RT_LIST_META:
+      return {RecordType::RT_LIST_ELE, RecordType::RT_LIST_NODE};
+    case RecordType::RT_HASH_META:
+      return {RecordType::RT_HASH_ELE};
+    case RecordType::RT_SET_META:
+      return {RecordType::RT_SET_ELE};
+    case RecordType::RT_ZSET_META:
+      return {RecordType::RT_ZSET_S_ELE, RecordType::RT_ZSET_H_ELE};
+    case RecordType::RT_KV:
+      return {RecordType::RT_KV_PIECE};
+    default:
+      return {};
+  }
+}
+
+bool isSubkeyOf(const RecordKey& rk, const RecordValue& meta) {
+  if (rk.getRecordType() == RecordType::RT_KV_PIECE && !meta.isPieced()) {
+    return false;
+  }
+  if ((rk.getRecordType() == RecordType::RT_LIST_ELE ||
+       rk.getRecordType() == RecordType::RT_LIST_NODE) &&
+      meta.getRecordType() == RecordType::RT_LIST_META) {
+    auto lm = ListMetaValue::decode(meta.getValue());
+    if (lm.ok() && lm.value().isChunked() !=
+          (rk.getRecordType() == RecordType::RT_LIST_NODE)) {
+      return false;
+    }
+  }
+  return meta.getRecordType() == getMetaType(rk.getRecordType()) &&
+    meta.getVersion() == rk.getVersion();
+}
 }  // namespace rcd_util
 }  // namespace tendisplus
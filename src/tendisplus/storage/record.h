@@ -8,6 +8,7 @@
 #include <string>
 #include <utility>
 #include <memory>
+#include <list>
 #include <vector>
 #include <limits>
 #include <sstream>
@@ -19,11 +20,15 @@
 
 namespace tendisplus {
 
+#define KEYCOUNT_CHUNKID 0XFFFC0000U
+#define GCINDEX_CHUNKID 0XFFFD0000U
 #define VERSIONMETA_CHUNKID 0XFFFE0000U
 #define TTLINDEX_CHUNKID 0XFFFF0000U
 #define REPLLOGKEY_CHUNKID 0XFFFFFF00U
 #define REPLLOGKEYV2_CHUNKID 0XFFFFFF01U
 
+#define KEYCOUNT_DBID 0XFFFC0000U
+#define GCINDEX_DBID 0XFFFD0000U
 #define VERSIONMETA_DBID 0XFFFE0000U
 #define TTLINDEX_DBID 0XFFFF0000U
 #define REPLLOGKEY_DBID 0XFFFFFF00U
@@ -54,6 +59,8 @@ enum class RecordType {
   RT_BINLOG,     /* For binlog in RecordKey and RecordValue  */
   RT_TTL_INDEX,  /* For ttl index  in RecordKey and RecordValue  */
   RT_DATA_META,  /* For key type in RecordKey */
+  RT_KV_PIECE,   /* For string piece type in RecordKey and RecordValue */
+  RT_LIST_NODE,  /* For list node type in RecordKey and RecordValue */
 };
 
 uint8_t rt2Char(RecordType t);
@@ -74,7 +81,8 @@ bool isRealEleType(RecordType keyType, RecordType valueType);
 // PK is primarykey, its length is described in len(PK)
 // 0
 // VERSION is varint, it means multi-version of record. For *_META, it
-//   always 0. Maybe it would be useful for _ELE. It would be always 0 now.
+//   always 0. For _ELE, it's the VERSION in the value of its meta, the
+//   subkeys of other versions are invisible and will be reclaimed.
 // SK is secondarykey, its length is not stored
 // len(PK) is varint32 stored in bigendian, so we can read from the end
 // backwards. the last 1B are reserved.
@@ -82,7 +90,8 @@ bool isRealEleType(RecordType keyType, RecordType valueType);
 // TYPE + TTL + VERSION + VERSIONEP + CAS + PIECESIZE + TOTALSIZE + UserValue
 // TYPE is one byte for real type of record
 // TTL is a varint64
-// VERSION is a varint64, for multi-version. Reversed, always 0
+// VERSION is a varint64, the version of the subkeys. It's 0 unless the
+//   key is recreated before its lazily deleted subkeys are reclaimed.
 // VERSIONEP is a varint64, for extended protocol. Reversed, always 0
 // CAS is a varint64, for cas cmd
 // PIECESIZE is a varint64, for very big value. Reversed, always 0
@@ -116,6 +125,9 @@ class RecordKey {
   const std::string& getSecondaryKey() const;
   uint32_t getChunkId() const;
   uint32_t getDbId() const;
+  uint64_t getVersion() const {
+    return _version;
+  }
 
   // an encoded prefix until prefix and a padding zero.
   // mainly for prefix scan.
@@ -131,6 +143,8 @@ class RecordKey {
   static const std::string& prefixReplLogV2();
   static const std::string& prefixTTLIndex();
   static const std::string& prefixVersionMeta();
+  static const std::string& prefixGCIndex();
+  static const std::string& prefixKeyCount();
 
   RecordType getRecordType() const;
   RecordType getRecordValueType() const;
@@ -142,6 +156,11 @@ class RecordKey {
   static RecordType decodeType(const char* key, size_t size);
   static Expected<bool> validate(const std::string& key,
                                  RecordType type = RecordType::RT_INVALID);
+  // size of chunkid|type|dbid|pk|0 of an encoded key, or of a prefixPk()
+  // with version 0, return 0 if it's neither of them.
+  // NOTE: a prefixPk() whose pk begins with 0 may be taken as an encoded
+  // key, so it's ambiguous.
+  static size_t decodePrefixPkSize(const char* key, size_t size);
   static size_t minSize();
   static size_t getHdrSize() {
     return PK_OFFSET;
@@ -238,6 +257,13 @@ class RecordValue {
   uint64_t getTotalSize() const {
     return _totalSize;
   }
+  void setTotalSize(uint64_t size) {
+    _totalSize = size;
+  }
+  // whether it's a string stored in RT_KV_PIECE records, see Bitmap
+  bool isPieced() const {
+    return _type == RecordType::RT_KV && _pieceSize != (uint64_t)-1;
+  }
   std::string encode() const;
   static Expected<RecordValue> decode(const std::string& value);
   static Expected<size_t> decodeHdrSize(const std::string& value);
@@ -260,20 +286,17 @@ class RecordValue {
   // meta type. For other RecordKey._type, it's useless.
   RecordType _type;
   uint64_t _ttl;
-  // version for subkey, maybe it useful for big key deletion, reversed
+  // version for subkey, see GCIndex
   uint64_t _version;
   // version for extended protocol, reversed
   uint64_t _versionEP;
   // cas
   int64_t _cas;
-  // For very big values, it may split into multi pieces;  reversed
+  // For very big values, it may split into multi pieces. Only a RT_KV
+  // may be pieced now, its _value is empty and the content is in the
+  // RT_KV_PIECE records of _version, see Bitmap
   uint64_t _pieceSize;
-  // if (_pieceSize > _totalSize)
-  //      _valus.size() == _totalSize
-  // else
-  //      _totalSize > _values.size()
-  // TODO(vinchen) it would be useful for append and bitmap
-  // the whole value size, maybe > _value.size()
+  // the whole value size of a pieced value
   uint64_t _totalSize;
   std::string _value;
 };
@@ -466,10 +489,10 @@ class ReplLogRawV2 {
   ReplLogRawV2(const std::string& key, const std::string& value);
   explicit ReplLogRawV2(const Record& record);
   ReplLogRawV2(std::string&& key, std::string&& value);
-  uint64_t getBinlogId();
-  uint64_t getVersionEp();
-  uint64_t getTimestamp();
-  uint32_t getChunkId();
+  uint64_t getBinlogId() const;
+  uint64_t getVersionEp() const;
+  uint64_t getTimestamp() const;
+  uint32_t getChunkId() const;
   const std::string& getReplLogKey() const {
     return _key;
   }
@@ -583,8 +606,20 @@ class BinlogReader {
   mystring_view _val;
 };
 
+/*
+ * A list keeps its elements either in the RT_LIST_ELE records of the
+ * sequences in [head, tail), or in the RT_LIST_NODE records of a chunked
+ * list, see QuickList. The meta of a chunked list follows the fixed
+ * fields with the next node id, the number of the nodes, and the
+ * positions of the head and the tail node in the node index:
+ * HEAD|TAIL|ENCODING|NEXTID|NODES|FIRST|LAST
+ * tail - head is the length of the list in both of the encodings.
+ */
 class ListMetaValue {
  public:
+  // never the first byte of a one byte varint
+  static constexpr uint8_t ENCODING = 0xA6;
+
   ListMetaValue(uint64_t head, uint64_t tail);
   ListMetaValue(ListMetaValue&&);
   static Expected<ListMetaValue> decode(const std::string&);
@@ -594,10 +629,77 @@ class ListMetaValue {
   uint64_t getHead() const;
   void setTail(uint64_t tail);
   uint64_t getTail() const;
+  bool isChunked() const {
+    return _chunked;
+  }
+  uint64_t getNextNodeId() const {
+    return _nextNodeId;
+  }
+  uint64_t getNodeCount() const {
+    return _nodeCount;
+  }
+  uint64_t getFirstPos() const {
+    return _firstPos;
+  }
+  uint64_t getLastPos() const {
+    return _lastPos;
+  }
+  // make it a chunked meta of nodes nodes, the head node is at firstPos
+  // of the node index and the tail node at lastPos
+  void setNodes(uint64_t nodes,
+                uint64_t firstPos,
+                uint64_t lastPos,
+                uint64_t nextNodeId);
 
  private:
   uint64_t _head;
   uint64_t _tail;
+  bool _chunked;
+  uint64_t _nextNodeId;
+  uint64_t _nodeCount;
+  uint64_t _firstPos;
+  uint64_t _lastPos;
+};
+
+/*
+ * The elements of a small hash, set or zset packed into its meta value,
+ * like the listpack of redis, so that reading or writing the collection
+ * costs one record. The entries are sorted by the subkey. The value of a
+ * set entry is empty, the value of a zset entry is the doubleEncode()ed
+ * score. It follows the fixed fields of the meta value:
+ * ...|ENCODING|N|LEN|SUBKEY|LEN|VALUE|...
+ * The metas without it keep their elements in the subkey records.
+ */
+class ListPack {
+ public:
+  using Entry = std::pair<std::string, std::string>;
+  // never the first byte of a one byte varint
+  static constexpr uint8_t ENCODING = 0xA5;
+
+  ListPack() = default;
+  // decode the listpack at the beginning of buf, the encoding byte
+  // has been skipped by the caller
+  static Expected<ListPack> decode(const uint8_t* buf, size_t size);
+  // append the encoding byte and the entries to out
+  void encode(std::vector<uint8_t>* out) const;
+  size_t size() const {
+    return _entries.size();
+  }
+  const std::vector<Entry>& getEntries() const {
+    return _entries;
+  }
+  // return nullptr if subkey not exists
+  const std::string* get(const std::string& subkey) const;
+  // return true if subkey is newly added
+  bool set(const std::string& subkey, const std::string& value);
+  // return true if subkey existed
+  bool del(const std::string& subkey);
+  // whether the entries are still small enough to be packed, see
+  // hash-max-listpack-entries and hash-max-listpack-value
+  bool fits(uint64_t maxEntries, uint64_t maxValue) const;
+
+ private:
+  std::vector<Entry> _entries;
 };
 
 class HashMetaValue {
@@ -612,9 +714,18 @@ class HashMetaValue {
   // void setCas(int64_t cas);
   uint64_t getCount() const;
   // uint64_t getCas() const;
+  // return nullptr if the fields are in the RT_HASH_ELE records
+  ListPack* getListPack();
+  const ListPack* getListPack() const;
+  // pack the fields into the meta, the count follows the listpack
+  void setListPack(ListPack lp);
+  // the fields are moved to the RT_HASH_ELE records by the caller
+  void resetListPack();
 
  private:
   uint64_t _count;
+  bool _isListPack;
+  ListPack _lp;
 };
 
 class SetMetaValue {
@@ -625,9 +736,18 @@ class SetMetaValue {
   std::string encode() const;
   void setCount(uint64_t count);
   uint64_t getCount() const;
+  // return nullptr if the members are in the RT_SET_ELE records
+  ListPack* getListPack();
+  const ListPack* getListPack() const;
+  // pack the members into the meta, the count follows the listpack
+  void setListPack(ListPack lp);
+  // the members are moved to the RT_SET_ELE records by the caller
+  void resetListPack();
 
  private:
   uint64_t _count;
+  bool _isListPack;
+  ListPack _lp;
 };
 
 
@@ -645,6 +765,9 @@ H_ELE: *(COUNT)
 CHUNK|DBID|H_ELE|KEY|SUBKEY|
 score
 
+A small zset has neither S_ELE nor H_ELE, its members are packed after
+the fields of META, see ListPack. The COUNT still includes the head.
+
 */
 
 // ZsetSkipListMetaValue
@@ -660,6 +783,11 @@ class ZSlMetaValue {
   uint32_t getCount() const;
   uint64_t getTail() const;
   uint64_t getPosAlloc() const;
+  // return nullptr if the members are in the S_ELE/H_ELE records
+  ListPack* getListPack();
+  const ListPack* getListPack() const;
+  // pack the members into the meta, the count follows the listpack
+  void setListPack(ListPack lp);
   // can not dynamicly change
   static constexpr int8_t MAX_LAYER = ZSKIPLIST_MAXLEVEL;
   static constexpr uint32_t MAX_NUM = (1 << 31);
@@ -675,6 +803,8 @@ class ZSlMetaValue {
   uint32_t _count;
   uint64_t _tail;
   uint64_t _posAlloc;
+  bool _isListPack;
+  ListPack _lp;
 };
 
 class ZSlEleValue {
@@ -773,6 +903,105 @@ class TTLIndex {
   static constexpr uint32_t DBID = TTLINDEX_CHUNKID;
 };
 
+// GCIndex records the collections of a key which are deleted lazily, only
+// their metas are deleted in the txn, the subkeys are left there and
+// reclaimed by GCManager in background. A collection created before the
+// reclaim gets a newer version than the deleted ones, and its subkeys
+// are kept apart from theirs. See Command::delKeyLazyInLock().
+// The pieces of a pieced string overwritten or deleted are recorded as a
+// RT_KV, see Bitmap.
+class GCIndex {
+ public:
+  GCIndex() : GCIndex(0, 0, "") {}
+  GCIndex(uint32_t chunkId,
+          uint32_t dbId,
+          const std::string& priKey,
+          uint64_t version = 0,
+          const std::string& types = "")
+    : _chunkId(chunkId),
+      _dbId(dbId),
+      _priKey(priKey),
+      _version(version),
+      _types(types) {}
+
+  // the key of the index record
+  RecordKey getRecordKey() const;
+  std::string encode() const;
+  std::string encodeValue() const;
+  static Expected<GCIndex> decode(const RecordKey& rk, const RecordValue& rv);
+
+  // add a collection of valueType and version deleted lazily, or the
+  // pieces of a string as RT_KV
+  void addKey(RecordType valueType, uint64_t version);
+  std::vector<RecordType> getTypes() const;
+
+  uint32_t getChunkId() const {
+    return _chunkId;
+  }
+  uint32_t getDbId() const {
+    return _dbId;
+  }
+  const std::string& getPriKey() const {
+    return _priKey;
+  }
+  // the newest version of the deleted collections
+  uint64_t getVersion() const {
+    return _version;
+  }
+
+ private:
+  uint32_t _chunkId;
+  uint32_t _dbId;
+  std::string _priKey;
+  uint64_t _version;
+  // rt2Char() of the value types of the deleted collections
+  std::string _types;
+
+ public:
+  static constexpr uint32_t CHUNKID = GCINDEX_CHUNKID;
+  static constexpr uint32_t DBID = GCINDEX_DBID;
+};
+
+// KeyCount is the number of the keys of a (chunk, db) in a kvstore. The
+// records are updated by merges in the txns writing the metas, so they
+// are always consistent with the data, see RocksTxn::commit(). The record
+// without chunk and db is the marker that the counts are complete, the
+// counts of a store without it are rebuilt when it's opened.
+class KeyCount {
+ public:
+  KeyCount() : KeyCount(0, 0, 0) {}
+  KeyCount(uint32_t chunkId, uint32_t dbId, int64_t count)
+    : _chunkId(chunkId), _dbId(dbId), _count(count) {}
+
+  RecordKey getRecordKey() const;
+  std::string encode() const;
+  // the value of the record, and the operand of the merges
+  static std::string encodeValue(int64_t count);
+  static Expected<int64_t> decodeValue(const std::string& value);
+  static Expected<KeyCount> decode(const RecordKey& rk, const RecordValue& rv);
+  static RecordKey getMarkerKey();
+  static bool isMarker(const RecordKey& rk);
+
+  uint32_t getChunkId() const {
+    return _chunkId;
+  }
+  uint32_t getDbId() const {
+    return _dbId;
+  }
+  int64_t getCount() const {
+    return _count;
+  }
+
+ private:
+  uint32_t _chunkId;
+  uint32_t _dbId;
+  int64_t _count;
+
+ public:
+  static constexpr uint32_t CHUNKID = KEYCOUNT_CHUNKID;
+  static constexpr uint32_t DBID = KEYCOUNT_DBID;
+};
+
 class VersionMeta {
  public:
   VersionMeta() : VersionMeta(0, 0, "") {}
@@ -829,6 +1058,21 @@ class VersionMeta {
 namespace rcd_util {
 Expected<uint64_t> getSubKeyCount(const RecordKey& key, const RecordValue& val);
 
+// the meta type of a subkey type, eg. RT_HASH_META of RT_HASH_ELE
+RecordType getMetaType(RecordType eleType);
+// the subkey types of a meta type, zset has two
+std::vector<RecordType> getEleTypes(RecordType metaType);
+// whether the subkey rk belongs to the collection of meta. if not, the
+// collection was deleted lazily and rk is an orphan waiting for reclaim
+bool isSubkeyOf(const RecordKey& rk, const RecordValue& meta);
+// the ListPack of a hash, set or zset meta, nullptr if the elements of the
+// collection are stored as subkeys
+Expected<std::unique_ptr<ListPack>> getListPack(const RecordValue& meta);
+// the subkey records of the elements packed in lp, as if they were stored
+// as subkeys. fakeEle gives the chunkid, dbid, type, pk and version
+std::list<Record> listPackRecords(const ListPack& lp,
+                                  const RecordKey& fakeEle);
+
 std::string makeInvalidErrStr(RecordType type,
                               const std::string& key,
                               uint64_t metaCnt,
@@ -0,0 +1,216 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include "tendisplus/storage/record_cache.h"
+#include "tendisplus/utils/invariant.h"
+
+namespace tendisplus {
+
+static_assert((RecordCache::SKETCH_WIDTH & (RecordCache::SKETCH_WIDTH - 1)) ==
+                0,
+              "the width of the sketch should be a power of 2");
+
+RecordCache::RecordCache(const std::shared_ptr<ServerParams>& cfg)
+  : _cfg(cfg) {}
+
+uint64_t RecordCache::capacity() const {
+  if (!_cfg || _cfg->kvStoreCount == 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(_cfg->recordCacheMB) * 1024 * 1024 /
+    _cfg->kvStoreCount;
+}
+
+bool RecordCache::enabled() const {
+  return capacity() > 0;
+}
+
+uint64_t RecordCache::shardCapacity() const {
+  return capacity() / SHARDS;
+}
+
+RecordCache::Shard& RecordCache::shardOf(const std::string& key) {
+  return _shards[std::hash<std::string>()(key) % SHARDS];
+}
+
+const RecordCache::Shard& RecordCache::shardOf(const std::string& key) const {
+  return _shards[std::hash<std::string>()(key) % SHARDS];
+}
+
+// the counters of key in each row of the sketch
+static std::array<size_t, 4> sketchIndexes(const std::string& key) {
+  // the shard is chosen by the low bits of the hash, mix it again
+  uint64_t h = std::hash<std::string>()(key) * 0x9E3779B97F4A7C15ULL;
+  std::array<size_t, 4> result;
+  for (size_t i = 0; i < result.size(); ++i) {
+    result[i] = (h >> (i * 16)) & (RecordCache::SKETCH_WIDTH - 1);
+  }
+  return result;
+}
+
+void RecordCache::countRead(Shard* shard, const std::string& key) {
+  for (auto i : sketchIndexes(key)) {
+    if (shard->sketch[i] < SKETCH_MAX) {
+      shard->sketch[i]++;
+    }
+  }
+  if (++shard->sketchReads >= SKETCH_WIDTH * 10) {
+    for (auto& v : shard->sketch) {
+      v >>= 1;
+    }
+    shard->sketchReads = 0;
+  }
+}
+
+uint8_t RecordCache::estimate(const Shard& shard,
+                              const std::string& key) const {
+  uint8_t result = SKETCH_MAX;
+  for (auto i : sketchIndexes(key)) {
+    result = std::min(result, shard.sketch[i]);
+  }
+  return result;
+}
+
+size_t RecordCache::sweep(Shard* shard) {
+  INVARIANT_D(!shard->map.empty());
+  while (true) {
+    if (shard->hand >= shard->clock.size()) {
+      shard->hand = 0;
+    }
+    Slot& slot = shard->clock[shard->hand];
+    if (slot.value && !slot.referenced) {
+      return shard->hand;
+    }
+    slot.referenced = false;
+    shard->hand++;
+  }
+}
+
+void RecordCache::eraseInLock(Shard* shard, size_t pos) {
+  Slot& slot = shard->clock[pos];
+  shard->memUsage -= slot.memUsage;
+  shard->map.erase(slot.key);
+  slot.key.clear();
+  slot.key.shrink_to_fit();
+  slot.value.reset();
+  slot.memUsage = 0;
+  slot.referenced = false;
+  shard->free.push_back(pos);
+}
+
+void RecordCache::clearInLock(Shard* shard) {
+  shard->epoch.fetch_add(1, std::memory_order_acq_rel);
+  shard->map.clear();
+  shard->clock.clear();
+  shard->free.clear();
+  shard->hand = 0;
+  shard->memUsage = 0;
+}
+
+Expected<RecordValue> RecordCache::get(const std::string& key) {
+  Shard& shard = shardOf(key);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  countRead(&shard, key);
+  auto it = shard.map.find(key);
+  if (it == shard.map.end()) {
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  Slot& slot = shard.clock[it->second];
+  slot.referenced = true;
+  hits.fetch_add(1, std::memory_order_relaxed);
+  return *slot.value;
+}
+
+uint64_t RecordCache::getEpoch(const std::string& key) const {
+  return shardOf(key).epoch.load(std::memory_order_acquire);
+}
+
+bool RecordCache::put(const std::string& key,
+                      const RecordValue& value,
+                      uint64_t epoch) {
+  uint64_t cap = shardCapacity();
+  uint64_t mem = key.size() + value.getValue().size() + sizeof(Slot) +
+    sizeof(RecordValue);
+  if (mem > cap / MAX_ENTRY_RATIO) {
+    return false;
+  }
+  Shard& shard = shardOf(key);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  // invalidated after the value was read from the store
+  if (shard.epoch.load(std::memory_order_acquire) != epoch) {
+    return false;
+  }
+  auto it = shard.map.find(key);
+  if (it != shard.map.end()) {
+    eraseInLock(&shard, it->second);
+  }
+  uint8_t reads = estimate(shard, key);
+  while (shard.memUsage + mem > cap) {
+    size_t victim = sweep(&shard);
+    if (estimate(shard, shard.clock[victim].key) >= reads) {
+      rejects.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    eraseInLock(&shard, victim);
+    evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  size_t pos;
+  if (!shard.free.empty()) {
+    pos = shard.free.back();
+    shard.free.pop_back();
+  } else {
+    pos = shard.clock.size();
+    shard.clock.emplace_back();
+  }
+  Slot& slot = shard.clock[pos];
+  slot.key = key;
+  slot.value = std::make_unique<RecordValue>(value);
+  slot.memUsage = mem;
+  slot.referenced = false;
+  shard.map[key] = pos;
+  shard.memUsage += mem;
+  return true;
+}
+
+void RecordCache::invalidate(const std::string& key) {
+  Shard& shard = shardOf(key);
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  shard.epoch.fetch_add(1, std::memory_order_acq_rel);
+  auto it = shard.map.find(key);
+  if (it != shard.map.end()) {
+    eraseInLock(&shard, it->second);
+  }
+}
+
+void RecordCache::clear() {
+  for (auto& shard : _shards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    clearInLock(&shard);
+  }
+}
+
+uint64_t RecordCache::memUsage() const {
+  uint64_t result = 0;
+  for (auto& shard : _shards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    result += shard.memUsage;
+  }
+  return result;
+}
+
+size_t RecordCache::size() const {
+  size_t result = 0;
+  for (auto& shard : _shards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    result += shard.map.size();
+  }
+  return result;
+}
+
+}  // namespace tendisplus
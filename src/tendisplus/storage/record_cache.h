@@ -0,0 +1,102 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_RECORD_CACHE_H_
+#define SRC_TENDISPLUS_STORAGE_RECORD_CACHE_H_
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "tendisplus/server/server_params.h"
+#include "tendisplus/storage/record.h"
+#include "tendisplus/utils/status.h"
+
+namespace tendisplus {
+
+// NOTE: RecordCache keeps the decoded RecordValues of the hot keys of a
+// kvstore, so that reading them skips the memtables, the L0 files and the
+// block cache of rocksdb, see RocksKVStore::getKV().
+// It is sharded by the hash of the encoded RecordKey. A shard evicts its
+// values in the CLOCK order, and admits a value only if its key is read
+// more often than the key it evicts, as counted by a small count-min
+// sketch of the reads (TinyLFU), so that a scan doesn't flush the hot keys.
+// Writers invalidate the keys after commit, see RocksTxn::commit(), and the
+// epochs prevent a value read before the invalidation from being put after
+// it, as ZSetIndexCache does.
+// The capacity is record-cache-mb shared by all the kvstores, and a value
+// bigger than 1/MAX_ENTRY_RATIO of a shard is not cached. It can't be
+// changed online, as the writers only track the keys written while it is
+// enabled.
+class RecordCache {
+ public:
+  explicit RecordCache(const std::shared_ptr<ServerParams>& cfg);
+  RecordCache(const RecordCache&) = delete;
+  RecordCache(RecordCache&&) = delete;
+  bool enabled() const;
+  uint64_t capacity() const;
+  // ERR_NOTFOUND if key is not cached
+  Expected<RecordValue> get(const std::string& key);
+  // get the epoch before reading key from the store, and pass it to put(),
+  // which ignores the value if key has been invalidated
+  uint64_t getEpoch(const std::string& key) const;
+  bool put(const std::string& key, const RecordValue& value, uint64_t epoch);
+  void invalidate(const std::string& key);
+  void clear();
+  uint64_t memUsage() const;
+  size_t size() const;
+
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> evictions{0};
+  // not admitted, for the keys evicted are read more often
+  std::atomic<uint64_t> rejects{0};
+
+  static constexpr size_t SHARDS = 16;
+  static constexpr uint64_t MAX_ENTRY_RATIO = 16;
+  // counters of the sketch of a shard, they are halved once SKETCH_WIDTH *
+  // 10 reads are counted, so that the keys once hot are forgotten
+  static constexpr size_t SKETCH_WIDTH = 4096;
+  static constexpr uint8_t SKETCH_MAX = 15;
+
+ private:
+  struct Slot {
+    std::string key;
+    // nullptr if the slot is free
+    std::unique_ptr<RecordValue> value;
+    uint64_t memUsage = 0;
+    // read since the hand of the clock passed it
+    bool referenced = false;
+  };
+  struct Shard {
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, size_t> map;
+    std::vector<Slot> clock;
+    std::vector<size_t> free;
+    size_t hand = 0;
+    uint64_t memUsage = 0;
+    std::array<uint8_t, SKETCH_WIDTH> sketch{};
+    uint64_t sketchReads = 0;
+    std::atomic<uint64_t> epoch{0};
+  };
+  uint64_t shardCapacity() const;
+  Shard& shardOf(const std::string& key);
+  const Shard& shardOf(const std::string& key) const;
+  // count a read of key in the sketch
+  void countRead(Shard* shard, const std::string& key);
+  uint8_t estimate(const Shard& shard, const std::string& key) const;
+  // the next slot not referenced, the shard is not empty
+  size_t sweep(Shard* shard);
+  void eraseInLock(Shard* shard, size_t pos);
+  void clearInLock(Shard* shard);
+  const std::shared_ptr<ServerParams> _cfg;
+  std::array<Shard, SHARDS> _shards;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_RECORD_CACHE_H_
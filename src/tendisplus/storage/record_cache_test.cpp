@@ -0,0 +1,131 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "tendisplus/storage/record_cache.h"
+
+namespace tendisplus {
+
+// n keys in the same shard of the cache
+std::vector<std::string> genShardKeys(size_t n) {
+  std::vector<std::string> keys;
+  for (size_t i = 0; keys.size() < n; ++i) {
+    auto key = "k" + std::to_string(i);
+    if (std::hash<std::string>()(key) % RecordCache::SHARDS == 0) {
+      keys.emplace_back(std::move(key));
+    }
+  }
+  return keys;
+}
+
+// read key from the cache, and put it on a miss, as RocksKVStore::getKV does
+bool readThrough(RecordCache* cache,
+                 const std::string& key,
+                 const RecordValue& value) {
+  if (cache->get(key).ok()) {
+    return true;
+  }
+  return cache->put(key, value, cache->getEpoch(key));
+}
+
+TEST(RecordCache, Common) {
+  auto cfg = std::make_shared<ServerParams>();
+  cfg->kvStoreCount = 2;
+  RecordCache cache(cfg);
+  EXPECT_FALSE(cache.enabled());
+  RecordValue v1("v1", RecordType::RT_KV, -1, 100);
+  EXPECT_FALSE(cache.put("k1", v1, cache.getEpoch("k1")));
+
+  cfg->recordCacheMB = 2;
+  EXPECT_TRUE(cache.enabled());
+  EXPECT_EQ(cache.capacity(), 1024 * 1024U);
+  EXPECT_TRUE(cache.put("k1", v1, cache.getEpoch("k1")));
+  auto eValue = cache.get("k1");
+  EXPECT_TRUE(eValue.ok());
+  EXPECT_EQ(eValue.value(), v1);
+  EXPECT_EQ(eValue.value().getTtl(), 100U);
+  EXPECT_EQ(cache.get("k2").status().code(), ErrorCodes::ERR_NOTFOUND);
+  EXPECT_EQ(cache.hits, 1U);
+  EXPECT_EQ(cache.misses, 1U);
+
+  // replaced
+  RecordValue v2("v2", RecordType::RT_KV, -1);
+  EXPECT_TRUE(cache.put("k1", v2, cache.getEpoch("k1")));
+  EXPECT_EQ(cache.get("k1").value(), v2);
+  EXPECT_EQ(cache.size(), 1U);
+
+  // invalidated after the epoch is got
+  uint64_t epoch = cache.getEpoch("k1");
+  cache.invalidate("k1");
+  EXPECT_FALSE(cache.get("k1").ok());
+  EXPECT_FALSE(cache.put("k1", v1, epoch));
+  EXPECT_TRUE(cache.put("k1", v1, cache.getEpoch("k1")));
+  EXPECT_EQ(cache.size(), 1U);
+  EXPECT_GT(cache.memUsage(), 0U);
+
+  epoch = cache.getEpoch("k2");
+  cache.clear();
+  EXPECT_EQ(cache.size(), 0U);
+  EXPECT_EQ(cache.memUsage(), 0U);
+  EXPECT_FALSE(cache.put("k2", v2, epoch));
+}
+
+TEST(RecordCache, Admit) {
+  auto cfg = std::make_shared<ServerParams>();
+  cfg->kvStoreCount = 1;
+  cfg->recordCacheMB = 1;
+  RecordCache cache(cfg);
+  uint64_t shardCap = cache.capacity() / RecordCache::SHARDS;
+  RecordValue value(std::string(shardCap / 20, 'v'), RecordType::RT_KV, -1);
+
+  // too big to be cached
+  RecordValue big(std::string(shardCap / RecordCache::MAX_ENTRY_RATIO, 'v'),
+                  RecordType::RT_KV,
+                  -1);
+  EXPECT_FALSE(cache.put("big", big, cache.getEpoch("big")));
+
+  auto keys = genShardKeys(40);
+  // the hot keys fill the shard, the ones after it is full are rejected
+  for (size_t i = 0; i < 20; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      readThrough(&cache, keys[i], value);
+    }
+  }
+  size_t cached = cache.size();
+  EXPECT_GT(cached, 10U);
+  EXPECT_LT(cached, 20U);
+  EXPECT_LE(cache.memUsage(), shardCap);
+  EXPECT_GT(cache.memUsage() + value.getValue().size() * 2, shardCap);
+  for (size_t i = 0; i < cached; ++i) {
+    EXPECT_TRUE(cache.get(keys[i]).ok());
+  }
+
+  // a scan of the keys read once doesn't evict them
+  uint64_t rejects = cache.rejects;
+  for (size_t i = 20; i < 40; ++i) {
+    EXPECT_FALSE(readThrough(&cache, keys[i], value));
+  }
+  EXPECT_EQ(cache.size(), cached);
+  EXPECT_EQ(cache.rejects, rejects + 20);
+  uint64_t evictions = cache.evictions;
+  uint64_t hits = cache.hits;
+  for (size_t i = 0; i < cached; ++i) {
+    EXPECT_TRUE(cache.get(keys[i]).ok());
+  }
+  EXPECT_EQ(cache.hits, hits + cached);
+
+  // a key read more often than the ones cached is admitted
+  for (int j = 0; j < 8; ++j) {
+    readThrough(&cache, keys[39], value);
+  }
+  EXPECT_TRUE(cache.get(keys[39]).ok());
+  EXPECT_GT(cache.evictions, evictions);
+  EXPECT_LE(cache.memUsage(), shardCap);
+}
+
+}  // namespace tendisplus
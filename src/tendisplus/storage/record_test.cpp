@@ -4,6 +4,7 @@
 
 #include <time.h>
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <set>
@@ -126,6 +127,36 @@ TEST(Record, MinRec) {
   EXPECT_TRUE(minSize == RecordValue::minSize());
 }
 
+TEST(Record, PrefixPkSize) {
+  for (auto& pk : {"a", "abc", "", "\xff\x01"}) {
+    for (auto& sk : {"", "x", "\0\0"}) {
+      RecordKey rk(1, 2, RecordType::RT_HASH_ELE, pk, sk);
+      std::string key = rk.encode();
+      size_t size = RecordKey::getHdrSize() + strlen(pk) + 1;
+      EXPECT_EQ(RecordKey::decodePrefixPkSize(key.c_str(), key.size()), size);
+
+      std::string prefix = rk.prefixPk();
+      if (strlen(pk) != 0) {
+        EXPECT_EQ(prefix.size(), size + 1);
+        EXPECT_EQ(
+          RecordKey::decodePrefixPkSize(prefix.c_str(), prefix.size()), size);
+      }
+    }
+  }
+
+  // a pk beginning with 0 is still right for the encoded keys
+  std::string pk("\0a", 2);
+  RecordKey rk(1, 2, RecordType::RT_SET_ELE, pk, "b");
+  std::string key = rk.encode();
+  EXPECT_EQ(RecordKey::decodePrefixPkSize(key.c_str(), key.size()),
+            RecordKey::getHdrSize() + pk.size() + 1);
+
+  EXPECT_EQ(RecordKey::decodePrefixPkSize("", 0), 0U);
+  RecordKey chunk(1, 2, RecordType::RT_INVALID, "", "");
+  std::string prefix = chunk.prefixChunkid();
+  EXPECT_EQ(RecordKey::decodePrefixPkSize(prefix.c_str(), prefix.size()), 0U);
+}
+
 TEST(Record, Common) {
   srand((unsigned int)time(NULL));
 #ifdef _WIN32
@@ -359,6 +390,53 @@ TEST(TTLIndex, Prefix) {
   EXPECT_EQ(prefix[8], '\x00');
 }
 
+TEST(GCIndex, Common) {
+  GCIndex index(10, 2, "abc");
+  index.addKey(RecordType::RT_HASH_META, 3);
+  index.addKey(RecordType::RT_SET_META, 1);
+  index.addKey(RecordType::RT_HASH_META, 5);
+  EXPECT_EQ(index.getVersion(), 5);
+
+  RecordKey rk = index.getRecordKey();
+  EXPECT_EQ(rk.getChunkId(), GCIndex::CHUNKID);
+  EXPECT_EQ(rk.encode().compare(0,
+                                RecordKey::prefixGCIndex().size(),
+                                RecordKey::prefixGCIndex()),
+            0);
+  RecordValue rv(index.encodeValue(), RecordType::RT_META, -1);
+  auto eIndex = GCIndex::decode(rk, rv);
+  EXPECT_TRUE(eIndex.ok());
+  EXPECT_EQ(eIndex.value().getChunkId(), 10);
+  EXPECT_EQ(eIndex.value().getDbId(), 2);
+  EXPECT_EQ(eIndex.value().getPriKey(), "abc");
+  EXPECT_EQ(eIndex.value().getVersion(), 5);
+  std::vector<RecordType> types = {RecordType::RT_HASH_META,
+                                   RecordType::RT_SET_META};
+  EXPECT_EQ(eIndex.value().getTypes(), types);
+
+  RecordKey badRk(0, 0, RecordType::RT_META, "abc", "");
+  EXPECT_FALSE(GCIndex::decode(badRk, rv).ok());
+}
+
+TEST(GCIndex, IsSubkeyOf) {
+  RecordValue meta("", RecordType::RT_HASH_META, -1);
+  meta.setVersion(2);
+  RecordKey ele(0, 0, RecordType::RT_HASH_ELE, "abc", "f", 2);
+  EXPECT_TRUE(rcd_util::isSubkeyOf(ele, meta));
+  RecordKey oldEle(0, 0, RecordType::RT_HASH_ELE, "abc", "f", 1);
+  EXPECT_FALSE(rcd_util::isSubkeyOf(oldEle, meta));
+  RecordKey setEle(0, 0, RecordType::RT_SET_ELE, "abc", "f", 2);
+  EXPECT_FALSE(rcd_util::isSubkeyOf(setEle, meta));
+
+  // versions sort after the version 0 prefix of the same pk
+  std::string prefix = RecordKey(0, 0, RecordType::RT_HASH_ELE, "abc", "")
+                         .prefixPk();
+  prefix.pop_back();
+  EXPECT_EQ(ele.encode().compare(0, prefix.size(), prefix), 0);
+  EXPECT_EQ(oldEle.encode().compare(0, prefix.size(), prefix), 0);
+  EXPECT_LT(oldEle.encode(), ele.encode());
+}
+
 TEST(ZSl, Common) {
   srand(time(NULL));
 #ifdef _WIN32
@@ -404,6 +482,132 @@ TEST(ZSl, Common) {
   }
 }
 
+TEST(ListPack, Common) {
+  ListPack lp;
+  EXPECT_TRUE(lp.set("b", "2"));
+  EXPECT_TRUE(lp.set("a", "1"));
+  EXPECT_FALSE(lp.set("b", "3"));
+  EXPECT_EQ(lp.size(), 2);
+  EXPECT_EQ(*lp.get("b"), "3");
+  EXPECT_EQ(lp.get("c"), nullptr);
+  EXPECT_EQ(lp.getEntries().front().first, "a");
+
+  EXPECT_TRUE(lp.fits(2, 1));
+  EXPECT_FALSE(lp.fits(1, 1));
+  EXPECT_TRUE(lp.set("c", "33"));
+  EXPECT_FALSE(lp.fits(3, 1));
+
+  std::vector<uint8_t> buf;
+  lp.encode(&buf);
+  EXPECT_EQ(buf[0], ListPack::ENCODING);
+  auto elp = ListPack::decode(buf.data() + 1, buf.size() - 1);
+  EXPECT_TRUE(elp.ok());
+  EXPECT_EQ(elp.value().getEntries(), lp.getEntries());
+  EXPECT_FALSE(ListPack::decode(buf.data() + 1, buf.size() - 2).ok());
+
+  EXPECT_TRUE(lp.del("a"));
+  EXPECT_FALSE(lp.del("a"));
+  EXPECT_EQ(lp.size(), 2);
+}
+
+TEST(ListPack, Meta) {
+  ListPack lp;
+  lp.set("f1", "v1");
+  lp.set("f2", "v2");
+
+  HashMetaValue hm;
+  hm.setListPack(lp);
+  auto ehm = HashMetaValue::decode(hm.encode());
+  EXPECT_TRUE(ehm.ok());
+  EXPECT_EQ(ehm.value().getCount(), 2);
+  EXPECT_NE(ehm.value().getListPack(), nullptr);
+  EXPECT_EQ(*ehm.value().getListPack()->get("f2"), "v2");
+
+  // metas written before the listpack are read as per-subkey
+  ehm = HashMetaValue::decode(HashMetaValue(5).encode());
+  EXPECT_TRUE(ehm.ok());
+  EXPECT_EQ(ehm.value().getCount(), 5);
+  EXPECT_EQ(ehm.value().getListPack(), nullptr);
+
+  hm.resetListPack();
+  EXPECT_EQ(hm.getListPack(), nullptr);
+  EXPECT_EQ(hm.getCount(), 2);
+
+  SetMetaValue sm;
+  sm.setListPack(lp);
+  auto esm = SetMetaValue::decode(sm.encode());
+  EXPECT_TRUE(esm.ok());
+  EXPECT_EQ(esm.value().getCount(), 2);
+  EXPECT_NE(esm.value().getListPack(), nullptr);
+  esm = SetMetaValue::decode(SetMetaValue(3).encode());
+  EXPECT_TRUE(esm.ok());
+  EXPECT_EQ(esm.value().getListPack(), nullptr);
+
+  // the head of the skiplist is included into the count
+  ZSlMetaValue zm(1, 1, 0);
+  zm.setListPack(lp);
+  auto ezm = ZSlMetaValue::decode(zm.encode());
+  EXPECT_TRUE(ezm.ok());
+  EXPECT_EQ(ezm.value().getCount(), 3);
+  EXPECT_NE(ezm.value().getListPack(), nullptr);
+  ezm = ZSlMetaValue::decode(ZSlMetaValue(1, 1, 0).encode());
+  EXPECT_TRUE(ezm.ok());
+  EXPECT_EQ(ezm.value().getListPack(), nullptr);
+
+  RecordValue rv(zm.encode(), RecordType::RT_ZSET_META, -1);
+  rv.setVersion(7);
+  auto elp = rcd_util::getListPack(rv);
+  EXPECT_TRUE(elp.ok());
+  EXPECT_NE(elp.value(), nullptr);
+  RecordKey fake(1, 2, RecordType::RT_ZSET_H_ELE, "z", "", 7);
+  auto rcds = rcd_util::listPackRecords(*elp.value(), fake);
+  EXPECT_EQ(rcds.size(), 2);
+  EXPECT_EQ(rcds.front().getRecordKey().getSecondaryKey(), "f1");
+  EXPECT_EQ(rcds.front().getRecordKey().getVersion(), 7);
+  EXPECT_EQ(rcds.front().getRecordValue().getValue(), "v1");
+}
+
+TEST(ListMeta, Chunked) {
+  ListMetaValue lm(100, 106);
+  lm.setNodes(2, 1ULL << 63, (1ULL << 63) + 7, 5);
+  EXPECT_TRUE(lm.isChunked());
+  auto elm = ListMetaValue::decode(lm.encode());
+  EXPECT_TRUE(elm.ok());
+  EXPECT_TRUE(elm.value().isChunked());
+  EXPECT_EQ(elm.value().getHead(), 100);
+  EXPECT_EQ(elm.value().getTail(), 106);
+  EXPECT_EQ(elm.value().getNextNodeId(), 5);
+  EXPECT_EQ(elm.value().getNodeCount(), 2);
+  EXPECT_EQ(elm.value().getFirstPos(), 1ULL << 63);
+  EXPECT_EQ(elm.value().getLastPos(), (1ULL << 63) + 7);
+
+  // metas written before the nodes are read as per-element
+  elm = ListMetaValue::decode(ListMetaValue(1, 5).encode());
+  EXPECT_TRUE(elm.ok());
+  EXPECT_FALSE(elm.value().isChunked());
+  EXPECT_EQ(elm.value().getTail(), 5);
+
+  // a node holds one element at least
+  std::string v = lm.encode();
+  v.pop_back();
+  EXPECT_FALSE(ListMetaValue::decode(v).ok());
+  ListMetaValue bad(100, 101);
+  bad.setNodes(2, 1, 2, 3);
+  EXPECT_FALSE(ListMetaValue::decode(bad.encode()).ok());
+
+  RecordValue meta(lm.encode(), RecordType::RT_LIST_META, -1);
+  meta.setVersion(2);
+  RecordKey node(0, 0, RecordType::RT_LIST_NODE, "l", "n", 2);
+  RecordKey ele(0, 0, RecordType::RT_LIST_ELE, "l", "100", 2);
+  EXPECT_TRUE(rcd_util::isSubkeyOf(node, meta));
+  EXPECT_FALSE(rcd_util::isSubkeyOf(ele, meta));
+  RecordValue oldMeta(ListMetaValue(1, 5).encode(),
+                      RecordType::RT_LIST_META, -1);
+  oldMeta.setVersion(2);
+  EXPECT_FALSE(rcd_util::isSubkeyOf(node, oldMeta));
+  EXPECT_TRUE(rcd_util::isSubkeyOf(ele, oldMeta));
+}
+
 TEST(VersionMeta, Compare) {
   auto meta1 = VersionMeta(0, 0, "sync_1");
   auto meta2 = VersionMeta(0, -1, "sync_1");
@@ -454,7 +454,7 @@ ReplLogRawV2::ReplLogRawV2(std::string&& key, std::string&& value)
 ReplLogRawV2::ReplLogRawV2(ReplLogRawV2&& o)
   : _key(std::move(o._key)), _val(std::move(o._val)) {}
 
-uint64_t ReplLogRawV2::getBinlogId() {
+uint64_t ReplLogRawV2::getBinlogId() const {
   if (_key.size() < RecordKey::minSize()) {
     INVARIANT_D(0);
     return Transaction::TXNID_UNINITED;
@@ -463,7 +463,7 @@ uint64_t ReplLogRawV2::getBinlogId() {
   return int64Decode(_key.c_str() + ReplLogKeyV2::BINLOG_OFFSET);
 }
 
-uint64_t ReplLogRawV2::getVersionEp() {
+uint64_t ReplLogRawV2::getVersionEp() const {
   if (_val.size() <
       RecordValue::minSize() + ReplLogValueV2::fixedHeaderSize()) {
     INVARIANT_D(0);
@@ -480,7 +480,7 @@ uint64_t ReplLogRawV2::getVersionEp() {
                      ReplLogValueV2::VERSIONEP_OFFSET);
 }
 
-uint64_t ReplLogRawV2::getTimestamp() {
+uint64_t ReplLogRawV2::getTimestamp() const {
   if (_val.size() <
       RecordValue::minSize() + ReplLogValueV2::fixedHeaderSize()) {
     INVARIANT_D(0);
@@ -496,7 +496,7 @@ uint64_t ReplLogRawV2::getTimestamp() {
                      ReplLogValueV2::TIMESTAMP_OFFSET);
 }
 
-uint32_t ReplLogRawV2::getChunkId() {
+uint32_t ReplLogRawV2::getChunkId() const {
   if (_val.size() <
       RecordValue::minSize() + ReplLogValueV2::fixedHeaderSize()) {
     INVARIANT_D(0);
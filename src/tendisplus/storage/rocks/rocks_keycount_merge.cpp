@@ -0,0 +1,34 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include "glog/logging.h"
+#include "tendisplus/storage/rocks/rocks_keycount_merge.h"
+#include "tendisplus/storage/record.h"
+
+namespace tendisplus {
+
+bool KeyCountMergeOperator::Merge(const rocksdb::Slice& key,
+                                  const rocksdb::Slice* existing_value,
+                                  const rocksdb::Slice& value,
+                                  std::string* new_value,
+                                  rocksdb::Logger* /*logger*/) const {
+  int64_t count = 0;
+  if (existing_value != nullptr) {
+    auto eCount = KeyCount::decodeValue(existing_value->ToString());
+    if (!eCount.ok()) {
+      LOG(ERROR) << "invalid key count:" << hexlify(key.ToString());
+      return false;
+    }
+    count = eCount.value();
+  }
+  auto eDelta = KeyCount::decodeValue(value.ToString());
+  if (!eDelta.ok()) {
+    LOG(ERROR) << "invalid key count delta:" << hexlify(key.ToString());
+    return false;
+  }
+  *new_value = KeyCount::encodeValue(count + eDelta.value());
+  return true;
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,32 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_KEYCOUNT_MERGE_H_
+#define SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_KEYCOUNT_MERGE_H_
+
+#include <string>
+#include "rocksdb/merge_operator.h"
+#include "rocksdb/slice.h"
+
+namespace tendisplus {
+
+// adds the deltas merged into the KeyCount records, both the values and
+// the operands are KeyCount::encodeValue(). The txns add their deltas by
+// MergeUntracked(), so they never conflict with each other.
+class KeyCountMergeOperator : public rocksdb::AssociativeMergeOperator {
+ public:
+  const char* Name() const override {
+    return "tendisplus.KeyCountMerge";
+  }
+
+  bool Merge(const rocksdb::Slice& key,
+             const rocksdb::Slice* existing_value,
+             const rocksdb::Slice& value,
+             std::string* new_value,
+             rocksdb::Logger* logger) const override;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_KEYCOUNT_MERGE_H_
@@ -2,6 +2,7 @@
 // Please refer to the license text that comes with this tendis open source
 // project for additional information.
 
+#include <fstream>
 #include <memory>
 #include <utility>
 #include <string>
@@ -26,11 +27,14 @@
 #include "rocksdb/utilities/backupable_db.h"
 #include "rocksdb/utilities/checkpoint.h"
 #include "rocksdb/options.h"
+#include "rocksdb/convenience.h"
 #include "rocksdb/iostats_context.h"
 #include "rocksdb/perf_context.h"
 
 #include "tendisplus/storage/rocks/rocks_kvstore.h"
+#include "tendisplus/storage/rocks/rocks_keycount_merge.h"
 #include "tendisplus/storage/rocks/rocks_kvttlcompactfilter.h"
+#include "tendisplus/storage/rocks/rocks_prefix_transform.h"
 #include "tendisplus/utils/sync_point.h"
 #include "tendisplus/utils/scopeguard.h"
 #include "tendisplus/utils/invariant.h"
@@ -39,6 +43,7 @@
 #include "tendisplus/server/session.h"
 #include "tendisplus/server/server_entry.h"
 #include "tendisplus/storage/varint.h"
+#include "tendisplus/storage/binlog_file.h"
 
 namespace tendisplus {
 
@@ -57,8 +62,12 @@ namespace tendisplus {
 #endif
 
 RocksKVCursor::RocksKVCursor(std::unique_ptr<rocksdb::Iterator> it)
+  : RocksKVCursor(std::move(it), "") {}
+
+RocksKVCursor::RocksKVCursor(std::unique_ptr<rocksdb::Iterator> it,
+                             const std::string& start)
   : Cursor(), _it(std::move(it)) {
-  _it->Seek("");
+  _it->Seek(rocksdb::Slice(start.c_str(), start.size()));
 }
 
 void RocksKVCursor::seek(const std::string& prefix) {
@@ -191,11 +200,36 @@ std::unique_ptr<VersionMetaCursor> RocksTxn::createVersionMetaCursor() {
   return std::make_unique<VersionMetaCursor>(std::move(cursor));
 }
 
+std::unique_ptr<GCIndexCursor> RocksTxn::createGCIndexCursor() {
+  RecordKey chunkMax(GCIndex::CHUNKID + 1, 0, RecordType::RT_INVALID, "", "");
+  string upperbound = chunkMax.prefixChunkid();
+  auto cursor =
+    createCursor(ColumnFamilyNumber::ColumnFamily_Default, &upperbound);
+  return std::make_unique<GCIndexCursor>(std::move(cursor));
+}
+
 std::unique_ptr<BasicDataCursor> RocksTxn::createDataCursor() {
   auto cursor = createCursor(ColumnFamilyNumber::ColumnFamily_Default);
   return std::make_unique<BasicDataCursor>(std::move(cursor));
 }
 
+std::unique_ptr<BasicDataCursor> RocksTxn::createPkCursor(
+  const std::string& prefix) {
+  rocksdb::ReadOptions readOpts;
+  RESET_PERFCONTEXT();
+  readOpts.snapshot = _txn->GetSnapshot();
+  if (RecordKeyPrefixTransform::isPkPrefix(prefix)) {
+    // stop at the first key of another pk, the prefix blooms can
+    // filter the memtables and sst files which have no such pk
+    readOpts.prefix_same_as_start = true;
+  } else {
+    readOpts.total_order_seek = true;
+  }
+  std::unique_ptr<rocksdb::Iterator> iter(_txn->GetIterator(readOpts));
+  auto cursor = std::make_unique<RocksKVCursor>(std::move(iter), prefix);
+  return std::make_unique<BasicDataCursor>(std::move(cursor), false);
+}
+
 std::unique_ptr<AllDataCursor> RocksTxn::createAllDataCursor() {
   auto cursor = createCursor(ColumnFamilyNumber::ColumnFamily_Default);
   return std::make_unique<AllDataCursor>(std::move(cursor));
@@ -217,6 +251,8 @@ std::unique_ptr<Cursor> RocksTxn::createCursor(
     readOpts.iterate_upper_bound = &_upperBound;
   }
   readOpts.snapshot = _txn->GetSnapshot();
+  // prefix_extractor is set, seek across pks needs total_order_seek
+  readOpts.total_order_seek = true;
   // create iterator corresponding to chosen column family
   rocksdb::Iterator* iter;
   if (column_family_num == ColumnFamilyNumber::ColumnFamily_Default) {
@@ -305,10 +341,36 @@ Expected<uint64_t> RocksTxn::commit() {
     binlogTxnId = _txnId;
   }
 
+  // the key counts are changed in the same write with the metas
+  for (const auto& v : _keyCountDeltas) {
+    if (v.second == 0) {
+      continue;
+    }
+    KeyCount kc(v.first.first, v.first.second, 0);
+    auto s =
+      _txn->MergeUntracked(kc.encode(), KeyCount::encodeValue(v.second));
+    if (!s.ok()) {
+      binlogTxnId = Transaction::TXNID_UNINITED;
+      return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+    }
+  }
+
   TEST_SYNC_POINT("RocksTxn::commit()::1");
   TEST_SYNC_POINT("RocksTxn::commit()::2");
   auto s = _txn->Commit();
   if (s.ok()) {
+    for (const auto& key : _modifiedMetas) {
+      if (_zsetIndexUpdates.count(key) == 0) {
+        _store->getZSetIndexCache()->invalidate(key);
+      }
+    }
+    for (const auto& v : _zsetIndexUpdates) {
+      _store->getZSetIndexCache()->update(v.first, v.second);
+    }
+    for (const auto& key : _modifiedKeys) {
+      _store->getRecordCache()->invalidate(key);
+    }
+    _store->getKeyCounter()->apply(_keyCountDeltas);
     return _txnId;
   } else {
     binlogTxnId = Transaction::TXNID_UNINITED;
@@ -380,6 +442,38 @@ Expected<std::string> RocksTxn::getKV(const std::string& key) {
   return {ErrorCodes::ERR_INTERNAL, s.ToString()};
 }
 
+std::vector<Expected<std::string>> RocksTxn::getKVs(
+  const std::vector<std::string>& keys) {
+  std::vector<Expected<std::string>> result;
+  if (keys.size() == 0) {
+    return result;
+  }
+  result.reserve(keys.size());
+
+  rocksdb::ReadOptions readOpts;
+  RESET_PERFCONTEXT();
+  std::vector<rocksdb::Slice> slices;
+  slices.reserve(keys.size());
+  for (const auto& key : keys) {
+    INVARIANT_D(RecordKey::decodeType(key) != RecordType::RT_BINLOG);
+    slices.emplace_back(key);
+  }
+
+  std::vector<std::string> values;
+  auto ss = _txn->MultiGet(readOpts, slices, &values);
+  INVARIANT_D(ss.size() == keys.size() && values.size() == keys.size());
+  for (size_t i = 0; i < ss.size(); i++) {
+    if (ss[i].ok()) {
+      result.emplace_back(std::move(values[i]));
+    } else if (ss[i].IsNotFound()) {
+      result.emplace_back(ErrorCodes::ERR_NOTFOUND, ss[i].ToString());
+    } else {
+      result.emplace_back(ErrorCodes::ERR_INTERNAL, ss[i].ToString());
+    }
+  }
+  return result;
+}
+
 Status RocksTxn::setKV(const std::string& key,
                        const std::string& val,
                        const uint64_t ts) {
@@ -388,11 +482,16 @@ Status RocksTxn::setKV(const std::string& key,
   }
 
   RESET_PERFCONTEXT();
+  auto cs = countKey(key, false, val);
+  if (!cs.ok()) {
+    return cs;
+  }
   // put data into default column family
   auto s = _txn->Put(key, val);
   if (!s.ok()) {
     return {ErrorCodes::ERR_INTERNAL, s.ToString()};
   }
+  addModifiedKey(key);
 
   if (_store->enableRepllog()) {
     INVARIANT_D(_store->dbId() != CATALOG_NAME);
@@ -426,12 +525,17 @@ Status RocksTxn::delKV(const std::string& key, const uint64_t ts) {
   if (RecordKey::decodeType(key) == RecordType::RT_BINLOG) {
     s = _txn->Delete(_store->getBinlogColumnFamilyHandle(), key);
   } else {
+    auto cs = countKey(key, true);
+    if (!cs.ok()) {
+      return cs;
+    }
     s = _txn->Delete(key);
   }
 
   if (!s.ok()) {
     return {ErrorCodes::ERR_INTERNAL, s.ToString()};
   }
+  addModifiedKey(key);
 
   if (_store->enableRepllog()) {
     INVARIANT_D(_store->dbId() != CATALOG_NAME);
@@ -528,17 +632,27 @@ Status RocksTxn::applyBinlog(const ReplLogValueEntryV2& logEntry) {
   switch (logEntry.getOp()) {
     case ReplOp::REPL_OP_SET: {
       // TODO(vinchen): RecordKey::validate()
+      auto cs = countKey(logEntry.getOpKey(), false);
+      if (!cs.ok()) {
+        return cs;
+      }
       auto s = _txn->Put(logEntry.getOpKey(), logEntry.getOpValue());
       if (!s.ok()) {
         return {ErrorCodes::ERR_INTERNAL, s.ToString()};
       }
+      addModifiedKey(logEntry.getOpKey());
       break;
     }
     case ReplOp::REPL_OP_DEL: {
+      auto cs = countKey(logEntry.getOpKey(), true);
+      if (!cs.ok()) {
+        return cs;
+      }
       auto s = _txn->Delete(logEntry.getOpKey());
       if (!s.ok()) {
         return {ErrorCodes::ERR_INTERNAL, s.ToString()};
       }
+      addModifiedKey(logEntry.getOpKey());
       break;
     }
     case ReplOp::REPL_OP_STMT: {
@@ -565,6 +679,172 @@ Status RocksTxn::applyBinlog(const ReplLogValueEntryV2& logEntry) {
   return {ErrorCodes::ERR_OK, ""};
 }
 
+void RocksTxn::addModifiedKey(const std::string& key) {
+  if (key.size() <= RecordKey::getHdrSize() ||
+      RecordKey::decodeChunkId(key) >= CLUSTER_SLOTS) {
+    return;
+  }
+  if (_store->getRecordCache()->enabled()) {
+    _modifiedKeys.push_back(key);
+  }
+  if (RecordKey::decodeType(key) == RecordType::RT_DATA_META &&
+      _store->getZSetIndexCache()->enabled()) {
+    _modifiedMetas.push_back(key);
+    _zsetIndexUpdates.erase(key);
+  }
+}
+
+void RocksTxn::updateZSetIndex(const std::string& key,
+                               ZSetIndexUpdate&& update) {
+  if (_store->getZSetIndexCache()->enabled()) {
+    _zsetIndexUpdates[key] = std::move(update);
+  }
+}
+
+namespace {
+// whether the value is a pieced string, see Bitmap. Only the header is
+// decoded, a plain string may be big.
+bool decodePieced(const std::string& value, uint64_t* version) {
+  if (value.size() < RecordValue::minSize() ||
+      RecordValue::decodeType(value.c_str(), value.size()) !=
+        RecordType::RT_KV) {
+    return false;
+  }
+  auto eSize = RecordValue::decodeHdrSize(value);
+  if (!eSize.ok()) {
+    return false;
+  }
+  auto eValue = RecordValue::decode(value.substr(0, eSize.value()));
+  if (!eValue.ok() || !eValue.value().isPieced()) {
+    return false;
+  }
+  *version = eValue.value().getVersion();
+  return true;
+}
+
+// the ttl of the value if it's a string, otherwise 0
+uint64_t decodeStringTtl(const std::string& value) {
+  if (value.size() < RecordValue::minSize() ||
+      RecordValue::decodeType(value.c_str(), value.size()) !=
+        RecordType::RT_KV) {
+    return 0;
+  }
+  return RecordValue::decodeTtl(value.c_str(), value.size());
+}
+}  // namespace
+
+Status RocksTxn::countKey(const std::string& key,
+                          bool isDelete,
+                          const std::string& newValue) {
+  if (key.size() <= RecordKey::getHdrSize() ||
+      RecordKey::decodeType(key) != RecordType::RT_DATA_META ||
+      RecordKey::decodeChunkId(key) >= CLUSTER_SLOTS) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  // the latest value, not the one in the snapshot of the txn
+  std::string value;
+  auto s = _txn->Get(rocksdb::ReadOptions(), key, &value);
+  if (!s.ok() && !s.IsNotFound()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  bool exists = s.ok();
+  if (exists == isDelete) {
+    auto& delta = _keyCountDeltas[{RecordKey::decodeChunkId(key),
+                                   RecordKey::decodeDbId(key)}];
+    delta += isDelete ? -1 : 1;
+  }
+  if (_replOnly) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+
+  // NOTE: the commands write the ttl indexes of the other types, but a
+  // string is mostly overwritten without being read, so its ttl index is
+  // kept here, where the old value is read anyway. IndexManager deletes
+  // the expired strings by them, and the slaves get them by the binlog.
+  uint64_t oldTtl = exists ? decodeStringTtl(value) : 0;
+  uint64_t newTtl = isDelete ? 0 : decodeStringTtl(newValue);
+  if (oldTtl != newTtl && !_store->getCfg()->noexpire) {
+    auto ts = indexStringTtl(key, oldTtl, newTtl);
+    if (!ts.ok()) {
+      return ts;
+    }
+  }
+
+  // NOTE: the pieces are not deleted with the meta of a pieced string,
+  // GCManager reclaims them. A string pieced again gets a version newer
+  // than the GCIndex, see Command::getSubkeyVersion(). The GCIndex of a
+  // master is replicated by the binlog.
+  uint64_t oldVersion = 0;
+  uint64_t newVersion = 0;
+  if (exists && decodePieced(value, &oldVersion) &&
+      (isDelete || !decodePieced(newValue, &newVersion) ||
+       newVersion != oldVersion)) {
+    return addPiecesToGC(key, oldVersion);
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status RocksTxn::indexStringTtl(const std::string& key,
+                                uint64_t oldTtl,
+                                uint64_t newTtl) {
+  auto eKey = RecordKey::decode(key);
+  if (!eKey.ok()) {
+    return eKey.status();
+  }
+  const auto& mk = eKey.value();
+  if (oldTtl > 0) {
+    TTLIndex index(mk.getPrimaryKey(), RecordType::RT_KV, mk.getDbId(), oldTtl);
+    auto s = delKV(index.encode());
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (newTtl > 0) {
+    TTLIndex index(mk.getPrimaryKey(), RecordType::RT_KV, mk.getDbId(), newTtl);
+    auto s =
+      setKV(index.encode(), RecordValue(RecordType::RT_TTL_INDEX).encode());
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status RocksTxn::addPiecesToGC(const std::string& key, uint64_t version) {
+  auto eKey = RecordKey::decode(key);
+  if (!eKey.ok()) {
+    return eKey.status();
+  }
+  const auto& mk = eKey.value();
+  GCIndex index(mk.getChunkId(), mk.getDbId(), mk.getPrimaryKey());
+  RecordKey indexRk = index.getRecordKey();
+  std::string indexKey = indexRk.encode();
+  std::string oldIndex;
+  auto s = _txn->Get(rocksdb::ReadOptions(), indexKey, &oldIndex);
+  if (s.ok()) {
+    auto eValue = RecordValue::decode(oldIndex);
+    if (!eValue.ok()) {
+      return eValue.status();
+    }
+    auto eIndex = GCIndex::decode(indexRk, eValue.value());
+    if (!eIndex.ok()) {
+      return eIndex.status();
+    }
+    index = std::move(eIndex.value());
+  } else if (!s.IsNotFound()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  std::string before = index.encodeValue();
+  index.addKey(RecordType::RT_KV, version);
+  if (s.ok() && index.encodeValue() == before) {
+    // recorded already, e.g. by Command::delKeyLazyInLock()
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  return setKV(
+    indexKey,
+    RecordValue(index.encodeValue(), RecordType::RT_META, -1).encode());
+}
+
 Status RocksTxn::setBinlogKV(uint64_t binlogId,
                              const std::string& logKey,
                              const std::string& logValue) {
@@ -628,7 +908,8 @@ uint64_t RocksTxn::getBinlogId() const {
 }
 
 void RocksTxn::setBinlogId(uint64_t binlogId) {
-  INVARIANT_D(_binlogId == Transaction::TXNID_UNINITED);
+  INVARIANT_D(_binlogId == Transaction::TXNID_UNINITED ||
+              (_replOnly && binlogId > _binlogId));
   _binlogId = binlogId;
 }
 
@@ -1068,6 +1349,13 @@ rocksdb::Options RocksKVStore::options() {
   if (!_cfg->level1Compress) {
     options.compression_per_level[1] = rocksdb::kNoCompression;
   }
+  if (_cfg->rocksPrefixBloom) {
+    // blooms on chunkid|type|dbid|pk, so that seeking into a collection
+    // that doesn't exist (or a small one) skips most of the sst files.
+    // the full-key blooms of the filter_policy still serve Get().
+    options.prefix_extractor = std::make_shared<RecordKeyPrefixTransform>();
+    options.memtable_prefix_bloom_size_ratio = 0.1;
+  }
   options.statistics = _stats;
   options.create_if_missing = true;
 
@@ -1100,6 +1388,7 @@ rocksdb::Options RocksKVStore::options() {
     options.compaction_filter_factory.reset(
       new KVTtlCompactionFilterFactory(this));
   }
+  options.merge_operator = std::make_shared<KeyCountMergeOperator>();
 
   // background listener
   auto listener = std::make_shared<BackgroundErrorListener>(_env);
@@ -1182,6 +1471,11 @@ Status RocksKVStore::stop() {
   }
   _isRunning = false;
 
+  _baseDB.store(nullptr, std::memory_order_release);
+  if (_optdb || _pesdb) {
+    // wait for the running compactions, their filters may read the db
+    rocksdb::CancelAllBackgroundWork(getBaseDB(), true);
+  }
   for (auto* h : _cfHandles) {
     delete h;
   }
@@ -1247,41 +1541,6 @@ RocksKVStore::TxnMode RocksKVStore::getTxnMode() const {
   return _txnMode;
 }
 
-// keylen(4) + key + vallen(4) + value
-int64_t RocksKVStore::saveBinlogV2(std::ofstream* fs, const ReplLogRawV2& log) {
-  uint64_t written = 0;
-  INVARIANT_D(fs != nullptr);
-
-  uint32_t keyLen = log.getReplLogKey().size();
-  uint32_t keyLenTrans = int32Encode(keyLen);
-  fs->write(reinterpret_cast<char*>(&keyLenTrans), sizeof(keyLenTrans));
-  if (!fs->good()) {
-    LOG(INFO) << "fs->write() failed.";
-    return -1;
-  }
-  fs->write(log.getReplLogKey().c_str(), keyLen);
-  if (!fs->good()) {
-    LOG(INFO) << "fs->write() failed.";
-    return -1;
-  }
-  uint32_t valLen = log.getReplLogValue().size();
-  uint32_t valLenTrans = int32Encode(valLen);
-  fs->write(reinterpret_cast<char*>(&valLenTrans), sizeof(valLenTrans));
-  if (!fs->good()) {
-    LOG(INFO) << "fs->write() failed.";
-    return -1;
-  }
-  fs->write(log.getReplLogValue().c_str(), valLen);
-  if (!fs->good()) {
-    LOG(INFO) << "fs->write() failed.";
-    return -1;
-  }
-  written += keyLen + valLen + sizeof(keyLen) + sizeof(valLen);
-
-  INVARIANT_D(fs->good());
-  return written;
-}
-
 Expected<bool> RocksKVStore::deleteBinlog(uint64_t start) {
   auto ptxn = const_cast<RocksKVStore*>(this)->createTransaction(nullptr);
   if (!ptxn.ok()) {
@@ -1331,7 +1590,7 @@ Expected<TruncateBinlogResult> RocksKVStore::truncateBinlogV2(
   uint64_t end,
   uint64_t save,
   Transaction* txn,
-  std::ofstream* fs,
+  BinlogFileWriter* fs,
   int64_t maxWritelen,
   bool tailSlave) {
   // DLOG(INFO) << "truncateBinlogV2 dbid:" << dbId()
@@ -1381,15 +1640,15 @@ Expected<TruncateBinlogResult> RocksKVStore::truncateBinlogV2(
         break;
       }
       // save binlog
-      int len = saveBinlogV2(fs, explog.value());
-      if (len < 0) {
-        LOG(ERROR) << "saveBinlogV2 failed, break.";
+      auto eLen = fs->append(explog.value());
+      if (!eLen.ok()) {
         // NOTE(takenliu): maybe write part of explog, so the binlog file's last
         // binlog will be error. then we change a new binlog file.
-        ret = -1;
-        break;
+        // the binlogs kept by fs are lost too, so the txn must not commit.
+        LOG(ERROR) << "save binlog failed:" << eLen.status().toString();
+        return eLen.status();
       }
-      written += len;
+      written += eLen.value();
     }
     nextSave = explog.value().getBinlogId() + 1;
     if (_cfg->binlogDelRange == 1 || _cfg->binlogDelRange == 0) {
@@ -1419,6 +1678,16 @@ Expected<TruncateBinlogResult> RocksKVStore::truncateBinlogV2(
     }
   }
 
+  if (fs) {
+    // the binlogs deleted by txn are in the file before it commits
+    auto eLen = fs->flush();
+    if (!eLen.ok()) {
+      LOG(ERROR) << "save binlog failed:" << eLen.status().toString();
+      return eLen.status();
+    }
+    written += eLen.value();
+  }
+
   result.deleten = deleten;
   result.written = written;
   result.timestamp = ts;
@@ -1588,6 +1857,10 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
     if (_isRunning) {
       return {ErrorCodes::ERR_INTERNAL, "already running"};
     }
+    // the data may be cleared or restored from a backup
+    _zsetIndexCache.clear();
+    _recordCache.clear();
+    _keyCounter.clear();
     LOG(INFO) << "RocksKVStore::restart id:" << dbId() << " restore:" << restore
               << " nextBinlogSeq:" << nextBinlogSeq
               << " highestVisible:" << highestVisible;
@@ -1637,8 +1910,12 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
     column_families.push_back(rocksdb::ColumnFamilyDescriptor(
       rocksdb::kDefaultColumnFamilyName, columOpts));
     if (!_cfg->binlogUsingDefaultCF) {
+      // binlogs are always iterated in total order
+      rocksdb::Options binlogOpts = columOpts;
+      binlogOpts.prefix_extractor.reset();
+      binlogOpts.memtable_prefix_bloom_size_ratio = 0;
       column_families.push_back(
-        rocksdb::ColumnFamilyDescriptor("binlog_cf", columOpts));
+        rocksdb::ColumnFamilyDescriptor("binlog_cf", binlogOpts));
     }
     if (_txnMode == TxnMode::TXN_OPT) {
       rocksdb::OptimisticTransactionDB* tmpDb = nullptr;
@@ -1657,11 +1934,13 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
         return {ErrorCodes::ERR_INTERNAL, status.ToString()};
       }
       rocksdb::ReadOptions readOpts;
+      readOpts.total_order_seek = true;
       iter.reset(
         tmpDb->GetBaseDB()->NewIterator(readOpts, getDataColumnFamilyHandle()));
       binlog_iter.reset(tmpDb->GetBaseDB()->NewIterator(
         readOpts, getBinlogColumnFamilyHandle()));
       _optdb.reset(tmpDb);
+      _baseDB.store(getBaseDB(), std::memory_order_release);
     } else {
       rocksdb::TransactionDB* tmpDb = nullptr;
       rocksdb::TransactionDBOptions txnDbOptions;
@@ -1685,11 +1964,13 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
       }
       LOG(INFO) << "rocksdb Open sucess,id:" << dbId() << " dbname:" << dbname;
       rocksdb::ReadOptions readOpts;
+      readOpts.total_order_seek = true;
       iter.reset(
         tmpDb->GetBaseDB()->NewIterator(readOpts, getDataColumnFamilyHandle()));
       binlog_iter.reset(tmpDb->GetBaseDB()->NewIterator(
         readOpts, getBinlogColumnFamilyHandle()));
       _pesdb.reset(tmpDb);
+      _baseDB.store(getBaseDB(), std::memory_order_release);
     }
     // NOTE(deyukong): during starttime, mutex is held and
     // no need to consider visibility
@@ -1770,6 +2051,10 @@ Expected<uint64_t> RocksKVStore::restart(bool restore,
       }
     }
 
+    auto s = loadKeyCounts();
+    if (!s.ok()) {
+      return s;
+    }
     _isRunning = true;
   }
   {
@@ -1812,12 +2097,15 @@ RocksKVStore::RocksKVStore(const std::string& id,
     _txnMode(txnMode),
     _optdb(nullptr),
     _pesdb(nullptr),
+    _baseDB(nullptr),
     _stats(rocksdb::CreateDBStatistics()),
     _blockCache(blockCache),
     _nextTxnSeq(0),
     _highestVisible(Transaction::TXNID_UNINITED),
     _logOb(nullptr),
-    _env(std::make_shared<RocksdbEnv>()) {
+    _env(std::make_shared<RocksdbEnv>()),
+    _zsetIndexCache(cfg),
+    _recordCache(cfg) {
   if (_cfg->noexpire) {
     _enableFilter = false;
   }
@@ -1872,7 +2160,8 @@ Expected<BackupInfo> RocksKVStore::backup(const std::string& dir,
   // BACKUP_COPY works with arbitory dir except the default one.
   // But if someone feels it necessary to add one more param make it clearer,
   // go ahead.
-  if (mode == KVStore::BackupMode::BACKUP_CKPT_INTER) {
+  if (mode == KVStore::BackupMode::BACKUP_CKPT_INTER ||
+      mode == KVStore::BackupMode::BACKUP_LINK_INTER) {
     // BACKUP_CKPT_INTER works with the default backupdir and _hasBackup flag.
     if (dir != dftBackupDir()) {
       return {ErrorCodes::ERR_INTERNAL, "BACKUP_CKPT_INTER invalid dir"};
@@ -1897,8 +2186,15 @@ Expected<BackupInfo> RocksKVStore::backup(const std::string& dir,
   }
   result.setBinlogPos(highVisible);
   result.setStartTimeSec(sinceEpoch());
-  if (mode == KVStore::BackupMode::BACKUP_CKPT ||
-      mode == KVStore::BackupMode::BACKUP_CKPT_INTER) {
+  std::map<std::string, uint64_t> flist;
+  if (mode == KVStore::BackupMode::BACKUP_LINK_INTER) {
+    auto eFlist = linkLiveFiles(dir);
+    if (!eFlist.ok()) {
+      return eFlist.status();
+    }
+    flist = std::move(eFlist.value());
+  } else if (mode == KVStore::BackupMode::BACKUP_CKPT ||
+             mode == KVStore::BackupMode::BACKUP_CKPT_INTER) {
     rocksdb::Checkpoint* checkpoint = nullptr;
     auto guard = MakeGuard([this, checkpoint]() {
       if (checkpoint) {
@@ -1928,25 +2224,28 @@ Expected<BackupInfo> RocksKVStore::backup(const std::string& dir,
       return {ErrorCodes::ERR_INTERNAL, s.ToString()};
     }
   }
-  std::map<std::string, uint64_t> flist;
-  try {
-    for (auto& p : filesystem::recursive_directory_iterator(dir)) {
-      const filesystem::path& path = p.path();
-      if (!filesystem::is_regular_file(p)) {
-        LOG(INFO) << "backup ignore:" << p.path();
-        continue;
-      }
-      size_t filesize = filesystem::file_size(path);
+  // the files linked are listed already, and some of them may grow after
+  // linked
+  if (mode != KVStore::BackupMode::BACKUP_LINK_INTER) {
+    try {
+      for (auto& p : filesystem::recursive_directory_iterator(dir)) {
+        const filesystem::path& path = p.path();
+        if (!filesystem::is_regular_file(p)) {
+          LOG(INFO) << "backup ignore:" << p.path();
+          continue;
+        }
+        size_t filesize = filesystem::file_size(path);
 #ifndef _WIN32
-      // assert path with bkupdir prefix
-      // for win32, the dir should change to "\\"
-      INVARIANT(path.string().find(dir) == 0);
+        // assert path with bkupdir prefix
+        // for win32, the dir should change to "\\"
+        INVARIANT(path.string().find(dir) == 0);
 #endif
-      std::string relative = path.string().erase(0, dir.size());
-      flist[relative] = filesize;
+        std::string relative = path.string().erase(0, dir.size());
+        flist[relative] = filesize;
+      }
+    } catch (const std::exception& ex) {
+      return {ErrorCodes::ERR_INTERNAL, ex.what()};
     }
-  } catch (const std::exception& ex) {
-    return {ErrorCodes::ERR_INTERNAL, ex.what()};
   }
   result.setFileList(flist);
   result.setEndTimeSec(sinceEpoch());
@@ -1960,6 +2259,105 @@ Expected<BackupInfo> RocksKVStore::backup(const std::string& dir,
   return result;
 }
 
+// The live files are kept by rocksdb until they are linked, the links keep
+// them after, so the backup costs no disk space but the MANIFEST and the
+// WALs rocksdb is appending. Only their sizes at GetLiveFiles() belong to
+// the backup, which the senders of the files keep to.
+Expected<std::map<std::string, uint64_t>> RocksKVStore::linkLiveFiles(
+  const std::string& dir) {
+  rocksdb::DB* db = getBaseDB();
+  auto s = db->DisableFileDeletions();
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  auto guard = MakeGuard([this, db]() {
+    auto s = db->EnableFileDeletions(false);
+    if (!s.ok()) {
+      LOG(ERROR) << "store:" << dbId()
+                 << " enable file deletions failed:" << s.ToString();
+    }
+  });
+
+  // the memtables are flushed, the wals only have the writes after it
+  std::vector<std::string> liveFiles;
+  uint64_t manifestSize = 0;
+  s = db->GetLiveFiles(liveFiles, &manifestSize, true);
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  rocksdb::VectorLogPtr walFiles;
+  s = db->GetSortedWalFiles(walFiles);
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+
+  bool succ = false;
+  auto cleanGuard = MakeGuard([&dir, &succ]() {
+    if (!succ) {
+      std::error_code ec;
+      filesystem::remove_all(dir, ec);
+    }
+  });
+  std::error_code ec;
+  filesystem::create_directories(dir, ec);
+  if (ec) {
+    return {ErrorCodes::ERR_INTERNAL, "create " + dir + ":" + ec.message()};
+  }
+  auto link = [&dir](const std::string& src,
+                     const std::string& name) -> Status {
+    std::error_code ec;
+    filesystem::create_hard_link(src, dir + name, ec);
+    if (ec) {
+      return {ErrorCodes::ERR_INTERNAL, "link " + src + ":" + ec.message()};
+    }
+    return {ErrorCodes::ERR_OK, ""};
+  };
+
+  // the names are like "/000012.sst" relative to the dbpath
+  std::map<std::string, uint64_t> flist;
+  std::string manifest;
+  for (const auto& name : liveFiles) {
+    auto s = link(db->GetName() + name, name);
+    if (!s.ok()) {
+      return s;
+    }
+    if (name.find("/MANIFEST-") == 0) {
+      manifest = name.substr(1);
+      flist[name] = manifestSize;
+    } else {
+      flist[name] = filesystem::file_size(dir + name, ec);
+      if (ec) {
+        return {ErrorCodes::ERR_INTERNAL, ec.message()};
+      }
+    }
+  }
+  // CURRENT is replaced but not rewritten, the one linked points to the
+  // MANIFEST above unless it's switched meanwhile
+  std::ifstream current(dir + "/CURRENT");
+  std::string currentManifest;
+  std::getline(current, currentManifest);
+  if (manifest.empty() || currentManifest != manifest) {
+    return {ErrorCodes::ERR_INTERNAL, "MANIFEST switched, retry later"};
+  }
+
+  std::string walDir = db->GetDBOptions().wal_dir;
+  if (walDir.empty()) {
+    walDir = db->GetName();
+  }
+  for (const auto& wal : walFiles) {
+    if (wal->Type() != rocksdb::kAliveLogFile) {
+      continue;
+    }
+    auto s = link(walDir + wal->PathName(), wal->PathName());
+    if (!s.ok()) {
+      return s;
+    }
+    flist[wal->PathName()] = wal->SizeFileBytes();
+  }
+  succ = true;
+  return flist;
+}
+
 Expected<std::string> RocksKVStore::saveBackupMeta(const std::string& dir,
                                                    BackupInfo* backup) {
   rapidjson::StringBuffer sb;
@@ -2168,11 +2566,17 @@ void RocksKVStore::setNextBinlogSeq(uint64_t binlogId, Transaction* txn) {
 
   _nextBinlogSeq = binlogId + 1;
 
+  auto it = _aliveTxns.find(txn->getTxnId());
+  INVARIANT_D(it != _aliveTxns.end() && !it->second.first);
+  if (txn->getBinlogId() != Transaction::TXNID_UNINITED) {
+    // a txn storing several binlogs is visible as the last one of them,
+    // see applyTxnsInLanesV2()
+    INVARIANT_D(binlogId > txn->getBinlogId());
+    _aliveBinlogs.erase(txn->getBinlogId());
+  }
   txn->setBinlogId(binlogId);
   INVARIANT_D(_aliveBinlogs.find(binlogId) == _aliveBinlogs.end());
   _aliveBinlogs.insert({binlogId, {false, txn->getTxnId()}});
-  auto it = _aliveTxns.find(txn->getTxnId());
-  INVARIANT_D(it != _aliveTxns.end() && !it->second.first);
 
   it->second.second = binlogId;
 }
@@ -2199,6 +2603,22 @@ rocksdb::DB* RocksKVStore::getBaseDB() const {
   return _optdb.get() ? _optdb->GetBaseDB() : _pesdb->GetBaseDB();
 }
 
+Expected<RecordValue> RocksKVStore::getKVNoTxn(const RecordKey& key) {
+  rocksdb::DB* db = _baseDB.load(std::memory_order_acquire);
+  if (db == nullptr) {
+    return {ErrorCodes::ERR_INTERNAL, "store not opened"};
+  }
+  std::string value;
+  auto s = db->Get(rocksdb::ReadOptions(), key.encode(), &value);
+  if (s.IsNotFound()) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  if (!s.ok()) {
+    return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+  }
+  return RecordValue::decode(value);
+}
+
 void RocksKVStore::addUnCommitedTxnInLock(uint64_t txnId) {
   if (_aliveTxns.find(txnId) != _aliveTxns.end()) {
     LOG(FATAL) << "BUG: txnid:" << txnId << " double add uncommitted";
@@ -2262,11 +2682,29 @@ void RocksKVStore::markCommittedInLock(uint64_t txnId, uint64_t binlogTxnId) {
 Expected<RecordValue> RocksKVStore::getKV(const RecordKey& key,
                                           Transaction* txn) {
   INVARIANT_D(txn->getKVStoreId() == dbId());
-  Expected<std::string> s = txn->getKV(key.encode());
+  std::string encKey = key.encode();
+  // the cache has the latest committed values, as the reads of the txns
+  // out of the snapshots, but a txn reads its own writes
+  bool cacheable = _recordCache.enabled() &&
+    key.getChunkId() < CLUSTER_SLOTS &&
+    !static_cast<RocksTxn*>(txn)->hasWrites();
+  uint64_t epoch = 0;
+  if (cacheable) {
+    auto eCached = _recordCache.get(encKey);
+    if (eCached.ok()) {
+      return eCached;
+    }
+    epoch = _recordCache.getEpoch(encKey);
+  }
+  Expected<std::string> s = txn->getKV(encKey);
   if (!s.ok()) {
     return s.status();
   }
-  return RecordValue::decode(s.value());
+  auto eValue = RecordValue::decode(s.value());
+  if (cacheable && eValue.ok()) {
+    _recordCache.put(encKey, eValue.value(), epoch);
+  }
+  return eValue;
 }
 
 Expected<RecordValue> RocksKVStore::getKV(const RecordKey& key,
@@ -2283,6 +2721,27 @@ Expected<RecordValue> RocksKVStore::getKV(const RecordKey& key,
   return eValue;
 }
 
+std::vector<Expected<RecordValue>> RocksKVStore::getKVs(
+  const std::vector<RecordKey>& keys, Transaction* txn) {
+  INVARIANT_D(txn->getKVStoreId() == dbId());
+  std::vector<std::string> encKeys;
+  encKeys.reserve(keys.size());
+  for (const auto& key : keys) {
+    encKeys.emplace_back(key.encode());
+  }
+
+  std::vector<Expected<RecordValue>> result;
+  result.reserve(keys.size());
+  for (auto& v : txn->getKVs(encKeys)) {
+    if (!v.ok()) {
+      result.emplace_back(v.status());
+    } else {
+      result.emplace_back(RecordValue::decode(v.value()));
+    }
+  }
+  return result;
+}
+
 Status RocksKVStore::setKV(const RecordKey& key,
                            const RecordValue& value,
                            Transaction* txn) {
@@ -2341,15 +2800,135 @@ Status RocksKVStore::deleteRangeWithoutBinlog(
   const std::string& end) {
   // TODO(takenliu) rocksdb 5.13 DeleteRange cause read performance degradation,
   //  use greater than rocksdb 5.18
-  rocksdb::Slice sBegin(begin);
-  rocksdb::Slice sEnd(end);
-  rocksdb::DB* db = getBaseDB();
-  auto s = db->DeleteRange(
-    rocksdb::WriteOptions(), column_family, sBegin.ToString(), sEnd.ToString());
+  rocksdb::WriteBatch batch;
+  auto s = batch.DeleteRange(column_family, begin, end);
+  // the chunks in [chunkBegin, chunkEnd) are deleted, the key counts of
+  // them are deleted in the same write
+  auto decodeChunk = [](const std::string& key, uint32_t dft) {
+    if (key.size() < sizeof(uint32_t)) {
+      return dft;
+    }
+    uint32_t chunkId = 0;
+    for (size_t i = 0; i < sizeof(chunkId); ++i) {
+      chunkId = (chunkId << 8) | static_cast<uint8_t>(key[i]);
+    }
+    return chunkId;
+  };
+  uint32_t chunkBegin = begin.empty() ? 0 : decodeChunk(begin, UINT32_MAX);
+  uint32_t chunkEnd = std::min(decodeChunk(end, UINT32_MAX),
+                               static_cast<uint32_t>(CLUSTER_SLOTS));
+  bool isData = column_family == getDataColumnFamilyHandle();
+  if (s.ok() && isData && chunkBegin < chunkEnd) {
+    auto countKey = [](uint32_t chunkId) {
+      std::string key = RecordKey::prefixKeyCount();
+      for (size_t i = 0; i < sizeof(chunkId); ++i) {
+        key.push_back(static_cast<char>(
+          (chunkId >> ((sizeof(chunkId) - i - 1) * 8)) & 0xff));
+      }
+      return key;
+    };
+    s = batch.DeleteRange(
+      column_family, countKey(chunkBegin), countKey(chunkEnd));
+  }
+  if (s.ok()) {
+    s = getBaseDB()->Write(rocksdb::WriteOptions(), &batch);
+  }
   if (!s.ok()) {
     LOG(ERROR) << "deleteRange failed:" << s.ToString();
     return {ErrorCodes::ERR_INTERNAL, s.ToString()};
   }
+  if (isData) {
+    _zsetIndexCache.clear();
+    _recordCache.clear();
+    if (chunkBegin < chunkEnd) {
+      _keyCounter.clearChunks(chunkBegin, chunkEnd);
+    }
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status RocksKVStore::loadKeyCounts() {
+  _keyCounter.clear();
+  if (dbId() == CATALOG_NAME) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  rocksdb::ReadOptions readOpts;
+  readOpts.total_order_seek = true;
+  std::unique_ptr<rocksdb::Iterator> iter(
+    getBaseDB()->NewIterator(readOpts, getDataColumnFamilyHandle()));
+
+  KeyCounter::Counts counts;
+  bool complete = false;
+  const std::string& prefix = RecordKey::prefixKeyCount();
+  for (iter->Seek(prefix); iter->Valid(); iter->Next()) {
+    if (!iter->key().starts_with(prefix)) {
+      break;
+    }
+    auto eRcd = Record::decode(iter->key().ToString(),
+                               iter->value().ToString());
+    if (!eRcd.ok()) {
+      return eRcd.status();
+    }
+    const auto& rk = eRcd.value().getRecordKey();
+    if (KeyCount::isMarker(rk)) {
+      complete = true;
+      continue;
+    }
+    auto eCount = KeyCount::decode(rk, eRcd.value().getRecordValue());
+    if (!eCount.ok()) {
+      return eCount.status();
+    }
+    const auto& kc = eCount.value();
+    counts[{kc.getChunkId(), kc.getDbId()}] = kc.getCount();
+  }
+  if (!iter->status().ok()) {
+    return {ErrorCodes::ERR_INTERNAL, iter->status().ToString()};
+  }
+
+  if (!complete) {
+    // the store written by an older version, count all the keys once
+    auto start = msSinceEpoch();
+    counts.clear();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      const auto key = iter->key();
+      if (key.size() <= RecordKey::getHdrSize()) {
+        continue;
+      }
+      std::string rk = key.ToString();
+      if (RecordKey::decodeChunkId(rk) >= CLUSTER_SLOTS) {
+        break;
+      }
+      if (RecordKey::decodeType(rk) == RecordType::RT_DATA_META) {
+        counts[{RecordKey::decodeChunkId(rk), RecordKey::decodeDbId(rk)}]++;
+      }
+    }
+    if (!iter->status().ok()) {
+      return {ErrorCodes::ERR_INTERNAL, iter->status().ToString()};
+    }
+
+    rocksdb::WriteBatch batch;
+    batch.DeleteRange(getDataColumnFamilyHandle(),
+                      prefix,
+                      RecordKey(KeyCount::CHUNKID + 1,
+                                0,
+                                RecordType::RT_INVALID,
+                                "",
+                                "")
+                        .prefixChunkid());
+    for (const auto& v : counts) {
+      KeyCount kc(v.first.first, v.first.second, v.second);
+      batch.Put(kc.encode(), KeyCount::encodeValue(v.second));
+    }
+    batch.Put(KeyCount::getMarkerKey().encode(),
+              RecordValue("", RecordType::RT_META, -1).encode());
+    auto s = getBaseDB()->Write(rocksdb::WriteOptions(), &batch);
+    if (!s.ok()) {
+      return {ErrorCodes::ERR_INTERNAL, s.ToString()};
+    }
+    LOG(INFO) << "dbId:" << dbId() << " counted the keys of " << counts.size()
+              << " chunk-dbs, used " << msSinceEpoch() - start << "ms";
+  }
+  _keyCounter.apply(counts);
   return {ErrorCodes::ERR_OK, ""};
 }
 
@@ -2617,11 +3196,47 @@ void RocksKVStore::appendJSONStat(
   w.Uint64(stat.compactFilterCount.load(std::memory_order_relaxed));
   w.Key("compact_kvexpired_count");
   w.Uint64(stat.compactKvExpiredCount.load(std::memory_order_relaxed));
+  w.Key("compact_subkey_reclaimed_count");
+  w.Uint64(stat.compactSubkeyReclaimedCount.load(std::memory_order_relaxed));
   w.Key("paused_error_count");
   w.Uint64(stat.pausedErrorCount.load(std::memory_order_relaxed));
   w.Key("destroyed_error_count");
   w.Uint64(stat.destroyedErrorCount.load(std::memory_order_relaxed));
 
+  w.Key("zset_index");
+  w.StartObject();
+  w.Key("entries");
+  w.Uint64(_zsetIndexCache.size());
+  w.Key("mem_usage");
+  w.Uint64(_zsetIndexCache.memUsage());
+  w.Key("hits");
+  w.Uint64(_zsetIndexCache.hits.load(std::memory_order_relaxed));
+  w.Key("misses");
+  w.Uint64(_zsetIndexCache.misses.load(std::memory_order_relaxed));
+  w.Key("builds");
+  w.Uint64(_zsetIndexCache.builds.load(std::memory_order_relaxed));
+  w.Key("updates");
+  w.Uint64(_zsetIndexCache.updates.load(std::memory_order_relaxed));
+  w.Key("evictions");
+  w.Uint64(_zsetIndexCache.evictions.load(std::memory_order_relaxed));
+  w.EndObject();
+
+  w.Key("record_cache");
+  w.StartObject();
+  w.Key("entries");
+  w.Uint64(_recordCache.size());
+  w.Key("mem_usage");
+  w.Uint64(_recordCache.memUsage());
+  w.Key("hits");
+  w.Uint64(_recordCache.hits.load(std::memory_order_relaxed));
+  w.Key("misses");
+  w.Uint64(_recordCache.misses.load(std::memory_order_relaxed));
+  w.Key("evictions");
+  w.Uint64(_recordCache.evictions.load(std::memory_order_relaxed));
+  w.Key("rejects");
+  w.Uint64(_recordCache.rejects.load(std::memory_order_relaxed));
+  w.EndObject();
+
   w.Key("rocksdb");
   w.StartObject();
   if (_isRunning) {
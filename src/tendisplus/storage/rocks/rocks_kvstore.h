@@ -5,6 +5,7 @@
 #ifndef SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_KVSTORE_H_
 #define SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_KVSTORE_H_
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <iostream>
@@ -22,7 +23,10 @@
 #include "rocksdb/utilities/transaction_db.h"
 
 #include "tendisplus/server/server_params.h"
+#include "tendisplus/storage/key_counter.h"
 #include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/record_cache.h"
+#include "tendisplus/storage/zset_index.h"
 
 namespace tendisplus {
 
@@ -56,7 +60,10 @@ class RocksTxn : public Transaction {
   std::unique_ptr<SlotsCursor> createSlotsCursor(uint32_t start,
                                                  uint32_t end) final;
   std::unique_ptr<VersionMetaCursor> createVersionMetaCursor() final;
+  std::unique_ptr<GCIndexCursor> createGCIndexCursor() final;
   std::unique_ptr<BasicDataCursor> createDataCursor() final;
+  std::unique_ptr<BasicDataCursor> createPkCursor(
+    const std::string& prefix) final;
   std::unique_ptr<AllDataCursor> createAllDataCursor() final;
   std::unique_ptr<BinlogCursor> createBinlogCursor() final;
 
@@ -64,12 +71,16 @@ class RocksTxn : public Transaction {
   Status rollback() final;
   // getKV: get data from chosen column family
   Expected<std::string> getKV(const std::string& key) final;
+  std::vector<Expected<std::string>> getKVs(
+    const std::vector<std::string>& keys) final;
   Status setKV(const std::string& key,
                const std::string& val,
                const uint64_t ts = 0) final;
   Status delKV(const std::string& key, const uint64_t ts = 0) final;
   Status addDeleteRangeBinlog(const std::string& begin,
                               const std::string& end) final;
+  void updateZSetIndex(const std::string& key,
+                       ZSetIndexUpdate&& update) final;
 #ifdef BINLOG_V1
   Status applyBinlog(const std::list<ReplLog>& txnLog) final;
   Status truncateBinlog(const std::list<ReplLog>& txnLog) final;
@@ -103,9 +114,30 @@ class RocksTxn : public Transaction {
   const std::unique_ptr<rocksdb::Transaction>& getRocksdbTxn() const {
     return _txn;
   }
+  // whether anything is written by the txn, which reads its own writes
+  bool hasWrites() const {
+    return _txn && _txn->GetNumPuts() + _txn->GetNumDeletes() > 0;
+  }
 
  protected:
   virtual void ensureTxn() {}
+  // remember the keys written, their cached RecordValue and ZSetIndex are
+  // invalidated on commit
+  void addModifiedKey(const std::string& key);
+  // count the meta key to be put or deleted in the key counts, it must
+  // be called before the write, see KeyCount. newValue is the value to be
+  // put, if a pieced string is overwritten or deleted, its pieces are
+  // recorded in the GCIndex, see Bitmap. The ttl index of a string is
+  // written or deleted too.
+  Status countKey(const std::string& key,
+                  bool isDelete,
+                  const std::string& newValue = "");
+  // replace the ttl index of the string of the meta key, 0 for none
+  Status indexStringTtl(const std::string& key,
+                        uint64_t oldTtl,
+                        uint64_t newTtl);
+  // add the version of the RT_KV meta key to its GCIndex
+  Status addPiecesToGC(const std::string& key, uint64_t version);
 
   uint64_t _txnId;
   uint64_t _binlogId;
@@ -132,6 +164,13 @@ class RocksTxn : public Transaction {
 
   std::shared_ptr<BinlogObserver> _logOb;
   Session* _session;
+  std::vector<std::string> _modifiedMetas;
+  std::vector<std::string> _modifiedKeys;
+  // the metas of _modifiedMetas whose ZSetIndex is updated rather than
+  // invalidated, a later write of the meta drops the update
+  std::unordered_map<std::string, ZSetIndexUpdate> _zsetIndexUpdates;
+  // the changes of the key counts, merged into the store on commit
+  KeyCounter::Counts _keyCountDeltas;
 
  private:
   // 0 for master, otherwise it's the latest commit binlog timestamp
@@ -178,6 +217,7 @@ class RocksPesTxn : public RocksTxn {
 class RocksKVCursor : public Cursor {
  public:
   explicit RocksKVCursor(std::unique_ptr<rocksdb::Iterator>);
+  RocksKVCursor(std::unique_ptr<rocksdb::Iterator>, const std::string& start);
   virtual ~RocksKVCursor() = default;
   void seek(const std::string& prefix) final;
   void seekToLast() final;
@@ -220,6 +260,8 @@ class RocksKVStore : public KVStore {
   Expected<RecordValue> getKV(const RecordKey& key,
                               Transaction* txn,
                               RecordType valueType) final;
+  std::vector<Expected<RecordValue>> getKVs(const std::vector<RecordKey>& keys,
+                                            Transaction* txn) final;
   Status setKV(const Record& kv, Transaction* txn) final;
   Status setKV(const RecordKey& key,
                const RecordValue& val,
@@ -248,10 +290,9 @@ class RocksKVStore : public KVStore {
                                                   uint64_t end,
                                                   uint64_t save,
                                                   Transaction* txn,
-                                                  std::ofstream* fs,
+                                                  BinlogFileWriter* fs,
                                                   int64_t maxWritelen,
                                                   bool tailSlave) final;
-  int64_t saveBinlogV2(std::ofstream* fs, const ReplLogRawV2& log);
   Expected<uint64_t> getBinlogCnt(Transaction* txn) const final;
   Expected<bool> validateAllBinlog(Transaction* txn) const final;
 #endif
@@ -305,6 +346,18 @@ class RocksKVStore : public KVStore {
   void appendJSONStat(
     rapidjson::PrettyWriter<rapidjson::StringBuffer>&) const final;
 
+  ZSetIndexCache* getZSetIndexCache() final {
+    return &_zsetIndexCache;
+  }
+
+  RecordCache* getRecordCache() final {
+    return &_recordCache;
+  }
+
+  KeyCounter* getKeyCounter() final {
+    return &_keyCounter;
+  }
+
   // if binlogTxnId == Transaction::TXNID_UNINITED, it mean rollback
   void markCommitted(uint64_t txnId, uint64_t binlogTxnId);
   rocksdb::OptimisticTransactionDB* getUnderlayerOptDB();
@@ -332,6 +385,9 @@ class RocksKVStore : public KVStore {
   Status setVersionMeta(const std::string& name,
                         uint64_t ts,
                         uint64_t version) override;
+  // read the data column family out of any transaction, it's for the
+  // compaction filter which can't create a txn
+  Expected<RecordValue> getKVNoTxn(const RecordKey& key);
   rocksdb::ColumnFamilyHandle* getDataColumnFamilyHandle() {
     return _cfHandles[0];
   }
@@ -352,8 +408,15 @@ class RocksKVStore : public KVStore {
   void initRocksProperties();
   Expected<std::string> saveBackupMeta(const std::string& dir,
                                        BackupInfo* result);
+  // hard link the live files of rocksdb into dir and return them with
+  // their sizes, see BACKUP_LINK_INTER
+  Expected<std::map<std::string, uint64_t>> linkLiveFiles(
+    const std::string& dir);
   Expected<std::string> loadCopy(const std::string& dir);
   Expected<std::string> copyCkpt(const std::string& dir);
+  // load the key counts from the store, or count the keys if the store
+  // has no complete counts, it's called when the store is opened
+  Status loadKeyCounts();
 
  private:
   mutable std::mutex _mutex;
@@ -374,6 +437,8 @@ class RocksKVStore : public KVStore {
 
   std::unique_ptr<rocksdb::OptimisticTransactionDB> _optdb;
   std::unique_ptr<rocksdb::TransactionDB> _pesdb;
+  // the base db of _optdb/_pesdb, nullptr if the store is stopped
+  std::atomic<rocksdb::DB*> _baseDB;
 
   std::shared_ptr<rocksdb::Statistics> _stats;
   std::shared_ptr<rocksdb::Cache> _blockCache;
@@ -415,6 +480,9 @@ class RocksKVStore : public KVStore {
   std::map<std::string, std::string> _rocksIntProperties;
   std::map<std::string, std::string> _rocksStringProperties;
   std::vector<rocksdb::ColumnFamilyHandle*> _cfHandles;
+  ZSetIndexCache _zsetIndexCache;
+  RecordCache _recordCache;
+  KeyCounter _keyCounter;
 };
 
 class RocksdbEnv {
@@ -652,6 +652,122 @@ TEST(RocksKVStore, CursorUpperBound) {
   EXPECT_EQ(cnt, 20000);
 }
 
+void checkPkCursor(RocksKVStore* kvstore,
+                   const std::vector<std::string>& pks,
+                   uint32_t num) {
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_EQ(eTxn.ok(), true);
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  for (const auto& pk : pks) {
+    RecordKey fake(0, 0, RecordType::RT_HASH_ELE, pk, "");
+    auto cursor = txn->createPkCursor(fake.prefixPk());
+    uint32_t cnt = 0;
+    while (true) {
+      Expected<Record> v = cursor->next();
+      if (!v.ok()) {
+        EXPECT_EQ(v.status().code(), ErrorCodes::ERR_EXHAUST);
+        break;
+      }
+      if (v.value().getRecordKey().prefixPk() != fake.prefixPk()) {
+        break;
+      }
+      cnt += 1;
+    }
+    EXPECT_EQ(cnt, pk == "none" ? 0 : num);
+  }
+}
+
+TEST(RocksKVStore, PkCursor) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+
+  // neighbour pks, and pks beginning with 0 which go in total order
+  std::vector<std::string> pks = {
+    "a", "ab", "b", std::string("\0", 1), std::string("\0a", 2), "none"};
+  uint32_t num = 100;
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_EQ(eTxn.ok(), true);
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  for (const auto& pk : pks) {
+    if (pk == "none") {
+      continue;
+    }
+    for (uint32_t i = 0; i < num; i++) {
+      Status s = kvstore->setKV(
+        Record(RecordKey(0, 0, RecordType::RT_HASH_ELE, pk, to_string(i)),
+               RecordValue("v", RecordType::RT_HASH_ELE, -1)),
+        txn.get());
+      EXPECT_EQ(s.ok(), true);
+    }
+  }
+  EXPECT_TRUE(txn->commit().ok());
+
+  // in the memtable
+  checkPkCursor(kvstore.get(), pks, num);
+
+  // in the sst files
+  auto status = kvstore->compactRange(
+    ColumnFamilyNumber::ColumnFamily_Default, nullptr, nullptr);
+  EXPECT_TRUE(status.ok());
+  checkPkCursor(kvstore.get(), pks, num);
+}
+
+TEST(RocksKVStore, GetKVs) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+
+  auto eTxn1 = kvstore->createTransaction(nullptr);
+  EXPECT_EQ(eTxn1.ok(), true);
+  std::unique_ptr<Transaction> txn1 = std::move(eTxn1.value());
+  for (auto& k : {"a", "c"}) {
+    Status s = kvstore->setKV(Record(RecordKey(0, 0, RecordType::RT_KV, k, ""),
+                                     RecordValue(k, RecordType::RT_KV, -1)),
+                              txn1.get());
+    EXPECT_EQ(s.ok(), true);
+  }
+  Expected<uint64_t> exptCommitId = txn1->commit();
+  EXPECT_EQ(exptCommitId.ok(), true);
+
+  auto eTxn2 = kvstore->createTransaction(nullptr);
+  EXPECT_EQ(eTxn2.ok(), true);
+  std::unique_ptr<Transaction> txn2 = std::move(eTxn2.value());
+  // uncommitted writes of the txn itself should be visible
+  Status s = kvstore->setKV(Record(RecordKey(0, 0, RecordType::RT_KV, "d", ""),
+                                   RecordValue("d", RecordType::RT_KV, -1)),
+                            txn2.get());
+  EXPECT_EQ(s.ok(), true);
+
+  std::vector<RecordKey> keys;
+  for (auto& k : {"c", "b", "a", "d", "a"}) {
+    keys.emplace_back(0, 0, RecordType::RT_KV, k, "");
+  }
+  auto vals = kvstore->getKVs(keys, txn2.get());
+  EXPECT_EQ(vals.size(), keys.size());
+  EXPECT_EQ(vals[0].value(), RecordValue("c", RecordType::RT_KV, -1));
+  EXPECT_EQ(vals[1].status().code(), ErrorCodes::ERR_NOTFOUND);
+  EXPECT_EQ(vals[2].value(), RecordValue("a", RecordType::RT_KV, -1));
+  EXPECT_EQ(vals[3].value(), RecordValue("d", RecordType::RT_KV, -1));
+  EXPECT_EQ(vals[4].value(), RecordValue("a", RecordType::RT_KV, -1));
+
+  EXPECT_EQ(kvstore->getKVs({}, txn2.get()).size(), 0U);
+}
+
 TEST(RocksKVStore, BackupCkptInter) {
   auto cfg = genParams();
   EXPECT_TRUE(filesystem::create_directory("db"));
@@ -722,6 +838,98 @@ TEST(RocksKVStore, BackupCkptInter) {
   testMaxBinlogId(kvstore);
 }
 
+TEST(RocksKVStore, BackupLinkInter) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  auto binlogversion = cfg->binlogUsingDefaultCF
+    ? BinlogVersion::BINLOG_VERSION_1
+    : BinlogVersion::BINLOG_VERSION_2;
+
+  auto setKV = [&kvstore](const std::string& key) {
+    auto eTxn = kvstore->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    Status s =
+      kvstore->setKV(Record(RecordKey(0, 0, RecordType::RT_KV, key, ""),
+                            RecordValue("txn1", RecordType::RT_KV, -1)),
+                     eTxn.value().get());
+    EXPECT_TRUE(s.ok());
+    Expected<uint64_t> exptCommitId = eTxn.value()->commit();
+    EXPECT_TRUE(exptCommitId.ok());
+    return exptCommitId.value();
+  };
+  uint64_t lastCommitId = setKV("a");
+
+  Expected<BackupInfo> expBk = kvstore->backup(
+    "wrong_dir", KVStore::BackupMode::BACKUP_LINK_INTER, binlogversion);
+  EXPECT_FALSE(expBk.ok());
+  expBk = kvstore->backup(kvstore->dftBackupDir(),
+                          KVStore::BackupMode::BACKUP_LINK_INTER,
+                          binlogversion);
+  EXPECT_TRUE(expBk.ok()) << expBk.status().toString();
+  const auto& flist = expBk.value().getFileList();
+  bool hasSst = false;
+  for (auto& bk : flist) {
+    LOG(INFO) << "backupInfo:[" << bk.first << "," << bk.second << "]";
+    EXPECT_TRUE(filesystem::exists(kvstore->dftBackupDir() + bk.first));
+    hasSst |= bk.first.find(".sst") != std::string::npos;
+  }
+  // the memtables are flushed
+  EXPECT_TRUE(hasSst);
+  EXPECT_EQ(flist.count("/CURRENT"), 1U);
+  EXPECT_EQ(flist.count("backup_meta"), 1U);
+  EXPECT_FALSE(kvstore
+                 ->backup(kvstore->dftBackupDir(),
+                          KVStore::BackupMode::BACKUP_LINK_INTER,
+                          binlogversion)
+                 .ok());
+
+  // written after the backup, into the linked wal
+  setKV("b");
+
+  // send the files as a fullsync does, only the sizes in the filelist
+  const std::string recvDir = "./db/recv";
+  for (auto& bk : flist) {
+    std::ifstream src(kvstore->dftBackupDir() + "/" + bk.first,
+                      std::ios::binary);
+    std::string data(bk.second, '\0');
+    src.read(&data[0], data.size());
+    EXPECT_TRUE(src.good());
+    filesystem::create_directories(recvDir);
+    std::ofstream dst(recvDir + "/" + bk.first, std::ios::binary);
+    dst.write(data.data(), data.size());
+  }
+  EXPECT_TRUE(kvstore->releaseBackup().ok());
+  EXPECT_FALSE(filesystem::exists(kvstore->dftBackupDir()));
+
+  Status s = kvstore->stop();
+  EXPECT_TRUE(s.ok());
+  s = kvstore->clear();
+  EXPECT_TRUE(s.ok());
+  filesystem::rename(recvDir, kvstore->dftBackupDir());
+
+  Expected<uint64_t> exptCommitId = kvstore->restart(true);
+  EXPECT_TRUE(exptCommitId.ok()) << exptCommitId.status().toString();
+  EXPECT_EQ(exptCommitId.value(), lastCommitId);
+
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  auto e = kvstore->getKV(RecordKey(0, 0, RecordType::RT_KV, "a", ""),
+                          eTxn.value().get());
+  EXPECT_TRUE(e.ok());
+  e = kvstore->getKV(RecordKey(0, 0, RecordType::RT_KV, "b", ""),
+                     eTxn.value().get());
+  EXPECT_EQ(e.status().code(), ErrorCodes::ERR_NOTFOUND);
+  testMaxBinlogId(kvstore);
+}
+
 TEST(RocksKVStore, BackupCkpt) {
   auto cfg = genParams();
   string backup_dir = "backup";
@@ -1226,6 +1434,8 @@ TEST(RocksKVStore, PesTruncateBinlog) {
 
 TEST(RocksKVStore, Compaction) {
   auto cfg = genParams();
+  // genData() writes subkeys without meta, keep them to count the filter
+  cfg->compactReclaimSubkeys = false;
   EXPECT_TRUE(filesystem::create_directory("db"));
   // EXPECT_TRUE(filesystem::create_directory("db/0"));
   EXPECT_TRUE(filesystem::create_directory("log"));
@@ -1277,10 +1487,11 @@ TEST(RocksKVStore, Compaction) {
   EXPECT_TRUE(status.ok());
   EXPECT_TRUE(hasCalled);
 
+  // the strings with a ttl have ttl indexes
   if (cfg->binlogUsingDefaultCF == true) {
-    EXPECT_EQ(totalFilter, 3000 * 2);
+    EXPECT_EQ(totalFilter, 3000 * 2 + kvCount + kvCount2);
   } else {
-    EXPECT_EQ(totalFilter, 3000);
+    EXPECT_EQ(totalFilter, 3000 + kvCount + kvCount2);
   }
   EXPECT_EQ(totalExpired, kvCount);
 
@@ -1291,14 +1502,475 @@ TEST(RocksKVStore, Compaction) {
   EXPECT_TRUE(status.ok());
   EXPECT_TRUE(hasCalled);
 
+  // the expired strings are kept for the txns deleting them
   if (cfg->binlogUsingDefaultCF == true) {
-    EXPECT_EQ(totalFilter, 3000 * 2 - kvCount);
+    EXPECT_EQ(totalFilter, 3000 * 2 + kvCount + kvCount2);
   } else {
-    EXPECT_EQ(totalFilter, 3000 - kvCount);
+    EXPECT_EQ(totalFilter, 3000 + kvCount + kvCount2);
   }
-  EXPECT_EQ(totalExpired, kvCount2);
+  EXPECT_EQ(totalExpired, kvCount + kvCount2);
+  EXPECT_EQ(kvstore->getKeyCounter()->takeExpired(UINT32_MAX).size(),
+            kvCount * 2 + kvCount2);
 
   testMaxBinlogId(kvstore);
 }
 
+TEST(RocksKVStore, CompactionReclaimSubkeys) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+    SyncPoint::GetInstance()->DisableProcessing();
+    SyncPoint::GetInstance()->ClearAllCallBacks();
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+
+  SyncPoint::GetInstance()->EnableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  uint64_t reclaimed = 0;
+  SyncPoint::GetInstance()->SetCallBack(
+    "InspectSubkeyReclaimedCount", [&](void* arg) mutable {
+      reclaimed += *reinterpret_cast<uint64_t*>(arg);
+    });
+  uint64_t lookups = 0;
+  SyncPoint::GetInstance()->SetCallBack(
+    "InspectSubkeyMetaLookupCount", [&](void* arg) mutable {
+      lookups += *reinterpret_cast<uint64_t*>(arg);
+    });
+
+  // alive: meta is alive
+  // nometa: meta is deleted
+  // expired: meta is expired
+  // typechanged: meta is replaced by a key of another type
+  uint32_t num = 100;
+  uint64_t now = msSinceEpoch();
+  std::vector<std::pair<std::string, RecordValue>> metas = {
+    {"alive", RecordValue("", RecordType::RT_HASH_META, -1, now + 3600000)},
+    {"expired", RecordValue("", RecordType::RT_HASH_META, -1, now - 1000)},
+    {"typechanged", RecordValue("", RecordType::RT_SET_META, -1)},
+  };
+  std::vector<std::string> pks = {"alive", "nometa", "expired", "typechanged"};
+
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_EQ(eTxn.ok(), true);
+  std::unique_ptr<Transaction> txn = std::move(eTxn.value());
+  for (auto& meta : metas) {
+    RecordKey mk(0, 0, RecordType::RT_DATA_META, meta.first, "");
+    EXPECT_TRUE(kvstore->setKV(mk, meta.second, txn.get()).ok());
+  }
+  for (auto& pk : pks) {
+    for (uint32_t i = 0; i < num; i++) {
+      RecordKey rk(0, 0, RecordType::RT_HASH_ELE, pk, to_string(i));
+      RecordValue rv("v", RecordType::RT_HASH_ELE, -1);
+      EXPECT_TRUE(kvstore->setKV(rk, rv, txn.get()).ok());
+    }
+  }
+  EXPECT_TRUE(txn->commit().ok());
+
+  auto status = kvstore->compactRange(
+    ColumnFamilyNumber::ColumnFamily_Default, nullptr, nullptr);
+  EXPECT_TRUE(status.ok());
+  EXPECT_EQ(reclaimed, 3 * num);
+  // one lookup per collection
+  EXPECT_EQ(lookups, pks.size());
+  EXPECT_EQ(kvstore->stat.compactSubkeyReclaimedCount.load(), 3 * num);
+
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_EQ(eTxn.ok(), true);
+  txn = std::move(eTxn.value());
+  for (auto& pk : pks) {
+    RecordKey fake(0, 0, RecordType::RT_HASH_ELE, pk, "");
+    auto cursor = txn->createPkCursor(fake.prefixPk());
+    uint32_t cnt = 0;
+    while (true) {
+      Expected<Record> v = cursor->next();
+      if (!v.ok() ||
+          v.value().getRecordKey().prefixPk() != fake.prefixPk()) {
+        break;
+      }
+      cnt++;
+    }
+    EXPECT_EQ(cnt, pk == "alive" ? num : 0) << pk;
+  }
+  txn.reset();
+
+  // a slave not applying any binlog yet doesn't know the time, the
+  // subkeys of the expired meta are kept
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_EQ(eTxn.ok(), true);
+  txn = std::move(eTxn.value());
+  for (uint32_t i = 0; i < num; i++) {
+    RecordKey rk(0, 0, RecordType::RT_HASH_ELE, "expired", to_string(i));
+    RecordValue rv("v", RecordType::RT_HASH_ELE, -1);
+    EXPECT_TRUE(kvstore->setKV(rk, rv, txn.get()).ok());
+  }
+  EXPECT_TRUE(txn->commit().ok());
+  txn.reset();
+  EXPECT_TRUE(kvstore->setMode(KVStore::StoreMode::REPLICATE_ONLY).ok());
+  EXPECT_EQ(kvstore->getCurrentTime(), 0U);
+  reclaimed = 0;
+  status = kvstore->compactRange(
+    ColumnFamilyNumber::ColumnFamily_Default, nullptr, nullptr);
+  EXPECT_TRUE(status.ok());
+  EXPECT_EQ(reclaimed, 0U);
+  EXPECT_TRUE(kvstore
+                ->getKVNoTxn(RecordKey(
+                  0, 0, RecordType::RT_HASH_ELE, "expired", to_string(0)))
+                .ok());
+}
+
+TEST(RocksKVStore, KeyCount) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  auto counter = kvstore->getKeyCounter();
+  EXPECT_TRUE(kvstore->isEmpty());
+
+  auto setKeys = [&kvstore](uint32_t chunkId, uint32_t dbId, uint32_t num) {
+    auto eTxn = kvstore->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    for (uint32_t i = 0; i < num; i++) {
+      RecordKey rk(chunkId, dbId, RecordType::RT_KV, to_string(i), "");
+      RecordValue rv("v", RecordType::RT_KV, -1);
+      EXPECT_TRUE(kvstore->setKV(rk, rv, eTxn.value().get()).ok());
+      // overwrite the key in the same txn
+      EXPECT_TRUE(kvstore->setKV(rk, rv, eTxn.value().get()).ok());
+      // the subkeys are not counted
+      RecordKey sub(chunkId, dbId, RecordType::RT_HASH_ELE, to_string(i), "f");
+      RecordValue subv("v", RecordType::RT_HASH_ELE, -1);
+      EXPECT_TRUE(kvstore->setKV(sub, subv, eTxn.value().get()).ok());
+    }
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+  };
+  setKeys(0, 0, 10);
+  setKeys(0, 1, 5);
+  setKeys(1, 0, 7);
+  setKeys(1, 0, 7);
+  EXPECT_EQ(counter->dbKeys(0), 17);
+  EXPECT_EQ(counter->dbKeys(1), 5);
+  EXPECT_EQ(counter->slotKeys(0), 15);
+  EXPECT_EQ(counter->slotKeys(1), 7);
+
+  // delete the keys, and the keys not exist
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  for (uint32_t i = 0; i < 8; i++) {
+    RecordKey rk(0, 0, RecordType::RT_KV, to_string(i * 2), "");
+    EXPECT_TRUE(kvstore->delKV(rk, eTxn.value().get()).ok());
+  }
+  // not counted before commit
+  EXPECT_EQ(counter->keys(0, 0), 10);
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  EXPECT_EQ(counter->keys(0, 0), 5);
+
+  // rollback
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  RecordKey rk(0, 0, RecordType::RT_KV, "1", "");
+  EXPECT_TRUE(kvstore->delKV(rk, eTxn.value().get()).ok());
+  EXPECT_TRUE(eTxn.value()->rollback().ok());
+  EXPECT_EQ(counter->keys(0, 0), 5);
+  auto expected = counter->getCounts();
+
+  // the counts are not data
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  auto cursor = eTxn.value()->createAllDataCursor();
+  while (true) {
+    auto eRcd = cursor->next();
+    if (!eRcd.ok()) {
+      EXPECT_EQ(eRcd.status().code(), ErrorCodes::ERR_EXHAUST);
+      break;
+    }
+    EXPECT_NE(eRcd.value().getRecordKey().getChunkId(), KeyCount::CHUNKID);
+  }
+  auto eCount = kvstore->getKV(KeyCount(1, 0, 0).getRecordKey(),
+                               eTxn.value().get());
+  EXPECT_TRUE(eCount.ok());
+  EXPECT_EQ(eCount.value().getValue(), "7");
+  eTxn.value().reset();
+
+  // loaded from the store
+  EXPECT_TRUE(kvstore->stop().ok());
+  EXPECT_TRUE(kvstore->restart(false).ok());
+  EXPECT_EQ(counter->getCounts(), expected);
+
+  // counted again without the marker
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  EXPECT_TRUE(
+    kvstore->delKV(KeyCount::getMarkerKey(), eTxn.value().get()).ok());
+  EXPECT_TRUE(
+    kvstore->delKV(KeyCount(0, 0, 0).getRecordKey(), eTxn.value().get())
+      .ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  EXPECT_TRUE(kvstore->stop().ok());
+  EXPECT_TRUE(kvstore->restart(false).ok());
+  EXPECT_EQ(counter->getCounts(), expected);
+
+  // delete the chunks
+  RecordKey rkStart(1, 0, RecordType::RT_INVALID, "", "");
+  RecordKey rkEnd(2, 0, RecordType::RT_INVALID, "", "");
+  EXPECT_TRUE(
+    kvstore->deleteRange(rkStart.prefixChunkid(), rkEnd.prefixChunkid()).ok());
+  expected.erase({1, 0});
+  EXPECT_EQ(counter->getCounts(), expected);
+  EXPECT_EQ(counter->slotKeys(1), 0);
+  EXPECT_EQ(counter->dbKeys(0), 5);
+  EXPECT_TRUE(kvstore->stop().ok());
+  EXPECT_TRUE(kvstore->restart(false).ok());
+  EXPECT_EQ(counter->slotKeys(1), 0);
+  EXPECT_EQ(counter->dbKeys(0), 5);
+  EXPECT_EQ(counter->dbKeys(1), 5);
+
+  // the expired keys are kept by the compaction, until the txns delete
+  // them
+  uint64_t ttl = msSinceEpoch() - 1000;
+  auto hasTtlIndex = [&kvstore, ttl](const std::string& key) {
+    auto eTxn = kvstore->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    TTLIndex index(key, RecordType::RT_KV, 0, ttl);
+    return eTxn.value()->getKV(index.encode()).ok();
+  };
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  for (uint32_t i = 0; i < 3; i++) {
+    RecordKey ek(2, 0, RecordType::RT_KV, to_string(i), "");
+    RecordValue ev("v", RecordType::RT_KV, -1, ttl);
+    EXPECT_TRUE(kvstore->setKV(ek, ev, eTxn.value().get()).ok());
+  }
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  EXPECT_EQ(counter->slotKeys(2), 3);
+  // IndexManager deletes the expired strings by their ttl indexes
+  for (uint32_t i = 0; i < 3; i++) {
+    EXPECT_TRUE(hasTtlIndex(to_string(i)));
+  }
+  EXPECT_TRUE(kvstore
+                ->compactRange(
+                  ColumnFamilyNumber::ColumnFamily_Default, nullptr, nullptr)
+                .ok());
+  EXPECT_EQ(counter->slotKeys(2), 3);
+  EXPECT_EQ(counter->takeExpired(10).size(), 3U);
+
+  // the expired values are at the bottom, a tombstone and a newer value
+  // are in level 0. The filter sees the values hidden by them.
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  EXPECT_TRUE(kvstore
+                ->delKV(RecordKey(2, 0, RecordType::RT_KV, "0", ""),
+                        eTxn.value().get())
+                .ok());
+  EXPECT_TRUE(kvstore
+                ->setKV(RecordKey(2, 0, RecordType::RT_KV, "1", ""),
+                        RecordValue("v", RecordType::RT_KV, -1),
+                        eTxn.value().get())
+                .ok());
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  EXPECT_EQ(counter->slotKeys(2), 2);
+  EXPECT_FALSE(hasTtlIndex("0"));
+  EXPECT_FALSE(hasTtlIndex("1"));
+  EXPECT_TRUE(hasTtlIndex("2"));
+  rocksdb::DB* db = kvstore->getUnderlayerPesDB();
+  auto cf = kvstore->getDataColumnFamilyHandle();
+  EXPECT_TRUE(db->Flush(rocksdb::FlushOptions(), cf).ok());
+  rocksdb::ColumnFamilyMetaData cfMeta;
+  db->GetColumnFamilyMetaData(cf, &cfMeta);
+  EXPECT_FALSE(cfMeta.levels[0].files.empty());
+  int bottom = cfMeta.levels.size() - 1;
+  while (bottom > 0 && cfMeta.levels[bottom].files.empty()) {
+    bottom--;
+  }
+  EXPECT_GT(bottom, 0);
+  std::vector<std::string> files;
+  for (const auto& f : cfMeta.levels[bottom].files) {
+    files.push_back(f.name);
+  }
+  EXPECT_FALSE(files.empty());
+  EXPECT_TRUE(
+    db->CompactFiles(rocksdb::CompactionOptions(), cf, files, bottom).ok());
+  EXPECT_EQ(counter->slotKeys(2), 2);
+  EXPECT_TRUE(kvstore->stop().ok());
+  EXPECT_TRUE(kvstore->restart(false).ok());
+  EXPECT_EQ(counter->slotKeys(2), 2);
+
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  for (uint32_t i = 0; i < 3; i++) {
+    RecordKey ek(2, 0, RecordType::RT_KV, to_string(i), "");
+    EXPECT_TRUE(kvstore->delKV(ek, eTxn.value().get()).ok());
+  }
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  EXPECT_FALSE(hasTtlIndex("2"));
+  EXPECT_TRUE(kvstore
+                ->compactRange(
+                  ColumnFamilyNumber::ColumnFamily_Default, nullptr, nullptr)
+                .ok());
+  EXPECT_EQ(counter->slotKeys(2), 0);
+  EXPECT_EQ(counter->getCounts(), expected);
+
+  EXPECT_TRUE(kvstore->stop().ok());
+  EXPECT_TRUE(kvstore->clear().ok());
+  EXPECT_TRUE(kvstore->restart(false).ok());
+  EXPECT_TRUE(counter->getCounts().empty());
+  EXPECT_TRUE(kvstore->isEmpty());
+}
+
+// the lanes of the slave apply the ops, then a txn stores the binlogs of
+// the batch, see applyTxnsInLanesV2()
+TEST(RocksKVStore, BinlogBatch) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  EXPECT_TRUE(kvstore->setMode(KVStore::StoreMode::REPLICATE_ONLY).ok());
+  uint64_t highest = kvstore->getHighestBinlogId();
+
+  std::vector<std::pair<std::string, std::string>> binlogs;
+  for (uint32_t i = 0; i < 3; i++) {
+    RecordKey rk(i, 0, RecordType::RT_KV, to_string(i), "");
+    RecordValue rv("v", RecordType::RT_KV, -1);
+    std::vector<ReplLogValueEntryV2> entries;
+    entries.emplace_back(
+      ReplOp::REPL_OP_SET, msSinceEpoch(), rk.encode(), rv.encode());
+    ReplLogValueV2 val(
+      i, ReplFlag::REPL_GROUP_START, i + 1, msSinceEpoch(), 0, "", nullptr, 0);
+    binlogs.emplace_back(ReplLogKeyV2(highest + 1 + i).encode(),
+                         val.encode(entries));
+  }
+
+  // two lanes
+  for (uint32_t lane = 0; lane < 2; lane++) {
+    auto eTxn = kvstore->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    for (const auto& binlog : binlogs) {
+      auto eVal = ReplLogValueV2::decode(binlog.second);
+      EXPECT_TRUE(eVal.ok());
+      size_t size = 0;
+      auto eEntry = ReplLogValueEntryV2::decode(
+        (const char*)eVal.value().getData() + eVal.value().getHdrSize(),
+        eVal.value().getDataSize() - eVal.value().getHdrSize(),
+        &size);
+      EXPECT_TRUE(eEntry.ok());
+      if (RecordKey::decodeChunkId(eEntry.value().getOpKey()) % 2 == lane) {
+        EXPECT_TRUE(eTxn.value()->applyBinlog(eEntry.value()).ok());
+      }
+    }
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+    EXPECT_EQ(kvstore->getHighestBinlogId(), highest);
+  }
+
+  auto eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  for (uint32_t i = 0; i < binlogs.size(); i++) {
+    EXPECT_TRUE(eTxn.value()
+                  ->setBinlogKV(
+                    highest + 1 + i, binlogs[i].first, binlogs[i].second)
+                  .ok());
+    EXPECT_EQ(eTxn.value()->getBinlogId(), highest + 1 + i);
+  }
+  // not visible before commit
+  EXPECT_EQ(kvstore->getHighestBinlogId(), highest);
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+  EXPECT_EQ(kvstore->getHighestBinlogId(), highest + 3);
+  EXPECT_EQ(kvstore->getNextBinlogSeq(), highest + 4);
+
+  eTxn = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  auto cursor = eTxn.value()->createRepllogCursorV2(highest + 1);
+  for (uint32_t i = 0; i < binlogs.size(); i++) {
+    auto eLog = cursor->next();
+    EXPECT_TRUE(eLog.ok());
+    EXPECT_EQ(eLog.value().getReplLogKey(), binlogs[i].first);
+    RecordKey rk(i, 0, RecordType::RT_KV, to_string(i), "");
+    EXPECT_TRUE(kvstore->getKV(rk, eTxn.value().get()).ok());
+  }
+  EXPECT_EQ(cursor->next().status().code(), ErrorCodes::ERR_EXHAUST);
+}
+
+TEST(RocksKVStore, RecordCache) {
+  auto cfg = genParams();
+  cfg->recordCacheMB = 16;
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto kvstore = std::make_unique<RocksKVStore>("0", cfg, blockCache);
+  auto cache = kvstore->getRecordCache();
+  EXPECT_TRUE(cache->enabled());
+
+  RecordKey rk(0, 0, RecordType::RT_KV, "a", "");
+  RecordValue v1("v1", RecordType::RT_KV, -1);
+  RecordValue v2("v2", RecordType::RT_KV, -1);
+  auto eTxn1 = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn1.ok());
+  EXPECT_TRUE(kvstore->setKV(rk, v1, eTxn1.value().get()).ok());
+  EXPECT_TRUE(eTxn1.value()->commit().ok());
+
+  // cached by the first read
+  auto eTxn2 = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn2.ok());
+  for (int i = 0; i < 2; i++) {
+    auto eValue = kvstore->getKV(rk, eTxn2.value().get());
+    EXPECT_TRUE(eValue.ok());
+    EXPECT_EQ(eValue.value(), v1);
+  }
+  EXPECT_EQ(cache->size(), 1U);
+  EXPECT_EQ(cache->hits, 1U);
+
+  // a txn reads its own writes, the others read the value committed
+  auto eTxn3 = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn3.ok());
+  EXPECT_TRUE(kvstore->setKV(rk, v2, eTxn3.value().get()).ok());
+  EXPECT_EQ(kvstore->getKV(rk, eTxn3.value().get()).value(), v2);
+  EXPECT_EQ(kvstore->getKV(rk, eTxn2.value().get()).value(), v1);
+  EXPECT_EQ(cache->hits, 2U);
+  EXPECT_TRUE(eTxn3.value()->commit().ok());
+  EXPECT_EQ(cache->size(), 0U);
+  EXPECT_EQ(kvstore->getKV(rk, eTxn2.value().get()).value(), v2);
+  EXPECT_EQ(kvstore->getKV(rk, eTxn2.value().get()).value(), v2);
+  EXPECT_EQ(cache->hits, 3U);
+
+  // deleted
+  auto eTxn4 = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn4.ok());
+  EXPECT_TRUE(kvstore->delKV(rk, eTxn4.value().get()).ok());
+  EXPECT_TRUE(eTxn4.value()->commit().ok());
+  EXPECT_EQ(kvstore->getKV(rk, eTxn2.value().get()).status().code(),
+            ErrorCodes::ERR_NOTFOUND);
+
+  // the data cleared
+  auto eTxn5 = kvstore->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn5.ok());
+  EXPECT_TRUE(kvstore->setKV(rk, v1, eTxn5.value().get()).ok());
+  EXPECT_TRUE(eTxn5.value()->commit().ok());
+  EXPECT_EQ(kvstore->getKV(rk, eTxn2.value().get()).value(), v1);
+  EXPECT_EQ(cache->size(), 1U);
+  eTxn2.value().reset();
+  EXPECT_TRUE(kvstore->stop().ok());
+  EXPECT_TRUE(kvstore->clear().ok());
+  EXPECT_TRUE(kvstore->restart(false).ok());
+  EXPECT_EQ(cache->size(), 0U);
+}
+
 }  // namespace tendisplus
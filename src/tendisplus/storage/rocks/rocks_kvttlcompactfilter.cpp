@@ -4,7 +4,6 @@
 
 #include <string>
 #include <memory>
-#include <limits>
 #include "rocksdb/compaction_filter.h"
 #include "tendisplus/storage/rocks/rocks_kvttlcompactfilter.h"
 #include "tendisplus/storage/record.h"
@@ -16,18 +15,27 @@
 namespace tendisplus {
 class KVTtlCompactionFilter : public CompactionFilter {
  public:
-  explicit KVTtlCompactionFilter(KVStore* store, uint64_t current_time)
-    : _store(store), _currentTime(current_time) {}
+  explicit KVTtlCompactionFilter(RocksKVStore* store,
+                                 uint64_t current_time,
+                                 bool reclaimSubkeys)
+    : _store(store),
+      _currentTime(current_time),
+      _reclaimSubkeys(reclaimSubkeys) {}
 
   ~KVTtlCompactionFilter() override {
     TEST_SYNC_POINT_CALLBACK("InspectKvTtlExpiredCount", &_expiredCount);
     TEST_SYNC_POINT_CALLBACK("InspectKvTtlFilterCount", &_filterCount);
+    TEST_SYNC_POINT_CALLBACK("InspectSubkeyReclaimedCount", &_reclaimedCount);
+    TEST_SYNC_POINT_CALLBACK("InspectSubkeyMetaLookupCount",
+                             &_metaLookupCount);
 
     // do something statistics here
     _store->stat.compactFilterCount.fetch_add(_filterCount,
                                               std::memory_order_relaxed);
     _store->stat.compactKvExpiredCount.fetch_add(_expiredCount,
                                                  std::memory_order_relaxed);
+    _store->stat.compactSubkeyReclaimedCount.fetch_add(
+      _reclaimedCount, std::memory_order_relaxed);
   }
 
   const char* Name() const override {
@@ -42,6 +50,11 @@ class KVTtlCompactionFilter : public CompactionFilter {
     RecordType type = RecordKey::decodeType(key.data(), key.size());
     RecordType vt;
     uint64_t ttl;
+    if (type == RecordType::RT_META &&
+        RecordKey::decodeChunkId(key.ToString()) == KeyCount::CHUNKID) {
+      // the key counts are not data
+      return false;
+    }
     _filterCount++;
     switch (type) {
       case RecordType::RT_DATA_META:
@@ -50,15 +63,40 @@ class KVTtlCompactionFilter : public CompactionFilter {
         if (vt == RecordType::RT_KV) {
           ttl = RecordValue::decodeTtl(existing_value.data(),
                                        existing_value.size());
-          if (ttl > 0 && ttl < _currentTime) {
+          if (_currentTime > 0 && ttl > 0 && ttl < _currentTime) {
             // Expired
             _expiredCount++;
             _expiredSize += key.size() + existing_value.size();
-
-            return true;
+            // NOTE: the version seen here may be hidden by a newer one in
+            // another level, or kept by a snapshot, so the key can't be
+            // uncounted here. It is kept and deleted by a txn, by its ttl
+            // index, or by the queue below if it has none. The slaves
+            // delete it by the binlog of the master.
+            if (_store->getMode() == KVStore::StoreMode::READ_WRITE) {
+              auto expRk = RecordKey::decode(key.ToString());
+              if (expRk.ok()) {
+                _store->getKeyCounter()->addExpired(
+                  TTLIndex(expRk.value().getPrimaryKey(),
+                           RecordType::RT_KV,
+                           expRk.value().getDbId(),
+                           ttl));
+              }
+            }
           }
         }
         break;
+      case RecordType::RT_LIST_ELE:
+      case RecordType::RT_HASH_ELE:
+      case RecordType::RT_SET_ELE:
+      case RecordType::RT_ZSET_S_ELE:
+      case RecordType::RT_ZSET_H_ELE:
+      case RecordType::RT_KV_PIECE:
+      case RecordType::RT_LIST_NODE:
+        if (_reclaimSubkeys && isOrphanSubkey(key)) {
+          _reclaimedCount++;
+          return true;
+        }
+        break;
       case RecordType::RT_INVALID:
         // TODO(vinchen): make sure
         INVARIANT_D(0);
@@ -70,15 +108,53 @@ class KVTtlCompactionFilter : public CompactionFilter {
   }
 
  private:
-  KVStore* _store;
+  // a subkey is an orphan if its meta is deleted, expired, or replaced by
+  // a key of another type or another version. Subkeys of one collection
+  // are adjacent, so the meta of the last pk is cached.
+  bool isOrphanSubkey(const rocksdb::Slice& key) const {
+    auto expRk = RecordKey::decode(std::string(key.data(), key.size()));
+    if (!expRk.ok()) {
+      return false;
+    }
+    const RecordKey& rk = expRk.value();
+    RecordKey mk(rk.getChunkId(),
+                 rk.getDbId(),
+                 RecordType::RT_DATA_META,
+                 rk.getPrimaryKey(),
+                 "");
+    std::string metaKey = mk.encode();
+    if (metaKey != _lastMetaKey) {
+      _lastMetaKey = std::move(metaKey);
+      _lastMeta = _store->getKVNoTxn(mk);
+      _metaLookupCount++;
+    }
+
+    if (!_lastMeta.ok()) {
+      // keep it if we're not sure
+      return _lastMeta.status().code() == ErrorCodes::ERR_NOTFOUND;
+    }
+    const RecordValue& meta = _lastMeta.value();
+    uint64_t ttl = meta.getTtl();
+    if (_currentTime > 0 && ttl > 0 && ttl < _currentTime) {
+      return true;
+    }
+    return !rcd_util::isSubkeyOf(rk, meta);
+  }
+
+  RocksKVStore* _store;
   // millisecond, same as ttl in the record
   const uint64_t _currentTime;
+  const bool _reclaimSubkeys;
+  mutable std::string _lastMetaKey;
+  mutable Expected<RecordValue> _lastMeta = {ErrorCodes::ERR_NOTFOUND, ""};
   // It is safe to not using std::atomic since the compaction filter,
   // created from a compaction filter factory, will not be called
   // from multiple threads.
   mutable uint64_t _expiredCount = 0;
   mutable uint64_t _expiredSize = 0;
   mutable uint64_t _filterCount = 0;
+  mutable uint64_t _reclaimedCount = 0;
+  mutable uint64_t _metaLookupCount = 0;
 };
 
 std::unique_ptr<CompactionFilter>
@@ -91,12 +167,18 @@ KVTtlCompactionFilterFactory::CreateCompactionFilter(
   currentTs = _store->getCurrentTime();
 
   if (currentTs == 0) {
+    // NOTE: a slave not applying any binlog yet doesn't know the time,
+    // nothing is expired then. The orphan subkeys are still reclaimed.
     LOG(WARNING) << "The currentTs is 0, the kvttlcompaction would do nothing";
-    currentTs = std::numeric_limits<uint64_t>::max();
   }
 
+  // NOTE: a subkey is reclaimed only if its meta is gone in the latest
+  // view of the db. The subkeys under a snapshot are not filtered by
+  // rocksdb, so the readers holding snapshots are not affected.
+  bool reclaimSubkeys = _store->getCfg()->compactReclaimSubkeys;
+
   return std::unique_ptr<CompactionFilter>(
-    new KVTtlCompactionFilter(_store, currentTs));
+    new KVTtlCompactionFilter(_store, currentTs, reclaimSubkeys));
 }
 
 }  // namespace tendisplus
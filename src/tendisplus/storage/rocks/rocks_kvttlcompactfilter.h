@@ -21,7 +21,8 @@ struct KVTTLCompactionContext {
 
 class KVTtlCompactionFilterFactory : public CompactionFilterFactory {
  public:
-  explicit KVTtlCompactionFilterFactory(KVStore* store) : _store(store) {}
+  explicit KVTtlCompactionFilterFactory(RocksKVStore* store)
+    : _store(store) {}
 
   const char* Name() const override {
     return "KVTTLCompactionFilterFactory";
@@ -31,7 +32,7 @@ class KVTtlCompactionFilterFactory : public CompactionFilterFactory {
     const CompactionFilter::Context& /*context*/) override;
 
  private:
-  KVStore* _store;
+  RocksKVStore* _store;
 };
 
 }  // namespace tendisplus
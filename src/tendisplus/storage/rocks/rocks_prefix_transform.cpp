@@ -0,0 +1,36 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <string>
+
+#include "tendisplus/storage/rocks/rocks_prefix_transform.h"
+#include "tendisplus/storage/record.h"
+
+namespace tendisplus {
+
+rocksdb::Slice RecordKeyPrefixTransform::Transform(
+  const rocksdb::Slice& key) const {
+  size_t size = RecordKey::decodePrefixPkSize(key.data(), key.size());
+  if (size == 0) {
+    return key;
+  }
+  return rocksdb::Slice(key.data(), size);
+}
+
+bool RecordKeyPrefixTransform::InDomain(const rocksdb::Slice& key) const {
+  return RecordKey::decodePrefixPkSize(key.data(), key.size()) != 0;
+}
+
+bool RecordKeyPrefixTransform::isPkPrefix(const std::string& prefix) {
+  // a pk beginning with 0 makes prefixPk() ambiguous, see
+  // RecordKey::decodePrefixPkSize(), such seeks go in total order.
+  if (prefix.size() <= RecordKey::getHdrSize() ||
+      prefix[RecordKey::getHdrSize()] == '\0') {
+    return false;
+  }
+  return RecordKey::decodePrefixPkSize(prefix.c_str(), prefix.size()) ==
+    prefix.size() - 1;
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,35 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_PREFIX_TRANSFORM_H_
+#define SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_PREFIX_TRANSFORM_H_
+
+#include <string>
+#include "rocksdb/slice.h"
+#include "rocksdb/slice_transform.h"
+
+namespace tendisplus {
+
+// extract chunkid|type|dbid|pk|0 from an encoded RecordKey, so that all
+// the subkeys of a collection share one prefix in the prefix blooms.
+// NOTE: rocksdb calls Transform() without InDomain() in some paths
+// (memtable insert, DBIter::Seek), so Transform() must be total. Keys out
+// of the domain are transformed to themselves.
+class RecordKeyPrefixTransform : public rocksdb::SliceTransform {
+ public:
+  const char* Name() const override {
+    return "tendisplus.RecordKeyPrefix";
+  }
+
+  rocksdb::Slice Transform(const rocksdb::Slice& key) const override;
+  bool InDomain(const rocksdb::Slice& key) const override;
+
+  // whether a cursor seeking to prefix can be limited to the keys sharing
+  // its pk by prefix_same_as_start, prefix should be a RecordKey::prefixPk()
+  static bool isPkPrefix(const std::string& prefix);
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_ROCKS_ROCKS_PREFIX_TRANSFORM_H_
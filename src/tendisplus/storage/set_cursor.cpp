@@ -0,0 +1,239 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <utility>
+#include "tendisplus/storage/set_cursor.h"
+#include "tendisplus/utils/invariant.h"
+
+namespace tendisplus {
+
+SetCursor::SetCursor(const ListPack* lp)
+  : _lp(lp),
+    _lpPos(0),
+    _txn(nullptr),
+    _exhausted(false),
+    _seekCount(0) {
+  INVARIANT_D(lp != nullptr);
+}
+
+SetCursor::SetCursor(const RecordKey& fake, Transaction* txn)
+  : _lp(nullptr),
+    _lpPos(0),
+    _fake(fake),
+    _prefix(fake.prefixPk()),
+    _txn(txn),
+    _exhausted(false),
+    _seekCount(0) {}
+
+void SetCursor::open() {
+  _cursor = _txn->createPkCursor(_prefix);
+  _lo = _prefix;
+}
+
+Status SetCursor::readKey() {
+  auto eKey = _cursor->key();
+  if (eKey.status().code() == ErrorCodes::ERR_EXHAUST) {
+    _exhausted = true;
+    _key.clear();
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  if (!eKey.ok()) {
+    return eKey.status();
+  }
+  _key = std::move(eKey.value());
+  _exhausted = _key.compare(0, _prefix.size(), _prefix) != 0;
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+Status SetCursor::takeValue(std::string* value) {
+  auto eRcd = _cursor->next();
+  if (!eRcd.ok()) {
+    return eRcd.status();
+  }
+  *value = eRcd.value().getRecordValue().getValue();
+  _lo = _key;
+  _lo.push_back('\0');
+  return readKey();
+}
+
+Expected<std::string> SetCursor::next(std::string* value) {
+  if (_lp) {
+    if (_lpPos >= _lp->size()) {
+      return {ErrorCodes::ERR_EXHAUST, ""};
+    }
+    const auto& entry = _lp->getEntries()[_lpPos++];
+    if (value) {
+      *value = entry.second;
+    }
+    return entry.first;
+  }
+  if (!_cursor) {
+    open();
+  }
+  auto eRcd = _cursor->next();
+  if (!eRcd.ok()) {
+    return eRcd.status();
+  }
+  const RecordKey& rk = eRcd.value().getRecordKey();
+  if (rk.prefixPk() != _prefix) {
+    return {ErrorCodes::ERR_EXHAUST, ""};
+  }
+  if (value) {
+    *value = eRcd.value().getRecordValue().getValue();
+  }
+  return rk.getSecondaryKey();
+}
+
+Expected<bool> SetCursor::contains(const std::string& member,
+                                   std::string* value) {
+  if (_lp) {
+    auto v = _lp->get(member);
+    if (v && value) {
+      *value = *v;
+    }
+    return v != nullptr;
+  }
+  if (!_cursor) {
+    open();
+    auto s = readKey();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  std::string key = RecordKey(_fake.getChunkId(),
+                              _fake.getDbId(),
+                              _fake.getRecordType(),
+                              _fake.getPrimaryKey(),
+                              member,
+                              _fake.getVersion())
+                      .encode();
+  for (uint32_t step = 0;; step++) {
+    if (!_exhausted && key == _key) {
+      if (value) {
+        RET_IF_ERR(takeValue(value));
+      }
+      return true;
+    }
+    if (key >= _lo && (_exhausted || key < _key)) {
+      return false;
+    }
+    if (key < _lo || step >= MAX_STEPS) {
+      // behind the cursor, or too far ahead of it
+      _cursor->seek(key);
+      _seekCount++;
+      _lo = key;
+      auto s = readKey();
+      if (!s.ok()) {
+        return s;
+      }
+      if (_exhausted || key != _key) {
+        return false;
+      }
+      if (value) {
+        RET_IF_ERR(takeValue(value));
+      }
+      return true;
+    }
+    // a few records ahead, step forward, the records between the old
+    // key and the new one are absent
+    auto eRcd = _cursor->next();
+    if (!eRcd.ok()) {
+      return eRcd.status();
+    }
+    _lo = _key;
+    _lo.push_back('\0');
+    auto s = readKey();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+}
+
+MemberCursor::MemberCursor(const ListPack* lp)
+  : _cursor(lp), _exhausted(false) {}
+
+MemberCursor::MemberCursor(const RecordKey& fake, Transaction* txn)
+  : _cursor(fake, txn), _exhausted(false) {
+  RecordKey empty(fake.getChunkId(),
+                  fake.getDbId(),
+                  fake.getRecordType(),
+                  fake.getPrimaryKey(),
+                  "",
+                  fake.getVersion());
+  _suffix = empty.encode().substr(empty.prefixPk().size());
+}
+
+// compare a[0:len]+suffix with b+suffix, the bytes before from are equal
+static int compareWithSuffix(const std::string& a,
+                             size_t len,
+                             const std::string& b,
+                             const std::string& suffix,
+                             size_t from) {
+  size_t n1 = len + suffix.size();
+  size_t n2 = b.size() + suffix.size();
+  for (size_t i = from; i < n1 && i < n2; ++i) {
+    uint8_t x = i < len ? a[i] : suffix[i - len];
+    uint8_t y = i < b.size() ? b[i] : suffix[i - b.size()];
+    if (x != y) {
+      return x < y ? -1 : 1;
+    }
+  }
+  return n1 < n2 ? -1 : (n1 > n2 ? 1 : 0);
+}
+
+bool MemberCursor::prefixesRead(const std::string& member) const {
+  if (_suffix.empty()) {
+    // packed, in the order of the members
+    return true;
+  }
+  size_t common = 0;
+  while (common < member.size() && common < _last.size() &&
+         member[common] == _last[common]) {
+    common++;
+  }
+  // the records left are after _last|suffix. A prefix longer than common
+  // is after it only if _last is a prefix of member, as member|suffix is
+  // not after _last|suffix
+  size_t end = member.size();
+  if (common < _last.size()) {
+    end = std::min(end, common + 1);
+  }
+  for (size_t len = 0; len < end; ++len) {
+    size_t from = std::min(len, common);
+    if (compareWithSuffix(member, len, _last, _suffix, from) > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Expected<std::pair<std::string, std::string>> MemberCursor::next() {
+  while (true) {
+    if (!_pending.empty() &&
+        (_exhausted || prefixesRead(_pending.begin()->first))) {
+      auto it = _pending.begin();
+      std::pair<std::string, std::string> result(it->first,
+                                                 std::move(it->second));
+      _pending.erase(it);
+      return std::move(result);
+    }
+    if (_exhausted) {
+      return {ErrorCodes::ERR_EXHAUST, ""};
+    }
+    std::string value;
+    auto eMember = _cursor.next(&value);
+    if (eMember.status().code() == ErrorCodes::ERR_EXHAUST) {
+      _exhausted = true;
+      continue;
+    }
+    if (!eMember.ok()) {
+      return eMember.status();
+    }
+    _last = std::move(eMember.value());
+    _pending.emplace(_last, std::move(value));
+  }
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,104 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_SET_CURSOR_H_
+#define SRC_TENDISPLUS_STORAGE_SET_CURSOR_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include "tendisplus/storage/record.h"
+#include "tendisplus/storage/kvstore.h"
+
+namespace tendisplus {
+
+// NOTE: SetCursor walks the members of a set in the order they are
+// stored, or answers whether a member is in the set, so that SINTER,
+// SUNION and SDIFF merge their sets as streams, rather than load them
+// into memory.
+// The RT_SET_ELE records are sorted by sk|len(pk), not by sk, so two
+// sets of pks of different lengths may order a member and its prefixes
+// differently. contains() doesn't rely on the order of the members asked:
+// it steps forward while the member is a few records ahead, and seeks
+// otherwise, so it costs a step mostly when the members are asked in the
+// order of the set, and a seek at most.
+// A cursor is either walked by next() or probed by contains(). It walks
+// the RT_ZSET_H_ELE records of a zset as well, the value of a member is
+// its encoded score then.
+class SetCursor {
+ public:
+  // the members packed in the meta, lp is kept by the caller
+  explicit SetCursor(const ListPack* lp);
+  // the RT_SET_ELE records of fake.prefixPk()
+  SetCursor(const RecordKey& fake, Transaction* txn);
+
+  // the next member, ERR_EXHAUST at the end. The value of the member is
+  // set into value, if not nullptr.
+  Expected<std::string> next(std::string* value = nullptr);
+  Expected<bool> contains(const std::string& member,
+                          std::string* value = nullptr);
+
+  uint64_t getSeekCount() const {
+    return _seekCount;
+  }
+
+  // the steps taken by contains() before it seeks
+  static constexpr uint32_t MAX_STEPS = 8;
+
+ private:
+  void open();
+  Status readKey();
+  // the value of the record the cursor is on, and step past it
+  Status takeValue(std::string* value);
+
+  const ListPack* _lp;
+  size_t _lpPos;
+  RecordKey _fake;
+  std::string _prefix;
+  Transaction* _txn;
+  std::unique_ptr<BasicDataCursor> _cursor;
+  // the key the cursor is on, unless _exhausted, and the records in
+  // [_lo, _key) are known to be absent
+  std::string _key;
+  std::string _lo;
+  bool _exhausted;
+  uint64_t _seekCount;
+};
+
+// NOTE: MemberCursor walks the members in their order, rather than the
+// order of the records, so that the members of several sets or zsets can
+// be merged, see ZUNIONSTORE.
+// The records are sorted by sk|suffix, suffix being the len(pk) and the
+// reserved bytes, so a member may be read after the members it is a
+// prefix of. A member read is kept until none of its prefixes can be read
+// after it, which is mostly at once, unless the members of the set
+// contain bytes below the ones of the suffix.
+class MemberCursor {
+ public:
+  explicit MemberCursor(const ListPack* lp);
+  MemberCursor(const RecordKey& fake, Transaction* txn);
+
+  // the next member and its value, ERR_EXHAUST at the end
+  Expected<std::pair<std::string, std::string>> next();
+
+  size_t getPendingCount() const {
+    return _pending.size();
+  }
+
+ private:
+  // whether the prefixes of member, if any, are read already
+  bool prefixesRead(const std::string& member) const;
+
+  SetCursor _cursor;
+  std::string _suffix;
+  // the last member read from _cursor
+  std::string _last;
+  bool _exhausted;
+  std::map<std::string, std::string> _pending;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_SET_CURSOR_H_
@@ -0,0 +1,228 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+#include "tendisplus/utils/status.h"
+#include "tendisplus/utils/scopeguard.h"
+#include "tendisplus/utils/portable.h"
+#include "tendisplus/storage/set_cursor.h"
+#include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/rocks/rocks_kvstore.h"
+#include "tendisplus/server/server_params.h"
+
+namespace tendisplus {
+
+std::shared_ptr<ServerParams> genParams() {
+  const auto guard = MakeGuard([] { remove("a.cfg"); });
+  std::ofstream myfile;
+  myfile.open("a.cfg");
+  myfile << "bind 127.0.0.1\n";
+  myfile << "port 8903\n";
+  myfile << "loglevel debug\n";
+  myfile << "logdir ./log\n";
+  myfile << "storage rocks\n";
+  myfile << "dir ./db\n";
+  myfile << "rocks.blockcachemb 4096\n";
+  myfile.close();
+  auto cfg = std::make_shared<ServerParams>();
+  auto s = cfg->parseFile("a.cfg");
+  EXPECT_EQ(s.ok(), true) << s.toString();
+  return cfg;
+}
+
+void addMembers(PStore store,
+                const RecordKey& fake,
+                const std::set<std::string>& members,
+                Transaction* txn) {
+  for (const auto& m : members) {
+    RecordKey rk(fake.getChunkId(),
+                 fake.getDbId(),
+                 RecordType::RT_SET_ELE,
+                 fake.getPrimaryKey(),
+                 m,
+                 fake.getVersion());
+    auto s =
+      store->setKV(rk, RecordValue("", RecordType::RT_SET_ELE, -1), txn);
+    EXPECT_TRUE(s.ok());
+  }
+}
+
+std::vector<std::string> walk(SetCursor* cursor) {
+  std::vector<std::string> result;
+  while (true) {
+    auto eMember = cursor->next();
+    if (eMember.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    EXPECT_TRUE(eMember.ok());
+    result.emplace_back(std::move(eMember.value()));
+  }
+  return result;
+}
+
+TEST(SetCursor, Common) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+
+  // the len(pk) of a pk of 98 bytes is 'b', so "a" is after "aa" and
+  // before "ac" in the records of it, but not in the ones of "s"
+  std::string longPk(98, 'x');
+  RecordKey fake1(0, 0, RecordType::RT_SET_ELE, "s", "", 1);
+  RecordKey fake2(0, 0, RecordType::RT_SET_ELE, longPk, "", 2);
+  // another set and another version around them
+  RecordKey other1(0, 0, RecordType::RT_SET_ELE, "s", "", 0);
+  RecordKey other2(0, 0, RecordType::RT_SET_ELE, "t", "", 1);
+
+  std::mt19937 gen(0);
+  std::set<std::string> members1, members2;
+  for (uint32_t i = 0; i < 2000; i++) {
+    std::string m(gen() % 3, 'a' + gen() % 3);
+    m.push_back('a' + gen() % 3);
+    m.append(std::to_string(gen() % 50));
+    if (gen() % 2) {
+      members1.insert(m);
+    } else {
+      members2.insert(m);
+    }
+  }
+  for (auto m : {"a", "aa", "ab", "ac", "b"}) {
+    members1.insert(m);
+    members2.insert(m);
+  }
+  addMembers(store, fake1, members1, txn);
+  addMembers(store, fake2, members2, txn);
+  addMembers(store, other1, {"z"}, txn);
+  addMembers(store, other2, {"a", "z"}, txn);
+
+  SetCursor walker1(fake1, txn);
+  auto walked1 = walk(&walker1);
+  EXPECT_EQ(std::set<std::string>(walked1.begin(), walked1.end()), members1);
+  EXPECT_EQ(walked1.size(), members1.size());
+  SetCursor walker2(fake2, txn);
+  auto walked2 = walk(&walker2);
+  EXPECT_EQ(std::set<std::string>(walked2.begin(), walked2.end()), members2);
+  EXPECT_EQ(walked2.size(), members2.size());
+
+  // the members of one set in its order, asked in the other set
+  SetCursor probe1(fake1, txn);
+  for (const auto& m : walked2) {
+    auto eFound = probe1.contains(m);
+    EXPECT_TRUE(eFound.ok());
+    EXPECT_EQ(eFound.value(), members1.count(m) > 0) << m;
+  }
+  SetCursor probe2(fake2, txn);
+  for (const auto& m : walked1) {
+    auto eFound = probe2.contains(m);
+    EXPECT_TRUE(eFound.ok());
+    EXPECT_EQ(eFound.value(), members2.count(m) > 0) << m;
+  }
+
+  // mostly steps, if asked in the order of the set
+  SetCursor ordered(fake1, txn);
+  for (const auto& m : walked1) {
+    auto eFound = ordered.contains(m);
+    EXPECT_TRUE(eFound.ok());
+    EXPECT_TRUE(eFound.value());
+  }
+  EXPECT_EQ(ordered.getSeekCount(), 0);
+
+  // and a seek at most otherwise
+  SetCursor random(fake2, txn);
+  for (uint32_t i = 0; i < 500; i++) {
+    auto it = members1.begin();
+    std::advance(it, gen() % members1.size());
+    auto eFound = random.contains(*it);
+    EXPECT_TRUE(eFound.ok());
+    EXPECT_EQ(eFound.value(), members2.count(*it) > 0) << *it;
+  }
+  EXPECT_LE(random.getSeekCount(), 500);
+  auto eFound = random.contains("z");
+  EXPECT_TRUE(eFound.ok());
+  EXPECT_FALSE(eFound.value());
+
+  // in the order of the members, rather than the records
+  MemberCursor merged1(fake1, txn);
+  MemberCursor merged2(fake2, txn);
+  std::vector<std::string> ordered1, ordered2;
+  size_t maxPending = 0;
+  while (true) {
+    auto eMember = merged2.next();
+    if (eMember.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    EXPECT_TRUE(eMember.ok());
+    ordered2.emplace_back(eMember.value().first);
+    maxPending = std::max(maxPending, merged2.getPendingCount());
+  }
+  EXPECT_EQ(ordered2, std::vector<std::string>(members2.begin(),
+                                               members2.end()));
+  // the members below 'b' are kept until the ones after them are read
+  EXPECT_GT(maxPending, 0U);
+  while (true) {
+    auto eMember = merged1.next();
+    if (eMember.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    EXPECT_TRUE(eMember.ok());
+    ordered1.emplace_back(eMember.value().first);
+  }
+  EXPECT_EQ(ordered1, std::vector<std::string>(members1.begin(),
+                                               members1.end()));
+
+  // the values come with the members
+  RecordKey zfake(0, 0, RecordType::RT_ZSET_H_ELE, longPk, "", 1);
+  for (auto m : {"a", "a0", "aa", "b"}) {
+    RecordKey rk(0, 0, RecordType::RT_ZSET_H_ELE, longPk, m, 1);
+    auto s = store->setKV(
+      rk, RecordValue(std::string(m) + "v", RecordType::RT_ZSET_H_ELE, -1),
+      txn);
+    EXPECT_TRUE(s.ok());
+  }
+  MemberCursor zmerged(zfake, txn);
+  for (auto m : {"a", "a0", "aa", "b"}) {
+    auto eMember = zmerged.next();
+    EXPECT_TRUE(eMember.ok());
+    EXPECT_EQ(eMember.value().first, m);
+    EXPECT_EQ(eMember.value().second, std::string(m) + "v");
+  }
+  EXPECT_EQ(zmerged.next().status().code(), ErrorCodes::ERR_EXHAUST);
+  SetCursor zprobe(zfake, txn);
+  std::string value;
+  EXPECT_TRUE(zprobe.contains("aa", &value).value());
+  EXPECT_EQ(value, "aav");
+  EXPECT_TRUE(zprobe.contains("b", &value).value());
+  EXPECT_EQ(value, "bv");
+  EXPECT_FALSE(zprobe.contains("c", &value).value());
+
+  ListPack lp;
+  lp.set("b", "");
+  lp.set("a", "");
+  SetCursor packed(&lp);
+  EXPECT_EQ(walk(&packed), std::vector<std::string>({"a", "b"}));
+  SetCursor packedProbe(&lp);
+  EXPECT_TRUE(packedProbe.contains("b").value());
+  EXPECT_FALSE(packedProbe.contains("c").value());
+}
+
+}  // namespace tendisplus
@@ -6,7 +6,9 @@
 #include <random>
 #include <map>
 #include <utility>
+#include <algorithm>
 #include "tendisplus/storage/skiplist.h"
+#include "tendisplus/storage/varint.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/server/session.h"
 
@@ -61,11 +63,25 @@ int slCmp(double score0,
   INVARIANT(0);
 }
 
+// the meta the index is built from, the meta key is not enough since
+// the zset may be modified or deleted and created again
+std::string zsetIndexToken(uint8_t level,
+                           uint32_t count,
+                           uint64_t tail,
+                           uint64_t posAlloc,
+                           uint64_t version) {
+  std::stringstream ss;
+  ss << static_cast<uint32_t>(level) << ' ' << count << ' ' << tail << ' '
+     << posAlloc << ' ' << version;
+  return ss.str();
+}
+
 SkipList::SkipList(uint32_t chunkId,
                    uint32_t dbId,
                    const std::string& pk,
                    const ZSlMetaValue& meta,
-                   PStore store)
+                   PStore store,
+                   uint64_t version)
   : nGetFromCache(0),
     nGetFromStore(0),
     nInserted(0),
@@ -79,7 +95,170 @@ SkipList::SkipList(uint32_t chunkId,
     _chunkId(chunkId),
     _dbId(dbId),
     _pk(pk),
-    _store(store) {}
+    _version(version),
+    _store(store),
+    _isListPack(false),
+    _maxListPackEntries(std::numeric_limits<uint64_t>::max()),
+    _maxListPackValue(std::numeric_limits<uint64_t>::max()),
+    _dirty(false) {
+  if (meta.getListPack()) {
+    loadListPack(*meta.getListPack());
+  } else if (_store && _store->getZSetIndexCache() &&
+             _store->getZSetIndexCache()->enabled()) {
+    _indexToken =
+      zsetIndexToken(_level, _count, _tail, _posAlloc, _version);
+  }
+}
+
+void SkipList::addIndexChange(bool insert,
+                              double score,
+                              const std::string& subkey) {
+  if (!_indexToken.empty()) {
+    _indexChanges.emplace_back(insert, ZSetIndex::Member(score, subkey));
+  }
+}
+
+// build the skiplist in the cache by appending the members in order
+void SkipList::loadListPack(const ListPack& lp) {
+  std::vector<std::pair<double, std::string>> members;
+  members.reserve(lp.size());
+  for (const auto& v : lp.getEntries()) {
+    auto score = doubleDecode(v.second);
+    if (!score.ok()) {
+      LOG(ERROR) << "invalid score of packed zset " << _pk
+                 << " subkey:" << v.first;
+      INVARIANT_D(0);
+      continue;
+    }
+    members.emplace_back(score.value(), v.first);
+  }
+  std::sort(members.begin(), members.end(), [](auto& a, auto& b) {
+    return slCmp(a.first, a.second, b.first, b.second) < 0;
+  });
+
+  _isListPack = true;
+  _count = 1;
+  auto s = bulkLoad(members, nullptr);
+  INVARIANT_D(s.ok());
+}
+
+Status SkipList::bulkLoad(
+  const std::vector<std::pair<double, std::string>>& members,
+  Transaction* txn) {
+  INVARIANT_D(_count == 1);
+  if (members.size() >= std::numeric_limits<int32_t>::max() / 2) {
+    return {ErrorCodes::ERR_INTERNAL, "zset count reach limit"};
+  }
+  _level = 1;
+  _tail = 0;
+  _dirty = true;
+  // the members are not tracked one by one, the index is invalidated
+  _indexToken.clear();
+  auto head = std::make_unique<ZSlEleValue>();
+  head->setChanged(true);
+  cache[ZSlMetaValue::HEAD_ID] = std::move(head);
+  // the last node and its rank in each level, a node is linked in all its
+  // levels once it is not the last one of its top level
+  std::vector<uint64_t> last(_maxLevel + 2, ZSlMetaValue::HEAD_ID);
+  std::vector<uint32_t> lastRank(_maxLevel + 1, 0);
+  std::vector<uint64_t> linked;
+  for (size_t j = 0; j < members.size(); ++j) {
+    const auto& m = members[j];
+    INVARIANT_D(j == 0 ||
+                slCmp(members[j - 1].first,
+                      members[j - 1].second,
+                      m.first,
+                      m.second) < 0);
+    uint32_t rank = _count;
+    auto p = makeNode(m.first, m.second);
+    uint8_t lvl = randomLevel();
+    _level = std::max(_level, lvl);
+    for (size_t i = 1; i <= lvl; ++i) {
+      if (last[i] != ZSlMetaValue::HEAD_ID && last[i + 1] != last[i]) {
+        linked.push_back(last[i]);
+      }
+      cache[last[i]]->setForward(i, p.first);
+      cache[last[i]]->setSpan(i, rank - lastRank[i]);
+      last[i] = p.first;
+      lastRank[i] = rank;
+    }
+    p.second->setBackward(_tail);
+    _tail = p.first;
+    cache[p.first] = std::move(p.second);
+    ++_count;
+    if (_isListPack) {
+      _members[m.second] = p.first;
+      continue;
+    }
+    // write the nodes done, only the last ones are kept in the cache
+    for (auto pos : linked) {
+      auto s = saveNode(pos, *cache[pos], txn);
+      if (!s.ok()) {
+        return s;
+      }
+      cache.erase(pos);
+    }
+    linked.clear();
+    auto s = setScore(m.second, m.first, txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  // a node without forward spans the nodes after it, as insert() does
+  for (size_t i = 1; i <= _level; ++i) {
+    cache[last[i]]->setSpan(i, _count - 1 - lastRank[i]);
+  }
+  return {ErrorCodes::ERR_OK, ""};
+}
+
+void SkipList::setMaxListPack(uint64_t maxEntries, uint64_t maxValue) {
+  _maxListPackEntries = maxEntries;
+  _maxListPackValue = maxValue;
+}
+
+bool SkipList::isListPack() const {
+  return _isListPack;
+}
+
+Expected<double> SkipList::getScore(const std::string& subkey,
+                                    Transaction* txn) {
+  if (_isListPack) {
+    auto it = _members.find(subkey);
+    if (it == _members.end()) {
+      return {ErrorCodes::ERR_NOTFOUND, ""};
+    }
+    return cache[it->second]->getScore();
+  }
+  RecordKey hk(
+    _chunkId, _dbId, RecordType::RT_ZSET_H_ELE, _pk, subkey, _version);
+  Expected<RecordValue> eValue = _store->getKV(hk, txn);
+  if (!eValue.ok()) {
+    return eValue.status();
+  }
+  return doubleDecode(eValue.value().getValue());
+}
+
+Status SkipList::setScore(const std::string& subkey,
+                          double score,
+                          Transaction* txn) {
+  if (_isListPack) {
+    // the score is in the node, see insert()
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  RecordKey hk(
+    _chunkId, _dbId, RecordType::RT_ZSET_H_ELE, _pk, subkey, _version);
+  RecordValue hv(score, RecordType::RT_ZSET_H_ELE);
+  return _store->setKV(hk, hv, txn);
+}
+
+Status SkipList::delScore(const std::string& subkey, Transaction* txn) {
+  if (_isListPack) {
+    return {ErrorCodes::ERR_OK, ""};
+  }
+  RecordKey hk(
+    _chunkId, _dbId, RecordType::RT_ZSET_H_ELE, _pk, subkey, _version);
+  return _store->delKV(hk, txn);
+}
 
 uint8_t SkipList::randomLevel() {
   static thread_local std::mt19937 generator(
@@ -151,7 +330,8 @@ Expected<ZSlEleValue*> SkipList::getNode(uint64_t pointer, Transaction* txn) {
     return it->second.get();
   }
   std::string pointerStr = std::to_string(pointer);
-  RecordKey rk(_chunkId, _dbId, RecordType::RT_ZSET_S_ELE, _pk, pointerStr);
+  RecordKey rk(
+    _chunkId, _dbId, RecordType::RT_ZSET_S_ELE, _pk, pointerStr, _version);
   Expected<RecordValue> rv = _store->getKV(rk, txn);
   if (!rv.ok()) {
     return rv.status();
@@ -170,18 +350,31 @@ Expected<ZSlEleValue*> SkipList::getNode(uint64_t pointer, Transaction* txn) {
 
 Status SkipList::delNode(uint64_t pointer, Transaction* txn) {
   // TODO(vinchen)
+  if (_isListPack) {
+    _members.erase(cache[pointer]->getSubKey());
+    cache.erase(pointer);
+    return {ErrorCodes::ERR_OK, ""};
+  }
   cache.erase(pointer);
   ++nDeleted;
-  RecordKey rk(
-    _chunkId, _dbId, RecordType::RT_ZSET_S_ELE, _pk, std::to_string(pointer));
+  RecordKey rk(_chunkId,
+               _dbId,
+               RecordType::RT_ZSET_S_ELE,
+               _pk,
+               std::to_string(pointer),
+               _version);
   return _store->delKV(rk, txn);
 }
 
 Status SkipList::saveNode(uint64_t pointer,
                           const ZSlEleValue& val,
                           Transaction* txn) {
-  RecordKey rk(
-    _chunkId, _dbId, RecordType::RT_ZSET_S_ELE, _pk, std::to_string(pointer));
+  RecordKey rk(_chunkId,
+               _dbId,
+               RecordType::RT_ZSET_S_ELE,
+               _pk,
+               std::to_string(pointer),
+               _version);
   RecordValue rv(val.encode(), RecordType::RT_ZSET_S_ELE, -1);
 
   // NOTE(vinchen): after saveNode, reset the change flag in ZSLEleValue
@@ -192,9 +385,53 @@ Status SkipList::saveNode(uint64_t pointer,
   return _store->setKV(rk, rv, txn);
 }
 
+Status SkipList::saveListPack(Transaction* txn,
+                              const Expected<RecordValue>& oldValue,
+                              uint64_t versionEP) {
+  ListPack lp;
+  bool fits = _count - 1 <= _maxListPackEntries;
+  for (const auto& v : _members) {
+    if (v.first.size() > _maxListPackValue) {
+      fits = false;
+    }
+    auto score = doubleEncode(cache[v.second]->getScore());
+    lp.set(v.first, std::string(score.begin(), score.end()));
+  }
+  if (fits) {
+    RecordKey rk(_chunkId, _dbId, RecordType::RT_ZSET_META, _pk, "");
+    ZSlMetaValue mv(1, 1, 0);
+    mv.setListPack(std::move(lp));
+    uint64_t ttl = oldValue.ok() ? oldValue.value().getTtl() : 0;
+    RecordValue rv(
+      mv.encode(), RecordType::RT_ZSET_META, versionEP, ttl, oldValue);
+    rv.setVersion(_version);
+    return _store->setKV(rk, rv, txn);
+  }
+
+  // move the members to the S_ELE and H_ELE records, the nodes are
+  // written by save()
+  _isListPack = false;
+  for (const auto& v : _members) {
+    cache[v.second]->setChanged(true);
+    auto s = setScore(v.first, cache[v.second]->getScore(), txn);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  cache[ZSlMetaValue::HEAD_ID]->setChanged(true);
+  _members.clear();
+  return {ErrorCodes::ERR_OK, ""};
+}
+
 Status SkipList::save(Transaction* txn,
                       const Expected<RecordValue>& oldValue,
                       uint64_t versionEP) {
+  if (_isListPack) {
+    auto s = saveListPack(txn, oldValue, versionEP);
+    if (!s.ok() || _isListPack) {
+      return s;
+    }
+  }
   // saveNode one time
   for (auto& v : cache) {
     if (v.second->isChanged()) {
@@ -210,7 +447,20 @@ Status SkipList::save(Transaction* txn,
   uint64_t ttl = oldValue.ok() ? oldValue.value().getTtl() : 0;
   RecordValue rv(
     mv.encode(), RecordType::RT_ZSET_META, versionEP, ttl, oldValue);
-  return _store->setKV(rk, rv, txn);
+  rv.setVersion(_version);
+  auto s = _store->setKV(rk, rv, txn);
+  if (!s.ok() || _indexToken.empty()) {
+    return s;
+  }
+  ZSetIndexUpdate update;
+  update.token = std::move(_indexToken);
+  update.newToken =
+    zsetIndexToken(_level, _count, _tail, _posAlloc, _version);
+  update.changes = std::move(_indexChanges);
+  txn->updateZSetIndex(rk.encode(), std::move(update));
+  _indexToken.clear();
+  _indexChanges.clear();
+  return s;
 }
 
 Status SkipList::removeInternal(uint64_t pos,
@@ -239,6 +489,8 @@ Status SkipList::removeInternal(uint64_t pos,
   }
 
   --_count;
+  _dirty = true;
+  addIndexChange(false, cache[pos]->getScore(), cache[pos]->getSubKey());
   while (_level > 1 && cache[ZSlMetaValue::HEAD_ID]->getForward(_level) == 0) {
     --_level;
   }
@@ -442,6 +694,13 @@ Status SkipList::remove(double score,
 Expected<uint32_t> SkipList::rank(double score,
                                   const std::string& subkey,
                                   Transaction* txn) {
+  auto index = getIndex();
+  if (index) {
+    auto r = index->rank(score, subkey);
+    if (r.ok()) {
+      return r;
+    }
+  }
   uint32_t rank = 0;
   Expected<ZSlEleValue*> expHead = getNode(ZSlMetaValue::HEAD_ID, txn);
   if (!expHead.ok()) {
@@ -561,6 +820,40 @@ Expected<uint64_t> SkipList::lastInRange(const Zrangespec& range,
   return pos;
 }
 
+Expected<uint64_t> SkipList::count(const Zrangespec& range, Transaction* txn) {
+  auto index = getIndex();
+  if (index) {
+    return index->count(range);
+  }
+  auto f = firstInRange(range, txn);
+  if (!f.ok()) {
+    return f.status();
+  }
+  if (f.value() == SKIPLIST_INVALID_POS) {
+    return 0;
+  }
+  auto first = cache[f.value()].get();
+  Expected<uint32_t> eRank = rank(first->getScore(), first->getSubKey(), txn);
+  if (!eRank.ok()) {
+    return eRank.status();
+  }
+  // _count - 1 : total skiplist nodes exclude head
+  uint64_t cnt = _count - 1 - (eRank.value() - 1);
+  auto l = lastInRange(range, txn);
+  if (!l.ok()) {
+    return l.status();
+  }
+  if (l.value() == SKIPLIST_INVALID_POS) {
+    return cnt;
+  }
+  auto last = cache[l.value()].get();
+  eRank = rank(last->getScore(), last->getSubKey(), txn);
+  if (!eRank.ok()) {
+    return eRank.status();
+  }
+  return cnt - (_count - 1 - eRank.value());
+}
+
 Expected<bool> SkipList::isInRange(const Zrangespec& range, Transaction* txn) {
   // TODO(vinchen)
   if (range.min > range.max ||
@@ -722,6 +1015,10 @@ Expected<std::list<std::pair<double, std::string>>> SkipList::scanByScore(
   uint64_t limit,
   bool rev,
   Transaction* txn) {
+  auto index = getIndex();
+  if (index) {
+    return index->scanByScore(range, offset, limit, rev);
+  }
   uint64_t pos = SKIPLIST_INVALID_POS;
   if (rev) {
     auto tmp = lastInRange(range, txn);
@@ -889,6 +1186,10 @@ Expected<std::list<std::pair<double, std::string>>> SkipList::scanByLex(
 
 Expected<std::list<std::pair<double, std::string>>> SkipList::scanByRank(
   int64_t start, int64_t len, bool rev, Transaction* txn) {
+  auto index = getIndex();
+  if (index) {
+    return index->scanByRank(start, len, rev);
+  }
   ZSlEleValue* ln = nullptr;
   if (rev) {
     Expected<ZSlEleValue*> expTail = getNode(_tail, txn);
@@ -1005,6 +1306,9 @@ Status SkipList::insert(double score,
   }
   std::pair<uint64_t, SkipList::PSE> p = SkipList::makeNode(score, subkey);
   cache[p.first] = std::move(p.second);
+  if (_isListPack) {
+    _members[subkey] = p.first;
+  }
   for (size_t i = 1; i <= lvl; ++i) {
     INVARIANT(update[i] >= ZSlMetaValue::HEAD_ID);
     INVARIANT(cache.find(update[i]) != cache.end());
@@ -1034,9 +1338,113 @@ Status SkipList::insert(double score,
     _tail = p.first;
   }
   ++_count;
+  _dirty = true;
+  addIndexChange(true, score, subkey);
   return {ErrorCodes::ERR_OK, ""};
 }
 
+std::shared_ptr<const ZSetIndex> SkipList::getIndex() {
+  ZSetIndexCache* indexCache = _store->getZSetIndexCache();
+  if (_isListPack || _dirty || indexCache == nullptr ||
+      !indexCache->enabled() || _count - 1 < indexCache->minCount()) {
+    return nullptr;
+  }
+  RecordKey mk(_chunkId, _dbId, RecordType::RT_ZSET_META, _pk, "");
+  std::string key = mk.encode();
+  std::string token =
+    zsetIndexToken(_level, _count, _tail, _posAlloc, _version);
+  auto index = indexCache->get(key, token);
+  if (index) {
+    return index;
+  }
+  if (!indexCache->shouldBuild(key, _count - 1)) {
+    return nullptr;
+  }
+  uint64_t epoch = indexCache->getEpoch(key);
+  auto eIndex = loadIndex(token);
+  if (!eIndex.ok()) {
+    if (eIndex.status().code() != ErrorCodes::ERR_NOTFOUND) {
+      LOG(WARNING) << "load zset index of " << _pk
+                   << " failed:" << eIndex.status().toString();
+    }
+    return nullptr;
+  }
+  indexCache->put(key, token, epoch, eIndex.value());
+  return eIndex.value();
+}
+
+Expected<std::shared_ptr<ZSetIndex>> SkipList::loadIndex(
+  const std::string& token) {
+  // a new txn, since the txn of the caller may have writes, and the
+  // meta and the members should be read from one snapshot
+  auto ptxn = _store->createTransaction(nullptr);
+  if (!ptxn.ok()) {
+    return ptxn.status();
+  }
+  std::unique_ptr<Transaction> txn = std::move(ptxn.value());
+  txn->SetSnapshot();
+
+  RecordKey mk(_chunkId, _dbId, RecordType::RT_ZSET_META, _pk, "");
+  auto metaCursor = txn->createPkCursor(mk.prefixPk());
+  auto eMeta = metaCursor->next();
+  if (eMeta.status().code() == ErrorCodes::ERR_EXHAUST) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  } else if (!eMeta.ok()) {
+    return eMeta.status();
+  }
+  if (eMeta.value().getRecordKey().encode() != mk.encode() ||
+      eMeta.value().getRecordValue().getRecordType() !=
+        RecordType::RT_ZSET_META) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  const RecordValue& rv = eMeta.value().getRecordValue();
+  auto eMetaContent = ZSlMetaValue::decode(rv.getValue());
+  if (!eMetaContent.ok()) {
+    return eMetaContent.status();
+  }
+  const ZSlMetaValue& meta = eMetaContent.value();
+  if (meta.getListPack() ||
+      zsetIndexToken(meta.getLevel(),
+                     meta.getCount(),
+                     meta.getTail(),
+                     meta.getPosAlloc(),
+                     rv.getVersion()) != token) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+
+  std::vector<ZSetIndex::Member> members;
+  members.reserve(_count - 1);
+  RecordKey fake(
+    _chunkId, _dbId, RecordType::RT_ZSET_H_ELE, _pk, "", _version);
+  auto cursor = txn->createPkCursor(fake.prefixPk());
+  while (true) {
+    Expected<Record> exptRcd = cursor->next();
+    if (exptRcd.status().code() == ErrorCodes::ERR_EXHAUST) {
+      break;
+    }
+    if (!exptRcd.ok()) {
+      return exptRcd.status();
+    }
+    const RecordKey& rcdkey = exptRcd.value().getRecordKey();
+    if (rcdkey.prefixPk() != fake.prefixPk()) {
+      break;
+    }
+    auto score = doubleDecode(exptRcd.value().getRecordValue().getValue());
+    if (!score.ok()) {
+      return score.status();
+    }
+    members.emplace_back(score.value(), rcdkey.getSecondaryKey());
+  }
+  if (members.size() != _count - 1) {
+    return {ErrorCodes::ERR_INTERNAL,
+            "zset count mismatch:" + std::to_string(members.size())};
+  }
+  std::sort(members.begin(), members.end(), [](auto& a, auto& b) {
+    return slCmp(a.first, a.second, b.first, b.second) < 0;
+  });
+  return std::make_shared<ZSetIndex>(std::move(members));
+}
+
 Status SkipList::traverse(std::stringstream& ss, Transaction* txn) {
   for (size_t i = _level; i >= 1; i--) {
     Expected<ZSlEleValue*> expNode = getNode(ZSlMetaValue::HEAD_ID, txn);
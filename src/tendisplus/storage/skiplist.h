@@ -13,8 +13,10 @@
 #include <vector>
 #include <atomic>
 #include <utility>
+#include <unordered_map>
 #include "tendisplus/storage/record.h"
 #include "tendisplus/storage/kvstore.h"
+#include "tendisplus/storage/zset_index.h"
 #include "tendisplus/utils/redis_port.h"
 
 namespace tendisplus {
@@ -22,6 +24,15 @@ namespace tendisplus {
 using Zrangespec = redis_port::Zrangespec;
 using Zlexrangespec = redis_port::Zlexrangespec;
 const uint64_t SKIPLIST_INVALID_POS = (uint64_t)-1;
+// NOTE: a small zset packed in its meta (see ListPack) is loaded into
+// the cache as a whole by the constructor, and written back into the meta
+// by save(), no S_ELE or H_ELE records are read or written for it. save()
+// moves it to the records once it is beyond the limits of setMaxListPack().
+// rank(), scanByRank() and scanByScore() of a big zset are answered by its
+// ZSetIndex rather than the nodes in the store if the ZSetIndexCache of the
+// store is enabled, until the SkipList is modified. The members inserted
+// and removed are passed to the txn by save(), which updates the cached
+// ZSetIndex after commit.
 class SkipList {
  public:
   using PSE = std::unique_ptr<ZSlEleValue>;
@@ -30,8 +41,15 @@ class SkipList {
            uint32_t dbId,
            const std::string& pk,
            const ZSlMetaValue& meta,
-           PStore store);
+           PStore store,
+           uint64_t version = 0);
   Status insert(double score, const std::string& subkey, Transaction* txn);
+  // build an empty skiplist of the members sorted by (score, subkey) in one
+  // pass, rather than by insert(). The levels of a node are linked as the
+  // nodes after it come, and it is written once they all are, so only the
+  // last node of each level is kept in the cache, the rest by save().
+  Status bulkLoad(const std::vector<std::pair<double, std::string>>& members,
+                  Transaction* txn);
   Status remove(double score, const std::string& subkey, Transaction* txn);
   Expected<uint32_t> rank(double score,
                           const std::string& subkey,
@@ -42,6 +60,8 @@ class SkipList {
 
   Expected<uint64_t> firstInRange(const Zrangespec& range, Transaction* txn);
   Expected<uint64_t> lastInRange(const Zrangespec& range, Transaction* txn);
+  // the number of elements in range
+  Expected<uint64_t> count(const Zrangespec& range, Transaction* txn);
 
   Expected<uint64_t> firstInLexRange(const Zlexrangespec& range,
                                      Transaction* txn);
@@ -79,6 +99,17 @@ class SkipList {
               const Expected<RecordValue>& oldValue,
               uint64_t versionEP);
   Status traverse(std::stringstream& ss, Transaction* txn);
+
+  // the score of subkey from its H_ELE record, or from the cache if the
+  // zset is packed in the meta. ERR_NOTFOUND if subkey not exists.
+  Expected<double> getScore(const std::string& subkey, Transaction* txn);
+  Status setScore(const std::string& subkey, double score, Transaction* txn);
+  Status delScore(const std::string& subkey, Transaction* txn);
+  // zset-max-listpack-entries and zset-max-listpack-value, unlimited
+  // by default, so that the packed zset is never converted by save()
+  void setMaxListPack(uint64_t maxEntries, uint64_t maxValue);
+  bool isListPack() const;
+
   uint32_t getCount() const;
   uint64_t getAlloc() const;
   uint64_t getTail() const;
@@ -101,6 +132,17 @@ class SkipList {
   Expected<ZSlEleValue*> getEleByRank(uint32_t rank, Transaction* txn);
   Expected<ZSlEleValue*> getNode(uint64_t pointer, Transaction* txn);
   std::pair<uint64_t, PSE> makeNode(double score, const std::string& subkey);
+  void loadListPack(const ListPack& lp);
+  Status saveListPack(Transaction* txn,
+                      const Expected<RecordValue>& oldValue,
+                      uint64_t versionEP);
+  // nullptr if the zset should not or can not be served by its index
+  std::shared_ptr<const ZSetIndex> getIndex();
+  // read the members from the store, ERR_NOTFOUND if the meta is no longer
+  // the one of token
+  Expected<std::shared_ptr<ZSetIndex>> loadIndex(const std::string& token);
+  // the member is inserted or removed, see ZSetIndexUpdate
+  void addIndexChange(bool insert, double score, const std::string& subkey);
   const uint8_t _maxLevel;
   uint8_t _level;
   uint32_t _count;
@@ -109,8 +151,22 @@ class SkipList {
   uint32_t _chunkId;
   uint32_t _dbId;
   std::string _pk;
+  // version of the subkeys, see GCIndex
+  uint64_t _version;
   PStore _store;
   PSE_MAP cache;
+  // the zset is packed in the meta, and all the nodes are in the cache
+  bool _isListPack;
+  uint64_t _maxListPackEntries;
+  uint64_t _maxListPackValue;
+  // subkey -> pos of the packed zset
+  std::unordered_map<std::string, uint64_t> _members;
+  // inserted or removed, the ZSetIndex is stale
+  bool _dirty;
+  // the token of the meta the SkipList is loaded from and the changes
+  // since, empty if the changes are not tracked
+  std::string _indexToken;
+  std::vector<std::pair<bool, ZSetIndex::Member>> _indexChanges;
 };
 
 }  // namespace tendisplus
@@ -449,4 +449,314 @@ TEST(SkipList, Common) {
   LOG(INFO) << "skiplist level:" << static_cast<uint32_t>(sl.getLevel());
 }
 
+TEST(SkipList, ListPack) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+
+  // a new packed zset has neither meta nor head records
+  RecordKey mk(0, 0, RecordType::RT_ZSET_META, "lpkey", "");
+  RecordKey head(0,
+                 0,
+                 RecordType::RT_ZSET_S_ELE,
+                 "lpkey",
+                 std::to_string(ZSlMetaValue::HEAD_ID));
+  auto loadMeta = [&](Transaction* txn) {
+    Expected<RecordValue> eMeta = store->getKV(mk, txn);
+    if (!eMeta.ok()) {
+      ZSlMetaValue meta(1, 1, 0);
+      meta.setListPack(ListPack());
+      return meta;
+    }
+    auto eMetaContent = ZSlMetaValue::decode(eMeta.value().getValue());
+    EXPECT_TRUE(eMetaContent.ok());
+    return eMetaContent.value();
+  };
+
+  constexpr uint32_t MAX_ENTRIES = 8;
+  std::vector<uint32_t> keys;
+  for (uint32_t i = 1; i <= MAX_ENTRIES + 1; ++i) {
+    keys.push_back(i);
+  }
+  std::random_shuffle(keys.begin(), keys.end());
+  for (auto& i : keys) {
+    auto eTxn = store->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    SkipList sl(0, 0, "lpkey", loadMeta(eTxn.value().get()), store);
+    sl.setMaxListPack(MAX_ENTRIES, 64);
+    Status s = sl.insert(i, std::to_string(i), eTxn.value().get());
+    EXPECT_TRUE(s.ok()) << s.toString();
+    s = sl.setScore(std::to_string(i), i, eTxn.value().get());
+    EXPECT_TRUE(s.ok()) << s.toString();
+    s = sl.save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1);
+    EXPECT_TRUE(s.ok()) << s.toString();
+    bool packed = sl.getCount() <= MAX_ENTRIES + 1;
+    EXPECT_EQ(sl.isListPack(), packed);
+    EXPECT_EQ(store->getKV(head, eTxn.value().get()).ok(), !packed);
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+  }
+
+  // the last insert moves the elements to the records
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  auto meta = loadMeta(eTxn.value().get());
+  EXPECT_EQ(meta.getListPack(), nullptr);
+  EXPECT_EQ(meta.getCount(), MAX_ENTRIES + 2);
+  SkipList sl(0, 0, "lpkey", meta, store);
+  EXPECT_FALSE(sl.isListPack());
+  auto eScore = sl.getScore("3", eTxn.value().get());
+  EXPECT_TRUE(eScore.ok());
+  EXPECT_EQ(eScore.value(), 3);
+  auto arr = sl.scanByRank(0, MAX_ENTRIES + 1, false, eTxn.value().get());
+  EXPECT_TRUE(arr.ok());
+  EXPECT_EQ(arr.value().size(), MAX_ENTRIES + 1);
+  uint32_t expected = 1;
+  for (const auto& v : arr.value()) {
+    EXPECT_EQ(v.first, expected);
+    EXPECT_EQ(v.second, std::to_string(expected));
+    expected++;
+  }
+  auto eRank = sl.rank(5, "5", eTxn.value().get());
+  EXPECT_TRUE(eRank.ok());
+
+  // ranks of a packed zset are the same as the converted one
+  ZSlMetaValue packedMeta(1, 1, 0);
+  ListPack lp;
+  for (uint32_t i = 1; i <= MAX_ENTRIES + 1; ++i) {
+    auto score = doubleEncode(i);
+    lp.set(std::to_string(i), std::string(score.begin(), score.end()));
+  }
+  packedMeta.setListPack(lp);
+  SkipList packed(0, 0, "lpkey2", packedMeta, store);
+  EXPECT_TRUE(packed.isListPack());
+  EXPECT_EQ(packed.getCount(), MAX_ENTRIES + 2);
+  auto ePackedRank = packed.rank(5, "5", eTxn.value().get());
+  EXPECT_TRUE(ePackedRank.ok());
+  EXPECT_EQ(ePackedRank.value(), eRank.value());
+  auto rev = packed.scanByRank(0, 3, true, eTxn.value().get());
+  EXPECT_TRUE(rev.ok());
+  EXPECT_EQ(rev.value().front().second, std::to_string(MAX_ENTRIES + 1));
+  Status s = packed.remove(5, "5", eTxn.value().get());
+  EXPECT_TRUE(s.ok()) << s.toString();
+  EXPECT_EQ(packed.getScore("5", eTxn.value().get()).status().code(),
+            ErrorCodes::ERR_NOTFOUND);
+}
+
+TEST(SkipList, BulkLoad) {
+  auto cfg = genParams();
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+
+  constexpr uint32_t CNT = 3000;
+  std::vector<std::pair<double, std::string>> members;
+  for (uint32_t i = 1; i <= CNT; ++i) {
+    // some scores are equal, sorted by subkey then
+    members.emplace_back(i / 3, std::to_string(i));
+  }
+  // the order of (score, subkey)
+  std::sort(members.begin(), members.end());
+
+  auto eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  SkipList loaded(0, 0, "bulk", ZSlMetaValue(1, 1, 0), store, 1);
+  Status s = loaded.bulkLoad(members, eTxn.value().get());
+  EXPECT_TRUE(s.ok()) << s.toString();
+  // the nodes are mostly written by bulkLoad()
+  EXPECT_GT(loaded.nUpdated, CNT / 2);
+  s = loaded.save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1);
+  EXPECT_TRUE(s.ok()) << s.toString();
+  // the head is written as well
+  EXPECT_EQ(loaded.nUpdated, CNT + 1);
+  EXPECT_TRUE(eTxn.value()->commit().ok());
+
+  eTxn = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn.ok());
+  Transaction* txn = eTxn.value().get();
+  RecordKey mk(0, 0, RecordType::RT_ZSET_META, "bulk", "");
+  auto eMeta = store->getKV(mk, txn);
+  EXPECT_TRUE(eMeta.ok());
+  EXPECT_EQ(eMeta.value().getVersion(), 1U);
+  auto meta = ZSlMetaValue::decode(eMeta.value().getValue());
+  EXPECT_TRUE(meta.ok());
+  EXPECT_EQ(meta.value().getCount(), CNT + 1);
+  SkipList sl(0, 0, "bulk", meta.value(), store, 1);
+  for (uint32_t i = 0; i < CNT; i += 7) {
+    auto eRank = sl.rank(members[i].first, members[i].second, txn);
+    EXPECT_TRUE(eRank.ok());
+    EXPECT_EQ(eRank.value(), i + 1);
+    auto eScore = sl.getScore(members[i].second, txn);
+    EXPECT_TRUE(eScore.ok());
+    EXPECT_EQ(eScore.value(), members[i].first);
+  }
+  auto rev = sl.scanByRank(0, 10, true, txn);
+  EXPECT_TRUE(rev.ok());
+  EXPECT_EQ(rev.value().front().second, members.back().second);
+  auto arr = sl.scanByRank(0, CNT, false, txn);
+  EXPECT_TRUE(arr.ok());
+  std::vector<std::pair<double, std::string>> scanned(arr.value().begin(),
+                                                      arr.value().end());
+  EXPECT_EQ(scanned, members);
+
+  // and it is modified as one built by insert()
+  s = sl.remove(members[10].first, members[10].second, txn);
+  EXPECT_TRUE(s.ok());
+  s = sl.insert(CNT, "last", txn);
+  EXPECT_TRUE(s.ok());
+  auto eRank = sl.rank(CNT, "last", txn);
+  EXPECT_TRUE(eRank.ok());
+  EXPECT_EQ(eRank.value(), CNT);
+  eRank = sl.rank(members[11].first, members[11].second, txn);
+  EXPECT_TRUE(eRank.ok());
+  EXPECT_EQ(eRank.value(), 11U);
+}
+
+TEST(SkipList, Index) {
+  auto cfg = genParams();
+  cfg->zsetIndexMinCount = 16;
+  EXPECT_TRUE(filesystem::create_directory("db"));
+  EXPECT_TRUE(filesystem::create_directory("log"));
+  const auto guard = MakeGuard([] {
+    filesystem::remove_all("./log");
+    filesystem::remove_all("./db");
+  });
+  auto blockCache =
+    rocksdb::NewLRUCache(cfg->rocksBlockcacheMB * 1024 * 1024LL, 4);
+  auto store = std::shared_ptr<KVStore>(new RocksKVStore("0", cfg, blockCache));
+  auto indexCache = store->getZSetIndexCache();
+
+  RecordKey mk(0, 0, RecordType::RT_ZSET_META, "idxkey", "");
+  RecordKey head(0,
+                 0,
+                 RecordType::RT_ZSET_S_ELE,
+                 "idxkey",
+                 std::to_string(ZSlMetaValue::HEAD_ID));
+  auto eTxn1 = store->createTransaction(nullptr);
+  EXPECT_TRUE(eTxn1.ok());
+  ZSlMetaValue meta(1, 1, 0);
+  RecordValue rv(meta.encode(), RecordType::RT_ZSET_META, -1);
+  Status s = store->setKV(mk, rv, eTxn1.value().get());
+  EXPECT_TRUE(s.ok());
+  ZSlEleValue headVal;
+  RecordValue subRv(headVal.encode(), RecordType::RT_ZSET_S_ELE, -1);
+  s = store->setKV(head, subRv, eTxn1.value().get());
+  EXPECT_TRUE(s.ok());
+  EXPECT_TRUE(eTxn1.value()->commit().ok());
+
+  auto loadMeta = [&](Transaction* txn) {
+    Expected<RecordValue> eMeta = store->getKV(mk, txn);
+    EXPECT_TRUE(eMeta.ok());
+    auto eMetaContent = ZSlMetaValue::decode(eMeta.value().getValue());
+    EXPECT_TRUE(eMetaContent.ok());
+    return eMetaContent.value();
+  };
+  auto insert = [&](uint32_t from, uint32_t to) {
+    auto eTxn = store->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    SkipList sl(0, 0, "idxkey", loadMeta(eTxn.value().get()), store);
+    for (uint32_t i = from; i < to; ++i) {
+      // duplicated scores are ordered by the subkeys
+      Status s = sl.insert(i % 50, std::to_string(i), eTxn.value().get());
+      EXPECT_TRUE(s.ok()) << s.toString();
+      s = sl.setScore(std::to_string(i), i % 50, eTxn.value().get());
+      EXPECT_TRUE(s.ok()) << s.toString();
+    }
+    s = sl.save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1);
+    EXPECT_TRUE(s.ok()) << s.toString();
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+  };
+  auto remove = [&](uint32_t from, uint32_t to, uint32_t step) {
+    auto eTxn = store->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    SkipList sl(0, 0, "idxkey", loadMeta(eTxn.value().get()), store);
+    for (uint32_t i = from; i < to; i += step) {
+      Status s = sl.remove(i % 50, std::to_string(i), eTxn.value().get());
+      EXPECT_TRUE(s.ok()) << s.toString();
+      s = sl.delScore(std::to_string(i), eTxn.value().get());
+      EXPECT_TRUE(s.ok()) << s.toString();
+    }
+    s = sl.save(eTxn.value().get(), {ErrorCodes::ERR_NOTFOUND, ""}, -1);
+    EXPECT_TRUE(s.ok()) << s.toString();
+    EXPECT_TRUE(eTxn.value()->commit().ok());
+  };
+  // the results of the queries leaderboards run
+  auto query = [&]() {
+    auto eTxn = store->createTransaction(nullptr);
+    EXPECT_TRUE(eTxn.ok());
+    SkipList sl(0, 0, "idxkey", loadMeta(eTxn.value().get()), store);
+    std::list<std::pair<double, std::string>> result;
+    auto append = [&](const Expected<std::list<std::pair<double,
+                        std::string>>>& arr) {
+      EXPECT_TRUE(arr.ok());
+      result.insert(result.end(), arr.value().begin(), arr.value().end());
+      result.emplace_back(-1, "");
+    };
+    auto all = sl.scanByRank(0, sl.getCount() - 1, false, eTxn.value().get());
+    append(all);
+    append(sl.scanByRank(0, 10, true, eTxn.value().get()));
+    append(sl.scanByRank(17, 30, true, eTxn.value().get()));
+    Zrangespec range;
+    range.min = 10;
+    range.max = 20;
+    range.minex = true;
+    range.maxex = false;
+    append(sl.scanByScore(range, 0, -1, false, eTxn.value().get()));
+    append(sl.scanByScore(range, 3, 5, true, eTxn.value().get()));
+    append(sl.scanByScore(range, 1000, 5, false, eTxn.value().get()));
+    auto eCount = sl.count(range, eTxn.value().get());
+    EXPECT_TRUE(eCount.ok());
+    result.emplace_back(eCount.value(), "count");
+    uint32_t i = 0;
+    for (const auto& v : all.value()) {
+      if (i++ % 7 != 0) {
+        continue;
+      }
+      auto eRank = sl.rank(v.first, v.second, eTxn.value().get());
+      EXPECT_TRUE(eRank.ok());
+      result.emplace_back(eRank.value(), "rank");
+    }
+    return result;
+  };
+
+  insert(0, 200);
+  // walk the skiplist
+  EXPECT_FALSE(indexCache->enabled());
+  auto expected = query();
+  EXPECT_EQ(indexCache->misses, 0U);
+
+  cfg->zsetIndexCacheMB = 10;
+  EXPECT_TRUE(indexCache->enabled());
+  EXPECT_EQ(query(), expected);
+  EXPECT_EQ(indexCache->builds, 1U);
+  EXPECT_EQ(indexCache->size(), 1U);
+  EXPECT_EQ(query(), expected);
+  EXPECT_EQ(indexCache->builds, 1U);
+  EXPECT_GT(indexCache->hits, 0U);
+
+  // the commits update the index rather than invalidating it
+  insert(200, 300);
+  EXPECT_EQ(indexCache->size(), 1U);
+  EXPECT_EQ(indexCache->updates, 1U);
+  remove(0, 300, 3);
+  EXPECT_EQ(indexCache->updates, 2U);
+  auto indexed = query();
+  EXPECT_EQ(indexCache->builds, 1U);
+  EXPECT_EQ(indexed.front().second, "100");
+  cfg->zsetIndexCacheMB = 0;
+  EXPECT_EQ(query(), indexed);
+}
+
 }  // namespace tendisplus
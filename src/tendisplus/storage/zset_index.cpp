@@ -0,0 +1,402 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include "tendisplus/storage/zset_index.h"
+
+namespace tendisplus {
+
+namespace {
+
+bool memberLess(const ZSetIndex::Member& a, const ZSetIndex::Member& b) {
+  return a.first < b.first || (a.first == b.first && a.second < b.second);
+}
+
+}  // namespace
+
+ZSetIndex::ZSetIndex(std::vector<Member>&& members)
+  : _size(members.size()), _memUsage(sizeof(ZSetIndex)) {
+  _blocks.reserve((_size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+  for (size_t i = 0; i < _size; i += BLOCK_SIZE) {
+    size_t end = std::min(i + BLOCK_SIZE, _size);
+    _blocks.emplace_back(std::make_move_iterator(members.begin() + i),
+                         std::make_move_iterator(members.begin() + end));
+  }
+  _memUsage += _blocks.capacity() * sizeof(std::vector<Member>);
+  for (const auto& b : _blocks) {
+    _memUsage += b.capacity() * sizeof(Member);
+    for (const auto& v : b) {
+      _memUsage += v.second.size();
+    }
+  }
+}
+
+size_t ZSetIndex::size() const {
+  return _size;
+}
+
+uint64_t ZSetIndex::memUsage() const {
+  return _memUsage;
+}
+
+template <typename Pred>
+ZSetIndex::Loc ZSetIndex::partitionPoint(Pred pred) const {
+  auto b = std::partition_point(
+    _blocks.begin(), _blocks.end(), [&pred](const std::vector<Member>& v) {
+      return pred(v.back());
+    });
+  if (b == _blocks.end()) {
+    return {_blocks.size(), 0};
+  }
+  auto it = std::partition_point(b->begin(), b->end(), pred);
+  return {b - _blocks.begin(), it - b->begin()};
+}
+
+ZSetIndex::Loc ZSetIndex::find(double score, const std::string& subkey) const {
+  Member m(score, subkey);
+  return partitionPoint([&m](const Member& v) { return memberLess(v, m); });
+}
+
+size_t ZSetIndex::position(const Loc& loc) const {
+  size_t pos = loc.second;
+  for (size_t i = 0; i < loc.first; ++i) {
+    pos += _blocks[i].size();
+  }
+  return pos;
+}
+
+ZSetIndex::Loc ZSetIndex::locate(size_t pos) const {
+  size_t i = 0;
+  while (i < _blocks.size() && pos >= _blocks[i].size()) {
+    pos -= _blocks[i].size();
+    ++i;
+  }
+  return {i, pos};
+}
+
+bool ZSetIndex::next(Loc* loc) const {
+  if (++loc->second == _blocks[loc->first].size()) {
+    ++loc->first;
+    loc->second = 0;
+  }
+  return loc->first < _blocks.size();
+}
+
+bool ZSetIndex::prev(Loc* loc) const {
+  if (loc->second > 0) {
+    --loc->second;
+    return true;
+  }
+  if (loc->first == 0) {
+    return false;
+  }
+  --loc->first;
+  loc->second = _blocks[loc->first].size() - 1;
+  return true;
+}
+
+Expected<uint32_t> ZSetIndex::rank(double score,
+                                   const std::string& subkey) const {
+  Loc loc = find(score, subkey);
+  if (loc.first == _blocks.size() ||
+      _blocks[loc.first][loc.second] != Member(score, subkey)) {
+    return {ErrorCodes::ERR_NOTFOUND, ""};
+  }
+  return static_cast<uint32_t>(position(loc) + 1);
+}
+
+std::list<ZSetIndex::Member> ZSetIndex::scanByRank(int64_t start,
+                                                   int64_t len,
+                                                   bool rev) const {
+  std::list<Member> result;
+  int64_t n = _size;
+  int64_t pos = rev ? n - 1 - start : start;
+  if (len <= 0 || pos < 0 || pos >= n) {
+    return result;
+  }
+  Loc loc = locate(pos);
+  for (int64_t i = 0; i < len; ++i) {
+    result.push_back(_blocks[loc.first][loc.second]);
+    if (!(rev ? prev(&loc) : next(&loc))) {
+      break;
+    }
+  }
+  return result;
+}
+
+size_t ZSetIndex::lowerBound(const redis_port::Zrangespec& range) const {
+  return position(partitionPoint([&range](const Member& m) {
+    return range.minex ? m.first <= range.min : m.first < range.min;
+  }));
+}
+
+size_t ZSetIndex::upperBound(const redis_port::Zrangespec& range) const {
+  return position(partitionPoint([&range](const Member& m) {
+    return range.maxex ? m.first < range.max : m.first <= range.max;
+  }));
+}
+
+std::list<ZSetIndex::Member> ZSetIndex::scanByScore(
+  const redis_port::Zrangespec& range,
+  uint64_t offset,
+  uint64_t limit,
+  bool rev) const {
+  std::list<Member> result;
+  size_t lo = lowerBound(range);
+  size_t hi = upperBound(range);
+  if (lo >= hi) {
+    return result;
+  }
+  // as SkipList::scanByScore(), an offset beyond the end stops at the
+  // last member rather than returning nothing
+  if (rev) {
+    int64_t pos = hi - 1;
+    pos = offset >= static_cast<uint64_t>(pos) ? 0 : pos - offset;
+    Loc loc = locate(pos);
+    while (limit-- && pos-- >= static_cast<int64_t>(lo)) {
+      result.push_back(_blocks[loc.first][loc.second]);
+      prev(&loc);
+    }
+  } else {
+    size_t pos = lo;
+    pos = offset >= _size - 1 - pos ? _size - 1 : pos + offset;
+    Loc loc = locate(pos);
+    while (limit-- && pos++ < hi) {
+      result.push_back(_blocks[loc.first][loc.second]);
+      next(&loc);
+    }
+  }
+  return result;
+}
+
+uint64_t ZSetIndex::count(const redis_port::Zrangespec& range) const {
+  size_t lo = lowerBound(range);
+  size_t hi = upperBound(range);
+  return lo >= hi ? 0 : hi - lo;
+}
+
+bool ZSetIndex::insert(double score, const std::string& subkey) {
+  Loc loc = find(score, subkey);
+  if (loc.first == _blocks.size()) {
+    // the last one
+    if (_blocks.empty()) {
+      _blocks.emplace_back();
+      _memUsage += sizeof(std::vector<Member>);
+    }
+    loc = {_blocks.size() - 1, _blocks.back().size()};
+  } else if (_blocks[loc.first][loc.second] == Member(score, subkey)) {
+    return false;
+  }
+  auto& b = _blocks[loc.first];
+  b.emplace(b.begin() + loc.second, score, subkey);
+  if (b.size() >= 2 * BLOCK_SIZE) {
+    std::vector<Member> half(std::make_move_iterator(b.begin() + BLOCK_SIZE),
+                             std::make_move_iterator(b.end()));
+    b.resize(BLOCK_SIZE);
+    _blocks.emplace(_blocks.begin() + loc.first + 1, std::move(half));
+    _memUsage += sizeof(std::vector<Member>);
+  }
+  ++_size;
+  _memUsage += sizeof(Member) + subkey.size();
+  return true;
+}
+
+bool ZSetIndex::erase(double score, const std::string& subkey) {
+  Loc loc = find(score, subkey);
+  if (loc.first == _blocks.size() ||
+      _blocks[loc.first][loc.second] != Member(score, subkey)) {
+    return false;
+  }
+  auto& b = _blocks[loc.first];
+  b.erase(b.begin() + loc.second);
+  if (b.empty()) {
+    _blocks.erase(_blocks.begin() + loc.first);
+    _memUsage -= sizeof(std::vector<Member>);
+  }
+  --_size;
+  _memUsage -= sizeof(Member) + subkey.size();
+  return true;
+}
+
+ZSetIndexCache::ZSetIndexCache(const std::shared_ptr<ServerParams>& cfg)
+  : _cfg(cfg), _memUsage(0) {
+  for (auto& v : _epochs) {
+    v = 0;
+  }
+}
+
+uint64_t ZSetIndexCache::capacity() const {
+  if (!_cfg || _cfg->kvStoreCount == 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(_cfg->zsetIndexCacheMB) * 1024 * 1024 /
+    _cfg->kvStoreCount;
+}
+
+bool ZSetIndexCache::enabled() const {
+  return capacity() > 0;
+}
+
+uint64_t ZSetIndexCache::minCount() const {
+  return _cfg ? _cfg->zsetIndexMinCount : 0;
+}
+
+size_t ZSetIndexCache::shard(const std::string& key) const {
+  return std::hash<std::string>()(key) % EPOCH_SHARDS;
+}
+
+void ZSetIndexCache::eraseInLock(std::list<Entry>::iterator it) {
+  _memUsage -= it->memUsage;
+  _map.erase(it->key);
+  _lru.erase(it);
+}
+
+std::shared_ptr<const ZSetIndex> ZSetIndexCache::get(
+  const std::string& key, const std::string& token) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  if (capacity() == 0 && !_lru.empty()) {
+    // disabled online, release the memory
+    _map.clear();
+    _lru.clear();
+    _memUsage = 0;
+  }
+  auto it = _map.find(key);
+  if (it == _map.end() || it->second->token != token) {
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  _lru.splice(_lru.begin(), _lru, it->second);
+  hits.fetch_add(1, std::memory_order_relaxed);
+  return it->second->index;
+}
+
+uint64_t ZSetIndexCache::getEpoch(const std::string& key) const {
+  return _epochs[shard(key)].load(std::memory_order_acquire);
+}
+
+bool ZSetIndexCache::put(const std::string& key,
+                         const std::string& token,
+                         uint64_t epoch,
+                         std::shared_ptr<ZSetIndex> index) {
+  uint64_t cap = capacity();
+  uint64_t mem = index->memUsage() + key.size() + token.size();
+  if (mem > cap) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lk(_mutex);
+  // invalidated after the index was read from the store
+  if (_epochs[shard(key)].load(std::memory_order_acquire) != epoch) {
+    return false;
+  }
+  auto it = _map.find(key);
+  if (it != _map.end()) {
+    eraseInLock(it->second);
+  }
+  _lru.push_front({key, token, std::move(index), mem});
+  _map[key] = _lru.begin();
+  _memUsage += mem;
+  while (_memUsage > cap) {
+    eraseInLock(std::prev(_lru.end()));
+    evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+  builds.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool ZSetIndexCache::shouldBuild(const std::string& key, uint64_t count) {
+  // the least the index takes, the members have no subkey
+  uint64_t mem = sizeof(ZSetIndex) + count * sizeof(ZSetIndex::Member);
+  if (mem > capacity()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lk(_mutex);
+  auto it = _reads.find(key);
+  if (it == _reads.end()) {
+    if (_reads.size() >= MAX_READ_KEYS) {
+      _reads.clear();
+    }
+    it = _reads.emplace(key, 0).first;
+  }
+  if (++it->second < BUILD_AFTER_READS) {
+    return false;
+  }
+  _reads.erase(it);
+  return true;
+}
+
+void ZSetIndexCache::update(const std::string& key,
+                            const ZSetIndexUpdate& update) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  _epochs[shard(key)].fetch_add(1, std::memory_order_acq_rel);
+  auto it = _map.find(key);
+  if (it == _map.end()) {
+    return;
+  }
+  auto e = it->second;
+  if (e->token != update.token) {
+    eraseInLock(e);
+    return;
+  }
+  for (const auto& v : update.changes) {
+    const auto& m = v.second;
+    bool ok = v.first ? e->index->insert(m.first, m.second)
+                      : e->index->erase(m.first, m.second);
+    if (!ok) {
+      // the index is not the zset of token
+      eraseInLock(e);
+      return;
+    }
+  }
+  if (e->index->size() < minCount()) {
+    eraseInLock(e);
+    return;
+  }
+  _memUsage -= e->memUsage;
+  e->token = update.newToken;
+  e->memUsage = e->index->memUsage() + key.size() + e->token.size();
+  _memUsage += e->memUsage;
+  _lru.splice(_lru.begin(), _lru, e);
+  uint64_t cap = capacity();
+  while (_memUsage > cap && !_lru.empty()) {
+    eraseInLock(std::prev(_lru.end()));
+    evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+  updates.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ZSetIndexCache::invalidate(const std::string& key) {
+  std::lock_guard<std::mutex> lk(_mutex);
+  _epochs[shard(key)].fetch_add(1, std::memory_order_acq_rel);
+  _reads.erase(key);
+  auto it = _map.find(key);
+  if (it != _map.end()) {
+    eraseInLock(it->second);
+  }
+}
+
+void ZSetIndexCache::clear() {
+  std::lock_guard<std::mutex> lk(_mutex);
+  for (auto& v : _epochs) {
+    v.fetch_add(1, std::memory_order_acq_rel);
+  }
+  _map.clear();
+  _lru.clear();
+  _reads.clear();
+  _memUsage = 0;
+}
+
+uint64_t ZSetIndexCache::memUsage() const {
+  std::lock_guard<std::mutex> lk(_mutex);
+  return _memUsage;
+}
+
+size_t ZSetIndexCache::size() const {
+  std::lock_guard<std::mutex> lk(_mutex);
+  return _lru.size();
+}
+
+}  // namespace tendisplus
@@ -0,0 +1,162 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_STORAGE_ZSET_INDEX_H_
+#define SRC_TENDISPLUS_STORAGE_ZSET_INDEX_H_
+
+#include <array>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "tendisplus/server/server_params.h"
+#include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/status.h"
+
+namespace tendisplus {
+
+// an in-memory copy of the members of a zset, sorted by (score, subkey)
+// as the SkipList. rank and range queries are answered without walking
+// the SkipList nodes in the store, see ZSetIndexCache.
+// The members are kept in blocks of about BLOCK_SIZE, so a member is
+// inserted or erased without moving the whole zset. It is not thread
+// safe, the writers of the zset update it with the key locked, which
+// the readers lock too.
+class ZSetIndex {
+ public:
+  using Member = std::pair<double, std::string>;
+  // members are sorted
+  explicit ZSetIndex(std::vector<Member>&& members);
+  size_t size() const;
+  // approximate bytes of the index
+  uint64_t memUsage() const;
+  // 1-based rank as SkipList::rank(), ERR_NOTFOUND if not exists
+  Expected<uint32_t> rank(double score, const std::string& subkey) const;
+  // the same with SkipList::scanByRank(), start is 0-based and
+  // [start, start + len) must be in the index
+  std::list<Member> scanByRank(int64_t start, int64_t len, bool rev) const;
+  // the same with SkipList::scanByScore()
+  std::list<Member> scanByScore(const redis_port::Zrangespec& range,
+                                uint64_t offset,
+                                uint64_t limit,
+                                bool rev) const;
+  uint64_t count(const redis_port::Zrangespec& range) const;
+  // false if the member exists
+  bool insert(double score, const std::string& subkey);
+  // false if the member not exists
+  bool erase(double score, const std::string& subkey);
+
+  static constexpr size_t BLOCK_SIZE = 512;
+
+ private:
+  // (block, offset) of a member
+  using Loc = std::pair<size_t, size_t>;
+  // the first member for which pred is false, pred is true for a prefix
+  // of the members as std::partition_point()
+  template <typename Pred>
+  Loc partitionPoint(Pred pred) const;
+  // the first member not less than (score, subkey)
+  Loc find(double score, const std::string& subkey) const;
+  size_t position(const Loc& loc) const;
+  Loc locate(size_t pos) const;
+  // step loc to the next or the previous member, false if none
+  bool next(Loc* loc) const;
+  bool prev(Loc* loc) const;
+  // the first position >= range.min, and the first position > range.max
+  size_t lowerBound(const redis_port::Zrangespec& range) const;
+  size_t upperBound(const redis_port::Zrangespec& range) const;
+  // no empty block
+  std::vector<std::vector<Member>> _blocks;
+  size_t _size;
+  uint64_t _memUsage;
+};
+
+// the members inserted and removed by the writes of a zset, which update
+// its cached index from the meta of token to the meta of newToken after
+// commit, see ZSetIndexCache::update()
+struct ZSetIndexUpdate {
+  std::string token;
+  std::string newToken;
+  // true for inserted, in the order of the writes
+  std::vector<std::pair<bool, ZSetIndex::Member>> changes;
+};
+
+// a bounded LRU cache of ZSetIndex, keyed by the encoded meta RecordKey.
+// An index is only valid for the meta it is built from, the token, so
+// a reader looks it up with the meta it has read. The SkipList writes
+// update the index in place after commit, other writes of the meta
+// invalidate the key, see RocksTxn::commit(). The epochs prevent an index
+// built before the invalidation from being inserted after it.
+// The capacity is zset-index-cache-mb shared by all the kvstores, and
+// zsets with fewer members than zset-index-min-count are not cached.
+// Building an index reads the whole zset, so a zset is indexed only after
+// BUILD_AFTER_READS reads, see shouldBuild().
+class ZSetIndexCache {
+ public:
+  explicit ZSetIndexCache(const std::shared_ptr<ServerParams>& cfg);
+  ZSetIndexCache(const ZSetIndexCache&) = delete;
+  ZSetIndexCache(ZSetIndexCache&&) = delete;
+  bool enabled() const;
+  uint64_t capacity() const;
+  uint64_t minCount() const;
+  // return nullptr if key is not cached or cached with another token
+  std::shared_ptr<const ZSetIndex> get(const std::string& key,
+                                       const std::string& token);
+  // get the epoch before reading the members of key from the store, and
+  // pass it to put(), which ignores the index if key has been invalidated
+  uint64_t getEpoch(const std::string& key) const;
+  bool put(const std::string& key,
+           const std::string& token,
+           uint64_t epoch,
+           std::shared_ptr<ZSetIndex> index);
+  // called on a miss of key, whether the index of count members is worth
+  // building now
+  bool shouldBuild(const std::string& key, uint64_t count);
+  // apply the changes to the index of key cached with update.token, and
+  // cache it with update.newToken. Otherwise the key is invalidated.
+  // It must be called with the key locked.
+  void update(const std::string& key, const ZSetIndexUpdate& update);
+  void invalidate(const std::string& key);
+  void clear();
+  uint64_t memUsage() const;
+  size_t size() const;
+
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> builds{0};
+  std::atomic<uint64_t> updates{0};
+  std::atomic<uint64_t> evictions{0};
+
+  static constexpr uint32_t BUILD_AFTER_READS = 3;
+  // the keys whose reads are counted
+  static constexpr size_t MAX_READ_KEYS = 4096;
+
+ private:
+  struct Entry {
+    std::string key;
+    std::string token;
+    std::shared_ptr<ZSetIndex> index;
+    uint64_t memUsage;
+  };
+  static constexpr size_t EPOCH_SHARDS = 64;
+  size_t shard(const std::string& key) const;
+  void eraseInLock(std::list<Entry>::iterator it);
+  const std::shared_ptr<ServerParams> _cfg;
+  mutable std::mutex _mutex;
+  // front is the most recently used
+  std::list<Entry> _lru;
+  std::unordered_map<std::string, std::list<Entry>::iterator> _map;
+  // key -> the reads of it since invalidated
+  std::unordered_map<std::string, uint32_t> _reads;
+  uint64_t _memUsage;
+  std::array<std::atomic<uint64_t>, EPOCH_SHARDS> _epochs;
+};
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_STORAGE_ZSET_INDEX_H_
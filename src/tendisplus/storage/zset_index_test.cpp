@@ -0,0 +1,302 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "gtest/gtest.h"
+#include "tendisplus/storage/zset_index.h"
+
+namespace tendisplus {
+
+// scores 1, 1, 2, 2, ... with members "a", "b", "c", ...
+std::shared_ptr<ZSetIndex> genIndex(size_t n) {
+  std::vector<ZSetIndex::Member> members;
+  members.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    members.emplace_back((i + 2) / 2, std::string(1, 'a' + i % 26) +
+                           std::to_string(i));
+  }
+  return std::make_shared<ZSetIndex>(std::move(members));
+}
+
+redis_port::Zrangespec genRange(double min, double max, bool minex,
+                                bool maxex) {
+  redis_port::Zrangespec range;
+  range.min = min;
+  range.max = max;
+  range.minex = minex;
+  range.maxex = maxex;
+  return range;
+}
+
+TEST(ZSetIndex, Common) {
+  auto index = genIndex(10);
+  EXPECT_EQ(index->size(), 10U);
+
+  auto eRank = index->rank(1, "a0");
+  EXPECT_TRUE(eRank.ok());
+  EXPECT_EQ(eRank.value(), 1U);
+  eRank = index->rank(3, "e4");
+  EXPECT_TRUE(eRank.ok());
+  EXPECT_EQ(eRank.value(), 5U);
+  EXPECT_EQ(index->rank(3, "a0").status().code(), ErrorCodes::ERR_NOTFOUND);
+
+  auto arr = index->scanByRank(0, 3, false);
+  EXPECT_EQ(arr.size(), 3U);
+  EXPECT_EQ(arr.front().second, "a0");
+  EXPECT_EQ(arr.back().second, "c2");
+  arr = index->scanByRank(1, 3, true);
+  EXPECT_EQ(arr.size(), 3U);
+  EXPECT_EQ(arr.front().second, "i8");
+  EXPECT_EQ(arr.back().second, "g6");
+
+  // [2, 3]: c2 d3 e4 f5
+  auto range = genRange(2, 3, false, false);
+  EXPECT_EQ(index->count(range), 4U);
+  arr = index->scanByScore(range, 0, -1, false);
+  EXPECT_EQ(arr.size(), 4U);
+  EXPECT_EQ(arr.front().second, "c2");
+  arr = index->scanByScore(range, 1, 2, true);
+  EXPECT_EQ(arr.size(), 2U);
+  EXPECT_EQ(arr.front().second, "e4");
+  EXPECT_EQ(arr.back().second, "d3");
+
+  // (2, 3)
+  range = genRange(2, 3, true, true);
+  EXPECT_EQ(index->count(range), 0U);
+  EXPECT_TRUE(index->scanByScore(range, 0, -1, false).empty());
+  // (2, 3]
+  range = genRange(2, 3, true, false);
+  EXPECT_EQ(index->count(range), 2U);
+  // max < min
+  range = genRange(3, 2, false, false);
+  EXPECT_EQ(index->count(range), 0U);
+  EXPECT_TRUE(index->scanByScore(range, 0, -1, true).empty());
+
+  // an offset beyond the end stops at the last member, as SkipList does
+  range = genRange(1, 100, false, false);
+  arr = index->scanByScore(range, 100, -1, false);
+  EXPECT_EQ(arr.size(), 1U);
+  EXPECT_EQ(arr.front().second, "j9");
+  arr = index->scanByScore(range, 100, -1, true);
+  EXPECT_EQ(arr.size(), 1U);
+  EXPECT_EQ(arr.front().second, "a0");
+}
+
+TEST(ZSetIndex, Update) {
+  // the members span blocks, which are split and erased
+  size_t n = ZSetIndex::BLOCK_SIZE * 3;
+  auto index = genIndex(n);
+  std::vector<ZSetIndex::Member> members;
+  for (size_t i = 0; i < n; ++i) {
+    members.emplace_back((i + 2) / 2, std::string(1, 'a' + i % 26) +
+                           std::to_string(i));
+  }
+  auto check = [&]() {
+    EXPECT_EQ(index->size(), members.size());
+    auto arr = index->scanByRank(0, members.size(), false);
+    EXPECT_TRUE(std::equal(arr.begin(), arr.end(), members.begin(),
+                           members.end()));
+    arr = index->scanByRank(0, members.size(), true);
+    EXPECT_TRUE(std::equal(arr.begin(), arr.end(), members.rbegin(),
+                           members.rend()));
+    for (size_t i = 0; i < members.size(); i += 97) {
+      auto eRank = index->rank(members[i].first, members[i].second);
+      EXPECT_TRUE(eRank.ok());
+      EXPECT_EQ(eRank.value(), i + 1);
+    }
+    // (100, 200]
+    auto range = genRange(100, 200, true, false);
+    auto lo = std::partition_point(
+      members.begin(), members.end(), [](const ZSetIndex::Member& m) {
+        return m.first <= 100;
+      });
+    auto hi = std::partition_point(
+      members.begin(), members.end(), [](const ZSetIndex::Member& m) {
+        return m.first <= 200;
+      });
+    EXPECT_EQ(index->count(range), static_cast<uint64_t>(hi - lo));
+    arr = index->scanByScore(range, 10, -1, false);
+    EXPECT_TRUE(std::equal(arr.begin(), arr.end(), lo + 10, hi));
+  };
+  check();
+
+  // into one block until it is split
+  for (size_t i = 0; i < ZSetIndex::BLOCK_SIZE * 2; ++i) {
+    ZSetIndex::Member m(150, "x" + std::to_string(i));
+    EXPECT_TRUE(index->insert(m.first, m.second));
+    members.insert(
+      std::upper_bound(members.begin(), members.end(), m), m);
+  }
+  EXPECT_FALSE(index->insert(150, "x0"));
+  EXPECT_TRUE(index->insert(n * 2, "last"));
+  members.emplace_back(n * 2, "last");
+  EXPECT_TRUE(index->insert(-1, "first"));
+  members.insert(members.begin(), {-1, "first"});
+  check();
+
+  // erase the members after the first one, across the blocks
+  uint64_t mem = index->memUsage();
+  for (size_t i = 0; i < 600; ++i) {
+    EXPECT_TRUE(index->erase(members[1].first, members[1].second));
+    members.erase(members.begin() + 1);
+  }
+  EXPECT_FALSE(index->erase(1, "a0"));
+  EXPECT_LT(index->memUsage(), mem);
+  check();
+
+  auto empty = std::make_shared<ZSetIndex>(std::vector<ZSetIndex::Member>());
+  EXPECT_TRUE(empty->scanByRank(0, 1, false).empty());
+  EXPECT_TRUE(empty->insert(1, "a"));
+  EXPECT_EQ(empty->rank(1, "a").value(), 1U);
+  EXPECT_TRUE(empty->erase(1, "a"));
+  EXPECT_EQ(empty->size(), 0U);
+}
+
+TEST(ZSetIndexCache, Common) {
+  auto cfg = std::make_shared<ServerParams>();
+  cfg->kvStoreCount = 1;
+  ZSetIndexCache cache(cfg);
+  EXPECT_FALSE(cache.enabled());
+  auto index = genIndex(100);
+  EXPECT_FALSE(cache.put("k1", "t1", cache.getEpoch("k1"), index));
+
+  cfg->zsetIndexCacheMB = 1;
+  EXPECT_TRUE(cache.enabled());
+  EXPECT_EQ(cache.capacity(), 1024 * 1024U);
+  EXPECT_TRUE(cache.put("k1", "t1", cache.getEpoch("k1"), index));
+  EXPECT_EQ(cache.get("k1", "t1"), index);
+  EXPECT_EQ(cache.get("k1", "t2"), nullptr);
+  EXPECT_EQ(cache.get("k2", "t1"), nullptr);
+  EXPECT_EQ(cache.hits, 1U);
+  EXPECT_EQ(cache.misses, 2U);
+
+  // invalidated after the epoch is got
+  uint64_t epoch = cache.getEpoch("k1");
+  cache.invalidate("k1");
+  EXPECT_EQ(cache.get("k1", "t1"), nullptr);
+  EXPECT_FALSE(cache.put("k1", "t1", epoch, index));
+  EXPECT_TRUE(cache.put("k1", "t1", cache.getEpoch("k1"), index));
+  EXPECT_EQ(cache.size(), 1U);
+
+  epoch = cache.getEpoch("k2");
+  cache.clear();
+  EXPECT_EQ(cache.size(), 0U);
+  EXPECT_EQ(cache.memUsage(), 0U);
+  EXPECT_FALSE(cache.put("k2", "t2", epoch, index));
+}
+
+TEST(ZSetIndexCache, ShouldBuild) {
+  auto cfg = std::make_shared<ServerParams>();
+  cfg->kvStoreCount = 1;
+  cfg->zsetIndexCacheMB = 1;
+  ZSetIndexCache cache(cfg);
+  for (uint32_t i = 1; i < ZSetIndexCache::BUILD_AFTER_READS; ++i) {
+    EXPECT_FALSE(cache.shouldBuild("k1", 100));
+  }
+  EXPECT_TRUE(cache.shouldBuild("k1", 100));
+
+  // the reads are counted since the key is invalidated
+  for (uint32_t i = 1; i < ZSetIndexCache::BUILD_AFTER_READS; ++i) {
+    EXPECT_FALSE(cache.shouldBuild("k1", 100));
+  }
+  cache.invalidate("k1");
+  for (uint32_t i = 1; i < ZSetIndexCache::BUILD_AFTER_READS; ++i) {
+    EXPECT_FALSE(cache.shouldBuild("k1", 100));
+  }
+  EXPECT_TRUE(cache.shouldBuild("k1", 100));
+
+  // too big to be cached
+  for (uint32_t i = 0; i < ZSetIndexCache::BUILD_AFTER_READS; ++i) {
+    EXPECT_FALSE(cache.shouldBuild("k2", 1000000));
+  }
+}
+
+TEST(ZSetIndexCache, Update) {
+  auto cfg = std::make_shared<ServerParams>();
+  cfg->kvStoreCount = 1;
+  cfg->zsetIndexCacheMB = 1;
+  cfg->zsetIndexMinCount = 5;
+  ZSetIndexCache cache(cfg);
+  auto index = genIndex(10);
+  EXPECT_TRUE(cache.put("k1", "t1", cache.getEpoch("k1"), index));
+  uint64_t mem = cache.memUsage();
+
+  ZSetIndexUpdate update;
+  update.token = "t1";
+  update.newToken = "t2";
+  update.changes.emplace_back(true, ZSetIndex::Member(0, "z"));
+  update.changes.emplace_back(false, ZSetIndex::Member(1, "a0"));
+  update.changes.emplace_back(true, ZSetIndex::Member(100, "y"));
+  uint64_t epoch = cache.getEpoch("k1");
+  cache.update("k1", update);
+  EXPECT_EQ(cache.updates, 1U);
+  EXPECT_EQ(cache.get("k1", "t1"), nullptr);
+  EXPECT_EQ(cache.get("k1", "t2"), index);
+  EXPECT_EQ(index->size(), 11U);
+  EXPECT_EQ(index->rank(0, "z").value(), 1U);
+  EXPECT_EQ(index->rank(100, "y").value(), 11U);
+  EXPECT_GT(cache.memUsage(), mem);
+  // an index read before the update is stale
+  EXPECT_FALSE(cache.put("k1", "t1", epoch, genIndex(10)));
+
+  // cached with another token
+  update.token = "t3";
+  cache.update("k1", update);
+  EXPECT_EQ(cache.get("k1", "t2"), nullptr);
+  EXPECT_EQ(cache.size(), 0U);
+  EXPECT_EQ(cache.memUsage(), 0U);
+
+  // not the zset of the token
+  index = genIndex(10);
+  EXPECT_TRUE(cache.put("k1", "t1", cache.getEpoch("k1"), index));
+  update.token = "t1";
+  update.changes = {{false, {2, "b1"}}};
+  cache.update("k1", update);
+  EXPECT_EQ(cache.size(), 0U);
+
+  // fewer members than zset-index-min-count
+  EXPECT_TRUE(cache.put("k1", "t1", cache.getEpoch("k1"), genIndex(5)));
+  update.changes = {{false, {1, "a0"}}};
+  cache.update("k1", update);
+  EXPECT_EQ(cache.size(), 0U);
+  EXPECT_EQ(cache.updates, 1U);
+}
+
+TEST(ZSetIndexCache, Evict) {
+  auto cfg = std::make_shared<ServerParams>();
+  cfg->kvStoreCount = 1;
+  cfg->zsetIndexCacheMB = 1;
+  ZSetIndexCache cache(cfg);
+  auto index = genIndex(7000);
+  EXPECT_GT(index->memUsage(), cache.capacity() / 4);
+  EXPECT_LT(index->memUsage(), cache.capacity() / 3);
+
+  for (int i = 0; i < 3; ++i) {
+    auto key = "k" + std::to_string(i);
+    EXPECT_TRUE(cache.put(key, "t", cache.getEpoch(key), index));
+  }
+  EXPECT_EQ(cache.size(), 3U);
+  // k0 is the most recently used, k1 is evicted
+  EXPECT_NE(cache.get("k0", "t"), nullptr);
+  EXPECT_TRUE(cache.put("k3", "t", cache.getEpoch("k3"), index));
+  EXPECT_EQ(cache.size(), 3U);
+  EXPECT_EQ(cache.evictions, 1U);
+  EXPECT_EQ(cache.get("k1", "t"), nullptr);
+  EXPECT_NE(cache.get("k0", "t"), nullptr);
+  EXPECT_LE(cache.memUsage(), cache.capacity());
+
+  // too big to be cached
+  EXPECT_FALSE(cache.put("k4", "t", cache.getEpoch("k4"), genIndex(50000)));
+
+  // disabled online
+  cfg->zsetIndexCacheMB = 0;
+  EXPECT_EQ(cache.get("k0", "t"), nullptr);
+  EXPECT_EQ(cache.size(), 0U);
+}
+
+}  // namespace tendisplus
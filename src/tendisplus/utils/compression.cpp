@@ -0,0 +1,108 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include "tendisplus/utils/compression.h"
+
+#include <string>
+#include "lz4.h"
+#include "tendisplus/storage/varint.h"
+#include "tendisplus/utils/invariant.h"
+#include "tendisplus/utils/string.h"
+
+namespace tendisplus {
+
+Expected<Codec> codecFromName(const std::string& name) {
+  auto v = toLower(name);
+  if (v == "none") {
+    return Codec::NONE;
+  } else if (v == "lz4") {
+    return Codec::LZ4;
+  }
+  return {ErrorCodes::ERR_PARSEOPT, "unknown codec:" + name};
+}
+
+std::string codecName(Codec codec) {
+  switch (codec) {
+    case Codec::NONE:
+      return "none";
+    case Codec::LZ4:
+      return "lz4";
+    default:
+      INVARIANT_D(0);
+      return "unknown";
+  }
+}
+
+Codec negotiateCodec(const std::string& names) {
+  for (const auto& name : stringSplit(names, ",")) {
+    auto eCodec = codecFromName(name);
+    if (eCodec.ok()) {
+      return eCodec.value();
+    }
+  }
+  return Codec::NONE;
+}
+
+Expected<std::string> compressFrame(Codec codec, const std::string& data) {
+  if (data.size() > MAX_FRAME_DATA) {
+    return {ErrorCodes::ERR_INTERNAL, "too big data to compress"};
+  }
+  std::string frame = varintEncodeStr(data.size());
+  size_t hdrSize = frame.size();
+  switch (codec) {
+    case Codec::NONE:
+      frame.append(data);
+      return frame;
+    case Codec::LZ4: {
+      int bound = LZ4_compressBound(data.size());
+      frame.resize(hdrSize + bound);
+      int size = LZ4_compress_default(
+        data.data(), &frame[hdrSize], data.size(), bound);
+      if (size <= 0) {
+        return {ErrorCodes::ERR_INTERNAL, "lz4 compress failed"};
+      }
+      frame.resize(hdrSize + size);
+      return frame;
+    }
+    default:
+      INVARIANT_D(0);
+      return {ErrorCodes::ERR_INTERNAL, "unknown codec"};
+  }
+}
+
+Expected<std::string> uncompressFrame(Codec codec, const std::string& frame) {
+  auto eSize = varintDecodeFwd(reinterpret_cast<const uint8_t*>(frame.data()),
+                               frame.size());
+  if (!eSize.ok()) {
+    return {ErrorCodes::ERR_DECODE, "bad frame header"};
+  }
+  uint64_t dataSize = eSize.value().first;
+  size_t hdrSize = eSize.value().second;
+  if (dataSize > MAX_FRAME_DATA) {
+    return {ErrorCodes::ERR_DECODE, "too big frame data"};
+  }
+  switch (codec) {
+    case Codec::NONE:
+      if (frame.size() - hdrSize != dataSize) {
+        return {ErrorCodes::ERR_DECODE, "bad frame size"};
+      }
+      return frame.substr(hdrSize);
+    case Codec::LZ4: {
+      std::string data(dataSize, '\0');
+      int size = LZ4_decompress_safe(frame.data() + hdrSize,
+                                     &data[0],
+                                     frame.size() - hdrSize,
+                                     dataSize);
+      if (size < 0 || static_cast<uint64_t>(size) != dataSize) {
+        return {ErrorCodes::ERR_DECODE, "lz4 decompress failed"};
+      }
+      return data;
+    }
+    default:
+      INVARIANT_D(0);
+      return {ErrorCodes::ERR_DECODE, "unknown codec"};
+  }
+}
+
+}  // namespace tendisplus
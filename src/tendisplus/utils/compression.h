@@ -0,0 +1,35 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_UTILS_COMPRESSION_H_
+#define SRC_TENDISPLUS_UTILS_COMPRESSION_H_
+
+#include <string>
+#include "tendisplus/utils/status.h"
+
+namespace tendisplus {
+
+// the codecs of the binlogs sent to a slave, negotiated by INCRSYNC, see
+// ReplManager::registerIncrSync()
+enum class Codec {
+  NONE = 0,
+  LZ4 = 1,
+};
+
+// ERR_PARSEOPT if name is not a codec
+Expected<Codec> codecFromName(const std::string& name);
+std::string codecName(Codec codec);
+// the first codec known of the names separated by ',', NONE if none
+Codec negotiateCodec(const std::string& names);
+
+// a frame is the size of the data as a varint, then the data compressed
+// by codec, the data is at most MAX_FRAME_DATA bytes
+Expected<std::string> compressFrame(Codec codec, const std::string& data);
+Expected<std::string> uncompressFrame(Codec codec, const std::string& frame);
+
+constexpr size_t MAX_FRAME_DATA = 1024 * 1024 * 1024;
+
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_UTILS_COMPRESSION_H_
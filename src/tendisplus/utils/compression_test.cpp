@@ -0,0 +1,51 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <string>
+#include "gtest/gtest.h"
+#include "tendisplus/utils/compression.h"
+
+namespace tendisplus {
+
+TEST(Compression, Codec) {
+  EXPECT_EQ(codecFromName("LZ4").value(), Codec::LZ4);
+  EXPECT_EQ(codecFromName("none").value(), Codec::NONE);
+  EXPECT_EQ(codecFromName("zstd").status().code(), ErrorCodes::ERR_PARSEOPT);
+  EXPECT_EQ(codecName(Codec::LZ4), "lz4");
+
+  EXPECT_EQ(negotiateCodec("zstd,lz4"), Codec::LZ4);
+  EXPECT_EQ(negotiateCodec("zstd"), Codec::NONE);
+  EXPECT_EQ(negotiateCodec(""), Codec::NONE);
+}
+
+TEST(Compression, Frame) {
+  std::string data;
+  for (int i = 0; i < 10000; i++) {
+    data += "{\"field\":" + std::to_string(i % 100) + "}";
+  }
+  for (auto codec : {Codec::NONE, Codec::LZ4}) {
+    auto eFrame = compressFrame(codec, data);
+    EXPECT_TRUE(eFrame.ok());
+    auto eData = uncompressFrame(codec, eFrame.value());
+    EXPECT_TRUE(eData.ok());
+    EXPECT_EQ(eData.value(), data);
+    if (codec == Codec::LZ4) {
+      EXPECT_LT(eFrame.value().size(), data.size() / 3);
+    }
+
+    eFrame = compressFrame(codec, "");
+    EXPECT_TRUE(eFrame.ok());
+    EXPECT_EQ(uncompressFrame(codec, eFrame.value()).value(), "");
+  }
+
+  // corrupted
+  auto frame = compressFrame(Codec::LZ4, data).value();
+  EXPECT_FALSE(uncompressFrame(Codec::LZ4, frame.substr(0, 100)).ok());
+  EXPECT_FALSE(uncompressFrame(Codec::NONE, frame).ok());
+  EXPECT_FALSE(uncompressFrame(Codec::LZ4, "").ok());
+  frame[0] = '\xff';
+  EXPECT_FALSE(uncompressFrame(Codec::LZ4, frame).ok());
+}
+
+}  // namespace tendisplus
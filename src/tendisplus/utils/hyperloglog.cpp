@@ -45,6 +45,7 @@
 #include "glog/logging.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/simd.h"
 #include "tendisplus/utils/time.h"
 
 namespace tendisplus {
@@ -994,50 +995,17 @@ double hllSparseSum(
  * internally as speedup for PFCOUNT with multiple keys. */
 double hllRawSum(uint8_t* registers, double* PE, int* ezp) {
   double E = 0;
-  int j, ez = 0;
-  uint64_t* word = reinterpret_cast<uint64_t*>(registers);
-  uint8_t* bytes;
-
-  for (j = 0; j < HLL_REGISTERS / 8; j++) {
-    if (*word == 0) {
-      ez += 8;
-    } else {
-      bytes = reinterpret_cast<uint8_t*>(word);
-      if (bytes[0])
-        E += PE[bytes[0]];
-      else
-        ez++;
-      if (bytes[1])
-        E += PE[bytes[1]];
-      else
-        ez++;
-      if (bytes[2])
-        E += PE[bytes[2]];
-      else
-        ez++;
-      if (bytes[3])
-        E += PE[bytes[3]];
-      else
-        ez++;
-      if (bytes[4])
-        E += PE[bytes[4]];
-      else
-        ez++;
-      if (bytes[5])
-        E += PE[bytes[5]];
-      else
-        ez++;
-      if (bytes[6])
-        E += PE[bytes[6]];
-      else
-        ez++;
-      if (bytes[7])
-        E += PE[bytes[7]];
-      else
-        ez++;
-    }
-    word++;
+  int j, ez;
+  uint32_t histo[64] = {0};
+
+  // count the registers of every value by the simd kernel, then sum them
+  // up from the biggest value, so the result does not depend on the order
+  // of the registers
+  simd::regHisto(registers, HLL_REGISTERS, histo);
+  for (j = 63; j >= 1; j--) {
+    E += histo[j] * PE[j];
   }
+  ez = histo[0];
 
   // 2^(-reg[j]) is 1 when m is 0, add it 'ez' times for every zero register
   // in the HLL.
@@ -1131,13 +1099,9 @@ int hllMerge(uint8_t* max, struct hllhdr* hdr, size_t hdrSize) {
   int i;
 
   if (hdr->encoding == HLL_DENSE) {
-    uint8_t val;
-
-    for (i = 0; i < HLL_REGISTERS; i++) {
-      HLL_DENSE_GET_REGISTER(val, hdr->registers, i);
-      if (val > max[i])
-        max[i] = val;
-    }
+    /* Unpack and merge the 6 bit registers by the simd kernel. */
+    static_assert(HLL_BITS == 6, "denseMaxMerge works on 6 bits only");
+    simd::denseMaxMerge(max, hdr->registers, HLL_REGISTERS);
   } else {
     uint8_t *p = reinterpret_cast<uint8_t*>(hdr), *end = p + hdrSize;
     int64_t runlen, regval;
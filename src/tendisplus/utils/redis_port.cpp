@@ -12,6 +12,7 @@
 #include "glog/logging.h"
 #include "tendisplus/utils/invariant.h"
 #include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/simd.h"
 #include "tendisplus/utils/time.h"
 
 namespace tendisplus {
@@ -150,36 +151,18 @@ int64_t bitPos(const void* s, size_t count, uint32_t bit) {
   long pos = 0;     // NOLINT:runtime/int
   unsigned long j;  // NOLINT:runtime/int
 
-  /* Process whole words first, seeking for first word that is not
-   * all ones or all zeros respectively if we are lookig for zeros
-   * or ones. This is much faster with large strings having contiguous
-   * blocks of 1 or 0 bits compared to the vanilla bit per bit processing.
-   *
-   * Note that if we start from an address that is not aligned
-   * to sizeof(unsigned long) we consume it byte by byte until it is
-   * aligned. */
-
-  /* Skip initial bits not aligned to sizeof(unsigned long) byte by byte. */
+  /* Skip the bytes that are all ones or all zeros respectively if we are
+   * looking for zeros or ones. This is much faster with large strings
+   * having contiguous blocks of 1 or 0 bits compared to the vanilla bit
+   * per bit processing. The simd kernel stops at the first byte not
+   * skipped, which needs no alignment. */
   skipval = bit ? 0 : UCHAR_MAX;
   c = (unsigned char*)s;
-  while ((unsigned long)c & (sizeof(*l) - 1) && count) {  // NOLINT:runtime/int
-    if (*c != skipval)
-      break;
-    c++;
-    count--;
-    pos += 8;
-  }
-
-  /* Skip bits with full word step. */
-  skipval = bit ? 0 : ULONG_MAX;
+  j = simd::skipBytes(c, count, skipval);
+  c += j;
+  count -= j;
+  pos += j * 8;
   l = (unsigned long*)c;  // NOLINT:runtime/int
-  while (count >= sizeof(*l)) {
-    if (*l != skipval)
-      break;
-    l++;
-    count -= sizeof(*l);
-    pos += sizeof(*l) * 8;
-  }
 
   /* Load bytes into "word" considering the first byte as the most significant
    * (we basically consider it as written in big endian, since we consider the
@@ -228,57 +211,7 @@ int64_t bitPos(const void* s, size_t count, uint32_t bit) {
 }
 
 size_t popCount(const void* s, long count) {  // (NOLINT)
-  size_t bits = 0;
-  const unsigned char* p = static_cast<const unsigned char*>(s);
-  uint32_t* p4;
-  static const unsigned char bitsinbyte[256] = {
-    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4,
-    2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 1, 2, 2, 3, 2, 3, 3, 4,
-    2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6,
-    4, 5, 5, 6, 5, 6, 6, 7, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5,
-    3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6,
-    4, 5, 5, 6, 5, 6, 6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-    4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};  // (NOLINT)
-
-  /* Count initial bytes not aligned to 32 bit. */
-  while ((unsigned long)p & 3 && count) {  // (NOLINT)
-    bits += bitsinbyte[*p++];
-    count--;
-  }
-
-  /* Count bits 16 bytes at a time */
-  p4 = (uint32_t*)p;     // (NOLINT)
-  while (count >= 16) {  // (NOLINT)
-    uint32_t aux1, aux2, aux3, aux4;
-
-    aux1 = *p4++;
-    aux2 = *p4++;
-    aux3 = *p4++;
-    aux4 = *p4++;
-    count -= 16;
-
-    aux1 = aux1 - ((aux1 >> 1) & 0x55555555);
-    aux1 = (aux1 & 0x33333333) + ((aux1 >> 2) & 0x33333333);
-    aux2 = aux2 - ((aux2 >> 1) & 0x55555555);
-    aux2 = (aux2 & 0x33333333) + ((aux2 >> 2) & 0x33333333);
-    aux3 = aux3 - ((aux3 >> 1) & 0x55555555);
-    aux3 = (aux3 & 0x33333333) + ((aux3 >> 2) & 0x33333333);
-    aux4 = aux4 - ((aux4 >> 1) & 0x55555555);
-    aux4 = (aux4 & 0x33333333) + ((aux4 >> 2) & 0x33333333);
-    bits += ((((aux1 + (aux1 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24) +
-      ((((aux2 + (aux2 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24) +
-      ((((aux3 + (aux3 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24) +
-      ((((aux4 + (aux4 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
-  }
-  /* Count the remaining bytes. */
-  p = (unsigned char*)p4;
-  while (count--)
-    bits += bitsinbyte[*p++];  // (NOLINT)
-  return bits;
+  return simd::popCount(s, count);
 }
 
 /* Convert a long double into a string. If humanfriendly is non-zero
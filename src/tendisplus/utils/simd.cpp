@@ -0,0 +1,602 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <string.h>
+#include <atomic>
+#include "tendisplus/utils/simd.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TENDIS_SIMD_X86
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+
+namespace tendisplus {
+namespace simd {
+
+namespace {
+
+enum class BitOp {
+  AND,
+  OR,
+  XOR,
+  NOT,
+};
+
+/* ========================= scalar ========================= */
+
+// port from redis source code, bitops.c::redisPopcount
+uint64_t popCountScalar(const uint8_t* p, size_t count) {
+  uint64_t bits = 0;
+  const uint32_t* p4;
+  static const unsigned char bitsinbyte[256] = {
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4,
+    2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 1, 2, 2, 3, 2, 3, 3, 4,
+    2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6,
+    4, 5, 5, 6, 5, 6, 6, 7, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5,
+    3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6,
+    4, 5, 5, 6, 5, 6, 6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+    4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};  // (NOLINT)
+
+  /* Count initial bytes not aligned to 32 bit. */
+  while ((unsigned long)p & 3 && count) {  // (NOLINT)
+    bits += bitsinbyte[*p++];
+    count--;
+  }
+
+  /* Count bits 16 bytes at a time */
+  p4 = (const uint32_t*)p;  // (NOLINT)
+  while (count >= 16) {
+    uint32_t aux1, aux2, aux3, aux4;
+
+    aux1 = *p4++;
+    aux2 = *p4++;
+    aux3 = *p4++;
+    aux4 = *p4++;
+    count -= 16;
+
+    aux1 = aux1 - ((aux1 >> 1) & 0x55555555);
+    aux1 = (aux1 & 0x33333333) + ((aux1 >> 2) & 0x33333333);
+    aux2 = aux2 - ((aux2 >> 1) & 0x55555555);
+    aux2 = (aux2 & 0x33333333) + ((aux2 >> 2) & 0x33333333);
+    aux3 = aux3 - ((aux3 >> 1) & 0x55555555);
+    aux3 = (aux3 & 0x33333333) + ((aux3 >> 2) & 0x33333333);
+    aux4 = aux4 - ((aux4 >> 1) & 0x55555555);
+    aux4 = (aux4 & 0x33333333) + ((aux4 >> 2) & 0x33333333);
+    bits += ((((aux1 + (aux1 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24) +
+      ((((aux2 + (aux2 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24) +
+      ((((aux3 + (aux3 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24) +
+      ((((aux4 + (aux4 >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+  }
+  /* Count the remaining bytes. */
+  p = (const uint8_t*)p4;  // (NOLINT)
+  while (count--)
+    bits += bitsinbyte[*p++];
+  return bits;
+}
+
+size_t skipBytesScalar(const uint8_t* p, size_t n, uint8_t val) {
+  size_t i = 0;
+  uint64_t word = 0x0101010101010101ULL * val;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t v;
+    memcpy(&v, p + i, sizeof(v));
+    if (v != word) {
+      break;
+    }
+  }
+  while (i < n && p[i] == val) {
+    i++;
+  }
+  return i;
+}
+
+void bitOpScalar(BitOp op, uint8_t* dst, const uint8_t* src, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t a, b = 0;
+    memcpy(&a, dst + i, sizeof(a));
+    if (op != BitOp::NOT) {
+      memcpy(&b, src + i, sizeof(b));
+    }
+    switch (op) {
+      case BitOp::AND:
+        a &= b;
+        break;
+      case BitOp::OR:
+        a |= b;
+        break;
+      case BitOp::XOR:
+        a ^= b;
+        break;
+      case BitOp::NOT:
+        a = ~a;
+        break;
+    }
+    memcpy(dst + i, &a, sizeof(a));
+  }
+  for (; i < n; i++) {
+    switch (op) {
+      case BitOp::AND:
+        dst[i] &= src[i];
+        break;
+      case BitOp::OR:
+        dst[i] |= src[i];
+        break;
+      case BitOp::XOR:
+        dst[i] ^= src[i];
+        break;
+      case BitOp::NOT:
+        dst[i] = ~dst[i];
+        break;
+    }
+  }
+}
+
+void maxMergeScalar(uint8_t* max, const uint8_t* regs, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (regs[i] > max[i]) {
+      max[i] = regs[i];
+    }
+  }
+}
+
+// every 3 bytes of dense are 4 registers, the first register is in the
+// lowest bits of the first byte
+void denseMaxMergeScalar(uint8_t* max, const uint8_t* dense, size_t n) {
+  for (size_t r = 0; r + 4 <= n; r += 4) {
+    const uint8_t* p = dense + r / 4 * 3;
+    uint32_t w = p[0] | (p[1] << 8) | (p[2] << 16);
+    for (size_t k = 0; k < 4; k++) {
+      uint8_t v = (w >> (6 * k)) & 63;
+      if (v > max[r + k]) {
+        max[r + k] = v;
+      }
+    }
+  }
+}
+
+void regHistoScalar(const uint8_t* regs, size_t n, uint32_t* histo) {
+  // 4 tables to break the dependency between the same values in a row
+  uint32_t h[4][64] = {{0}};
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    h[0][regs[i] & 63]++;
+    h[1][regs[i + 1] & 63]++;
+    h[2][regs[i + 2] & 63]++;
+    h[3][regs[i + 3] & 63]++;
+  }
+  for (; i < n; i++) {
+    h[0][regs[i] & 63]++;
+  }
+  for (size_t v = 0; v < 64; v++) {
+    histo[v] += h[0][v] + h[1][v] + h[2][v] + h[3][v];
+  }
+}
+
+#ifdef TENDIS_SIMD_X86
+
+/* ========================= avx2 ========================= */
+
+// count the bits of the low and high nibbles by a table lookup
+TARGET_AVX2 uint64_t popCountAvx2(const uint8_t* p, size_t n) {
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    __m256i lo = _mm256_and_si256(v, low);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                  _mm256_shuffle_epi8(lookup, hi));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+  }
+  uint64_t bits = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+    _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+  return bits + popCountScalar(p + i, n - i);
+}
+
+TARGET_AVX2 size_t skipBytesAvx2(const uint8_t* p, size_t n, uint8_t val) {
+  const __m256i v = _mm256_set1_epi8(static_cast<char>(val));
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(d, v));
+    if (eq != 0xffffffff) {
+      return i + __builtin_ctz(~eq);
+    }
+  }
+  return i + skipBytesScalar(p + i, n - i, val);
+}
+
+TARGET_AVX2 void bitOpAvx2(BitOp op,
+                           uint8_t* dst,
+                           const uint8_t* src,
+                           size_t n) {
+  const __m256i ones = _mm256_set1_epi8(-1);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i* d = reinterpret_cast<__m256i*>(dst + i);
+    __m256i a = _mm256_loadu_si256(d);
+    if (op == BitOp::NOT) {
+      _mm256_storeu_si256(d, _mm256_xor_si256(a, ones));
+      continue;
+    }
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    switch (op) {
+      case BitOp::AND:
+        a = _mm256_and_si256(a, b);
+        break;
+      case BitOp::OR:
+        a = _mm256_or_si256(a, b);
+        break;
+      default:
+        a = _mm256_xor_si256(a, b);
+        break;
+    }
+    _mm256_storeu_si256(d, a);
+  }
+  bitOpScalar(op, dst + i, op == BitOp::NOT ? src : src + i, n - i);
+}
+
+TARGET_AVX2 void maxMergeAvx2(uint8_t* max, const uint8_t* regs, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i* m = reinterpret_cast<__m256i*>(max + i);
+    __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(regs + i));
+    _mm256_storeu_si256(m, _mm256_max_epu8(_mm256_loadu_si256(m), r));
+  }
+  maxMergeScalar(max + i, regs + i, n - i);
+}
+
+// 24 bytes are unpacked to 32 registers a round. Every 3 bytes are moved
+// into a 32 bit lane, then the 4 registers are shifted to their bytes.
+TARGET_AVX2 void denseMaxMergeAvx2(uint8_t* max,
+                                   const uint8_t* dense,
+                                   size_t n) {
+  const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+                                           6, 7, 8, -1, 9, 10, 11, -1,
+                                           0, 1, 2, -1, 3, 4, 5, -1,
+                                           6, 7, 8, -1, 9, 10, 11, -1);
+  const __m256i m0 = _mm256_set1_epi32(0x3f);
+  const __m256i m1 = _mm256_set1_epi32(0x3f00);
+  const __m256i m2 = _mm256_set1_epi32(0x3f0000);
+  const __m256i m3 = _mm256_set1_epi32(0x3f000000);
+  size_t bytes = n / 4 * 3;
+  size_t r = 0;
+  // the second 16 bytes loaded end at off + 28
+  for (; r + 32 <= n && r / 4 * 3 + 28 <= bytes; r += 32) {
+    const uint8_t* p = dense + r / 4 * 3;
+    __m256i v = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)),
+      1);
+    __m256i w = _mm256_shuffle_epi8(v, shuffle);
+    __m256i regs = _mm256_or_si256(
+      _mm256_or_si256(_mm256_and_si256(w, m0),
+                      _mm256_and_si256(_mm256_slli_epi32(w, 2), m1)),
+      _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(w, 4), m2),
+                      _mm256_and_si256(_mm256_slli_epi32(w, 6), m3)));
+    __m256i* m = reinterpret_cast<__m256i*>(max + r);
+    _mm256_storeu_si256(m, _mm256_max_epu8(_mm256_loadu_si256(m), regs));
+  }
+  denseMaxMergeScalar(max + r, dense + r / 4 * 3, n - r);
+}
+
+// the zero registers are counted 32 at a time, which are most of the
+// registers of a small HyperLogLog, the others one by one
+TARGET_AVX2 void regHistoAvx2(const uint8_t* regs,
+                              size_t n,
+                              uint32_t* histo) {
+  const __m256i zero = _mm256_setzero_si256();
+  uint32_t h[64] = {0};
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(regs + i));
+    uint32_t nz = ~static_cast<uint32_t>(
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)));
+    h[0] += 32 - __builtin_popcount(nz);
+    while (nz) {
+      h[regs[i + __builtin_ctz(nz)] & 63]++;
+      nz &= nz - 1;
+    }
+  }
+  for (size_t v = 0; v < 64; v++) {
+    histo[v] += h[v];
+  }
+  regHistoScalar(regs + i, n - i, histo);
+}
+
+/* ========================= avx512 ========================= */
+
+// the avx512 intrinsics of some gcc versions start from an undefined
+// vector, such as _mm512_broadcast_i32x4(), which is a false warning
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#if !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+TARGET_AVX512 uint64_t popCountAvx512(const uint8_t* p, size_t n) {
+  const __m512i lookup = _mm512_broadcast_i32x4(
+    _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+  const __m512i low = _mm512_set1_epi8(0x0f);
+  __m512i acc = _mm512_setzero_si512();
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    __m512i v = _mm512_loadu_si512(p + i);
+    __m512i lo = _mm512_and_si512(v, low);
+    __m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), low);
+    __m512i cnt = _mm512_add_epi8(_mm512_shuffle_epi8(lookup, lo),
+                                  _mm512_shuffle_epi8(lookup, hi));
+    acc = _mm512_add_epi64(acc, _mm512_sad_epu8(cnt, _mm512_setzero_si512()));
+  }
+  uint64_t bits = _mm512_reduce_add_epi64(acc);
+  return bits + popCountScalar(p + i, n - i);
+}
+
+TARGET_AVX512 size_t skipBytesAvx512(const uint8_t* p, size_t n, uint8_t val) {
+  const __m512i v = _mm512_set1_epi8(static_cast<char>(val));
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    uint64_t ne = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(p + i), v);
+    if (ne) {
+      return i + __builtin_ctzll(ne);
+    }
+  }
+  return i + skipBytesScalar(p + i, n - i, val);
+}
+
+TARGET_AVX512 void bitOpAvx512(BitOp op,
+                               uint8_t* dst,
+                               const uint8_t* src,
+                               size_t n) {
+  const __m512i ones = _mm512_set1_epi8(-1);
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    __m512i a = _mm512_loadu_si512(dst + i);
+    if (op == BitOp::NOT) {
+      _mm512_storeu_si512(dst + i, _mm512_xor_si512(a, ones));
+      continue;
+    }
+    __m512i b = _mm512_loadu_si512(src + i);
+    switch (op) {
+      case BitOp::AND:
+        a = _mm512_and_si512(a, b);
+        break;
+      case BitOp::OR:
+        a = _mm512_or_si512(a, b);
+        break;
+      default:
+        a = _mm512_xor_si512(a, b);
+        break;
+    }
+    _mm512_storeu_si512(dst + i, a);
+  }
+  bitOpScalar(op, dst + i, op == BitOp::NOT ? src : src + i, n - i);
+}
+
+TARGET_AVX512 void maxMergeAvx512(uint8_t* max,
+                                  const uint8_t* regs,
+                                  size_t n) {
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    __m512i m = _mm512_loadu_si512(max + i);
+    __m512i r = _mm512_loadu_si512(regs + i);
+    _mm512_storeu_si512(max + i, _mm512_max_epu8(m, r));
+  }
+  maxMergeScalar(max + i, regs + i, n - i);
+}
+
+// the same with denseMaxMergeAvx2(), 48 bytes to 64 registers a round
+TARGET_AVX512 void denseMaxMergeAvx512(uint8_t* max,
+                                       const uint8_t* dense,
+                                       size_t n) {
+  const __m512i shuffle = _mm512_broadcast_i32x4(
+    _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+  const __m512i m0 = _mm512_set1_epi32(0x3f);
+  const __m512i m1 = _mm512_set1_epi32(0x3f00);
+  const __m512i m2 = _mm512_set1_epi32(0x3f0000);
+  const __m512i m3 = _mm512_set1_epi32(0x3f000000);
+  size_t bytes = n / 4 * 3;
+  size_t r = 0;
+  // the last 16 bytes loaded end at off + 52
+  for (; r + 64 <= n && r / 4 * 3 + 52 <= bytes; r += 64) {
+    const uint8_t* p = dense + r / 4 * 3;
+    __m512i v = _mm512_castsi128_si512(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    v = _mm512_inserti32x4(
+      v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), 1);
+    v = _mm512_inserti32x4(
+      v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 24)), 2);
+    v = _mm512_inserti32x4(
+      v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 36)), 3);
+    __m512i w = _mm512_shuffle_epi8(v, shuffle);
+    __m512i regs = _mm512_or_si512(
+      _mm512_or_si512(_mm512_and_si512(w, m0),
+                      _mm512_and_si512(_mm512_slli_epi32(w, 2), m1)),
+      _mm512_or_si512(_mm512_and_si512(_mm512_slli_epi32(w, 4), m2),
+                      _mm512_and_si512(_mm512_slli_epi32(w, 6), m3)));
+    __m512i m = _mm512_loadu_si512(max + r);
+    _mm512_storeu_si512(max + r, _mm512_max_epu8(m, regs));
+  }
+  denseMaxMergeScalar(max + r, dense + r / 4 * 3, n - r);
+}
+
+TARGET_AVX512 void regHistoAvx512(const uint8_t* regs,
+                                  size_t n,
+                                  uint32_t* histo) {
+  const __m512i zero = _mm512_setzero_si512();
+  uint32_t h[64] = {0};
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    uint64_t nz = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(regs + i), zero);
+    h[0] += 64 - __builtin_popcountll(nz);
+    while (nz) {
+      h[regs[i + __builtin_ctzll(nz)] & 63]++;
+      nz &= nz - 1;
+    }
+  }
+  for (size_t v = 0; v < 64; v++) {
+    histo[v] += h[v];
+  }
+  regHistoScalar(regs + i, n - i, histo);
+}
+
+#pragma GCC diagnostic pop
+
+#endif  // TENDIS_SIMD_X86
+
+/* ========================= dispatch ========================= */
+
+struct Kernels {
+  Level level;
+  uint64_t (*popCount)(const uint8_t*, size_t);
+  size_t (*skipBytes)(const uint8_t*, size_t, uint8_t);
+  void (*bitOp)(BitOp, uint8_t*, const uint8_t*, size_t);
+  void (*maxMerge)(uint8_t*, const uint8_t*, size_t);
+  void (*denseMaxMerge)(uint8_t*, const uint8_t*, size_t);
+  void (*regHisto)(const uint8_t*, size_t, uint32_t*);
+};
+
+const Kernels kScalar = {Level::SCALAR,
+                         popCountScalar,
+                         skipBytesScalar,
+                         bitOpScalar,
+                         maxMergeScalar,
+                         denseMaxMergeScalar,
+                         regHistoScalar};
+
+#ifdef TENDIS_SIMD_X86
+const Kernels kAvx2 = {Level::AVX2,
+                       popCountAvx2,
+                       skipBytesAvx2,
+                       bitOpAvx2,
+                       maxMergeAvx2,
+                       denseMaxMergeAvx2,
+                       regHistoAvx2};
+
+const Kernels kAvx512 = {Level::AVX512,
+                         popCountAvx512,
+                         skipBytesAvx512,
+                         bitOpAvx512,
+                         maxMergeAvx512,
+                         denseMaxMergeAvx512,
+                         regHistoAvx512};
+#endif
+
+const Kernels* kernelsOf(Level l) {
+#ifdef TENDIS_SIMD_X86
+  switch (l) {
+    case Level::AVX512:
+      return &kAvx512;
+    case Level::AVX2:
+      return &kAvx2;
+    default:
+      break;
+  }
+#endif
+  return &kScalar;
+}
+
+std::atomic<const Kernels*>& current() {
+  static std::atomic<const Kernels*> kernels(kernelsOf(detected()));
+  return kernels;
+}
+
+const Kernels* kernels() {
+  return current().load(std::memory_order_relaxed);
+}
+
+}  // namespace
+
+Level detected() {
+#ifdef TENDIS_SIMD_X86
+  static const Level l = []() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+      return Level::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      return Level::AVX2;
+    }
+    return Level::SCALAR;
+  }();
+  return l;
+#else
+  return Level::SCALAR;
+#endif
+}
+
+Level level() {
+  return kernels()->level;
+}
+
+Level setLevel(Level l) {
+  if (static_cast<int>(l) > static_cast<int>(detected())) {
+    l = detected();
+  }
+  current().store(kernelsOf(l), std::memory_order_relaxed);
+  return level();
+}
+
+const char* levelName(Level l) {
+  switch (l) {
+    case Level::AVX512:
+      return "avx512";
+    case Level::AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+uint64_t popCount(const void* s, size_t n) {
+  return kernels()->popCount(static_cast<const uint8_t*>(s), n);
+}
+
+size_t skipBytes(const void* s, size_t n, uint8_t val) {
+  return kernels()->skipBytes(static_cast<const uint8_t*>(s), n, val);
+}
+
+void bitAnd(uint8_t* dst, const uint8_t* src, size_t n) {
+  kernels()->bitOp(BitOp::AND, dst, src, n);
+}
+
+void bitOr(uint8_t* dst, const uint8_t* src, size_t n) {
+  kernels()->bitOp(BitOp::OR, dst, src, n);
+}
+
+void bitXor(uint8_t* dst, const uint8_t* src, size_t n) {
+  kernels()->bitOp(BitOp::XOR, dst, src, n);
+}
+
+void bitNot(uint8_t* dst, size_t n) {
+  kernels()->bitOp(BitOp::NOT, dst, nullptr, n);
+}
+
+void maxMerge(uint8_t* max, const uint8_t* regs, size_t n) {
+  kernels()->maxMerge(max, regs, n);
+}
+
+void denseMaxMerge(uint8_t* max, const uint8_t* dense, size_t n) {
+  kernels()->denseMaxMerge(max, dense, n);
+}
+
+void regHisto(const uint8_t* regs, size_t n, uint32_t* histo) {
+  kernels()->regHisto(regs, n, histo);
+}
+
+}  // namespace simd
+}  // namespace tendisplus
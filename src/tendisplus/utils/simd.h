@@ -0,0 +1,59 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#ifndef SRC_TENDISPLUS_UTILS_SIMD_H_
+#define SRC_TENDISPLUS_UTILS_SIMD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tendisplus {
+
+// NOTE: the kernels of BITCOUNT, BITPOS, BITOP and the HyperLogLog
+// registers. Every kernel has a scalar version and, on x86-64, AVX2 and
+// AVX-512BW versions compiled with the target attribute, so the binary
+// still runs on the cpus without them. The best level the cpu supports
+// is chosen on the first call, all the levels give the same results.
+namespace simd {
+
+enum class Level {
+  SCALAR = 0,
+  AVX2 = 1,
+  AVX512 = 2,
+};
+
+// the best level supported by the cpu
+Level detected();
+// the level in use
+Level level();
+// use another level, it is capped by detected(). Return the level in use.
+// It is for the tests and the benchmarks.
+Level setLevel(Level l);
+const char* levelName(Level l);
+
+// the number of bits set in the n bytes of s
+uint64_t popCount(const void* s, size_t n);
+// the number of the leading bytes of s equal to val, n if all are
+size_t skipBytes(const void* s, size_t n, uint8_t val);
+
+// dst[i] = dst[i] op src[i] for i in [0, n)
+void bitAnd(uint8_t* dst, const uint8_t* src, size_t n);
+void bitOr(uint8_t* dst, const uint8_t* src, size_t n);
+void bitXor(uint8_t* dst, const uint8_t* src, size_t n);
+// dst[i] = ~dst[i] for i in [0, n)
+void bitNot(uint8_t* dst, size_t n);
+
+// max[i] = MAX(max[i], regs[i]) for i in [0, n)
+void maxMerge(uint8_t* max, const uint8_t* regs, size_t n);
+// the same with maxMerge(), but the n registers of regs are packed in 6
+// bits each, as the dense HyperLogLog. n must be a multiple of 4.
+void denseMaxMerge(uint8_t* max, const uint8_t* dense, size_t n);
+// histo[v] += the number of the registers equal to v, the values of
+// regs must be less than 64 and histo must have 64 elements
+void regHisto(const uint8_t* regs, size_t n, uint32_t* histo);
+
+}  // namespace simd
+}  // namespace tendisplus
+
+#endif  // SRC_TENDISPLUS_UTILS_SIMD_H_
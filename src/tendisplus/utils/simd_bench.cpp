@@ -0,0 +1,107 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+// microbenchmark of the simd kernels, runs every kernel at every level the
+// cpu supports, usage: simd_bench [bitmap KB] [rounds]
+// BITCOUNT, BITPOS and BITOP work on a bitmap of the given size, PFCOUNT
+// merges 50 dense HyperLogLogs and counts the merged registers
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>  // NOLINT
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/simd.h"
+
+namespace tendisplus {
+namespace simd {
+
+// run fn rounds times, return the ns of a round
+double timeIt(size_t rounds, const std::function<void()>& fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < rounds; i++) {
+    fn();
+  }
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count();
+  return static_cast<double>(ns) / rounds;
+}
+
+void report(const char* name, Level l, double ns, size_t bytes) {
+  std::cout << std::left << std::setw(10) << name << std::setw(8)
+            << levelName(l) << std::right << std::setw(12) << std::fixed
+            << std::setprecision(0) << ns << " ns/op" << std::setw(10)
+            << std::setprecision(2) << bytes / ns << " GB/s" << std::endl;
+}
+
+void runBench(size_t bytes, size_t rounds) {
+  std::vector<uint8_t> a(bytes), b(bytes);
+  for (size_t i = 0; i < bytes; i++) {
+    a[i] = rand();  // NOLINT
+    b[i] = rand();  // NOLINT
+  }
+  // BITPOS 1 of a bitmap with a single bit set at the end
+  std::vector<uint8_t> sparse(bytes, 0);
+  sparse[bytes - 1] = 1;
+
+  const size_t hllNum = 50;
+  const size_t denseSize = HLL_REGISTERS * HLL_BITS / 8;
+  std::vector<uint8_t> denses(hllNum * denseSize);
+  for (auto& v : denses) {
+    v = rand();  // NOLINT
+  }
+  std::vector<uint8_t> raw(HLL_REGISTERS);
+
+  uint64_t sink = 0;
+  for (int i = 0; i <= static_cast<int>(detected()); i++) {
+    Level l = setLevel(static_cast<Level>(i));
+    double ns = timeIt(rounds, [&]() { sink += popCount(a.data(), bytes); });
+    report("bitcount", l, ns, bytes);
+
+    ns = timeIt(rounds, [&]() {
+      sink += redis_port::bitPos(sparse.data(), bytes, 1);
+    });
+    report("bitpos", l, ns, bytes);
+
+    ns = timeIt(rounds, [&]() { bitXor(a.data(), b.data(), bytes); });
+    report("bitop", l, ns, bytes * 2);
+
+    ns = timeIt(rounds, [&]() {
+      memset(raw.data(), 0, raw.size());
+      for (size_t k = 0; k < hllNum; k++) {
+        denseMaxMerge(raw.data(), &denses[k * denseSize], HLL_REGISTERS);
+      }
+      uint32_t histo[64] = {0};
+      regHisto(raw.data(), raw.size(), histo);
+      sink += histo[0];
+    });
+    report("pfcount", l, ns, hllNum * denseSize);
+  }
+  std::cout << "(" << sink << ")" << std::endl;
+}
+
+}  // namespace simd
+}  // namespace tendisplus
+
+int main(int argc, char** argv) {
+  size_t kb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1024;
+  size_t rounds = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1000;
+  if (kb == 0 || rounds == 0) {
+    std::cerr << "usage: " << argv[0] << " [bitmap KB] [rounds]" << std::endl;
+    return 1;
+  }
+
+  std::cout << "bitmap KB:" << kb << " rounds:" << rounds
+            << " detected:" << tendisplus::simd::levelName(
+                 tendisplus::simd::detected())
+            << std::endl;
+  tendisplus::simd::runBench(kb * 1024, rounds);
+  return 0;
+}
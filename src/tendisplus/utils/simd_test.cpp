@@ -0,0 +1,201 @@
+// Copyright (C) 2020 THL A29 Limited, a Tencent company.  All rights reserved.
+// Please refer to the license text that comes with this tendis open source
+// project for additional information.
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "tendisplus/utils/redis_port.h"
+#include "tendisplus/utils/simd.h"
+
+namespace tendisplus {
+
+// all the levels the cpu supports, the scalar one is the first
+std::vector<simd::Level> allLevels() {
+  std::vector<simd::Level> levels;
+  for (int l = 0; l <= static_cast<int>(simd::detected()); l++) {
+    levels.push_back(static_cast<simd::Level>(l));
+  }
+  return levels;
+}
+
+std::string randomBytes(size_t n, uint32_t density) {
+  std::string s(n, 0);
+  for (auto& c : s) {
+    // density percent of the bits are set
+    for (int bit = 0; bit < 8; bit++) {
+      if (static_cast<uint32_t>(rand() % 100) < density) {  // NOLINT
+        c |= 1 << bit;
+      }
+    }
+  }
+  return s;
+}
+
+// the sizes around the widths of the vectors, from an unaligned address
+const std::vector<size_t> kSizes = {0, 1, 7, 8, 31, 32, 33, 63, 64, 65, 1000};
+
+TEST(Simd, PopCount) {
+  for (auto l : allLevels()) {
+    EXPECT_EQ(simd::setLevel(l), l);
+    for (size_t n : kSizes) {
+      for (uint32_t density : {0, 30, 100}) {
+        std::string s = randomBytes(n + 1, density);
+        uint64_t expected = 0;
+        for (size_t i = 1; i < s.size(); i++) {
+          expected += __builtin_popcount(static_cast<uint8_t>(s[i]));
+        }
+        EXPECT_EQ(simd::popCount(s.data() + 1, n), expected)
+          << simd::levelName(l) << " " << n;
+        EXPECT_EQ(redis_port::popCount(s.data() + 1, n), expected);
+      }
+    }
+  }
+  simd::setLevel(simd::detected());
+}
+
+TEST(Simd, SkipBytes) {
+  for (auto l : allLevels()) {
+    simd::setLevel(l);
+    for (size_t n : kSizes) {
+      for (uint8_t val : {0x00, 0xff}) {
+        std::string s(n + 1, static_cast<char>(val));
+        EXPECT_EQ(simd::skipBytes(s.data() + 1, n, val), n);
+        for (size_t pos = 0; pos < n; pos += 5) {
+          s[pos + 1] = 0x10;
+          EXPECT_EQ(simd::skipBytes(s.data() + 1, n, val), pos)
+            << simd::levelName(l);
+          s[pos + 1] = static_cast<char>(val);
+        }
+      }
+    }
+    // bitPos() skips by skipBytes()
+    std::string s(100, 0);
+    s[70] = 0x08;
+    EXPECT_EQ(redis_port::bitPos(s.data(), s.size(), 1), 70 * 8 + 4);
+    EXPECT_EQ(redis_port::bitPos(s.data(), s.size(), 0), 0);
+    s.assign(100, '\xff');
+    EXPECT_EQ(redis_port::bitPos(s.data(), s.size(), 0), 100 * 8);
+    EXPECT_EQ(redis_port::bitPos(s.data(), s.size(), 1), 0);
+  }
+  simd::setLevel(simd::detected());
+}
+
+TEST(Simd, BitOp) {
+  for (auto l : allLevels()) {
+    simd::setLevel(l);
+    for (size_t n : kSizes) {
+      std::string a = randomBytes(n + 1, 50);
+      std::string b = randomBytes(n + 1, 50);
+      std::string andv = a, orv = a, xorv = a, notv = a;
+      auto ptr = [](std::string* s) {
+        return reinterpret_cast<uint8_t*>(&(*s)[1]);
+      };
+      const uint8_t* src = reinterpret_cast<const uint8_t*>(b.data()) + 1;
+      simd::bitAnd(ptr(&andv), src, n);
+      simd::bitOr(ptr(&orv), src, n);
+      simd::bitXor(ptr(&xorv), src, n);
+      simd::bitNot(ptr(&notv), n);
+      EXPECT_EQ(andv[0], a[0]);
+      for (size_t i = 1; i <= n; i++) {
+        EXPECT_EQ(andv[i], a[i] & b[i]) << simd::levelName(l);
+        EXPECT_EQ(orv[i], a[i] | b[i]);
+        EXPECT_EQ(xorv[i], a[i] ^ b[i]);
+        EXPECT_EQ(notv[i], static_cast<char>(~a[i]));
+      }
+    }
+  }
+  simd::setLevel(simd::detected());
+}
+
+TEST(Simd, HllRegisters) {
+  // the macros touch one byte beyond the registers
+  std::vector<uint8_t> packed(HLL_REGISTERS * HLL_BITS / 8 + 1);
+  std::vector<uint8_t> regs(HLL_REGISTERS);
+  for (size_t i = 0; i < HLL_REGISTERS; i++) {
+    uint8_t v = rand() % (HLL_REGISTER_MAX + 1);  // NOLINT
+    HLL_DENSE_SET_REGISTER(packed.data(), i, v);
+  }
+  for (size_t i = 0; i < HLL_REGISTERS; i++) {
+    HLL_DENSE_GET_REGISTER(regs[i], packed.data(), i);
+  }
+  // the kernels never read beyond the registers
+  std::vector<uint8_t> dense(packed.begin(), packed.end() - 1);
+  std::vector<uint8_t> init(HLL_REGISTERS);
+  for (auto& v : init) {
+    v = rand() % (HLL_REGISTER_MAX + 1);  // NOLINT
+  }
+  std::vector<uint8_t> expected(init);
+  for (size_t i = 0; i < HLL_REGISTERS; i++) {
+    expected[i] = std::max(expected[i], regs[i]);
+  }
+  uint32_t expectedHisto[64] = {0};
+  for (auto v : init) {
+    expectedHisto[v]++;
+  }
+
+  for (auto l : allLevels()) {
+    simd::setLevel(l);
+    std::vector<uint8_t> max(init);
+    simd::denseMaxMerge(max.data(), dense.data(), HLL_REGISTERS);
+    EXPECT_EQ(max, expected) << simd::levelName(l);
+
+    max = init;
+    simd::maxMerge(max.data(), regs.data(), HLL_REGISTERS);
+    EXPECT_EQ(max, expected);
+
+    // a part of the registers
+    max = init;
+    simd::denseMaxMerge(max.data(), dense.data(), 100);
+    simd::maxMerge(max.data() + 100, regs.data() + 100, 33);
+    for (size_t i = 0; i < HLL_REGISTERS; i++) {
+      EXPECT_EQ(max[i], i < 133 ? expected[i] : init[i]);
+    }
+
+    uint32_t histo[64] = {0};
+    simd::regHisto(init.data(), init.size(), histo);
+    for (size_t v = 0; v < 64; v++) {
+      EXPECT_EQ(histo[v], expectedHisto[v]);
+    }
+  }
+  simd::setLevel(simd::detected());
+}
+
+TEST(Simd, HllCount) {
+  // PFCOUNT of many keys: merge the dense registers into a raw hll
+  std::vector<std::vector<uint8_t>> denses(10);
+  for (size_t k = 0; k < denses.size(); k++) {
+    denses[k].resize(HLL_REGISTERS * HLL_BITS / 8 + 1);
+    for (size_t i = 0; i < HLL_REGISTERS; i += k + 1) {
+      HLL_DENSE_SET_REGISTER(denses[k].data(), i, rand() % 20);  // NOLINT
+    }
+  }
+  std::vector<uint64_t> counts;
+  for (auto l : allLevels()) {
+    simd::setLevel(l);
+    std::vector<char> buf(HLL_HDR_SIZE + HLL_REGISTERS, 0);
+    auto raw = reinterpret_cast<redis_port::hllhdr*>(buf.data());
+    raw->encoding = HLL_RAW;
+    std::vector<char> dbuf(HLL_DENSE_SIZE + 1, 0);
+    auto dense = reinterpret_cast<redis_port::hllhdr*>(dbuf.data());
+    dense->encoding = HLL_DENSE;
+    for (auto& d : denses) {
+      memcpy(dense->registers, d.data(), d.size() - 1);
+      EXPECT_EQ(redis_port::hllMerge(raw->registers, dense, HLL_DENSE_SIZE),
+                C_OK);
+    }
+    int invalid = 0;
+    counts.push_back(
+      redis_port::hllCount(raw, HLL_HDR_SIZE + HLL_REGISTERS, &invalid));
+    EXPECT_EQ(invalid, 0);
+  }
+  for (auto count : counts) {
+    EXPECT_EQ(count, counts.front());
+  }
+  simd::setLevel(simd::detected());
+}
+
+}  // namespace tendisplus
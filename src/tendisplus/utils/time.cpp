@@ -9,6 +9,8 @@
 #ifdef _WIN32
 #include <time.h>
 #include <unistd.h>
+#else
+#include <sys/resource.h>
 #endif  // !
 
 
@@ -37,6 +39,19 @@ uint64_t msSinceEpoch() {
     .count();
 }
 
+uint64_t cpuTimeUs() {
+#ifndef _WIN32
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0) {
+    return 0;
+  }
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL +
+    ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#else
+  return 0;
+#endif  // !_WIN32
+}
+
 std::string timePointRepr(const SCLOCK::time_point& tp) {
   std::stringstream ss;
   using SYSCLOCK = std::chrono::system_clock;
@@ -13,6 +13,8 @@ namespace tendisplus {
 uint64_t nsSinceEpoch();
 uint64_t msSinceEpoch();
 uint32_t sinceEpoch();
+// user and system cpu time consumed by this process
+uint64_t cpuTimeUs();
 
 using SCLOCK = std::chrono::steady_clock;
 std::string timePointRepr(const SCLOCK::time_point&);